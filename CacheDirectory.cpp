@@ -0,0 +1,195 @@
+#include "CacheDirectory.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	uint64_t Finalize(uint64_t hash)
+	{
+		hash ^= hash >> 33;
+		hash *= 0xFF51AFD7ED558CCDull;
+		hash ^= hash >> 33;
+		return hash;
+	}
+
+	uint64_t ComputeChecksum(const void* data, uint64_t size)
+	{
+		CacheKeyHasher hasher;
+		hasher.AddField(data, size);
+		return hasher.Get().low;
+	}
+
+	bool CreateDirectoryIfMissing(const std::string& directory)
+	{
+#ifdef _WIN32
+		return _mkdir(directory.c_str()) == 0 || errno == EEXIST;
+#else
+		return mkdir(directory.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+	}
+}
+
+std::string CacheKey::ToString() const
+{
+	char text[33];
+	snprintf(text, sizeof(text), "%016llx%016llx", static_cast<unsigned long long>(high),
+		static_cast<unsigned long long>(low));
+	return text;
+}
+
+void CacheKeyHasher::AddField(const void* data, uint64_t size)
+{
+	AddWord(size);
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (; size >= sizeof(uint64_t); bytes += sizeof(uint64_t), size -= sizeof(uint64_t))
+	{
+		uint64_t word;
+		memcpy(&word, bytes, sizeof(word));
+		AddWord(word);
+	}
+	if (size > 0)
+	{
+		uint64_t word = 0;
+		memcpy(&word, bytes, static_cast<size_t>(size));
+		AddWord(word);
+	}
+}
+
+CacheKey CacheKeyHasher::Get() const
+{
+	CacheKey key;
+	key.high = Finalize(m_high);
+	key.low = Finalize(m_low);
+	return key;
+}
+
+void CacheKeyHasher::AddWord(uint64_t word)
+{
+	m_high = (m_high ^ word) * 0x9E3779B97F4A7C15ull;
+	m_high ^= m_high >> 29;
+	m_low = (m_low ^ word) * 0xC2B2AE3D27D4EB4Full;
+	m_low ^= m_low >> 31;
+}
+
+CacheDirectory::CacheDirectory(const std::string& directory, const std::string& extension, uint32_t magic,
+	uint32_t version)
+	: m_directory(directory), m_extension(extension), m_magic(magic), m_version(version)
+{
+	if (!m_directory.empty())
+	{
+		CreateDirectoryIfMissing(m_directory);
+		if (m_directory.back() != '/' && m_directory.back() != '\\')
+		{
+			m_directory += '/';
+		}
+	}
+}
+
+std::string CacheDirectory::GetEntryFileName(const CacheKey& key) const
+{
+	return m_directory + key.ToString() + m_extension;
+}
+
+std::unique_ptr<MappedFile> CacheDirectory::Load(const CacheKey& key, bool& invalid) const
+{
+	invalid = false;
+	if (!IsEnabled())
+	{
+		return nullptr;
+	}
+	std::string fileName = GetEntryFileName(key);
+	FileStamp stamp;
+	if (!MappedFile::GetStamp(fileName, stamp))
+	{
+		return nullptr;
+	}
+
+	std::unique_ptr<MappedFile> file;
+	try
+	{
+		file.reset(new MappedFile(fileName));
+	}
+	catch (const std::runtime_error&)
+	{
+		invalid = true;
+		return nullptr;
+	}
+
+	CacheEntryHeader header;
+	bool valid = file->GetSize() >= sizeof(header) && file->GetData() != nullptr;
+	if (valid)
+	{
+		memcpy(&header, file->GetData(), sizeof(header));
+		valid = header.magic == m_magic && header.version == m_version &&
+			header.keyHigh == key.high && header.keyLow == key.low &&
+			header.dataSize == file->GetSize() - sizeof(header) &&
+			header.dataChecksum == ComputeChecksum(file->GetData() + sizeof(header), header.dataSize);
+	}
+	if (!valid)
+	{
+		invalid = true;
+		return nullptr;
+	}
+	return file;
+}
+
+bool CacheDirectory::Write(const CacheKey& key, const void* data, uint64_t size) const
+{
+	if (!IsEnabled())
+	{
+		return false;
+	}
+
+	CacheEntryHeader header = {};
+	header.magic = m_magic;
+	header.version = m_version;
+	header.keyHigh = key.high;
+	header.keyLow = key.low;
+	header.dataSize = size;
+	header.dataChecksum = ComputeChecksum(data, size);
+
+	std::string fileName = GetEntryFileName(key);
+	// The temporary name is unique to the write, as other threads or processes may write the same
+	// entry at the same time
+	static std::atomic<uint32_t> writeCount(0);
+	static const uint32_t processTag = std::random_device()();
+	std::string temporaryFileName = fileName + "." + std::to_string(processTag) + "." +
+		std::to_string(writeCount++) + ".tmp";
+	{
+		std::ofstream file(temporaryFileName, std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+		if (!file)
+		{
+			file.close();
+			std::remove(temporaryFileName.c_str());
+			return false;
+		}
+	}
+
+	// rename does not replace existing files on Windows. The entry being replaced is corrupted,
+	// or identical if another process wrote it in the meantime
+	std::remove(fileName.c_str());
+	if (std::rename(temporaryFileName.c_str(), fileName.c_str()) != 0)
+	{
+		std::remove(temporaryFileName.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+// #DXR Custom: Pipeline Cache
+// Directory of content-addressed cache entries, shared by the shader cache and the pipeline
+// cache. Each entry is a file named after its 128-bit key:
+//   <cache directory>/<key in hex><extension>
+// holding a CacheEntryHeader followed by the data, in native (little-endian) byte order. The
+// header identifies the kind of cache and the version of its format, repeats the key and holds a
+// checksum of the data, all verified on load. Entries are written to a temporary file renamed once
+// complete, so that an interrupted write is never loaded, and can be written by several threads
+// or processes at once.
+
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct CacheEntryHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t keyHigh;
+	uint64_t keyLow;
+	uint64_t dataSize;
+	uint64_t dataChecksum;
+	uint64_t reserved;						// Keeps the data 16-byte aligned
+};
+
+struct CacheKey
+{
+	uint64_t high = 0;
+	uint64_t low = 0;
+
+	bool operator==(const CacheKey& other) const { return high == other.high && low == other.low; }
+	bool operator!=(const CacheKey& other) const { return !(*this == other); }
+	bool operator<(const CacheKey& other) const { return high != other.high ? high < other.high : low < other.low; }
+	/// 32 hexadecimal digits
+	std::string ToString() const;
+};
+
+/// Two independent 64-bit hashes of the data, processed as 64-bit words. The fields are prefixed
+/// with their size, so that moving bytes from one field to the next changes the key
+class CacheKeyHasher
+{
+public:
+	void AddField(const void* data, uint64_t size);
+	void AddString(const std::string& value) { AddField(value.data(), value.size()); }
+
+	CacheKey Get() const;
+
+private:
+	void AddWord(uint64_t word);
+
+	uint64_t m_high = 0xCBF29CE484222325ull;
+	uint64_t m_low = 0x84222325CBF29CE4ull;
+};
+
+class CacheDirectory
+{
+public:
+	/// <summary>
+	/// Entries of the given kind in a directory, created if missing. An empty directory disables
+	/// the cache: no entry is found, and writes fail
+	/// </summary>
+	CacheDirectory(const std::string& directory, const std::string& extension, uint32_t magic, uint32_t version);
+
+	bool IsEnabled() const { return !m_directory.empty(); }
+	std::string GetEntryFileName(const CacheKey& key) const;
+
+	/// <summary>
+	/// Map and verify an entry, returning nullptr if it is missing or invalid. invalid is set if
+	/// the entry exists but cannot be loaded. The data starts at kDataOffset in the mapping
+	/// </summary>
+	std::unique_ptr<MappedFile> Load(const CacheKey& key, bool& invalid) const;
+	/// <summary>
+	/// Write an entry, replacing any existing one. Returns false on failure
+	/// </summary>
+	bool Write(const CacheKey& key, const void* data, uint64_t size) const;
+
+	static const uint64_t kDataOffset = sizeof(CacheEntryHeader);
+
+private:
+	std::string m_directory;				// With a trailing separator, empty if disabled
+	std::string m_extension;
+	uint32_t m_magic;
+	uint32_t m_version;
+};
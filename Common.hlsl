@@ -74,6 +74,12 @@ static const float MIN_SECONDARY_RAY_T_MAX_VALUE = 0.01f;
 
 #define DEFAULT_RAY_FLAG RAY_FLAG_CULL_FRONT_FACING_TRIANGLES
 
+// #DXR Custom: Instance Culling
+// Inclusion mask of the camera rays, only set on the instances in the view frustum (see
+// kInstanceMaskCamera in D3D12HelloTriangle.h). The other rays include all the instances
+#define INSTANCE_MASK_CAMERA 0x01
+#define INSTANCE_MASK_ALL 0xFF
+
 float2 DirectionToSpherical(float3 dir)
 {
     float theta = acos(dir.y) / (PI);
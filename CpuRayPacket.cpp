@@ -0,0 +1,174 @@
+#include "CpuRayPacket.h"
+#include "CpuRayPacketKernel.h"
+
+#if CPU_TRAVERSAL_X64
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+#endif
+
+namespace
+{
+	// One ray at a time, for CPUs without a SIMD kernel
+	struct ScalarLanes
+	{
+		static const uint32_t WIDTH = 1;
+		typedef float Float;
+		typedef bool Mask;
+
+		static Float Set(float v) { return v; }
+		static Float Load(const float* p) { return *p; }
+		static void Store(float* p, Float v) { *p = v; }
+		static Float Add(Float a, Float b) { return a + b; }
+		static Float Sub(Float a, Float b) { return a - b; }
+		static Float Mul(Float a, Float b) { return a * b; }
+		static Float Div(Float a, Float b) { return a / b; }
+		static Float Min(Float a, Float b) { return (b < a) ? b : a; }
+		static Float Max(Float a, Float b) { return (a < b) ? b : a; }
+		static Mask LessEqual(Float a, Float b) { return a <= b; }
+		static Mask GreaterEqual(Float a, Float b) { return a >= b; }
+		static Mask NotLess(Float a, Float b) { return !(a < b); }
+		static Mask NotGreater(Float a, Float b) { return !(a > b); }
+		static Mask And(Mask a, Mask b) { return a && b; }
+		static Float Select(Mask m, Float a, Float b) { return m ? a : b; }
+		static uint32_t MoveMask(Mask m) { return m ? 1u : 0u; }
+		static Mask MaskFromBits(uint32_t bits) { return (bits & 1u) != 0; }
+	};
+
+#if CPU_TRAVERSAL_X64
+	// SSE2 is part of x64, the packet is processed as 2 groups of 4 rays
+	struct SSELanes
+	{
+		static const uint32_t WIDTH = 4;
+		typedef __m128 Float;
+		typedef __m128 Mask;
+
+		static Float Set(float v) { return _mm_set1_ps(v); }
+		static Float Load(const float* p) { return _mm_load_ps(p); }
+		static void Store(float* p, Float v) { _mm_store_ps(p, v); }
+		static Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+		static Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+		static Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+		static Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+		// minps returns its second operand unless the first one is smaller
+		static Float Min(Float a, Float b) { return _mm_min_ps(b, a); }
+		static Float Max(Float a, Float b) { return _mm_max_ps(b, a); }
+		static Mask LessEqual(Float a, Float b) { return _mm_cmple_ps(a, b); }
+		static Mask GreaterEqual(Float a, Float b) { return _mm_cmpge_ps(a, b); }
+		static Mask NotLess(Float a, Float b) { return _mm_cmpnlt_ps(a, b); }
+		static Mask NotGreater(Float a, Float b) { return _mm_cmpngt_ps(a, b); }
+		static Mask And(Mask a, Mask b) { return _mm_and_ps(a, b); }
+		static Float Select(Mask m, Float a, Float b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+		static uint32_t MoveMask(Mask m) { return static_cast<uint32_t>(_mm_movemask_ps(m)); }
+		static Mask MaskFromBits(uint32_t bits)
+		{
+			const __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+			__m128i selected = _mm_and_si128(_mm_set1_epi32(static_cast<int>(bits)), laneBits);
+			return _mm_castsi128_ps(_mm_cmpeq_epi32(selected, laneBits));
+		}
+	};
+#endif
+
+#if CPU_TRAVERSAL_X64
+	// AVX2 requires both CPU support and the OS saving the YMM registers on context switches
+	bool IsAVX2Supported()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}
+#endif
+}
+
+namespace CpuTraversal
+{
+	uint32_t TracePacketScalar(const PacketGeometry& geometry, RayPacket& packet, uint32_t activeMask, bool anyHit)
+	{
+		PacketKernel<ScalarLanes> kernel;
+		return kernel.Trace(geometry, packet, activeMask, anyHit);
+	}
+
+#if CPU_TRAVERSAL_X64
+	uint32_t TracePacketSSE(const PacketGeometry& geometry, RayPacket& packet, uint32_t activeMask, bool anyHit)
+	{
+		PacketKernel<SSELanes> kernel;
+		return kernel.Trace(geometry, packet, activeMask, anyHit);
+	}
+#endif
+
+	/// <summary>
+	/// Most capable kernel supported by the CPU and the operating system
+	/// </summary>
+	Kernel DetectKernel()
+	{
+#if CPU_TRAVERSAL_X64
+		static const Kernel detected = IsAVX2Supported() ? Kernel::AVX2 : Kernel::SSE;
+		return detected;
+#else
+		return Kernel::Scalar;
+#endif
+	}
+
+	/// <summary>
+	/// Kernel actually used for a requested one: Auto selects the detected kernel, and kernels
+	/// which the CPU does not support fall back to the detected one
+	/// </summary>
+	Kernel ResolveKernel(Kernel requested)
+	{
+		const Kernel detected = DetectKernel();
+		if (requested == Kernel::Auto || static_cast<int>(requested) > static_cast<int>(detected))
+			return detected;
+		return requested;
+	}
+
+	/// <summary>
+	/// Entry point of a resolved kernel
+	/// </summary>
+	TracePacketFunction GetTracePacketFunction(Kernel kernel)
+	{
+		switch (ResolveKernel(kernel))
+		{
+#if CPU_TRAVERSAL_X64
+		case Kernel::AVX2:
+			return TracePacketAVX2;
+		case Kernel::SSE:
+			return TracePacketSSE;
+#endif
+		default:
+			return TracePacketScalar;
+		}
+	}
+
+	const char* GetKernelName(Kernel kernel)
+	{
+		switch (kernel)
+		{
+		case Kernel::Auto:
+			return "Auto";
+		case Kernel::Scalar:
+			return "Scalar";
+		case Kernel::SSE:
+			return "SSE";
+		case Kernel::AVX2:
+			return "AVX2";
+		}
+		return "Unknown";
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+// #DXR Custom: CPU Ray Packets
+// Packet traversal kernels used by the CpuRaytracer. The 4 sub-pixel samples of RayGen.hlsl, and
+// the reflection and shadow rays they spawn, are mostly coherent: tracing them together through
+// the BVH amortizes the node fetches and lets the box and triangle tests run on SIMD lanes.
+//
+// A packet holds PACKET_SIZE rays in structure-of-arrays layout. The same kernel is compiled for
+// several instruction sets (8 lanes with AVX2, 2 x 4 lanes with SSE, and a scalar loop for other
+// CPUs), and the best one supported by the running CPU is selected at runtime.
+//
+// The kernels only see raw pointers to the BVH and mesh data, so that the AVX2 version can be
+// compiled in its own translation unit without leaking AVX2 code into shared inline functions.
+
+#include "nv_helpers_dx12/BottomLevelBVHBuilder.h"
+
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CPU_TRAVERSAL_X64 1
+#endif
+
+namespace CpuTraversal
+{
+	// The near-first traversal never holds more than depth + 1 nodes on its stack
+	static const uint32_t MAX_BVH_DEPTH = 127;
+
+	// Number of rays in a packet: 2 pixels of 4 sub-pixel samples
+	static const uint32_t PACKET_SIZE = 8;
+
+	/// Instruction set used by the packet kernel
+	enum class Kernel
+	{
+		Auto,		// Best kernel supported by the CPU
+		Scalar,
+		SSE,
+		AVX2
+	};
+
+	/// Object-space rays, one per lane. Lanes which are not set in the active mask are ignored
+	struct RayPacket
+	{
+		alignas(32) float originX[PACKET_SIZE];
+		alignas(32) float originY[PACKET_SIZE];
+		alignas(32) float originZ[PACKET_SIZE];
+		alignas(32) float directionX[PACKET_SIZE];
+		alignas(32) float directionY[PACKET_SIZE];
+		alignas(32) float directionZ[PACKET_SIZE];
+		alignas(32) float tMin[PACKET_SIZE];
+		alignas(32) float tMax[PACKET_SIZE];	// Closest intersection on output
+		uint32_t primitiveIndex[PACKET_SIZE];	// Triangle hit by each ray, on output
+	};
+
+	/// BVH and mesh data traversed by the kernels, see BottomLevelBVH and CpuMesh
+	struct PacketGeometry
+	{
+		const nv_helpers_dx12::BVHNode* nodes = nullptr;
+		const uint32_t* primitiveIndices = nullptr;
+		const uint8_t* vertexData = nullptr;
+		uint32_t vertexStrideInBytes = 0;
+		const uint32_t* indexData = nullptr;
+	};
+
+	/// Closest or any hit of the active rays of a packet against a mesh, culling front-facing
+	/// triangles. Returns the mask of the rays which found an intersection, for which tMax and
+	/// primitiveIndex are updated
+	typedef uint32_t (*TracePacketFunction)(const PacketGeometry& geometry, RayPacket& packet,
+		uint32_t activeMask, bool anyHit);
+
+	uint32_t TracePacketScalar(const PacketGeometry& geometry, RayPacket& packet, uint32_t activeMask, bool anyHit);
+#if CPU_TRAVERSAL_X64
+	uint32_t TracePacketSSE(const PacketGeometry& geometry, RayPacket& packet, uint32_t activeMask, bool anyHit);
+	uint32_t TracePacketAVX2(const PacketGeometry& geometry, RayPacket& packet, uint32_t activeMask, bool anyHit);
+#endif
+
+	/// <summary>
+	/// Most capable kernel supported by the CPU and the operating system
+	/// </summary>
+	Kernel DetectKernel();
+
+	/// <summary>
+	/// Kernel actually used for a requested one: Auto selects the detected kernel, and kernels
+	/// which the CPU does not support fall back to the detected one
+	/// </summary>
+	Kernel ResolveKernel(Kernel requested);
+
+	/// <summary>
+	/// Entry point of a resolved kernel
+	/// </summary>
+	TracePacketFunction GetTracePacketFunction(Kernel kernel);
+
+	const char* GetKernelName(Kernel kernel);
+}
@@ -0,0 +1,75 @@
+// #DXR Custom: CPU Ray Packets
+// AVX2 version of the packet kernel, tracing the 8 rays of a packet with a single vector. It is
+// only called when DetectKernel reports AVX2 support.
+//
+// MSVC accepts AVX intrinsics without /arch:AVX2, so this file is built with the same options as
+// the rest of the project. GCC and Clang need the target to be enabled, which is done for the
+// kernel only: the standard library and the shared headers are included before, so that none of
+// their inline functions get compiled with AVX instructions.
+
+#include "CpuRayPacket.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+
+#if CPU_TRAVERSAL_X64
+
+#include <immintrin.h>
+
+#if defined(__GNUC__) && !defined(__AVX2__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define CPU_TRAVERSAL_AVX2_TARGET 1
+#endif
+
+#include "CpuRayPacketKernel.h"
+
+namespace
+{
+	struct AVX2Lanes
+	{
+		static const uint32_t WIDTH = 8;
+		typedef __m256 Float;
+		typedef __m256 Mask;
+
+		static Float Set(float v) { return _mm256_set1_ps(v); }
+		static Float Load(const float* p) { return _mm256_load_ps(p); }
+		static void Store(float* p, Float v) { _mm256_store_ps(p, v); }
+		static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+		static Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+		static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+		static Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+		// vminps returns its second operand unless the first one is smaller
+		static Float Min(Float a, Float b) { return _mm256_min_ps(b, a); }
+		static Float Max(Float a, Float b) { return _mm256_max_ps(b, a); }
+		static Mask LessEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+		static Mask GreaterEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+		static Mask NotLess(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_NLT_UQ); }
+		static Mask NotGreater(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_NGT_UQ); }
+		static Mask And(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+		static Float Select(Mask m, Float a, Float b) { return _mm256_blendv_ps(b, a, m); }
+		static uint32_t MoveMask(Mask m) { return static_cast<uint32_t>(_mm256_movemask_ps(m)); }
+		static Mask MaskFromBits(uint32_t bits)
+		{
+			const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+			__m256i selected = _mm256_and_si256(_mm256_set1_epi32(static_cast<int>(bits)), laneBits);
+			return _mm256_castsi256_ps(_mm256_cmpeq_epi32(selected, laneBits));
+		}
+	};
+}
+
+namespace CpuTraversal
+{
+	uint32_t TracePacketAVX2(const PacketGeometry& geometry, RayPacket& packet, uint32_t activeMask, bool anyHit)
+	{
+		PacketKernel<AVX2Lanes> kernel;
+		return kernel.Trace(geometry, packet, activeMask, anyHit);
+	}
+}
+
+#if CPU_TRAVERSAL_AVX2_TARGET
+#pragma GCC pop_options
+#endif
+
+#endif
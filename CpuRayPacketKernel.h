@@ -0,0 +1,251 @@
+#pragma once
+
+// #DXR Custom: CPU Ray Packets
+// Packet traversal kernel shared by the instruction set specific translation units. It is written
+// against a small SIMD interface (Lanes), each translation unit providing its own implementation:
+//
+//   WIDTH                   number of rays processed by one vector
+//   Float, Mask             vector of floats and result of the comparisons
+//   Set, Load, Store        broadcast, aligned load and store
+//   Add, Sub, Mul, Div      arithmetic
+//   Min, Max                same semantics as std::min / std::max, so that the results match the
+//                           scalar traversal of the CpuRaytracer, NaNs included
+//   LessEqual, GreaterEqual ordered comparisons
+//   NotLess, NotGreater     unordered comparisons, !(a < b) and !(a > b)
+//   And, Select, MoveMask   mask operations, MoveMask returning one bit per lane
+//   MaskFromBits            mask enabling the lanes whose bit is set
+//
+// Everything is declared in an anonymous namespace: each translation unit gets its own copy, built
+// with its own code generation options.
+
+#include "CpuRayPacket.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+	template <class Lanes>
+	struct PacketKernel
+	{
+		typedef typename Lanes::Float Float;
+		typedef typename Lanes::Mask Mask;
+
+		static const uint32_t WIDTH = Lanes::WIDTH;
+		static const uint32_t GROUPS = CpuTraversal::PACKET_SIZE / WIDTH;
+		static const uint32_t GROUP_BITS = (1u << WIDTH) - 1;
+
+		Float originX[GROUPS], originY[GROUPS], originZ[GROUPS];
+		Float directionX[GROUPS], directionY[GROUPS], directionZ[GROUPS];
+		Float invDirectionX[GROUPS], invDirectionY[GROUPS], invDirectionZ[GROUPS];
+		Float tMin[GROUPS], tMax[GROUPS];
+
+		// Slab test of all the live rays against a node. Returns the mask of the rays entering the
+		// box, and the smallest entry distance among them
+		uint32_t IntersectBox(const nv_helpers_dx12::BVHNode& node, uint32_t live, float& nearestEntry) const
+		{
+			const Float boxMinX = Lanes::Set(node.boundsMin[0]);
+			const Float boxMinY = Lanes::Set(node.boundsMin[1]);
+			const Float boxMinZ = Lanes::Set(node.boundsMin[2]);
+			const Float boxMaxX = Lanes::Set(node.boundsMax[0]);
+			const Float boxMaxY = Lanes::Set(node.boundsMax[1]);
+			const Float boxMaxZ = Lanes::Set(node.boundsMax[2]);
+
+			alignas(32) float entries[CpuTraversal::PACKET_SIZE];
+			uint32_t result = 0;
+			for (uint32_t g = 0; g < GROUPS; g++)
+			{
+				if (((live >> (g * WIDTH)) & GROUP_BITS) == 0)
+					continue;
+
+				Float t0x = Lanes::Mul(Lanes::Sub(boxMinX, originX[g]), invDirectionX[g]);
+				Float t0y = Lanes::Mul(Lanes::Sub(boxMinY, originY[g]), invDirectionY[g]);
+				Float t0z = Lanes::Mul(Lanes::Sub(boxMinZ, originZ[g]), invDirectionZ[g]);
+				Float t1x = Lanes::Mul(Lanes::Sub(boxMaxX, originX[g]), invDirectionX[g]);
+				Float t1y = Lanes::Mul(Lanes::Sub(boxMaxY, originY[g]), invDirectionY[g]);
+				Float t1z = Lanes::Mul(Lanes::Sub(boxMaxZ, originZ[g]), invDirectionZ[g]);
+
+				// glm::min(t0, t1) returns t0 unless t1 < t0, which is std::min(t0, t1)
+				Float enter = Lanes::Max(Lanes::Max(Lanes::Min(t0x, t1x), Lanes::Min(t0y, t1y)),
+					Lanes::Max(Lanes::Min(t0z, t1z), tMin[g]));
+				Float exit = Lanes::Min(Lanes::Min(Lanes::Max(t0x, t1x), Lanes::Max(t0y, t1y)),
+					Lanes::Min(Lanes::Max(t0z, t1z), tMax[g]));
+
+				Lanes::Store(entries + g * WIDTH, enter);
+				result |= Lanes::MoveMask(Lanes::LessEqual(enter, exit)) << (g * WIDTH);
+			}
+			result &= live;
+
+			for (uint32_t lane = 0; lane < CpuTraversal::PACKET_SIZE; lane++)
+			{
+				if ((result & (1u << lane)) != 0 && entries[lane] < nearestEntry)
+					nearestEntry = entries[lane];
+			}
+			return result;
+		}
+
+		// Moller-Trumbore test of all the live rays against a triangle, rejecting front faces as
+		// RAY_FLAG_CULL_FRONT_FACING_TRIANGLES does. Hits shrink tMax and are returned as a mask
+		uint32_t IntersectTriangle(const float* v0, const float* v1, const float* v2, uint32_t live,
+			uint32_t primitiveIndex, uint32_t* primitiveIndices)
+		{
+			const Float e1x = Lanes::Set(v1[0] - v0[0]);
+			const Float e1y = Lanes::Set(v1[1] - v0[1]);
+			const Float e1z = Lanes::Set(v1[2] - v0[2]);
+			const Float e2x = Lanes::Set(v2[0] - v0[0]);
+			const Float e2y = Lanes::Set(v2[1] - v0[1]);
+			const Float e2z = Lanes::Set(v2[2] - v0[2]);
+			const Float v0x = Lanes::Set(v0[0]);
+			const Float v0y = Lanes::Set(v0[1]);
+			const Float v0z = Lanes::Set(v0[2]);
+			const Float zero = Lanes::Set(0.0f);
+			const Float one = Lanes::Set(1.0f);
+
+			uint32_t result = 0;
+			for (uint32_t g = 0; g < GROUPS; g++)
+			{
+				const uint32_t groupLive = (live >> (g * WIDTH)) & GROUP_BITS;
+				if (groupLive == 0)
+					continue;
+
+				// p = cross(direction, e2)
+				Float px = Lanes::Sub(Lanes::Mul(directionY[g], e2z), Lanes::Mul(e2y, directionZ[g]));
+				Float py = Lanes::Sub(Lanes::Mul(directionZ[g], e2x), Lanes::Mul(e2z, directionX[g]));
+				Float pz = Lanes::Sub(Lanes::Mul(directionX[g], e2y), Lanes::Mul(e2x, directionY[g]));
+				Float det = Dot(e1x, e1y, e1z, px, py, pz);
+				Mask valid = Lanes::NotGreater(det, Lanes::Set(-1e-12f));
+
+				Float invDet = Lanes::Div(one, det);
+				Float sx = Lanes::Sub(originX[g], v0x);
+				Float sy = Lanes::Sub(originY[g], v0y);
+				Float sz = Lanes::Sub(originZ[g], v0z);
+				Float u = Lanes::Mul(Dot(sx, sy, sz, px, py, pz), invDet);
+				valid = Lanes::And(valid, Lanes::And(Lanes::NotLess(u, zero), Lanes::NotGreater(u, one)));
+
+				// q = cross(s, e1)
+				Float qx = Lanes::Sub(Lanes::Mul(sy, e1z), Lanes::Mul(e1y, sz));
+				Float qy = Lanes::Sub(Lanes::Mul(sz, e1x), Lanes::Mul(e1z, sx));
+				Float qz = Lanes::Sub(Lanes::Mul(sx, e1y), Lanes::Mul(e1x, sy));
+				Float v = Lanes::Mul(Dot(directionX[g], directionY[g], directionZ[g], qx, qy, qz), invDet);
+				valid = Lanes::And(valid, Lanes::And(Lanes::NotLess(v, zero), Lanes::NotGreater(Lanes::Add(u, v), one)));
+
+				Float t = Lanes::Mul(Dot(e2x, e2y, e2z, qx, qy, qz), invDet);
+				valid = Lanes::And(valid, Lanes::And(Lanes::GreaterEqual(t, tMin[g]), Lanes::LessEqual(t, tMax[g])));
+
+				const uint32_t hits = Lanes::MoveMask(valid) & groupLive;
+				if (hits == 0)
+					continue;
+
+				tMax[g] = Lanes::Select(Lanes::MaskFromBits(hits), t, tMax[g]);
+				for (uint32_t lane = 0; lane < WIDTH; lane++)
+				{
+					if ((hits & (1u << lane)) != 0)
+						primitiveIndices[g * WIDTH + lane] = primitiveIndex;
+				}
+				result |= hits << (g * WIDTH);
+			}
+			return result;
+		}
+
+		// glm::dot evaluation order
+		static Float Dot(const Float& ax, const Float& ay, const Float& az, const Float& bx, const Float& by, const Float& bz)
+		{
+			return Lanes::Add(Lanes::Add(Lanes::Mul(ax, bx), Lanes::Mul(ay, by)), Lanes::Mul(az, bz));
+		}
+
+		static const float* FetchPosition(const CpuTraversal::PacketGeometry& geometry, uint32_t index)
+		{
+			return reinterpret_cast<const float*>(geometry.vertexData + static_cast<size_t>(index) * geometry.vertexStrideInBytes);
+		}
+
+		// Stack-based traversal shared by all the rays of the packet: a node is visited as long as
+		// one live ray enters it, and the child entered first by the packet is visited first
+		uint32_t Trace(const CpuTraversal::PacketGeometry& geometry, CpuTraversal::RayPacket& packet,
+			uint32_t activeMask, bool anyHit)
+		{
+			const Float one = Lanes::Set(1.0f);
+			for (uint32_t g = 0; g < GROUPS; g++)
+			{
+				originX[g] = Lanes::Load(packet.originX + g * WIDTH);
+				originY[g] = Lanes::Load(packet.originY + g * WIDTH);
+				originZ[g] = Lanes::Load(packet.originZ + g * WIDTH);
+				directionX[g] = Lanes::Load(packet.directionX + g * WIDTH);
+				directionY[g] = Lanes::Load(packet.directionY + g * WIDTH);
+				directionZ[g] = Lanes::Load(packet.directionZ + g * WIDTH);
+				invDirectionX[g] = Lanes::Div(one, directionX[g]);
+				invDirectionY[g] = Lanes::Div(one, directionY[g]);
+				invDirectionZ[g] = Lanes::Div(one, directionZ[g]);
+				tMin[g] = Lanes::Load(packet.tMin + g * WIDTH);
+				tMax[g] = Lanes::Load(packet.tMax + g * WIDTH);
+			}
+
+			const nv_helpers_dx12::BVHNode* nodes = geometry.nodes;
+			uint32_t live = activeMask;
+			uint32_t found = 0;
+
+			uint32_t stack[CpuTraversal::MAX_BVH_DEPTH + 1];
+			uint32_t stackSize = 0;
+
+			float rootEntry = Infinity();
+			if (IntersectBox(nodes[0], live, rootEntry) == 0)
+				return 0;
+			stack[stackSize++] = 0;
+
+			while (stackSize > 0 && live != 0)
+			{
+				const nv_helpers_dx12::BVHNode& node = nodes[stack[--stackSize]];
+
+				if (node.IsLeaf())
+				{
+					for (uint32_t p = 0; p < node.primitiveCount && live != 0; p++)
+					{
+						uint32_t tri = geometry.primitiveIndices[node.leftFirst + p];
+						const uint32_t* indices = geometry.indexData + 3 * tri;
+						uint32_t hits = IntersectTriangle(FetchPosition(geometry, indices[0]),
+							FetchPosition(geometry, indices[1]), FetchPosition(geometry, indices[2]), live, tri,
+							packet.primitiveIndex);
+						found |= hits;
+
+						// Shadow rays are done as soon as they are occluded
+						if (anyHit)
+							live &= ~hits;
+					}
+					continue;
+				}
+
+				uint32_t nearChild = node.leftFirst;
+				uint32_t farChild = node.leftFirst + 1;
+				float nearEntry = Infinity();
+				float farEntry = Infinity();
+				uint32_t hitNear = IntersectBox(nodes[nearChild], live, nearEntry);
+				uint32_t hitFar = IntersectBox(nodes[farChild], live, farEntry);
+
+				// Push the farthest child first so that the nearest one is popped next
+				if (hitNear != 0 && hitFar != 0)
+				{
+					if (farEntry < nearEntry)
+						std::swap(nearChild, farChild);
+					stack[stackSize++] = farChild;
+					stack[stackSize++] = nearChild;
+				}
+				else if (hitNear != 0)
+				{
+					stack[stackSize++] = nearChild;
+				}
+				else if (hitFar != 0)
+				{
+					stack[stackSize++] = farChild;
+				}
+			}
+
+			for (uint32_t g = 0; g < GROUPS; g++)
+				Lanes::Store(packet.tMax + g * WIDTH, tMax[g]);
+			return found;
+		}
+
+		static float Infinity()
+		{
+			return std::numeric_limits<float>::infinity();
+		}
+	};
+}
@@ -0,0 +1,919 @@
+#include "CpuRaytracer.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+using namespace CpuShading;
+
+namespace
+{
+	// HLSL saturate()
+	inline float Saturate(float v)
+	{
+		return std::min(std::max(v, 0.0f), 1.0f);
+	}
+
+	inline glm::vec3 Saturate(const glm::vec3& v)
+	{
+		return glm::clamp(v, glm::vec3(0.0f), glm::vec3(1.0f));
+	}
+
+	// HLSL reflect()
+	inline glm::vec3 Reflect(const glm::vec3& i, const glm::vec3& n)
+	{
+		return i - 2.0f * glm::dot(n, i) * n;
+	}
+
+	inline float SecondaryRayTMin(float minTMult)
+	{
+		return glm::clamp(MIN_SECONDARY_RAY_T * minTMult, MIN_SECONDARY_RAY_T, MIN_SECONDARY_RAY_T_MAX_VALUE);
+	}
+
+	inline uint32_t CountBits(uint32_t mask)
+	{
+		uint32_t count = 0;
+		for (; mask != 0; mask &= mask - 1)
+			count++;
+		return count;
+	}
+
+	inline glm::vec3 FetchPosition(const CpuMesh& mesh, uint32_t index)
+	{
+		const float* p = reinterpret_cast<const float*>(mesh.vertexData + static_cast<size_t>(index) * mesh.vertexStrideInBytes);
+		return glm::vec3(p[0], p[1], p[2]);
+	}
+
+	// Slab test of a ray against an axis-aligned box, restricted to [tMin, tMax]
+	inline bool IntersectBox(const glm::vec3& origin, const glm::vec3& invDirection,
+		const glm::vec3& boxMin, const glm::vec3& boxMax, float tMin, float tMax, float& enter)
+	{
+		glm::vec3 t0 = (boxMin - origin) * invDirection;
+		glm::vec3 t1 = (boxMax - origin) * invDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+		enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, tMin));
+		float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+		return enter <= exit;
+	}
+
+	inline bool IntersectBox(const glm::vec3& origin, const glm::vec3& invDirection,
+		const glm::vec3& boxMin, const glm::vec3& boxMax, float tMin, float tMax)
+	{
+		float enter;
+		return IntersectBox(origin, invDirection, boxMin, boxMax, tMin, tMax, enter);
+	}
+
+	// Moller-Trumbore intersection. DXR considers a triangle front-facing when its vertices appear
+	// clockwise from the ray origin, which corresponds to a positive determinant here. Those are
+	// rejected to match RAY_FLAG_CULL_FRONT_FACING_TRIANGLES
+	inline bool IntersectTriangleCullFront(const glm::vec3& origin, const glm::vec3& direction,
+		const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, float tMin, float tMax, float& t)
+	{
+		glm::vec3 e1 = v1 - v0;
+		glm::vec3 e2 = v2 - v0;
+		glm::vec3 p = glm::cross(direction, e2);
+		float det = glm::dot(e1, p);
+		if (det > -1e-12f)
+			return false;
+
+		float invDet = 1.0f / det;
+		glm::vec3 s = origin - v0;
+		float u = glm::dot(s, p) * invDet;
+		if (u < 0.0f || u > 1.0f)
+			return false;
+		glm::vec3 q = glm::cross(s, e1);
+		float v = glm::dot(direction, q) * invDet;
+		if (v < 0.0f || u + v > 1.0f)
+			return false;
+
+		t = glm::dot(e2, q) * invDet;
+		return t >= tMin && t <= tMax;
+	}
+}
+
+/// <summary>
+/// Prepare the scene for rendering: builds the BVH of each mesh and computes the
+/// world-to-object transforms and the world-space bounds of each instance. The mesh data is
+/// referenced, not copied.
+/// </summary>
+void CpuRaytracer::SetScene(const CpuScene& scene, const nv_helpers_dx12::BVHBuildSettings& bvhSettings)
+{
+	m_scene = &scene;
+
+	// #DXR Custom: CPU BVH
+	m_meshBVHs.resize(scene.meshes.size());
+	for (size_t i = 0; i < scene.meshes.size(); i++)
+	{
+		const CpuMesh& mesh = scene.meshes[i];
+		if (mesh.bvhNodes)
+		{
+			// #DXR Custom: Mesh Cache
+			nv_helpers_dx12::BottomLevelBVH& bvh = m_meshBVHs[i];
+			bvh.nodes.assign(mesh.bvhNodes, mesh.bvhNodes + mesh.bvhNodeCount);
+			bvh.primitiveIndices.assign(mesh.bvhPrimitiveIndices, mesh.bvhPrimitiveIndices + mesh.bvhPrimitiveCount);
+			bvh.geometryTriangleOffsets.assign(1, 0);
+			bvh.geometryOpaque.assign(1, 1);
+			bvh.stats = {};
+			bvh.stats.triangleCount = mesh.indexCount / 3;
+			bvh.stats.nodeCount = mesh.bvhNodeCount;
+			bvh.stats.maxDepth = mesh.bvhMaxDepth;
+		}
+		else
+		{
+			nv_helpers_dx12::BottomLevelBVHBuilder builder;
+			builder.AddVertexBuffer(mesh.vertexData, 0, mesh.vertexCount, mesh.vertexStrideInBytes,
+				mesh.indexData, 0, mesh.indexCount);
+			builder.Generate(m_meshBVHs[i], bvhSettings);
+		}
+
+		if (m_meshBVHs[i].stats.maxDepth > CpuTraversal::MAX_BVH_DEPTH)
+			throw std::runtime_error("Mesh BVH is too deep for the CPU traversal stack");
+	}
+
+	m_preparedInstances.resize(scene.instances.size());
+
+	for (size_t i = 0; i < scene.instances.size(); i++)
+	{
+		const CpuInstance& instance = scene.instances[i];
+		PreparedInstance& prepared = m_preparedInstances[i];
+
+		// The XMMATRIX memory layout read as a column-major glm matrix yields the transpose, which
+		// turns the row-vector convention into the column-vector convention used by glm
+		prepared.objectToWorld = glm::make_mat4(instance.objectToWorld);
+		prepared.worldToObject = glm::inverse(prepared.objectToWorld);
+
+		// World-space bounds of the transformed vertices, used to skip whole instances
+		const CpuMesh& mesh = scene.meshes[instance.meshIndex];
+		prepared.worldMin = glm::vec3(std::numeric_limits<float>::max());
+		prepared.worldMax = glm::vec3(-std::numeric_limits<float>::max());
+		for (uint32_t v = 0; v < mesh.vertexCount; v++)
+		{
+			glm::vec3 p = glm::vec3(prepared.objectToWorld * glm::vec4(FetchPosition(mesh, v), 1.0f));
+			prepared.worldMin = glm::min(prepared.worldMin, p);
+			prepared.worldMax = glm::max(prepared.worldMax, p);
+		}
+	}
+}
+
+/// <summary>
+/// Render the scene into an RGBA8 image of the given size, with the same dispatch semantics
+/// as DispatchRays(width, height, 1). The image is split in tiles shaded by a pool of threads.
+/// </summary>
+void CpuRaytracer::Render(const CpuCamera& camera, uint32_t width, uint32_t height,
+	std::vector<uint8_t>& outputRGBA8, const CpuRenderOptions& options)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	outputRGBA8.resize(static_cast<size_t>(width) * height * 4);
+
+	// #DXR Custom: CPU Tile Scheduler
+	uint32_t threadCount = options.threadCount;
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	if (!m_threadPool || m_threadPool->GetThreadCount() != threadCount)
+		m_threadPool.reset(new nv_helpers_dx12::ThreadPool(threadCount));
+
+	if (options.tileSize == 0 && m_autoTileSize == 0)
+		TuneTileSize(width, height);
+	const uint32_t tileSize = options.tileSize != 0 ? options.tileSize : m_autoTileSize;
+	const uint32_t tilesX = (width + tileSize - 1) / tileSize;
+	const uint32_t tilesY = (height + tileSize - 1) / tileSize;
+	const uint32_t tileCount = tilesX * tilesY;
+
+	// #DXR Custom: CPU Ray Packets
+	const CpuTraversal::Kernel kernel = CpuTraversal::ResolveKernel(options.kernel);
+	m_tracePacket = options.usePackets ? CpuTraversal::GetTracePacketFunction(kernel) : nullptr;
+	m_minPacketRays = options.minPacketRays;
+
+	m_stats = {};
+	m_stats.tiles.resize(tileCount);
+	m_stats.threadBusyMilliseconds.assign(threadCount, 0.0);
+	std::vector<RayCounters> counters(threadCount);
+
+	// Each tile is a task of the pool: a thread starts with a contiguous band of tiles, and steals
+	// tiles from the other threads once done with it. The cost of a tile varies a lot with the
+	// depth of its reflection chains, which a fixed split of the image would not absorb
+	m_threadPool->ParallelFor(tileCount, 1, [&](uint32_t begin, uint32_t end, uint32_t threadIndex)
+	{
+		RayCounters& threadCounters = counters[threadIndex];
+		for (uint32_t tile = begin; tile < end; tile++)
+		{
+			const uint64_t raysBefore = threadCounters.primary + threadCounters.reflection + threadCounters.shadow;
+			auto tileStart = std::chrono::steady_clock::now();
+
+			RenderTile(tile, tilesX, tileSize, camera, width, height, outputRGBA8.data(), threadCounters);
+
+			CpuTileStats& tileStats = m_stats.tiles[tile];
+			tileStats.x = (tile % tilesX) * tileSize;
+			tileStats.y = (tile / tilesX) * tileSize;
+			tileStats.width = std::min(tileSize, width - tileStats.x);
+			tileStats.height = std::min(tileSize, height - tileStats.y);
+			tileStats.threadIndex = threadIndex;
+			tileStats.rays = threadCounters.primary + threadCounters.reflection + threadCounters.shadow - raysBefore;
+			tileStats.milliseconds =
+				std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tileStart).count();
+			m_stats.threadBusyMilliseconds[threadIndex] += tileStats.milliseconds;
+		}
+	});
+
+	for (const RayCounters& c : counters)
+	{
+		m_stats.primaryRays += c.primary;
+		m_stats.reflectionRays += c.reflection;
+		m_stats.shadowRays += c.shadow;
+		m_stats.packetRays += c.packetRays;
+		m_stats.singleRays += c.singleRays;
+	}
+	m_stats.tileCount = tileCount;
+	m_stats.threadCount = threadCount;
+	m_stats.tileSize = tileSize;
+	m_stats.renderMilliseconds =
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	m_stats.kernel = options.usePackets ? kernel : CpuTraversal::Kernel::Scalar;
+	if (m_stats.renderMilliseconds > 0.0)
+	{
+		uint64_t rays = m_stats.primaryRays + m_stats.reflectionRays + m_stats.shadowRays;
+		m_stats.raysPerSecondPerThread = rays / (m_stats.renderMilliseconds * 0.001) / threadCount;
+	}
+
+	// Threads which found no tile to shade count as idle
+	double busiest = 0.0;
+	double totalBusy = 0.0;
+	for (double busy : m_stats.threadBusyMilliseconds)
+	{
+		busiest = std::max(busiest, busy);
+		totalBusy += busy;
+	}
+	m_stats.loadImbalance = totalBusy > 0.0 ? busiest * threadCount / totalBusy : 1.0;
+
+	if (options.tileSize == 0)
+		TuneTileSize(width, height);
+}
+
+// #DXR Custom: CPU Tile Scheduler
+// Small tiles balance the load better, large tiles have less scheduling overhead and keep the
+// packets of a tile coherent. The first frame starts from the largest size giving each thread
+// enough tiles to steal from, then the size is halved while the threads finish unevenly, and
+// doubled back when the frame is well balanced with plenty of tiles per thread
+void CpuRaytracer::TuneTileSize(uint32_t width, uint32_t height)
+{
+	const uint32_t MIN_TILE_SIZE = 4;
+	const uint32_t MAX_TILE_SIZE = 64;
+	const uint32_t MIN_TILES_PER_THREAD = 8;
+	const uint32_t MAX_TILES_PER_THREAD = 64;
+	const double MAX_IMBALANCE = 1.1;
+	const double MIN_IMBALANCE = 1.03;
+
+	auto tileCountFor = [&](uint32_t size)
+	{
+		return ((width + size - 1) / size) * ((height + size - 1) / size);
+	};
+	const uint32_t threadCount = m_threadPool->GetThreadCount();
+
+	if (m_autoTileSize == 0)
+	{
+		m_autoTileSize = MAX_TILE_SIZE;
+		while (m_autoTileSize > MIN_TILE_SIZE && tileCountFor(m_autoTileSize) < threadCount * MIN_TILES_PER_THREAD)
+			m_autoTileSize /= 2;
+		return;
+	}
+
+	if (m_stats.loadImbalance > MAX_IMBALANCE && m_autoTileSize > MIN_TILE_SIZE)
+	{
+		m_autoTileSize /= 2;
+	}
+	else if (m_stats.loadImbalance < MIN_IMBALANCE && m_autoTileSize < MAX_TILE_SIZE &&
+		tileCountFor(m_autoTileSize) > threadCount * MAX_TILES_PER_THREAD)
+	{
+		m_autoTileSize *= 2;
+	}
+}
+
+void CpuRaytracer::RenderTile(uint32_t tileIndex, uint32_t tilesX, uint32_t tileSize, const CpuCamera& camera,
+	uint32_t width, uint32_t height, uint8_t* output, RayCounters& counters) const
+{
+	const uint32_t x0 = (tileIndex % tilesX) * tileSize;
+	const uint32_t y0 = (tileIndex / tilesX) * tileSize;
+	const uint32_t x1 = std::min(x0 + tileSize, width);
+	const uint32_t y1 = std::min(y0 + tileSize, height);
+
+	// #DXR Custom: CPU Ray Packets
+	const uint32_t pixelsPerPacket = m_tracePacket != nullptr ? CpuTraversal::PACKET_SIZE / SAMPLE_COUNT : 1;
+
+	for (uint32_t y = y0; y < y1; y++)
+	{
+		for (uint32_t x = x0; x < x1; x += pixelsPerPacket)
+		{
+			const uint32_t pixelCount = std::min(pixelsPerPacket, x1 - x);
+			glm::vec3 colors[CpuTraversal::PACKET_SIZE / SAMPLE_COUNT];
+			if (m_tracePacket != nullptr)
+				ShadePixelPacket(x, y, pixelCount, width, height, camera, colors, counters);
+			else
+				colors[0] = ShadePixel(x, y, width, height, camera, counters);
+
+			for (uint32_t p = 0; p < pixelCount; p++)
+			{
+				glm::vec3 color = Saturate(colors[p]);
+
+				// Conversion to DXGI_FORMAT_R8G8B8A8_UNORM, as done when writing the output UAV
+				uint8_t* pixel = output + (static_cast<size_t>(y) * width + x + p) * 4;
+				pixel[0] = static_cast<uint8_t>(color.r * 255.0f + 0.5f);
+				pixel[1] = static_cast<uint8_t>(color.g * 255.0f + 0.5f);
+				pixel[2] = static_cast<uint8_t>(color.b * 255.0f + 0.5f);
+				pixel[3] = 255;
+			}
+		}
+	}
+}
+
+// RayGen.hlsl: 4 sub-pixel samples, each followed by an iterative chain of reflection rays
+glm::vec3 CpuRaytracer::ShadePixel(uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+	const CpuCamera& camera, RayCounters& counters) const
+{
+	static const glm::vec2 offsets[SAMPLE_COUNT] =
+	{
+		glm::vec2(0.25f, 0.25f),
+		glm::vec2(0.75f, 0.25f),
+		glm::vec2(0.25f, 0.75f),
+		glm::vec2(0.75f, 0.75f)
+	};
+
+	const glm::vec2 dims = glm::vec2(static_cast<float>(width), static_cast<float>(height));
+	glm::vec3 finalColor = glm::vec3(0.0f);
+
+	for (int i = 0; i < SAMPLE_COUNT; i++)
+	{
+		glm::vec2 d = ((glm::vec2(static_cast<float>(x), static_cast<float>(y)) + offsets[i]) / dims) * 2.0f - 1.0f;
+
+		glm::vec3 currentRayEnergy = glm::vec3(1.0f);
+		glm::vec3 resultColor = glm::vec3(0.0f);
+		glm::vec3 currentPosition = glm::vec3(camera.viewInverse * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+		glm::vec4 target = camera.projectionInverse * glm::vec4(d.x, -d.y, 1.0f, 1.0f);
+		// As in the shader, the direction is neither normalized nor divided by w
+		glm::vec3 currentDirection = glm::vec3(camera.viewInverse * glm::vec4(glm::vec3(target), 0.0f));
+		float currentMinTMult = 1.0f;
+
+		counters.primary++;
+
+		for (int j = 0; j < NUM_REFLECTIONS; j++)
+		{
+			Ray ray;
+			ray.origin = currentPosition;
+			ray.direction = currentDirection;
+			ray.tMin = SecondaryRayTMin(currentMinTMult);
+			ray.tMax = MAX_RAY_T;
+
+			glm::vec3 color;
+			float distance;
+			glm::vec4 normalAndIsHit;
+			glm::vec3 rayEnergy = currentRayEnergy;
+			ShadeReflection(ray, color, distance, normalAndIsHit, rayEnergy, counters);
+
+			// The sky seen directly or through a miss after a hit is brightened, see RayGen.hlsl
+			float hitMult = Saturate(normalAndIsHit.w);
+			float shouldNotAdd = hitMult + Saturate(1.0f - static_cast<float>(j)) * (1.0f - hitMult);
+			resultColor += currentRayEnergy * color * (SKY_INTENSITY - (SKY_INTENSITY - 1.0f) * shouldNotAdd);
+			currentRayEnergy = rayEnergy;
+
+			if (normalAndIsHit.w == 0.0f)
+				break;
+			currentMinTMult = normalAndIsHit.w;
+
+			currentPosition += currentDirection * distance;
+			currentDirection = Reflect(currentDirection, glm::vec3(normalAndIsHit));
+
+			if (j + 1 < NUM_REFLECTIONS)
+				counters.reflection++;
+		}
+
+		float mult = 1.0f / (i + 1.0f);
+		finalColor = mult * resultColor + (1.0f - mult) * finalColor;
+	}
+
+	return finalColor;
+}
+
+// #DXR Custom: CPU Ray Packets
+// Same computations as ShadePixel, reordered so that the rays of all the samples at a given depth
+// are traced together: lane l holds sample l % SAMPLE_COUNT of pixel x + l / SAMPLE_COUNT
+void CpuRaytracer::ShadePixelPacket(uint32_t x, uint32_t y, uint32_t pixelCount, uint32_t width, uint32_t height,
+	const CpuCamera& camera, glm::vec3* colorsOut, RayCounters& counters) const
+{
+	static const glm::vec2 offsets[SAMPLE_COUNT] =
+	{
+		glm::vec2(0.25f, 0.25f),
+		glm::vec2(0.75f, 0.25f),
+		glm::vec2(0.25f, 0.75f),
+		glm::vec2(0.75f, 0.75f)
+	};
+
+	struct SampleState
+	{
+		glm::vec3 rayEnergy;
+		glm::vec3 resultColor;
+		glm::vec3 position;
+		glm::vec3 direction;
+		float minTMult;
+	};
+
+	const uint32_t laneCount = pixelCount * SAMPLE_COUNT;
+	const glm::vec2 dims = glm::vec2(static_cast<float>(width), static_cast<float>(height));
+	const glm::vec3 cameraPosition = glm::vec3(camera.viewInverse * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+	SampleState samples[CpuTraversal::PACKET_SIZE];
+	uint32_t live = 0;
+	for (uint32_t lane = 0; lane < laneCount; lane++)
+	{
+		const uint32_t px = x + lane / SAMPLE_COUNT;
+		glm::vec2 d = ((glm::vec2(static_cast<float>(px), static_cast<float>(y)) + offsets[lane % SAMPLE_COUNT]) / dims) * 2.0f - 1.0f;
+		glm::vec4 target = camera.projectionInverse * glm::vec4(d.x, -d.y, 1.0f, 1.0f);
+
+		SampleState& sample = samples[lane];
+		sample.rayEnergy = glm::vec3(1.0f);
+		sample.resultColor = glm::vec3(0.0f);
+		sample.position = cameraPosition;
+		sample.direction = glm::vec3(camera.viewInverse * glm::vec4(glm::vec3(target), 0.0f));
+		sample.minTMult = 1.0f;
+
+		live |= 1u << lane;
+		counters.primary++;
+	}
+
+	for (int j = 0; j < NUM_REFLECTIONS && live != 0; j++)
+	{
+		Ray rays[CpuTraversal::PACKET_SIZE];
+		for (uint32_t lane = 0; lane < laneCount; lane++)
+		{
+			if ((live & (1u << lane)) == 0)
+				continue;
+			rays[lane].origin = samples[lane].position;
+			rays[lane].direction = samples[lane].direction;
+			rays[lane].tMin = SecondaryRayTMin(samples[lane].minTMult);
+			rays[lane].tMax = MAX_RAY_T;
+		}
+
+		Hit hits[CpuTraversal::PACKET_SIZE];
+		const uint32_t hitMask = TraceRays(rays, live, false, hits, counters);
+
+		// All the shadow rays share the light direction, which keeps them coherent
+		Ray shadowRays[CpuTraversal::PACKET_SIZE];
+		glm::vec4 normalAndIsHit[CpuTraversal::PACKET_SIZE];
+		for (uint32_t lane = 0; lane < laneCount; lane++)
+		{
+			if ((hitMask & (1u << lane)) != 0)
+				PrepareHit(rays[lane], hits[lane], normalAndIsHit[lane], shadowRays[lane]);
+		}
+
+		Hit shadowHits[CpuTraversal::PACKET_SIZE];
+		counters.shadow += CountBits(hitMask);
+		const uint32_t occludedMask = TraceRays(shadowRays, hitMask, true, shadowHits, counters);
+
+		for (uint32_t lane = 0; lane < laneCount; lane++)
+		{
+			const uint32_t bit = 1u << lane;
+			if ((live & bit) == 0)
+				continue;
+
+			SampleState& sample = samples[lane];
+			glm::vec3 color;
+			float distance;
+			glm::vec3 rayEnergy = sample.rayEnergy;
+			if ((hitMask & bit) != 0)
+				ShadeHit(hits[lane], normalAndIsHit[lane], (occludedMask & bit) != 0, color, distance, rayEnergy);
+			else
+				ShadeMiss(rays[lane], color, distance, normalAndIsHit[lane], rayEnergy);
+
+			// The sky seen directly or through a miss after a hit is brightened, see RayGen.hlsl
+			float hitMult = Saturate(normalAndIsHit[lane].w);
+			float shouldNotAdd = hitMult + Saturate(1.0f - static_cast<float>(j)) * (1.0f - hitMult);
+			sample.resultColor += sample.rayEnergy * color * (SKY_INTENSITY - (SKY_INTENSITY - 1.0f) * shouldNotAdd);
+			sample.rayEnergy = rayEnergy;
+
+			if (normalAndIsHit[lane].w == 0.0f)
+			{
+				live &= ~bit;
+				continue;
+			}
+			sample.minTMult = normalAndIsHit[lane].w;
+
+			sample.position += sample.direction * distance;
+			sample.direction = Reflect(sample.direction, glm::vec3(normalAndIsHit[lane]));
+
+			if (j + 1 < NUM_REFLECTIONS)
+				counters.reflection++;
+		}
+	}
+
+	for (uint32_t p = 0; p < pixelCount; p++)
+	{
+		glm::vec3 finalColor = glm::vec3(0.0f);
+		for (int i = 0; i < SAMPLE_COUNT; i++)
+		{
+			float mult = 1.0f / (i + 1.0f);
+			finalColor = mult * samples[p * SAMPLE_COUNT + i].resultColor + (1.0f - mult) * finalColor;
+		}
+		colorsOut[p] = finalColor;
+	}
+}
+
+// ReflectionClosestHit (ReflectionRay.hlsl) and ReflectionMiss (ReflectionMiss.hlsl)
+void CpuRaytracer::ShadeReflection(const Ray& ray, glm::vec3& colorOut, float& distanceOut,
+	glm::vec4& normalAndIsHitOut, glm::vec3& rayEnergyInOut, RayCounters& counters) const
+{
+	Hit hit;
+	if (!TraceRay(ray, false, hit))
+	{
+		ShadeMiss(ray, colorOut, distanceOut, normalAndIsHitOut, rayEnergyInOut);
+		return;
+	}
+
+	Ray shadowRay;
+	PrepareHit(ray, hit, normalAndIsHitOut, shadowRay);
+
+	Hit shadowHit;
+	counters.shadow++;
+	bool occluded = TraceRay(shadowRay, true, shadowHit);
+
+	ShadeHit(hit, normalAndIsHitOut, occluded, colorOut, distanceOut, rayEnergyInOut);
+}
+
+// ReflectionMiss.hlsl
+void CpuRaytracer::ShadeMiss(const Ray& ray, glm::vec3& colorOut, float& distanceOut,
+	glm::vec4& normalAndIsHitOut, glm::vec3& rayEnergyInOut) const
+{
+	colorOut = SampleSkybox(glm::normalize(ray.direction));
+	distanceOut = -1.0f;
+	normalAndIsHitOut = glm::vec4(0.0f);
+	rayEnergyInOut = glm::vec3(0.0f);
+}
+
+// ReflectionClosestHit up to the shadow ray: surface normal, ray offset and shadow ray
+void CpuRaytracer::PrepareHit(const Ray& ray, const Hit& hit, glm::vec4& normalAndIsHitOut, Ray& shadowRayOut) const
+{
+	const CpuInstance& instance = m_scene->instances[hit.instanceIndex];
+	const CpuMesh& mesh = m_scene->meshes[instance.meshIndex];
+	const PreparedInstance& prepared = m_preparedInstances[hit.instanceIndex];
+
+	// mul(float3x4, float3) in HLSL truncates the matrix to its 3x3 part, hence no translation
+	glm::mat3 objectToWorld = glm::mat3(prepared.objectToWorld);
+	uint32_t vertId = 3 * hit.primitiveIndex;
+	glm::vec3 v1 = objectToWorld * FetchPosition(mesh, mesh.indexData[vertId + 0]);
+	glm::vec3 v2 = objectToWorld * FetchPosition(mesh, mesh.indexData[vertId + 1]);
+	glm::vec3 v3 = objectToWorld * FetchPosition(mesh, mesh.indexData[vertId + 2]);
+
+	float minTMult = glm::length(v2 - v3);
+
+	glm::vec3 normal = glm::normalize(glm::cross(v2 - v3, v1 - v2));
+	if (glm::dot(normal, ray.direction) > 0.0f)
+		normal = -normal;
+
+	// Shadow ray (ShadowRay.hlsl): any hit marks the point as occluded
+	shadowRayOut.origin = ray.origin + hit.t * ray.direction;
+	shadowRayOut.direction = -LIGHT_DIR;
+	shadowRayOut.tMin = SecondaryRayTMin(minTMult);
+	shadowRayOut.tMax = MAX_RAY_T;
+
+	normalAndIsHitOut = glm::vec4(normal, minTMult);
+}
+
+// ReflectionClosestHit once the visibility of the light is known
+void CpuRaytracer::ShadeHit(const Hit& hit, const glm::vec4& normalAndIsHit, bool occluded, glm::vec3& colorOut,
+	float& distanceOut, glm::vec3& rayEnergyInOut) const
+{
+	const CpuInstance& instance = m_scene->instances[hit.instanceIndex];
+
+	glm::vec3 lightDir = -LIGHT_DIR;
+	float diff = std::max(glm::dot(glm::vec3(normalAndIsHit), lightDir), 0.0f);
+	glm::vec3 diffuse = diff * LIGHT_COL;
+	float diffFactor = occluded ? 0.0f : 1.0f;
+
+	glm::vec3 hitColor = (diffFactor * diffuse + AMBIENT_FACTOR * LIGHT_COL) * instance.material.albedo;
+
+	colorOut = Saturate(hitColor);
+	distanceOut = hit.t;
+	rayEnergyInOut = rayEnergyInOut * instance.material.specular;
+}
+
+// DirectionToSpherical (Common.hlsl) followed by a point-sampled lookup with a black border
+glm::vec3 CpuRaytracer::SampleSkybox(const glm::vec3& direction) const
+{
+	const CpuSkybox& skybox = m_scene->skybox;
+	if (skybox.width == 0 || skybox.height == 0)
+		return SKY_COL;
+
+	float theta = std::acos(direction.y) / PI;
+	float phi = std::atan2(direction.x, direction.z) / (PI * 2.0f) + 0.5f;
+
+	if (!(phi >= 0.0f && phi < 1.0f && theta >= 0.0f && theta < 1.0f))
+		return glm::vec3(0.0f);
+
+	uint32_t tx = std::min(static_cast<uint32_t>(phi * skybox.width), skybox.width - 1);
+	uint32_t ty = std::min(static_cast<uint32_t>(theta * skybox.height), skybox.height - 1);
+	const float* texel = &skybox.rgb[(static_cast<size_t>(ty) * skybox.width + tx) * 3];
+	return glm::vec3(texel[0], texel[1], texel[2]);
+}
+
+// Equivalent of TraceRay with RAY_FLAG_CULL_FRONT_FACING_TRIANGLES. If anyHit is true the
+// traversal stops at the first intersection (shadow rays only need visibility)
+bool CpuRaytracer::TraceRay(const Ray& ray, bool anyHit, Hit& hit) const
+{
+	bool found = false;
+	float closest = ray.tMax;
+	const glm::vec3 invDirection = 1.0f / ray.direction;
+
+	for (size_t i = 0; i < m_preparedInstances.size(); i++)
+	{
+		const PreparedInstance& prepared = m_preparedInstances[i];
+		if (!IntersectBox(ray.origin, invDirection, prepared.worldMin, prepared.worldMax, ray.tMin, closest))
+			continue;
+
+		// Intersect in object space: the transform is affine, so t is preserved
+		glm::vec3 origin = glm::vec3(prepared.worldToObject * glm::vec4(ray.origin, 1.0f));
+		glm::vec3 direction = glm::vec3(prepared.worldToObject * glm::vec4(ray.direction, 0.0f));
+
+		const CpuMesh& mesh = m_scene->meshes[m_scene->instances[i].meshIndex];
+		const nv_helpers_dx12::BottomLevelBVH& bvh = m_meshBVHs[m_scene->instances[i].meshIndex];
+		uint32_t primitiveIndex;
+		if (TraceMesh(bvh, mesh, origin, direction, ray.tMin, anyHit, closest, primitiveIndex))
+		{
+			found = true;
+			hit.t = closest;
+			hit.instanceIndex = static_cast<uint32_t>(i);
+			hit.primitiveIndex = primitiveIndex;
+			if (anyHit)
+				return true;
+		}
+	}
+	return found;
+}
+
+// #DXR Custom: CPU Ray Packets
+// Traces the active rays of a packet, as a packet when they are coherent enough and one by one
+// otherwise. Returns the mask of the rays which hit something
+uint32_t CpuRaytracer::TraceRays(const Ray* rays, uint32_t activeMask, bool anyHit, Hit* hits, RayCounters& counters) const
+{
+	const uint32_t rayCount = CountBits(activeMask);
+	if (rayCount == 0)
+		return 0;
+
+	// Rays pointing into different octants quickly diverge in the hierarchy
+	bool coherent = rayCount >= std::max(m_minPacketRays, 1u);
+	int octant = -1;
+	for (uint32_t lane = 0; lane < CpuTraversal::PACKET_SIZE && coherent; lane++)
+	{
+		if ((activeMask & (1u << lane)) == 0)
+			continue;
+		const glm::vec3& d = rays[lane].direction;
+		int laneOctant = (d.x < 0.0f ? 1 : 0) | (d.y < 0.0f ? 2 : 0) | (d.z < 0.0f ? 4 : 0);
+		if (octant >= 0 && laneOctant != octant)
+			coherent = false;
+		octant = laneOctant;
+	}
+
+	if (coherent)
+	{
+		counters.packetRays += rayCount;
+		return TracePacket(rays, activeMask, anyHit, hits);
+	}
+
+	counters.singleRays += rayCount;
+	uint32_t hitMask = 0;
+	for (uint32_t lane = 0; lane < CpuTraversal::PACKET_SIZE; lane++)
+	{
+		if ((activeMask & (1u << lane)) != 0 && TraceRay(rays[lane], anyHit, hits[lane]))
+			hitMask |= 1u << lane;
+	}
+	return hitMask;
+}
+
+// Instance loop of TraceRay for a packet. The rays entering the bounds of an instance are moved
+// to its object space, and the packet kernel traverses the BVH of its mesh
+uint32_t CpuRaytracer::TracePacket(const Ray* rays, uint32_t activeMask, bool anyHit, Hit* hits) const
+{
+	float closest[CpuTraversal::PACKET_SIZE];
+	glm::vec3 invDirections[CpuTraversal::PACKET_SIZE];
+	for (uint32_t lane = 0; lane < CpuTraversal::PACKET_SIZE; lane++)
+	{
+		if ((activeMask & (1u << lane)) == 0)
+			continue;
+		closest[lane] = rays[lane].tMax;
+		invDirections[lane] = 1.0f / rays[lane].direction;
+	}
+
+	CpuTraversal::RayPacket packet;
+	uint32_t live = activeMask;
+	uint32_t hitMask = 0;
+
+	for (size_t i = 0; i < m_preparedInstances.size() && live != 0; i++)
+	{
+		const PreparedInstance& prepared = m_preparedInstances[i];
+
+		uint32_t instanceMask = 0;
+		for (uint32_t lane = 0; lane < CpuTraversal::PACKET_SIZE; lane++)
+		{
+			if ((live & (1u << lane)) == 0 || !IntersectBox(rays[lane].origin, invDirections[lane],
+				prepared.worldMin, prepared.worldMax, rays[lane].tMin, closest[lane]))
+			{
+				// Inactive lanes are still processed by the kernel, keep their values finite
+				packet.originX[lane] = packet.originY[lane] = packet.originZ[lane] = 0.0f;
+				packet.directionX[lane] = packet.directionY[lane] = packet.directionZ[lane] = 1.0f;
+				packet.tMin[lane] = 0.0f;
+				packet.tMax[lane] = 0.0f;
+				continue;
+			}
+
+			// Intersect in object space: the transform is affine, so t is preserved
+			glm::vec3 origin = glm::vec3(prepared.worldToObject * glm::vec4(rays[lane].origin, 1.0f));
+			glm::vec3 direction = glm::vec3(prepared.worldToObject * glm::vec4(rays[lane].direction, 0.0f));
+			packet.originX[lane] = origin.x;
+			packet.originY[lane] = origin.y;
+			packet.originZ[lane] = origin.z;
+			packet.directionX[lane] = direction.x;
+			packet.directionY[lane] = direction.y;
+			packet.directionZ[lane] = direction.z;
+			packet.tMin[lane] = rays[lane].tMin;
+			packet.tMax[lane] = closest[lane];
+			instanceMask |= 1u << lane;
+		}
+		if (instanceMask == 0)
+			continue;
+
+		const uint32_t meshIndex = m_scene->instances[i].meshIndex;
+		const CpuMesh& mesh = m_scene->meshes[meshIndex];
+		const nv_helpers_dx12::BottomLevelBVH& bvh = m_meshBVHs[meshIndex];
+
+		CpuTraversal::PacketGeometry geometry;
+		geometry.nodes = bvh.nodes.data();
+		geometry.primitiveIndices = bvh.primitiveIndices.data();
+		geometry.vertexData = mesh.vertexData;
+		geometry.vertexStrideInBytes = mesh.vertexStrideInBytes;
+		geometry.indexData = mesh.indexData;
+
+		const uint32_t found = m_tracePacket(geometry, packet, instanceMask, anyHit);
+		for (uint32_t lane = 0; lane < CpuTraversal::PACKET_SIZE; lane++)
+		{
+			if ((found & (1u << lane)) == 0)
+				continue;
+			closest[lane] = packet.tMax[lane];
+			hits[lane].t = closest[lane];
+			hits[lane].instanceIndex = static_cast<uint32_t>(i);
+			hits[lane].primitiveIndex = packet.primitiveIndex[lane];
+		}
+		hitMask |= found;
+
+		if (anyHit)
+			live &= ~found;
+	}
+	return hitMask;
+}
+
+// Stack-based traversal of the flat node array, visiting the nearest child first so that the
+// closest hit shrinks the search interval as early as possible
+bool CpuRaytracer::TraceMesh(const nv_helpers_dx12::BottomLevelBVH& bvh, const CpuMesh& mesh, const glm::vec3& origin,
+	const glm::vec3& direction, float tMin, bool anyHit, float& closest, uint32_t& primitiveIndex) const
+{
+	const glm::vec3 invDirection = 1.0f / direction;
+	const nv_helpers_dx12::BVHNode* nodes = bvh.nodes.data();
+
+	bool found = false;
+	uint32_t stack[CpuTraversal::MAX_BVH_DEPTH + 1];
+	uint32_t stackSize = 0;
+
+	if (!IntersectBox(origin, invDirection, glm::make_vec3(nodes[0].boundsMin), glm::make_vec3(nodes[0].boundsMax), tMin, closest))
+		return false;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const nv_helpers_dx12::BVHNode& node = nodes[stack[--stackSize]];
+
+		if (node.IsLeaf())
+		{
+			for (uint32_t p = 0; p < node.primitiveCount; p++)
+			{
+				uint32_t tri = bvh.primitiveIndices[node.leftFirst + p];
+				glm::vec3 v0 = FetchPosition(mesh, mesh.indexData[3 * tri + 0]);
+				glm::vec3 v1 = FetchPosition(mesh, mesh.indexData[3 * tri + 1]);
+				glm::vec3 v2 = FetchPosition(mesh, mesh.indexData[3 * tri + 2]);
+
+				float t;
+				if (IntersectTriangleCullFront(origin, direction, v0, v1, v2, tMin, closest, t))
+				{
+					found = true;
+					closest = t;
+					primitiveIndex = tri;
+					if (anyHit)
+						return true;
+				}
+			}
+			continue;
+		}
+
+		uint32_t nearChild = node.leftFirst;
+		uint32_t farChild = node.leftFirst + 1;
+		float nearEntry, farEntry;
+		bool hitNear = IntersectBox(origin, invDirection, glm::make_vec3(nodes[nearChild].boundsMin),
+			glm::make_vec3(nodes[nearChild].boundsMax), tMin, closest, nearEntry);
+		bool hitFar = IntersectBox(origin, invDirection, glm::make_vec3(nodes[farChild].boundsMin),
+			glm::make_vec3(nodes[farChild].boundsMax), tMin, closest, farEntry);
+
+		// Push the farthest child first so that the nearest one is popped next
+		if (hitNear && hitFar)
+		{
+			if (farEntry < nearEntry)
+				std::swap(nearChild, farChild);
+			stack[stackSize++] = farChild;
+			stack[stackSize++] = nearChild;
+		}
+		else if (hitNear)
+		{
+			stack[stackSize++] = nearChild;
+		}
+		else if (hitFar)
+		{
+			stack[stackSize++] = farChild;
+		}
+	}
+	return found;
+}
+
+/// <summary>
+/// Write the per-tile statistics of the last frame as CSV, one line per tile
+/// </summary>
+bool CpuRaytracer::WriteTileStats(const std::string& fileName) const
+{
+	std::ofstream file(fileName);
+	if (!file.good())
+		return false;
+
+	file << "x,y,width,height,thread,rays,milliseconds\n";
+	for (const CpuTileStats& tile : m_stats.tiles)
+	{
+		file << tile.x << "," << tile.y << "," << tile.width << "," << tile.height << ","
+			<< tile.threadIndex << "," << tile.rays << "," << tile.milliseconds << "\n";
+	}
+	return file.good();
+}
+
+/// <summary>
+/// Write an RGBA8 image as a binary PPM file, dropping the alpha channel
+/// </summary>
+bool CpuRaytracer::WritePPM(const std::string& fileName, uint32_t width, uint32_t height,
+	const std::vector<uint8_t>& rgba8)
+{
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file.good())
+		return false;
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+	std::vector<uint8_t> row(static_cast<size_t>(width) * 3);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			const uint8_t* pixel = &rgba8[(static_cast<size_t>(y) * width + x) * 4];
+			row[3 * x + 0] = pixel[0];
+			row[3 * x + 1] = pixel[1];
+			row[3 * x + 2] = pixel[2];
+		}
+		file.write(reinterpret_cast<const char*>(row.data()), row.size());
+	}
+	return file.good();
+}
+
+bool CpuRaytracer::ReadPPM(const std::string& fileName, uint32_t& width, uint32_t& height,
+	std::vector<uint8_t>& rgba8)
+{
+	std::ifstream file(fileName, std::ios::binary);
+	std::string magic;
+	uint32_t maxValue = 0;
+	file >> magic >> width >> height >> maxValue;
+	if (!file.good() || magic != "P6" || maxValue != 255 || width == 0 || height == 0)
+		return false;
+	// A single whitespace separates the header from the pixels
+	file.get();
+
+	std::vector<uint8_t> row(static_cast<size_t>(width) * 3);
+	rgba8.resize(static_cast<size_t>(width) * height * 4);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		file.read(reinterpret_cast<char*>(row.data()), row.size());
+		for (uint32_t x = 0; x < width; x++)
+		{
+			uint8_t* pixel = &rgba8[(static_cast<size_t>(y) * width + x) * 4];
+			pixel[0] = row[3 * x + 0];
+			pixel[1] = row[3 * x + 1];
+			pixel[2] = row[3 * x + 2];
+			pixel[3] = 255;
+		}
+	}
+	return file.good();
+}
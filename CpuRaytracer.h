@@ -0,0 +1,288 @@
+#pragma once
+
+// #DXR Custom: CPU Reference Renderer
+// Portable (std + glm only) implementation of the shading pipeline found in RayGen.hlsl,
+// ReflectionRay.hlsl, ShadowRay.hlsl and ReflectionMiss.hlsl. It renders the same scene as the
+// DXR path without requiring a GPU, so that the shading can be regression-tested and profiled on
+// machines without a raytracing capable device.
+//
+// The constants below mirror Common.hlsl and must be kept in sync with it.
+
+#include <glm/glm.hpp>
+
+#include "CpuRayPacket.h"
+#include "nv_helpers_dx12/BottomLevelBVHBuilder.h"
+#include "nv_helpers_dx12/ThreadPool.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace CpuShading
+{
+	static const glm::vec3 LIGHT_DIR = glm::normalize(glm::vec3(-1.0f, -1.0f, -1.0f));
+	static const glm::vec3 LIGHT_COL = glm::vec3(1.0f, 1.0f, 1.0f);
+	static const glm::vec3 SKY_COL = glm::vec3(0.0f, 0.2f, 0.7f);
+
+	static const float PI = 3.14159265f;
+	static const float AMBIENT_FACTOR = 0.2f;
+	static const float SKY_INTENSITY = 1.8f;
+	static const float MAX_RAY_T = 100000.0f;
+	static const float MIN_SECONDARY_RAY_T = 0.00005f;
+	static const float MIN_SECONDARY_RAY_T_MAX_VALUE = 0.01f;
+
+	static const int NUM_REFLECTIONS = 10;
+	static const int SAMPLE_COUNT = 4;
+}
+
+/// Geometry of a single mesh, described the same way as the vertex and index buffers handed to
+/// BottomLevelASGenerator::AddVertexBuffer. The data is not owned and must outlive the renderer.
+struct CpuMesh
+{
+	const uint8_t* vertexData = nullptr;	// First vertex position (3 floats), possibly interleaved
+	uint32_t vertexCount = 0;
+	uint32_t vertexStrideInBytes = 0;		// Size of a vertex including all its other data
+	const uint32_t* indexData = nullptr;	// 32-bit indices, 3 per triangle
+	uint32_t indexCount = 0;
+
+	// #DXR Custom: Mesh Cache
+	// Optional hierarchy built offline, e.g. stored in a mesh cache. When set, SetScene uses it
+	// instead of building one, regardless of the build settings
+	const nv_helpers_dx12::BVHNode* bvhNodes = nullptr;
+	uint32_t bvhNodeCount = 0;
+	const uint32_t* bvhPrimitiveIndices = nullptr;
+	uint32_t bvhPrimitiveCount = 0;
+	uint32_t bvhMaxDepth = 0;
+};
+
+/// Material as stored in the material table (see MaterialTable.h)
+struct CpuMaterial
+{
+	glm::vec3 albedo = glm::vec3(0.0f);
+	glm::vec3 specular = glm::vec3(0.0f);
+};
+
+/// Instance of a mesh, equivalent to a TLAS instance plus its hit group root parameters
+struct CpuInstance
+{
+	uint32_t meshIndex = 0;
+	// Object to world transform stored row-major with the row-vector convention, i.e. the memory
+	// layout of a DirectX::XMMATRIX, so that instance matrices can be copied verbatim
+	float objectToWorld[16] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+								0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+	CpuMaterial material;
+};
+
+/// Equirectangular environment map sampled by the miss shaders. When empty, SKY_COL is used
+struct CpuSkybox
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<float> rgb;					// width * height * 3 linear values, row-major
+};
+
+struct CpuScene
+{
+	std::vector<CpuMesh> meshes;
+	std::vector<CpuInstance> instances;
+	CpuSkybox skybox;
+};
+
+/// Inverse camera matrices, as stored in the CameraParams constant buffer (viewI, projectionI)
+struct CpuCamera
+{
+	glm::mat4 viewInverse = glm::mat4(1.0f);
+	glm::mat4 projectionInverse = glm::mat4(1.0f);
+};
+
+struct CpuRenderOptions
+{
+	uint32_t tileSize = 0;					// 0 tunes the tile size from frame to frame, see Render
+	uint32_t threadCount = 0;				// 0 selects std::thread::hardware_concurrency()
+
+	// #DXR Custom: CPU Ray Packets
+	// The samples of 2 neighboring pixels are traced as one packet of 8 rays. Packets with fewer
+	// live rays than minPacketRays, or whose rays do not all point into the same octant, are
+	// traced one ray at a time since most of their lanes would be wasted
+	bool usePackets = true;
+	CpuTraversal::Kernel kernel = CpuTraversal::Kernel::Auto;
+	uint32_t minPacketRays = 4;
+};
+
+/// Shading cost of a tile, to locate the expensive regions of the image
+struct CpuTileStats
+{
+	uint32_t x = 0;
+	uint32_t y = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t threadIndex = 0;				// Thread which shaded the tile
+	uint64_t rays = 0;						// All ray types
+	double milliseconds = 0.0;
+};
+
+/// Counters gathered during a frame, used to profile the shading cost
+struct CpuRenderStats
+{
+	uint64_t primaryRays = 0;
+	uint64_t reflectionRays = 0;
+	uint64_t shadowRays = 0;
+	uint32_t tileCount = 0;
+	uint32_t threadCount = 0;
+	double renderMilliseconds = 0.0;
+
+	// #DXR Custom: CPU Tile Scheduler
+	uint32_t tileSize = 0;					// Tile size used for the frame
+	std::vector<CpuTileStats> tiles;		// In row-major tile order
+	std::vector<double> threadBusyMilliseconds;	// Time spent shading tiles, per thread
+	double loadImbalance = 0.0;				// Busiest thread time over the average, 1 is perfect
+
+	// #DXR Custom: CPU Ray Packets
+	CpuTraversal::Kernel kernel = CpuTraversal::Kernel::Scalar;	// Packet kernel used for the frame
+	uint64_t packetRays = 0;				// Rays traced as part of a packet
+	uint64_t singleRays = 0;				// Rays traced one at a time
+	double raysPerSecondPerThread = 0.0;	// All ray types, divided by the thread count
+};
+
+class CpuRaytracer
+{
+public:
+	/// <summary>
+	/// Prepare the scene for rendering: builds the BVH of each mesh and computes the
+	/// world-to-object transforms and the world-space bounds of each instance. The mesh data is
+	/// referenced, not copied.
+	/// </summary>
+	void SetScene(const CpuScene& scene, const nv_helpers_dx12::BVHBuildSettings& bvhSettings = {});
+
+	/// <summary>
+	/// Render the scene into an RGBA8 image of the given size, with the same dispatch semantics
+	/// as DispatchRays(width, height, 1). The image is split in tiles shaded by a pool of threads.
+	/// </summary>
+	void Render(const CpuCamera& camera, uint32_t width, uint32_t height,
+		std::vector<uint8_t>& outputRGBA8, const CpuRenderOptions& options = {});
+
+	const CpuRenderStats& GetStats() const { return m_stats; }
+
+	/// <summary>
+	/// Write the per-tile statistics of the last frame as CSV, one line per tile
+	/// </summary>
+	bool WriteTileStats(const std::string& fileName) const;
+
+	/// Tile size used by the next frame rendered with CpuRenderOptions::tileSize set to 0
+	uint32_t GetAutoTileSize() const { return m_autoTileSize; }
+
+	/// Hierarchy built for a mesh of the scene, giving access to its build statistics
+	const nv_helpers_dx12::BottomLevelBVH& GetMeshBVH(size_t meshIndex) const { return m_meshBVHs[meshIndex]; }
+
+	/// <summary>
+	/// Write an RGBA8 image as a binary PPM file, dropping the alpha channel
+	/// </summary>
+	static bool WritePPM(const std::string& fileName, uint32_t width, uint32_t height,
+		const std::vector<uint8_t>& rgba8);
+
+	/// <summary>
+	/// Read a binary PPM file with 8-bit channels, as written by WritePPM, into an RGBA8 image
+	/// whose alpha is 255. Returns false if the file is missing or in another format
+	/// </summary>
+	static bool ReadPPM(const std::string& fileName, uint32_t& width, uint32_t& height,
+		std::vector<uint8_t>& rgba8);
+
+private:
+	struct Ray
+	{
+		glm::vec3 origin;
+		glm::vec3 direction;
+		float tMin;
+		float tMax;
+	};
+
+	struct Hit
+	{
+		float t;
+		uint32_t instanceIndex;
+		uint32_t primitiveIndex;
+	};
+
+	struct PreparedInstance
+	{
+		glm::mat4 objectToWorld;
+		glm::mat4 worldToObject;
+		glm::vec3 worldMin;
+		glm::vec3 worldMax;
+	};
+
+	/// Per-thread ray counters, merged into m_stats at the end of the frame
+	struct RayCounters
+	{
+		uint64_t primary = 0;
+		uint64_t reflection = 0;
+		uint64_t shadow = 0;
+		uint64_t packetRays = 0;
+		uint64_t singleRays = 0;
+	};
+
+	// Equivalent of TraceRay with RAY_FLAG_CULL_FRONT_FACING_TRIANGLES. If anyHit is true the
+	// traversal stops at the first intersection (shadow rays only need visibility)
+	bool TraceRay(const Ray& ray, bool anyHit, Hit& hit) const;
+
+	// #DXR Custom: CPU Ray Packets
+	// Traces the active rays of a packet, as a packet when they are coherent enough and one by
+	// one otherwise. Returns the mask of the rays which hit something
+	uint32_t TraceRays(const Ray* rays, uint32_t activeMask, bool anyHit, Hit* hits, RayCounters& counters) const;
+
+	// Instance loop of TraceRay, running the packet kernel on the meshes
+	uint32_t TracePacket(const Ray* rays, uint32_t activeMask, bool anyHit, Hit* hits) const;
+
+	// ReflectionRay.hlsl / ReflectionMiss.hlsl
+	void ShadeReflection(const Ray& ray, glm::vec3& colorOut, float& distanceOut,
+		glm::vec4& normalAndIsHitOut, glm::vec3& rayEnergyInOut, RayCounters& counters) const;
+
+	// ReflectionMiss.hlsl
+	void ShadeMiss(const Ray& ray, glm::vec3& colorOut, float& distanceOut,
+		glm::vec4& normalAndIsHitOut, glm::vec3& rayEnergyInOut) const;
+
+	// ReflectionClosestHit up to the shadow ray: surface normal, ray offset and shadow ray
+	void PrepareHit(const Ray& ray, const Hit& hit, glm::vec4& normalAndIsHitOut, Ray& shadowRayOut) const;
+
+	// ReflectionClosestHit once the visibility of the light is known
+	void ShadeHit(const Hit& hit, const glm::vec4& normalAndIsHit, bool occluded, glm::vec3& colorOut,
+		float& distanceOut, glm::vec3& rayEnergyInOut) const;
+
+	// RayGen.hlsl, for a single launch index
+	glm::vec3 ShadePixel(uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+		const CpuCamera& camera, RayCounters& counters) const;
+
+	// RayGen.hlsl for pixelCount neighboring launch indices, whose samples form one packet. The
+	// reflection chains of all the samples are advanced together
+	void ShadePixelPacket(uint32_t x, uint32_t y, uint32_t pixelCount, uint32_t width, uint32_t height,
+		const CpuCamera& camera, glm::vec3* colorsOut, RayCounters& counters) const;
+
+	glm::vec3 SampleSkybox(const glm::vec3& direction) const;
+
+	void RenderTile(uint32_t tileIndex, uint32_t tilesX, uint32_t tileSize, const CpuCamera& camera,
+		uint32_t width, uint32_t height, uint8_t* output, RayCounters& counters) const;
+
+	// #DXR Custom: CPU Tile Scheduler
+	// Adjusts m_autoTileSize from the load balance of the frame which just completed
+	void TuneTileSize(uint32_t width, uint32_t height);
+
+	// Closest or any hit of a ray against the BVH of a mesh, in object space
+	bool TraceMesh(const nv_helpers_dx12::BottomLevelBVH& bvh, const CpuMesh& mesh, const glm::vec3& origin,
+		const glm::vec3& direction, float tMin, bool anyHit, float& closest, uint32_t& primitiveIndex) const;
+
+	const CpuScene* m_scene = nullptr;
+	std::vector<PreparedInstance> m_preparedInstances;
+	std::vector<nv_helpers_dx12::BottomLevelBVH> m_meshBVHs;
+	CpuRenderStats m_stats;
+
+	// #DXR Custom: CPU Ray Packets
+	// Kernel and coherence threshold of the frame being rendered, nullptr if packets are disabled
+	CpuTraversal::TracePacketFunction m_tracePacket = nullptr;
+	uint32_t m_minPacketRays = 0;
+
+	// #DXR Custom: CPU Tile Scheduler
+	// Kept from frame to frame, and recreated when the requested thread count changes
+	std::unique_ptr<nv_helpers_dx12::ThreadPool> m_threadPool;
+	uint32_t m_autoTileSize = 0;			// 0 until the first auto-tuned frame
+};
@@ -22,10 +22,14 @@
 #include "Windowsx.h"
 
 #include "MeshDataUtility.h"
+#include "MeshLoader.h"
 #include "MaterialTypes.h"
 #include "ResourceUploadBatch.h"
 #include "WICTextureLoader.h"
+#include "CpuRaytracer.h"
 
+#include <algorithm>
+#include <chrono>
 #include <stdexcept>
 #include <random>
 
@@ -44,6 +48,9 @@ void D3D12HelloTriangle::OnInit()
 	nv_helpers_dx12::CameraManip.setWindowSize(GetWidth(), GetHeight());
 	nv_helpers_dx12::CameraManip.setLookat(glm::vec3(1.5f, 1.5f, 1.5f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
+	// #DXR Custom: Parallel Shader Compilation - overlapped with the rest of the initialization
+	StartShaderCompilation();
+
 	LoadPipeline();
 	LoadAssets();
 
@@ -63,7 +70,7 @@ void D3D12HelloTriangle::OnInit()
 	// rays (ray payload)
 	CreateRaytracingPipeline(); // #DXR
 
-	CreatePerInstanceConstantBuffers(); // #DXR Extra: Per-Instance Data
+	CreateMaterialTable(); // #DXR Custom: Material Table
 
 	// Create a constant buffers, with a color for each vertex of the triangle, for each
 	// triangle instance
@@ -196,7 +203,21 @@ void D3D12HelloTriangle::LoadPipeline()
 		}
 	}
 
-	ThrowIfFailed(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocator)));
+	// #DXR Custom: Frames In Flight
+	// Each frame in flight records its commands in its own allocator, and stages its constants in
+	// its own upload pages, which are reset once the GPU is done with the frame
+	m_uploadHeapFactory = std::make_unique<nv_helpers_dx12::D3D12MemoryHeapFactory>(
+		m_device.Get(), nv_helpers_dx12::kUploadHeapProps, D3D12_RESOURCE_FLAG_NONE,
+		D3D12_RESOURCE_STATE_GENERIC_READ);
+
+	nv_helpers_dx12::MemoryPoolDesc uploadPoolDesc;
+	uploadPoolDesc.strategy = nv_helpers_dx12::AllocationStrategy::Linear;
+	uploadPoolDesc.pageSizeInBytes = 64 * 1024;
+	for (UINT n = 0; n < FrameCount; n++)
+	{
+		ThrowIfFailed(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_frameResources[n].commandAllocator)));
+		m_frameResources[n].uploadPool = std::make_unique<nv_helpers_dx12::MemoryPool>(*m_uploadHeapFactory, uploadPoolDesc);
+	}
 
 	// #DXR Extra: Depth Buffering
 	// The original sample does not support depth buffering, so we need to allocate a depth buffer,
@@ -229,9 +250,16 @@ void D3D12HelloTriangle::LoadAssets()
 
 		// #DXR Extra: Refitting (Rasterization)
 		// Per-instance properties index for the current geometry
+		// #DXR Custom: Draw Batching - now the offset of the current batch in its instance list
 		CD3DX12_ROOT_PARAMETER indexParameter;
 		indexParameter.InitAsConstants(1 /*value count*/, 1 /*register*/);
 
+		// #DXR Custom: Draw Batching
+		// Instances of the batches, indexed by the constant above plus SV_InstanceID. The list is
+		// written in the upload memory of the frame, hence a root descriptor rather than a table
+		CD3DX12_ROOT_PARAMETER drawInstancesParameter;
+		drawInstancesParameter.InitAsShaderResourceView(1 /*register*/);
+
 		// OLD: replaced by Perspective Camera
 		//CD3DX12_ROOT_SIGNATURE_DESC rootSignatureDesc;
 		//rootSignatureDesc.Init(0, nullptr, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
@@ -241,7 +269,7 @@ void D3D12HelloTriangle::LoadAssets()
 		//rootSignatureDesc.Init(1, &constantParameter, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
 		// #DXR Extra: Refitting (Rasterization)
-		std::vector<CD3DX12_ROOT_PARAMETER> params = { constantParameter, matricesParameter, indexParameter };
+		std::vector<CD3DX12_ROOT_PARAMETER> params = { constantParameter, matricesParameter, indexParameter, drawInstancesParameter };
 		CD3DX12_ROOT_SIGNATURE_DESC rootSignatureDesc;
 		rootSignatureDesc.Init(static_cast<UINT>(params.size()), params.data(), 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
@@ -254,18 +282,9 @@ void D3D12HelloTriangle::LoadAssets()
 
 	// Create the pipeline state, which includes compiling and loading shaders.
 	{
-		ComPtr<ID3DBlob> vertexShader;
-		ComPtr<ID3DBlob> pixelShader;
-
-#if defined(_DEBUG)
-		// Enable better shader debugging with the graphics debugging tools.
-		UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
-#else
-		UINT compileFlags = 0;
-#endif
-
-		ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, nullptr, "VSMain", "vs_5_0", compileFlags, 0, &vertexShader, nullptr));
-		ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, nullptr, "PSMain", "ps_5_0", compileFlags, 0, &pixelShader, nullptr));
+		// #DXR Custom: Parallel Shader Compilation - compiled by the jobs started in OnInit
+		ComPtr<ID3DBlob> vertexShader = m_vertexShaderJob.get();
+		ComPtr<ID3DBlob> pixelShader = m_pixelShaderJob.get();
 
 		// Define the vertex input layout.
 		D3D12_INPUT_ELEMENT_DESC inputElementDescs[] =
@@ -274,6 +293,18 @@ void D3D12HelloTriangle::LoadAssets()
 			{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
 		};
 
+		// #DXR Custom: Packed Vertices
+		// All the meshes share the position format. The padding lane of the packed positions holds 1,
+		// and their dequantization is folded into the instance matrices
+		MeshVertexLayout layout;
+		layout.positionFormat = m_vertexPositionFormat;
+		if (layout.IsPacked())
+		{
+			inputElementDescs[0].Format = layout.GetPositionFormat();
+			inputElementDescs[1].Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+			inputElementDescs[1].AlignedByteOffset = offsetof(PackedVertex, color);
+		}
+
 		// Describe and create the graphics pipeline state object (PSO).
 		D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
 		psoDesc.InputLayout = { inputElementDescs, _countof(inputElementDescs) };
@@ -301,56 +332,102 @@ void D3D12HelloTriangle::LoadAssets()
 	}
 
 	// Create the command list.
-	ThrowIfFailed(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator.Get(), m_pipelineState.Get(), IID_PPV_ARGS(&m_commandList)));
+	// The initialization work is recorded before the first frame, in the allocator of the first frame context
+	ThrowIfFailed(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_frameResources[0].commandAllocator.Get(), m_pipelineState.Get(), IID_PPV_ARGS(&m_commandList)));
 
 	
 
 	// Create the vertex and index buffers.
 	{
-		CreateMeshBuffers(MeshDataUtility::TetrahedronVertices, m_tetrahedronVertexBuffer, m_tetrahedronVertexBufferView,
-						  MeshDataUtility::TetrahedronIndices, m_tetrahedronIndexBuffer, m_tetrahedronIndexBufferView);
-		CreateMeshBuffers(MeshDataUtility::PlaneVertices, m_planeVertexBuffer, m_planeVertexBufferView,
-						  MeshDataUtility::PlaneIndices, m_planeIndexBuffer, m_planeIndexBufferView);
+		// #DXR Custom: Mesh Cache
+		m_tetrahedronMesh = MeshView::FromVectors(MeshDataUtility::TetrahedronVertices, MeshDataUtility::TetrahedronIndices);
+		m_planeMesh = MeshView::FromVectors(MeshDataUtility::PlaneVertices, MeshDataUtility::PlaneIndices);
+
+		// #DXR Custom: Mesh Loader
+		if (!m_meshPath.empty())
+		{
+			LoadMeshFile();
+		}
+
+		// #DXR Custom: Mesh LOD
+		std::vector<uint32_t> tetrahedronLodIndices;
+		std::vector<uint32_t> planeLodIndices;
+		BuildMeshLods(m_tetrahedronMesh, m_tetrahedronLods, tetrahedronLodIndices);
+		BuildMeshLods(m_planeMesh, m_planeLods, planeLodIndices);
+
+		CreateMeshBuffers(m_tetrahedronMesh, m_tetrahedronVertexBuffer, m_tetrahedronVertexBufferView,
+						  m_tetrahedronIndexBuffer, m_tetrahedronIndexBufferView, m_tetrahedronLayout, tetrahedronLodIndices);
+		CreateMeshBuffers(m_planeMesh, m_planeVertexBuffer, m_planeVertexBufferView,
+						  m_planeIndexBuffer, m_planeIndexBufferView, m_planeLayout, planeLodIndices);
+		// #DXR Custom: Packed Vertices
+		CreateMeshFormatBuffer();
 		CreateSkyboxTextureBuffer();
 
 	}
 
 	// Create synchronization objects and wait until assets have been uploaded to the GPU.
 	{
-		ThrowIfFailed(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
-		m_fenceValue = 1;
-
-		// Create an event handle to use for frame synchronization.
-		m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-		if (m_fenceEvent == nullptr)
-		{
-			ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
-		}
+		// #DXR Custom: Frames In Flight
+		m_frameFence = std::make_unique<nv_helpers_dx12::D3D12TimelineFence>(m_device.Get(), m_commandQueue.Get());
+		m_frameRing = std::make_unique<nv_helpers_dx12::FrameContextRing>(*m_frameFence, FrameCount);
 
 		// Wait for the command list to execute; we are reusing the same command 
 		// list in our main loop but for now, we just want to wait for setup to 
 		// complete before continuing.
-		WaitForPreviousFrame();
+		m_frameRing->WaitForIdle();
 	}
 }
 
 // Update frame-based values.
 void D3D12HelloTriangle::OnUpdate()
 {
-	// #DXR Extra: Perspective Camera
-	UpdateCameraBuffer();
-	// #DXR Extra: Refitting (Rasterization)
-	UpdateInstancePropertiesBuffer();
-	
+	// #DXR Custom: Frames In Flight
+	// Wait until the GPU is done with the resources of this frame context, rather than for the
+	// previous frame. Its upload memory can then be reused for the constants of the new frame
+	m_frameRing->BeginFrame();
+	GetCurrentFrameResources().uploadPool->Reset();
+
+	// #DXR Custom: Pipeline Additions
+	UpdatePipelineAdditions();
+	// #DXR Custom: Incremental SBT
+	// The GPU is done with the SBT copy of this frame: write the records it is missing
+	m_sbtHelper.Patch(GetCurrentFrameResources().sbtStorage.Get(), m_rtStateObjectProps.Get(),
+		m_frameRing->GetFrameIndex());
+
 	// #DXR Extra: Refitting
 	// Increment the time counter at each frame, and update the corresponding instance matrix of the
 	// first triangle to animate its position
+	// #DXR Custom: Instance Store - moved before the culling, which then sees the new transform
 	m_time++;
-	m_instances[0].second =
+	m_transformHierarchy.SetLocalTransform(m_animatedNode,
 		XMMatrixScaling(0.5f, 0.5f, 0.5f) *
 		XMMatrixRotationAxis({ 0.0f, 1.0f, 0.0f }, static_cast<float>(m_time) / 50.0f) *
-		XMMatrixTranslation(0.0f, 0.1f * cosf(m_time / 20.0f), 0.0f);
+		XMMatrixTranslation(0.0f, 0.1f * cosf(m_time / 20.0f), 0.0f));
+	// #DXR Custom: Transform Hierarchy
+	UpdateInstanceTransforms();
 
+	// #DXR Extra: Perspective Camera
+	UpdateCameraBuffer();
+	// #DXR Custom: Instance Culling
+	CullInstances();
+	// #DXR Custom: Mesh LOD
+	SelectLods();
+	// #DXR Custom: Meshlets
+	if (m_raster)
+	{
+		CullMeshlets();
+	}
+	else
+	{
+		m_visibleMeshletRanges.clear();
+	}
+	// #DXR Custom: Material Table
+	UpdateMaterialTable();
+
+	// #DXR Extra: Refitting (Rasterization)
+	// #DXR Custom: Instance Store - once the transforms, masks and levels of detail are final.
+	// Only the changed instances are rewritten before the next TLAS update
+	UpdateInstanceBuffers();
 }
 
 // Render the scene.
@@ -366,16 +443,24 @@ void D3D12HelloTriangle::OnRender()
 	// Present the frame.
 	ThrowIfFailed(m_swapChain->Present(1, 0));
 
-	WaitForPreviousFrame();
+	// #DXR Custom: Frames In Flight
+	// Signal the end of the frame and move on to the next one without waiting for the GPU
+	m_frameRing->EndFrame();
+	m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
 }
 
 void D3D12HelloTriangle::OnDestroy()
 {
 	// Ensure that the GPU is no longer referencing resources that are about to be
 	// cleaned up by the destructor.
-	WaitForPreviousFrame();
-
-	CloseHandle(m_fenceEvent);
+	m_frameRing->WaitForIdle();
+
+	// #DXR Custom: Frames In Flight
+	const nv_helpers_dx12::FrameRingStats& ringStats = m_frameRing->GetStats();
+	char message[256];
+	sprintf_s(message, "Frames in flight: %llu frames, %u waits for the GPU (%.1f ms), %u deferred releases\n",
+		ringStats.frameCount, ringStats.blockingWaits, ringStats.waitMilliseconds, ringStats.releasedCount);
+	OutputDebugStringA(message);
 }
 
 void D3D12HelloTriangle::PopulateCommandList()
@@ -383,12 +468,18 @@ void D3D12HelloTriangle::PopulateCommandList()
 	// Command list allocators can only be reset when the associated 
 	// command lists have finished execution on the GPU; apps should use 
 	// fences to determine GPU execution progress.
-	ThrowIfFailed(m_commandAllocator->Reset());
+	// #DXR Custom: Frames In Flight - the allocator of the frame context is no
+	// longer in use since BeginFrame
+	ID3D12CommandAllocator* commandAllocator = GetCurrentFrameResources().commandAllocator.Get();
+	ThrowIfFailed(commandAllocator->Reset());
 
 	// However, when ExecuteCommandList() is called on a particular command 
 	// list, that command list can then be reset at any time and must be before 
 	// re-recording.
-	ThrowIfFailed(m_commandList->Reset(m_commandAllocator.Get(), m_pipelineState.Get()));
+	ThrowIfFailed(m_commandList->Reset(commandAllocator, m_pipelineState.Get()));
+
+	// #DXR Custom: Frames In Flight
+	CopyFrameConstants();
 
 	// Set necessary state.
 	m_commandList->SetGraphicsRootSignature(m_rootSignature.Get());
@@ -438,20 +529,41 @@ void D3D12HelloTriangle::PopulateCommandList()
 		m_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 		m_commandList->ClearRenderTargetView(rtvHandle, clearColor, 0, nullptr);
 
-		for (size_t i = 0; i < m_instances.size() - 1; i++) // Last instance is for plane, which used different command, thus .size() - 1
+		// #DXR Custom: Draw Batching
+		// The instances sharing a mesh and an index range are drawn by a single instanced draw
+		BuildDrawBatches();
+		m_commandList->SetGraphicsRootShaderResourceView(3, GetCurrentFrameResources().drawInstances.gpuAddress);
+
+		struct CommandListSink : public DrawCommandSink
 		{
-			m_commandList->SetGraphicsRoot32BitConstant(2, static_cast<UINT>(i), 0);
-			m_commandList->IASetVertexBuffers(0, 1, &m_tetrahedronVertexBufferView);
-			m_commandList->IASetIndexBuffer(&m_tetrahedronIndexBufferView);
-			m_commandList->DrawIndexedInstanced(12, 1, 0, 0, 0);
-		}
+			ID3D12GraphicsCommandList* commandList;
+			ID3D12PipelineState* pipelineState;
+			const D3D12_VERTEX_BUFFER_VIEW* vertexBufferViews[2];
+			const D3D12_INDEX_BUFFER_VIEW* indexBufferViews[2];
 
-		// #DXR Extra: Per-Instance Data
-		// In a way similar to triangle rendering, rasterize the plane
-		m_commandList->SetGraphicsRoot32BitConstant(2, static_cast<UINT>(m_instances.size()-1), 0);
-		m_commandList->IASetVertexBuffers(0, 1, &m_planeVertexBufferView);
-		m_commandList->IASetIndexBuffer(&m_planeIndexBufferView);
-		m_commandList->DrawIndexedInstanced(6, 1, 0, 0, 0);
+			void SetPipelineState(uint32_t) override { commandList->SetPipelineState(pipelineState); }
+			void SetMesh(uint32_t mesh) override
+			{
+				commandList->IASetVertexBuffers(0, 1, vertexBufferViews[mesh]);
+				commandList->IASetIndexBuffer(indexBufferViews[mesh]);
+			}
+			void SetInstanceOffset(uint32_t firstInstance) override
+			{
+				commandList->SetGraphicsRoot32BitConstant(2, firstInstance, 0);
+			}
+			void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex) override
+			{
+				commandList->DrawIndexedInstanced(indexCount, instanceCount, firstIndex, 0, 0);
+			}
+		};
+		CommandListSink sink;
+		sink.commandList = m_commandList.Get();
+		sink.pipelineState = m_pipelineState.Get();
+		sink.vertexBufferViews[kTetrahedronMesh] = &m_tetrahedronVertexBufferView;
+		sink.vertexBufferViews[kPlaneMesh] = &m_planeVertexBufferView;
+		sink.indexBufferViews[kTetrahedronMesh] = &m_tetrahedronIndexBufferView;
+		sink.indexBufferViews[kPlaneMesh] = &m_planeIndexBufferView;
+		m_drawBatcher.Record(sink);
 	}
 	else
 	{
@@ -461,7 +573,7 @@ void D3D12HelloTriangle::PopulateCommandList()
 		// Refit the top-level acceleration structure to account for the new transform matrix of the
 		// triangle. Note that the build contains a barrier, hence we can do the rendering in the
 		// same command list
-		CreateTopLevelAS(m_instances, true);
+		CreateTopLevelAS(true);
 
 		//const float clearColor[] = { 0.6f, 0.8f, 0.4f, 1.0f };
 		//m_commandList->ClearRenderTargetView(rtvHandle, clearColor, 0, nullptr);
@@ -485,9 +597,12 @@ void D3D12HelloTriangle::PopulateCommandList()
 		// shader, hit groups. As described in the CreateShaderBindingTable method,
 		// all SBT entries of a given type have the same size to allow a fixed stride.
 
+		// #DXR Custom: Incremental SBT - each frame in flight has its own copy of the SBT
+		ID3D12Resource* sbtStorage = GetCurrentFrameResources().sbtStorage.Get();
+
 		// The ray generation shaders are always at the beginning of the SBT.
 		uint32_t rayGenerationSectionSizeInBytes = m_sbtHelper.GetRayGenSectionSize();
-		desc.RayGenerationShaderRecord.StartAddress = m_sbtStorage->GetGPUVirtualAddress();
+		desc.RayGenerationShaderRecord.StartAddress = sbtStorage->GetGPUVirtualAddress();
 		desc.RayGenerationShaderRecord.SizeInBytes = rayGenerationSectionSizeInBytes;
 
 		// The miss shaders are in the second SBT section, right after the ray
@@ -496,14 +611,14 @@ void D3D12HelloTriangle::PopulateCommandList()
 		// also indicate the stride between the two miss shaders, which is the size
 		// of a SBT entry
 		uint32_t missSectionSizeInBytes = m_sbtHelper.GetMissSectionSize();
-		desc.MissShaderTable.StartAddress = m_sbtStorage->GetGPUVirtualAddress() + rayGenerationSectionSizeInBytes;
+		desc.MissShaderTable.StartAddress = sbtStorage->GetGPUVirtualAddress() + rayGenerationSectionSizeInBytes;
 		desc.MissShaderTable.SizeInBytes = missSectionSizeInBytes;
 		desc.MissShaderTable.StrideInBytes = m_sbtHelper.GetMissEntrySize();
 
 		// The hit groups section start after the miss shaders. In this sample we
 		// have one 1 hit per group for the triangle
 		uint32_t hitGroupsSectionSizeInBytes = m_sbtHelper.GetHitGroupSectionSize();
-		desc.HitGroupTable.StartAddress = m_sbtStorage->GetGPUVirtualAddress() + rayGenerationSectionSizeInBytes + missSectionSizeInBytes;
+		desc.HitGroupTable.StartAddress = sbtStorage->GetGPUVirtualAddress() + rayGenerationSectionSizeInBytes + missSectionSizeInBytes;
 		desc.HitGroupTable.SizeInBytes = hitGroupsSectionSizeInBytes;
 		desc.HitGroupTable.StrideInBytes = m_sbtHelper.GetHitGroupEntrySize();
 
@@ -545,28 +660,6 @@ void D3D12HelloTriangle::PopulateCommandList()
 	ThrowIfFailed(m_commandList->Close());
 }
 
-void D3D12HelloTriangle::WaitForPreviousFrame()
-{
-	// WAITING FOR THE FRAME TO COMPLETE BEFORE CONTINUING IS NOT BEST PRACTICE.
-	// This is code implemented as such for simplicity. The D3D12HelloFrameBuffering
-	// sample illustrates how to use fences for efficient resource usage and to
-	// maximize GPU utilization.
-
-	// Signal and increment the fence value.
-	const UINT64 fence = m_fenceValue;
-	ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), fence));
-	m_fenceValue++;
-
-	// Wait until the previous frame is finished.
-	if (m_fence->GetCompletedValue() < fence)
-	{
-		ThrowIfFailed(m_fence->SetEventOnCompletion(fence, m_fenceEvent));
-		WaitForSingleObject(m_fenceEvent, INFINITE);
-	}
-
-	m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
-}
-
 void D3D12HelloTriangle::CheckRaytracingSupport()
 {
 	D3D12_FEATURE_DATA_D3D12_OPTIONS5 options5 = {};
@@ -576,6 +669,10 @@ void D3D12HelloTriangle::CheckRaytracingSupport()
 	
 	if (options5.RaytracingTier < D3D12_RAYTRACING_TIER_1_0)
 		throw std::runtime_error("Raytracing not supported on device");
+
+	// #DXR Custom: Pipeline Additions
+	ComPtr<ID3D12Device7> device7;
+	m_pipelineAdditions = options5.RaytracingTier >= D3D12_RAYTRACING_TIER_1_1 && SUCCEEDED(m_device.As(&device7));
 }
 
 void D3D12HelloTriangle::OnKeyUp(UINT8 key)
@@ -595,6 +692,21 @@ void D3D12HelloTriangle::OnKeyUp(UINT8 key)
 			SetWindowText(Win32Application::GetHwnd(), windowText.c_str());
 		}
 	}
+	// #DXR Custom: Instance Culling
+	if (key == 'C')
+	{
+		m_instanceCulling = !m_instanceCulling;
+	}
+	// #DXR Custom: CPU Reference Renderer
+	if (key == 'R')
+	{
+		RenderCpuReference();
+	}
+	// #DXR Custom: Pipeline Additions
+	if (key == 'M')
+	{
+		ToggleReflectionVariant();
+	}
 	if (key == VK_ESCAPE)
 	{
 		PostQuitMessage(0);
@@ -613,23 +725,48 @@ void D3D12HelloTriangle::OnKeyUp(UINT8 key)
 /// <returns></returns>
 D3D12HelloTriangle::AccelerationStructureBuffers D3D12HelloTriangle::CreateBottomLevelAS(
 	std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vVertexBuffers,
-	std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vIndexBuffers)
+	std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vIndexBuffers,
+	const MeshVertexLayout& layout, UINT meshFormatSlot, const std::vector<MeshletDrawRange>& geometries)
 {
 	nv_helpers_dx12::BottomLevelASGenerator bottomLevelAS;
 
+	// #DXR Custom: Packed Vertices
+	// Packed positions are brought back to object space by the geometry transform, which is the
+	// dequantization stored at the start of the mesh format constants
+	ID3D12Resource* transformBuffer = layout.IsPacked() ? m_meshFormatBuffer.Get() : nullptr;
+	UINT64 transformOffset = layout.IsPacked() ? meshFormatSlot * kMeshFormatSlotSize : 0;
+
+	// #DXR Custom: Meshlets
+	// Large meshes are split in several geometries sharing the vertex buffer, so that the builder
+	// works on smaller pieces, and the hit shaders get one record per geometry
+	if (!geometries.empty() && !vVertexBuffers.empty() && !vIndexBuffers.empty())
+	{
+		for (const MeshletDrawRange& geometry : geometries)
+		{
+			bottomLevelAS.AddVertexBuffer(vVertexBuffers[0].first.Get(), 0,
+										  vVertexBuffers[0].second, layout.GetStride(),
+										  vIndexBuffers[0].first.Get(), geometry.firstIndex * sizeof(UINT),
+										  geometry.indexCount, transformBuffer, transformOffset, true,
+										  layout.GetPositionFormat());
+		}
+		vVertexBuffers.clear();
+	}
+
 	// Adding all vertex buffers and not transforming their position.
 	for (size_t i = 0; i < vVertexBuffers.size(); i++)
 	{
 		if (i < vIndexBuffers.size() && vIndexBuffers[i].second > 0)
 		{
 			bottomLevelAS.AddVertexBuffer(vVertexBuffers[i].first.Get(), 0,
-										  vVertexBuffers[i].second, sizeof(Vertex),
+										  vVertexBuffers[i].second, layout.GetStride(),
 										  vIndexBuffers[i].first.Get(), 0,
-										  vIndexBuffers[i].second, nullptr, 0, true);
+										  vIndexBuffers[i].second, transformBuffer, transformOffset, true,
+										  layout.GetPositionFormat());
 		}
 		else
 		{
-			bottomLevelAS.AddVertexBuffer(vVertexBuffers[i].first.Get(), 0, vVertexBuffers[i].second, sizeof(Vertex), 0, 0);
+			bottomLevelAS.AddVertexBuffer(vVertexBuffers[i].first.Get(), 0, vVertexBuffers[i].second, layout.GetStride(),
+										  transformBuffer, transformOffset, true, layout.GetPositionFormat());
 		}
 	}
 
@@ -645,6 +782,9 @@ D3D12HelloTriangle::AccelerationStructureBuffers D3D12HelloTriangle::CreateBotto
 	// Once the sizes are obtained, the application is responsible for allocating
 	// the necessary buffers. Since the entire generation will be done on the GPU,
 	// we can directly allocate those on the default heap
+	// #DXR Custom: GPU Memory Suballocation
+	// These buffers are committed resources rather than ranges of a MemoryPool: the AS
+	// generators take whole resources, and their UAV barriers would cover a whole pool page
 	AccelerationStructureBuffers buffers;
 	buffers.pScratch = nv_helpers_dx12::CreateBuffer(
 		m_device.Get(), scratchSizeInBytes,
@@ -669,18 +809,13 @@ D3D12HelloTriangle::AccelerationStructureBuffers D3D12HelloTriangle::CreateBotto
 /// Similarly, to the bottom-level AS generation, it is done in 3 steps: gathering
 /// the instances, computing the memory requirements for the AS and building the AS itself.
 /// </summary>
-/// <param name="instances">Pair of bottom level AS and matrix of the instance</param>
 /// <param name="updateOnly"> - if true, perform a refit instead of a full build</param>
-void D3D12HelloTriangle::CreateTopLevelAS(const std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>>& instances, bool updateOnly)
+void D3D12HelloTriangle::CreateTopLevelAS(bool updateOnly)
 {
 	if (!updateOnly)
 	{
-		// Gather all the instances into the builder helper
-		for (size_t i = 0; i < instances.size(); i++)
-		{
-			m_topLevelASGenerator.AddInstance(instances[i].first.Get(), instances[i].second, static_cast<UINT>(i), static_cast<UINT>(m_hitGroupsPerObject * i));
-		}
-
+		// #DXR Custom: Instance Store
+		// The instance descriptors are written by the instance store rather than by the generator
 		// As for the bottom-level AS, the building of the AS requires some scratch space
 		// to store temporary data in addition to the actual AS. In the case of the
 		// top-level AS, the instance descriptors also need to be stored in GPU memory.
@@ -688,10 +823,20 @@ void D3D12HelloTriangle::CreateTopLevelAS(const std::vector<std::pair<ComPtr<ID3
 		// descriptors) so that the application can allocate the corresponding memory.
 		UINT64 scratchSize, resultSize, instanceDescsSize;
 
-		m_topLevelASGenerator.ComputeASBufferSizes(m_device.Get(), true, &scratchSize, &resultSize, &instanceDescsSize);
+		m_topLevelASGenerator.ComputeASBufferSizes(m_device.Get(), true, m_instances.GetCount(),
+			&scratchSize, &resultSize, &instanceDescsSize);
+
+		// #DXR Custom: Frames In Flight
+		// The frames in flight may still use the previous buffers
+		if (m_topLevelASBuffers.pResult)
+		{
+			AccelerationStructureBuffers previousBuffers = m_topLevelASBuffers;
+			m_frameRing->DeferRelease([previousBuffers]() {});
+		}
 
 		// Create the scratch and result buffers. Since the build is all done on GPU,
-		// those can be allocated on the default heap
+		// those can be allocated on the default heap, as committed resources like the
+		// bottom-level buffers
 		m_topLevelASBuffers.pScratch = nv_helpers_dx12::CreateBuffer(
 			m_device.Get(), scratchSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
 			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nv_helpers_dx12::kDefaultHeapProps);
@@ -704,19 +849,41 @@ void D3D12HelloTriangle::CreateTopLevelAS(const std::vector<std::pair<ComPtr<ID3
 		// The buffer describing the instances: ID, shader binding information,
 		// matrices ... Those will be copied into the buffer by the helper through
 		// mapping, so the buffer has to be allocated on the upload heap.
-		m_topLevelASBuffers.pInstanceDesc = nv_helpers_dx12::CreateBuffer(
-			m_device.Get(), instanceDescsSize, D3D12_RESOURCE_FLAG_NONE,
-			D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+		// #DXR Custom: Frames In Flight
+		// The descriptors are rewritten by the CPU on each refit, so each frame in
+		// flight has its own buffer. The instance store tracks which instances each
+		// buffer is missing
+		for (UINT n = 0; n < FrameCount; n++)
+		{
+			if (m_frameResources[n].instanceDescs)
+			{
+				ComPtr<ID3D12Resource> previousDescs = m_frameResources[n].instanceDescs;
+				m_frameRing->DeferRelease([previousDescs]() {});
+			}
+			m_frameResources[n].instanceDescs = nv_helpers_dx12::CreateBuffer(
+				m_device.Get(), instanceDescsSize, D3D12_RESOURCE_FLAG_NONE,
+				D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+			// #DXR Custom: Instance Store - upload buffers can stay mapped
+			D3D12_RANGE readRange = { 0, 0 };
+			ThrowIfFailed(m_frameResources[n].instanceDescs->Map(0, &readRange,
+				reinterpret_cast<void**>(&m_frameResources[n].mappedInstanceDescs)));
+		}
+
+		// #DXR Custom: Instance Store
+		// The new buffers miss all the instances. Those of the current frame are written now for
+		// the build, the others on their next frame
+		m_instances.MarkAllChanged();
+		m_instances.WriteInstanceDescs(GetCurrentFrameResources().mappedInstanceDescs);
 	}
 	// After all the buffers are allocated, or if only an update is required,
 	// we can build the acceleration structure. Note that in the case of the update
 	// we also pass the existing AS as the 'previous' AS, so that it can be
 	// refitted in place.
 
-	m_topLevelASGenerator.Generate(m_commandList.Get(),
+	m_topLevelASGenerator.GenerateFromDescriptors(m_commandList.Get(),
 		m_topLevelASBuffers.pScratch.Get(),
 		m_topLevelASBuffers.pResult.Get(),
-		m_topLevelASBuffers.pInstanceDesc.Get(),
+		GetCurrentFrameResources().instanceDescs.Get(), m_instances.GetCount(),
 		updateOnly, m_topLevelASBuffers.pResult.Get());
 }
 
@@ -727,47 +894,107 @@ void D3D12HelloTriangle::CreateTopLevelAS(const std::vector<std::pair<ComPtr<ID3
 /// </summary>
 void D3D12HelloTriangle::CreateAccelerationStructures()
 {
+	// #DXR Custom: Mesh LOD
+	// One BLAS per level of detail, whose hit groups follow those of the previous levels in the
+	// SBT. The scratch buffers are kept until the command list is flushed below
+	std::vector<AccelerationStructureBuffers> lodBuffers;
+	UINT hitGroupOffset = 0;
+	auto createLodBottomLevelAS = [&](std::vector<MeshLod>& lods, ID3D12Resource* vertexBuffer, uint32_t vertexCount,
+		ID3D12Resource* indexBuffer, const MeshVertexLayout& layout, UINT meshFormatSlot)
+	{
+		for (MeshLod& lod : lods)
+		{
+			lodBuffers.push_back(CreateBottomLevelAS({ { vertexBuffer, vertexCount } },
+				{ { indexBuffer, lod.indexCount } }, layout, meshFormatSlot, lod.geometries));
+			lod.bottomLevelAS = lodBuffers.back().pResult;
+			lod.hitGroupOffset = hitGroupOffset;
+			hitGroupOffset += m_hitGroupsPerObject * static_cast<UINT>(lod.geometries.size());
+		}
+	};
+
 	// Build the bottom AS from the Triangle vertex buffer
-	AccelerationStructureBuffers bottomLevelBuffers =
-		CreateBottomLevelAS({ { m_tetrahedronVertexBuffer.Get(), 4 } }, { {m_tetrahedronIndexBuffer.Get(), 12} });
+	// #DXR Custom: Mesh Loader
+	// The counts come from the mesh data, as the tetrahedron can be replaced by a loaded mesh
+	createLodBottomLevelAS(m_tetrahedronLods, m_tetrahedronVertexBuffer.Get(), m_tetrahedronMesh.vertexCount,
+		m_tetrahedronIndexBuffer.Get(), m_tetrahedronLayout, kTetrahedronFormatSlot);
 
 	// #DXR Extra: Per-Instance Data
-	AccelerationStructureBuffers planeBottomLevelBuffers =
-		CreateBottomLevelAS({ {m_planeVertexBuffer.Get(), 4} }, { {m_planeIndexBuffer.Get(), 6} });
+	createLodBottomLevelAS(m_planeLods, m_planeVertexBuffer.Get(), m_planeMesh.vertexCount,
+		m_planeIndexBuffer.Get(), m_planeLayout, kPlaneFormatSlot);
+
+	// Full tetrahedron
+	AccelerationStructureBuffers bottomLevelBuffers = lodBuffers[0];
 
 	// Just one instance for now
-	m_instances =
-	{
-		//{bottomLevelBuffers.pResult, XMMatrixScaling(0.5f, 0.5f, 0.5f)},
-		//{bottomLevelBuffers.pResult, XMMatrixScaling(0.25f, 0.25f, 0.25f) * XMMatrixTranslation(1.0f, 1.0f, -1.0f)},
-		//{bottomLevelBuffers.pResult, XMMatrixScaling(5.0f, 5.0f, 5.0f) * XMMatrixTranslation(-5.0f, -5.0f, 5.0f)},
-		{bottomLevelBuffers.pResult, XMMatrixScaling(0.5f, 0.5f, 0.5f)},
-		{bottomLevelBuffers.pResult, XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixRotationAxis(XMVECTOR{0.0f, 1.0f, 0.0f}, XMConvertToRadians(135.0f)) * XMMatrixTranslation(1.0f, 0.0f, -1.0f)},
-		{bottomLevelBuffers.pResult, XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixRotationAxis(XMVECTOR{0.0f, 1.0f, 0.0f}, XMConvertToRadians(-135.0f)) * XMMatrixTranslation(-1.0f, 0.0f, -1.0f)},
-		{bottomLevelBuffers.pResult, XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixRotationAxis(XMVECTOR{0.0f, 1.0f, 0.0f}, XMConvertToRadians(45.0f)) * XMMatrixTranslation(1.0f, 0.0f, 1.0f)},
-		{bottomLevelBuffers.pResult, XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixRotationAxis(XMVECTOR{0.0f, 1.0f, 0.0f}, XMConvertToRadians(-45.0f)) * XMMatrixTranslation(-1.0f, 0.0f, 1.0f)},
-		{bottomLevelBuffers.pResult, XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixRotationAxis(XMVECTOR{0.0f, 1.0f, 0.0f}, XMConvertToRadians(-45.0f)) * XMMatrixTranslation(-2.0f, 0.0f, -2.0f)},
-		{bottomLevelBuffers.pResult, XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixRotationAxis(XMVECTOR{0.0f, 1.0f, 0.0f}, XMConvertToRadians(-45.0f)) * XMMatrixTranslation(-2.0f, 0.0f,  2.0f)},
-		{bottomLevelBuffers.pResult, XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixRotationAxis(XMVECTOR{0.0f, 1.0f, 0.0f}, XMConvertToRadians(-45.0f)) * XMMatrixTranslation( 2.0f, 0.0f,  2.0f)},
-		{bottomLevelBuffers.pResult, XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixRotationAxis(XMVECTOR{0.0f, 1.0f, 0.0f}, XMConvertToRadians(-45.0f)) * XMMatrixTranslation( 2.0f, 0.0f, -2.0f)},
+	// #DXR Custom: Instance Store - transforms of the instances, created below
+	// #DXR Custom: Transform Hierarchy - relative to the root node of the scene
+	std::vector<XMMATRIX> transforms =
+	{
+		//XMMatrixScaling(0.5f, 0.5f, 0.5f),
+		//XMMatrixScaling(0.25f, 0.25f, 0.25f) * XMMatrixTranslation(1.0f, 1.0f, -1.0f),
+		//XMMatrixScaling(5.0f, 5.0f, 5.0f) * XMMatrixTranslation(-5.0f, -5.0f, 5.0f),
+		XMMatrixScaling(0.5f, 0.5f, 0.5f),
+		XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixRotationAxis(XMVECTOR{0.0f, 1.0f, 0.0f}, XMConvertToRadians(135.0f)) * XMMatrixTranslation(1.0f, 0.0f, -1.0f),
+		XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixRotationAxis(XMVECTOR{0.0f, 1.0f, 0.0f}, XMConvertToRadians(-135.0f)) * XMMatrixTranslation(-1.0f, 0.0f, -1.0f),
+		XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixRotationAxis(XMVECTOR{0.0f, 1.0f, 0.0f}, XMConvertToRadians(45.0f)) * XMMatrixTranslation(1.0f, 0.0f, 1.0f),
+		XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixRotationAxis(XMVECTOR{0.0f, 1.0f, 0.0f}, XMConvertToRadians(-45.0f)) * XMMatrixTranslation(-1.0f, 0.0f, 1.0f),
+		XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixRotationAxis(XMVECTOR{0.0f, 1.0f, 0.0f}, XMConvertToRadians(-45.0f)) * XMMatrixTranslation(-2.0f, 0.0f, -2.0f),
+		XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixRotationAxis(XMVECTOR{0.0f, 1.0f, 0.0f}, XMConvertToRadians(-45.0f)) * XMMatrixTranslation(-2.0f, 0.0f,  2.0f),
+		XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixRotationAxis(XMVECTOR{0.0f, 1.0f, 0.0f}, XMConvertToRadians(-45.0f)) * XMMatrixTranslation( 2.0f, 0.0f,  2.0f),
+		XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixRotationAxis(XMVECTOR{0.0f, 1.0f, 0.0f}, XMConvertToRadians(-45.0f)) * XMMatrixTranslation( 2.0f, 0.0f, -2.0f),
 		// for some reason adding another entry to m_instances causes crash in the next UpdateCameraBuffer() call (line containing m_cameraBuffer->Map)
 		// #DXR Extra: Per-Instance Data
-		{planeBottomLevelBuffers.pResult, XMMatrixScaling(1000.0f, 1000.0f, 1000.0f) * XMMatrixTranslation(0.0f, -0.8f, 0.0f)}
+		XMMatrixScaling(1000.0f, 1000.0f, 1000.0f) * XMMatrixTranslation(0.0f, -0.8f, 0.0f)
 	};
-	CreateTopLevelAS(m_instances);
+	// #DXR Custom: Transform Hierarchy
+	// One node per instance below the root node, the first one being animated. The instances are
+	// created with the world transforms of their nodes
+	m_transformHierarchy.Clear();
+	uint32_t sceneNode = m_transformHierarchy.AddNode(TransformHierarchy::kNoParent, XMMatrixIdentity());
+	std::vector<uint32_t> instanceNodes(transforms.size());
+	for (size_t i = 0; i < transforms.size(); i++)
+	{
+		instanceNodes[i] = m_transformHierarchy.AddNode(sceneNode, transforms[i]);
+	}
+	m_animatedNode = instanceNodes[0];
+	m_transformHierarchy.Update();
+	m_nodeInstances.assign(m_transformHierarchy.GetNodeCount(), InstanceHandle());
+
+	// #DXR Custom: Instance Store
+	// The instances start with the full meshes, and their material index is their creation index
+	m_instances.Clear();
+	for (size_t i = 0; i < transforms.size(); i++)
+	{
+		bool isPlane = (i == transforms.size() - 1);
+		const MeshLod& lod = isPlane ? m_planeLods[0] : m_tetrahedronLods[0];
+		SceneInstanceDesc desc;
+		desc.bottomLevelAS = lod.bottomLevelAS->GetGPUVirtualAddress();
+		desc.hitGroupIndex = lod.hitGroupOffset;
+		desc.materialIndex = static_cast<uint32_t>(i);
+		desc.mesh = isPlane ? kPlaneMesh : kTetrahedronMesh;
+		m_nodeInstances[instanceNodes[i]] =
+			m_instances.Create(m_transformHierarchy.GetWorldTransform(instanceNodes[i]), desc);
+	}
+	// #DXR Custom: Mesh LOD
+	m_instanceLods.assign(m_instances.GetCount(), 0);
+	CreateTopLevelAS();
+
+	// #DXR Custom: Instance Culling
+	m_instanceCuller.Resize(m_instances.GetCount());
+	for (size_t i = 0; i < m_instances.GetCount(); i++)
+	{
+		UpdateInstanceBounds(i);
+	}
 
 	// Flush the command list and wait for it to finish
 	m_commandList->Close();
 	ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
 	m_commandQueue->ExecuteCommandLists(1, ppCommandLists);
-	m_fenceValue++;
-	m_commandQueue->Signal(m_fence.Get(), m_fenceValue);
-	m_fence->SetEventOnCompletion(m_fenceValue, m_fenceEvent);
-	WaitForSingleObject(m_fenceEvent, INFINITE);
+	m_frameRing->WaitForIdle();
 
 	// Once the command list is finished executing, reset it to be reused for
 	// rendering
-	ThrowIfFailed(m_commandList->Reset(m_commandAllocator.Get(), m_pipelineState.Get()));
+	ThrowIfFailed(m_commandList->Reset(GetCurrentFrameResources().commandAllocator.Get(), m_pipelineState.Get()));
 
 	// Store the AS buffers. The rest of the buffers will be released once we exit the function
 	m_bottomLevelAS = bottomLevelBuffers.pResult;
@@ -790,7 +1017,8 @@ ComPtr<ID3D12RootSignature> D3D12HelloTriangle::CreateRayGenSignature()
 		 {0 /*b0*/, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_CBV /*Camera Parameters*/, 3}
 		});
 
-	return rsc.Generate(m_device.Get(), true);
+	// #DXR Custom: Root Signature Cache - shared with the signatures of the same layout
+	return m_rootSignatureCache->GetOrCreate(m_device.Get(), rsc, true);
 }
 
 /// <summary>
@@ -805,22 +1033,21 @@ ComPtr<ID3D12RootSignature> D3D12HelloTriangle::CreateHitSignature()
 	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, 1);
 	rsc.AddHeapRangesParameter({
 		{2 /*t2*/, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1 /*2nd slot of the heap*/},
-	 	{3 /*t3*/, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2 /*3rd slot of the heap*/}
+	 	{3 /*t3*/, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2 /*3rd slot of the heap*/},
+		// #DXR Custom: Material Table
+		// The materials of all the instances are in a single table indexed by InstanceID(),
+		// rather than in a constant buffer bound in each hit group record
+		{4 /*t4-t6*/, 3, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 4 /*5th to 7th slots of the heap*/}
 		});
 	rsc.AddHeapRangesParameter({
 		{0 /*s0*/, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, 0 /*1st slot of the sampler heap*/}
 		});
+	// #DXR Custom: Packed Vertices
+	// Layout and dequantization of the vertex buffer bound in t0
+	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_CBV, 0 /*b0*/);
 
-	// #DXR Extra: Per-Instance Data
-	// The vertex colors may differ for each instance, so it is not possible to
-	// point to a single buffer in the heap. Instead we use the concept of root
-	// parameters, which are defined directly by a pointer in memory. In the
-	// shader binding table we will associate each hit shader instance with its
-	// constant buffer. Here we bind the buffer to the first slot, accessible in
-	// HLSL as register(b0)
-	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_CBV, 0);
-
-	return rsc.Generate(m_device.Get(), true);
+	// #DXR Custom: Root Signature Cache - shared with the signatures of the same layout
+	return m_rootSignatureCache->GetOrCreate(m_device.Get(), rsc, true);
 }
 
 /// <summary>
@@ -837,7 +1064,8 @@ ComPtr<ID3D12RootSignature> D3D12HelloTriangle::CreateMissSignature()
 	rsc.AddHeapRangesParameter({
 		{0 /*s0*/, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, 0 /*1st slot of the sampler heap*/}
 		});
-	return rsc.Generate(m_device.Get(), true);
+	// #DXR Custom: Root Signature Cache - shared with the signatures of the same layout
+	return m_rootSignatureCache->GetOrCreate(m_device.Get(), rsc, true);
 }
 
 /// <summary>
@@ -847,29 +1075,42 @@ ComPtr<ID3D12RootSignature> D3D12HelloTriangle::CreateMissSignature()
 /// </summary>
 void D3D12HelloTriangle::CreateRaytracingPipeline()
 {
-	nv_helpers_dx12::RayTracingPipelineGenerator pipeline(m_device.Get());
+	// #DXR Custom: Pipeline Additions - kept to add shaders later on
+	m_pipelineGenerator.reset(new nv_helpers_dx12::RayTracingPipelineGenerator(m_device.Get()));
+	nv_helpers_dx12::RayTracingPipelineGenerator& pipeline = *m_pipelineGenerator;
+	pipeline.SetAllowAdditions(m_pipelineAdditions);
+	// #DXR Custom: Root Signature Cache
+	if (!m_rootSignatureCache)
+	{
+		m_rootSignatureCache.reset(new RootSignatureCache("ShaderCache"));
+	}
 	
 	// The pipeline contains the DXIL code of all the shaders potentially executed
 	// during the raytracing process. This section compiles the HLSL code into a
 	// set of DXIL libraries. We chose to separate the code in several libraries
 	// by semantic (ray generation, hit, miss) for clarity. Any code layout can be
 	// used.
-	m_rayGenLibrary = nv_helpers_dx12::CompileShaderLibrary(L"RayGen.hlsl");
-	m_missLibrary = nv_helpers_dx12::CompileShaderLibrary(L"Miss.hlsl");
-	m_hitLibrary = nv_helpers_dx12::CompileShaderLibrary(L"Hit.hlsl");
+	// #DXR Custom: Parallel Shader Compilation
+	// The libraries were queued at the start of OnInit, and are awaited in turn
+	m_rayGenLibrary = WaitShaderLibrary(m_rayGenLibraryJob);
+	m_missLibrary = WaitShaderLibrary(m_missLibraryJob);
+	m_hitLibrary = WaitShaderLibrary(m_hitLibraryJob);
 
 	// #DXR Extra: Another Ray Type
-	m_shadowLibrary = nv_helpers_dx12::CompileShaderLibrary(L"ShadowRay.hlsl");
+	m_shadowLibrary = WaitShaderLibrary(m_shadowLibraryJob);
 	pipeline.AddLibrary(m_shadowLibrary.Get(), {L"ShadowClosestHit", L"ShadowMiss"});
 	m_shadowSignature = CreateHitSignature();
 
 	// #DXR Custom: Reflections
-	m_reflectionHitLibrary = nv_helpers_dx12::CompileShaderLibrary(L"ReflectionRay.hlsl");
-	m_reflectionMissLibrary = nv_helpers_dx12::CompileShaderLibrary(L"ReflectionMiss.hlsl");
+	m_reflectionHitLibrary = WaitShaderLibrary(m_reflectionHitLibraryJob);
+	m_reflectionMissLibrary = WaitShaderLibrary(m_reflectionMissLibraryJob);
 	pipeline.AddLibrary(m_reflectionHitLibrary.Get(), {L"ReflectionClosestHit"});
 	pipeline.AddLibrary(m_reflectionMissLibrary.Get(), {L"ReflectionMiss"});
 	m_reflectionSignature = CreateHitSignature();
 
+	// #DXR Custom: Parallel Shader Compilation
+	LogShaderCompilation();
+
 	// In a way similar to DLLs, each library is associated with a number of
 	// exported symbols. This has to be done explicitly in the lines below.
 	// Note that a single library can contain an arbitrary number of symbols,
@@ -952,13 +1193,209 @@ void D3D12HelloTriangle::CreateRaytracingPipeline()
 	pipeline.SetMaxRecursionDepth(3); // #DXR Custom: Simple Lighting - shading with shadows for reflected objects requires 3rd ray (raygen->reflection->shadow)
 
 	// Compile the pipeline for execution on the GPU
-	m_rtStateObject = pipeline.Generate();
+	// #DXR Custom: Pipeline Cache - unless a pipeline with the same description was already created
+	if (!m_pipelineCache)
+	{
+		m_pipelineCache.reset(new PipelineCache(std::unique_ptr<PipelineBlobStore>(new FilePipelineBlobStore("ShaderCache"))));
+	}
+	m_rtStateObject = m_pipelineCache->GetOrCreate(pipeline);
+
+	const PipelineCacheStats& pipelineStats = m_pipelineCache->GetStats();
+	char message[256];
+	sprintf_s(message, "Pipeline cache: %u memory hits, %u created (%u known from a previous run), %u collisions, "
+		"descriptions %.2f ms, creation %.2f ms\n", pipelineStats.memoryHitCount, pipelineStats.createCount,
+		pipelineStats.knownCount, pipelineStats.collisionCount, pipelineStats.describeMilliseconds,
+		pipelineStats.createMilliseconds);
+	OutputDebugStringA(message);
+
+	// #DXR Custom: Root Signature Cache
+	const RootSignatureCacheStats& rootSignatureStats = m_rootSignatureCache->GetStats();
+	sprintf_s(message, "Root signature cache: %u requests, %u distinct, %u signatures saved, %u created from disk, "
+		"%u serialized, %u collisions, hashing %.3f ms, creation %.3f ms\n", rootSignatureStats.requestCount,
+		static_cast<uint32_t>(m_rootSignatureCache->GetSize()), rootSignatureStats.sharedCount,
+		rootSignatureStats.diskHitCount, rootSignatureStats.serializeCount, rootSignatureStats.collisionCount,
+		rootSignatureStats.hashMilliseconds, rootSignatureStats.createMilliseconds);
+	OutputDebugStringA(message);
 
 	// Cast the state object into a properties object, allowing to later access
 	// the shader pointers by name
 	ThrowIfFailed(m_rtStateObject->QueryInterface(IID_PPV_ARGS(&m_rtStateObjectProps)));
 }
 
+// #DXR Custom: Pipeline Additions
+void D3D12HelloTriangle::ToggleReflectionVariant()
+{
+	if (!m_pipelineAdditions)
+	{
+		OutputDebugStringA("Pipeline additions: not supported by the device (raytracing tier 1.1 required)\n");
+		return;
+	}
+	if (m_reflectionVariantLibrary)
+	{
+		SetReflectionHitGroup(m_reflectionHitGroup == L"ReflectionHitGroup" ? L"ReflectionVariantHitGroup" :
+			L"ReflectionHitGroup");
+		return;
+	}
+	if (!m_reflectionVariantLibraryJob.valid())
+	{
+		ShaderCompileRequest request;
+		request.fileName = "ReflectionRay.hlsl";
+		request.targetProfile = "lib_6_3";
+		request.defines = { "REFLECTION_HIT_VARIANT" };
+		m_reflectionVariantLibraryJob = m_shaderJobs->Load(*m_shaderCache, request);
+	}
+}
+
+void D3D12HelloTriangle::UpdatePipelineAdditions()
+{
+	// Polled each frame, so that rendering goes on while the variant compiles
+	if (!m_reflectionVariantLibraryJob.valid() ||
+		m_reflectionVariantLibraryJob.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+	{
+		return;
+	}
+	ShaderLibraryJob job = m_reflectionVariantLibraryJob;
+	m_reflectionVariantLibraryJob = ShaderLibraryJob();
+	ComPtr<IDxcBlob> library;
+	try
+	{
+		library = WaitShaderLibrary(job);
+	}
+	catch (const std::runtime_error&)
+	{
+		// The compiler messages were shown, the variant can be compiled again with M
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	nv_helpers_dx12::RayTracingPipelineGenerator& pipeline = *m_pipelineGenerator;
+	m_reflectionVariantLibrary = library;
+	pipeline.AddLibrary(m_reflectionVariantLibrary.Get(), { L"ReflectionClosestHitVariant" });
+	pipeline.AddHitGroup(L"ReflectionVariantHitGroup", L"ReflectionClosestHitVariant");
+	pipeline.AddRootSignatureAssociation(m_reflectionSignature.Get(), { L"ReflectionVariantHitGroup" });
+
+	// The new state object holds the shaders of the previous one with the same identifiers, so the
+	// SBT records of the other hit groups remain valid
+	ComPtr<ID3D12StateObject> stateObject;
+	stateObject.Attach(pipeline.GenerateAddition(m_rtStateObject.Get()));
+	double additionMilliseconds = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+
+	// The previous state object is released once the frames in flight are done with it
+	ComPtr<ID3D12StateObject> previousStateObject = m_rtStateObject;
+	m_frameRing->DeferRelease([previousStateObject]() {});
+	m_rtStateObject = stateObject;
+	ThrowIfFailed(m_rtStateObject->QueryInterface(IID_PPV_ARGS(&m_rtStateObjectProps)));
+
+	char message[256];
+	sprintf_s(message, "Pipeline additions: reflection hit variant added to the state object in %.2f ms\n",
+		additionMilliseconds);
+	OutputDebugStringA(message);
+	SetReflectionHitGroup(L"ReflectionVariantHitGroup");
+}
+
+void D3D12HelloTriangle::SetReflectionHitGroup(const std::wstring& hitGroup)
+{
+	// #DXR Custom: Incremental SBT
+	// The records are only marked as changed: each frame rewrites them in its own copy of the SBT
+	// once the GPU is done with it, without waiting for the other frames in flight
+	m_reflectionHitGroup = hitGroup;
+	for (UINT record : m_reflectionHitRecords)
+	{
+		m_sbtHelper.SetHitGroupProgram(record, m_reflectionHitGroup);
+	}
+
+	char message[256];
+	sprintf_s(message, "Pipeline additions: %u SBT records switched to %ls\n",
+		static_cast<UINT>(m_reflectionHitRecords.size()), m_reflectionHitGroup.c_str());
+	OutputDebugStringA(message);
+}
+
+// #DXR Custom: Parallel Shader Compilation
+void D3D12HelloTriangle::StartShaderCompilation()
+{
+	// #DXR Custom: Shader Cache - the libraries are only compiled when their sources change
+	m_shaderCompiler.reset(new DxcShaderCompiler());
+	m_shaderCache.reset(new ShaderCache(*m_shaderCompiler, "ShaderCache"));
+	m_shaderJobs.reset(new ShaderCompileJobs());
+	m_shaderJobsStart = std::chrono::steady_clock::now();
+
+	auto loadLibrary = [&](const char* fileName)
+	{
+		ShaderCompileRequest request;
+		request.fileName = fileName;
+		request.targetProfile = "lib_6_3";
+		return m_shaderJobs->Load(*m_shaderCache, request);
+	};
+	// The largest libraries are queued first, so that they do not finish last
+	m_hitLibraryJob = loadLibrary("Hit.hlsl");
+	m_reflectionHitLibraryJob = loadLibrary("ReflectionRay.hlsl");
+	m_rayGenLibraryJob = loadLibrary("RayGen.hlsl");
+	m_shadowLibraryJob = loadLibrary("ShadowRay.hlsl");
+	m_missLibraryJob = loadLibrary("Miss.hlsl");
+	m_reflectionMissLibraryJob = loadLibrary("ReflectionMiss.hlsl");
+
+	// The raster shaders are compiled by FXC, which is thread-safe, without going through the cache
+#if defined(_DEBUG)
+	// Enable better shader debugging with the graphics debugging tools.
+	UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#else
+	UINT compileFlags = 0;
+#endif
+	std::wstring shaderPath = GetAssetFullPath(L"shaders.hlsl");
+	auto compileRaster = [shaderPath, compileFlags](const char* entryPoint, const char* target)
+	{
+		return std::function<ComPtr<ID3DBlob>()>([shaderPath, compileFlags, entryPoint, target]()
+		{
+			ComPtr<ID3DBlob> shader;
+			ThrowIfFailed(D3DCompileFromFile(shaderPath.c_str(), nullptr, nullptr, entryPoint, target, compileFlags, 0,
+				&shader, nullptr));
+			return shader;
+		});
+	};
+	m_vertexShaderJob = m_shaderJobs->Run("shaders.hlsl VSMain", compileRaster("VSMain", "vs_5_0"));
+	m_pixelShaderJob = m_shaderJobs->Run("shaders.hlsl PSMain", compileRaster("PSMain", "ps_5_0"));
+}
+
+ComPtr<IDxcBlob> D3D12HelloTriangle::WaitShaderLibrary(const ShaderLibraryJob& job)
+{
+	try
+	{
+		return DxcShaderCompiler::CreateBlob(job.get());
+	}
+	catch (const std::runtime_error& error)
+	{
+		// As nv_helpers_dx12::CompileShaderLibrary, show the compiler messages
+		MessageBoxA(nullptr, error.what(), "Error!", MB_OK);
+		throw;
+	}
+}
+
+void D3D12HelloTriangle::LogShaderCompilation()
+{
+	m_shaderJobs->Wait();
+	double totalMilliseconds = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - m_shaderJobsStart).count();
+
+	char message[256];
+	for (const ShaderJobTiming& timing : m_shaderJobs->GetTimings())
+	{
+		sprintf_s(message, "Shader job: %s, %s, %.2f ms on thread %u after %.2f ms in queue\n", timing.name.c_str(),
+			timing.cacheHit ? "cache hit" : "compiled", timing.runMilliseconds, timing.threadIndex,
+			timing.queuedMilliseconds);
+		OutputDebugStringA(message);
+	}
+
+	// #DXR Custom: Shader Cache
+	ShaderCacheStats shaderStats = m_shaderCache->GetStats();
+	sprintf_s(message, "Shader cache: %u hits, %u misses (%u invalid entries), %u threads, all jobs done %.2f ms "
+		"after the start (keys %.2f ms, loads %.2f ms, compiles %.2f ms, writes %.2f ms, summed over the threads)\n",
+		shaderStats.hitCount, shaderStats.missCount, shaderStats.invalidEntryCount, m_shaderJobs->GetThreadCount(),
+		totalMilliseconds, shaderStats.keyMilliseconds, shaderStats.loadMilliseconds, shaderStats.compileMilliseconds,
+		shaderStats.writeMilliseconds);
+	OutputDebugStringA(message);
+}
+
 /// <summary>
 /// Allocate the buffer holding the raytracing output, with the same size as
 /// the output image
@@ -1001,7 +1438,7 @@ void D3D12HelloTriangle::CreateShaderResourceHeap()
 	// Create a SRV/UAV/CBV descriptor heap. We need 3 entries - 1 SRV for the TLAS, 1 UAV for the
 	// raytracing output and 1 CBV for the camera matrices
 	m_srvUavHeap = nv_helpers_dx12::CreateDescriptorHeap(
-		m_device.Get(), 4, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, true); //Add texture (4th slot)
+		m_device.Get(), 7, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, true); //Add texture (4th slot) // #DXR Custom: Material Table (5th to 7th slots)
 
 
 	// Get a handle to the heap memory on the CPU side, to be able to write the
@@ -1046,6 +1483,9 @@ void D3D12HelloTriangle::CreateShaderResourceHeap()
 	cbvDesc.SizeInBytes = m_cameraBufferSize;
 	m_device->CreateConstantBufferView(&cbvDesc, srvHandle);
 
+	// #DXR Custom: Material Table
+	CreateMaterialTableViews();
+
 	m_samplerHeap = nv_helpers_dx12::CreateDescriptorHeap(m_device.Get(), 1, D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER, true);
 
 	D3D12_CPU_DESCRIPTOR_HANDLE samplerHeapHandle = m_samplerHeap->GetCPUDescriptorHandleForHeapStart();
@@ -1078,6 +1518,10 @@ void D3D12HelloTriangle::CreateShaderBindingTable()
 	// The SVT helper class collects calls to Add*Program. If called several
 	// times, the helper must be emptied before re-adding shaders.
 	m_sbtHelper.Reset();
+	// #DXR Custom: Incremental SBT
+	m_sbtHelper.SetBufferCount(FrameCount);
+	// #DXR Custom: Pipeline Additions
+	m_reflectionHitRecords.clear();
 
 	// The pointer to the beginning of the heap is the only parameter required by
 	// shaders without root parameters
@@ -1112,57 +1556,78 @@ void D3D12HelloTriangle::CreateShaderBindingTable()
 	//m_sbtHelper.AddHitGroup(L"HitGroup", {(void*)(m_globalConstantBuffer->GetGPUVirtualAddress())});
 
 	// #DXR Extra: Per-Instance Data
-	// We have 3 triangles, each of which needs to access its own constant buffer
-	// as a root parameter in its primary hit shader. The shadow hit only sets a
+	// The materials are read from the material table using InstanceID(), so the
+	// records only hold the geometry and heap pointers. The shadow hit only sets a
 	// boolean visibility in the payload, and does not require external data
-	for (int i = 0; i < m_instances.size() - 1; i++) // Change depending on object (tetrahedron) count
-	{
-		m_sbtHelper.AddHitGroup(L"HitGroup", 
-			{ 
-				(void*)(m_tetrahedronVertexBuffer->GetGPUVirtualAddress()),
-				(void*)(m_tetrahedronIndexBuffer->GetGPUVirtualAddress()),
-				heapPointer,
-				samplerHeapPointer,
-				(void*)(m_perInstanceConstantBuffers[i]->GetGPUVirtualAddress())
-			}
-		);
-		m_sbtHelper.AddHitGroup(L"ShadowHitGroup", {});
-		m_sbtHelper.AddHitGroup(L"ReflectionHitGroup", 
-			{
-				(void*)(m_tetrahedronVertexBuffer->GetGPUVirtualAddress()),
-				(void*)(m_tetrahedronIndexBuffer->GetGPUVirtualAddress()),
-				heapPointer,
-				samplerHeapPointer,
-				(void*)(m_perInstanceConstantBuffers[i]->GetGPUVirtualAddress())
-			}
-		);
+	// #DXR Custom: Meshlets
+	// Each BLAS geometry gets its own set of hit groups, in the order of CreateBottomLevelAS.
+	// PrimitiveIndex() restarts at 0 in each geometry, so the index buffer of a record starts
+	// at the first index of its geometry
+	// #DXR Custom: Mesh LOD
+	// The hit groups are shared by all the instances of a level of detail, in the order of
+	// CreateAccelerationStructures, which sets the hit group offsets of the levels
+	for (const MeshLod& lod : m_tetrahedronLods)
+	{
+		for (const MeshletDrawRange& geometry : lod.geometries)
+		{
+			D3D12_GPU_VIRTUAL_ADDRESS indexAddress =
+				m_tetrahedronIndexBuffer->GetGPUVirtualAddress() + geometry.firstIndex * sizeof(UINT);
+			m_sbtHelper.AddHitGroup(L"HitGroup", 
+				{ 
+					(void*)(m_tetrahedronVertexBuffer->GetGPUVirtualAddress()),
+					(void*)(indexAddress),
+					heapPointer,
+					samplerHeapPointer,
+					(void*)(GetMeshFormatAddress(kTetrahedronFormatSlot)) // #DXR Custom: Packed Vertices
+				}
+			);
+			m_sbtHelper.AddHitGroup(L"ShadowHitGroup", {});
+			m_reflectionHitRecords.push_back(m_sbtHelper.AddHitGroup(m_reflectionHitGroup, 
+				{
+					(void*)(m_tetrahedronVertexBuffer->GetGPUVirtualAddress()),
+					(void*)(indexAddress),
+					heapPointer,
+					samplerHeapPointer,
+					(void*)(GetMeshFormatAddress(kTetrahedronFormatSlot)) // #DXR Custom: Packed Vertices
+				}
+			));
+		}
 	}
 
 	// The plane also uses a constant buffer for its vertex colors
 	//m_sbtHelper.AddHitGroup(L"HitGroup", { (void*)(m_perInstanceConstantBuffers[0]->GetGPUVirtualAddress()) });
 
 	// #DXR Extra: Per-Instance Data (Plane)
-	m_sbtHelper.AddHitGroup(L"HitGroup", 
-		{
-			(void*)(m_planeVertexBuffer->GetGPUVirtualAddress()), // #DXR Custom : Directional Shadows
-			(void*)(m_planeIndexBuffer->GetGPUVirtualAddress()), // #DXR Custom : Indexed Plane
-			heapPointer,
-			samplerHeapPointer,
-			(void*)(m_perInstanceConstantBuffers[m_instances.size() - 1]->GetGPUVirtualAddress())
-		}
-	); // #DXR Extra: Another Ray Type (add heap pointer)
-	m_sbtHelper.AddHitGroup(L"ShadowHitGroup", {});
-
-	// #DXR Custom: Reflections
-	m_sbtHelper.AddHitGroup(L"ReflectionHitGroup",
+	for (const MeshLod& lod : m_planeLods)
+	{
+		for (const MeshletDrawRange& geometry : lod.geometries)
 		{
-			(void*)(m_planeVertexBuffer->GetGPUVirtualAddress()),
-			(void*)(m_planeIndexBuffer->GetGPUVirtualAddress()),
-			heapPointer,
-			samplerHeapPointer,
-			(void*)(m_perInstanceConstantBuffers[m_instances.size() - 1]->GetGPUVirtualAddress())
+			D3D12_GPU_VIRTUAL_ADDRESS indexAddress =
+				m_planeIndexBuffer->GetGPUVirtualAddress() + geometry.firstIndex * sizeof(UINT);
+			m_sbtHelper.AddHitGroup(L"HitGroup", 
+				{
+					(void*)(m_planeVertexBuffer->GetGPUVirtualAddress()), // #DXR Custom : Directional Shadows
+					(void*)(indexAddress), // #DXR Custom : Indexed Plane
+					heapPointer,
+					samplerHeapPointer,
+					(void*)(GetMeshFormatAddress(kPlaneFormatSlot)) // #DXR Custom: Packed Vertices
+				}
+			); // #DXR Extra: Another Ray Type (add heap pointer)
+			m_sbtHelper.AddHitGroup(L"ShadowHitGroup", {});
+
+			// #DXR Custom: Reflections
+			// #DXR Custom: Pipeline Additions - with the hit group selected with M
+			m_reflectionHitRecords.push_back(m_sbtHelper.AddHitGroup(m_reflectionHitGroup,
+				{
+					(void*)(m_planeVertexBuffer->GetGPUVirtualAddress()),
+					(void*)(indexAddress),
+					heapPointer,
+					samplerHeapPointer,
+					(void*)(GetMeshFormatAddress(kPlaneFormatSlot))
+				}
+			));
 		}
-	);
+	}
 
 	// Compute the size of the SBT given the number of shaders and their parameters
 	uint32_t sbtSize = m_sbtHelper.ComputeSBTSize();
@@ -1170,16 +1635,27 @@ void D3D12HelloTriangle::CreateShaderBindingTable()
 	// Create the SBT on the upload heap. This is required as the helper will use
 	// mapping to write the SBT contents. After the SBT compilation it could be
 	// copied to the default heap for performance.
-	m_sbtStorage = nv_helpers_dx12::CreateBuffer(
-		m_device.Get(), sbtSize, D3D12_RESOURCE_FLAG_NONE,
-		D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
-	if (!m_sbtStorage)
+	// #DXR Custom: Incremental SBT
+	// Each frame in flight has its own copy, so that changed records are written
+	// while the GPU reads the copies of the previous frames
+	for (UINT n = 0; n < FrameCount; n++)
 	{
-		throw std::logic_error("Could not allocate the shader binding table");
-	}
+		if (m_frameResources[n].sbtStorage)
+		{
+			ComPtr<ID3D12Resource> previousStorage = m_frameResources[n].sbtStorage;
+			m_frameRing->DeferRelease([previousStorage]() {});
+		}
+		m_frameResources[n].sbtStorage = nv_helpers_dx12::CreateBuffer(
+			m_device.Get(), sbtSize, D3D12_RESOURCE_FLAG_NONE,
+			D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+		if (!m_frameResources[n].sbtStorage)
+		{
+			throw std::logic_error("Could not allocate the shader binding table");
+		}
 
-	// Compile the SBT from the shader and parameters info
-	m_sbtHelper.Generate(m_sbtStorage.Get(), m_rtStateObjectProps.Get());
+		// Compile the SBT from the shader and parameters info
+		m_sbtHelper.Generate(m_frameResources[n].sbtStorage.Get(), m_rtStateObjectProps.Get(), n);
+	}
 }
 
 
@@ -1198,9 +1674,12 @@ void D3D12HelloTriangle::CreateCameraBuffer()
 	m_cameraBufferSize = nbMatrix * sizeof(XMMATRIX);
 
 	// Create the constant buffer for all matrices
+	// #DXR Custom: Frames In Flight
+	// The buffer lives in the default heap and is updated by a copy at the start of each frame, so
+	// that the frames in flight do not overwrite the matrices used by the GPU
 	m_cameraBuffer = nv_helpers_dx12::CreateBuffer(
 		m_device.Get(), m_cameraBufferSize, D3D12_RESOURCE_FLAG_NONE,
-		D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+		D3D12_RESOURCE_STATE_COMMON, nv_helpers_dx12::kDefaultHeapProps);
 
 	////// Create a descriptor heap that will be used by the rasterization shaders
 	////m_constHeap = nv_helpers_dx12::CreateDescriptorHeap(
@@ -1232,7 +1711,7 @@ void D3D12HelloTriangle::CreateCameraBuffer()
 	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
 	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
 	srvDesc.Buffer.FirstElement = 0;
-	srvDesc.Buffer.NumElements = static_cast<UINT>(m_instances.size());
+	srvDesc.Buffer.NumElements = static_cast<UINT>(m_instances.GetCount());
 	srvDesc.Buffer.StructureByteStride = sizeof(InstanceProperties);
 	srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
 	// Write the per-instance buffer view in the heap
@@ -1266,11 +1745,15 @@ void D3D12HelloTriangle::UpdateCameraBuffer()
 	matrices[2] = XMMatrixInverse(&det, matrices[0]);
 	matrices[3] = XMMatrixInverse(&det, matrices[1]);
 
+	// #DXR Custom: Meshlets
+	XMStoreFloat4x4(&m_cameraView, matrices[0]);
+	XMStoreFloat4x4(&m_cameraProjection, matrices[1]);
+
 	// Copy the matrix contents
-	uint8_t *pData;
-	ThrowIfFailed(m_cameraBuffer->Map(0, nullptr, (void**)&pData));
-	memcpy(pData, matrices.data(), m_cameraBufferSize);
-	m_cameraBuffer->Unmap(0, nullptr);
+	// #DXR Custom: Frames In Flight - into the upload memory of the frame, see CopyFrameConstants
+	FrameResources& frame = GetCurrentFrameResources();
+	frame.cameraConstants = frame.uploadPool->Allocate(m_cameraBufferSize, nv_helpers_dx12::MemoryAlignment::ConstantBuffer);
+	memcpy(frame.cameraConstants.cpuAddress, matrices.data(), m_cameraBufferSize);
 }
 
 void D3D12HelloTriangle::OnButtonDown(UINT32 lParam)
@@ -1331,19 +1814,17 @@ void D3D12HelloTriangle::CreateGlobalConstantBuffer()
 	m_globalConstantBuffer->Unmap(0, nullptr);
 }
 
-// #DXR Extra: Per-Instance Data
-void D3D12HelloTriangle::CreatePerInstanceConstantBuffers()
+// #DXR Custom: Material Table
+void D3D12HelloTriangle::CreateMaterialTable()
 {
-	// Due to HLSL packing rules, we create the CB with 9 float4 (each needs to start on a 16-byte
-	// boundary)
 	std::random_device r;
 	std::default_random_engine el(r());
 	std::uniform_real_distribution<float> uniform_dist(0.0f, 1.0f);
 
 	//Material{XMVECTOR{0.8f, 0.8f, 0.8f}, XMVECTOR{0.08f, 0.08f, 0.08f}},
-	int instanceCount = static_cast<int>(m_instances.size());
-	Material* bufferData = new Material[instanceCount];
-	for (int i = 0; i < instanceCount - 1; i++)
+	uint32_t instanceCount = static_cast<uint32_t>(m_instances.GetCount());
+	m_instanceMaterials.resize(instanceCount);
+	for (uint32_t i = 0; i < instanceCount - 1; i++)
 	{
 		bool isMetal = (uniform_dist(el)) > 0.5f;
 		float r = uniform_dist(el);
@@ -1351,28 +1832,112 @@ void D3D12HelloTriangle::CreatePerInstanceConstantBuffers()
 		float b = uniform_dist(el);
 		XMVECTOR albedo = isMetal ? XMVECTOR{ 0.0f, 0.0f, 0.0f, 1.0f} : XMVECTOR{ r, g, b, 1.0f };
 		XMVECTOR specular = isMetal ? XMVECTOR{ r, g, b, 1.0f } : XMVECTOR{ 0.04f, 0.04f, 0.04f, 1.0f };
-		
-		bufferData[i] = Material{ albedo, specular };
+
+		m_instanceMaterials[i] = Material{ albedo, specular };
 	}
-	bufferData[instanceCount-1] = Material{ XMVECTOR{ 0.8f, 0.8f, 0.8f }, XMVECTOR{ 0.04f, 0.04f, 0.04f } };
+	m_instanceMaterials[instanceCount - 1] = Material{ XMVECTOR{ 0.8f, 0.8f, 0.8f }, XMVECTOR{ 0.04f, 0.04f, 0.04f } };
 
-	m_perInstanceConstantBuffers.resize(instanceCount);
-	int i(0);
-	for (auto& cb : m_perInstanceConstantBuffers)
+	// The table is indexed by InstanceID(), which is the material index of the instance, set to
+	// its creation index in CreateAccelerationStructures
+	m_materialTable.Resize(instanceCount);
+	for (uint32_t i = 0; i < instanceCount; i++)
 	{
-		const uint32_t bufferSize = sizeof(Material);
-		cb = nv_helpers_dx12::CreateBuffer(
-			m_device.Get(), bufferSize, D3D12_RESOURCE_FLAG_NONE,
-			D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+		m_materialTable.SetMaterial(i, m_instanceMaterials[i]);
+	}
 
-		uint8_t* pData;
-		ThrowIfFailed(cb->Map(0, nullptr, (void**)&pData));
-		memcpy(pData, &bufferData[i], bufferSize);
-		cb->Unmap(0, nullptr);
-		i++;
+	UpdateMaterialTable();
+
+	char message[256];
+	sprintf_s(message, "Material table: %u instances, %u unique materials, %llu bytes\n",
+		m_materialTable.GetInstanceCount(), m_materialTable.GetUniqueMaterialCount(), m_materialTableLayout.sizeInBytes);
+	OutputDebugStringA(message);
+}
+
+// #DXR Custom: Material Table
+void D3D12HelloTriangle::UpdateMaterialTable()
+{
+	if (!m_materialTable.HasChanges() && m_materialTableAllocation.IsValid())
+	{
+		return;
+	}
+
+	// #DXR Custom: Frames In Flight
+	// The table is shared by the frames in flight. Materials rarely change, so rather than
+	// versioning the table, the GPU is drained before it is rewritten in place
+	m_frameRing->WaitForIdle();
+
+	if (m_materialTableAllocation.IsValid() && m_materialTable.Fits(m_materialTableLayout))
+	{
+		m_materialTable.Upload(m_materialTableAllocation.cpuAddress, m_materialTableLayout, false);
+		return;
 	}
 
-	delete[] bufferData;
+	// #DXR Custom: GPU Memory Suballocation
+	// The table is the only allocation of its pool, so growing it simply restarts the pool. The
+	// capacities are doubled to amortize the reallocations when instances are added one by one
+	if (!m_materialTablePool)
+	{
+		nv_helpers_dx12::MemoryPoolDesc poolDesc;
+		poolDesc.strategy = nv_helpers_dx12::AllocationStrategy::Linear;
+		poolDesc.pageSizeInBytes = 64 * 1024;
+		m_materialTablePool = std::make_unique<nv_helpers_dx12::MemoryPool>(*m_uploadHeapFactory, poolDesc);
+	}
+	m_materialTablePool->Reset();
+
+	m_materialTableLayout = MaterialTable::ComputeLayout(
+		(std::max)(m_materialTable.GetInstanceCount(), 2 * m_materialTableLayout.instanceCapacity),
+		(std::max)(m_materialTable.GetMaterialSlotCount(), 2 * m_materialTableLayout.materialCapacity));
+	m_materialTableAllocation = m_materialTablePool->Allocate(m_materialTableLayout.sizeInBytes,
+		nv_helpers_dx12::MemoryAlignment::ConstantBuffer);
+	m_materialTable.Upload(m_materialTableAllocation.cpuAddress, m_materialTableLayout, true);
+
+	// The views of the previous buffer are replaced. On startup they are written along with the
+	// rest of the heap in CreateShaderResourceHeap
+	if (m_srvUavHeap)
+	{
+		CreateMaterialTableViews();
+	}
+}
+
+// #DXR Custom: Material Table
+void D3D12HelloTriangle::CreateMaterialTableViews()
+{
+	// The table starts at the 5th slot of the heap, after the camera constant buffer
+	UINT increment = m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	D3D12_CPU_DESCRIPTOR_HANDLE srvHandle = m_srvUavHeap->GetCPUDescriptorHandleForHeapStart();
+	srvHandle.ptr += 4 * increment;
+
+	ID3D12Resource* resource =
+		static_cast<nv_helpers_dx12::D3D12MemoryHeap*>(m_materialTableAllocation.heap)->GetResource();
+
+	// Each section is a structured buffer, whose first element is expressed in units of its stride
+	struct Section
+	{
+		uint64_t offset;
+		UINT elementCount;
+		UINT stride;
+	};
+	const Section sections[] =
+	{
+		{ m_materialTableLayout.instanceOffset, m_materialTableLayout.instanceCapacity, sizeof(uint32_t) },
+		{ m_materialTableLayout.albedoOffset, m_materialTableLayout.materialCapacity, sizeof(XMFLOAT4) },
+		{ m_materialTableLayout.specularOffset, m_materialTableLayout.materialCapacity, sizeof(XMFLOAT4) }
+	};
+
+	for (const Section& section : sections)
+	{
+		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		srvDesc.Buffer.FirstElement = (m_materialTableAllocation.offset + section.offset) / section.stride;
+		srvDesc.Buffer.NumElements = section.elementCount;
+		srvDesc.Buffer.StructureByteStride = section.stride;
+		srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+		m_device->CreateShaderResourceView(resource, &srvDesc, srvHandle);
+
+		srvHandle.ptr += increment;
+	}
 }
 
 // #DXR Extra: Depth Buffering
@@ -1417,37 +1982,125 @@ void D3D12HelloTriangle::CreateDepthBuffer()
 /// </summary>
 void D3D12HelloTriangle::CreateInstancePropertiesBuffer()
 {
-	uint32_t bufferSize = ROUND_UP(static_cast<uint32_t>(m_instances.size()) * sizeof(InstanceProperties),
+	static_assert(sizeof(InstanceProperties) == sizeof(XMFLOAT4X4), "The instance store writes the properties as matrices");
+	uint32_t bufferSize = ROUND_UP(m_instances.GetCount() * sizeof(InstanceProperties),
 									D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
 
 	// Create the constant buffer for all matrices
+	// #DXR Custom: Frames In Flight - updated by a copy like the camera buffer
 	m_instanceProperties = nv_helpers_dx12::CreateBuffer(
-		m_device.Get(), bufferSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ,
-		nv_helpers_dx12::kUploadHeapProps);
+		m_device.Get(), bufferSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COMMON,
+		nv_helpers_dx12::kDefaultHeapProps);
+
+	// #DXR Custom: Instance Store
+	// Each frame keeps its own copy of the matrices in upload memory, rather than allocating it
+	// from the upload pool of the frame, so that only the changed instances have to be written
+	for (UINT n = 0; n < FrameCount; n++)
+	{
+		m_frameResources[n].instanceProperties = nv_helpers_dx12::CreateBuffer(
+			m_device.Get(), bufferSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ,
+			nv_helpers_dx12::kUploadHeapProps);
+		D3D12_RANGE readRange = { 0, 0 };
+		ThrowIfFailed(m_frameResources[n].instanceProperties->Map(0, &readRange,
+			reinterpret_cast<void**>(&m_frameResources[n].mappedInstanceProperties)));
+	}
+	m_instances.MarkAllChanged();
 }
 
-/// <summary>
-/// Copy the per-instance data into the buffer
-/// </summary>
-void D3D12HelloTriangle::UpdateInstancePropertiesBuffer()
+// #DXR Custom: Transform Hierarchy
+void D3D12HelloTriangle::UpdateInstanceTransforms()
 {
-	InstanceProperties* current = nullptr;
-	CD3DX12_RANGE readRange(0, 0); // We do not intend to read from this resource on the CPU.
-	ThrowIfFailed(m_instanceProperties->Map(0, &readRange, reinterpret_cast<void**>(&current)));
-	for (const auto& inst : m_instances)
+	m_transformHierarchy.Update();
+	for (uint32_t node : m_transformHierarchy.GetChangedNodes())
 	{
-		current->objectToWorld = inst.second;
-		current++;
+		InstanceHandle instance = m_nodeInstances[node];
+		if (!m_instances.IsValid(instance))
+		{
+			continue;
+		}
+		uint32_t index = m_instances.GetIndex(instance);
+		m_instances.SetTransform(index, m_transformHierarchy.GetWorldTransform(node));
+		// #DXR Custom: Instance Culling
+		UpdateInstanceBounds(index);
 	}
-	m_instanceProperties->Unmap(0, nullptr);
+}
 
+// #DXR Custom: Instance Store
+void D3D12HelloTriangle::UpdateInstanceBuffers()
+{
+	// #DXR Custom: Packed Vertices
+	// The vertex shader reads packed positions in [-1, 1], which the dequantization brings back to
+	// object space before the instance matrix
+	XMFLOAT4X4 meshVertexTransforms[2];
+	XMStoreFloat4x4(&meshVertexTransforms[kTetrahedronMesh], m_tetrahedronLayout.IsPacked() ?
+		m_tetrahedronLayout.quantization.GetMatrix() : XMMatrixIdentity());
+	XMStoreFloat4x4(&meshVertexTransforms[kPlaneMesh], m_planeLayout.IsPacked() ?
+		m_planeLayout.quantization.GetMatrix() : XMMatrixIdentity());
+
+	// #DXR Custom: Frames In Flight - into the buffers of the frame, see CopyFrameConstants
+	FrameResources& frame = GetCurrentFrameResources();
+	m_instances.WriteChanges(m_frameRing->GetFrameIndex(), meshVertexTransforms, frame.mappedInstanceProperties,
+		frame.mappedInstanceDescs);
+}
+
+// #DXR Custom: Frames In Flight
+void D3D12HelloTriangle::CopyFrameConstants()
+{
+	FrameResources& frame = GetCurrentFrameResources();
+
+	// Buffers are implicitly promoted from the common state to copy destinations, and decay back
+	// to the common state at the end of the frame
+	auto copyFromUpload = [this](ID3D12Resource* destination, const nv_helpers_dx12::MemoryAllocation& source)
+	{
+		ID3D12Resource* uploadBuffer = static_cast<nv_helpers_dx12::D3D12MemoryHeap*>(source.heap)->GetResource();
+		m_commandList->CopyBufferRegion(destination, 0, uploadBuffer, source.offset, source.size);
+	};
+	copyFromUpload(m_cameraBuffer.Get(), frame.cameraConstants);
+	// #DXR Custom: Instance Store - the copy of the frame holds all the instances
+	m_commandList->CopyBufferRegion(m_instanceProperties.Get(), 0, frame.instanceProperties.Get(), 0,
+		m_instances.GetCount() * sizeof(InstanceProperties));
+
+	// The camera is read as a constant buffer by the vertex and raytracing shaders, the instance
+	// properties as a structured buffer by the vertex shader
+	D3D12_RESOURCE_STATES readState =
+		D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+	CD3DX12_RESOURCE_BARRIER barriers[] =
+	{
+		CD3DX12_RESOURCE_BARRIER::Transition(m_cameraBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, readState),
+		CD3DX12_RESOURCE_BARRIER::Transition(m_instanceProperties.Get(), D3D12_RESOURCE_STATE_COPY_DEST, readState)
+	};
+	m_commandList->ResourceBarrier(_countof(barriers), barriers);
 }
 
 void D3D12HelloTriangle::CreateMeshBuffers(
-	std::vector<Vertex>& vertices, ComPtr<ID3D12Resource>& vertexBuffer, D3D12_VERTEX_BUFFER_VIEW &vertexBufferView, 
-	std::vector<UINT>& indices, ComPtr<ID3D12Resource>& indexBuffer, D3D12_INDEX_BUFFER_VIEW &indexBufferView)
+	const MeshView& mesh, ComPtr<ID3D12Resource>& vertexBuffer, D3D12_VERTEX_BUFFER_VIEW &vertexBufferView,
+	ComPtr<ID3D12Resource>& indexBuffer, D3D12_INDEX_BUFFER_VIEW &indexBufferView, MeshVertexLayout& layout,
+	const std::vector<uint32_t>& lodIndices)
 {
-	const UINT vertexBufferSize = static_cast<UINT>(vertices.size()) * sizeof(Vertex);
+	// #DXR Custom: Packed Vertices
+	// The positions are quantized in the bounds of the mesh. The vertices are packed into a
+	// temporary copy rather than into the upload heap, so that the error can be measured without
+	// reading back write-combined memory
+	layout = MeshVertexLayout();
+	layout.positionFormat = m_vertexPositionFormat;
+	std::vector<PackedVertex> packedVertices;
+	if (layout.IsPacked())
+	{
+		layout.quantization = VertexPacking::ComputeQuantization(mesh.boundsMin, mesh.boundsMax);
+		packedVertices.resize(mesh.vertexCount);
+		VertexPacking::Encode(mesh.vertices, mesh.vertexCount, packedVertices.data(), layout.positionFormat, layout.quantization);
+
+		VertexPackingError error = VertexPacking::MeasureError(mesh.vertices, packedVertices.data(), mesh.vertexCount,
+			layout.positionFormat, layout.quantization);
+		char message[256];
+		sprintf_s(message, "Packed vertices: %u vertices, %llu -> %llu bytes, position error max %g (%.2e of the diagonal) "
+			"rms %g, color error max %.4f\n",
+			mesh.vertexCount, error.sizeInBytes, error.packedSizeInBytes, error.maxPositionError,
+			error.relativePositionError, error.rmsPositionError, error.maxColorError);
+		OutputDebugStringA(message);
+	}
+
+	const UINT vertexBufferSize = mesh.vertexCount * layout.GetStride();
 
 	// Note: using upload heaps to transfer static data like vert buffers is not
 	// recommended. Every time the GPU needs it, the upload heap will be
@@ -1466,16 +2119,21 @@ void D3D12HelloTriangle::CreateMeshBuffers(
 	UINT8* pVertexDataBegin;
 	CD3DX12_RANGE readRange(0, 0); // We do not intend to read from this resource on the CPU.
 	ThrowIfFailed(vertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-	memcpy(pVertexDataBegin, vertices.data(), vertexBufferSize);
+	// #DXR Custom: Mesh Cache
+	// For cached meshes, the copy reads the mapped file directly
+	memcpy(pVertexDataBegin, layout.IsPacked() ? static_cast<const void*>(packedVertices.data()) : mesh.vertices,
+		vertexBufferSize);
 	vertexBuffer->Unmap(0, nullptr);
 
 	// Initialize the vertex buffer view.
 	vertexBufferView.BufferLocation = vertexBuffer->GetGPUVirtualAddress();
-	vertexBufferView.StrideInBytes = sizeof(Vertex);
+	vertexBufferView.StrideInBytes = layout.GetStride();
 	vertexBufferView.SizeInBytes = vertexBufferSize;
 
 	// #DXR Custom: Indexed Plane
-	const UINT indexBufferSize = static_cast<UINT>(indices.size()) * sizeof(UINT);
+	// #DXR Custom: Mesh LOD
+	const UINT meshIndexSize = mesh.indexCount * sizeof(UINT);
+	const UINT indexBufferSize = meshIndexSize + static_cast<UINT>(lodIndices.size() * sizeof(UINT));
 
 	CD3DX12_HEAP_PROPERTIES heapProperty = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
 	CD3DX12_RESOURCE_DESC bufferResource = CD3DX12_RESOURCE_DESC::Buffer(indexBufferSize);
@@ -1486,7 +2144,11 @@ void D3D12HelloTriangle::CreateMeshBuffers(
 	// Copy the triangle data to the index buffer
 	UINT8* pIndexDataBegin;
 	ThrowIfFailed(indexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pIndexDataBegin)));
-	memcpy(pIndexDataBegin, indices.data(), indexBufferSize);
+	memcpy(pIndexDataBegin, mesh.indices, meshIndexSize);
+	if (!lodIndices.empty())
+	{
+		memcpy(pIndexDataBegin + meshIndexSize, lodIndices.data(), lodIndices.size() * sizeof(UINT));
+	}
 	indexBuffer->Unmap(0, nullptr);
 
 	// Initialize the index buffer view
@@ -1495,6 +2157,375 @@ void D3D12HelloTriangle::CreateMeshBuffers(
 	indexBufferView.SizeInBytes = indexBufferSize;
 }
 
+// #DXR Custom: Packed Vertices
+/// <summary>
+/// Write the layout of the vertex buffer of each mesh, read by the hit shaders and by the BLAS
+/// builder for the dequantization transform
+/// </summary>
+void D3D12HelloTriangle::CreateMeshFormatBuffer()
+{
+	m_meshFormatBuffer = nv_helpers_dx12::CreateBuffer(
+		m_device.Get(), 2 * kMeshFormatSlotSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ,
+		nv_helpers_dx12::kUploadHeapProps);
+
+	uint8_t* pData;
+	ThrowIfFailed(m_meshFormatBuffer->Map(0, nullptr, reinterpret_cast<void**>(&pData)));
+	const std::pair<UINT, const MeshVertexLayout*> meshes[] =
+	{
+		{ kTetrahedronFormatSlot, &m_tetrahedronLayout },
+		{ kPlaneFormatSlot, &m_planeLayout }
+	};
+	for (const auto& mesh : meshes)
+	{
+		MeshFormatConstants constants = {};
+		mesh.second->quantization.GetTransform3x4(constants.dequantization);
+		constants.positionFormat = static_cast<uint32_t>(mesh.second->positionFormat);
+		constants.strideInBytes = mesh.second->GetStride();
+		memcpy(pData + mesh.first * kMeshFormatSlotSize, &constants, sizeof(constants));
+	}
+	m_meshFormatBuffer->Unmap(0, nullptr);
+}
+
+// #DXR Custom: Mesh LOD
+void D3D12HelloTriangle::BuildMeshLods(const MeshView& mesh, std::vector<MeshLod>& lods, std::vector<uint32_t>& lodIndices)
+{
+	LodChainStats stats;
+	std::vector<MeshLodLevel> levels = MeshSimplifier::BuildLodChain(mesh.vertices, mesh.vertexCount,
+		mesh.indices, mesh.indexCount, lodIndices, {}, &stats);
+
+	char message[256];
+	sprintf_s(message, "Mesh LOD: %zu levels, %u triangles in total for %u in the mesh, %.2f ms\n",
+		levels.size(), stats.totalTriangles, stats.sourceTriangles, stats.milliseconds);
+	OutputDebugStringA(message);
+
+	lods.clear();
+	lods.resize(levels.size());
+	for (size_t k = 0; k < levels.size(); k++)
+	{
+		MeshLod& lod = lods[k];
+		lod.firstIndex = levels[k].firstIndex;
+		lod.indexCount = levels[k].indexCount;
+		lod.error = levels[k].error;
+
+		sprintf_s(message, "Mesh LOD %zu: %u triangles, error %g\n", k, lod.indexCount / 3, lod.error);
+		OutputDebugStringA(message);
+
+		// #DXR Custom: Meshlets
+		// The mesh itself is in meshlet order when it was loaded with GetMeshLoadOptions, the
+		// simplified levels are ordered here, before their index buffer is created
+		const uint32_t* indices = mesh.indices;
+		if (k > 0)
+		{
+			uint32_t* levelIndices = lodIndices.data() + (lod.firstIndex - mesh.indexCount);
+			MeshletBuilder::OrderTriangles(mesh.vertices, mesh.vertexCount, levelIndices, lod.indexCount);
+			indices = levelIndices;
+		}
+		BuildMeshlets(mesh, indices, lod);
+	}
+}
+
+// #DXR Custom: Meshlets
+/// <summary>
+/// Build the meshlets of a level of detail for the CPU culling, and group them in BLAS geometries
+/// if the level is too large for a single one
+/// </summary>
+void D3D12HelloTriangle::BuildMeshlets(const MeshView& mesh, const uint32_t* indices, MeshLod& lod)
+{
+	MeshletStats stats;
+	MeshletBuilder::Build(mesh.vertices, mesh.vertexCount, indices, lod.indexCount, lod.meshlets, {}, &stats);
+
+	if (lod.indexCount / 3 > kMaxBlasGeometryTriangles)
+	{
+		lod.geometries = MeshletBuilder::SplitGeometries(lod.meshlets, kMaxBlasGeometryTriangles);
+	}
+	else
+	{
+		lod.geometries = { { 0, lod.indexCount } };
+	}
+	// The geometries are ranges of the whole index buffer
+	for (MeshletDrawRange& geometry : lod.geometries)
+	{
+		geometry.firstIndex += lod.firstIndex;
+	}
+
+	char message[256];
+	sprintf_s(message, "Meshlets: %u triangles, %u meshlets (%.1f vertices, %.1f triangles on average), "
+		"%zu BLAS geometries, %.2f ms on %u threads\n",
+		lod.indexCount / 3, stats.meshletCount, stats.averageVertexCount, stats.averageTriangleCount,
+		lod.geometries.size(), stats.milliseconds, stats.threadCount);
+	OutputDebugStringA(message);
+}
+
+/// <summary>
+/// Gather the visible meshlets of each instance in m_visibleMeshletRanges
+/// </summary>
+void D3D12HelloTriangle::CullMeshlets()
+{
+	// The raster pipeline does not cull the back faces, so only the frustum test applies
+	MeshletCullOptions options;
+	options.backface = false;
+
+	XMMATRIX viewProjection = XMLoadFloat4x4(&m_cameraView) * XMLoadFloat4x4(&m_cameraProjection);
+	m_visibleMeshletRanges.resize(m_instances.GetCount());
+	// #DXR Custom: Instance Culling - the instances outside of the frustum have no visible meshlets
+	for (std::vector<MeshletDrawRange>& ranges : m_visibleMeshletRanges)
+	{
+		ranges.clear();
+	}
+	for (uint32_t i : m_visibleInstances)
+	{
+		// The meshlet bounds are in the space of the float vertices, hence the instance matrix
+		// without the dequantization of packed meshes
+		XMFLOAT4X4 objectToClip;
+		XMMATRIX objectToWorld = m_instances.GetTransform(i);
+		XMStoreFloat4x4(&objectToClip, objectToWorld * viewProjection);
+
+		XMVECTOR det;
+		XMFLOAT4X4 viewToObject;
+		XMStoreFloat4x4(&viewToObject, XMMatrixInverse(&det, objectToWorld * XMLoadFloat4x4(&m_cameraView)));
+		XMFLOAT3 cameraPosition(viewToObject._41, viewToObject._42, viewToObject._43);
+
+		// #DXR Custom: Mesh LOD - the meshlets index the range of the level of detail
+		const MeshLod& lod = GetInstanceLod(i);
+		MeshletBuilder::Cull(lod.meshlets, objectToClip, cameraPosition, m_visibleMeshletRanges[i], options);
+		for (MeshletDrawRange& range : m_visibleMeshletRanges[i])
+		{
+			range.firstIndex += lod.firstIndex;
+		}
+	}
+}
+
+// #DXR Custom: Instance Culling
+void D3D12HelloTriangle::UpdateInstanceBounds(size_t instanceIndex)
+{
+	// As for the TLAS, the bounds of the full mesh also hold its other levels of detail. They are
+	// the bounds of the float vertices, hence the instance matrix without the dequantization of
+	// packed meshes
+	const MeshView& mesh = GetInstanceMesh(instanceIndex);
+	m_instanceCuller.SetInstanceBounds(static_cast<uint32_t>(instanceIndex), mesh.boundsMin, mesh.boundsMax,
+		m_instances.GetTransform(static_cast<uint32_t>(instanceIndex)));
+}
+
+void D3D12HelloTriangle::CullInstances()
+{
+	if (m_instanceCulling)
+	{
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection, XMLoadFloat4x4(&m_cameraView) * XMLoadFloat4x4(&m_cameraProjection));
+		m_instanceCuller.Cull(viewProjection, m_visibleInstances);
+	}
+	else
+	{
+		m_visibleInstances.resize(m_instances.GetCount());
+		for (size_t i = 0; i < m_instances.GetCount(); i++)
+		{
+			m_visibleInstances[i] = static_cast<uint32_t>(i);
+		}
+	}
+
+	// Only the instances whose visibility changed are rewritten on the next TLAS update
+	size_t next = 0;
+	for (size_t i = 0; i < m_instances.GetCount(); i++)
+	{
+		bool isVisible = next < m_visibleInstances.size() && m_visibleInstances[next] == i;
+		next += isVisible ? 1 : 0;
+		m_instances.SetMask(static_cast<uint32_t>(i),
+			isVisible ? (kInstanceMaskCamera | kInstanceMaskSecondary) : kInstanceMaskSecondary);
+	}
+}
+
+// #DXR Custom: Draw Batching
+void D3D12HelloTriangle::BuildDrawBatches()
+{
+	// #DXR Custom: Meshlets
+	// Only the visible meshlets of each instance are drawn. The ranges are missing if the raster
+	// mode was just enabled, in which case the whole meshes are drawn for this frame
+	// #DXR Custom: Mesh LOD - each instance draws its level of detail
+	bool culled = m_visibleMeshletRanges.size() == m_instances.GetCount();
+	m_drawBatcher.Clear();
+	// #DXR Custom: Instance Culling - only the instances in the frustum are drawn
+	for (uint32_t i : m_visibleInstances)
+	{
+		uint32_t mesh = m_instances.GetMesh(i);
+		if (!culled)
+		{
+			const MeshLod& lod = GetInstanceLod(i);
+			m_drawBatcher.Add(kRasterPipeline, mesh, lod.firstIndex, lod.indexCount, i);
+			continue;
+		}
+		for (const MeshletDrawRange& range : m_visibleMeshletRanges[i])
+		{
+			m_drawBatcher.Add(kRasterPipeline, mesh, range.firstIndex, range.indexCount, i);
+		}
+	}
+	m_drawBatcher.Build();
+
+	// The list is read in place from the upload memory, which keeps its size free to change
+	// with the culling. It is never empty, so that the root descriptor stays valid
+	const std::vector<uint32_t>& instances = m_drawBatcher.GetInstances();
+	FrameResources& frame = GetCurrentFrameResources();
+	frame.drawInstances = frame.uploadPool->Allocate((std::max)(instances.size(), size_t(1)) * sizeof(uint32_t),
+		nv_helpers_dx12::MemoryAlignment::ConstantBuffer);
+	if (!instances.empty())
+	{
+		memcpy(frame.drawInstances.cpuAddress, instances.data(), instances.size() * sizeof(uint32_t));
+	}
+}
+
+// #DXR Custom: Mesh LOD
+void D3D12HelloTriangle::SelectLods()
+{
+	glm::vec3 eye, center, up;
+	nv_helpers_dx12::CameraManip.getLookat(eye, center, up);
+	XMVECTOR eyePosition = XMVectorSet(eye.x, eye.y, eye.z, 1.0f);
+
+	// Pixels covered by a unit length at a unit distance from the eye, given by the vertical
+	// field of view of the projection
+	float pixelsPerUnit = 0.5f * static_cast<float>(GetHeight()) * m_cameraProjection._22;
+
+	for (size_t i = 0; i < m_instances.GetCount(); i++)
+	{
+		const std::vector<MeshLod>& lods = GetInstanceLods(i);
+		if (lods.size() < 2)
+		{
+			continue;
+		}
+
+		// Distance from the eye to the bounding sphere of the instance, kept beyond the near plane
+		const MeshView& mesh = GetInstanceMesh(i);
+		XMVECTOR boundsMin = XMLoadFloat3(&mesh.boundsMin);
+		XMVECTOR boundsMax = XMLoadFloat3(&mesh.boundsMax);
+		XMMATRIX transform = m_instances.GetTransform(static_cast<uint32_t>(i));
+		float scale = (std::max)((std::max)(XMVectorGetX(XMVector3Length(transform.r[0])),
+			XMVectorGetX(XMVector3Length(transform.r[1]))), XMVectorGetX(XMVector3Length(transform.r[2])));
+		float radius = 0.5f * scale * XMVectorGetX(XMVector3Length(XMVectorSubtract(boundsMax, boundsMin)));
+		XMVECTOR worldCenter = XMVector3TransformCoord(XMVectorScale(XMVectorAdd(boundsMin, boundsMax), 0.5f), transform);
+		float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(worldCenter, eyePosition))) - radius;
+		distance = (std::max)(distance, 0.1f);
+
+		// The errors grow with the levels
+		UINT selected = 0;
+		while (selected + 1 < lods.size() &&
+			lods[selected + 1].error * scale * pixelsPerUnit / distance <= kLodPixelError)
+		{
+			selected++;
+		}
+
+		if (selected != m_instanceLods[i])
+		{
+			m_instanceLods[i] = selected;
+			m_instances.SetBottomLevelAS(static_cast<uint32_t>(i), lods[selected].bottomLevelAS->GetGPUVirtualAddress(),
+				lods[selected].hitGroupOffset);
+		}
+	}
+}
+
+const D3D12HelloTriangle::MeshLod& D3D12HelloTriangle::GetInstanceLod(size_t instanceIndex) const
+{
+	return GetInstanceLods(instanceIndex)[m_instanceLods[instanceIndex]];
+}
+
+const std::vector<D3D12HelloTriangle::MeshLod>& D3D12HelloTriangle::GetInstanceLods(size_t instanceIndex) const
+{
+	return (m_instances.GetMesh(static_cast<uint32_t>(instanceIndex)) == kPlaneMesh) ? m_planeLods : m_tetrahedronLods;
+}
+
+const MeshView& D3D12HelloTriangle::GetInstanceMesh(size_t instanceIndex) const
+{
+	return (m_instances.GetMesh(static_cast<uint32_t>(instanceIndex)) == kPlaneMesh) ? m_planeMesh : m_tetrahedronMesh;
+}
+
+// #DXR Custom: Mesh Cache
+MeshLoadOptions D3D12HelloTriangle::GetMeshLoadOptions()
+{
+	// The mesh is scaled to the size of the tetrahedron, so that it fits the instance layout
+	MeshLoadOptions options;
+	options.normalizedSize = 2.0f;
+
+	// #DXR Custom: Mesh Optimizer
+	// Authoring order is rarely cache friendly. The reordering keeps the geometry, hence the BLAS
+	options.optimize = true;
+	return options;
+}
+
+// #DXR Custom: Mesh Loader
+void D3D12HelloTriangle::LoadMeshFile()
+{
+	int length = WideCharToMultiByte(CP_ACP, 0, m_meshPath.c_str(), -1, nullptr, 0, nullptr, nullptr);
+	std::string fileName(length > 0 ? length - 1 : 0, '\0');
+	WideCharToMultiByte(CP_ACP, 0, m_meshPath.c_str(), -1, &fileName[0], length, nullptr, nullptr);
+
+	// #DXR Custom: Mesh Cache
+	// Text meshes are converted to a cache next to them on the first run, and mapped on the
+	// following ones as long as the source is unchanged. Caches can also be given directly
+	char message[512];
+	const std::string cacheExtension = ".mcache";
+	bool isCache = fileName.size() > cacheExtension.size() &&
+		fileName.compare(fileName.size() - cacheExtension.size(), cacheExtension.size(), cacheExtension) == 0;
+	std::string cacheFileName = isCache ? fileName : fileName + cacheExtension;
+	FileStamp source;
+	bool hasSource = !isCache && MappedFile::GetStamp(fileName, source);
+	if (m_meshCache.Open(cacheFileName, hasSource ? &source : nullptr) &&
+		m_meshCache.GetMeshCount() > 0 && m_meshCache.GetMesh(0).indexCount > 0)
+	{
+		m_tetrahedronMesh = m_meshCache.GetMesh(0);
+		sprintf_s(message, "Mesh cache: %s, %u vertices, %u triangles, opened in %.3f ms\n",
+			cacheFileName.c_str(), m_tetrahedronMesh.vertexCount, m_tetrahedronMesh.indexCount / 3,
+			m_meshCache.GetStats().openMilliseconds);
+		OutputDebugStringA(message);
+		return;
+	}
+	m_meshCache.Close();
+	if (isCache)
+	{
+		OutputDebugStringA(("Mesh cache: " + cacheFileName + " is missing, out of date or corrupted\n").c_str());
+		return;
+	}
+
+	std::vector<Vertex> vertices;
+	std::vector<UINT> indices;
+	MeshLoadStats stats;
+	try
+	{
+		MeshLoader::Load(fileName, vertices, indices, GetMeshLoadOptions(), &stats);
+	}
+	catch (const std::runtime_error& error)
+	{
+		OutputDebugStringA((std::string("Mesh loader: ") + error.what() + "\n").c_str());
+		return;
+	}
+	if (indices.empty())
+	{
+		OutputDebugStringA(("Mesh loader: no triangle in " + fileName + "\n").c_str());
+		return;
+	}
+
+	MeshDataUtility::TetrahedronVertices.swap(vertices);
+	MeshDataUtility::TetrahedronIndices.swap(indices);
+	m_tetrahedronMesh = MeshView::FromVectors(MeshDataUtility::TetrahedronVertices, MeshDataUtility::TetrahedronIndices);
+
+	sprintf_s(message, "Mesh loader: %s, %u vertices (%u in file), %u triangles, %.1f ms "
+		"(parse %.1f ms, dedup %.1f ms) on %u threads, %.1f MB/s, %.2f Mtris/s\n",
+		fileName.c_str(), stats.vertexCount, stats.inputVertexCount, stats.triangleCount, stats.totalMilliseconds,
+		stats.parseMilliseconds, stats.deduplicateMilliseconds, stats.threadCount, stats.megabytesPerSecond,
+		stats.trianglesPerSecond / 1e6);
+	OutputDebugStringA(message);
+
+	// #DXR Custom: Mesh Optimizer
+	sprintf_s(message, "Mesh optimizer: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %u clusters, %.1f ms\n",
+		stats.optimization.before.acmr, stats.optimization.after.acmr, stats.optimization.before.atvr,
+		stats.optimization.after.atvr, stats.optimization.clusterCount, stats.optimization.milliseconds);
+	OutputDebugStringA(message);
+
+	// The cache is only used from the next run, the mesh being already loaded
+	MeshCacheStats cacheStats;
+	if (MeshCache::Write(cacheFileName, { m_tetrahedronMesh }, source, &cacheStats))
+	{
+		sprintf_s(message, "Mesh cache: wrote %s in %.1f ms\n", cacheFileName.c_str(), cacheStats.writeMilliseconds);
+		OutputDebugStringA(message);
+	}
+}
+
 void D3D12HelloTriangle::CreateSkyboxTextureBuffer()
 {
 	// Debug (check format)
@@ -1512,3 +2543,119 @@ void D3D12HelloTriangle::CreateSkyboxTextureBuffer()
 	uploadResourcesFinished.wait();
 }
 
+// #DXR Custom: CPU Reference Renderer
+void D3D12HelloTriangle::RenderCpuReference()
+{
+	CpuScene& scene = m_cpuScene;
+	scene = CpuScene();
+	// #DXR Custom: Mesh Cache
+	// The hierarchies stored in the mesh cache are reused instead of being rebuilt
+	// The meshes are indexed by the mesh identifiers of the instances, kTetrahedronMesh and kPlaneMesh
+	const MeshView* meshViews[] = { &m_tetrahedronMesh, &m_planeMesh };
+	scene.meshes.resize(_countof(meshViews));
+	for (size_t i = 0; i < _countof(meshViews); i++)
+	{
+		const MeshView& view = *meshViews[i];
+		CpuMesh& mesh = scene.meshes[i];
+		mesh.vertexData = reinterpret_cast<const uint8_t*>(view.vertices);
+		mesh.vertexCount = view.vertexCount;
+		mesh.vertexStrideInBytes = sizeof(Vertex);
+		mesh.indexData = view.indices;
+		mesh.indexCount = view.indexCount;
+		mesh.bvhNodes = view.bvhNodes;
+		mesh.bvhNodeCount = view.bvhNodeCount;
+		mesh.bvhPrimitiveIndices = view.bvhPrimitives;
+		mesh.bvhPrimitiveCount = view.bvhPrimitiveCount;
+		mesh.bvhMaxDepth = view.bvhMaxDepth;
+	}
+
+	scene.instances.resize(m_instances.GetCount());
+	for (size_t i = 0; i < m_instances.GetCount(); i++)
+	{
+		CpuInstance& instance = scene.instances[i];
+		instance.meshIndex = m_instances.GetMesh(static_cast<uint32_t>(i));
+		XMMATRIX objectToWorld = m_instances.GetTransform(static_cast<uint32_t>(i));
+		memcpy(instance.objectToWorld, &objectToWorld, sizeof(instance.objectToWorld));
+
+		XMFLOAT4 albedo, specular;
+		XMStoreFloat4(&albedo, m_instanceMaterials[i].albedo);
+		XMStoreFloat4(&specular, m_instanceMaterials[i].specularReflection);
+		instance.material.albedo = glm::vec3(albedo.x, albedo.y, albedo.z);
+		instance.material.specular = glm::vec3(specular.x, specular.y, specular.z);
+	}
+
+	// The skybox texture is created without sRGB conversion, so the raw UNORM values are used
+	ScratchImage skyboxImage, skyboxFloatImage;
+	if (SUCCEEDED(LoadFromWICFile(L"cape_hill.jpg", WIC_FLAGS_IGNORE_SRGB, nullptr, skyboxImage)) &&
+		SUCCEEDED(Convert(*skyboxImage.GetImage(0, 0, 0), DXGI_FORMAT_R32G32B32A32_FLOAT,
+			TEX_FILTER_DEFAULT, TEX_THRESHOLD_DEFAULT, skyboxFloatImage)))
+	{
+		const Image* image = skyboxFloatImage.GetImage(0, 0, 0);
+		scene.skybox.width = static_cast<uint32_t>(image->width);
+		scene.skybox.height = static_cast<uint32_t>(image->height);
+		scene.skybox.rgb.resize(image->width * image->height * 3);
+		for (size_t y = 0; y < image->height; y++)
+		{
+			const float* row = reinterpret_cast<const float*>(image->pixels + y * image->rowPitch);
+			for (size_t x = 0; x < image->width; x++)
+			{
+				float* dst = &scene.skybox.rgb[(y * image->width + x) * 3];
+				dst[0] = row[x * 4 + 0];
+				dst[1] = row[x * 4 + 1];
+				dst[2] = row[x * 4 + 2];
+			}
+		}
+	}
+
+	// Same matrices as in UpdateCameraBuffer. The memory layout of an XMMATRIX read by glm gives
+	// the equivalent column-vector matrix
+	XMMATRIX view;
+	const glm::mat4& mat = nv_helpers_dx12::CameraManip.getMatrix();
+	memcpy(&view, glm::value_ptr(mat), 16 * sizeof(float));
+	float fovAngleY = 45.0f * XM_PI / 180.0f;
+	XMMATRIX projection = XMMatrixPerspectiveFovRH(fovAngleY, m_aspectRatio, 0.1f, 1000.0f);
+
+	XMVECTOR det;
+	XMMATRIX viewI = XMMatrixInverse(&det, view);
+	XMMATRIX projectionI = XMMatrixInverse(&det, projection);
+
+	CpuCamera camera;
+	camera.viewInverse = glm::make_mat4(reinterpret_cast<const float*>(&viewI));
+	camera.projectionInverse = glm::make_mat4(reinterpret_cast<const float*>(&projectionI));
+
+	// #DXR Custom: CPU Tile Scheduler
+	// The default options tune the tile size from frame to frame
+	CpuRaytracer& raytracer = m_cpuRaytracer;
+	raytracer.SetScene(scene);
+
+	std::vector<uint8_t> image;
+	raytracer.Render(camera, GetWidth(), GetHeight(), image);
+	CpuRaytracer::WritePPM("cpu_reference.ppm", GetWidth(), GetHeight(), image);
+
+	const CpuRenderStats& stats = raytracer.GetStats();
+	char message[256];
+	sprintf_s(message, "CPU reference: %.2f ms, %u threads, %u tiles, %llu primary / %llu reflection / %llu shadow rays\n",
+		stats.renderMilliseconds, stats.threadCount, stats.tileCount,
+		stats.primaryRays, stats.reflectionRays, stats.shadowRays);
+	OutputDebugStringA(message);
+
+	// #DXR Custom: CPU Ray Packets
+	sprintf_s(message, "CPU reference: %s kernel, %.2f Mrays/s per thread, %llu rays in packets / %llu single rays\n",
+		CpuTraversal::GetKernelName(stats.kernel), stats.raysPerSecondPerThread * 1e-6,
+		stats.packetRays, stats.singleRays);
+	OutputDebugStringA(message);
+
+	// #DXR Custom: CPU Tile Scheduler
+	sprintf_s(message, "CPU reference: %ux%u tiles, load imbalance %.3f, tile timings written to cpu_reference_tiles.csv\n",
+		stats.tileSize, stats.tileSize, stats.loadImbalance);
+	OutputDebugStringA(message);
+	raytracer.WriteTileStats("cpu_reference_tiles.csv");
+
+	for (size_t i = 0; i < scene.meshes.size(); i++)
+	{
+		const nv_helpers_dx12::BVHBuildStats& bvhStats = raytracer.GetMeshBVH(i).stats;
+		sprintf_s(message, "CPU reference: mesh %zu BVH built in %.3f ms (%.0f triangles/s), %u triangles, %u nodes, SAH cost %.2f\n",
+			i, bvhStats.buildMilliseconds, bvhStats.trianglesPerSecond, bvhStats.triangleCount, bvhStats.nodeCount, bvhStats.sahCost);
+		OutputDebugStringA(message);
+	}
+}
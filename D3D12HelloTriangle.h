@@ -17,7 +17,23 @@
 #include "DXSample.h"
 #include "nv_helpers_dx12/TopLevelASGenerator.h"
 #include "nv_helpers_dx12/ShaderBindingTableGenerator.h"
+#include "nv_helpers_dx12/D3D12MemoryHeap.h"
+#include "nv_helpers_dx12/D3D12TimelineFence.h"
 #include "VertexTypes.h"
+#include "MaterialTypes.h"
+#include "MaterialTable.h"
+#include "MeshCache.h"
+#include "MeshletBuilder.h"
+#include "MeshSimplifier.h"
+#include "DrawBatcher.h"
+#include "InstanceCuller.h"
+#include "SceneInstanceStore.h"
+#include "TransformHierarchy.h"
+#include "DxcShaderCompiler.h"
+#include "ShaderCompileJobs.h"
+#include "PipelineCache.h"
+#include "RootSignatureCache.h"
+#include "CpuRaytracer.h"
 #include "DirectXTex.h"
 
 #include <memory>
@@ -42,6 +58,10 @@ public:
 	virtual void OnRender();
 	virtual void OnDestroy();
 
+	// #DXR Custom: Mesh Cache
+	// Options of the meshes loaded with -mesh, shared with the -convert-mesh converter
+	static MeshLoadOptions GetMeshLoadOptions();
+
 private:
 	static const UINT FrameCount = 2;
 
@@ -51,7 +71,6 @@ private:
 	ComPtr<IDXGISwapChain3> m_swapChain;
 	ComPtr<ID3D12Device5> m_device;
 	ComPtr<ID3D12Resource> m_renderTargets[FrameCount];
-	ComPtr<ID3D12CommandAllocator> m_commandAllocator;
 	ComPtr<ID3D12CommandQueue> m_commandQueue;
 	ComPtr<ID3D12RootSignature> m_rootSignature;
 	ComPtr<ID3D12DescriptorHeap> m_rtvHeap;
@@ -65,16 +84,51 @@ private:
 
 	// Synchronization objects.
 	UINT m_frameIndex;
-	HANDLE m_fenceEvent;
-	ComPtr<ID3D12Fence> m_fence;
-	UINT64 m_fenceValue;
+
+	// #DXR Custom: Frames In Flight
+	// Resources written by the CPU for a frame, which cannot be touched again until the GPU has
+	// executed that frame. The CPU records up to FrameCount frames ahead of the GPU
+	struct FrameResources
+	{
+		ComPtr<ID3D12CommandAllocator> commandAllocator;
+		// Staging memory of the per-frame constants, copied to the GPU buffers by the frame
+		std::unique_ptr<nv_helpers_dx12::MemoryPool> uploadPool;
+		nv_helpers_dx12::MemoryAllocation cameraConstants;
+		// #DXR Custom: Instance Store
+		// Instance matrices read by the vertex shader, copied to the GPU buffer by the frame. As
+		// the TLAS instance descriptors, they are kept mapped and written by the instance store,
+		// which only rewrites the instances changed since the frame last wrote them
+		ComPtr<ID3D12Resource> instanceProperties;
+		XMFLOAT4X4* mappedInstanceProperties = nullptr;
+		// #DXR Custom: Draw Batching - instances of the raster batches, read in place by the vertex shader
+		nv_helpers_dx12::MemoryAllocation drawInstances;
+		// Top-level AS instance descriptors, rewritten by the refits
+		ComPtr<ID3D12Resource> instanceDescs;
+		D3D12_RAYTRACING_INSTANCE_DESC* mappedInstanceDescs = nullptr;
+		// #DXR Custom: Incremental SBT
+		// Copy of the shader binding table, in which the SBT generator rewrites the records changed
+		// since the frame last wrote it
+		ComPtr<ID3D12Resource> sbtStorage;
+	};
+	FrameResources m_frameResources[FrameCount];
+	std::unique_ptr<nv_helpers_dx12::D3D12TimelineFence> m_frameFence;
+	std::unique_ptr<nv_helpers_dx12::FrameContextRing> m_frameRing;
+
+	/// <summary>
+	/// Resources of the frame being recorded
+	/// </summary>
+	FrameResources& GetCurrentFrameResources() { return m_frameResources[m_frameRing->GetFrameIndex()]; }
+
+	/// <summary>
+	/// Copy the per-frame constants from the upload memory of the frame to the GPU buffers
+	/// </summary>
+	void CopyFrameConstants();
 
 	bool m_raster = true;
 	
 	void LoadPipeline();
 	void LoadAssets();
 	void PopulateCommandList();
-	void WaitForPreviousFrame();
 
 	void CheckRaytracingSupport();
 	virtual void OnKeyUp(UINT8 key);
@@ -89,27 +143,67 @@ private:
 
 	ComPtr<ID3D12Resource> m_bottomLevelAS;
 
+	// #DXR Custom: Packed Vertices
+	/// Layout of the vertex buffer of a mesh, shared by the input layout, the BLAS and the hit shaders
+	struct MeshVertexLayout
+	{
+		VertexPositionFormat positionFormat = VertexPositionFormat::Float32;
+		VertexQuantization quantization;		// Identity for Float32
+
+		bool IsPacked() const { return positionFormat != VertexPositionFormat::Float32; }
+		UINT GetStride() const { return IsPacked() ? sizeof(PackedVertex) : sizeof(Vertex); }
+		DXGI_FORMAT GetPositionFormat() const
+		{
+			return positionFormat == VertexPositionFormat::Snorm16 ? DXGI_FORMAT_R16G16B16A16_SNORM :
+				positionFormat == VertexPositionFormat::Float16 ? DXGI_FORMAT_R16G16B16A16_FLOAT :
+				DXGI_FORMAT_R32G32B32_FLOAT;
+		}
+	};
+
 	nv_helpers_dx12::TopLevelASGenerator m_topLevelASGenerator;
 	AccelerationStructureBuffers m_topLevelASBuffers;
-	std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>> m_instances;
+	// #DXR Custom: Instance Store
+	// The dense index of an instance is its index in the instance properties and in the TLAS, and
+	// its material index is its InstanceID(). Its mesh identifier, kTetrahedronMesh or kPlaneMesh,
+	// selects its mesh, levels of detail and raster draws, whatever its dense index
+	SceneInstanceStore m_instances{ FrameCount };
+
+	// #DXR Custom: Transform Hierarchy
+	// The instances are nodes of the hierarchy, below a root node for the whole scene. Their world
+	// transforms are copied into the instance store when they change
+	TransformHierarchy m_transformHierarchy;
+	// Instance of each node, invalid for the nodes without one
+	std::vector<InstanceHandle> m_nodeInstances;
+	// Node moved in OnUpdate
+	uint32_t m_animatedNode = TransformHierarchy::kNoParent;
+
+	/// <summary>
+	/// Propagate the transforms of the hierarchy, and copy the world transforms of the changed
+	/// nodes into their instances
+	/// </summary>
+	void UpdateInstanceTransforms();
 
 	/// <summary>
 	/// Create the acceleration structure of an instance
 	/// </summary>
 	/// <param name="vVertexBuffers">pair of buffer and vertex count</param>
 	/// <returns>AccelerationStructureBuffers for TLAS</returns>
+	/// <param name="layout">format of the vertex buffers</param>
+	/// <param name="meshFormatSlot">slot of the dequantization transform of packed vertex buffers</param>
+	/// <param name="geometries">index ranges of the first index buffer, each becoming a geometry. The whole buffer is used if empty</param>
 	AccelerationStructureBuffers CreateBottomLevelAS(
 		std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vVertexBuffers,
-		std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vIndexBuffers = {});
+		std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> vIndexBuffers = {},
+		const MeshVertexLayout& layout = {}, UINT meshFormatSlot = 0,
+		const std::vector<MeshletDrawRange>& geometries = {});
 
 
 	// #DXR Extra: Refitting
 	/// <summary>
 	/// Create the main acceleration structure that holds all instances of the scene
 	/// </summary>
-	/// <param name="instances"> - pair of BLAS and transform</param>
 	/// <param name="updateOnly"> - if true, perform a refit instead of a full build</param>
-	void CreateTopLevelAS(const std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>>& instances, bool updateOnly = false);
+	void CreateTopLevelAS(bool updateOnly = false);
 
 	void CreateAccelerationStructures();
 
@@ -118,6 +212,9 @@ private:
 	ComPtr<ID3D12RootSignature> CreateRayGenSignature();
 	ComPtr<ID3D12RootSignature> CreateMissSignature();
 	ComPtr<ID3D12RootSignature> CreateHitSignature();
+	// #DXR Custom: Root Signature Cache
+	// Root signatures by layout: the hit, shadow and reflection hit groups share a single one
+	std::unique_ptr<RootSignatureCache> m_rootSignatureCache;
 
 	void CreateRaytracingPipeline();
 
@@ -125,16 +222,81 @@ private:
 	ComPtr<IDxcBlob> m_hitLibrary;
 	ComPtr<IDxcBlob> m_missLibrary;
 
+	// #DXR Custom: Shader Cache
+	// The DXIL libraries are compiled on the first launch, and mapped from the cache afterwards.
+	// Declared before the jobs, which use them until destroyed
+	std::unique_ptr<DxcShaderCompiler> m_shaderCompiler;
+	std::unique_ptr<ShaderCache> m_shaderCache;
+
+
+	// #DXR Custom: Parallel Shader Compilation
+	// All the shaders are compiled concurrently from the start of OnInit, and awaited where used
+	using ShaderLibraryJob = std::shared_future<std::shared_ptr<const ShaderBinary>>;
+	std::unique_ptr<ShaderCompileJobs> m_shaderJobs;
+	std::chrono::steady_clock::time_point m_shaderJobsStart;
+	ShaderLibraryJob m_rayGenLibraryJob;
+	ShaderLibraryJob m_missLibraryJob;
+	ShaderLibraryJob m_hitLibraryJob;
+	ShaderLibraryJob m_shadowLibraryJob;
+	ShaderLibraryJob m_reflectionHitLibraryJob;
+	ShaderLibraryJob m_reflectionMissLibraryJob;
+	std::shared_future<ComPtr<ID3DBlob>> m_vertexShaderJob;
+	std::shared_future<ComPtr<ID3DBlob>> m_pixelShaderJob;
+
+	/// <summary>
+	/// Queue the compilation of the raytracing libraries, through the shader cache, and of the
+	/// raster shaders
+	/// </summary>
+	void StartShaderCompilation();
+	/// <summary>
+	/// Wait for a DXIL library. Shows the compiler messages and rethrows if it failed to compile
+	/// </summary>
+	ComPtr<IDxcBlob> WaitShaderLibrary(const ShaderLibraryJob& job);
+	/// <summary>
+	/// Report the timings of the shader jobs, once all of them are complete
+	/// </summary>
+	void LogShaderCompilation();
+
 	ComPtr<ID3D12RootSignature> m_rayGenSignature;
 	ComPtr<ID3D12RootSignature> m_hitSignature;
 	ComPtr<ID3D12RootSignature> m_missSignature;
 
 	// Ray tracing pipeline state
 	ComPtr<ID3D12StateObject> m_rtStateObject;
+	// #DXR Custom: Pipeline Cache
+	// State objects by pipeline description, so that generating a known pipeline reuses it
+	std::unique_ptr<PipelineCache> m_pipelineCache;
 	// Ray tracing pipeline state properties, retaining the shader identifiers
 	// to use in the Shader Binding Table
 	ComPtr<ID3D12StateObjectProperties> m_rtStateObjectProps;
 
+	// #DXR Custom: Pipeline Additions
+	// The pipeline generator is kept once the state object is created, so that shaders can be added
+	// to it at runtime. The M key compiles a variant of the reflection hit in the background, adds
+	// it to the state object without compiling the other shaders again, and switches the reflection
+	// records of the SBT between the two hit groups
+	std::unique_ptr<nv_helpers_dx12::RayTracingPipelineGenerator> m_pipelineGenerator;
+	bool m_pipelineAdditions = false;			// Raytracing tier 1.1, checked by CheckRaytracingSupport
+	ShaderLibraryJob m_reflectionVariantLibraryJob;
+	ComPtr<IDxcBlob> m_reflectionVariantLibrary;
+	std::wstring m_reflectionHitGroup = L"ReflectionHitGroup";	// Used by the reflection records
+	std::vector<UINT> m_reflectionHitRecords;	// Indices of the reflection records in the hit groups of the SBT
+
+	/// <summary>
+	/// Queue the compilation of the reflection hit variant on the first press, then switch the
+	/// reflection records between the original hit group and the variant once it is added
+	/// </summary>
+	void ToggleReflectionVariant();
+	/// <summary>
+	/// Add the reflection hit variant to the state object once its library is compiled
+	/// </summary>
+	void UpdatePipelineAdditions();
+	/// <summary>
+	/// Point the reflection records of the SBT to a hit group. Only those records are rewritten, in
+	/// each copy of the SBT as its frame comes around
+	/// </summary>
+	void SetReflectionHitGroup(const std::wstring& hitGroup);
+
 
 	// #DXR
 	void CreateRaytracingOutputBuffer();
@@ -145,12 +307,14 @@ private:
 	// #DXR
 	void CreateShaderBindingTable();
 	nv_helpers_dx12::ShaderBindingTableGenerator m_sbtHelper;
-	ComPtr<ID3D12Resource> m_sbtStorage;
 
 	// #DXR Extra: Perspective Camera
 	void CreateCameraBuffer();
 	void UpdateCameraBuffer();
 	ComPtr<ID3D12Resource> m_cameraBuffer;
+	// #DXR Custom: Meshlets - matrices of the last camera update, for the CPU culling
+	XMFLOAT4X4 m_cameraView;
+	XMFLOAT4X4 m_cameraProjection;
 	ComPtr<ID3D12DescriptorHeap> m_constHeap;
 	uint32_t m_cameraBufferSize = 0;
 
@@ -165,9 +329,32 @@ private:
 	void D3D12HelloTriangle::CreateGlobalConstantBuffer();
 	ComPtr<ID3D12Resource> m_globalConstantBuffer;
 
-	// #DXR Extra: Per-Instance Data
-	void CreatePerInstanceConstantBuffers();
-	std::vector<ComPtr<ID3D12Resource>> m_perInstanceConstantBuffers;
+	// #DXR Custom: Material Table
+	/// <summary>
+	/// Assign a material to each instance and upload the material table
+	/// </summary>
+	void CreateMaterialTable();
+
+	/// <summary>
+	/// Upload the entries of the material table modified since the last call. The buffer is
+	/// reallocated, and its views rewritten, when the table outgrows it
+	/// </summary>
+	void UpdateMaterialTable();
+
+	/// <summary>
+	/// Write the views of the sections of the material table in the shader resource heap
+	/// </summary>
+	void CreateMaterialTableViews();
+
+	MaterialTable m_materialTable;
+	MaterialTableLayout m_materialTableLayout;
+
+	// #DXR Custom: GPU Memory Suballocation
+	// The material table and the per-frame constants are suballocated from persistently mapped
+	// upload pages
+	std::unique_ptr<nv_helpers_dx12::D3D12MemoryHeapFactory> m_uploadHeapFactory;
+	std::unique_ptr<nv_helpers_dx12::MemoryPool> m_materialTablePool;
+	nv_helpers_dx12::MemoryAllocation m_materialTableAllocation;
 
 	// #DXR Extra: Depth Buffering
 	void CreateDepthBuffer();
@@ -194,7 +381,12 @@ private:
 
 	ComPtr<ID3D12Resource> m_instanceProperties;
 	void CreateInstancePropertiesBuffer();
-	void UpdateInstancePropertiesBuffer();
+	// #DXR Custom: Instance Store
+	/// <summary>
+	/// Write the instance matrices and TLAS descriptors of the instances changed since the
+	/// current frame context last wrote them
+	/// </summary>
+	void UpdateInstanceBuffers();
 
 	// This value must be manually changed according to implemented setup in CreateShaderBindingTable()
 	int m_hitGroupsPerObject = 3;
@@ -210,9 +402,138 @@ private:
 
 
 	// #DXR Custom: Slight Code Refactor
+	// #DXR Custom: Mesh Cache
+	// The geometry is read through a view, which points either to MeshDataUtility or to the mapped cache
+	// #DXR Custom: Packed Vertices
+	// The vertices are packed if m_vertexPositionFormat is set, the layout receiving their quantization
+	// #DXR Custom: Mesh LOD
+	// The indices of the levels of detail are stored after the mesh indices
 	void CreateMeshBuffers(
-		std::vector<Vertex>& vertices, ComPtr<ID3D12Resource>& vertexBuffer, D3D12_VERTEX_BUFFER_VIEW& vertexBufferView,
-		std::vector<UINT>& indices, ComPtr<ID3D12Resource>& indexBuffer, D3D12_INDEX_BUFFER_VIEW& indexBufferView);
+		const MeshView& mesh, ComPtr<ID3D12Resource>& vertexBuffer, D3D12_VERTEX_BUFFER_VIEW& vertexBufferView,
+		ComPtr<ID3D12Resource>& indexBuffer, D3D12_INDEX_BUFFER_VIEW& indexBufferView, MeshVertexLayout& layout,
+		const std::vector<uint32_t>& lodIndices);
+
+	// #DXR Custom: Mesh Loader
+	// Replace the tetrahedron by the mesh of m_meshPath, keeping it if the file cannot be loaded
+	void LoadMeshFile();
+
+	// #DXR Custom: Mesh Cache
+	// Geometry of the meshes, used by the buffers, the acceleration structures and the CPU
+	// reference. Loaded meshes are mapped from m_meshCache, which stays open until destruction
+	MeshCache m_meshCache;
+	MeshView m_tetrahedronMesh;
+	MeshView m_planeMesh;
+
+	// #DXR Custom: Packed Vertices
+	/// Per-mesh constants of the hit shaders, matching the MeshFormat cbuffer of Hit.hlsl. The
+	/// dequantization is also the geometry transform of the BLAS of packed meshes
+	struct MeshFormatConstants
+	{
+		float dequantization[12];				// Row-major 3x4
+		uint32_t positionFormat;				// VertexPositionFormat
+		uint32_t strideInBytes;
+	};
+
+	// Slots of m_meshFormatBuffer, each aligned for a root constant buffer view
+	static const UINT kTetrahedronFormatSlot = 0;
+	static const UINT kPlaneFormatSlot = 1;
+	static const UINT kMeshFormatSlotSize = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+
+	MeshVertexLayout m_tetrahedronLayout;
+	MeshVertexLayout m_planeLayout;
+	ComPtr<ID3D12Resource> m_meshFormatBuffer;
+	void CreateMeshFormatBuffer();
+	D3D12_GPU_VIRTUAL_ADDRESS GetMeshFormatAddress(UINT slot) const
+	{
+		return m_meshFormatBuffer->GetGPUVirtualAddress() + slot * kMeshFormatSlotSize;
+	}
+
+	// #DXR Custom: Meshlets
+	// Meshes above this size are split in several BLAS geometries, each made of whole meshlets
+	static const uint32_t kMaxBlasGeometryTriangles = 1 << 20;
+
+	// #DXR Custom: Mesh LOD
+	/// Level of detail of a mesh: a range of its index buffer, with its own meshlets, BLAS and hit
+	/// groups. Level 0 is the full mesh
+	struct MeshLod
+	{
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;
+		float error = 0.0f;							// Estimated object-space distance to the full mesh
+		MeshletData meshlets;						// Triangle offsets relative to firstIndex
+		std::vector<MeshletDrawRange> geometries;	// Index ranges of the BLAS geometries, at least one
+		ComPtr<ID3D12Resource> bottomLevelAS;
+		UINT hitGroupOffset = 0;					// Hit group index of the first geometry
+	};
+
+	// Largest error of the selected levels, in pixels
+	static constexpr float kLodPixelError = 1.0f;
+
+	std::vector<MeshLod> m_tetrahedronLods;
+	std::vector<MeshLod> m_planeLods;
+	// Level of detail of each instance, selected in OnUpdate
+	std::vector<UINT> m_instanceLods;
+
+	/// <summary>
+	/// Build the levels of detail of a mesh and their meshlets. The indices of the levels other
+	/// than the full mesh are written to lodIndices, to be stored after the mesh indices
+	/// </summary>
+	void BuildMeshLods(const MeshView& mesh, std::vector<MeshLod>& lods, std::vector<uint32_t>& lodIndices);
+	void BuildMeshlets(const MeshView& mesh, const uint32_t* indices, MeshLod& lod);
+	/// <summary>
+	/// Select the coarsest level of detail of each instance whose error, projected on the screen
+	/// from the eye of the camera, stays under kLodPixelError
+	/// </summary>
+	void SelectLods();
+	/// <summary>
+	/// Current level of detail of an instance
+	/// </summary>
+	const MeshLod& GetInstanceLod(size_t instanceIndex) const;
+	/// <summary>
+	/// Levels of detail and mesh of an instance, given by its mesh identifier in m_instances
+	/// </summary>
+	const std::vector<MeshLod>& GetInstanceLods(size_t instanceIndex) const;
+	const MeshView& GetInstanceMesh(size_t instanceIndex) const;
+
+	// #DXR Custom: Meshlets
+	// Visible index ranges of each instance, gathered in OnUpdate for the raster path
+	std::vector<std::vector<MeshletDrawRange>> m_visibleMeshletRanges;
+	void CullMeshlets();
+
+	// #DXR Custom: Instance Culling
+	// Inclusion masks of the TLAS instances: the camera rays only trace the instances in the view
+	// frustum, the other rays trace all of them. INSTANCE_MASK_CAMERA in Common.hlsl matches the
+	// first one
+	static const UINT8 kInstanceMaskCamera = 0x01;
+	static const UINT8 kInstanceMaskSecondary = 0x02;
+
+	bool m_instanceCulling = true;				// Toggled with the C key
+	InstanceCuller m_instanceCuller;
+	// Instances in the view frustum, in increasing order. They are the only ones drawn by the raster path
+	std::vector<uint32_t> m_visibleInstances;
+
+	/// <summary>
+	/// Update the world-space bounds of an instance after a change of its transform
+	/// </summary>
+	void UpdateInstanceBounds(size_t instanceIndex);
+	/// <summary>
+	/// Gather the instances in the view frustum, and set the inclusion masks of the TLAS instances
+	/// </summary>
+	void CullInstances();
+
+	// #DXR Custom: Draw Batching
+	// Identifiers of the raster draws in DrawBatcher
+	static const uint32_t kRasterPipeline = 0;
+	static const uint32_t kTetrahedronMesh = 0;
+	static const uint32_t kPlaneMesh = 1;
+
+	DrawBatcher m_drawBatcher;
+
+	/// <summary>
+	/// Group the raster draws of the instances in instanced draws, and write the instances of the
+	/// batches into the upload memory of the frame
+	/// </summary>
+	void BuildDrawBatches();
 
 
 	// #DXR Custom: Upload textures
@@ -222,4 +543,19 @@ private:
 	void CreateSkyboxTextureBuffer();
 
 	ComPtr<ID3D12DescriptorHeap> m_samplerHeap;
+
+	// #DXR Custom: CPU Reference Renderer
+	/// <summary>
+	/// Render the current frame with the CPU raytracer and write it to cpu_reference.ppm
+	/// </summary>
+	void RenderCpuReference();
+
+	// #DXR Custom: CPU Tile Scheduler
+	// Kept from one reference frame to the next, so that the thread pool is reused and the tile
+	// size tuned by the previous frames carries over. The scene only references the mesh data
+	CpuRaytracer m_cpuRaytracer;
+	CpuScene m_cpuScene;
+
+	// Material of each instance, as assigned in the material table
+	std::vector<Material> m_instanceMaterials;
 };
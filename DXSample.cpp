@@ -87,5 +87,24 @@ void DXSample::ParseCommandLineArgs(WCHAR* argv[], int argc)
 			m_useWarpDevice = true;
 			m_title = m_title + L" (WARP)";
 		}
+		// #DXR Custom: Mesh Loader
+		else if ((_wcsicmp(argv[i], L"-mesh") == 0 || _wcsicmp(argv[i], L"/mesh") == 0) && i + 1 < argc)
+		{
+			m_meshPath = argv[++i];
+		}
+		// #DXR Custom: Packed Vertices
+		else if (_wcsicmp(argv[i], L"-packed-vertices") == 0 || _wcsicmp(argv[i], L"/packed-vertices") == 0)
+		{
+			m_vertexPositionFormat = VertexPositionFormat::Snorm16;
+			if (i + 1 < argc && _wcsicmp(argv[i + 1], L"fp16") == 0)
+			{
+				m_vertexPositionFormat = VertexPositionFormat::Float16;
+				i++;
+			}
+			else if (i + 1 < argc && _wcsicmp(argv[i + 1], L"snorm16") == 0)
+			{
+				i++;
+			}
+		}
 	}
 }
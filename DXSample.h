@@ -13,6 +13,7 @@
 
 #include "DXSampleHelper.h"
 #include "Win32Application.h"
+#include "VertexPacking.h"
 #include <dxgi1_2.h>
 class DXSample
 {
@@ -53,6 +54,14 @@ protected:
 	// Adapter info.
 	bool m_useWarpDevice;
 
+	// #DXR Custom: Mesh Loader
+	// OBJ or PLY file replacing the tetrahedron, set with -mesh <path>
+	std::wstring m_meshPath;
+
+	// #DXR Custom: Packed Vertices
+	// Storage of the vertex positions, set with -packed-vertices [snorm16|fp16]
+	VertexPositionFormat m_vertexPositionFormat = VertexPositionFormat::Float32;
+
 private:
 	// Root assets path.
 	std::wstring m_assetsPath;
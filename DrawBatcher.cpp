@@ -0,0 +1,90 @@
+#include "DrawBatcher.h"
+
+#include <algorithm>
+
+namespace
+{
+	bool SameBatch(const DrawItem& a, const DrawItem& b)
+	{
+		return a.pipelineState == b.pipelineState && a.mesh == b.mesh &&
+			a.firstIndex == b.firstIndex && a.indexCount == b.indexCount;
+	}
+
+	bool BatchOrder(const DrawItem& a, const DrawItem& b)
+	{
+		if (a.pipelineState != b.pipelineState)
+		{
+			return a.pipelineState < b.pipelineState;
+		}
+		if (a.mesh != b.mesh)
+		{
+			return a.mesh < b.mesh;
+		}
+		if (a.firstIndex != b.firstIndex)
+		{
+			return a.firstIndex < b.firstIndex;
+		}
+		if (a.indexCount != b.indexCount)
+		{
+			return a.indexCount < b.indexCount;
+		}
+		return a.instance < b.instance;
+	}
+}
+
+void DrawBatcher::Clear()
+{
+	m_items.clear();
+	m_batches.clear();
+	m_instances.clear();
+}
+
+void DrawBatcher::Add(uint32_t pipelineState, uint32_t mesh, uint32_t firstIndex, uint32_t indexCount, uint32_t instance)
+{
+	if (indexCount == 0)
+	{
+		return;
+	}
+	m_items.push_back({ pipelineState, mesh, firstIndex, indexCount, instance });
+}
+
+void DrawBatcher::Build()
+{
+	// The instances also take part in the order, so that the batches do not depend on the order
+	// of the calls to Add
+	std::sort(m_items.begin(), m_items.end(), BatchOrder);
+
+	m_batches.clear();
+	m_instances.resize(m_items.size());
+	for (size_t i = 0; i < m_items.size(); i++)
+	{
+		const DrawItem& item = m_items[i];
+		if (i == 0 || !SameBatch(item, m_items[i - 1]))
+		{
+			m_batches.push_back({ item.pipelineState, item.mesh, item.firstIndex, item.indexCount,
+				static_cast<uint32_t>(i), 0 });
+		}
+		m_batches.back().instanceCount++;
+		m_instances[i] = item.instance;
+	}
+}
+
+void DrawBatcher::Record(DrawCommandSink& sink) const
+{
+	for (size_t i = 0; i < m_batches.size(); i++)
+	{
+		const DrawBatch& batch = m_batches[i];
+		if (i == 0 || batch.pipelineState != m_batches[i - 1].pipelineState)
+		{
+			sink.SetPipelineState(batch.pipelineState);
+			// The mesh is bound again after a change of pipeline state, whose input layout may differ
+			sink.SetMesh(batch.mesh);
+		}
+		else if (batch.mesh != m_batches[i - 1].mesh)
+		{
+			sink.SetMesh(batch.mesh);
+		}
+		sink.SetInstanceOffset(batch.firstInstance);
+		sink.DrawIndexedInstanced(batch.indexCount, batch.instanceCount, batch.firstIndex);
+	}
+}
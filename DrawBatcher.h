@@ -0,0 +1,86 @@
+#pragma once
+
+// #DXR Custom: Draw Batching
+// Groups the raster draws of the instances in instanced draw calls. Each draw is described by a
+// pipeline state, a mesh and a range of its index buffer; the draws sharing all three are merged
+// in a single DrawIndexedInstanced, drawing one instance per draw.
+//
+// The draws are sorted by pipeline state, then mesh, then range, so that the state changes are
+// only recorded once per pipeline state and per mesh. The instances of the batches are stored in
+// a single list, in batch order: a batch draws the instances
+//   GetInstances()[firstInstance + SV_InstanceID]
+// the offset being passed to the vertex shader along with the draw.
+//
+// Batches are recorded through the DrawCommandSink interface rather than on a command list, so
+// that the recording can be checked without a device.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct DrawItem
+{
+	uint32_t pipelineState;					// Identifiers chosen by the caller
+	uint32_t mesh;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t instance;
+};
+
+struct DrawBatch
+{
+	uint32_t pipelineState;
+	uint32_t mesh;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t firstInstance;					// First entry in DrawBatcher::GetInstances
+	uint32_t instanceCount;
+};
+
+/// Receiver of the commands recorded by DrawBatcher::Record
+class DrawCommandSink
+{
+public:
+	virtual ~DrawCommandSink() = default;
+
+	virtual void SetPipelineState(uint32_t pipelineState) = 0;
+	/// Bind the vertex and index buffers of a mesh
+	virtual void SetMesh(uint32_t mesh) = 0;
+	/// Offset of the first instance of the next draw in the instance list
+	virtual void SetInstanceOffset(uint32_t firstInstance) = 0;
+	virtual void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex) = 0;
+};
+
+class DrawBatcher
+{
+public:
+	/// <summary>
+	/// Remove the draws and the batches
+	/// </summary>
+	void Clear();
+
+	/// <summary>
+	/// Add the draw of a range of the index buffer of a mesh, for one instance. Empty ranges are ignored
+	/// </summary>
+	void Add(uint32_t pipelineState, uint32_t mesh, uint32_t firstIndex, uint32_t indexCount, uint32_t instance);
+
+	/// <summary>
+	/// Sort the draws added since the last call to Clear and group them in batches
+	/// </summary>
+	void Build();
+
+	/// <summary>
+	/// Record the batches, only setting the pipeline state and the mesh when they change
+	/// </summary>
+	void Record(DrawCommandSink& sink) const;
+
+	const std::vector<DrawBatch>& GetBatches() const { return m_batches; }
+	/// Instances of all the batches, in batch order
+	const std::vector<uint32_t>& GetInstances() const { return m_instances; }
+	size_t GetDrawCount() const { return m_items.size(); }
+
+private:
+	std::vector<DrawItem> m_items;
+	std::vector<DrawBatch> m_batches;
+	std::vector<uint32_t> m_instances;
+};
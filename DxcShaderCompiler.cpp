@@ -0,0 +1,222 @@
+#include "DxcShaderCompiler.h"
+
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	std::wstring ToWide(const std::string& text)
+	{
+		if (text.empty())
+		{
+			return std::wstring();
+		}
+		int length = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), static_cast<int>(text.size()), nullptr, 0);
+		std::wstring wide(length, L'\0');
+		MultiByteToWideChar(CP_UTF8, 0, text.c_str(), static_cast<int>(text.size()), &wide[0], length);
+		return wide;
+	}
+
+	/// IDxcBlob exposing a ShaderBinary, mapped or in memory
+	class ShaderBinaryBlob : public IDxcBlob
+	{
+	public:
+		explicit ShaderBinaryBlob(std::shared_ptr<const ShaderBinary> binary)
+			: m_binary(std::move(binary))
+		{
+		}
+
+		HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, void** object) override
+		{
+			if (object == nullptr)
+			{
+				return E_POINTER;
+			}
+			if (iid == __uuidof(IUnknown) || iid == __uuidof(IDxcBlob))
+			{
+				*object = static_cast<IDxcBlob*>(this);
+				AddRef();
+				return S_OK;
+			}
+			*object = nullptr;
+			return E_NOINTERFACE;
+		}
+
+		ULONG STDMETHODCALLTYPE AddRef() override { return ++m_refCount; }
+
+		ULONG STDMETHODCALLTYPE Release() override
+		{
+			ULONG refCount = --m_refCount;
+			if (refCount == 0)
+			{
+				delete this;
+			}
+			return refCount;
+		}
+
+		LPVOID STDMETHODCALLTYPE GetBufferPointer() override { return const_cast<void*>(m_binary->GetData()); }
+		SIZE_T STDMETHODCALLTYPE GetBufferSize() override { return m_binary->GetSize(); }
+
+	private:
+		std::atomic<ULONG> m_refCount{ 1 };
+		std::shared_ptr<const ShaderBinary> m_binary;
+	};
+}
+
+DxcShaderCompiler::DxcShaderCompiler()
+{
+	std::unique_ptr<Instance> instance = CreateInstance();
+
+	// The version and flags identify the build of dxcompiler.dll loaded at runtime
+	m_version = "dxc";
+	ComPtr<IDxcVersionInfo> versionInfo;
+	UINT32 major = 0, minor = 0, flags = 0;
+	if (SUCCEEDED(instance->compiler.As(&versionInfo)) && SUCCEEDED(versionInfo->GetVersion(&major, &minor)) &&
+		SUCCEEDED(versionInfo->GetFlags(&flags)))
+	{
+		m_version += " " + std::to_string(major) + "." + std::to_string(minor) + " flags " + std::to_string(flags);
+	}
+	m_freeInstances.push_back(std::move(instance));
+}
+
+bool DxcShaderCompiler::Compile(const ShaderCompileRequest& request, std::vector<uint8_t>& bytecode, std::string& errors)
+{
+	std::unique_ptr<Instance> instance;
+	{
+		std::lock_guard<std::mutex> lock(m_instancesMutex);
+		if (!m_freeInstances.empty())
+		{
+			instance = std::move(m_freeInstances.back());
+			m_freeInstances.pop_back();
+		}
+	}
+	if (!instance)
+	{
+		try
+		{
+			instance = CreateInstance();
+		}
+		catch (const std::runtime_error& error)
+		{
+			errors = error.what();
+			return false;
+		}
+	}
+
+	bool compiled = CompileWithInstance(*instance, request, bytecode, errors);
+
+	std::lock_guard<std::mutex> lock(m_instancesMutex);
+	m_freeInstances.push_back(std::move(instance));
+	return compiled;
+}
+
+std::unique_ptr<DxcShaderCompiler::Instance> DxcShaderCompiler::CreateInstance()
+{
+	std::unique_ptr<Instance> instance(new Instance());
+	if (FAILED(DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&instance->compiler))) ||
+		FAILED(DxcCreateInstance(CLSID_DxcLibrary, IID_PPV_ARGS(&instance->library))) ||
+		FAILED(instance->library->CreateIncludeHandler(&instance->includeHandler)))
+	{
+		throw std::runtime_error("Cannot create the DXC compiler");
+	}
+	return instance;
+}
+
+bool DxcShaderCompiler::CompileWithInstance(Instance& instance, const ShaderCompileRequest& request, std::vector<uint8_t>& bytecode,
+	std::string& errors)
+{
+	std::ifstream shaderFile(request.fileName, std::ios::binary);
+	if (!shaderFile)
+	{
+		errors = "Cannot find shader file " + request.fileName;
+		return false;
+	}
+	std::string source((std::istreambuf_iterator<char>(shaderFile)), std::istreambuf_iterator<char>());
+
+	ComPtr<IDxcBlobEncoding> sourceBlob;
+	if (FAILED(instance.library->CreateBlobWithEncodingFromPinned(source.data(), static_cast<UINT32>(source.size()), 0,
+		&sourceBlob)))
+	{
+		errors = "Cannot create the source blob";
+		return false;
+	}
+
+	// DXC takes wide strings, which must outlive the call
+	std::wstring fileName = ToWide(request.fileName);
+	std::wstring entryPoint = ToWide(request.entryPoint);
+	std::wstring targetProfile = ToWide(request.targetProfile);
+	std::vector<std::wstring> defineStrings;
+	for (const std::string& define : request.defines)
+	{
+		size_t equal = define.find('=');
+		defineStrings.push_back(ToWide(define.substr(0, equal)));
+		defineStrings.push_back(equal == std::string::npos ? std::wstring() : ToWide(define.substr(equal + 1)));
+	}
+	std::vector<std::wstring> argumentStrings;
+	for (const std::string& directory : request.includeDirectories)
+	{
+		argumentStrings.push_back(L"-I");
+		argumentStrings.push_back(ToWide(directory));
+	}
+	for (const std::string& argument : request.arguments)
+	{
+		argumentStrings.push_back(ToWide(argument));
+	}
+
+	std::vector<DxcDefine> defines(request.defines.size());
+	for (size_t i = 0; i < defines.size(); i++)
+	{
+		defines[i].Name = defineStrings[2 * i].c_str();
+		defines[i].Value = defineStrings[2 * i + 1].empty() ? nullptr : defineStrings[2 * i + 1].c_str();
+	}
+	std::vector<LPCWSTR> arguments;
+	for (const std::wstring& argument : argumentStrings)
+	{
+		arguments.push_back(argument.c_str());
+	}
+
+	ComPtr<IDxcOperationResult> result;
+	HRESULT status = E_FAIL;
+	if (FAILED(instance.compiler->Compile(sourceBlob.Get(), fileName.c_str(), entryPoint.c_str(), targetProfile.c_str(),
+		arguments.data(), static_cast<UINT32>(arguments.size()), defines.data(), static_cast<UINT32>(defines.size()),
+		instance.includeHandler.Get(), &result)) || FAILED(result->GetStatus(&status)))
+	{
+		errors = "Cannot run the DXC compiler";
+		return false;
+	}
+
+	if (FAILED(status))
+	{
+		ComPtr<IDxcBlobEncoding> errorBlob;
+		if (SUCCEEDED(result->GetErrorBuffer(&errorBlob)) && errorBlob)
+		{
+			errors.assign(static_cast<const char*>(errorBlob->GetBufferPointer()), errorBlob->GetBufferSize());
+		}
+		else
+		{
+			errors = "Failed to get shader compiler error";
+		}
+		return false;
+	}
+
+	ComPtr<IDxcBlob> blob;
+	if (FAILED(result->GetResult(&blob)))
+	{
+		errors = "Cannot get the compiled shader";
+		return false;
+	}
+	const uint8_t* data = static_cast<const uint8_t*>(blob->GetBufferPointer());
+	bytecode.assign(data, data + blob->GetBufferSize());
+	return true;
+}
+
+ComPtr<IDxcBlob> DxcShaderCompiler::CreateBlob(std::shared_ptr<const ShaderBinary> binary)
+{
+	ComPtr<IDxcBlob> blob;
+	blob.Attach(new ShaderBinaryBlob(std::move(binary)));
+	return blob;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+// #DXR Custom: Shader Cache
+// ShaderCompiler implemented with the DirectX Shader Compiler, replacing
+// nv_helpers_dx12::CompileShaderLibrary in the sample. The compiled shaders are wrapped in
+// IDxcBlob objects for the pipeline generator, which keep the binaries alive.
+//
+// #DXR Custom: Parallel Shader Compilation
+// DXC compiler objects must not be used by several threads at once. Instead of the static
+// singletons of CompileShaderLibrary, each concurrent compilation takes a compiler instance from a
+// pool, creating a new one when all are in use, so that there are as many instances as threads
+// compiling at the same time.
+
+#include "ShaderCache.h"
+
+#include <windows.h>
+#include <dxcapi.h>
+#include <wrl/client.h>
+
+#include <mutex>
+
+class DxcShaderCompiler : public ShaderCompiler
+{
+public:
+	/// <summary>
+	/// Create the DXC compiler. Throws std::runtime_error if dxcompiler.dll cannot be loaded
+	/// </summary>
+	DxcShaderCompiler();
+
+	std::string GetVersion() const override { return m_version; }
+	bool Compile(const ShaderCompileRequest& request, std::vector<uint8_t>& bytecode, std::string& errors) override;
+
+	/// <summary>
+	/// Blob pointing to the bytecode of a binary, holding a reference on it
+	/// </summary>
+	static Microsoft::WRL::ComPtr<IDxcBlob> CreateBlob(std::shared_ptr<const ShaderBinary> binary);
+
+private:
+	struct Instance
+	{
+		Microsoft::WRL::ComPtr<IDxcCompiler> compiler;
+		Microsoft::WRL::ComPtr<IDxcLibrary> library;
+		Microsoft::WRL::ComPtr<IDxcIncludeHandler> includeHandler;
+	};
+
+	/// Create the objects of a compiler instance. Throws std::runtime_error on failure
+	static std::unique_ptr<Instance> CreateInstance();
+	static bool CompileWithInstance(Instance& instance, const ShaderCompileRequest& request, std::vector<uint8_t>& bytecode,
+		std::string& errors);
+
+	// Instances not in use
+	std::mutex m_instancesMutex;
+	std::vector<std::unique_ptr<Instance>> m_freeInstances;
+	std::string m_version;
+};
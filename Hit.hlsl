@@ -9,8 +9,8 @@ struct MyStructColor
     float4 c;
 };
 
-cbuffer Colors : register(b0)
-{
+//cbuffer Colors : register(b0)
+//{
     // #DXR Extra: Per-Instance Data (Global Constant Buffer, Layout 1)
     //float4 A[3];
     //float4 B[3];
@@ -20,12 +20,19 @@ cbuffer Colors : register(b0)
     //MyStructColor Tint[3];
     
     // #DXR Extra: Per-Instance Data (Per-Instance Constant Buffer)
-    Material mat;
-}
+    //Material mat;
+//}
+
+// #DXR Custom: Material Table
+// Materials of all the instances, indexed by InstanceID() (see MaterialTable.h)
+StructuredBuffer<uint> instanceMaterials : register(t4);
+StructuredBuffer<float4> materialAlbedo : register(t5);
+StructuredBuffer<float4> materialSpecular : register(t6);
 
 
-StructuredBuffer<STriVertex> BTriVertex : register(t0);
-StructuredBuffer<int> indices : register(t1);
+// #DXR Custom: Packed Vertices
+// Declares the vertex and index buffers of the hit geometry
+#include "VertexFetch.hlsl"
 
 // #DXR Extra: Another Ray Type
 // Raytracing acceleration structure, accessed as a SRV
@@ -43,9 +50,9 @@ void ClosestHit(inout HitInfo payload, Attributes attrib)
     
     // #DXR Custom: Directional Shadows for tetrahedron
     float3x4 objectToWorld = ObjectToWorld();
-    float3 v1 = mul(objectToWorld, BTriVertex[indices[vertId + 0]].vertex);
-    float3 v2 = mul(objectToWorld, BTriVertex[indices[vertId + 1]].vertex);
-    float3 v3 = mul(objectToWorld, BTriVertex[indices[vertId + 2]].vertex);
+    float3 v1 = mul(objectToWorld, FetchVertexPosition(indices[vertId + 0]));
+    float3 v2 = mul(objectToWorld, FetchVertexPosition(indices[vertId + 1]));
+    float3 v3 = mul(objectToWorld, FetchVertexPosition(indices[vertId + 2]));
     
     float minTMult = length(v2 - v3);
     
@@ -104,7 +111,9 @@ void ClosestHit(inout HitInfo payload, Attributes attrib)
     // the SBT in the same order as they are added in the AS, in which case
     // the value below represents the stride (4 bits representing the number
     // of hit groups) between two consecutive objects.
-    0,
+    // #DXR Custom: Meshlets
+    // Large meshes are split in several geometries, each with its own 3 hit groups
+    3,
     // Index of the miss shader: shadow miss shader
     1,
     // Ray information to trace
@@ -122,7 +131,8 @@ void ClosestHit(inout HitInfo payload, Attributes attrib)
     float currentMinTMult = minTMult;
     
     resultColor += currentRayEnergy * (0.0f, 0.0f, 0.0f);
-    currentRayEnergy *= mat.specular;
+    // #DXR Custom: Material Table
+    currentRayEnergy *= materialSpecular[instanceMaterials[InstanceID()]].rgb;
     
     ReflectionHitInfo reflectionPayload;
     int lastValidReflection = 0;
@@ -147,7 +157,7 @@ void ClosestHit(inout HitInfo payload, Attributes attrib)
             DEFAULT_RAY_FLAG, // Flags 
             0xFF, // Instance inclusion mask: include all
             2, // Hit group offset : reflection hit group
-            0, // SBT offset
+            3, // SBT offset : 3 hit groups per BLAS geometry (#DXR Custom: Meshlets)
             2, // Index of the miss shader: reflection miss shader
             ray, // Ray information to trace
             reflectionPayload); // Payload
@@ -197,9 +207,9 @@ void ClosestHit(inout HitInfo payload, Attributes attrib)
     // hitColor = A * barycentrics.x + B * barycentrics.y + C * barycentrics.z;
     
     // #DXR Extra: Indexed Geometry
-    float3 objectColor = BTriVertex[indices[vertId + 0]].color * barycentrics.x +
-                         BTriVertex[indices[vertId + 1]].color * barycentrics.y +
-                         BTriVertex[indices[vertId + 2]].color * barycentrics.z;
+    float3 objectColor = FetchVertexColor(indices[vertId + 0]).rgb * barycentrics.x +
+                         FetchVertexColor(indices[vertId + 1]).rgb * barycentrics.y +
+                         FetchVertexColor(indices[vertId + 2]).rgb * barycentrics.z;
     
     // #DXR Custom: Simple Lighting
     float3 hitColor = (diffFactor * diffuse + AMBIENT_FACTOR * LIGHT_COL) * objectColor;
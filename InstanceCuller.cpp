@@ -0,0 +1,174 @@
+#include "InstanceCuller.h"
+
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define INSTANCE_CULLING_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	const uint32_t kPlaneCount = 4;
+
+	/// Plane a.x + b.y + c.z + d >= 0 on the inner side
+	struct Plane
+	{
+		float a, b, c, d;
+	};
+
+	/// Side planes of the frustum, from the columns of the view-projection matrix (Gribb and
+	/// Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix")
+	void ExtractSidePlanes(const XMFLOAT4X4& m, Plane planes[kPlaneCount])
+	{
+		for (uint32_t i = 0; i < kPlaneCount; i++)
+		{
+			uint32_t column = i / 2;					// x for left and right, y for bottom and top
+			float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+			planes[i].a = m.m[0][3] + sign * m.m[0][column];
+			planes[i].b = m.m[1][3] + sign * m.m[1][column];
+			planes[i].c = m.m[2][3] + sign * m.m[2][column];
+			planes[i].d = m.m[3][3] + sign * m.m[3][column];
+		}
+	}
+}
+
+void InstanceCuller::Resize(uint32_t instanceCount)
+{
+	m_instanceCount = instanceCount;
+	m_centerX.resize(instanceCount, 0.0f);
+	m_centerY.resize(instanceCount, 0.0f);
+	m_centerZ.resize(instanceCount, 0.0f);
+	m_extentX.resize(instanceCount, -FLT_MAX);
+	m_extentY.resize(instanceCount, -FLT_MAX);
+	m_extentZ.resize(instanceCount, -FLT_MAX);
+}
+
+void InstanceCuller::SetInstanceBounds(uint32_t instance, const XMFLOAT3& objectMin, const XMFLOAT3& objectMax,
+	const XMMATRIX& objectToWorld)
+{
+	if (instance >= m_instanceCount)
+	{
+		throw std::logic_error("Instance index out of range");
+	}
+
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, objectToWorld);
+	float center[3] = { 0.5f * (objectMin.x + objectMax.x), 0.5f * (objectMin.y + objectMax.y), 0.5f * (objectMin.z + objectMax.z) };
+	float extent[3] = { 0.5f * (objectMax.x - objectMin.x), 0.5f * (objectMax.y - objectMin.y), 0.5f * (objectMax.z - objectMin.z) };
+
+	// The center is transformed as a point, and the half extents by the absolute values of the
+	// linear part of the matrix
+	float worldCenter[3];
+	float worldExtent[3];
+	for (int j = 0; j < 3; j++)
+	{
+		worldCenter[j] = m.m[3][j];
+		worldExtent[j] = 0.0f;
+		for (int i = 0; i < 3; i++)
+		{
+			worldCenter[j] += center[i] * m.m[i][j];
+			worldExtent[j] += extent[i] * std::fabs(m.m[i][j]);
+		}
+	}
+
+	m_centerX[instance] = worldCenter[0];
+	m_centerY[instance] = worldCenter[1];
+	m_centerZ[instance] = worldCenter[2];
+	m_extentX[instance] = worldExtent[0];
+	m_extentY[instance] = worldExtent[1];
+	m_extentZ[instance] = worldExtent[2];
+}
+
+uint32_t InstanceCuller::Cull(const XMFLOAT4X4& worldToClip, std::vector<uint32_t>& visible,
+	const InstanceCullOptions& options, InstanceCullStats* stats) const
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	Plane planes[kPlaneCount];
+	ExtractSidePlanes(worldToClip, planes);
+
+	// A box is outside of a plane if its center is further from it than the projection of its
+	// half extents on the normal: dot(n, c) + d + dot(|n|, e) < 0
+	visible.resize(m_instanceCount);
+	uint32_t visibleCount = 0;
+	uint32_t instance = 0;
+
+#ifdef INSTANCE_CULLING_SSE
+	if (options.simd)
+	{
+		__m128 a[kPlaneCount], b[kPlaneCount], c[kPlaneCount], d[kPlaneCount];
+		__m128 absA[kPlaneCount], absB[kPlaneCount], absC[kPlaneCount];
+		for (uint32_t p = 0; p < kPlaneCount; p++)
+		{
+			a[p] = _mm_set1_ps(planes[p].a);
+			b[p] = _mm_set1_ps(planes[p].b);
+			c[p] = _mm_set1_ps(planes[p].c);
+			d[p] = _mm_set1_ps(planes[p].d);
+			absA[p] = _mm_set1_ps(std::fabs(planes[p].a));
+			absB[p] = _mm_set1_ps(std::fabs(planes[p].b));
+			absC[p] = _mm_set1_ps(std::fabs(planes[p].c));
+		}
+		const __m128 zero = _mm_setzero_ps();
+
+		for (; instance + 4 <= m_instanceCount; instance += 4)
+		{
+			__m128 centerX = _mm_loadu_ps(&m_centerX[instance]);
+			__m128 centerY = _mm_loadu_ps(&m_centerY[instance]);
+			__m128 centerZ = _mm_loadu_ps(&m_centerZ[instance]);
+			__m128 extentX = _mm_loadu_ps(&m_extentX[instance]);
+			__m128 extentY = _mm_loadu_ps(&m_extentY[instance]);
+			__m128 extentZ = _mm_loadu_ps(&m_extentZ[instance]);
+
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (uint32_t p = 0; p < kPlaneCount; p++)
+			{
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[p], centerX), _mm_mul_ps(b[p], centerY)),
+					_mm_add_ps(_mm_mul_ps(c[p], centerZ), d[p]));
+				__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absA[p], extentX), _mm_mul_ps(absB[p], extentY)),
+					_mm_mul_ps(absC[p], extentZ));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+			}
+
+			// Append the visible lanes in order
+			int mask = _mm_movemask_ps(inside);
+			for (uint32_t lane = 0; mask != 0; lane++, mask >>= 1)
+			{
+				if (mask & 1)
+				{
+					visible[visibleCount++] = instance + lane;
+				}
+			}
+		}
+	}
+#endif
+
+	for (; instance < m_instanceCount; instance++)
+	{
+		bool inside = true;
+		for (uint32_t p = 0; p < kPlaneCount && inside; p++)
+		{
+			const Plane& plane = planes[p];
+			float distance = plane.a * m_centerX[instance] + plane.b * m_centerY[instance] + plane.c * m_centerZ[instance] + plane.d;
+			float radius = std::fabs(plane.a) * m_extentX[instance] + std::fabs(plane.b) * m_extentY[instance] +
+				std::fabs(plane.c) * m_extentZ[instance];
+			inside = (distance + radius >= 0.0f);
+		}
+		if (inside)
+		{
+			visible[visibleCount++] = instance;
+		}
+	}
+	visible.resize(visibleCount);
+
+	if (stats)
+	{
+		stats->instanceCount = m_instanceCount;
+		stats->visibleCount = visibleCount;
+		stats->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+	return visibleCount;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+// #DXR Custom: Instance Culling
+// Culls the instances whose world-space bounds are outside of the view frustum, before the raster
+// draws and the TLAS update. The bounds are the object-space boxes of the meshes transformed by
+// the instance matrices (Arvo, "Transforming Axis-Aligned Bounding Boxes", 1990), stored as
+// centers and half extents in structure-of-arrays layout so that 4 instances are tested at once
+// with SSE. Other CPUs use a scalar loop.
+//
+// Only the 4 side planes of the frustum are tested. They all go through the eye, so the visible
+// instances are exactly those which the camera rays can reach, whatever the depth range of the
+// raster projection: the same result serves the raster draws and the instance masks of the TLAS.
+
+#include "VertexTypes.h"
+
+#include <cstdint>
+#include <vector>
+
+struct InstanceCullOptions
+{
+	bool simd = true;						// Use the SSE kernel when available
+};
+
+struct InstanceCullStats
+{
+	uint32_t instanceCount = 0;
+	uint32_t visibleCount = 0;
+	double milliseconds = 0.0;
+};
+
+class InstanceCuller
+{
+public:
+	/// <summary>
+	/// Set the number of instances. The bounds of the new instances are empty until set, and never visible
+	/// </summary>
+	void Resize(uint32_t instanceCount);
+	uint32_t GetInstanceCount() const { return m_instanceCount; }
+
+	/// <summary>
+	/// Set the world-space bounds of an instance from the object-space bounds of its mesh and its
+	/// transform, in the row vector convention of DirectXMath. Throws std::logic_error if the index
+	/// is out of range
+	/// </summary>
+	void SetInstanceBounds(uint32_t instance, const XMFLOAT3& objectMin, const XMFLOAT3& objectMax,
+		const XMMATRIX& objectToWorld);
+
+	/// <summary>
+	/// Write the indices of the instances intersecting the frustum to visible, in increasing order.
+	/// worldToClip is the view-projection matrix, in the row vector convention of DirectXMath.
+	/// Returns the number of visible instances
+	/// </summary>
+	uint32_t Cull(const XMFLOAT4X4& worldToClip, std::vector<uint32_t>& visible,
+		const InstanceCullOptions& options = {}, InstanceCullStats* stats = nullptr) const;
+
+private:
+	uint32_t m_instanceCount = 0;
+	// Centers and half extents of the world-space boxes. Empty boxes have negative extents
+	std::vector<float> m_centerX;
+	std::vector<float> m_centerY;
+	std::vector<float> m_centerZ;
+	std::vector<float> m_extentX;
+	std::vector<float> m_extentY;
+	std::vector<float> m_extentZ;
+};
@@ -15,6 +15,29 @@
 _Use_decl_annotations_
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow)
 {
+	// #DXR Custom: Mesh Cache
+	// Offline converter: "-convert-mesh <source.obj|ply> <cache.mcache>" writes the cache and exits
+	int argc;
+	LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+	if (argc == 4 && _wcsicmp(argv[1], L"-convert-mesh") == 0)
+	{
+		char source[MAX_PATH], cache[MAX_PATH];
+		WideCharToMultiByte(CP_ACP, 0, argv[2], -1, source, MAX_PATH, nullptr, nullptr);
+		WideCharToMultiByte(CP_ACP, 0, argv[3], -1, cache, MAX_PATH, nullptr, nullptr);
+		LocalFree(argv);
+
+		try
+		{
+			return MeshCache::Convert(source, cache, D3D12HelloTriangle::GetMeshLoadOptions()) ? 0 : 1;
+		}
+		catch (const std::runtime_error& error)
+		{
+			OutputDebugStringA((std::string("Mesh cache: ") + error.what() + "\n").c_str());
+			return 1;
+		}
+	}
+	LocalFree(argv);
+
 	CoInitialize(NULL);
 	D3D12HelloTriangle sample(1280, 720, L"D3D12 Hello Triangle");
 	return Win32Application::Run(&sample, hInstance, nCmdShow);
@@ -0,0 +1,130 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& fileName)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error("Could not open " + fileName);
+	}
+	m_file = reinterpret_cast<intptr_t>(file);
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		Close();
+		throw std::runtime_error("Could not read the size of " + fileName);
+	}
+	m_size = static_cast<uint64_t>(size.QuadPart);
+	if (m_size == 0)
+	{
+		return;
+	}
+
+	m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping != nullptr)
+	{
+		m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+#else
+	int file = open(fileName.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		throw std::runtime_error("Could not open " + fileName);
+	}
+	m_file = file;
+
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0)
+	{
+		Close();
+		throw std::runtime_error("Could not read the size of " + fileName);
+	}
+	m_size = static_cast<uint64_t>(fileStat.st_size);
+	if (m_size == 0)
+	{
+		return;
+	}
+
+	void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+	m_data = data == MAP_FAILED ? nullptr : static_cast<const char*>(data);
+#endif
+	if (m_data == nullptr)
+	{
+		Close();
+		throw std::runtime_error("Could not map " + fileName);
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+// Also called on the failures of the constructor, since the destructor does not run when it throws
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (m_data)
+	{
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping)
+	{
+		CloseHandle(m_mapping);
+	}
+	if (m_file != -1)
+	{
+		CloseHandle(reinterpret_cast<HANDLE>(m_file));
+	}
+#else
+	if (m_data)
+	{
+		munmap(const_cast<char*>(m_data), m_size);
+	}
+	if (m_file != -1)
+	{
+		close(static_cast<int>(m_file));
+	}
+#endif
+	m_data = nullptr;
+	m_size = 0;
+	m_mapping = nullptr;
+	m_file = -1;
+}
+
+bool MappedFile::GetStamp(const std::string& fileName, FileStamp& stamp)
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(fileName.c_str(), GetFileExInfoStandard, &attributes))
+	{
+		return false;
+	}
+	stamp.sizeInBytes = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+	stamp.modificationTime = (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) |
+		attributes.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat fileStat;
+	if (stat(fileName.c_str(), &fileStat) != 0)
+	{
+		return false;
+	}
+	stamp.sizeInBytes = static_cast<uint64_t>(fileStat.st_size);
+	stamp.modificationTime = static_cast<uint64_t>(fileStat.st_mtime);
+#endif
+	return true;
+}
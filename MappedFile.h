@@ -0,0 +1,51 @@
+#pragma once
+
+// #DXR Custom: Mesh Cache
+// Read-only memory mapping of a whole file, shared by the mesh loader and the mesh cache. The
+// pages are loaded by the OS on first access, so that mapping a large file is immediate and only
+// the parts actually read cost I/O.
+
+#include <cstdint>
+#include <string>
+
+/// Size and last modification time of a file, used to detect out of date caches
+struct FileStamp
+{
+	uint64_t sizeInBytes = 0;
+	uint64_t modificationTime = 0;			// In the units of the OS, only compared for equality
+
+	bool operator==(const FileStamp& other) const
+	{
+		return sizeInBytes == other.sizeInBytes && modificationTime == other.modificationTime;
+	}
+};
+
+class MappedFile
+{
+public:
+	/// <summary>
+	/// Map the whole file. Throws std::runtime_error if it cannot be opened or mapped
+	/// </summary>
+	explicit MappedFile(const std::string& fileName);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/// Start of the file, nullptr for empty files
+	const char* GetData() const { return m_data; }
+	uint64_t GetSize() const { return m_size; }
+
+	/// <summary>
+	/// Read the stamp of a file, returning false if it does not exist
+	/// </summary>
+	static bool GetStamp(const std::string& fileName, FileStamp& stamp);
+
+private:
+	void Close();
+
+	const char* m_data = nullptr;
+	uint64_t m_size = 0;
+	intptr_t m_file = -1;					// HANDLE on Windows, file descriptor elsewhere. -1 if closed
+	void* m_mapping = nullptr;				// Mapping object HANDLE, Windows only
+};
@@ -0,0 +1,205 @@
+#include "MaterialTable.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	// Start of each section of the table, as required by the float4 arrays
+	const uint64_t kSectionAlignment = 16;
+
+	uint64_t AlignSection(uint64_t offset)
+	{
+		return (offset + kSectionAlignment - 1) & ~(kSectionAlignment - 1);
+	}
+}
+
+MaterialTableLayout MaterialTable::ComputeLayout(uint32_t instanceCapacity, uint32_t materialCapacity)
+{
+	MaterialTableLayout layout;
+	layout.instanceCapacity = instanceCapacity;
+	layout.materialCapacity = materialCapacity;
+	layout.instanceOffset = 0;
+	layout.albedoOffset = AlignSection(layout.instanceOffset + uint64_t(instanceCapacity) * sizeof(uint32_t));
+	layout.specularOffset = layout.albedoOffset + uint64_t(materialCapacity) * sizeof(XMFLOAT4);
+	layout.sizeInBytes = layout.specularOffset + uint64_t(materialCapacity) * sizeof(XMFLOAT4);
+	return layout;
+}
+
+void MaterialTable::Resize(uint32_t instanceCount, const Material& defaultMaterial)
+{
+	uint32_t previousCount = GetInstanceCount();
+	for (uint32_t i = instanceCount; i < previousCount; i++)
+	{
+		ReleaseMaterial(m_instanceMaterials[i]);
+	}
+
+	m_instanceMaterials.resize(instanceCount);
+	m_instanceDirtyFlags.resize(instanceCount, false);
+	for (uint32_t i = previousCount; i < instanceCount; i++)
+	{
+		m_instanceMaterials[i] = AcquireMaterial(defaultMaterial);
+		MarkInstanceDirty(i);
+	}
+}
+
+void MaterialTable::SetMaterial(uint32_t instanceID, const Material& material)
+{
+	if (instanceID >= GetInstanceCount())
+	{
+		throw std::logic_error("Material assigned to an instance outside of the table");
+	}
+
+	// Acquire before releasing, so that reassigning the same material never recycles its entry
+	uint32_t materialIndex = AcquireMaterial(material);
+	ReleaseMaterial(m_instanceMaterials[instanceID]);
+	if (m_instanceMaterials[instanceID] != materialIndex)
+	{
+		m_instanceMaterials[instanceID] = materialIndex;
+		MarkInstanceDirty(instanceID);
+	}
+}
+
+bool MaterialTable::Fits(const MaterialTableLayout& layout) const
+{
+	return GetInstanceCount() <= layout.instanceCapacity && GetMaterialSlotCount() <= layout.materialCapacity;
+}
+
+uint64_t MaterialTable::Upload(uint8_t* dst, const MaterialTableLayout& layout, bool fullUpload)
+{
+	if (!Fits(layout))
+	{
+		throw std::logic_error("The material table does not fit in the buffer layout");
+	}
+
+	uint32_t* instanceMaterials = reinterpret_cast<uint32_t*>(dst + layout.instanceOffset);
+	XMFLOAT4* albedo = reinterpret_cast<XMFLOAT4*>(dst + layout.albedoOffset);
+	XMFLOAT4* specular = reinterpret_cast<XMFLOAT4*>(dst + layout.specularOffset);
+
+	uint64_t bytesWritten = 0;
+	if (fullUpload)
+	{
+		// Unused material entries are written as well, they are simply never referenced
+		memcpy(instanceMaterials, m_instanceMaterials.data(), m_instanceMaterials.size() * sizeof(uint32_t));
+		memcpy(albedo, m_albedo.data(), m_albedo.size() * sizeof(XMFLOAT4));
+		memcpy(specular, m_specular.data(), m_specular.size() * sizeof(XMFLOAT4));
+		bytesWritten = m_instanceMaterials.size() * sizeof(uint32_t) + m_albedo.size() * 2 * sizeof(XMFLOAT4);
+	}
+	else
+	{
+		// Instances removed by Resize may still be listed
+		for (uint32_t instanceID : m_dirtyInstances)
+		{
+			if (instanceID < GetInstanceCount())
+			{
+				instanceMaterials[instanceID] = m_instanceMaterials[instanceID];
+				bytesWritten += sizeof(uint32_t);
+			}
+		}
+		for (uint32_t materialIndex : m_dirtyMaterials)
+		{
+			albedo[materialIndex] = m_albedo[materialIndex];
+			specular[materialIndex] = m_specular[materialIndex];
+			bytesWritten += 2 * sizeof(XMFLOAT4);
+		}
+	}
+
+	for (uint32_t instanceID : m_dirtyInstances)
+	{
+		if (instanceID < GetInstanceCount())
+		{
+			m_instanceDirtyFlags[instanceID] = false;
+		}
+	}
+	for (uint32_t materialIndex : m_dirtyMaterials)
+	{
+		m_materialDirtyFlags[materialIndex] = false;
+	}
+	m_dirtyInstances.clear();
+	m_dirtyMaterials.clear();
+
+	return bytesWritten;
+}
+
+bool MaterialTable::MaterialKey::operator==(const MaterialKey& other) const
+{
+	return memcmp(this, &other, sizeof(MaterialKey)) == 0;
+}
+
+size_t MaterialTable::MaterialKeyHash::operator()(const MaterialKey& key) const
+{
+	// FNV-1a over the bits of the 8 floats, consistent with the bitwise comparison
+	uint32_t words[8];
+	memcpy(words, &key, sizeof(words));
+	uint64_t hash = 14695981039346656037ull;
+	for (uint32_t word : words)
+	{
+		hash ^= word;
+		hash *= 1099511628211ull;
+	}
+	return static_cast<size_t>(hash);
+}
+
+uint32_t MaterialTable::AcquireMaterial(const Material& material)
+{
+	MaterialKey key;
+	XMStoreFloat4(&key.albedo, material.albedo);
+	XMStoreFloat4(&key.specular, material.specularReflection);
+
+	auto it = m_materialIndices.find(key);
+	if (it != m_materialIndices.end())
+	{
+		m_referenceCounts[it->second]++;
+		return it->second;
+	}
+
+	uint32_t materialIndex;
+	if (!m_freeMaterials.empty())
+	{
+		materialIndex = m_freeMaterials.back();
+		m_freeMaterials.pop_back();
+	}
+	else
+	{
+		materialIndex = GetMaterialSlotCount();
+		m_albedo.emplace_back();
+		m_specular.emplace_back();
+		m_referenceCounts.push_back(0);
+		m_materialDirtyFlags.push_back(false);
+	}
+
+	m_albedo[materialIndex] = key.albedo;
+	m_specular[materialIndex] = key.specular;
+	m_referenceCounts[materialIndex] = 1;
+	m_materialIndices.emplace(key, materialIndex);
+	MarkMaterialDirty(materialIndex);
+	return materialIndex;
+}
+
+void MaterialTable::ReleaseMaterial(uint32_t materialIndex)
+{
+	if (--m_referenceCounts[materialIndex] == 0)
+	{
+		MaterialKey key{ m_albedo[materialIndex], m_specular[materialIndex] };
+		m_materialIndices.erase(key);
+		m_freeMaterials.push_back(materialIndex);
+	}
+}
+
+void MaterialTable::MarkInstanceDirty(uint32_t instanceID)
+{
+	if (!m_instanceDirtyFlags[instanceID])
+	{
+		m_instanceDirtyFlags[instanceID] = true;
+		m_dirtyInstances.push_back(instanceID);
+	}
+}
+
+void MaterialTable::MarkMaterialDirty(uint32_t materialIndex)
+{
+	if (!m_materialDirtyFlags[materialIndex])
+	{
+		m_materialDirtyFlags[materialIndex] = true;
+		m_dirtyMaterials.push_back(materialIndex);
+	}
+}
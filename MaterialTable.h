@@ -0,0 +1,114 @@
+#pragma once
+
+// #DXR Custom: Material Table
+// All the materials of the scene are stored in a single buffer read by the hit shaders, instead
+// of one constant buffer per instance bound in each hit group record. The table is indexed with
+// InstanceID(), which is the material index of the instance in the instance store, and identical materials are
+// stored only once.
+//
+// GPU layout (structure of arrays, each section starting on a 16-byte boundary):
+//   uint   instanceMaterials[instanceCapacity]  - index of the material of each instance
+//   float4 materialAlbedo[materialCapacity]
+//   float4 materialSpecular[materialCapacity]
+// Each section is exposed to HLSL as its own StructuredBuffer (see Hit.hlsl).
+//
+// Changing the material of an instance only marks the modified entries, so that Upload can
+// rewrite a handful of bytes instead of the whole table.
+
+#include "MaterialTypes.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/// Offsets of the sections of the table in the GPU buffer, for given capacities
+struct MaterialTableLayout
+{
+	uint32_t instanceCapacity = 0;
+	uint32_t materialCapacity = 0;
+	uint64_t instanceOffset = 0;
+	uint64_t albedoOffset = 0;
+	uint64_t specularOffset = 0;
+	uint64_t sizeInBytes = 0;
+};
+
+class MaterialTable
+{
+public:
+	/// <summary>
+	/// Compute the layout of a table able to hold the given number of instances and materials
+	/// </summary>
+	static MaterialTableLayout ComputeLayout(uint32_t instanceCapacity, uint32_t materialCapacity);
+
+	/// <summary>
+	/// Set the number of instances. New instances use the default material until assigned
+	/// </summary>
+	void Resize(uint32_t instanceCount, const Material& defaultMaterial = Material{});
+
+	/// <summary>
+	/// Assign a material to an instance. If an identical material is already in the table, its
+	/// entry is shared, and entries no longer used by any instance are recycled
+	/// </summary>
+	void SetMaterial(uint32_t instanceID, const Material& material);
+
+	uint32_t GetInstanceCount() const { return static_cast<uint32_t>(m_instanceMaterials.size()); }
+
+	/// Number of material entries, including recycled ones awaiting reuse
+	uint32_t GetMaterialSlotCount() const { return static_cast<uint32_t>(m_albedo.size()); }
+
+	/// Number of distinct materials referenced by the instances
+	uint32_t GetUniqueMaterialCount() const { return static_cast<uint32_t>(m_materialIndices.size()); }
+
+	/// <summary>
+	/// Check whether the contents of the table fit in a buffer with the given layout
+	/// </summary>
+	bool Fits(const MaterialTableLayout& layout) const;
+
+	/// <summary>
+	/// Write the table into mapped memory organized with the given layout. With fullUpload set,
+	/// every entry is written, which is required after the buffer is (re)allocated. Otherwise only
+	/// the entries modified since the previous upload are written. Returns the number of bytes written
+	/// </summary>
+	uint64_t Upload(uint8_t* dst, const MaterialTableLayout& layout, bool fullUpload);
+
+	bool HasChanges() const { return !m_dirtyInstances.empty() || !m_dirtyMaterials.empty(); }
+
+private:
+	/// Bitwise copy of a material, used as the deduplication key
+	struct MaterialKey
+	{
+		XMFLOAT4 albedo;
+		XMFLOAT4 specular;
+
+		bool operator==(const MaterialKey& other) const;
+	};
+
+	struct MaterialKeyHash
+	{
+		size_t operator()(const MaterialKey& key) const;
+	};
+
+	/// Find or insert the material, and add a reference to it
+	uint32_t AcquireMaterial(const Material& material);
+
+	/// Remove a reference to a material, recycling its entry when unused
+	void ReleaseMaterial(uint32_t materialIndex);
+
+	void MarkInstanceDirty(uint32_t instanceID);
+	void MarkMaterialDirty(uint32_t materialIndex);
+
+	std::vector<uint32_t> m_instanceMaterials;
+
+	// Material entries, in the order of the GPU arrays
+	std::vector<XMFLOAT4> m_albedo;
+	std::vector<XMFLOAT4> m_specular;
+	std::vector<uint32_t> m_referenceCounts;
+	std::vector<uint32_t> m_freeMaterials;
+	std::unordered_map<MaterialKey, uint32_t, MaterialKeyHash> m_materialIndices;
+
+	// Entries modified since the last upload. The flags avoid duplicates in the lists
+	std::vector<uint32_t> m_dirtyInstances;
+	std::vector<uint32_t> m_dirtyMaterials;
+	std::vector<bool> m_instanceDirtyFlags;
+	std::vector<bool> m_materialDirtyFlags;
+};
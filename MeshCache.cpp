@@ -0,0 +1,386 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double MillisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	uint64_t AlignOffset(uint64_t offset)
+	{
+		return (offset + kMeshCacheAlignment - 1) & ~uint64_t(kMeshCacheAlignment - 1);
+	}
+
+	/// Checksum processing the data as 64-bit words, so that large payloads are hashed at memory
+	/// speed. Partial words are kept between calls, so that the result does not depend on how the
+	/// data is split
+	class Checksum
+	{
+	public:
+		void Add(const void* data, uint64_t size)
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			while (size > 0)
+			{
+				if (m_pendingSize == 0 && size >= sizeof(uint64_t))
+				{
+					AddWord(bytes);
+					bytes += sizeof(uint64_t);
+					size -= sizeof(uint64_t);
+					continue;
+				}
+				m_pending[m_pendingSize++] = *bytes++;
+				size--;
+				if (m_pendingSize == sizeof(uint64_t))
+				{
+					AddWord(m_pending);
+					m_pendingSize = 0;
+				}
+			}
+		}
+
+		uint64_t Get() const
+		{
+			uint64_t hash = m_hash;
+			for (uint32_t i = 0; i < m_pendingSize; i++)
+			{
+				hash = (hash ^ m_pending[i]) * 0x100000001B3ull;
+			}
+			return hash ^ (hash >> 31);
+		}
+
+	private:
+		void AddWord(const uint8_t* bytes)
+		{
+			uint64_t word;
+			memcpy(&word, bytes, sizeof(word));
+			m_hash = (m_hash ^ word) * 0x9E3779B97F4A7C15ull;
+			m_hash ^= m_hash >> 29;
+		}
+
+		uint64_t m_hash = 0xCBF29CE484222325ull;
+		uint8_t m_pending[sizeof(uint64_t)] = {};
+		uint32_t m_pendingSize = 0;
+	};
+
+	uint32_t ComputeHeaderChecksum(MeshCacheHeader header, const MeshCacheEntry* entries)
+	{
+		header.headerChecksum = 0;
+		Checksum checksum;
+		checksum.Add(&header, sizeof(header));
+		checksum.Add(entries, static_cast<uint64_t>(header.meshCount) * sizeof(MeshCacheEntry));
+		uint64_t hash = checksum.Get();
+		return static_cast<uint32_t>(hash ^ (hash >> 32));
+	}
+
+	/// True if count elements of the given size starting at offset fit in the file
+	bool SectionFits(uint64_t offset, uint32_t count, uint64_t elementSize, uint64_t fileSize)
+	{
+		return offset % kMeshCacheAlignment == 0 && offset <= fileSize &&
+			count * elementSize <= fileSize - offset;
+	}
+
+	/// Write sections to the file, updating the payload checksum
+	class SectionWriter
+	{
+	public:
+		explicit SectionWriter(std::ofstream& stream) : m_stream(stream) {}
+
+		void Write(const void* data, uint64_t size)
+		{
+			m_stream.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+			m_checksum.Add(data, size);
+			m_offset += size;
+		}
+
+		/// Pad with zeros up to the next section boundary
+		void Align()
+		{
+			static const uint8_t kZeros[kMeshCacheAlignment] = {};
+			Write(kZeros, AlignOffset(m_offset) - m_offset);
+		}
+
+		void SetOffset(uint64_t offset) { m_offset = offset; }
+		uint64_t GetOffset() const { return m_offset; }
+		uint64_t GetChecksum() const { return m_checksum.Get(); }
+
+	private:
+		std::ofstream& m_stream;
+		Checksum m_checksum;
+		uint64_t m_offset = 0;
+	};
+}
+
+MeshView MeshView::FromVectors(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+	MeshView view;
+	view.vertices = vertices.data();
+	view.vertexCount = static_cast<uint32_t>(vertices.size());
+	view.indices = indices.data();
+	view.indexCount = static_cast<uint32_t>(indices.size());
+
+	if (!vertices.empty())
+	{
+		view.boundsMin = vertices[0].position;
+		view.boundsMax = vertices[0].position;
+	}
+	for (const Vertex& vertex : vertices)
+	{
+		view.boundsMin.x = (std::min)(view.boundsMin.x, vertex.position.x);
+		view.boundsMin.y = (std::min)(view.boundsMin.y, vertex.position.y);
+		view.boundsMin.z = (std::min)(view.boundsMin.z, vertex.position.z);
+		view.boundsMax.x = (std::max)(view.boundsMax.x, vertex.position.x);
+		view.boundsMax.y = (std::max)(view.boundsMax.y, vertex.position.y);
+		view.boundsMax.z = (std::max)(view.boundsMax.z, vertex.position.z);
+	}
+	return view;
+}
+
+bool MeshCache::Open(const std::string& fileName, const FileStamp* expectedSource, bool verifyPayload)
+{
+	Close();
+	auto start = Clock::now();
+
+	std::unique_ptr<MappedFile> file;
+	try
+	{
+		file.reset(new MappedFile(fileName));
+	}
+	catch (const std::runtime_error&)
+	{
+		return false;
+	}
+
+	// Validate the header and the mesh table, which are the only parts read on open
+	const uint64_t fileSize = file->GetSize();
+	if (fileSize < sizeof(MeshCacheHeader))
+	{
+		return false;
+	}
+	const MeshCacheHeader& header = *reinterpret_cast<const MeshCacheHeader*>(file->GetData());
+	if (header.magic != kMeshCacheMagic || header.version != kMeshCacheVersion ||
+		header.vertexStride != sizeof(Vertex) || header.bvhNodeStride != sizeof(nv_helpers_dx12::BVHNode) ||
+		header.fileSize != fileSize ||
+		header.meshCount > (fileSize - sizeof(MeshCacheHeader)) / sizeof(MeshCacheEntry))
+	{
+		return false;
+	}
+	const MeshCacheEntry* entries =
+		reinterpret_cast<const MeshCacheEntry*>(file->GetData() + sizeof(MeshCacheHeader));
+	if (header.headerChecksum != ComputeHeaderChecksum(header, entries))
+	{
+		return false;
+	}
+	if (expectedSource && !(header.source == *expectedSource))
+	{
+		return false;
+	}
+
+	for (uint32_t i = 0; i < header.meshCount; i++)
+	{
+		const MeshCacheEntry& entry = entries[i];
+		if (!SectionFits(entry.vertexOffset, entry.vertexCount, sizeof(Vertex), fileSize) ||
+			!SectionFits(entry.indexOffset, entry.indexCount, sizeof(uint32_t), fileSize) ||
+			!SectionFits(entry.bvhNodeOffset, entry.bvhNodeCount, sizeof(nv_helpers_dx12::BVHNode), fileSize) ||
+			!SectionFits(entry.bvhPrimitiveOffset, entry.bvhPrimitiveCount, sizeof(uint32_t), fileSize) ||
+			entry.indexCount % 3 != 0)
+		{
+			return false;
+		}
+	}
+	m_stats.openMilliseconds = MillisecondsSince(start);
+
+	// The payload is only read on request, as it touches every page of the file. The indices and
+	// the hierarchies are checked along with it, since out of range indices would make the CPU
+	// renderer read outside of the sections
+	m_stats.verifyMilliseconds = 0.0;
+	if (verifyPayload)
+	{
+		auto verifyStart = Clock::now();
+		uint64_t payloadOffset = sizeof(MeshCacheHeader) + header.meshCount * sizeof(MeshCacheEntry);
+		Checksum checksum;
+		checksum.Add(file->GetData() + payloadOffset, fileSize - payloadOffset);
+		if (checksum.Get() != header.payloadChecksum)
+		{
+			return false;
+		}
+		for (uint32_t i = 0; i < header.meshCount; i++)
+		{
+			const MeshCacheEntry& entry = entries[i];
+			const uint32_t* indices = reinterpret_cast<const uint32_t*>(file->GetData() + entry.indexOffset);
+			if (std::any_of(indices, indices + entry.indexCount, [&](uint32_t index) { return index >= entry.vertexCount; }))
+			{
+				return false;
+			}
+
+			const nv_helpers_dx12::BVHNode* nodes =
+				reinterpret_cast<const nv_helpers_dx12::BVHNode*>(file->GetData() + entry.bvhNodeOffset);
+			const uint32_t* primitives = reinterpret_cast<const uint32_t*>(file->GetData() + entry.bvhPrimitiveOffset);
+			bool invalidNode = std::any_of(nodes, nodes + entry.bvhNodeCount, [&](const nv_helpers_dx12::BVHNode& node) {
+				return node.IsLeaf() ? uint64_t(node.leftFirst) + node.primitiveCount > entry.bvhPrimitiveCount
+					: uint64_t(node.leftFirst) + 2 > entry.bvhNodeCount;
+			});
+			bool invalidPrimitive = std::any_of(primitives, primitives + entry.bvhPrimitiveCount,
+				[&](uint32_t primitive) { return primitive >= entry.indexCount / 3; });
+			if (invalidNode || invalidPrimitive)
+			{
+				return false;
+			}
+		}
+		m_stats.verifyMilliseconds = MillisecondsSince(verifyStart);
+	}
+
+	m_file = std::move(file);
+	m_entries = entries;
+	m_meshCount = header.meshCount;
+	return true;
+}
+
+void MeshCache::Close()
+{
+	m_file.reset();
+	m_entries = nullptr;
+	m_meshCount = 0;
+}
+
+MeshView MeshCache::GetMesh(uint32_t meshIndex) const
+{
+	if (meshIndex >= m_meshCount)
+	{
+		throw std::logic_error("Mesh index outside of the cache");
+	}
+	const MeshCacheEntry& entry = m_entries[meshIndex];
+	const char* data = m_file->GetData();
+
+	MeshView view;
+	view.vertices = reinterpret_cast<const Vertex*>(data + entry.vertexOffset);
+	view.vertexCount = entry.vertexCount;
+	view.indices = reinterpret_cast<const uint32_t*>(data + entry.indexOffset);
+	view.indexCount = entry.indexCount;
+	view.boundsMin = XMFLOAT3(entry.boundsMin[0], entry.boundsMin[1], entry.boundsMin[2]);
+	view.boundsMax = XMFLOAT3(entry.boundsMax[0], entry.boundsMax[1], entry.boundsMax[2]);
+	if (entry.bvhNodeCount > 0)
+	{
+		view.bvhNodes = reinterpret_cast<const nv_helpers_dx12::BVHNode*>(data + entry.bvhNodeOffset);
+		view.bvhNodeCount = entry.bvhNodeCount;
+		view.bvhPrimitives = reinterpret_cast<const uint32_t*>(data + entry.bvhPrimitiveOffset);
+		view.bvhPrimitiveCount = entry.bvhPrimitiveCount;
+		view.bvhMaxDepth = entry.bvhMaxDepth;
+	}
+	return view;
+}
+
+bool MeshCache::Write(const std::string& fileName, const std::vector<MeshView>& meshes,
+	const FileStamp& source, MeshCacheStats* stats)
+{
+	auto start = Clock::now();
+
+	// The hierarchies are built first, as their size determines the layout of the file
+	std::vector<nv_helpers_dx12::BottomLevelBVH> bvhs(meshes.size());
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const MeshView& mesh = meshes[i];
+		if (mesh.indexCount > 0)
+		{
+			nv_helpers_dx12::BottomLevelBVHBuilder builder;
+			builder.AddVertexBuffer(mesh.vertices, 0, mesh.vertexCount, sizeof(Vertex),
+				mesh.indices, 0, mesh.indexCount);
+			builder.Generate(bvhs[i]);
+		}
+	}
+
+	MeshCacheHeader header = {};
+	header.magic = kMeshCacheMagic;
+	header.version = kMeshCacheVersion;
+	header.meshCount = static_cast<uint32_t>(meshes.size());
+	header.vertexStride = sizeof(Vertex);
+	header.bvhNodeStride = sizeof(nv_helpers_dx12::BVHNode);
+	header.source = source;
+
+	std::vector<MeshCacheEntry> entries(meshes.size());
+	uint64_t offset = AlignOffset(sizeof(MeshCacheHeader) + entries.size() * sizeof(MeshCacheEntry));
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const MeshView& mesh = meshes[i];
+		const nv_helpers_dx12::BottomLevelBVH& bvh = bvhs[i];
+		MeshCacheEntry& entry = entries[i];
+		entry = {};
+		entry.vertexCount = mesh.vertexCount;
+		entry.indexCount = mesh.indexCount;
+		entry.bvhNodeCount = static_cast<uint32_t>(bvh.nodes.size());
+		entry.bvhPrimitiveCount = static_cast<uint32_t>(bvh.primitiveIndices.size());
+		entry.bvhMaxDepth = bvh.stats.maxDepth;
+		memcpy(entry.boundsMin, &mesh.boundsMin, sizeof(entry.boundsMin));
+		memcpy(entry.boundsMax, &mesh.boundsMax, sizeof(entry.boundsMax));
+
+		entry.vertexOffset = offset;
+		offset = AlignOffset(offset + static_cast<uint64_t>(entry.vertexCount) * sizeof(Vertex));
+		entry.indexOffset = offset;
+		offset = AlignOffset(offset + static_cast<uint64_t>(entry.indexCount) * sizeof(uint32_t));
+		entry.bvhNodeOffset = offset;
+		offset = AlignOffset(offset + static_cast<uint64_t>(entry.bvhNodeCount) * sizeof(nv_helpers_dx12::BVHNode));
+		entry.bvhPrimitiveOffset = offset;
+		offset = AlignOffset(offset + static_cast<uint64_t>(entry.bvhPrimitiveCount) * sizeof(uint32_t));
+	}
+	header.fileSize = offset;
+
+	std::ofstream stream(fileName, std::ios::binary | std::ios::trunc);
+	if (!stream)
+	{
+		return false;
+	}
+
+	// The header is written twice, its checksums being only known once the payload is written
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	stream.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(MeshCacheEntry));
+
+	SectionWriter writer(stream);
+	writer.SetOffset(sizeof(MeshCacheHeader) + entries.size() * sizeof(MeshCacheEntry));
+	writer.Align();
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const MeshView& mesh = meshes[i];
+		const nv_helpers_dx12::BottomLevelBVH& bvh = bvhs[i];
+		writer.Write(mesh.vertices, static_cast<uint64_t>(mesh.vertexCount) * sizeof(Vertex));
+		writer.Align();
+		writer.Write(mesh.indices, static_cast<uint64_t>(mesh.indexCount) * sizeof(uint32_t));
+		writer.Align();
+		writer.Write(bvh.nodes.data(), bvh.nodes.size() * sizeof(nv_helpers_dx12::BVHNode));
+		writer.Align();
+		writer.Write(bvh.primitiveIndices.data(), bvh.primitiveIndices.size() * sizeof(uint32_t));
+		writer.Align();
+	}
+
+	header.payloadChecksum = writer.GetChecksum();
+	header.headerChecksum = ComputeHeaderChecksum(header, entries.data());
+	stream.seekp(0);
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	stream.close();
+
+	if (stats)
+	{
+		stats->writeMilliseconds = MillisecondsSince(start);
+	}
+	return !stream.fail();
+}
+
+bool MeshCache::Convert(const std::string& sourceFileName, const std::string& cacheFileName,
+	const MeshLoadOptions& options, MeshLoadStats* loadStats, MeshCacheStats* stats)
+{
+	FileStamp source;
+	MappedFile::GetStamp(sourceFileName, source);
+
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	MeshLoader::Load(sourceFileName, vertices, indices, options, loadStats);
+	return Write(cacheFileName, { MeshView::FromVectors(vertices, indices) }, source, stats);
+}
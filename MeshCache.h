@@ -0,0 +1,135 @@
+#pragma once
+
+// #DXR Custom: Mesh Cache
+// Binary container storing meshes in the exact layout used at runtime, so that loading a mesh
+// only maps the file: the vertices and indices are copied from the mapping straight into the
+// upload buffers of CreateMeshBuffers, and the BVH nodes of the CPU reference renderer are built
+// offline, instead of parsing text and building the hierarchy at every startup.
+//
+// File layout, in native (little-endian) byte order:
+//   MeshCacheHeader
+//   MeshCacheEntry[meshCount]
+//   sections, each starting on a kMeshCacheAlignment boundary:
+//     Vertex   vertices[vertexCount]           per mesh
+//     uint32_t indices[indexCount]             per mesh
+//     BVHNode  bvhNodes[bvhNodeCount]          per mesh
+//     uint32_t bvhPrimitives[bvhPrimitiveCount] per mesh
+//
+// The header and the mesh table are protected by a checksum, always verified on open, along with
+// the bounds of all the sections. The payload has its own checksum, only verified on request
+// since it requires reading the whole file. The header also records the stamp of the source file,
+// so that a cache can be rebuilt when its source changes.
+
+#include "MappedFile.h"
+#include "MeshLoader.h"
+#include "VertexTypes.h"
+#include "nv_helpers_dx12/BottomLevelBVHBuilder.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+static const uint32_t kMeshCacheMagic = 0x434D444D;	// "MDMC"
+static const uint32_t kMeshCacheVersion = 3;		// 2: the sample writes optimized meshes, 3: in meshlet order
+static const uint32_t kMeshCacheAlignment = 64;
+
+struct MeshCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t meshCount;
+	uint32_t vertexStride;					// sizeof(Vertex), to reject caches of another layout
+	uint32_t bvhNodeStride;					// sizeof(BVHNode)
+	uint32_t headerChecksum;				// Of the header and mesh table, with this field set to 0
+	uint64_t fileSize;
+	uint64_t payloadChecksum;				// Of everything following the mesh table
+	FileStamp source;						// Stamp of the file the cache was converted from
+};
+
+/// Location of the sections of a mesh, as offsets from the start of the file
+struct MeshCacheEntry
+{
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t bvhNodeOffset;
+	uint64_t bvhPrimitiveOffset;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t bvhNodeCount;
+	uint32_t bvhPrimitiveCount;
+	float boundsMin[3];
+	uint32_t bvhMaxDepth;
+	float boundsMax[3];
+	uint32_t reserved;
+};
+
+/// Non-owning view of the geometry of a mesh, pointing into a mapped cache or into vectors
+struct MeshView
+{
+	const Vertex* vertices = nullptr;
+	uint32_t vertexCount = 0;
+	const uint32_t* indices = nullptr;
+	uint32_t indexCount = 0;
+	XMFLOAT3 boundsMin = { 0.0f, 0.0f, 0.0f };
+	XMFLOAT3 boundsMax = { 0.0f, 0.0f, 0.0f };
+
+	// Hierarchy built by the converter with the default BVHBuildSettings, empty if unavailable
+	const nv_helpers_dx12::BVHNode* bvhNodes = nullptr;
+	uint32_t bvhNodeCount = 0;
+	const uint32_t* bvhPrimitives = nullptr;
+	uint32_t bvhPrimitiveCount = 0;
+	uint32_t bvhMaxDepth = 0;
+
+	/// <summary>
+	/// View of meshes held in vectors, such as the ones of MeshDataUtility. The bounds are computed
+	/// and there is no hierarchy
+	/// </summary>
+	static MeshView FromVectors(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+};
+
+/// Timings of the cache operations, to compare them with the text loader
+struct MeshCacheStats
+{
+	double openMilliseconds = 0.0;			// Mapping and validation
+	double verifyMilliseconds = 0.0;		// Payload checksum, if verified
+	double writeMilliseconds = 0.0;			// Hierarchy builds and file writes, when converting
+};
+
+class MeshCache
+{
+public:
+	/// <summary>
+	/// Map a cache and validate its header. Returns false if the file is missing, of another
+	/// version or layout, corrupted, or if a source stamp is given and differs from the one stored
+	/// in the cache. The views returned by GetMesh remain valid until the cache is closed.
+	/// </summary>
+	bool Open(const std::string& fileName, const FileStamp* expectedSource = nullptr, bool verifyPayload = false);
+
+	void Close();
+
+	bool IsOpen() const { return m_file != nullptr; }
+	uint32_t GetMeshCount() const { return m_meshCount; }
+	MeshView GetMesh(uint32_t meshIndex) const;
+	const MeshCacheStats& GetStats() const { return m_stats; }
+
+	/// <summary>
+	/// Write meshes to a cache, building their hierarchies. Returns false if the file cannot be
+	/// written
+	/// </summary>
+	static bool Write(const std::string& fileName, const std::vector<MeshView>& meshes,
+		const FileStamp& source = {}, MeshCacheStats* stats = nullptr);
+
+	/// <summary>
+	/// Load an OBJ or PLY file with MeshLoader and write it to a cache. Throws std::runtime_error if
+	/// the source cannot be loaded, and returns false if the cache cannot be written
+	/// </summary>
+	static bool Convert(const std::string& sourceFileName, const std::string& cacheFileName,
+		const MeshLoadOptions& options = {}, MeshLoadStats* loadStats = nullptr, MeshCacheStats* stats = nullptr);
+
+private:
+	std::unique_ptr<MappedFile> m_file;
+	const MeshCacheEntry* m_entries = nullptr;
+	uint32_t m_meshCount = 0;
+	MeshCacheStats m_stats;
+};
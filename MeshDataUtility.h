@@ -1,6 +1,6 @@
 #pragma once
 
-#include <windows.h>
+#include <cstdint>
 #include <vector>
 #include "VertexTypes.h"
 
@@ -8,8 +8,8 @@ class MeshDataUtility
 {
 public:
 	static std::vector<Vertex> PlaneVertices;
-	static std::vector<UINT>   PlaneIndices;
+	static std::vector<uint32_t> PlaneIndices;
 
 	static std::vector<Vertex> TetrahedronVertices;
-	static std::vector<UINT>   TetrahedronIndices;
+	static std::vector<uint32_t> TetrahedronIndices;
 };
\ No newline at end of file
@@ -0,0 +1,1089 @@
+#include "MeshLoader.h"
+
+#include "MappedFile.h"
+#include "nv_helpers_dx12/ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double MillisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	const uint32_t kInvalidIndex = 0xFFFFFFFFu;
+
+	// Grain of the parallel loops over vertices and faces
+	const uint32_t kElementGrain = 64 * 1024;
+
+	bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	bool IsDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	const char* SkipSpaces(const char* p, const char* end)
+	{
+		while (p < end && IsSpace(*p))
+		{
+			p++;
+		}
+		return p;
+	}
+
+	uint32_t CheckedCount(uint64_t count, const char* what)
+	{
+		if (count >= kInvalidIndex)
+		{
+			throw std::runtime_error(std::string("Too many ") + what + " for 32-bit indices");
+		}
+		return static_cast<uint32_t>(count);
+	}
+
+	//--------------------------------------------------------------------------------------------
+	// OBJ
+
+	/// Corner whose index is relative to the end of the vertices preceding it in the file. The
+	/// vertex count of the previous chunks is unknown while the chunks are parsed in parallel, hence
+	/// the index is expressed from the start of the chunk, and fixed up once the chunks are merged
+	struct ObjRelativeCorner
+	{
+		uint32_t position;		// In the corners of the chunk
+		int64_t index;			// Relative to the first vertex of the chunk, may be negative
+	};
+
+	struct ObjChunk
+	{
+		const char* begin = nullptr;
+		const char* end = nullptr;
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> corners;	// 0-based vertex indices, 3 per triangle
+		std::vector<ObjRelativeCorner> relativeCorners;
+		std::string error;				// Parallel tasks cannot throw, the first error is kept here
+	};
+
+	struct ObjPolygonCorner
+	{
+		int64_t index;
+		bool isRelative;
+	};
+
+	/// Parse the vertex and face lines of a chunk. Other statements are ignored
+	void ParseObjChunk(ObjChunk& chunk, const XMFLOAT4& defaultColor)
+	{
+		std::vector<ObjPolygonCorner> polygon;
+		const char* line = chunk.begin;
+		while (line < chunk.end && chunk.error.empty())
+		{
+			const char* lineEnd = static_cast<const char*>(memchr(line, '\n', chunk.end - line));
+			if (lineEnd == nullptr)
+			{
+				lineEnd = chunk.end;
+			}
+
+			const char* p = SkipSpaces(line, lineEnd);
+			if (lineEnd - p >= 2 && p[0] == 'v' && IsSpace(p[1]))
+			{
+				// v x y z [w] or v x y z r g b, the latter being a common extension for vertex colors
+				float values[7];
+				int valueCount = 0;
+				p = SkipSpaces(p + 1, lineEnd);
+				while (valueCount < 7 && p < lineEnd && MeshLoader::ParseFloat(p, lineEnd, values[valueCount]))
+				{
+					valueCount++;
+					p = SkipSpaces(p, lineEnd);
+				}
+				if (valueCount < 3)
+				{
+					chunk.error = "Vertex with fewer than 3 coordinates";
+					break;
+				}
+
+				Vertex vertex;
+				vertex.position = XMFLOAT3(values[0], values[1], values[2]);
+				vertex.color = valueCount >= 6 ? XMFLOAT4(values[3], values[4], values[5], 1.0f) : defaultColor;
+				chunk.vertices.push_back(vertex);
+			}
+			else if (lineEnd - p >= 2 && p[0] == 'f' && IsSpace(p[1]))
+			{
+				// f v1 v2 v3 ..., where each corner is v, v/vt, v/vt/vn or v//vn. Only v is used
+				polygon.clear();
+				p = SkipSpaces(p + 1, lineEnd);
+				while (p < lineEnd)
+				{
+					bool negative = p < lineEnd && *p == '-';
+					if (negative)
+					{
+						p++;
+					}
+					if (p == lineEnd || !IsDigit(*p))
+					{
+						chunk.error = "Invalid face corner";
+						break;
+					}
+					int64_t index = 0;
+					while (p < lineEnd && IsDigit(*p))
+					{
+						index = (std::min)(index * 10 + (*p - '0'), int64_t(1) << 40);
+						p++;
+					}
+					if (index == 0)
+					{
+						chunk.error = "Face corner with index 0";
+						break;
+					}
+					if (negative)
+					{
+						polygon.push_back({ static_cast<int64_t>(chunk.vertices.size()) - index, true });
+					}
+					else
+					{
+						polygon.push_back({ index - 1, false });
+					}
+
+					while (p < lineEnd && !IsSpace(*p))
+					{
+						p++;
+					}
+					p = SkipSpaces(p, lineEnd);
+				}
+				if (!chunk.error.empty())
+				{
+					break;
+				}
+				if (polygon.size() < 3)
+				{
+					chunk.error = "Face with fewer than 3 corners";
+					break;
+				}
+
+				// Triangulate as a fan around the first corner
+				for (size_t i = 1; i + 1 < polygon.size(); i++)
+				{
+					for (const ObjPolygonCorner& corner : { polygon[0], polygon[i], polygon[i + 1] })
+					{
+						if (corner.isRelative)
+						{
+							chunk.relativeCorners.push_back(
+								{ static_cast<uint32_t>(chunk.corners.size()), corner.index });
+							chunk.corners.push_back(0);
+						}
+						else
+						{
+							// Out of range indices are caught once the vertex count is known
+							chunk.corners.push_back(static_cast<uint32_t>((std::min)(corner.index, int64_t(kInvalidIndex))));
+						}
+					}
+				}
+			}
+
+			line = lineEnd + 1;
+		}
+	}
+
+	void LoadObj(const char* data, uint64_t size, nv_helpers_dx12::ThreadPool& pool,
+		const MeshLoadOptions& options, std::vector<Vertex>& vertices, std::vector<uint32_t>& corners,
+		MeshLoadStats& stats)
+	{
+		// Split the file in chunks ending on a line boundary
+		const uint64_t chunkSize = (std::max)(options.chunkSizeInBytes, uint64_t(4096));
+		const char* dataEnd = data + size;
+		std::vector<ObjChunk> chunks;
+		const char* chunkBegin = data;
+		while (chunkBegin < dataEnd)
+		{
+			const char* chunkEnd = dataEnd;
+			if (static_cast<uint64_t>(dataEnd - chunkBegin) > chunkSize)
+			{
+				const char* newline = static_cast<const char*>(
+					memchr(chunkBegin + chunkSize, '\n', dataEnd - (chunkBegin + chunkSize)));
+				chunkEnd = newline ? newline + 1 : dataEnd;
+			}
+			chunks.emplace_back();
+			chunks.back().begin = chunkBegin;
+			chunks.back().end = chunkEnd;
+			chunkBegin = chunkEnd;
+		}
+		stats.chunkCount = static_cast<uint32_t>(chunks.size());
+
+		pool.ParallelFor(static_cast<uint32_t>(chunks.size()), 1,
+			[&](uint32_t begin, uint32_t end, uint32_t /*threadIndex*/) {
+				for (uint32_t i = begin; i < end; i++)
+				{
+					ParseObjChunk(chunks[i], options.defaultColor);
+				}
+			});
+
+		// Offset of each chunk in the merged arrays
+		std::vector<uint64_t> vertexOffsets(chunks.size() + 1, 0);
+		std::vector<uint64_t> cornerOffsets(chunks.size() + 1, 0);
+		for (size_t i = 0; i < chunks.size(); i++)
+		{
+			if (!chunks[i].error.empty())
+			{
+				std::ostringstream message;
+				message << "Malformed OBJ file near byte " << (chunks[i].begin - data) << ": " << chunks[i].error;
+				throw std::runtime_error(message.str());
+			}
+			vertexOffsets[i + 1] = vertexOffsets[i] + chunks[i].vertices.size();
+			cornerOffsets[i + 1] = cornerOffsets[i] + chunks[i].corners.size();
+		}
+		const uint32_t vertexCount = CheckedCount(vertexOffsets.back(), "vertices");
+		CheckedCount(cornerOffsets.back(), "triangles");
+
+		vertices.resize(vertexCount);
+		corners.resize(cornerOffsets.back());
+
+		// Merge the chunks, resolving the relative indices and validating all of them
+		std::atomic<bool> invalidIndex(false);
+		pool.ParallelFor(static_cast<uint32_t>(chunks.size()), 1,
+			[&](uint32_t begin, uint32_t end, uint32_t /*threadIndex*/) {
+				for (uint32_t i = begin; i < end; i++)
+				{
+					ObjChunk& chunk = chunks[i];
+					std::copy(chunk.vertices.begin(), chunk.vertices.end(), vertices.begin() + vertexOffsets[i]);
+
+					for (const ObjRelativeCorner& corner : chunk.relativeCorners)
+					{
+						int64_t index = static_cast<int64_t>(vertexOffsets[i]) + corner.index;
+						chunk.corners[corner.position] = index < 0 ? kInvalidIndex : static_cast<uint32_t>(index);
+					}
+
+					uint32_t* destination = corners.data() + cornerOffsets[i];
+					for (size_t c = 0; c < chunk.corners.size(); c++)
+					{
+						if (chunk.corners[c] >= vertexCount)
+						{
+							invalidIndex = true;
+						}
+						destination[c] = chunk.corners[c];
+					}
+
+					// Release the memory of the chunk as soon as it has been merged
+					std::vector<Vertex>().swap(chunk.vertices);
+					std::vector<uint32_t>().swap(chunk.corners);
+				}
+			});
+		if (invalidIndex)
+		{
+			throw std::runtime_error("Malformed OBJ file: face referencing a vertex which does not exist");
+		}
+	}
+
+	//--------------------------------------------------------------------------------------------
+	// PLY
+
+	enum class PlyType
+	{
+		Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64
+	};
+
+	struct PlyProperty
+	{
+		std::string name;
+		PlyType type = PlyType::Float32;		// Type of the value, or of the items of a list
+		bool isList = false;
+		PlyType countType = PlyType::UInt8;		// Type of the item count of a list
+		uint32_t offset = 0;					// In the element, when it has no list
+	};
+
+	struct PlyElement
+	{
+		std::string name;
+		uint64_t count = 0;
+		std::vector<PlyProperty> properties;
+		bool hasLists = false;
+		uint32_t stride = 0;					// Size of the element, when it has no list
+	};
+
+	uint32_t PlyTypeSize(PlyType type)
+	{
+		switch (type)
+		{
+		case PlyType::Int8:
+		case PlyType::UInt8:
+			return 1;
+		case PlyType::Int16:
+		case PlyType::UInt16:
+			return 2;
+		case PlyType::Int32:
+		case PlyType::UInt32:
+		case PlyType::Float32:
+			return 4;
+		default:
+			return 8;
+		}
+	}
+
+	PlyType ParsePlyType(const std::string& name)
+	{
+		static const struct
+		{
+			const char* name;
+			PlyType type;
+		} kTypes[] =
+		{
+			{ "char", PlyType::Int8 }, { "int8", PlyType::Int8 },
+			{ "uchar", PlyType::UInt8 }, { "uint8", PlyType::UInt8 },
+			{ "short", PlyType::Int16 }, { "int16", PlyType::Int16 },
+			{ "ushort", PlyType::UInt16 }, { "uint16", PlyType::UInt16 },
+			{ "int", PlyType::Int32 }, { "int32", PlyType::Int32 },
+			{ "uint", PlyType::UInt32 }, { "uint32", PlyType::UInt32 },
+			{ "float", PlyType::Float32 }, { "float32", PlyType::Float32 },
+			{ "double", PlyType::Float64 }, { "float64", PlyType::Float64 }
+		};
+		for (const auto& type : kTypes)
+		{
+			if (name == type.name)
+			{
+				return type.type;
+			}
+		}
+		throw std::runtime_error("Unknown PLY property type " + name);
+	}
+
+	/// Read a value of the given type, converting it from the byte order of the file
+	template <typename T>
+	T ReadRaw(const char* p, bool swapBytes)
+	{
+		T value;
+		if (swapBytes)
+		{
+			char bytes[sizeof(T)];
+			for (size_t i = 0; i < sizeof(T); i++)
+			{
+				bytes[i] = p[sizeof(T) - 1 - i];
+			}
+			memcpy(&value, bytes, sizeof(T));
+		}
+		else
+		{
+			memcpy(&value, p, sizeof(T));
+		}
+		return value;
+	}
+
+	double ReadPlyValue(const char* p, PlyType type, bool swapBytes)
+	{
+		switch (type)
+		{
+		case PlyType::Int8: return ReadRaw<int8_t>(p, swapBytes);
+		case PlyType::UInt8: return ReadRaw<uint8_t>(p, swapBytes);
+		case PlyType::Int16: return ReadRaw<int16_t>(p, swapBytes);
+		case PlyType::UInt16: return ReadRaw<uint16_t>(p, swapBytes);
+		case PlyType::Int32: return ReadRaw<int32_t>(p, swapBytes);
+		case PlyType::UInt32: return ReadRaw<uint32_t>(p, swapBytes);
+		case PlyType::Float32: return ReadRaw<float>(p, swapBytes);
+		default: return ReadRaw<double>(p, swapBytes);
+		}
+	}
+
+	/// Colors stored as integers are normalized by the largest value of their type
+	float PlyColorScale(PlyType type)
+	{
+		switch (type)
+		{
+		case PlyType::Int8: return 1.0f / 127.0f;
+		case PlyType::UInt8: return 1.0f / 255.0f;
+		case PlyType::Int16: return 1.0f / 32767.0f;
+		case PlyType::UInt16: return 1.0f / 65535.0f;
+		case PlyType::Int32: return 1.0f / 2147483647.0f;
+		case PlyType::UInt32: return 1.0f / 4294967295.0f;
+		default: return 1.0f;
+		}
+	}
+
+	const PlyProperty* FindPlyProperty(const PlyElement& element, const char* name)
+	{
+		for (const PlyProperty& property : element.properties)
+		{
+			if (property.name == name)
+			{
+				return &property;
+			}
+		}
+		return nullptr;
+	}
+
+	/// Parse the header, returning the offset of the binary data
+	uint64_t ParsePlyHeader(const char* data, uint64_t size, bool& bigEndian, std::vector<PlyElement>& elements)
+	{
+		const char* p = data;
+		const char* end = data + size;
+		bool isFirstLine = true;
+		bool hasFormat = false;
+		while (p < end)
+		{
+			const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+			if (lineEnd == nullptr)
+			{
+				break;
+			}
+			std::istringstream line(std::string(p, lineEnd));
+			p = lineEnd + 1;
+
+			std::string keyword;
+			line >> keyword;
+			if (isFirstLine)
+			{
+				if (keyword != "ply")
+				{
+					throw std::runtime_error("Not a PLY file");
+				}
+				isFirstLine = false;
+			}
+			else if (keyword == "format")
+			{
+				std::string format;
+				line >> format;
+				if (format == "binary_little_endian")
+				{
+					bigEndian = false;
+				}
+				else if (format == "binary_big_endian")
+				{
+					bigEndian = true;
+				}
+				else
+				{
+					throw std::runtime_error("Unsupported PLY format " + format + ", only binary files are supported");
+				}
+				hasFormat = true;
+			}
+			else if (keyword == "element")
+			{
+				PlyElement element;
+				line >> element.name >> element.count;
+				if (line.fail())
+				{
+					throw std::runtime_error("Malformed PLY element declaration");
+				}
+				elements.push_back(element);
+			}
+			else if (keyword == "property")
+			{
+				if (elements.empty())
+				{
+					throw std::runtime_error("PLY property declared outside of an element");
+				}
+				PlyProperty property;
+				std::string type;
+				line >> type;
+				if (type == "list")
+				{
+					std::string countType;
+					std::string itemType;
+					line >> countType >> itemType;
+					property.isList = true;
+					property.countType = ParsePlyType(countType);
+					property.type = ParsePlyType(itemType);
+				}
+				else
+				{
+					property.type = ParsePlyType(type);
+				}
+				line >> property.name;
+				if (line.fail())
+				{
+					throw std::runtime_error("Malformed PLY property declaration");
+				}
+
+				PlyElement& element = elements.back();
+				property.offset = element.stride;
+				element.hasLists |= property.isList;
+				element.stride += property.isList ? 0 : PlyTypeSize(property.type);
+				element.properties.push_back(property);
+			}
+			else if (keyword == "end_header")
+			{
+				if (!hasFormat)
+				{
+					throw std::runtime_error("PLY file without format");
+				}
+				return static_cast<uint64_t>(p - data);
+			}
+			// comment, obj_info and unknown keywords are ignored
+		}
+		throw std::runtime_error("Truncated PLY header");
+	}
+
+	/// Walks the elements with lists, whose size is only known by reading them
+	class PlyReader
+	{
+	public:
+		PlyReader(const char* begin, const char* end, bool swapBytes)
+			: m_p(begin), m_end(end), m_swapBytes(swapBytes) {}
+
+		const char* GetPosition() const { return m_p; }
+
+		double Read(PlyType type)
+		{
+			const char* p = Consume(PlyTypeSize(type));
+			return ReadPlyValue(p, type, m_swapBytes);
+		}
+
+		const char* Consume(uint64_t size)
+		{
+			if (size > static_cast<uint64_t>(m_end - m_p))
+			{
+				throw std::runtime_error("Truncated PLY file");
+			}
+			const char* p = m_p;
+			m_p += size;
+			return p;
+		}
+
+	private:
+		const char* m_p;
+		const char* m_end;
+		bool m_swapBytes;
+	};
+
+	void DecodePlyVertices(const char* data, const PlyElement& element, bool swapBytes,
+		nv_helpers_dx12::ThreadPool& pool, const MeshLoadOptions& options, std::vector<Vertex>& vertices)
+	{
+		const PlyProperty* position[3] =
+		{
+			FindPlyProperty(element, "x"), FindPlyProperty(element, "y"), FindPlyProperty(element, "z")
+		};
+		const PlyProperty* color[4] =
+		{
+			FindPlyProperty(element, "red"), FindPlyProperty(element, "green"),
+			FindPlyProperty(element, "blue"), FindPlyProperty(element, "alpha")
+		};
+		for (const PlyProperty* property : position)
+		{
+			if (property == nullptr)
+			{
+				throw std::runtime_error("PLY vertices without x, y and z");
+			}
+		}
+		const bool hasColor = color[0] && color[1] && color[2];
+
+		pool.ParallelFor(static_cast<uint32_t>(vertices.size()), kElementGrain,
+			[&](uint32_t begin, uint32_t end, uint32_t /*threadIndex*/) {
+				for (uint32_t i = begin; i < end; i++)
+				{
+					const char* p = data + static_cast<uint64_t>(i) * element.stride;
+					Vertex& vertex = vertices[i];
+					vertex.position.x = static_cast<float>(ReadPlyValue(p + position[0]->offset, position[0]->type, swapBytes));
+					vertex.position.y = static_cast<float>(ReadPlyValue(p + position[1]->offset, position[1]->type, swapBytes));
+					vertex.position.z = static_cast<float>(ReadPlyValue(p + position[2]->offset, position[2]->type, swapBytes));
+
+					vertex.color = options.defaultColor;
+					if (hasColor)
+					{
+						float* channels = &vertex.color.x;
+						for (int c = 0; c < 4; c++)
+						{
+							if (color[c])
+							{
+								channels[c] = static_cast<float>(ReadPlyValue(p + color[c]->offset, color[c]->type, swapBytes)) *
+									PlyColorScale(color[c]->type);
+							}
+						}
+					}
+				}
+			});
+	}
+
+	/// Decode the faces, returning the position following the element. When the element only holds
+	/// the vertex indices of triangles, all faces have the same size and are decoded in parallel
+	const char* DecodePlyFaces(const char* data, const char* dataEnd, const PlyElement& element,
+		bool swapBytes, uint32_t vertexCount, nv_helpers_dx12::ThreadPool& pool, std::vector<uint32_t>& corners)
+	{
+		const PlyProperty* indexProperty = FindPlyProperty(element, "vertex_indices");
+		if (indexProperty == nullptr)
+		{
+			indexProperty = FindPlyProperty(element, "vertex_index");
+		}
+		if (indexProperty == nullptr || !indexProperty->isList)
+		{
+			throw std::runtime_error("PLY faces without a vertex_indices list");
+		}
+
+		std::atomic<bool> invalidIndex(false);
+		const uint32_t countSize = PlyTypeSize(indexProperty->countType);
+		const uint32_t indexSize = PlyTypeSize(indexProperty->type);
+		const uint64_t triangleSize = countSize + 3 * indexSize;
+		if (element.properties.size() == 1 && element.count <= static_cast<uint64_t>(dataEnd - data) / triangleSize)
+		{
+			const uint32_t faceCount = CheckedCount(element.count, "triangles");
+			std::atomic<bool> allTriangles(true);
+			pool.ParallelFor(faceCount, kElementGrain,
+				[&](uint32_t begin, uint32_t end, uint32_t /*threadIndex*/) {
+					for (uint32_t i = begin; i < end && allTriangles; i++)
+					{
+						if (ReadPlyValue(data + i * triangleSize, indexProperty->countType, swapBytes) != 3.0)
+						{
+							allTriangles = false;
+						}
+					}
+				});
+
+			if (allTriangles)
+			{
+				CheckedCount(3 * static_cast<uint64_t>(faceCount), "triangles");
+				corners.resize(3 * static_cast<size_t>(faceCount));
+				pool.ParallelFor(faceCount, kElementGrain,
+					[&](uint32_t begin, uint32_t end, uint32_t /*threadIndex*/) {
+						for (uint32_t i = begin; i < end; i++)
+						{
+							const char* p = data + i * triangleSize + countSize;
+							for (uint32_t c = 0; c < 3; c++)
+							{
+								double index = ReadPlyValue(p + c * indexSize, indexProperty->type, swapBytes);
+								if (index < 0.0 || index >= vertexCount)
+								{
+									invalidIndex = true;
+									index = 0.0;
+								}
+								corners[3 * static_cast<size_t>(i) + c] = static_cast<uint32_t>(index);
+							}
+						}
+					});
+				if (invalidIndex)
+				{
+					throw std::runtime_error("Malformed PLY file: face referencing a vertex which does not exist");
+				}
+				return data + faceCount * triangleSize;
+			}
+		}
+
+		// Faces of any size, mixed with other properties
+		PlyReader reader(data, dataEnd, swapBytes);
+		std::vector<uint32_t> polygon;
+		for (uint64_t i = 0; i < element.count; i++)
+		{
+			for (const PlyProperty& property : element.properties)
+			{
+				if (!property.isList)
+				{
+					reader.Consume(PlyTypeSize(property.type));
+					continue;
+				}
+				double itemCount = reader.Read(property.countType);
+				if (itemCount < 0.0)
+				{
+					throw std::runtime_error("Malformed PLY list");
+				}
+				if (&property != indexProperty)
+				{
+					reader.Consume(static_cast<uint64_t>(itemCount) * PlyTypeSize(property.type));
+					continue;
+				}
+
+				polygon.clear();
+				for (uint64_t c = 0; c < static_cast<uint64_t>(itemCount); c++)
+				{
+					double index = reader.Read(property.type);
+					if (index < 0.0 || index >= vertexCount)
+					{
+						throw std::runtime_error("Malformed PLY file: face referencing a vertex which does not exist");
+					}
+					polygon.push_back(static_cast<uint32_t>(index));
+				}
+				for (size_t c = 1; c + 1 < polygon.size(); c++)
+				{
+					corners.push_back(polygon[0]);
+					corners.push_back(polygon[c]);
+					corners.push_back(polygon[c + 1]);
+				}
+			}
+		}
+		CheckedCount(corners.size(), "triangles");
+		return reader.GetPosition();
+	}
+
+	void LoadPly(const char* data, uint64_t size, nv_helpers_dx12::ThreadPool& pool,
+		const MeshLoadOptions& options, std::vector<Vertex>& vertices, std::vector<uint32_t>& corners)
+	{
+		bool bigEndian = false;
+		std::vector<PlyElement> elements;
+		const char* p = data + ParsePlyHeader(data, size, bigEndian, elements);
+		const char* dataEnd = data + size;
+
+		// Multi-byte values are swapped when the byte order of the file differs from the host
+		const uint16_t one = 1;
+		const bool swapBytes = bigEndian == (*reinterpret_cast<const uint8_t*>(&one) == 1);
+
+		uint32_t vertexCount = 0;
+		for (const PlyElement& element : elements)
+		{
+			if (element.name == "vertex")
+			{
+				vertexCount = CheckedCount(element.count, "vertices");
+			}
+		}
+
+		for (const PlyElement& element : elements)
+		{
+			if (!element.hasLists)
+			{
+				if (element.count > static_cast<uint64_t>(dataEnd - p) / (std::max)(element.stride, 1u))
+				{
+					throw std::runtime_error("Truncated PLY file");
+				}
+				if (element.name == "vertex")
+				{
+					vertices.resize(vertexCount);
+					DecodePlyVertices(p, element, swapBytes, pool, options, vertices);
+				}
+				p += element.count * element.stride;
+			}
+			else if (element.name == "face")
+			{
+				p = DecodePlyFaces(p, dataEnd, element, swapBytes, vertexCount, pool, corners);
+			}
+			else if (element.name == "vertex")
+			{
+				throw std::runtime_error("PLY vertices with list properties are not supported");
+			}
+			else
+			{
+				// Skip the element, reading the size of its lists
+				PlyReader reader(p, dataEnd, swapBytes);
+				for (uint64_t i = 0; i < element.count; i++)
+				{
+					for (const PlyProperty& property : element.properties)
+					{
+						uint64_t itemCount = 1;
+						if (property.isList)
+						{
+							itemCount = static_cast<uint64_t>((std::max)(reader.Read(property.countType), 0.0));
+						}
+						reader.Consume(itemCount * PlyTypeSize(property.type));
+					}
+				}
+				p = reader.GetPosition();
+			}
+		}
+	}
+
+	//--------------------------------------------------------------------------------------------
+	// Deduplication
+
+	uint32_t HashVertex(const Vertex& vertex)
+	{
+		static_assert(sizeof(Vertex) % sizeof(uint32_t) == 0, "Vertex is hashed as 32-bit words");
+		uint32_t words[sizeof(Vertex) / sizeof(uint32_t)];
+		memcpy(words, &vertex, sizeof(Vertex));
+
+		uint64_t hash = 0x9E3779B97F4A7C15ull;
+		for (uint32_t word : words)
+		{
+			hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+			hash ^= hash >> 32;
+		}
+		return static_cast<uint32_t>(hash);
+	}
+
+	/// Replace the vertices by the unique vertices referenced by the corners, in order of first
+	/// reference, and remap the corners accordingly. Vertices are compared bitwise
+	void DeduplicateVertices(nv_helpers_dx12::ThreadPool& pool, std::vector<Vertex>& vertices,
+		std::vector<uint32_t>& corners)
+	{
+		const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+		std::vector<uint32_t> hashes(vertexCount);
+		pool.ParallelFor(vertexCount, kElementGrain,
+			[&](uint32_t begin, uint32_t end, uint32_t /*threadIndex*/) {
+				for (uint32_t i = begin; i < end; i++)
+				{
+					hashes[i] = HashVertex(vertices[i]);
+				}
+			});
+
+		// Open addressing table of unique vertex indices, at most half full
+		uint64_t tableSize = 16;
+		while (tableSize < 2 * static_cast<uint64_t>(vertexCount))
+		{
+			tableSize *= 2;
+		}
+		const uint64_t tableMask = tableSize - 1;
+		std::vector<uint32_t> table(tableSize, kInvalidIndex);
+
+		std::vector<uint32_t> remap(vertexCount, kInvalidIndex);
+		std::vector<Vertex> uniqueVertices;
+		for (uint32_t& corner : corners)
+		{
+			uint32_t& mapped = remap[corner];
+			if (mapped == kInvalidIndex)
+			{
+				const Vertex& vertex = vertices[corner];
+				uint64_t slot = hashes[corner] & tableMask;
+				while (table[slot] != kInvalidIndex &&
+					memcmp(&uniqueVertices[table[slot]], &vertex, sizeof(Vertex)) != 0)
+				{
+					slot = (slot + 1) & tableMask;
+				}
+				if (table[slot] == kInvalidIndex)
+				{
+					table[slot] = static_cast<uint32_t>(uniqueVertices.size());
+					uniqueVertices.push_back(vertex);
+				}
+				mapped = table[slot];
+			}
+			corner = mapped;
+		}
+
+		vertices.swap(uniqueVertices);
+	}
+
+	void Normalize(std::vector<Vertex>& vertices, float size)
+	{
+		if (vertices.empty())
+		{
+			return;
+		}
+		XMFLOAT3 minimum = vertices[0].position;
+		XMFLOAT3 maximum = vertices[0].position;
+		for (const Vertex& vertex : vertices)
+		{
+			minimum.x = (std::min)(minimum.x, vertex.position.x);
+			minimum.y = (std::min)(minimum.y, vertex.position.y);
+			minimum.z = (std::min)(minimum.z, vertex.position.z);
+			maximum.x = (std::max)(maximum.x, vertex.position.x);
+			maximum.y = (std::max)(maximum.y, vertex.position.y);
+			maximum.z = (std::max)(maximum.z, vertex.position.z);
+		}
+
+		float extent = (std::max)((std::max)(maximum.x - minimum.x, maximum.y - minimum.y), maximum.z - minimum.z);
+		float scale = extent > 0.0f ? size / extent : 1.0f;
+		XMFLOAT3 center((minimum.x + maximum.x) * 0.5f, (minimum.y + maximum.y) * 0.5f, (minimum.z + maximum.z) * 0.5f);
+		for (Vertex& vertex : vertices)
+		{
+			vertex.position.x = (vertex.position.x - center.x) * scale;
+			vertex.position.y = (vertex.position.y - center.y) * scale;
+			vertex.position.z = (vertex.position.z - center.z) * scale;
+		}
+	}
+
+	bool HasExtension(const std::string& fileName, const char* extension)
+	{
+		size_t length = strlen(extension);
+		if (fileName.size() < length)
+		{
+			return false;
+		}
+		for (size_t i = 0; i < length; i++)
+		{
+			char c = fileName[fileName.size() - length + i];
+			if (c >= 'A' && c <= 'Z')
+			{
+				c = static_cast<char>(c - 'A' + 'a');
+			}
+			if (c != extension[i])
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+void MeshLoader::Load(const std::string& fileName, std::vector<Vertex>& vertices,
+	std::vector<uint32_t>& indices, const MeshLoadOptions& options, MeshLoadStats* stats)
+{
+	const bool isObj = HasExtension(fileName, ".obj");
+	if (!isObj && !HasExtension(fileName, ".ply"))
+	{
+		throw std::runtime_error("Unsupported mesh file " + fileName + ", expected .obj or .ply");
+	}
+
+	MeshLoadStats loadStats;
+	auto start = Clock::now();
+	MappedFile file(fileName);
+	loadStats.fileSizeInBytes = file.GetSize();
+	loadStats.mapMilliseconds = MillisecondsSince(start);
+
+	nv_helpers_dx12::ThreadPool pool(options.threadCount);
+	loadStats.threadCount = pool.GetThreadCount();
+
+	auto parseStart = Clock::now();
+	vertices.clear();
+	indices.clear();
+	if (isObj)
+	{
+		LoadObj(file.GetData(), file.GetSize(), pool, options, vertices, indices, loadStats);
+	}
+	else
+	{
+		LoadPly(file.GetData(), file.GetSize(), pool, options, vertices, indices);
+		loadStats.chunkCount = (std::max)(static_cast<uint32_t>(vertices.size() / kElementGrain), 1u);
+	}
+	loadStats.inputVertexCount = static_cast<uint32_t>(vertices.size());
+	loadStats.triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	loadStats.parseMilliseconds = MillisecondsSince(parseStart);
+
+	auto deduplicateStart = Clock::now();
+	if (options.deduplicateVertices)
+	{
+		DeduplicateVertices(pool, vertices, indices);
+	}
+	loadStats.vertexCount = static_cast<uint32_t>(vertices.size());
+	loadStats.deduplicateMilliseconds = MillisecondsSince(deduplicateStart);
+
+	// #DXR Custom: Mesh Optimizer
+	if (options.optimize)
+	{
+		MeshOptimizer::Optimize(vertices, indices, options.optimization, &loadStats.optimization);
+		loadStats.vertexCount = static_cast<uint32_t>(vertices.size());
+	}
+
+	if (options.normalizedSize > 0.0f)
+	{
+		Normalize(vertices, options.normalizedSize);
+	}
+
+	loadStats.totalMilliseconds = MillisecondsSince(start);
+	if (loadStats.totalMilliseconds > 0.0)
+	{
+		double seconds = loadStats.totalMilliseconds / 1000.0;
+		loadStats.megabytesPerSecond = static_cast<double>(loadStats.fileSizeInBytes) / (1024.0 * 1024.0) / seconds;
+		loadStats.trianglesPerSecond = loadStats.triangleCount / seconds;
+	}
+
+	if (stats)
+	{
+		*stats = loadStats;
+	}
+}
+
+bool MeshLoader::ParseFloat(const char*& begin, const char* end, float& value)
+{
+	static const float kFloatPowersOf10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+	static const double kDoublePowersOf10[] =
+	{
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	const char* p = begin;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+
+	// Accumulate up to 19 significant digits, which always fit in 64 bits
+	uint64_t mantissa = 0;
+	int digitCount = 0;
+	int exponent = 0;
+	bool hasDigits = false;
+	bool isTruncated = false;
+	while (p < end && IsDigit(*p))
+	{
+		hasDigits = true;
+		if (digitCount < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			digitCount += mantissa != 0 ? 1 : 0;
+		}
+		else
+		{
+			exponent++;
+			isTruncated |= *p != '0';
+		}
+		p++;
+	}
+	if (p < end && *p == '.')
+	{
+		p++;
+		while (p < end && IsDigit(*p))
+		{
+			hasDigits = true;
+			if (digitCount < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				digitCount += mantissa != 0 ? 1 : 0;
+				exponent--;
+			}
+			else
+			{
+				isTruncated |= *p != '0';
+			}
+			p++;
+		}
+	}
+
+	if (hasDigits && p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char* q = p + 1;
+		bool negativeExponent = false;
+		if (q < end && (*q == '-' || *q == '+'))
+		{
+			negativeExponent = *q == '-';
+			q++;
+		}
+		if (q < end && IsDigit(*q))
+		{
+			int explicitExponent = 0;
+			while (q < end && IsDigit(*q))
+			{
+				explicitExponent = (std::min)(explicitExponent * 10 + (*q - '0'), 100000);
+				q++;
+			}
+			exponent += negativeExponent ? -explicitExponent : explicitExponent;
+			p = q;
+		}
+	}
+
+	if (hasDigits && !isTruncated)
+	{
+		// Both the mantissa and the power of 10 are exact, hence a single rounding occurs
+		if (mantissa == 0)
+		{
+			value = negative ? -0.0f : 0.0f;
+			begin = p;
+			return true;
+		}
+		if (mantissa <= (uint64_t(1) << 24) && exponent >= -10 && exponent <= 10)
+		{
+			float result = static_cast<float>(mantissa);
+			result = exponent < 0 ? result / kFloatPowersOf10[-exponent] : result * kFloatPowersOf10[exponent];
+			value = negative ? -result : result;
+			begin = p;
+			return true;
+		}
+		if (mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22)
+		{
+			double result = static_cast<double>(mantissa);
+			result = exponent < 0 ? result / kDoublePowersOf10[-exponent] : result * kDoublePowersOf10[exponent];
+			value = static_cast<float>(negative ? -result : result);
+			begin = p;
+			return true;
+		}
+	}
+
+	// Long mantissas, large exponents, inf and nan go through strtod, on a null-terminated copy
+	// since the mapped file is not terminated
+	const char* tokenEnd = begin;
+	while (tokenEnd < end && !IsSpace(*tokenEnd) && *tokenEnd != '\n')
+	{
+		tokenEnd++;
+	}
+	std::string token(begin, tokenEnd);
+	char* parsedEnd = nullptr;
+	double result = strtod(token.c_str(), &parsedEnd);
+	if (parsedEnd == token.c_str())
+	{
+		return false;
+	}
+	value = static_cast<float>(result);
+	begin += parsedEnd - token.c_str();
+	return true;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+// #DXR Custom: Mesh Loader
+// Loads triangle meshes from Wavefront OBJ and binary PLY files into the Vertex layout used by
+// MeshDataUtility, with 32-bit indices ready for CreateMeshBuffers and the BLAS builder.
+//
+// The file is memory-mapped instead of being read through a stream, and split in chunks parsed
+// in parallel on a ThreadPool:
+//   - OBJ files are split on line boundaries. Each chunk collects its vertices and face corners,
+//     and the chunks are concatenated once the vertex count preceding each of them is known,
+//     which is needed to resolve the relative (negative) OBJ indices.
+//   - PLY vertices have a fixed size, hence the vertex element is split evenly. The faces are
+//     decoded in parallel when they are all triangles, which is the common case.
+// Vertices are then deduplicated on their exact position and color, so that faces sharing
+// vertices index them instead of duplicating them. Vertices referenced by no face are dropped.
+//
+// Only the positions and vertex colors are kept, since the Vertex layout has no other attribute.
+// Texture coordinates, normals, materials and groups are ignored. Malformed files throw a
+// std::runtime_error describing the problem.
+
+#include "MeshOptimizer.h"
+#include "VertexTypes.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct MeshLoadOptions
+{
+	uint32_t threadCount = 0;				// 0 selects std::thread::hardware_concurrency()
+	uint64_t chunkSizeInBytes = 4 << 20;	// Amount of OBJ text parsed by a task
+	bool deduplicateVertices = true;
+	XMFLOAT4 defaultColor = { 1.0f, 1.0f, 1.0f, 1.0f };	// For files without vertex colors
+
+	// When positive, the mesh is centered on the origin and scaled so that its largest extent is
+	// this size, so that arbitrary files can replace the built-in meshes
+	float normalizedSize = 0.0f;
+	// #DXR Custom: Mesh Optimizer
+	// Reorder the triangles and vertices for the vertex cache, overdraw and vertex fetch
+	bool optimize = false;
+	MeshOptimizationOptions optimization;
+};
+
+/// Timings and throughput of a load, to profile the loader on large files
+struct MeshLoadStats
+{
+	uint64_t fileSizeInBytes = 0;
+	uint32_t inputVertexCount = 0;			// Vertices declared in the file
+	uint32_t vertexCount = 0;				// Vertices after deduplication
+	uint32_t triangleCount = 0;
+	uint32_t chunkCount = 0;				// Parallel parsing tasks
+	uint32_t threadCount = 0;
+
+	double mapMilliseconds = 0.0;			// Opening and mapping the file
+	double parseMilliseconds = 0.0;			// Parsing, including the concatenation of the chunks
+	double deduplicateMilliseconds = 0.0;
+	double totalMilliseconds = 0.0;
+
+	double megabytesPerSecond = 0.0;		// File size over the total time
+	double trianglesPerSecond = 0.0;
+
+	// #DXR Custom: Mesh Optimizer
+	MeshOptimizationStats optimization;		// Only filled if MeshLoadOptions::optimize is set
+};
+
+class MeshLoader
+{
+public:
+	/// <summary>
+	/// Load an OBJ or binary PLY file, selected from the extension of the file name. Polygons are
+	/// triangulated as fans. Throws std::runtime_error if the file cannot be read or is malformed.
+	/// </summary>
+	static void Load(const std::string& fileName, std::vector<Vertex>& vertices,
+		std::vector<uint32_t>& indices, const MeshLoadOptions& options = {}, MeshLoadStats* stats = nullptr);
+
+	/// <summary>
+	/// Parse a float at the start of [begin, end), advancing begin past it. Accepts the decimal
+	/// forms written by C printf, and returns false if there is no number at the start of the range.
+	/// Values with at most 19 significant digits and a small exponent, which covers the output of
+	/// all common exporters, are converted with a single multiplication by an exact power of 10
+	/// instead of going through strtod.
+	/// </summary>
+	static bool ParseFloat(const char*& begin, const char* end, float& value);
+};
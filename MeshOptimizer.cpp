@@ -0,0 +1,537 @@
+#include "MeshOptimizer.h"
+#include "MeshletBuilder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+	const uint32_t kInvalidIndex = 0xFFFFFFFFu;
+
+	/// FIFO cache simulated with timestamps: a vertex is in the cache if fewer than cacheSize
+	/// misses occurred since it was loaded. Advancing the time by cacheSize flushes the cache
+	class VertexCacheSimulator
+	{
+	public:
+		VertexCacheSimulator(uint32_t vertexCount, uint32_t cacheSize)
+			: m_loadTimes(vertexCount, 0), m_cacheSize(cacheSize), m_time(cacheSize + 1) {}
+
+		/// Returns 1 if the vertex had to be transformed
+		uint32_t Access(uint32_t vertex)
+		{
+			if (m_time - m_loadTimes[vertex] > m_cacheSize)
+			{
+				m_loadTimes[vertex] = m_time++;
+				return 1;
+			}
+			return 0;
+		}
+
+		uint32_t AccessTriangle(const uint32_t* corners)
+		{
+			return Access(corners[0]) + Access(corners[1]) + Access(corners[2]);
+		}
+
+		void Flush()
+		{
+			m_time += m_cacheSize + 1;
+		}
+
+	private:
+		std::vector<uint32_t> m_loadTimes;
+		uint32_t m_cacheSize;
+		uint32_t m_time;
+	};
+
+	/// Score of a vertex in Forsyth's algorithm, from its position in the LRU cache (-1 if not
+	/// cached) and its number of triangles left. The last triangle's vertices get a fixed score,
+	/// so that the next triangle does not simply reuse them, and vertices with few triangles left
+	/// are boosted so that they are finished before they leave the cache
+	float ForsythVertexScore(int32_t cachePosition, uint32_t liveCount, uint32_t cacheSize)
+	{
+		if (liveCount == 0)
+		{
+			return -1.0f;
+		}
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+			{
+				score = 0.75f;
+			}
+			else
+			{
+				const float scale = 1.0f / static_cast<float>(cacheSize - 3);
+				score = std::pow(1.0f - (cachePosition - 3) * scale, 1.5f);
+			}
+		}
+		return score + 2.0f / std::sqrt(static_cast<float>(liveCount));
+	}
+
+	struct Cluster
+	{
+		uint32_t firstTriangle;
+		uint32_t triangleCount;
+		float sortKey;
+	};
+}
+
+void MeshOptimizer::Optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+	const MeshOptimizationOptions& options, MeshOptimizationStats* stats)
+{
+	auto start = std::chrono::steady_clock::now();
+	MeshOptimizationStats optimizationStats;
+	optimizationStats.before = AnalyzeVertexCache(indices, static_cast<uint32_t>(vertices.size()), options.cacheSize);
+
+	if (options.optimizeVertexCache)
+	{
+		if (options.vertexCacheAlgorithm == VertexCacheAlgorithm::Forsyth)
+		{
+			OptimizeVertexCacheForsyth(indices, static_cast<uint32_t>(vertices.size()), options.cacheSize);
+		}
+		else
+		{
+			OptimizeVertexCache(indices, static_cast<uint32_t>(vertices.size()), options.cacheSize);
+		}
+	}
+	if (options.optimizeOverdraw)
+	{
+		optimizationStats.clusterCount = OptimizeOverdraw(indices, vertices, options.cacheSize, options.overdrawThreshold);
+	}
+	if (options.optimizeMeshlets)
+	{
+		MeshletBuilder::OrderTriangles(vertices.data(), static_cast<uint32_t>(vertices.size()), indices.data(),
+			static_cast<uint32_t>(indices.size()));
+	}
+	if (options.optimizeVertexFetch)
+	{
+		OptimizeVertexFetch(vertices, indices);
+	}
+
+	optimizationStats.after = AnalyzeVertexCache(indices, static_cast<uint32_t>(vertices.size()), options.cacheSize);
+	optimizationStats.milliseconds =
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	if (stats)
+	{
+		*stats = optimizationStats;
+	}
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+	const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Triangles adjacent to each vertex, stored contiguously per vertex. The live count of a
+	// vertex is the number of its triangles not emitted yet
+	std::vector<uint32_t> liveCounts(vertexCount, 0);
+	for (uint32_t index : indices)
+	{
+		liveCounts[index]++;
+	}
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveCounts[v];
+	}
+	std::vector<uint32_t> adjacency(indices.size());
+	{
+		std::vector<uint32_t> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (uint32_t i = 0; i < indices.size(); i++)
+		{
+			adjacency[cursors[indices[i]]++] = i / 3;
+		}
+	}
+
+	std::vector<uint32_t> cacheTimes(vertexCount, 0);
+	std::vector<uint8_t> isEmitted(triangleCount, 0);
+	std::vector<uint32_t> deadEndStack;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	uint32_t time = cacheSize + 1;
+	uint32_t nextVertex = 0;			// Scan position for restarts once the dead-end stack is empty
+
+	uint32_t fanningVertex = indices[0];
+	while (fanningVertex != kInvalidIndex)
+	{
+		// Emit all the remaining triangles around the fanning vertex
+		candidates.clear();
+		for (uint32_t a = adjacencyOffsets[fanningVertex]; a < adjacencyOffsets[fanningVertex + 1]; a++)
+		{
+			uint32_t triangle = adjacency[a];
+			if (isEmitted[triangle])
+			{
+				continue;
+			}
+			isEmitted[triangle] = 1;
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				uint32_t v = indices[3 * triangle + c];
+				output.push_back(v);
+				deadEndStack.push_back(v);
+				candidates.push_back(v);
+				liveCounts[v]--;
+				if (time - cacheTimes[v] > cacheSize)
+				{
+					cacheTimes[v] = time++;
+				}
+			}
+		}
+
+		// Fan next around the candidate which was loaded the longest ago, provided it will still be
+		// in the cache once its own triangles have been emitted
+		fanningVertex = kInvalidIndex;
+		int64_t bestPriority = -1;
+		for (uint32_t v : candidates)
+		{
+			if (liveCounts[v] == 0)
+			{
+				continue;
+			}
+			int64_t age = static_cast<int64_t>(time) - cacheTimes[v];
+			int64_t priority = age + 2 * static_cast<int64_t>(liveCounts[v]) <= cacheSize ? age : 0;
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				fanningVertex = v;
+			}
+		}
+
+		// Dead end: restart from the most recently used vertex with triangles left, or from the
+		// next one in index order
+		while (fanningVertex == kInvalidIndex && !deadEndStack.empty())
+		{
+			uint32_t v = deadEndStack.back();
+			deadEndStack.pop_back();
+			if (liveCounts[v] > 0)
+			{
+				fanningVertex = v;
+			}
+		}
+		while (fanningVertex == kInvalidIndex && nextVertex < vertexCount)
+		{
+			if (liveCounts[nextVertex] > 0)
+			{
+				fanningVertex = nextVertex;
+			}
+			nextVertex++;
+		}
+	}
+
+	indices.swap(output);
+}
+
+void MeshOptimizer::OptimizeVertexCacheForsyth(std::vector<uint32_t>& indices, uint32_t vertexCount,
+	uint32_t cacheSize)
+{
+	const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	if (triangleCount == 0)
+	{
+		return;
+	}
+	// The position score needs a few entries past the 3 of the last triangle
+	cacheSize = (std::max)(cacheSize, 4u);
+
+	// Same adjacency as Tipsify. The triangles of a vertex are compacted as they are emitted, so
+	// that the first liveCounts[v] entries are the remaining ones
+	std::vector<uint32_t> liveCounts(vertexCount, 0);
+	for (uint32_t index : indices)
+	{
+		liveCounts[index]++;
+	}
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveCounts[v];
+	}
+	std::vector<uint32_t> adjacency(indices.size());
+	{
+		std::vector<uint32_t> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (uint32_t i = 0; i < indices.size(); i++)
+		{
+			adjacency[cursors[indices[i]]++] = i / 3;
+		}
+	}
+
+	std::vector<float> vertexScores(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		vertexScores[v] = ForsythVertexScore(-1, liveCounts[v], cacheSize);
+	}
+	std::vector<float> triangleScores(triangleCount);
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		triangleScores[t] = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] +
+			vertexScores[indices[3 * t + 2]];
+	}
+
+	// The cache holds up to 3 more entries while a triangle is pushed in front of it
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> nextCache;
+	cache.reserve(cacheSize + 3);
+	nextCache.reserve(cacheSize + 3);
+	std::vector<int32_t> cachePositions(vertexCount, -1);
+	std::vector<uint8_t> isEmitted(triangleCount, 0);
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	uint32_t nextTriangle = 0;			// Scan position for restarts when no cached vertex has triangles left
+
+	uint32_t bestTriangle = 0;
+	for (uint32_t t = 1; t < triangleCount; t++)
+	{
+		bestTriangle = triangleScores[t] > triangleScores[bestTriangle] ? t : bestTriangle;
+	}
+	while (bestTriangle != kInvalidIndex)
+	{
+		isEmitted[bestTriangle] = 1;
+		const uint32_t* corners = &indices[3 * bestTriangle];
+		output.insert(output.end(), corners, corners + 3);
+
+		// Remove the triangle from the adjacency of its vertices, and move them to the front of
+		// the cache
+		nextCache.clear();
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			uint32_t v = corners[c];
+			uint32_t* triangles = &adjacency[adjacencyOffsets[v]];
+			uint32_t* found = std::find(triangles, triangles + liveCounts[v], bestTriangle);
+			std::swap(*found, triangles[liveCounts[v] - 1]);
+			liveCounts[v]--;
+			if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end())
+			{
+				nextCache.push_back(v);
+			}
+		}
+		for (uint32_t v : cache)
+		{
+			if (v != corners[0] && v != corners[1] && v != corners[2])
+			{
+				nextCache.push_back(v);
+			}
+		}
+
+		// Rescore the vertices of the cache, including the ones falling out of it, and the
+		// remaining triangles around them. The best of these triangles is emitted next
+		for (uint32_t i = 0; i < nextCache.size(); i++)
+		{
+			cachePositions[nextCache[i]] = i < cacheSize ? static_cast<int32_t>(i) : -1;
+		}
+		for (uint32_t v : nextCache)
+		{
+			float score = ForsythVertexScore(cachePositions[v], liveCounts[v], cacheSize);
+			float delta = score - vertexScores[v];
+			vertexScores[v] = score;
+			for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v] + liveCounts[v]; a++)
+			{
+				triangleScores[adjacency[a]] += delta;
+			}
+		}
+		if (nextCache.size() > cacheSize)
+		{
+			nextCache.resize(cacheSize);
+		}
+		cache.swap(nextCache);
+
+		bestTriangle = kInvalidIndex;
+		float bestScore = -1.0f;
+		for (uint32_t v : cache)
+		{
+			for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v] + liveCounts[v]; a++)
+			{
+				uint32_t triangle = adjacency[a];
+				if (triangleScores[triangle] > bestScore)
+				{
+					bestScore = triangleScores[triangle];
+					bestTriangle = triangle;
+				}
+			}
+		}
+
+		// Dead end: restart from the next triangle left in index order, rather than searching all
+		// of them for the best score, which would make the algorithm quadratic
+		while (bestTriangle == kInvalidIndex && nextTriangle < triangleCount)
+		{
+			if (!isEmitted[nextTriangle])
+			{
+				bestTriangle = nextTriangle;
+			}
+			nextTriangle++;
+		}
+	}
+
+	indices.swap(output);
+}
+
+uint32_t MeshOptimizer::OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices,
+	uint32_t cacheSize, float threshold)
+{
+	const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	if (triangleCount == 0)
+	{
+		return 0;
+	}
+	const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+
+	// Hard boundaries are the triangles whose 3 vertices miss the cache, where the vertex cache
+	// order restarted. Reordering whole hard clusters does not change the cache efficiency
+	std::vector<uint32_t> hardBoundaries;
+	{
+		VertexCacheSimulator cache(vertexCount, cacheSize);
+		for (uint32_t t = 0; t < triangleCount; t++)
+		{
+			if (cache.AccessTriangle(&indices[3 * t]) == 3)
+			{
+				hardBoundaries.push_back(t);
+			}
+		}
+		if (hardBoundaries.empty() || hardBoundaries[0] != 0)
+		{
+			hardBoundaries.insert(hardBoundaries.begin(), 0);
+		}
+		hardBoundaries.push_back(triangleCount);
+	}
+
+	// Split the hard clusters further where the cluster started so far has an ACMR within the
+	// threshold of the whole hard cluster, so that restarting with a cold cache costs little
+	std::vector<Cluster> clusters;
+	VertexCacheSimulator cache(vertexCount, cacheSize);
+	for (size_t h = 0; h + 1 < hardBoundaries.size(); h++)
+	{
+		const uint32_t begin = hardBoundaries[h];
+		const uint32_t end = hardBoundaries[h + 1];
+
+		cache.Flush();
+		uint32_t hardMisses = 0;
+		for (uint32_t t = begin; t < end; t++)
+		{
+			hardMisses += cache.AccessTriangle(&indices[3 * t]);
+		}
+		const float clusterThreshold = threshold * hardMisses / (end - begin);
+
+		cache.Flush();
+		uint32_t clusterBegin = begin;
+		uint32_t clusterMisses = 0;
+		for (uint32_t t = begin; t < end; t++)
+		{
+			clusterMisses += cache.AccessTriangle(&indices[3 * t]);
+			if (t + 1 < end && clusterMisses <= clusterThreshold * (t + 1 - clusterBegin))
+			{
+				clusters.push_back({ clusterBegin, t + 1 - clusterBegin, 0.0f });
+				clusterBegin = t + 1;
+				clusterMisses = 0;
+				cache.Flush();
+			}
+		}
+		clusters.push_back({ clusterBegin, end - clusterBegin, 0.0f });
+	}
+
+	// Sort the clusters by how much they face away from the center of the mesh, as the outer
+	// surfaces are the most likely to occlude the rest
+	auto position = [&](uint32_t corner) { return vertices[indices[corner]].position; };
+	float meshCenter[3] = { 0.0f, 0.0f, 0.0f };
+	for (uint32_t index : indices)
+	{
+		meshCenter[0] += vertices[index].position.x;
+		meshCenter[1] += vertices[index].position.y;
+		meshCenter[2] += vertices[index].position.z;
+	}
+	for (float& coordinate : meshCenter)
+	{
+		coordinate /= static_cast<float>(indices.size());
+	}
+
+	for (Cluster& cluster : clusters)
+	{
+		// Area weighted centroid and normal, the cross product having a length of twice the area
+		float centroid[3] = { 0.0f, 0.0f, 0.0f };
+		float normal[3] = { 0.0f, 0.0f, 0.0f };
+		float area = 0.0f;
+		for (uint32_t t = cluster.firstTriangle; t < cluster.firstTriangle + cluster.triangleCount; t++)
+		{
+			XMFLOAT3 p0 = position(3 * t);
+			XMFLOAT3 p1 = position(3 * t + 1);
+			XMFLOAT3 p2 = position(3 * t + 2);
+			float e1[3] = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+			float e2[3] = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			float triangleArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+			centroid[0] += (p0.x + p1.x + p2.x) / 3.0f * triangleArea;
+			centroid[1] += (p0.y + p1.y + p2.y) / 3.0f * triangleArea;
+			centroid[2] += (p0.z + p1.z + p2.z) / 3.0f * triangleArea;
+			normal[0] += n[0];
+			normal[1] += n[1];
+			normal[2] += n[2];
+			area += triangleArea;
+		}
+
+		float normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (area > 0.0f && normalLength > 0.0f)
+		{
+			cluster.sortKey = ((centroid[0] / area - meshCenter[0]) * normal[0] +
+				(centroid[1] / area - meshCenter[1]) * normal[1] +
+				(centroid[2] / area - meshCenter[2]) * normal[2]) / normalLength;
+		}
+	}
+	std::stable_sort(clusters.begin(), clusters.end(),
+		[](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	for (const Cluster& cluster : clusters)
+	{
+		output.insert(output.end(), indices.begin() + 3 * cluster.firstTriangle,
+			indices.begin() + 3 * (cluster.firstTriangle + cluster.triangleCount));
+	}
+	indices.swap(output);
+	return static_cast<uint32_t>(clusters.size());
+}
+
+void MeshOptimizer::OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	std::vector<uint32_t> remap(vertices.size(), kInvalidIndex);
+	std::vector<Vertex> output;
+	output.reserve(vertices.size());
+	for (uint32_t& index : indices)
+	{
+		if (remap[index] == kInvalidIndex)
+		{
+			remap[index] = static_cast<uint32_t>(output.size());
+			output.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices.swap(output);
+}
+
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount,
+	uint32_t cacheSize)
+{
+	VertexCacheStats stats;
+	if (indices.size() < 3)
+	{
+		return stats;
+	}
+
+	VertexCacheSimulator cache(vertexCount, cacheSize);
+	std::vector<uint8_t> isReferenced(vertexCount, 0);
+	uint32_t misses = 0;
+	uint32_t referencedCount = 0;
+	for (uint32_t index : indices)
+	{
+		misses += cache.Access(index);
+		referencedCount += isReferenced[index] ? 0 : 1;
+		isReferenced[index] = 1;
+	}
+
+	stats.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+	stats.atvr = static_cast<float>(misses) / static_cast<float>(referencedCount);
+	return stats;
+}
@@ -0,0 +1,590 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	const uint32_t kInvalidIndex = 0xFFFFFFFFu;
+
+	// Weight of the planes through the border edges, relative to the planes of the triangles
+	const double kBorderWeight = 10.0;
+
+	// Smallest cosine between the normal of a triangle before and after a collapse
+	const float kMinNormalDot = 0.25f;
+
+	enum class VertexKind : uint8_t
+	{
+		Manifold,		// Moves in any direction
+		Border,			// Only slides along its border
+		Locked			// Never moves
+	};
+
+	struct Vector3
+	{
+		float x, y, z;
+	};
+
+	Vector3 Subtract(const Vector3& a, const Vector3& b)
+	{
+		return { a.x - b.x, a.y - b.y, a.z - b.z };
+	}
+
+	Vector3 Cross(const Vector3& a, const Vector3& b)
+	{
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	float Dot(const Vector3& a, const Vector3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	/// Weighted sum of the squared distances to a set of planes, as the symmetric matrix A, the
+	/// vector b and the scalar c of p.A.p + 2 b.p + c
+	struct Quadric
+	{
+		double a00, a11, a22, a01, a02, a12;
+		double b0, b1, b2;
+		double c;
+		double weight;
+	};
+
+	/// Plane n.p + d = 0, with n normalized
+	Quadric PlaneQuadric(const Vector3& n, float d, double weight)
+	{
+		Quadric q;
+		q.a00 = weight * n.x * n.x;
+		q.a11 = weight * n.y * n.y;
+		q.a22 = weight * n.z * n.z;
+		q.a01 = weight * n.x * n.y;
+		q.a02 = weight * n.x * n.z;
+		q.a12 = weight * n.y * n.z;
+		q.b0 = weight * n.x * d;
+		q.b1 = weight * n.y * d;
+		q.b2 = weight * n.z * d;
+		q.c = weight * d * d;
+		q.weight = weight;
+		return q;
+	}
+
+	void AddQuadric(Quadric& q, const Quadric& r)
+	{
+		q.a00 += r.a00; q.a11 += r.a11; q.a22 += r.a22;
+		q.a01 += r.a01; q.a02 += r.a02; q.a12 += r.a12;
+		q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+		q.c += r.c;
+		q.weight += r.weight;
+	}
+
+	/// Average squared distance of a point to the planes of a quadric
+	double EvaluateQuadric(const Quadric& q, const Vector3& p)
+	{
+		double rx = q.a00 * p.x + q.a01 * p.y + q.a02 * p.z;
+		double ry = q.a01 * p.x + q.a11 * p.y + q.a12 * p.z;
+		double rz = q.a02 * p.x + q.a12 * p.y + q.a22 * p.z;
+		double error = rx * p.x + ry * p.y + rz * p.z + 2.0 * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+		return q.weight > 0.0 ? std::fabs(error) / q.weight : 0.0;
+	}
+
+	/// Map each vertex to the first vertex at the same position, using an open addressing table
+	void WeldPositions(const Vertex* vertices, uint32_t vertexCount, std::vector<uint32_t>& remap)
+	{
+		size_t tableSize = 1;
+		while (tableSize < vertexCount + vertexCount / 4 + 1)
+		{
+			tableSize *= 2;
+		}
+		std::vector<uint32_t> table(tableSize, kInvalidIndex);
+
+		remap.resize(vertexCount);
+		for (uint32_t v = 0; v < vertexCount; v++)
+		{
+			uint32_t bits[3];
+			memcpy(bits, &vertices[v].position, sizeof(bits));
+			size_t slot = ((bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u)) & (tableSize - 1);
+			for (;;)
+			{
+				uint32_t first = table[slot];
+				if (first == kInvalidIndex)
+				{
+					table[slot] = v;
+					remap[v] = v;
+					break;
+				}
+				if (memcmp(&vertices[first].position, &vertices[v].position, sizeof(XMFLOAT3)) == 0)
+				{
+					remap[v] = first;
+					break;
+				}
+				slot = (slot + 1) & (tableSize - 1);
+			}
+		}
+	}
+
+	/// Returns false if no triangle references a vertex
+	bool ComputeBounds(const Vertex* vertices, const uint32_t* indices, size_t indexCount, Vector3& boundsMin,
+		Vector3& boundsMax)
+	{
+		if (indexCount == 0)
+		{
+			return false;
+		}
+		const XMFLOAT3& first = vertices[indices[0]].position;
+		boundsMin = { first.x, first.y, first.z };
+		boundsMax = boundsMin;
+		for (size_t i = 1; i < indexCount; i++)
+		{
+			const XMFLOAT3& p = vertices[indices[i]].position;
+			boundsMin = { (std::min)(boundsMin.x, p.x), (std::min)(boundsMin.y, p.y), (std::min)(boundsMin.z, p.z) };
+			boundsMax = { (std::max)(boundsMax.x, p.x), (std::max)(boundsMax.y, p.y), (std::max)(boundsMax.z, p.z) };
+		}
+		return true;
+	}
+
+	/// Triangles around each vertex, in compressed rows
+	struct Adjacency
+	{
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> triangles;
+
+		void Build(const std::vector<uint32_t>& corners, uint32_t vertexCount)
+		{
+			offsets.assign(vertexCount + 1, 0);
+			for (uint32_t corner : corners)
+			{
+				offsets[corner + 1]++;
+			}
+			for (uint32_t v = 0; v < vertexCount; v++)
+			{
+				offsets[v + 1] += offsets[v];
+			}
+
+			triangles.resize(corners.size());
+			std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < corners.size(); i++)
+			{
+				triangles[cursor[corners[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		/// Number of triangles with the directed edge a->b
+		uint32_t CountEdge(const std::vector<uint32_t>& corners, uint32_t a, uint32_t b) const
+		{
+			uint32_t count = 0;
+			for (uint32_t i = offsets[a]; i < offsets[a + 1]; i++)
+			{
+				const uint32_t* triangle = &corners[3 * triangles[i]];
+				uint32_t k = triangle[0] == a ? 0 : (triangle[1] == a ? 1 : 2);
+				count += triangle[(k + 1) % 3] == b;
+			}
+			return count;
+		}
+	};
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		float error;
+	};
+
+	/// Counting sort on the upper 16 bits of the errors, which are positive floats. The order is
+	/// exact up to 1/128 of relative error, which is enough to pick the cheapest collapses
+	void SortCollapses(const std::vector<Collapse>& collapses, std::vector<Collapse>& sorted)
+	{
+		auto key = [](const Collapse& collapse)
+		{
+			uint32_t bits;
+			memcpy(&bits, &collapse.error, sizeof(bits));
+			return bits >> 15;
+		};
+
+		std::vector<uint32_t> offsets((1 << 16) + 1, 0);
+		for (const Collapse& collapse : collapses)
+		{
+			offsets[key(collapse) + 1]++;
+		}
+		for (size_t i = 1; i < offsets.size(); i++)
+		{
+			offsets[i] += offsets[i - 1];
+		}
+		sorted.resize(collapses.size());
+		for (const Collapse& collapse : collapses)
+		{
+			sorted[offsets[key(collapse)]++] = collapse;
+		}
+	}
+
+	class QuadricSimplifier
+	{
+	public:
+		QuadricSimplifier(const Vertex* vertices, uint32_t vertexCount, std::vector<uint32_t>& indices)
+			: m_vertexCount(vertexCount), m_indices(indices)
+		{
+			WeldPositions(vertices, vertexCount, m_remap);
+
+			// Positions are normalized to the unit cube, for the precision of the quadrics
+			Vector3 boundsMin, boundsMax;
+			ComputeBounds(vertices, indices.data(), indices.size(), boundsMin, boundsMax);
+			m_scale = (std::max)((std::max)(boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y), boundsMax.z - boundsMin.z);
+			float invScale = m_scale > 0.0f ? 1.0f / m_scale : 0.0f;
+			m_positions.resize(vertexCount);
+			for (uint32_t v = 0; v < vertexCount; v++)
+			{
+				const XMFLOAT3& p = vertices[v].position;
+				m_positions[v] = { (p.x - boundsMin.x) * invScale, (p.y - boundsMin.y) * invScale, (p.z - boundsMin.z) * invScale };
+			}
+
+			// Triangles degenerate once welded are removed first
+			UpdateCorners();
+			std::vector<uint32_t> noCollapse(vertexCount, kInvalidIndex);
+			ApplyCollapses(noCollapse);
+			m_adjacency.Build(m_corners, m_vertexCount);
+			ComputeQuadrics();
+		}
+
+		/// Distance scale of the normalized positions
+		float GetScale() const { return m_scale; }
+
+		/// Run collapse passes until the target is reached, no collapse is possible below the error
+		/// limit, or the mesh cannot be simplified further. Returns the largest normalized squared error
+		double Run(uint32_t targetTriangles, double errorLimit)
+		{
+			double maxError = 0.0;
+			std::vector<Collapse> candidates;
+			std::vector<Collapse> sortedCandidates;
+			std::vector<uint8_t> locked(m_vertexCount);
+			std::vector<uint32_t> collapseTargets(m_vertexCount, kInvalidIndex);
+
+			while (m_corners.size() / 3 > targetTriangles)
+			{
+				GatherCandidates(errorLimit, candidates);
+				if (candidates.empty())
+				{
+					break;
+				}
+				SortCollapses(candidates, sortedCandidates);
+
+				// Collapses are independent if they do not share a triangle: each one locks the
+				// vertices of the triangles it changes
+				std::fill(locked.begin(), locked.end(), uint8_t(0));
+				uint32_t triangleCount = static_cast<uint32_t>(m_corners.size() / 3);
+				uint32_t collapseCount = 0;
+				for (const Collapse& collapse : sortedCandidates)
+				{
+					if (triangleCount <= targetTriangles)
+					{
+						break;
+					}
+					if (locked[collapse.from] || locked[collapse.to] || IsFlipping(collapse.from, collapse.to))
+					{
+						continue;
+					}
+
+					for (uint32_t i = m_adjacency.offsets[collapse.from]; i < m_adjacency.offsets[collapse.from + 1]; i++)
+					{
+						const uint32_t* triangle = &m_corners[3 * m_adjacency.triangles[i]];
+						triangleCount -= (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to);
+						locked[triangle[0]] = locked[triangle[1]] = locked[triangle[2]] = 1;
+					}
+					locked[collapse.to] = 1;
+					collapseTargets[collapse.from] = collapse.to;
+					AddQuadric(m_quadrics[collapse.to], m_quadrics[collapse.from]);
+					maxError = (std::max)(maxError, static_cast<double>(collapse.error));
+					collapseCount++;
+				}
+				if (collapseCount == 0)
+				{
+					break;
+				}
+
+				ApplyCollapses(collapseTargets);
+				m_adjacency.Build(m_corners, m_vertexCount);
+			}
+			return maxError;
+		}
+
+	private:
+		/// Welded corners of the triangles
+		void UpdateCorners()
+		{
+			m_corners.resize(m_indices.size());
+			for (size_t i = 0; i < m_indices.size(); i++)
+			{
+				m_corners[i] = m_remap[m_indices[i]];
+			}
+		}
+
+		/// Area-weighted planes of the triangles, and planes through the border edges. The kinds of
+		/// the vertices are classified along the way
+		void ComputeQuadrics()
+		{
+			m_quadrics.assign(m_vertexCount, Quadric{});
+			m_kinds.assign(m_vertexCount, VertexKind::Manifold);
+			std::vector<uint8_t> borderEdges(m_vertexCount, 0);
+
+			for (size_t t = 0; t < m_corners.size() / 3; t++)
+			{
+				const uint32_t* triangle = &m_corners[3 * t];
+				Vector3 normal = Cross(Subtract(m_positions[triangle[1]], m_positions[triangle[0]]),
+					Subtract(m_positions[triangle[2]], m_positions[triangle[0]]));
+				float length = std::sqrt(Dot(normal, normal));
+				if (length == 0.0f)
+				{
+					continue;
+				}
+				normal = { normal.x / length, normal.y / length, normal.z / length };
+
+				Quadric plane = PlaneQuadric(normal, -Dot(normal, m_positions[triangle[0]]), 0.5 * length);
+				for (int k = 0; k < 3; k++)
+				{
+					AddQuadric(m_quadrics[triangle[k]], plane);
+				}
+
+				for (int k = 0; k < 3; k++)
+				{
+					uint32_t a = triangle[k];
+					uint32_t b = triangle[(k + 1) % 3];
+					if (m_adjacency.CountEdge(m_corners, a, b) > 1)
+					{
+						// Edge shared by more than two triangles
+						m_kinds[a] = m_kinds[b] = VertexKind::Locked;
+					}
+					if (m_adjacency.CountEdge(m_corners, b, a) != 0)
+					{
+						continue;
+					}
+
+					Vector3 edge = Subtract(m_positions[b], m_positions[a]);
+					float edgeLength = std::sqrt(Dot(edge, edge));
+					Vector3 edgeNormal = Cross(edge, normal);
+					float edgeNormalLength = std::sqrt(Dot(edgeNormal, edgeNormal));
+					if (edgeNormalLength > 0.0f)
+					{
+						edgeNormal = { edgeNormal.x / edgeNormalLength, edgeNormal.y / edgeNormalLength, edgeNormal.z / edgeNormalLength };
+						Quadric border = PlaneQuadric(edgeNormal, -Dot(edgeNormal, m_positions[a]),
+							kBorderWeight * edgeLength * edgeLength);
+						AddQuadric(m_quadrics[a], border);
+						AddQuadric(m_quadrics[b], border);
+					}
+					borderEdges[a] = static_cast<uint8_t>((std::min)(borderEdges[a] + 1, 255));
+					borderEdges[b] = static_cast<uint8_t>((std::min)(borderEdges[b] + 1, 255));
+				}
+			}
+
+			for (uint32_t v = 0; v < m_vertexCount; v++)
+			{
+				if (m_kinds[v] == VertexKind::Manifold && borderEdges[v] != 0)
+				{
+					// Vertices joining several borders would pinch them
+					m_kinds[v] = borderEdges[v] == 2 ? VertexKind::Border : VertexKind::Locked;
+				}
+			}
+		}
+
+		/// Cheapest allowed direction of each edge below the error limit
+		void GatherCandidates(double errorLimit, std::vector<Collapse>& candidates) const
+		{
+			candidates.clear();
+			for (size_t i = 0; i < m_corners.size(); i++)
+			{
+				uint32_t a = m_corners[i];
+				uint32_t b = m_corners[i - i % 3 + (i + 1) % 3];
+				bool isBorderEdge = m_adjacency.CountEdge(m_corners, b, a) == 0;
+				if (!isBorderEdge && a > b)
+				{
+					// Interior edges are seen from both of their triangles
+					continue;
+				}
+
+				Collapse best = { kInvalidIndex, kInvalidIndex, 0.0f };
+				double bestError = errorLimit;
+				const uint32_t directions[2][2] = { { a, b }, { b, a } };
+				for (const auto& direction : directions)
+				{
+					uint32_t from = direction[0];
+					uint32_t to = direction[1];
+					bool allowed = m_kinds[from] == VertexKind::Manifold ||
+						(m_kinds[from] == VertexKind::Border && isBorderEdge);
+					if (!allowed)
+					{
+						continue;
+					}
+					Quadric q = m_quadrics[from];
+					AddQuadric(q, m_quadrics[to]);
+					double error = EvaluateQuadric(q, m_positions[to]);
+					if (error <= bestError)
+					{
+						best = { from, to, static_cast<float>(error) };
+						bestError = error;
+					}
+				}
+				if (best.from != kInvalidIndex)
+				{
+					candidates.push_back(best);
+				}
+			}
+		}
+
+		/// True if moving from onto to turns a remaining triangle of from too much
+		bool IsFlipping(uint32_t from, uint32_t to) const
+		{
+			for (uint32_t i = m_adjacency.offsets[from]; i < m_adjacency.offsets[from + 1]; i++)
+			{
+				const uint32_t* triangle = &m_corners[3 * m_adjacency.triangles[i]];
+				if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+				{
+					continue;
+				}
+
+				// Corners following from, in the winding order
+				uint32_t k = triangle[0] == from ? 0 : (triangle[1] == from ? 1 : 2);
+				const Vector3& b = m_positions[triangle[(k + 1) % 3]];
+				const Vector3& c = m_positions[triangle[(k + 2) % 3]];
+				Vector3 bc = Subtract(c, b);
+				Vector3 before = Cross(bc, Subtract(m_positions[from], b));
+				Vector3 after = Cross(bc, Subtract(m_positions[to], b));
+				float dot = Dot(before, after);
+				if (dot <= 0.0f || dot * dot < kMinNormalDot * kMinNormalDot * Dot(before, before) * Dot(after, after))
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		/// Move the corners of the collapsed vertices and remove the degenerate triangles. The other
+		/// corners keep their vertex, hence their attributes
+		void ApplyCollapses(std::vector<uint32_t>& collapseTargets)
+		{
+			size_t writeIndex = 0;
+			for (size_t i = 0; i < m_indices.size(); i += 3)
+			{
+				uint32_t triangle[3];
+				for (int k = 0; k < 3; k++)
+				{
+					uint32_t target = collapseTargets[m_corners[i + k]];
+					triangle[k] = target != kInvalidIndex ? target : m_indices[i + k];
+				}
+				uint32_t a = m_remap[triangle[0]];
+				uint32_t b = m_remap[triangle[1]];
+				uint32_t c = m_remap[triangle[2]];
+				if (a == b || b == c || a == c)
+				{
+					continue;
+				}
+				for (int k = 0; k < 3; k++)
+				{
+					m_indices[writeIndex + k] = triangle[k];
+				}
+				writeIndex += 3;
+			}
+			m_indices.resize(writeIndex);
+
+			for (size_t i = 0; i < m_corners.size(); i++)
+			{
+				collapseTargets[m_corners[i]] = kInvalidIndex;
+			}
+			UpdateCorners();
+		}
+
+		uint32_t m_vertexCount;
+		std::vector<uint32_t>& m_indices;
+		std::vector<uint32_t> m_remap;			// First vertex at the same position
+		std::vector<uint32_t> m_corners;		// m_indices through m_remap
+		std::vector<Vector3> m_positions;		// Normalized
+		std::vector<Quadric> m_quadrics;		// Of the welded vertices
+		std::vector<VertexKind> m_kinds;
+		Adjacency m_adjacency;
+		float m_scale = 0.0f;
+	};
+}
+
+float MeshSimplifier::Simplify(const Vertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount,
+	uint32_t targetIndexCount, float targetError, std::vector<uint32_t>& result)
+{
+	for (uint32_t i = 0; i < indexCount; i++)
+	{
+		if (indices[i] >= vertexCount)
+		{
+			throw std::runtime_error("Vertex index out of range in the mesh to simplify");
+		}
+	}
+
+	result.assign(indices, indices + indexCount - indexCount % 3);
+	if (result.size() <= targetIndexCount)
+	{
+		return 0.0f;
+	}
+
+	QuadricSimplifier simplifier(vertices, vertexCount, result);
+	if (simplifier.GetScale() == 0.0f)
+	{
+		return 0.0f;
+	}
+	double normalizedError = targetError / simplifier.GetScale();
+	double maxError = simplifier.Run(targetIndexCount / 3, normalizedError * normalizedError);
+	return static_cast<float>(std::sqrt(maxError)) * simplifier.GetScale();
+}
+
+std::vector<MeshLodLevel> MeshSimplifier::BuildLodChain(const Vertex* vertices, uint32_t vertexCount,
+	const uint32_t* indices, uint32_t indexCount, std::vector<uint32_t>& lodIndices,
+	const LodChainOptions& options, LodChainStats* stats)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<MeshLodLevel> levels;
+	levels.push_back({ 0, indexCount, 0.0f });
+	lodIndices.clear();
+
+	float maxError = 0.0f;
+	Vector3 boundsMin, boundsMax;
+	if (ComputeBounds(vertices, indices, indexCount, boundsMin, boundsMax))
+	{
+		Vector3 diagonal = Subtract(boundsMax, boundsMin);
+		maxError = options.maxRelativeError * std::sqrt(Dot(diagonal, diagonal));
+	}
+
+	std::vector<uint32_t> source(indices, indices + indexCount);
+	std::vector<uint32_t> simplified;
+	float error = 0.0f;
+	while (levels.size() < options.maxLevels && error < maxError)
+	{
+		uint32_t sourceTriangles = static_cast<uint32_t>(source.size() / 3);
+		if (sourceTriangles <= options.minTriangles)
+		{
+			break;
+		}
+
+		uint32_t targetTriangles = (std::max)(static_cast<uint32_t>(sourceTriangles * options.reduction), options.minTriangles);
+		float levelError = Simplify(vertices, vertexCount, source.data(), static_cast<uint32_t>(source.size()),
+			3 * targetTriangles, maxError - error, simplified);
+		if (simplified.empty() || simplified.size() > source.size() * options.minReduction)
+		{
+			break;
+		}
+
+		if (options.optimizeVertexCache)
+		{
+			MeshOptimizer::OptimizeVertexCache(simplified, vertexCount, options.cacheSize);
+		}
+
+		error += levelError;
+		levels.push_back({ indexCount + static_cast<uint32_t>(lodIndices.size()), static_cast<uint32_t>(simplified.size()), error });
+		lodIndices.insert(lodIndices.end(), simplified.begin(), simplified.end());
+		source.swap(simplified);
+	}
+
+	if (stats)
+	{
+		stats->sourceTriangles = indexCount / 3;
+		stats->totalTriangles = (indexCount + static_cast<uint32_t>(lodIndices.size())) / 3;
+		stats->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+	return levels;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+// #DXR Custom: Mesh LOD
+// Simplifies indexed meshes by edge collapses ordered by the quadric error metric (Garland and
+// Heckbert, "Surface Simplification Using Quadric Error Metrics", 1997), and builds chains of
+// levels of detail from them.
+//
+// The collapses are half-edge collapses: a vertex is merged into one of its neighbors, so the
+// simplified meshes only reference vertices of the input and share its vertex buffer. Vertices at
+// the same position are welded for the topology, so that attribute seams do not open cracks. Each
+// vertex accumulates the planes of its triangles, weighted by their area, and the planes through
+// the border edges perpendicular to their triangle, so that open borders keep their shape. Border
+// vertices only slide along their border, and vertices where the surface is not manifold are
+// never moved. Collapses flipping a triangle are rejected.
+//
+// The collapses are applied in passes: the candidate edges are sorted by error, and the cheapest
+// independent ones are collapsed, until the triangle target or the error limit is reached.
+//
+// The errors are distances in the space of the vertices: the square root of the average squared
+// distance between the collapsed vertex and the planes it accumulated. They estimate, rather than
+// bound, the distance to the input. The error of a level adds the error of the previous one to the
+// error of its own simplification.
+
+#include "VertexTypes.h"
+
+#include <cstdint>
+#include <vector>
+
+struct LodChainOptions
+{
+	uint32_t maxLevels = 4;					// Including the input, level 0
+	float reduction = 0.5f;					// Triangle count targeted by each level, relative to the previous one
+	float maxRelativeError = 0.05f;			// Largest error of a level, relative to the diagonal of the bounding box
+	float minReduction = 0.85f;				// A level is dropped if it keeps more triangles than this ratio
+	uint32_t minTriangles = 16;				// No level is built below this triangle count
+	bool optimizeVertexCache = true;		// Reorder the triangles of the levels with MeshOptimizer
+	uint32_t cacheSize = 16;
+};
+
+/// Level of detail, as a range of the index buffer
+struct MeshLodLevel
+{
+	uint32_t firstIndex;					// In the input indices followed by the indices of the other levels
+	uint32_t indexCount;
+	float error;							// Estimated distance to the input, in the space of the vertices
+};
+
+struct LodChainStats
+{
+	uint32_t sourceTriangles = 0;
+	uint32_t totalTriangles = 0;			// Over all levels, including the input
+	double milliseconds = 0.0;
+};
+
+class MeshSimplifier
+{
+public:
+	/// <summary>
+	/// Simplify a triangle list to at most targetIndexCount indices, as long as the error stays below
+	/// targetError. The triangles are written to result, referencing the same vertices, and the error
+	/// reached is returned. Throws std::runtime_error if an index is not smaller than vertexCount
+	/// </summary>
+	static float Simplify(const Vertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount,
+		uint32_t targetIndexCount, float targetError, std::vector<uint32_t>& result);
+
+	/// <summary>
+	/// Build the levels of detail of a mesh, each simplified from the previous one. Level 0 is the
+	/// input; the indices of the other levels are written to lodIndices, which is meant to follow
+	/// the input indices in the index buffer. Returns at least level 0
+	/// </summary>
+	static std::vector<MeshLodLevel> BuildLodChain(const Vertex* vertices, uint32_t vertexCount,
+		const uint32_t* indices, uint32_t indexCount, std::vector<uint32_t>& lodIndices,
+		const LodChainOptions& options = {}, LodChainStats* stats = nullptr);
+};
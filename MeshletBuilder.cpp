@@ -0,0 +1,683 @@
+#include "MeshletBuilder.h"
+#include "nv_helpers_dx12/ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+	// Triangles per parallel task. Meshlets are cut at the chunk boundaries, which costs at most
+	// one partial meshlet per chunk
+	const uint32_t kChunkTriangles = 1 << 15;
+	const uint32_t kMeshletGrain = 256;
+	const uint32_t kEmptySlot = 0xFFFFFFFFu;
+
+	// Normal cones wider than this (cosine of the largest angle to the axis) cannot be culled
+	const float kMinConeDot = 0.1f;
+
+	/// Map from the vertices of the mesh to the local vertices of the current meshlet: an open
+	/// addressing table at most half full
+	class LocalVertexMap
+	{
+	public:
+		explicit LocalVertexMap(uint32_t maxVertices)
+		{
+			uint32_t bits = 1;
+			while ((1u << bits) < 2 * maxVertices)
+			{
+				bits++;
+			}
+			m_shift = 32 - bits;
+			m_keys.assign(size_t(1) << bits, kEmptySlot);
+			m_values.resize(m_keys.size());
+		}
+
+		/// Local index of a vertex, or -1 if it is not in the meshlet
+		int Find(uint32_t vertex) const
+		{
+			for (uint32_t slot = Hash(vertex);; slot = (slot + 1) & Mask())
+			{
+				if (m_keys[slot] == vertex)
+				{
+					return m_values[slot];
+				}
+				if (m_keys[slot] == kEmptySlot)
+				{
+					return -1;
+				}
+			}
+		}
+
+		void Insert(uint32_t vertex, uint8_t localIndex)
+		{
+			uint32_t slot = Hash(vertex);
+			while (m_keys[slot] != kEmptySlot)
+			{
+				slot = (slot + 1) & Mask();
+			}
+			m_keys[slot] = vertex;
+			m_values[slot] = localIndex;
+		}
+
+		void Clear()
+		{
+			std::fill(m_keys.begin(), m_keys.end(), kEmptySlot);
+		}
+
+	private:
+		uint32_t Hash(uint32_t vertex) const { return (vertex * 0x9E3779B1u) >> m_shift; }
+		uint32_t Mask() const { return static_cast<uint32_t>(m_keys.size() - 1); }
+
+		std::vector<uint32_t> m_keys;
+		std::vector<uint8_t> m_values;
+		uint32_t m_shift;
+	};
+
+	/// Vertices a triangle would add to a meshlet, counting repeated corners once
+	uint32_t CountNewVertices(const LocalVertexMap& map, const uint32_t* corners)
+	{
+		uint32_t newVertices = 0;
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			bool repeated = (c > 0 && corners[c] == corners[0]) || (c > 1 && corners[c] == corners[1]);
+			if (!repeated && map.Find(corners[c]) < 0)
+			{
+				newVertices++;
+			}
+		}
+		return newVertices;
+	}
+
+	/// Meshlets of a chunk, whose vertex offsets are relative to the chunk until concatenated
+	struct ChunkMeshlets
+	{
+		std::vector<Meshlet> meshlets;
+		std::vector<uint32_t> vertices;
+	};
+
+	/// Scan the triangles [firstTriangle, endTriangle). The local indices are written directly
+	/// into the triangles of the output, which follow the order of the index buffer. Returns false
+	/// if an index is out of range
+	bool BuildChunk(const uint32_t* indices, uint32_t vertexCount, uint32_t firstTriangle, uint32_t endTriangle,
+		const MeshletBuildOptions& options, ChunkMeshlets& chunk, uint8_t* triangles)
+	{
+		LocalVertexMap map(options.maxVertices);
+		Meshlet current = { 0, 0, firstTriangle, 0 };
+
+		for (uint32_t triangle = firstTriangle; triangle < endTriangle; triangle++)
+		{
+			const uint32_t* corners = indices + 3 * static_cast<size_t>(triangle);
+			if (corners[0] >= vertexCount || corners[1] >= vertexCount || corners[2] >= vertexCount)
+			{
+				return false;
+			}
+
+			uint32_t newVertices = CountNewVertices(map, corners);
+			if (current.vertexCount + newVertices > options.maxVertices || current.triangleCount == options.maxTriangles)
+			{
+				chunk.meshlets.push_back(current);
+				current = { static_cast<uint32_t>(chunk.vertices.size()), 0, triangle, 0 };
+				map.Clear();
+			}
+
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				int localIndex = map.Find(corners[c]);
+				if (localIndex < 0)
+				{
+					localIndex = static_cast<int>(current.vertexCount++);
+					map.Insert(corners[c], static_cast<uint8_t>(localIndex));
+					chunk.vertices.push_back(corners[c]);
+				}
+				triangles[3 * static_cast<size_t>(triangle) + c] = static_cast<uint8_t>(localIndex);
+			}
+			current.triangleCount++;
+		}
+
+		if (current.triangleCount > 0)
+		{
+			chunk.meshlets.push_back(current);
+		}
+		return true;
+	}
+
+	XMFLOAT3 Subtract(const XMFLOAT3& a, const XMFLOAT3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	float Dot(const XMFLOAT3& a, const XMFLOAT3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+	/// Grow the meshlets of the triangles [firstTriangle, endTriangle) and write their triangles to
+	/// ordered, meshlet by meshlet. A triangle joins the meshlet only if it fits in the limits, with
+	/// the same test as BuildChunk, and the meshlet is closed only when the next triangle written
+	/// does not fit: scanning the output cuts the same meshlets. Returns false if an index is out
+	/// of range
+	bool OrderChunk(const Vertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t firstTriangle,
+		uint32_t endTriangle, const MeshletBuildOptions& options, uint32_t* ordered)
+	{
+		const uint32_t triangleCount = endTriangle - firstTriangle;
+		const uint32_t* chunkIndices = indices + 3 * static_cast<size_t>(firstTriangle);
+
+		// The chunk only references a small part of the vertices, which are numbered locally
+		std::vector<uint32_t> chunkVertices(chunkIndices, chunkIndices + 3 * static_cast<size_t>(triangleCount));
+		std::sort(chunkVertices.begin(), chunkVertices.end());
+		chunkVertices.erase(std::unique(chunkVertices.begin(), chunkVertices.end()), chunkVertices.end());
+		if (!chunkVertices.empty() && chunkVertices.back() >= vertexCount)
+		{
+			return false;
+		}
+		const uint32_t chunkVertexCount = static_cast<uint32_t>(chunkVertices.size());
+		std::vector<uint32_t> corners(3 * static_cast<size_t>(triangleCount));
+		for (size_t i = 0; i < corners.size(); i++)
+		{
+			corners[i] = static_cast<uint32_t>(std::lower_bound(chunkVertices.begin(), chunkVertices.end(), chunkIndices[i]) -
+				chunkVertices.begin());
+		}
+
+		// Triangles around each vertex, repeated corners counted once. The live count of a vertex
+		// is the number of its triangles not written yet
+		auto isRepeated = [&](uint32_t t, uint32_t c)
+		{
+			const uint32_t* triangle = &corners[3 * static_cast<size_t>(t)];
+			return (c > 0 && triangle[c] == triangle[0]) || (c > 1 && triangle[c] == triangle[1]);
+		};
+		std::vector<uint32_t> liveCounts(chunkVertexCount, 0);
+		for (uint32_t t = 0; t < triangleCount; t++)
+		{
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				liveCounts[corners[3 * t + c]] += isRepeated(t, c) ? 0 : 1;
+			}
+		}
+		std::vector<uint32_t> adjacencyOffsets(chunkVertexCount + 1, 0);
+		for (uint32_t v = 0; v < chunkVertexCount; v++)
+		{
+			adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveCounts[v];
+		}
+		std::vector<uint32_t> adjacency(adjacencyOffsets[chunkVertexCount]);
+		{
+			std::vector<uint32_t> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (uint32_t t = 0; t < triangleCount; t++)
+			{
+				for (uint32_t c = 0; c < 3; c++)
+				{
+					if (!isRepeated(t, c))
+					{
+						adjacency[cursors[corners[3 * t + c]]++] = t;
+					}
+				}
+			}
+		}
+
+		std::vector<XMFLOAT3> centroids(triangleCount);
+		for (uint32_t t = 0; t < triangleCount; t++)
+		{
+			const XMFLOAT3& p0 = vertices[chunkIndices[3 * t]].position;
+			const XMFLOAT3& p1 = vertices[chunkIndices[3 * t + 1]].position;
+			const XMFLOAT3& p2 = vertices[chunkIndices[3 * t + 2]].position;
+			centroids[t] = { (p0.x + p1.x + p2.x) / 3.0f, (p0.y + p1.y + p2.y) / 3.0f, (p0.z + p1.z + p2.z) / 3.0f };
+		}
+
+		// Membership of the vertices and of the candidate triangles in the current meshlet, as
+		// the number of the meshlet, so that closing a meshlet clears them at once
+		std::vector<uint32_t> vertexMeshlets(chunkVertexCount, kEmptySlot);
+		std::vector<uint32_t> candidateMeshlets(triangleCount, kEmptySlot);
+		std::vector<uint8_t> isEmitted(triangleCount, 0);
+		std::vector<uint32_t> candidates;
+		uint32_t meshletIndex = 0;
+		uint32_t meshletVertexCount = 0;
+		uint32_t meshletTriangleCount = 0;
+		XMFLOAT3 centroidSum = { 0.0f, 0.0f, 0.0f };
+		uint32_t nextSeed = 0;
+
+		auto countNewVertices = [&](uint32_t t)
+		{
+			uint32_t newVertices = 0;
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				newVertices += (!isRepeated(t, c) && vertexMeshlets[corners[3 * t + c]] != meshletIndex) ? 1 : 0;
+			}
+			return newVertices;
+		};
+
+		for (uint32_t outputCount = 0; outputCount < triangleCount; outputCount++)
+		{
+			// Candidate adding the fewest vertices, then the closest to the center of the meshlet.
+			// A triangle whose vertex has no other triangle left ranks right after the ones adding
+			// no vertex, since leaving it would cost a vertex in a later meshlet for a single
+			// triangle (the same priority as meshoptimizer)
+			uint32_t best = kEmptySlot;
+			uint32_t bestPriority = 0;
+			float bestDistance = 0.0f;
+			const bool isFull = meshletTriangleCount == options.maxTriangles;
+			if (!isFull)
+			{
+				const float scale = 1.0f / (std::max)(meshletTriangleCount, 1u);
+				const XMFLOAT3 center = { centroidSum.x * scale, centroidSum.y * scale, centroidSum.z * scale };
+				size_t kept = 0;
+				for (uint32_t candidate : candidates)
+				{
+					if (isEmitted[candidate])
+					{
+						continue;
+					}
+					candidates[kept++] = candidate;
+					uint32_t newVertices = countNewVertices(candidate);
+					if (meshletVertexCount + newVertices > options.maxVertices)
+					{
+						continue;
+					}
+					uint32_t priority = 0;
+					if (newVertices > 0)
+					{
+						const uint32_t* triangle = &corners[3 * static_cast<size_t>(candidate)];
+						bool isDangling = liveCounts[triangle[0]] == 1 || liveCounts[triangle[1]] == 1 ||
+							liveCounts[triangle[2]] == 1;
+						priority = isDangling ? 1 : newVertices + 1;
+					}
+					XMFLOAT3 d = Subtract(centroids[candidate], center);
+					float distance = Dot(d, d);
+					if (best == kEmptySlot || priority < bestPriority || (priority == bestPriority && distance < bestDistance))
+					{
+						best = candidate;
+						bestPriority = priority;
+						bestDistance = distance;
+					}
+				}
+				candidates.resize(kept);
+			}
+
+			// No candidate fits: the next triangle in the input order either fits too, and the scan
+			// would add it to this meshlet anyway, or it starts the next meshlet. Seeding in the
+			// input order keeps the order of the clusters of the previous stages
+			if (best == kEmptySlot)
+			{
+				while (isEmitted[nextSeed])
+				{
+					nextSeed++;
+				}
+				best = nextSeed;
+				if (isFull || meshletVertexCount + countNewVertices(best) > options.maxVertices)
+				{
+					meshletIndex++;
+					meshletVertexCount = 0;
+					meshletTriangleCount = 0;
+					centroidSum = { 0.0f, 0.0f, 0.0f };
+					candidates.clear();
+				}
+			}
+
+			// Add the triangle, and the triangles around its new vertices to the candidates
+			isEmitted[best] = 1;
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				if (isRepeated(best, c))
+				{
+					continue;
+				}
+				uint32_t v = corners[3 * static_cast<size_t>(best) + c];
+				liveCounts[v]--;
+				if (vertexMeshlets[v] == meshletIndex)
+				{
+					continue;
+				}
+				vertexMeshlets[v] = meshletIndex;
+				meshletVertexCount++;
+				for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; a++)
+				{
+					uint32_t t = adjacency[a];
+					if (!isEmitted[t] && candidateMeshlets[t] != meshletIndex)
+					{
+						candidateMeshlets[t] = meshletIndex;
+						candidates.push_back(t);
+					}
+				}
+			}
+			meshletTriangleCount++;
+			centroidSum = { centroidSum.x + centroids[best].x, centroidSum.y + centroids[best].y,
+				centroidSum.z + centroids[best].z };
+			std::copy(chunkIndices + 3 * static_cast<size_t>(best), chunkIndices + 3 * static_cast<size_t>(best) + 3,
+				ordered + 3 * static_cast<size_t>(outputCount));
+		}
+		return true;
+	}
+
+	/// Bounding sphere of the vertices of a meshlet (Ritter): the sphere spanning the most
+	/// distant pair of extreme points along the axes, grown to enclose the remaining points
+	void ComputeSphere(const Vertex* vertices, const uint32_t* meshletVertices, uint32_t count, MeshletBounds& bounds)
+	{
+		uint32_t minIndex[3] = { 0, 0, 0 };
+		uint32_t maxIndex[3] = { 0, 0, 0 };
+		for (uint32_t i = 1; i < count; i++)
+		{
+			const float* p = &vertices[meshletVertices[i]].position.x;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (p[axis] < (&vertices[meshletVertices[minIndex[axis]]].position.x)[axis]) minIndex[axis] = i;
+				if (p[axis] > (&vertices[meshletVertices[maxIndex[axis]]].position.x)[axis]) maxIndex[axis] = i;
+			}
+		}
+
+		int widestAxis = 0;
+		float widestDistance = -1.0f;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			XMFLOAT3 d = Subtract(vertices[meshletVertices[maxIndex[axis]]].position, vertices[meshletVertices[minIndex[axis]]].position);
+			if (Dot(d, d) > widestDistance)
+			{
+				widestDistance = Dot(d, d);
+				widestAxis = axis;
+			}
+		}
+
+		const XMFLOAT3& a = vertices[meshletVertices[minIndex[widestAxis]]].position;
+		const XMFLOAT3& b = vertices[meshletVertices[maxIndex[widestAxis]]].position;
+		XMFLOAT3 center = { 0.5f * (a.x + b.x), 0.5f * (a.y + b.y), 0.5f * (a.z + b.z) };
+		float radius = 0.5f * std::sqrt(widestDistance);
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			XMFLOAT3 d = Subtract(vertices[meshletVertices[i]].position, center);
+			float distance = std::sqrt(Dot(d, d));
+			if (distance > radius)
+			{
+				// Move the center towards the point so that the new sphere touches it and still
+				// encloses the previous one
+				float shift = 0.5f * (distance - radius) / distance;
+				center = { center.x + d.x * shift, center.y + d.y * shift, center.z + d.z * shift };
+				radius = 0.5f * (radius + distance);
+			}
+		}
+
+		bounds.center = center;
+		bounds.radius = radius;
+	}
+
+	/// Normal cone, following the formulation of meshoptimizer: the axis is the average normal,
+	/// and the apex is moved back along the axis until it is behind all the triangle planes
+	void ComputeCone(const Vertex* vertices, const Meshlet& meshlet, const uint32_t* meshletVertices,
+		const uint8_t* triangles, MeshletBounds& bounds)
+	{
+		bounds.coneApex = bounds.center;
+		bounds.coneAxis = { 0.0f, 0.0f, 0.0f };
+		bounds.coneCutoff = 1.0f;
+
+		const uint8_t* local = triangles + 3 * static_cast<size_t>(meshlet.triangleOffset);
+		XMFLOAT3 axis = { 0.0f, 0.0f, 0.0f };
+		for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+		{
+			const XMFLOAT3& p0 = vertices[meshletVertices[local[3 * t + 0]]].position;
+			XMFLOAT3 e1 = Subtract(vertices[meshletVertices[local[3 * t + 1]]].position, p0);
+			XMFLOAT3 e2 = Subtract(vertices[meshletVertices[local[3 * t + 2]]].position, p0);
+			XMFLOAT3 n = { e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x };
+			float length = std::sqrt(Dot(n, n));
+			if (length > 0.0f)
+			{
+				axis = { axis.x + n.x / length, axis.y + n.y / length, axis.z + n.z / length };
+			}
+		}
+
+		float axisLength = std::sqrt(Dot(axis, axis));
+		if (axisLength == 0.0f)
+		{
+			return;
+		}
+		axis = { axis.x / axisLength, axis.y / axisLength, axis.z / axisLength };
+
+		float minDot = 1.0f;
+		float maxT = 0.0f;
+		for (uint32_t t = 0; t < meshlet.triangleCount && minDot > kMinConeDot; t++)
+		{
+			const XMFLOAT3& p0 = vertices[meshletVertices[local[3 * t + 0]]].position;
+			XMFLOAT3 e1 = Subtract(vertices[meshletVertices[local[3 * t + 1]]].position, p0);
+			XMFLOAT3 e2 = Subtract(vertices[meshletVertices[local[3 * t + 2]]].position, p0);
+			XMFLOAT3 n = { e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x };
+			float length = std::sqrt(Dot(n, n));
+			if (length == 0.0f)
+			{
+				continue;
+			}
+			n = { n.x / length, n.y / length, n.z / length };
+
+			float dn = Dot(axis, n);
+			minDot = (std::min)(minDot, dn);
+			if (dn > kMinConeDot)
+			{
+				// Distance along the axis at which center - t * axis lies on the triangle plane
+				maxT = (std::max)(maxT, Dot(Subtract(bounds.center, p0), n) / dn);
+			}
+		}
+
+		if (minDot <= kMinConeDot)
+		{
+			return;
+		}
+		bounds.coneAxis = axis;
+		bounds.coneApex = { bounds.center.x - axis.x * maxT, bounds.center.y - axis.y * maxT, bounds.center.z - axis.z * maxT };
+		// The normals are within acos(minDot) of the axis, so the meshlet faces away from the
+		// directions within 90 - acos(minDot) degrees of the axis: the cosine of that angle is
+		// sin(acos(minDot))
+		bounds.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+	}
+}
+
+void MeshletBuilder::Build(const Vertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount,
+	MeshletData& meshlets, const MeshletBuildOptions& options, MeshletStats* stats)
+{
+	if (options.maxVertices < 3 || options.maxVertices > 256 || options.maxTriangles < 1)
+	{
+		throw std::logic_error("Invalid meshlet limits");
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	nv_helpers_dx12::ThreadPool pool(options.threadCount);
+	const uint32_t triangleCount = indexCount / 3;
+	const uint32_t chunkCount = (triangleCount + kChunkTriangles - 1) / kChunkTriangles;
+
+	meshlets = MeshletData();
+	meshlets.triangles.resize(3 * static_cast<size_t>(triangleCount));
+
+	// The pool does not forward exceptions, so the tasks only record errors
+	std::vector<ChunkMeshlets> chunks(chunkCount);
+	std::atomic<bool> invalidIndex(false);
+	pool.ParallelFor(chunkCount, 1, [&](uint32_t begin, uint32_t end, uint32_t /*threadIndex*/)
+	{
+		for (uint32_t chunk = begin; chunk < end; chunk++)
+		{
+			uint32_t firstTriangle = chunk * kChunkTriangles;
+			uint32_t endTriangle = (std::min)(firstTriangle + kChunkTriangles, triangleCount);
+			if (!BuildChunk(indices, vertexCount, firstTriangle, endTriangle, options, chunks[chunk],
+				meshlets.triangles.data()))
+			{
+				invalidIndex = true;
+			}
+		}
+	});
+	if (invalidIndex)
+	{
+		meshlets = MeshletData();
+		throw std::runtime_error("Meshlet builder: vertex index out of range");
+	}
+
+	// Concatenate the chunks in order
+	std::vector<uint32_t> meshletOffsets(chunkCount + 1, 0);
+	std::vector<uint32_t> vertexOffsets(chunkCount + 1, 0);
+	for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
+	{
+		meshletOffsets[chunk + 1] = meshletOffsets[chunk] + static_cast<uint32_t>(chunks[chunk].meshlets.size());
+		vertexOffsets[chunk + 1] = vertexOffsets[chunk] + static_cast<uint32_t>(chunks[chunk].vertices.size());
+	}
+	meshlets.meshlets.resize(meshletOffsets[chunkCount]);
+	meshlets.vertices.resize(vertexOffsets[chunkCount]);
+	meshlets.bounds.resize(meshletOffsets[chunkCount]);
+
+	pool.ParallelFor(chunkCount, 1, [&](uint32_t begin, uint32_t end, uint32_t /*threadIndex*/)
+	{
+		for (uint32_t chunk = begin; chunk < end; chunk++)
+		{
+			Meshlet* dst = meshlets.meshlets.data() + meshletOffsets[chunk];
+			for (const Meshlet& meshlet : chunks[chunk].meshlets)
+			{
+				*dst = meshlet;
+				dst->vertexOffset += vertexOffsets[chunk];
+				dst++;
+			}
+			std::copy(chunks[chunk].vertices.begin(), chunks[chunk].vertices.end(),
+				meshlets.vertices.begin() + vertexOffsets[chunk]);
+			chunks[chunk] = ChunkMeshlets();
+		}
+	});
+
+	pool.ParallelFor(static_cast<uint32_t>(meshlets.meshlets.size()), kMeshletGrain,
+		[&](uint32_t begin, uint32_t end, uint32_t /*threadIndex*/)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const Meshlet& meshlet = meshlets.meshlets[i];
+			const uint32_t* meshletVertices = meshlets.vertices.data() + meshlet.vertexOffset;
+			ComputeSphere(vertices, meshletVertices, meshlet.vertexCount, meshlets.bounds[i]);
+			ComputeCone(vertices, meshlet, meshletVertices, meshlets.triangles.data(), meshlets.bounds[i]);
+		}
+	});
+
+	if (stats)
+	{
+		*stats = MeshletStats();
+		stats->meshletCount = static_cast<uint32_t>(meshlets.meshlets.size());
+		if (stats->meshletCount > 0)
+		{
+			stats->averageVertexCount = static_cast<float>(meshlets.vertices.size()) / stats->meshletCount;
+			stats->averageTriangleCount = static_cast<float>(triangleCount) / stats->meshletCount;
+		}
+		stats->threadCount = pool.GetThreadCount();
+		stats->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+void MeshletBuilder::OrderTriangles(const Vertex* vertices, uint32_t vertexCount, uint32_t* indices,
+	uint32_t indexCount, const MeshletBuildOptions& options)
+{
+	if (options.maxVertices < 3 || options.maxVertices > 256 || options.maxTriangles < 1)
+	{
+		throw std::logic_error("Invalid meshlet limits");
+	}
+
+	nv_helpers_dx12::ThreadPool pool(options.threadCount);
+	const uint32_t triangleCount = indexCount / 3;
+	const uint32_t chunkCount = (triangleCount + kChunkTriangles - 1) / kChunkTriangles;
+
+	// The input is only overwritten once all the chunks are ordered, so that nothing is changed
+	// if an index is invalid
+	std::vector<uint32_t> ordered(3 * static_cast<size_t>(triangleCount));
+	std::atomic<bool> invalidIndex(false);
+	pool.ParallelFor(chunkCount, 1, [&](uint32_t begin, uint32_t end, uint32_t /*threadIndex*/)
+	{
+		for (uint32_t chunk = begin; chunk < end; chunk++)
+		{
+			uint32_t firstTriangle = chunk * kChunkTriangles;
+			uint32_t endTriangle = (std::min)(firstTriangle + kChunkTriangles, triangleCount);
+			if (!OrderChunk(vertices, vertexCount, indices, firstTriangle, endTriangle, options,
+				ordered.data() + 3 * static_cast<size_t>(firstTriangle)))
+			{
+				invalidIndex = true;
+			}
+		}
+	});
+	if (invalidIndex)
+	{
+		throw std::runtime_error("Meshlet builder: vertex index out of range");
+	}
+	std::copy(ordered.begin(), ordered.end(), indices);
+}
+
+std::vector<MeshletDrawRange> MeshletBuilder::SplitGeometries(const MeshletData& meshlets, uint32_t maxTriangles)
+{
+	std::vector<MeshletDrawRange> ranges;
+	uint32_t firstTriangle = 0;
+	uint32_t triangleCount = 0;
+	for (const Meshlet& meshlet : meshlets.meshlets)
+	{
+		if (triangleCount > 0 && triangleCount + meshlet.triangleCount > maxTriangles)
+		{
+			ranges.push_back({ 3 * firstTriangle, 3 * triangleCount });
+			firstTriangle = meshlet.triangleOffset;
+			triangleCount = 0;
+		}
+		triangleCount += meshlet.triangleCount;
+	}
+	if (triangleCount > 0)
+	{
+		ranges.push_back({ 3 * firstTriangle, 3 * triangleCount });
+	}
+	return ranges;
+}
+
+uint32_t MeshletBuilder::Cull(const MeshletData& meshlets, const XMFLOAT4X4& objectToClip, const XMFLOAT3& cameraPosition,
+	std::vector<MeshletDrawRange>& ranges, const MeshletCullOptions& options)
+{
+	// Frustum planes in the space of the vertices (Gribb and Hartmann). With row vectors, each
+	// clip coordinate is the dot product of the position with a column of the matrix, and the
+	// D3D clip volume is -w <= x <= w, -w <= y <= w, 0 <= z <= w
+	float planes[6][4];
+	for (int i = 0; i < 4; i++)
+	{
+		const float x = objectToClip.m[i][0];
+		const float y = objectToClip.m[i][1];
+		const float z = objectToClip.m[i][2];
+		const float w = objectToClip.m[i][3];
+		planes[0][i] = w + x;
+		planes[1][i] = w - x;
+		planes[2][i] = w + y;
+		planes[3][i] = w - y;
+		planes[4][i] = z;
+		planes[5][i] = w - z;
+	}
+	for (auto& plane : planes)
+	{
+		float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		float scale = length > 0.0f ? 1.0f / length : 0.0f;
+		for (float& value : plane)
+		{
+			value *= scale;
+		}
+	}
+
+	ranges.clear();
+	uint32_t visibleCount = 0;
+	for (size_t i = 0; i < meshlets.meshlets.size(); i++)
+	{
+		const MeshletBounds& bounds = meshlets.bounds[i];
+		bool visible = true;
+		if (options.frustum)
+		{
+			for (int p = 0; p < 6 && visible; p++)
+			{
+				float distance = planes[p][0] * bounds.center.x + planes[p][1] * bounds.center.y +
+					planes[p][2] * bounds.center.z + planes[p][3];
+				visible = distance >= -bounds.radius;
+			}
+		}
+		if (visible && options.backface && bounds.coneCutoff < 1.0f)
+		{
+			XMFLOAT3 direction = Subtract(bounds.coneApex, cameraPosition);
+			float length = std::sqrt(Dot(direction, direction));
+			visible = Dot(direction, bounds.coneAxis) < bounds.coneCutoff * length;
+		}
+		if (!visible)
+		{
+			continue;
+		}
+
+		const Meshlet& meshlet = meshlets.meshlets[i];
+		visibleCount++;
+		if (!ranges.empty() && ranges.back().firstIndex + ranges.back().indexCount == 3 * meshlet.triangleOffset)
+		{
+			ranges.back().indexCount += 3 * meshlet.triangleCount;
+		}
+		else
+		{
+			ranges.push_back({ 3 * meshlet.triangleOffset, 3 * meshlet.triangleCount });
+		}
+	}
+	return visibleCount;
+}
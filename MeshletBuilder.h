@@ -0,0 +1,121 @@
+#pragma once
+
+// #DXR Custom: Meshlets
+// Splits indexed triangle lists in meshlets: small clusters of at most 64 vertices and 124
+// triangles, each with a bounding sphere and a normal cone. They are used to:
+//   - cull the clusters outside of the view frustum, or facing away from the camera, on the CPU
+//     before the raster draws (see Cull)
+//   - split huge meshes in several BLAS geometries, each made of whole meshlets (see
+//     SplitGeometries)
+//
+// Meshlets are built by scanning the triangles in the order of the index buffer, closing a meshlet
+// when the next triangle would exceed one of the limits. Each meshlet is thus a contiguous range of
+// triangles of the index buffer, which can be drawn without any other index buffer. The quality
+// of the clusters depends entirely on the order of the triangles, which OrderTriangles prepares:
+// it grows each meshlet greedily from a seed triangle, adding the neighboring triangle with the
+// fewest new vertices and the closest to the center of the meshlet, and writes the triangles
+// meshlet by meshlet, so that the scan of Build cuts exactly these meshlets. MeshOptimizer runs it
+// after its vertex cache and overdraw stages, whose order gives the seeds. Without it, Build
+// expects at least a vertex cache order, a scan of an arbitrary order giving scattered meshlets.
+//
+// The index buffer is split in fixed-size chunks built in parallel, meshlets never spanning two
+// chunks, and the results are concatenated in chunk order: the output does not depend on the
+// number of threads. OrderTriangles uses the same chunks.
+
+#include "VertexTypes.h"
+
+#include <cstdint>
+#include <vector>
+
+struct MeshletBuildOptions
+{
+	uint32_t maxVertices = 64;				// At most 256, local indices being 8-bit
+	uint32_t maxTriangles = 124;
+	uint32_t threadCount = 0;				// 0 selects std::thread::hardware_concurrency()
+};
+
+struct Meshlet
+{
+	uint32_t vertexOffset;					// First entry in MeshletData::vertices
+	uint32_t vertexCount;
+	uint32_t triangleOffset;				// First triangle, in the index buffer and in MeshletData::triangles
+	uint32_t triangleCount;
+};
+
+/// Bounding sphere and normal cone of a meshlet, in the space of the vertices
+struct MeshletBounds
+{
+	XMFLOAT3 center;
+	float radius;
+
+	// The meshlet faces away from a camera at position p if
+	//   dot(normalize(coneApex - p), coneAxis) >= coneCutoff
+	// The cutoff is 1 and the axis is null when the triangles face too many directions
+	XMFLOAT3 coneApex;
+	float coneCutoff;
+	XMFLOAT3 coneAxis;
+};
+
+struct MeshletData
+{
+	std::vector<Meshlet> meshlets;
+	std::vector<MeshletBounds> bounds;		// One per meshlet
+	std::vector<uint32_t> vertices;			// Vertex of the mesh for each local vertex of the meshlets
+	std::vector<uint8_t> triangles;			// Local vertex indices, 3 per triangle
+};
+
+/// Range of an index buffer
+struct MeshletDrawRange
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+};
+
+struct MeshletCullOptions
+{
+	bool frustum = true;
+	bool backface = true;					// Only valid if the back faces are culled by the rasterizer
+};
+
+struct MeshletStats
+{
+	uint32_t meshletCount = 0;
+	float averageVertexCount = 0.0f;		// Per meshlet
+	float averageTriangleCount = 0.0f;
+	uint32_t threadCount = 0;
+	double milliseconds = 0.0;
+};
+
+class MeshletBuilder
+{
+public:
+	/// <summary>
+	/// Build the meshlets of a triangle list. Throws std::runtime_error if an index is not
+	/// smaller than vertexCount
+	/// </summary>
+	static void Build(const Vertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount,
+		MeshletData& meshlets, const MeshletBuildOptions& options = {}, MeshletStats* stats = nullptr);
+
+	/// <summary>
+	/// Reorder the triangles of a triangle list so that Build, called with the same limits, cuts
+	/// compact meshlets. Each triangle keeps its corner order, hence its winding. Throws
+	/// std::runtime_error if an index is not smaller than vertexCount
+	/// </summary>
+	static void OrderTriangles(const Vertex* vertices, uint32_t vertexCount, uint32_t* indices, uint32_t indexCount,
+		const MeshletBuildOptions& options = {});
+
+	/// <summary>
+	/// Group consecutive meshlets in ranges of at most maxTriangles triangles, or a single meshlet
+	/// if it is larger
+	/// </summary>
+	static std::vector<MeshletDrawRange> SplitGeometries(const MeshletData& meshlets, uint32_t maxTriangles);
+
+	/// <summary>
+	/// Collect the index ranges of the visible meshlets, merging adjacent ones. objectToClip is the
+	/// transform from the space of the vertices to the clip space, in the row vector convention of
+	/// DirectXMath, and cameraPosition is given in the space of the vertices. Returns the number of
+	/// visible meshlets
+	/// </summary>
+	static uint32_t Cull(const MeshletData& meshlets, const XMFLOAT4X4& objectToClip, const XMFLOAT3& cameraPosition,
+		std::vector<MeshletDrawRange>& ranges, const MeshletCullOptions& options = {});
+};
@@ -0,0 +1,108 @@
+#include "PipelineCache.h"
+
+#include <chrono>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double MillisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+}
+
+FilePipelineBlobStore::FilePipelineBlobStore(const std::string& directory)
+	: m_entries(directory, ".rtpso", kPipelineCacheMagic, kPipelineCacheVersion)
+{
+}
+
+bool FilePipelineBlobStore::Load(const CacheKey& key, std::vector<uint8_t>& blob)
+{
+	bool invalid = false;
+	std::unique_ptr<MappedFile> file = m_entries.Load(key, invalid);
+	if (!file)
+	{
+		return false;
+	}
+	const uint8_t* data = reinterpret_cast<const uint8_t*>(file->GetData()) + CacheDirectory::kDataOffset;
+	blob.assign(data, data + (file->GetSize() - CacheDirectory::kDataOffset));
+	return true;
+}
+
+bool FilePipelineBlobStore::Store(const CacheKey& key, const std::vector<uint8_t>& blob)
+{
+	return m_entries.Write(key, blob.data(), blob.size());
+}
+
+PipelineCache::PipelineCache(std::unique_ptr<PipelineBlobStore> store)
+	: m_store(std::move(store))
+{
+}
+
+ComPtr<ID3D12StateObject> PipelineCache::GetOrCreate(nv_helpers_dx12::RayTracingPipelineGenerator& generator,
+	bool* cacheHit)
+{
+	auto start = Clock::now();
+	std::vector<uint8_t> description;
+	bool persistent = generator.SerializeDescription(description);
+	CacheKey key = ComputeKey(description);
+	m_stats.describeMilliseconds += MillisecondsSince(start);
+
+	auto entry = m_entries.find(key);
+	if (entry != m_entries.end())
+	{
+		if (entry->second.description == description)
+		{
+			m_stats.memoryHitCount++;
+			generator.MarkAsGenerated();
+			if (cacheHit)
+			{
+				*cacheHit = true;
+			}
+			return entry->second.stateObject;
+		}
+		m_stats.collisionCount++;
+	}
+	if (cacheHit)
+	{
+		*cacheHit = false;
+	}
+
+	start = Clock::now();
+	ComPtr<ID3D12StateObject> stateObject;
+	stateObject.Attach(generator.Generate());
+	m_stats.createMilliseconds += MillisecondsSince(start);
+	m_stats.createCount++;
+
+	// A colliding key keeps its first pipeline, the new one is simply not cached
+	if (entry == m_entries.end())
+	{
+		m_entries[key] = Entry{ description, stateObject };
+	}
+
+	if (m_store && persistent)
+	{
+		std::vector<uint8_t> stored;
+		if (m_store->Load(key, stored))
+		{
+			if (stored == description)
+			{
+				m_stats.knownCount++;
+				return stateObject;
+			}
+			m_stats.collisionCount++;
+		}
+		m_stats.storeFailureCount += m_store->Store(key, description) ? 0 : 1;
+	}
+	return stateObject;
+}
+
+CacheKey PipelineCache::ComputeKey(const std::vector<uint8_t>& description)
+{
+	CacheKeyHasher hasher;
+	hasher.AddField(description.data(), description.size());
+	return hasher.Get();
+}
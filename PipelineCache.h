@@ -0,0 +1,106 @@
+#pragma once
+
+// #DXR Custom: Pipeline Cache
+// Cache of raytracing state objects, keyed by a hash of the canonical description of their
+// pipeline (see RayTracingPipelineGenerator::SerializeDescription). Generating a pipeline whose
+// description is already known returns the existing state object, skipping the creation of the
+// state object, which is the bulk of the cost of Generate.
+//
+// The cache has two levels:
+//   - in memory, the state objects created during the run, stored with their full description so
+//     that a hash collision cannot return the wrong pipeline
+//   - on disk, a PipelineBlobStore persisting one blob per key across runs, implemented over a
+//     CacheDirectory by FilePipelineBlobStore
+// D3D12 has no serialized form of raytracing state objects, ID3D12PipelineLibrary only holding
+// graphics and compute pipeline states. The blobs are therefore the descriptions themselves: they
+// tell which pipelines were already created by a previous run, whose creation is then mostly
+// served by the shader cache of the driver, and are compared with the new descriptions to detect
+// collisions. Descriptions depending on the address of a root signature are only valid during the
+// run, and are kept in memory only.
+
+#include "CacheDirectory.h"
+#include "nv_helpers_dx12/RaytracingPipelineGenerator.h"
+
+#include <d3d12.h>
+#include <wrl/client.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+static const uint32_t kPipelineCacheMagic = 0x43504D44;	// "DMPC"
+static const uint32_t kPipelineCacheVersion = 1;
+
+/// Persistent storage of the pipeline blobs, one per key
+class PipelineBlobStore
+{
+public:
+	virtual ~PipelineBlobStore() = default;
+
+	/// Read the blob stored under a key. Returns false if there is none, or if it is invalid
+	virtual bool Load(const CacheKey& key, std::vector<uint8_t>& blob) = 0;
+	/// Store a blob, replacing any existing one. Returns false on failure
+	virtual bool Store(const CacheKey& key, const std::vector<uint8_t>& blob) = 0;
+};
+
+/// Blobs stored as <key>.rtpso entries of a cache directory
+class FilePipelineBlobStore : public PipelineBlobStore
+{
+public:
+	explicit FilePipelineBlobStore(const std::string& directory);
+
+	bool Load(const CacheKey& key, std::vector<uint8_t>& blob) override;
+	bool Store(const CacheKey& key, const std::vector<uint8_t>& blob) override;
+
+private:
+	CacheDirectory m_entries;
+};
+
+struct PipelineCacheStats
+{
+	uint32_t memoryHitCount = 0;
+	uint32_t createCount = 0;				// State objects created
+	uint32_t knownCount = 0;				// Created ones found in the blob store
+	uint32_t collisionCount = 0;			// Keys found with another description
+	uint32_t storeFailureCount = 0;
+	double describeMilliseconds = 0.0;		// Serializing and hashing the descriptions
+	double createMilliseconds = 0.0;
+};
+
+class PipelineCache
+{
+public:
+	/// <summary>
+	/// Cache in memory, and in the blob store if any
+	/// </summary>
+	explicit PipelineCache(std::unique_ptr<PipelineBlobStore> store = nullptr);
+
+	/// <summary>
+	/// State object of the pipeline described by the generator, calling Generate if it is not in
+	/// the cache. Throws as Generate. cacheHit receives whether the state object was found in memory.
+	/// Either way the generator considers its shaders as generated, for later additions
+	/// </summary>
+	Microsoft::WRL::ComPtr<ID3D12StateObject> GetOrCreate(nv_helpers_dx12::RayTracingPipelineGenerator& generator,
+		bool* cacheHit = nullptr);
+
+	static CacheKey ComputeKey(const std::vector<uint8_t>& description);
+
+	/// <summary>
+	/// Release the state objects held in memory
+	/// </summary>
+	void Clear() { m_entries.clear(); }
+
+	const PipelineCacheStats& GetStats() const { return m_stats; }
+	void ResetStats() { m_stats = PipelineCacheStats(); }
+
+private:
+	struct Entry
+	{
+		std::vector<uint8_t> description;
+		Microsoft::WRL::ComPtr<ID3D12StateObject> stateObject;
+	};
+
+	std::unique_ptr<PipelineBlobStore> m_store;
+	std::map<CacheKey, Entry> m_entries;
+	PipelineCacheStats m_stats;
+};
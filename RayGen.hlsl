@@ -73,9 +73,10 @@ void RayGen() {
             TraceRay(
             SceneBVH, // Acceleration structure
             DEFAULT_RAY_FLAG, // Flags 
-            0xFF, // Instance inclusion mask: include all
+            // #DXR Custom: Instance Culling - the first ray starts from the camera
+            j == 0 ? INSTANCE_MASK_CAMERA : INSTANCE_MASK_ALL, // Instance inclusion mask
             2, // Hit group offset : reflection hit group
-            0, // SBT offset
+            3, // SBT offset : 3 hit groups per BLAS geometry (#DXR Custom: Meshlets)
             2, // Index of the miss shader: reflection miss shader
             ray, // Ray information to trace
             reflectionPayload); // Payload
@@ -1,30 +1,46 @@
 #include "Common.hlsl"
 
-// #DXR Custom: Reflections
-cbuffer Colors : register(b0)
-{
-    Material mat;
-}
+// #DXR Custom: Material Table
+// Materials of all the instances, indexed by InstanceID() (see MaterialTable.h)
+StructuredBuffer<uint> instanceMaterials : register(t4);
+StructuredBuffer<float4> materialAlbedo : register(t5);
+StructuredBuffer<float4> materialSpecular : register(t6);
 
-StructuredBuffer<STriVertex> BTriVertex : register(t0);
-StructuredBuffer<int> indices : register(t1);
+// #DXR Custom: Packed Vertices
+// Declares the vertex and index buffers of the hit geometry
+#include "VertexFetch.hlsl"
 
 // #DXR Custom: Simple Lighting
 // Raytracing acceleration structure, accessed as a SRV
 RaytracingAccelerationStructure SceneBVH : register(t2);
 
+// #DXR Custom: Pipeline Additions
+// Compiled with REFLECTION_HIT_VARIANT defined, the library exports a variant of the reflection hit
+// shading the reflected surfaces with their normal, added to the pipeline at runtime
+#ifdef REFLECTION_HIT_VARIANT
+#define REFLECTION_CLOSEST_HIT ReflectionClosestHitVariant
+#else
+#define REFLECTION_CLOSEST_HIT ReflectionClosestHit
+#endif
+
 [shader("closesthit")]
-void ReflectionClosestHit(inout ReflectionHitInfo payload, Attributes attrib)
+void REFLECTION_CLOSEST_HIT(inout ReflectionHitInfo payload, Attributes attrib)
 {
     float3 barycentrics =
 		float3(1.0f - attrib.bary.x - attrib.bary.y, attrib.bary.x, attrib.bary.y);
 
+    // #DXR Custom: Material Table
+    uint materialIndex = instanceMaterials[InstanceID()];
+    Material mat;
+    mat.albedo = materialAlbedo[materialIndex].rgb;
+    mat.specular = materialSpecular[materialIndex].rgb;
+
     uint vertId = 3 * PrimitiveIndex();
     
     float3x4 objectToWorld = ObjectToWorld();
-    float3 v1 = mul(objectToWorld, BTriVertex[indices[vertId + 0]].vertex);
-    float3 v2 = mul(objectToWorld, BTriVertex[indices[vertId + 1]].vertex);
-    float3 v3 = mul(objectToWorld, BTriVertex[indices[vertId + 2]].vertex);
+    float3 v1 = mul(objectToWorld, FetchVertexPosition(indices[vertId + 0]));
+    float3 v2 = mul(objectToWorld, FetchVertexPosition(indices[vertId + 1]));
+    float3 v3 = mul(objectToWorld, FetchVertexPosition(indices[vertId + 2]));
     
     float minTMult = length(v2 - v3);
     
@@ -34,6 +50,10 @@ void ReflectionClosestHit(inout ReflectionHitInfo payload, Attributes attrib)
         normal = -normal;
     }
     
+#ifdef REFLECTION_HIT_VARIANT
+    mat.albedo = abs(normal);
+#endif
+    
     float3 worldOrigin = WorldRayOrigin() + RayTCurrent() * WorldRayDirection();
     
     float3 vectToLight = LIGHT_POS - worldOrigin;
@@ -78,7 +98,9 @@ void ReflectionClosestHit(inout ReflectionHitInfo payload, Attributes attrib)
     // the SBT in the same order as they are added in the AS, in which case
     // the value below represents the stride (4 bits representing the number
     // of hit groups) between two consecutive objects.
-    0,
+    // #DXR Custom: Meshlets
+    // Large meshes are split in several geometries, each with its own 3 hit groups
+    3,
     // Index of the miss shader: shadow miss shader
     1,
     // Ray information to trace
@@ -90,9 +112,9 @@ void ReflectionClosestHit(inout ReflectionHitInfo payload, Attributes attrib)
     // #DXR Custom: Simple Lighting
     float diffFactor = shadowPayload.isHit ? 0.0f : 1.0f;
     
-    float3 objectColor = BTriVertex[indices[vertId + 0]].color * barycentrics.x +
-                         BTriVertex[indices[vertId + 1]].color * barycentrics.y +
-                         BTriVertex[indices[vertId + 2]].color * barycentrics.z;
+    float3 objectColor = FetchVertexColor(indices[vertId + 0]).rgb * barycentrics.x +
+                         FetchVertexColor(indices[vertId + 1]).rgb * barycentrics.y +
+                         FetchVertexColor(indices[vertId + 2]).rgb * barycentrics.z;
     
     // #DXR Custom: Simple Lighting
     float3 hitColor = (diffFactor * diffuse + AMBIENT_FACTOR * LIGHT_COL) * /*objectColor*/mat.albedo;
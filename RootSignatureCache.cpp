@@ -0,0 +1,144 @@
+#include "RootSignatureCache.h"
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double MillisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+}
+
+RootSignatureCache::RootSignatureCache(const std::string& directory)
+	: m_blobs(directory, ".rootsig", kRootSignatureCacheMagic, kRootSignatureCacheVersion)
+{
+}
+
+ComPtr<ID3D12RootSignature> RootSignatureCache::GetOrCreate(ID3D12Device* device,
+	const nv_helpers_dx12::RootSignatureGenerator& generator, bool isLocal)
+{
+	m_stats.requestCount++;
+	auto start = Clock::now();
+	std::vector<uint8_t> layout;
+	generator.SerializeLayout(isLocal, layout);
+	CacheKey key = ComputeKey(layout);
+	m_stats.hashMilliseconds += MillisecondsSince(start);
+
+	auto entry = m_entries.find(key);
+	if (entry != m_entries.end())
+	{
+		if (entry->second.layout == layout)
+		{
+			m_stats.sharedCount++;
+			return entry->second.rootSignature;
+		}
+		m_stats.collisionCount++;
+	}
+
+	start = Clock::now();
+	ComPtr<ID3D12RootSignature> rootSignature = LoadEntry(device, key, layout);
+	if (rootSignature)
+	{
+		m_stats.diskHitCount++;
+	}
+	else
+	{
+		ID3DBlob* blob = generator.Serialize(isLocal);
+		try
+		{
+			rootSignature.Attach(nv_helpers_dx12::RootSignatureGenerator::CreateFromBlob(device,
+				blob->GetBufferPointer(), blob->GetBufferSize()));
+		}
+		catch (const std::logic_error&)
+		{
+			blob->Release();
+			throw;
+		}
+		m_stats.serializeCount++;
+		StoreEntry(key, layout, blob->GetBufferPointer(), blob->GetBufferSize());
+		blob->Release();
+	}
+	m_stats.createMilliseconds += MillisecondsSince(start);
+	m_stats.createCount++;
+
+	// A colliding key keeps its first root signature, the new one is simply not shared
+	if (entry == m_entries.end())
+	{
+		m_entries[key] = Entry{ layout, rootSignature };
+	}
+	return rootSignature;
+}
+
+CacheKey RootSignatureCache::ComputeKey(const std::vector<uint8_t>& layout)
+{
+	CacheKeyHasher hasher;
+	hasher.AddField(layout.data(), layout.size());
+	return hasher.Get();
+}
+
+ComPtr<ID3D12RootSignature> RootSignatureCache::LoadEntry(ID3D12Device* device, const CacheKey& key,
+	const std::vector<uint8_t>& layout)
+{
+	bool invalid = false;
+	std::unique_ptr<MappedFile> file = m_blobs.Load(key, invalid);
+	if (!file)
+	{
+		return nullptr;
+	}
+
+	// The entry holds the size of the layout, the layout and the blob
+	const uint64_t dataOffset = CacheDirectory::kDataOffset;
+	const uint8_t* data = reinterpret_cast<const uint8_t*>(file->GetData()) + dataOffset;
+	uint64_t dataSize = file->GetSize() - dataOffset;
+	uint64_t layoutSize = 0;
+	if (dataSize < sizeof(layoutSize))
+	{
+		return nullptr;
+	}
+	memcpy(&layoutSize, data, sizeof(layoutSize));
+	if (dataSize - sizeof(layoutSize) <= layoutSize)
+	{
+		return nullptr;
+	}
+	if (layoutSize != layout.size() || memcmp(data + sizeof(layoutSize), layout.data(), layout.size()) != 0)
+	{
+		m_stats.collisionCount++;
+		return nullptr;
+	}
+
+	const uint8_t* blob = data + sizeof(layoutSize) + layoutSize;
+	size_t blobSize = static_cast<size_t>(dataSize - sizeof(layoutSize) - layoutSize);
+	ComPtr<ID3D12RootSignature> rootSignature;
+	try
+	{
+		rootSignature.Attach(nv_helpers_dx12::RootSignatureGenerator::CreateFromBlob(device, blob, blobSize));
+	}
+	catch (const std::logic_error&)
+	{
+		// Rejected by the runtime, for example a blob written by another version: serialized again
+		return nullptr;
+	}
+	return rootSignature;
+}
+
+void RootSignatureCache::StoreEntry(const CacheKey& key, const std::vector<uint8_t>& layout, const void* blob,
+	size_t blobSize)
+{
+	if (!m_blobs.IsEnabled())
+	{
+		return;
+	}
+	uint64_t layoutSize = layout.size();
+	std::vector<uint8_t> data(sizeof(layoutSize) + layout.size() + blobSize);
+	memcpy(data.data(), &layoutSize, sizeof(layoutSize));
+	memcpy(data.data() + sizeof(layoutSize), layout.data(), layout.size());
+	memcpy(data.data() + sizeof(layoutSize) + layout.size(), blob, blobSize);
+	m_stats.storeFailureCount += m_blobs.Write(key, data.data(), data.size()) ? 0 : 1;
+}
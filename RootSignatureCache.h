@@ -0,0 +1,86 @@
+#pragma once
+
+// #DXR Custom: Root Signature Cache
+// Interning of root signatures by layout. The layout of a generator (see
+// RootSignatureGenerator::SerializeLayout) is hashed into a CacheKey, and generators with the same
+// layout share a single root signature, so that for example the hit, shadow and reflection hit
+// groups use one object instead of three identical ones.
+//
+// The serialized blobs are also persisted as <key>.rootsig entries of a CacheDirectory, holding
+// the layout followed by the blob. A root signature unknown in memory but found on disk is created
+// directly from its blob, without calling D3D12SerializeRootSignature. The stored layout is
+// compared with the requested one, so that a hash collision cannot return the wrong root
+// signature. The cache belongs to a single device.
+
+#include "CacheDirectory.h"
+#include "nv_helpers_dx12/RootSignatureGenerator.h"
+
+#include <d3d12.h>
+#include <wrl/client.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+static const uint32_t kRootSignatureCacheMagic = 0x53524D44;	// "DMRS"
+static const uint32_t kRootSignatureCacheVersion = 1;
+
+struct RootSignatureCacheStats
+{
+	uint32_t requestCount = 0;
+	uint32_t sharedCount = 0;				// Requests served by an existing root signature, ie. signatures saved
+	uint32_t createCount = 0;				// Root signatures created
+	uint32_t diskHitCount = 0;				// Created ones whose blob was loaded from disk
+	uint32_t serializeCount = 0;			// Created ones serialized by D3D12SerializeRootSignature
+	uint32_t collisionCount = 0;			// Keys found with another layout
+	uint32_t storeFailureCount = 0;
+	double hashMilliseconds = 0.0;			// Serializing and hashing the layouts
+	double createMilliseconds = 0.0;		// Loading or serializing the blobs, and creating the root signatures
+};
+
+class RootSignatureCache
+{
+public:
+	/// <summary>
+	/// Cache in memory, and in the directory unless it is empty
+	/// </summary>
+	explicit RootSignatureCache(const std::string& directory = std::string());
+
+	/// <summary>
+	/// Root signature with the layout of the generator, created if it is not in the cache. Throws
+	/// as RootSignatureGenerator::Generate
+	/// </summary>
+	Microsoft::WRL::ComPtr<ID3D12RootSignature> GetOrCreate(ID3D12Device* device,
+		const nv_helpers_dx12::RootSignatureGenerator& generator, bool isLocal);
+
+	static CacheKey ComputeKey(const std::vector<uint8_t>& layout);
+
+	/// <summary>
+	/// Release the root signatures held in memory
+	/// </summary>
+	void Clear() { m_entries.clear(); }
+	/// Number of distinct root signatures held in memory
+	size_t GetSize() const { return m_entries.size(); }
+
+	const RootSignatureCacheStats& GetStats() const { return m_stats; }
+	void ResetStats() { m_stats = RootSignatureCacheStats(); }
+
+private:
+	struct Entry
+	{
+		std::vector<uint8_t> layout;
+		Microsoft::WRL::ComPtr<ID3D12RootSignature> rootSignature;
+	};
+
+	/// <summary>
+	/// Create the root signature from the blob stored under the key, if any and if it was stored
+	/// for the same layout
+	/// </summary>
+	Microsoft::WRL::ComPtr<ID3D12RootSignature> LoadEntry(ID3D12Device* device, const CacheKey& key,
+		const std::vector<uint8_t>& layout);
+	void StoreEntry(const CacheKey& key, const std::vector<uint8_t>& layout, const void* blob, size_t blobSize);
+
+	CacheDirectory m_blobs;
+	std::map<CacheKey, Entry> m_entries;
+	RootSignatureCacheStats m_stats;
+};
@@ -0,0 +1,246 @@
+#include "SceneInstanceStore.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	template <typename T>
+	void MoveLast(std::vector<T>& values, uint32_t index)
+	{
+		values[index] = values.back();
+		values.pop_back();
+	}
+}
+
+SceneInstanceStore::SceneInstanceStore(uint32_t frameCount)
+	: m_frameChanges(frameCount > 0 ? frameCount : 1)
+{
+}
+
+InstanceHandle SceneInstanceStore::Create(const XMMATRIX& transform, const SceneInstanceDesc& desc)
+{
+	uint32_t index = GetCount();
+	XMFLOAT4X4 storedTransform;
+	XMStoreFloat4x4(&storedTransform, transform);
+	m_transforms.push_back(storedTransform);
+	m_bottomLevelAS.push_back(desc.bottomLevelAS);
+	m_hitGroupIndices.push_back(desc.hitGroupIndex);
+	m_materialIndices.push_back(desc.materialIndex);
+	m_meshes.push_back(desc.mesh);
+	m_masks.push_back(desc.mask);
+	m_flags.push_back(desc.flags);
+
+	InstanceHandle handle;
+	if (!m_freeSlots.empty())
+	{
+		handle.slot = m_freeSlots.back();
+		m_freeSlots.pop_back();
+		m_slotIndices[handle.slot] = index;
+	}
+	else
+	{
+		handle.slot = static_cast<uint32_t>(m_slotIndices.size());
+		m_slotIndices.push_back(index);
+		m_slotGenerations.push_back(0);
+	}
+	handle.generation = m_slotGenerations[handle.slot];
+	m_denseSlots.push_back(handle.slot);
+
+	for (FrameChanges& changes : m_frameChanges)
+	{
+		changes.bits.resize((GetCount() + 63) / 64, 0);
+	}
+	MarkChanged(index);
+	return handle;
+}
+
+void SceneInstanceStore::Destroy(InstanceHandle handle)
+{
+	uint32_t index = GetIndex(handle);
+	uint32_t last = GetCount() - 1;
+
+	// The last instance moves into the freed index, whose GPU data has to be rewritten
+	MoveLast(m_transforms, index);
+	MoveLast(m_bottomLevelAS, index);
+	MoveLast(m_hitGroupIndices, index);
+	MoveLast(m_materialIndices, index);
+	MoveLast(m_meshes, index);
+	MoveLast(m_masks, index);
+	MoveLast(m_flags, index);
+	MoveLast(m_denseSlots, index);
+	if (index != last)
+	{
+		m_slotIndices[m_denseSlots[index]] = index;
+		MarkChanged(index);
+	}
+
+	m_slotGenerations[handle.slot]++;
+	m_freeSlots.push_back(handle.slot);
+
+	// The last index may stay in the change lists, WriteChanges skips it as its bit is cleared
+	for (FrameChanges& changes : m_frameChanges)
+	{
+		changes.bits[last / 64] &= ~(uint64_t(1) << (last % 64));
+		changes.bits.resize((GetCount() + 63) / 64);
+	}
+}
+
+void SceneInstanceStore::Clear()
+{
+	while (GetCount() > 0)
+	{
+		uint32_t slot = m_denseSlots.back();
+		Destroy({ slot, m_slotGenerations[slot] });
+	}
+}
+
+bool SceneInstanceStore::IsValid(InstanceHandle handle) const
+{
+	return handle.slot < m_slotGenerations.size() && m_slotGenerations[handle.slot] == handle.generation &&
+		m_slotIndices[handle.slot] < GetCount() && m_denseSlots[m_slotIndices[handle.slot]] == handle.slot;
+}
+
+uint32_t SceneInstanceStore::GetIndex(InstanceHandle handle) const
+{
+	if (!IsValid(handle))
+	{
+		throw std::logic_error("Invalid instance handle");
+	}
+	return m_slotIndices[handle.slot];
+}
+
+void SceneInstanceStore::SetTransform(uint32_t index, const XMMATRIX& transform)
+{
+	CheckIndex(index);
+	XMStoreFloat4x4(&m_transforms[index], transform);
+	MarkChanged(index);
+}
+
+void SceneInstanceStore::SetBottomLevelAS(uint32_t index, D3D12_GPU_VIRTUAL_ADDRESS bottomLevelAS, uint32_t hitGroupIndex)
+{
+	CheckIndex(index);
+	if (m_bottomLevelAS[index] == bottomLevelAS && m_hitGroupIndices[index] == hitGroupIndex)
+	{
+		return;
+	}
+	m_bottomLevelAS[index] = bottomLevelAS;
+	m_hitGroupIndices[index] = hitGroupIndex;
+	MarkChanged(index);
+}
+
+void SceneInstanceStore::SetMaterialIndex(uint32_t index, uint32_t materialIndex)
+{
+	CheckIndex(index);
+	if (m_materialIndices[index] != materialIndex)
+	{
+		m_materialIndices[index] = materialIndex;
+		MarkChanged(index);
+	}
+}
+
+void SceneInstanceStore::SetMask(uint32_t index, uint8_t mask)
+{
+	CheckIndex(index);
+	if (m_masks[index] != mask)
+	{
+		m_masks[index] = mask;
+		MarkChanged(index);
+	}
+}
+
+void SceneInstanceStore::SetFlags(uint32_t index, uint8_t flags)
+{
+	CheckIndex(index);
+	if (m_flags[index] != flags)
+	{
+		m_flags[index] = flags;
+		MarkChanged(index);
+	}
+}
+
+void SceneInstanceStore::MarkAllChanged()
+{
+	for (FrameChanges& changes : m_frameChanges)
+	{
+		changes.indices.resize(GetCount());
+		for (uint32_t index = 0; index < GetCount(); index++)
+		{
+			changes.indices[index] = index;
+		}
+		for (uint32_t word = 0; word < changes.bits.size(); word++)
+		{
+			uint32_t bits = (std::min)(64u, GetCount() - word * 64);
+			changes.bits[word] = (bits == 64) ? ~uint64_t(0) : ((uint64_t(1) << bits) - 1);
+		}
+	}
+}
+
+uint32_t SceneInstanceStore::WriteChanges(uint32_t frameIndex, const XMFLOAT4X4* meshVertexTransforms,
+	XMFLOAT4X4* properties, D3D12_RAYTRACING_INSTANCE_DESC* descs)
+{
+	FrameChanges& changes = m_frameChanges.at(frameIndex);
+	uint32_t written = 0;
+	for (uint32_t index : changes.indices)
+	{
+		uint64_t bit = uint64_t(1) << (index % 64);
+		if (index >= GetCount() || (changes.bits[index / 64] & bit) == 0)
+		{
+			continue;
+		}
+		changes.bits[index / 64] &= ~bit;
+
+		// The matrix is loaded once in SIMD registers for both outputs
+		XMMATRIX transform = XMLoadFloat4x4(&m_transforms[index]);
+		XMStoreFloat4x4(&properties[index], XMLoadFloat4x4(&meshVertexTransforms[m_meshes[index]]) * transform);
+		WriteInstanceDesc(index, transform, descs[index]);
+		written++;
+	}
+	changes.indices.clear();
+	return written;
+}
+
+void SceneInstanceStore::WriteInstanceDescs(D3D12_RAYTRACING_INSTANCE_DESC* descs) const
+{
+	for (uint32_t index = 0; index < GetCount(); index++)
+	{
+		WriteInstanceDesc(index, XMLoadFloat4x4(&m_transforms[index]), descs[index]);
+	}
+}
+
+void SceneInstanceStore::CheckIndex(uint32_t index) const
+{
+	if (index >= GetCount())
+	{
+		throw std::logic_error("Instance index out of range");
+	}
+}
+
+void SceneInstanceStore::MarkChanged(uint32_t index)
+{
+	uint64_t bit = uint64_t(1) << (index % 64);
+	for (FrameChanges& changes : m_frameChanges)
+	{
+		if ((changes.bits[index / 64] & bit) == 0)
+		{
+			changes.bits[index / 64] |= bit;
+			changes.indices.push_back(index);
+		}
+	}
+}
+
+void SceneInstanceStore::WriteInstanceDesc(uint32_t index, const XMMATRIX& transform,
+	D3D12_RAYTRACING_INSTANCE_DESC& desc) const
+{
+	// The descriptor is assembled on the stack and copied whole, the destination being
+	// write-combined memory. XMStoreFloat3x4 stores the transposed matrix, as the TLAS expects
+	D3D12_RAYTRACING_INSTANCE_DESC instanceDesc;
+	XMStoreFloat3x4(reinterpret_cast<XMFLOAT3X4*>(instanceDesc.Transform), transform);
+	instanceDesc.InstanceID = m_materialIndices[index];
+	instanceDesc.InstanceMask = m_masks[index];
+	instanceDesc.InstanceContributionToHitGroupIndex = m_hitGroupIndices[index];
+	instanceDesc.Flags = m_flags[index];
+	instanceDesc.AccelerationStructure = m_bottomLevelAS[index];
+	memcpy(&desc, &instanceDesc, sizeof(desc));
+}
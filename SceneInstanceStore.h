@@ -0,0 +1,131 @@
+#pragma once
+
+// #DXR Custom: Instance Store
+// Instances of the scene in structure-of-arrays layout: each property (transform, bottom-level
+// AS, hit group, material, mesh, mask, flags) is stored in its own array, indexed by the dense
+// index of the instance. The dense index is the index of the instance in the GPU buffers, which
+// shifts when an instance is destroyed: the last instance moves into its place. Handles stay
+// valid across these moves, and are resolved with GetIndex.
+//
+// The store writes the GPU data of the instances itself, in a single pass over the changed
+// instances: the matrices read by the vertex shader, and the D3D12_RAYTRACING_INSTANCE_DESC of
+// the TLAS, whose transform is the transposed 3x4 part of the matrix. Each frame in flight has
+// its own copy of these buffers, so each frame context keeps the list of the instances changed
+// since the frame last wrote its buffers, and writing them costs the number of changed instances
+// rather than the instance count.
+
+#include "VertexTypes.h"
+
+#include <d3d12.h>
+
+#include <cstdint>
+#include <vector>
+
+/// Stable reference to an instance
+struct InstanceHandle
+{
+	uint32_t slot = 0xFFFFFFFFu;
+	uint32_t generation = 0;
+};
+
+/// Properties of a new instance, other than its transform
+struct SceneInstanceDesc
+{
+	D3D12_GPU_VIRTUAL_ADDRESS bottomLevelAS = 0;
+	uint32_t hitGroupIndex = 0;				// InstanceContributionToHitGroupIndex
+	uint32_t materialIndex = 0;				// InstanceID() in the hit shaders, see MaterialTable
+	uint32_t mesh = 0;						// Selects the vertex transform of the mesh, see WriteChanges
+	uint8_t mask = 0xFF;
+	uint8_t flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
+};
+
+class SceneInstanceStore
+{
+public:
+	explicit SceneInstanceStore(uint32_t frameCount = 1);
+
+	/// <summary>
+	/// Add an instance at the end of the dense arrays
+	/// </summary>
+	InstanceHandle Create(const XMMATRIX& transform, const SceneInstanceDesc& desc);
+
+	/// <summary>
+	/// Remove an instance. The last instance takes its dense index. Throws std::logic_error if
+	/// the handle is not valid
+	/// </summary>
+	void Destroy(InstanceHandle handle);
+
+	void Clear();
+
+	bool IsValid(InstanceHandle handle) const;
+	/// <summary>
+	/// Dense index of an instance. Throws std::logic_error if the handle is not valid
+	/// </summary>
+	uint32_t GetIndex(InstanceHandle handle) const;
+	uint32_t GetCount() const { return static_cast<uint32_t>(m_transforms.size()); }
+
+	// The setters take dense indices, and mark the instance as changed if the value differs.
+	// Throws std::logic_error if the index is out of range
+	void SetTransform(uint32_t index, const XMMATRIX& transform);
+	void SetBottomLevelAS(uint32_t index, D3D12_GPU_VIRTUAL_ADDRESS bottomLevelAS, uint32_t hitGroupIndex);
+	void SetMaterialIndex(uint32_t index, uint32_t materialIndex);
+	void SetMask(uint32_t index, uint8_t mask);
+	void SetFlags(uint32_t index, uint8_t flags);
+
+	XMMATRIX GetTransform(uint32_t index) const { return XMLoadFloat4x4(&m_transforms[index]); }
+	D3D12_GPU_VIRTUAL_ADDRESS GetBottomLevelAS(uint32_t index) const { return m_bottomLevelAS[index]; }
+	uint32_t GetHitGroupIndex(uint32_t index) const { return m_hitGroupIndices[index]; }
+	uint32_t GetMaterialIndex(uint32_t index) const { return m_materialIndices[index]; }
+	uint32_t GetMesh(uint32_t index) const { return m_meshes[index]; }
+	uint8_t GetMask(uint32_t index) const { return m_masks[index]; }
+	uint8_t GetFlags(uint32_t index) const { return m_flags[index]; }
+
+	/// <summary>
+	/// Mark all the instances as changed for all the frame contexts, for example after the GPU
+	/// buffers are reallocated
+	/// </summary>
+	void MarkAllChanged();
+
+	/// <summary>
+	/// Write the instances changed since the last call for this frame context. For each of them,
+	/// properties receives meshVertexTransforms[mesh] * transform, where the mesh transform maps
+	/// the vertices read by the vertex shader to the space of the instance transform, and descs
+	/// receives the TLAS instance descriptor. The memory is only written, so it can be
+	/// write-combined. Returns the number of instances written
+	/// </summary>
+	uint32_t WriteChanges(uint32_t frameIndex, const XMFLOAT4X4* meshVertexTransforms, XMFLOAT4X4* properties,
+		D3D12_RAYTRACING_INSTANCE_DESC* descs);
+
+	/// <summary>
+	/// Write the TLAS instance descriptors of all the instances, for a full build
+	/// </summary>
+	void WriteInstanceDescs(D3D12_RAYTRACING_INSTANCE_DESC* descs) const;
+
+private:
+	void CheckIndex(uint32_t index) const;
+	void MarkChanged(uint32_t index);
+	void WriteInstanceDesc(uint32_t index, const XMMATRIX& transform, D3D12_RAYTRACING_INSTANCE_DESC& desc) const;
+
+	std::vector<XMFLOAT4X4> m_transforms;
+	std::vector<D3D12_GPU_VIRTUAL_ADDRESS> m_bottomLevelAS;
+	std::vector<uint32_t> m_hitGroupIndices;
+	std::vector<uint32_t> m_materialIndices;
+	std::vector<uint32_t> m_meshes;
+	std::vector<uint8_t> m_masks;
+	std::vector<uint8_t> m_flags;
+
+	// Handles: dense index and generation of each slot, and slot of each dense index
+	std::vector<uint32_t> m_slotIndices;
+	std::vector<uint32_t> m_slotGenerations;
+	std::vector<uint32_t> m_freeSlots;
+	std::vector<uint32_t> m_denseSlots;
+
+	// Dense indices changed since a frame context last wrote its buffers. The bits avoid duplicates
+	// in the list, which may also hold indices destroyed since, whose bit is cleared
+	struct FrameChanges
+	{
+		std::vector<uint32_t> indices;
+		std::vector<uint64_t> bits;
+	};
+	std::vector<FrameChanges> m_frameChanges;
+};
@@ -0,0 +1,285 @@
+#include "ShaderCache.h"
+
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <stdexcept>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double MillisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// Bound on the number of files of an include closure, which stops include cycles between
+	// files reached through different relative paths
+	const size_t kMaxClosureFiles = 256;
+
+	bool ReadFile(const std::string& fileName, std::string& content)
+	{
+		std::ifstream file(fileName, std::ios::binary);
+		if (!file)
+		{
+			return false;
+		}
+		content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	std::string GetDirectory(const std::string& fileName)
+	{
+		size_t separator = fileName.find_last_of("/\\");
+		return separator == std::string::npos ? std::string() : fileName.substr(0, separator + 1);
+	}
+
+	std::string JoinPath(const std::string& directory, const std::string& fileName)
+	{
+		if (directory.empty() || directory.back() == '/' || directory.back() == '\\')
+		{
+			return directory + fileName;
+		}
+		return directory + "/" + fileName;
+	}
+
+	/// Names of the files included by a source, in order. Only the lines starting with
+	/// #include "name" or #include <name> are considered, regardless of comments and #if blocks
+	std::vector<std::string> FindIncludes(const std::string& source)
+	{
+		std::vector<std::string> includes;
+		size_t lineStart = 0;
+		while (lineStart < source.size())
+		{
+			size_t lineEnd = source.find('\n', lineStart);
+			if (lineEnd == std::string::npos)
+			{
+				lineEnd = source.size();
+			}
+
+			size_t i = source.find_first_not_of(" \t", lineStart);
+			if (i < lineEnd && source[i] == '#')
+			{
+				i = source.find_first_not_of(" \t", i + 1);
+				static const char kInclude[] = "include";
+				if (i < lineEnd && source.compare(i, sizeof(kInclude) - 1, kInclude) == 0)
+				{
+					i = source.find_first_not_of(" \t", i + sizeof(kInclude) - 1);
+					if (i < lineEnd && (source[i] == '"' || source[i] == '<'))
+					{
+						char close = (source[i] == '"') ? '"' : '>';
+						size_t nameEnd = source.find(close, i + 1);
+						if (nameEnd < lineEnd)
+						{
+							includes.push_back(source.substr(i + 1, nameEnd - i - 1));
+						}
+					}
+				}
+			}
+			lineStart = lineEnd + 1;
+		}
+		return includes;
+	}
+}
+
+ShaderBinary::ShaderBinary(std::vector<uint8_t> bytecode)
+	: m_bytecode(std::move(bytecode))
+{
+	m_data = m_bytecode.data();
+	m_size = m_bytecode.size();
+}
+
+ShaderBinary::ShaderBinary(std::unique_ptr<MappedFile> file, uint64_t offset, uint64_t size)
+	: m_file(std::move(file))
+{
+	if (offset > m_file->GetSize() || size > m_file->GetSize() - offset)
+	{
+		throw std::logic_error("Shader binary out of the bounds of the file");
+	}
+	m_data = m_file->GetData() + offset;
+	m_size = static_cast<size_t>(size);
+}
+
+ShaderCache::ShaderCache(ShaderCompiler& compiler, const std::string& directory)
+	: m_compiler(compiler), m_entries(directory, ".dxil", kShaderCacheMagic, kShaderCacheVersion)
+{
+}
+
+std::shared_ptr<const ShaderBinary> ShaderCache::Get(const ShaderCompileRequest& request, bool* cacheHit)
+{
+	// The stats are only locked to be updated, the threads loading and compiling concurrently
+	auto start = Clock::now();
+	ShaderCacheKey key = ComputeKey(request);
+	double keyMilliseconds = MillisecondsSince(start);
+
+	bool invalid = false;
+	if (m_entries.IsEnabled())
+	{
+		start = Clock::now();
+		std::shared_ptr<const ShaderBinary> binary = LoadEntry(key, invalid);
+		double loadMilliseconds = MillisecondsSince(start);
+
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		m_stats.keyMilliseconds += keyMilliseconds;
+		m_stats.loadMilliseconds += loadMilliseconds;
+		m_stats.invalidEntryCount += invalid ? 1 : 0;
+		if (binary)
+		{
+			m_stats.hitCount++;
+			if (cacheHit)
+			{
+				*cacheHit = true;
+			}
+			return binary;
+		}
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		m_stats.keyMilliseconds += keyMilliseconds;
+	}
+	if (cacheHit)
+	{
+		*cacheHit = false;
+	}
+
+	start = Clock::now();
+	std::vector<uint8_t> bytecode;
+	std::string errors;
+	if (!m_compiler.Compile(request, bytecode, errors))
+	{
+		throw std::runtime_error("Shader compiler error in " + request.fileName + ":\n" + errors);
+	}
+	double compileMilliseconds = MillisecondsSince(start);
+
+	bool written = true;
+	start = Clock::now();
+	if (m_entries.IsEnabled())
+	{
+		written = m_entries.Write(key, bytecode.data(), bytecode.size());
+	}
+	double writeMilliseconds = MillisecondsSince(start);
+
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		m_stats.missCount++;
+		m_stats.compileMilliseconds += compileMilliseconds;
+		m_stats.writeMilliseconds += writeMilliseconds;
+		m_stats.writeFailureCount += written ? 0 : 1;
+	}
+	return std::make_shared<ShaderBinary>(std::move(bytecode));
+}
+
+ShaderCacheKey ShaderCache::ComputeKey(const ShaderCompileRequest& request) const
+{
+	CacheKeyHasher hasher;
+	hasher.AddString(m_compiler.GetVersion());
+	hasher.AddString(request.entryPoint);
+	hasher.AddString(request.targetProfile);
+	for (const std::vector<std::string>* strings : { &request.defines, &request.includeDirectories, &request.arguments })
+	{
+		uint64_t count = strings->size();
+		hasher.AddField(&count, sizeof(count));
+		for (const std::string& value : *strings)
+		{
+			hasher.AddString(value);
+		}
+	}
+
+	// Depth-first walk of the include closure, in the order of the #include lines. The resolved
+	// names are hashed along with the contents, so that moving a file changes the key
+	std::string source;
+	if (!ReadFile(request.fileName, source))
+	{
+		throw std::runtime_error("Cannot read shader file " + request.fileName);
+	}
+	hasher.AddString(request.fileName);
+	hasher.AddString(source);
+
+	struct PendingFile
+	{
+		std::string fileName;
+		std::vector<std::string> includes;
+		size_t next;
+	};
+	std::vector<PendingFile> stack;
+	stack.push_back({ request.fileName, FindIncludes(source), 0 });
+	std::set<std::string> visited = { request.fileName };
+	while (!stack.empty())
+	{
+		PendingFile& file = stack.back();
+		if (file.next == file.includes.size())
+		{
+			stack.pop_back();
+			continue;
+		}
+		const std::string include = file.includes[file.next++];
+
+		// Same lookup order as the compiler: next to the including file, then in the include
+		// directories. Missing files are hashed by name, so that creating them changes the key
+		std::string resolved;
+		std::string content;
+		std::vector<std::string> candidates = { JoinPath(GetDirectory(file.fileName), include) };
+		for (const std::string& directory : request.includeDirectories)
+		{
+			candidates.push_back(JoinPath(directory, include));
+		}
+		for (const std::string& candidate : candidates)
+		{
+			if (ReadFile(candidate, content))
+			{
+				resolved = candidate;
+				break;
+			}
+		}
+		if (resolved.empty())
+		{
+			hasher.AddString("<missing>" + include);
+			continue;
+		}
+		if (!visited.insert(resolved).second)
+		{
+			continue;
+		}
+		if (visited.size() > kMaxClosureFiles)
+		{
+			throw std::runtime_error("Too many files included by " + request.fileName);
+		}
+
+		hasher.AddString(resolved);
+		hasher.AddString(content);
+		stack.push_back({ resolved, FindIncludes(content), 0 });
+	}
+	return hasher.Get();
+}
+
+std::string ShaderCache::GetEntryFileName(const ShaderCacheKey& key) const
+{
+	return m_entries.GetEntryFileName(key);
+}
+
+ShaderCacheStats ShaderCache::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	return m_stats;
+}
+
+void ShaderCache::ResetStats()
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	m_stats = ShaderCacheStats();
+}
+
+std::shared_ptr<const ShaderBinary> ShaderCache::LoadEntry(const ShaderCacheKey& key, bool& invalid) const
+{
+	std::unique_ptr<MappedFile> file = m_entries.Load(key, invalid);
+	if (!file)
+	{
+		return nullptr;
+	}
+	uint64_t offset = CacheDirectory::kDataOffset;
+	uint64_t size = file->GetSize() - offset;
+	return std::make_shared<ShaderBinary>(std::move(file), offset, size);
+}
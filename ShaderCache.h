@@ -0,0 +1,137 @@
+#pragma once
+
+// #DXR Custom: Shader Cache
+// Content-addressed on-disk cache of compiled shaders, so that the DXIL libraries are only
+// compiled when their source changes instead of at every launch. Each compiled shader is stored
+// in its own file, named after the key of the compilation:
+//   <cache directory>/<key in hex>.dxil
+// and mapped when found, the bytecode being handed to the pipeline straight from the mapping.
+//
+// The key is a 128-bit hash of:
+//   - the version of the compiler, so that updating it invalidates the cache
+//   - the target profile, entry point, defines, include directories and arguments
+//   - the name and content of the source file, and of all the files it includes, recursively
+// The include closure is found by scanning the #include lines of each file, and resolving them
+// relative to the including file, then in the include directories. This is a superset of what
+// the preprocessor reads, as the includes disabled by #if blocks are followed too: a change to
+// one of them causes an unnecessary compilation, but never loads an out of date shader. Running
+// the preprocessor instead would cost a large part of the compilation on every launch.
+//
+// The entries are stored through CacheDirectory, which verifies their key and checksum on load.
+// Corrupted entries count as misses, and are replaced.
+//
+// The compiler is reached through the ShaderCompiler interface, implemented with DXC by
+// DxcShaderCompiler, so that the cache can be exercised with a stub compiler without a device.
+//
+// #DXR Custom: Parallel Shader Compilation
+// Get can be called from several threads at once, see ShaderCompileJobs. The compiler must then
+// support concurrent calls to Compile.
+
+#include "CacheDirectory.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+static const uint32_t kShaderCacheMagic = 0x43534D44;	// "DMSC"
+static const uint32_t kShaderCacheVersion = 1;
+
+/// Compilation of a single HLSL file
+struct ShaderCompileRequest
+{
+	std::string fileName;
+	std::string entryPoint;					// Empty for libraries
+	std::string targetProfile;				// For example lib_6_3
+	std::vector<std::string> defines;		// NAME or NAME=VALUE
+	std::vector<std::string> includeDirectories;
+	std::vector<std::string> arguments;		// Other compiler arguments, such as -O3
+};
+
+/// Compiler used by the cache on a miss
+class ShaderCompiler
+{
+public:
+	virtual ~ShaderCompiler() = default;
+
+	/// Identifier of the compiler build, part of the cache keys
+	virtual std::string GetVersion() const = 0;
+	/// Compile a request. Returns false on failure, with the compiler messages in errors. Called
+	/// concurrently when the cache is used from several threads
+	virtual bool Compile(const ShaderCompileRequest& request, std::vector<uint8_t>& bytecode, std::string& errors) = 0;
+};
+
+/// Compiled shader, either mapped from a cache entry or held in memory after a compilation
+class ShaderBinary
+{
+public:
+	explicit ShaderBinary(std::vector<uint8_t> bytecode);
+	ShaderBinary(std::unique_ptr<MappedFile> file, uint64_t offset, uint64_t size);
+
+	ShaderBinary(const ShaderBinary&) = delete;
+	ShaderBinary& operator=(const ShaderBinary&) = delete;
+
+	const void* GetData() const { return m_data; }
+	size_t GetSize() const { return m_size; }
+	bool IsMapped() const { return m_file != nullptr; }
+
+private:
+	std::unique_ptr<MappedFile> m_file;
+	std::vector<uint8_t> m_bytecode;
+	const void* m_data = nullptr;
+	size_t m_size = 0;
+};
+
+using ShaderCacheKey = CacheKey;
+
+struct ShaderCacheStats
+{
+	uint32_t hitCount = 0;
+	uint32_t missCount = 0;
+	uint32_t invalidEntryCount = 0;			// Entries found corrupted, counted as misses
+	uint32_t writeFailureCount = 0;
+	double keyMilliseconds = 0.0;			// Reading and hashing the sources
+	double loadMilliseconds = 0.0;			// Mapping and verifying the entries
+	double compileMilliseconds = 0.0;
+	double writeMilliseconds = 0.0;
+};
+
+class ShaderCache
+{
+public:
+	/// <summary>
+	/// Cache in the given directory, created if missing. An empty directory disables the cache,
+	/// all the shaders are then compiled. The compiler must outlive the cache
+	/// </summary>
+	ShaderCache(ShaderCompiler& compiler, const std::string& directory);
+
+	/// <summary>
+	/// Load the shader from the cache, or compile it and add it to the cache. Throws
+	/// std::runtime_error if the source cannot be read, or with the compiler messages if the
+	/// compilation fails. Failing to write the cache is not an error. cacheHit receives whether the
+	/// shader was loaded from the cache
+	/// </summary>
+	std::shared_ptr<const ShaderBinary> Get(const ShaderCompileRequest& request, bool* cacheHit = nullptr);
+
+	/// <summary>
+	/// Key of a request, from the current content of its files. Throws std::runtime_error if the
+	/// source file cannot be read
+	/// </summary>
+	ShaderCacheKey ComputeKey(const ShaderCompileRequest& request) const;
+	std::string GetEntryFileName(const ShaderCacheKey& key) const;
+
+	ShaderCacheStats GetStats() const;
+	void ResetStats();
+
+private:
+	/// Map and verify an entry, returning nullptr if it is missing or invalid
+	std::shared_ptr<const ShaderBinary> LoadEntry(const ShaderCacheKey& key, bool& invalid) const;
+
+	ShaderCompiler& m_compiler;
+	CacheDirectory m_entries;
+	// The timings are summed over all the threads
+	mutable std::mutex m_statsMutex;
+	ShaderCacheStats m_stats;
+};
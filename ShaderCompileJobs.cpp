@@ -0,0 +1,123 @@
+#include "ShaderCompileJobs.h"
+
+#include <algorithm>
+
+namespace
+{
+	double MillisecondsBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+	{
+		return std::chrono::duration<double, std::milli>(end - start).count();
+	}
+}
+
+ShaderCompileJobs::ShaderCompileJobs(uint32_t threadCount)
+{
+	if (threadCount == 0)
+		threadCount = (std::max)(std::thread::hardware_concurrency(), 1u);
+
+	m_workers.reserve(threadCount);
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		m_workers.emplace_back(&ShaderCompileJobs::WorkerLoop, this, i);
+	}
+}
+
+ShaderCompileJobs::~ShaderCompileJobs()
+{
+	Wait();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_jobAvailable.notify_all();
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+std::shared_future<std::shared_ptr<const ShaderBinary>> ShaderCompileJobs::Load(ShaderCache& cache,
+	const ShaderCompileRequest& request)
+{
+	using Binary = std::shared_ptr<const ShaderBinary>;
+	auto task = std::make_shared<std::packaged_task<Binary(ShaderJobTiming&)>>(
+		[&cache, request](ShaderJobTiming& timing) { return cache.Get(request, &timing.cacheHit); });
+	std::shared_future<Binary> future = task->get_future().share();
+	Enqueue(request.fileName, [task](ShaderJobTiming& timing) { (*task)(timing); });
+	return future;
+}
+
+void ShaderCompileJobs::Wait()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_jobsDone.wait(lock, [&]() { return m_pendingJobCount == 0; });
+}
+
+std::vector<ShaderJobTiming> ShaderCompileJobs::GetTimings() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::vector<ShaderJobTiming> timings;
+	for (size_t i = 0; i < m_timings.size(); i++)
+	{
+		if (m_completed[i])
+		{
+			timings.push_back(m_timings[i]);
+		}
+	}
+	return timings;
+}
+
+void ShaderCompileJobs::Enqueue(const std::string& name, JobFunction function)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Job job;
+		job.index = static_cast<uint32_t>(m_timings.size());
+		job.function = std::move(function);
+		job.submitTime = std::chrono::steady_clock::now();
+		m_jobs.push_back(std::move(job));
+
+		ShaderJobTiming timing;
+		timing.name = name;
+		m_timings.push_back(timing);
+		m_completed.push_back(false);
+		m_pendingJobCount++;
+	}
+	m_jobAvailable.notify_one();
+}
+
+void ShaderCompileJobs::WorkerLoop(uint32_t threadIndex)
+{
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobAvailable.wait(lock, [&]() { return m_stop || !m_jobs.empty(); });
+			if (m_jobs.empty())
+			{
+				return;
+			}
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+
+		// The timing is filled outside of the lock, and only published once the job is complete
+		ShaderJobTiming timing;
+		auto start = std::chrono::steady_clock::now();
+		job.function(timing);
+		auto end = std::chrono::steady_clock::now();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		ShaderJobTiming& stored = m_timings[job.index];
+		stored.threadIndex = threadIndex;
+		stored.cacheHit = timing.cacheHit;
+		stored.queuedMilliseconds = MillisecondsBetween(job.submitTime, start);
+		stored.runMilliseconds = MillisecondsBetween(start, end);
+		m_completed[job.index] = true;
+		if (--m_pendingJobCount == 0)
+		{
+			m_jobsDone.notify_all();
+		}
+	}
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+// #DXR Custom: Parallel Shader Compilation
+// Runs the shader compilations of the startup as asynchronous jobs on a set of worker threads,
+// so that the shaders are compiled concurrently with each other and with the rest of the
+// initialization. Each job returns a future: the code assembling a pipeline only waits for the
+// shaders it uses, when it needs them. The compiler errors are rethrown by the futures.
+//
+// The jobs are independent and started in submission order; dependencies are expressed by the
+// waits on the futures outside of the jobs, never inside them, so that a worker cannot block on
+// a job queued behind it.
+
+#include "ShaderCache.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Timings of a completed job
+struct ShaderJobTiming
+{
+	std::string name;
+	uint32_t threadIndex = 0;				// Worker which ran the job
+	bool cacheHit = false;					// Loads from the shader cache only
+	double queuedMilliseconds = 0.0;		// From the submission to the start of the job
+	double runMilliseconds = 0.0;
+};
+
+class ShaderCompileJobs
+{
+public:
+	/// <summary>
+	/// Start the workers. 0 selects std::thread::hardware_concurrency()
+	/// </summary>
+	explicit ShaderCompileJobs(uint32_t threadCount = 0);
+	/// <summary>
+	/// Wait for the queued jobs, and stop the workers
+	/// </summary>
+	~ShaderCompileJobs();
+
+	ShaderCompileJobs(const ShaderCompileJobs&) = delete;
+	ShaderCompileJobs& operator=(const ShaderCompileJobs&) = delete;
+
+	/// <summary>
+	/// Queue a load from the shader cache, see ShaderCache::Get. The cache must outlive the job
+	/// </summary>
+	std::shared_future<std::shared_ptr<const ShaderBinary>> Load(ShaderCache& cache, const ShaderCompileRequest& request);
+
+	/// <summary>
+	/// Queue any other job, such as a compilation with another compiler
+	/// </summary>
+	template <typename Result>
+	std::shared_future<Result> Run(const std::string& name, std::function<Result()> job)
+	{
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::move(job));
+		std::shared_future<Result> future = task->get_future().share();
+		Enqueue(name, [task](ShaderJobTiming&) { (*task)(); });
+		return future;
+	}
+
+	/// <summary>
+	/// Wait until all the queued jobs are complete
+	/// </summary>
+	void Wait();
+
+	uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_workers.size()); }
+	/// <summary>
+	/// Timings of the completed jobs, in submission order. A future can be ready shortly before
+	/// the timing of its job, hence Wait first to get all of them
+	/// </summary>
+	std::vector<ShaderJobTiming> GetTimings() const;
+
+private:
+	/// Job body, filling the fields of the timing it knows about. Exceptions are caught by the
+	/// packaged tasks, and never reach the workers
+	using JobFunction = std::function<void(ShaderJobTiming&)>;
+
+	struct Job
+	{
+		uint32_t index;						// In m_timings
+		JobFunction function;
+		std::chrono::steady_clock::time_point submitTime;
+	};
+
+	void Enqueue(const std::string& name, JobFunction function);
+	void WorkerLoop(uint32_t threadIndex);
+
+	std::vector<std::thread> m_workers;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_jobAvailable;
+	std::condition_variable m_jobsDone;
+	std::deque<Job> m_jobs;
+	uint32_t m_pendingJobCount = 0;			// Queued or running
+	bool m_stop = false;
+	std::vector<ShaderJobTiming> m_timings;
+	std::vector<bool> m_completed;
+};
@@ -0,0 +1,249 @@
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+	/// Move the elements of values to their new positions
+	template <typename T>
+	void Permute(std::vector<T>& values, const std::vector<uint32_t>& newPositions)
+	{
+		std::vector<T> permuted(values.size());
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			permuted[newPositions[i]] = values[i];
+		}
+		values.swap(permuted);
+	}
+}
+
+uint32_t TransformHierarchy::AddNode(uint32_t parent, const XMMATRIX& localTransform)
+{
+	uint32_t level = 0;
+	uint32_t parentPosition = kNoParent;
+	if (parent != kNoParent)
+	{
+		CheckNode(parent);
+		level = m_levels[parent] + 1;
+		parentPosition = m_positions[parent];
+	}
+
+	// The node is appended, and moved to its level on the next Update
+	uint32_t node = GetNodeCount();
+	XMFLOAT4X4 transform;
+	XMStoreFloat4x4(&transform, localTransform);
+	m_localTransforms.push_back(transform);
+	m_worldTransforms.push_back(transform);
+	m_parentPositions.push_back(parentPosition);
+	m_nodes.push_back(node);
+	m_localChanged.push_back(1);
+	m_worldChanged.push_back(0);
+	m_positions.push_back(node);
+	m_levels.push_back(level);
+
+	if (level >= GetLevelCount())
+	{
+		m_levelLocalChanged.resize(level + 1, 0);
+		m_levelChanged.resize(level + 1, 0);
+	}
+	m_levelLocalChanged[level] = 1;
+	m_sorted = false;
+	return node;
+}
+
+void TransformHierarchy::Clear()
+{
+	m_localTransforms.clear();
+	m_worldTransforms.clear();
+	m_parentPositions.clear();
+	m_nodes.clear();
+	m_localChanged.clear();
+	m_worldChanged.clear();
+	m_positions.clear();
+	m_levels.clear();
+	m_levelStarts.clear();
+	m_levelLocalChanged.clear();
+	m_levelChanged.clear();
+	m_changedNodes.clear();
+	m_sorted = true;
+}
+
+uint32_t TransformHierarchy::GetParent(uint32_t node) const
+{
+	CheckNode(node);
+	uint32_t parentPosition = m_parentPositions[m_positions[node]];
+	return parentPosition == kNoParent ? kNoParent : m_nodes[parentPosition];
+}
+
+void TransformHierarchy::SetLocalTransform(uint32_t node, const XMMATRIX& localTransform)
+{
+	CheckNode(node);
+	uint32_t position = m_positions[node];
+	XMStoreFloat4x4(&m_localTransforms[position], localTransform);
+	m_localChanged[position] = 1;
+	m_levelLocalChanged[m_levels[node]] = 1;
+}
+
+XMMATRIX TransformHierarchy::GetLocalTransform(uint32_t node) const
+{
+	CheckNode(node);
+	return XMLoadFloat4x4(&m_localTransforms[m_positions[node]]);
+}
+
+XMMATRIX TransformHierarchy::GetWorldTransform(uint32_t node) const
+{
+	CheckNode(node);
+	return XMLoadFloat4x4(&m_worldTransforms[m_positions[node]]);
+}
+
+uint32_t TransformHierarchy::Update(const TransformUpdateOptions& options, TransformUpdateStats* stats)
+{
+	auto start = std::chrono::steady_clock::now();
+	if (!m_sorted)
+	{
+		SortByLevel();
+	}
+
+	uint32_t threadCount = options.threadCount;
+	if (threadCount == 0)
+		threadCount = (std::max)(std::thread::hardware_concurrency(), 1u);
+	if (!m_threadPool || m_threadPool->GetThreadCount() != threadCount)
+		m_threadPool.reset(new nv_helpers_dx12::ThreadPool(threadCount));
+
+	uint32_t updatedCount = 0;
+	uint32_t skippedLevelCount = 0;
+	for (uint32_t level = 0; level < GetLevelCount(); level++)
+	{
+		const uint32_t begin = m_levelStarts[level];
+		const uint32_t end = m_levelStarts[level + 1];
+
+		// Nothing to recompute: the flags left by the previous Update are cleared, since the next
+		// level reads those of its parents
+		bool parentsChanged = (level > 0) && m_levelChanged[level - 1];
+		if (!m_levelLocalChanged[level] && !parentsChanged)
+		{
+			if (m_levelChanged[level])
+			{
+				memset(m_worldChanged.data() + begin, 0, end - begin);
+				m_levelChanged[level] = 0;
+			}
+			skippedLevelCount++;
+			continue;
+		}
+
+		// The parents belong to the previous levels, which are complete
+		std::atomic<uint32_t> levelUpdatedCount(0);
+		m_threadPool->ParallelFor(end - begin, options.grainSize,
+			[&](uint32_t rangeBegin, uint32_t rangeEnd, uint32_t /*threadIndex*/)
+		{
+			uint32_t rangeUpdatedCount = 0;
+			for (uint32_t position = begin + rangeBegin; position < begin + rangeEnd; position++)
+			{
+				uint32_t parentPosition = m_parentPositions[position];
+				bool changed = m_localChanged[position] ||
+					(parentPosition != kNoParent && m_worldChanged[parentPosition]);
+				m_worldChanged[position] = changed;
+				if (!changed)
+				{
+					continue;
+				}
+
+				XMMATRIX world = XMLoadFloat4x4(&m_localTransforms[position]);
+				if (parentPosition != kNoParent)
+				{
+					world = XMMatrixMultiply(world, XMLoadFloat4x4(&m_worldTransforms[parentPosition]));
+				}
+				XMStoreFloat4x4(&m_worldTransforms[position], world);
+				m_localChanged[position] = 0;
+				rangeUpdatedCount++;
+			}
+			levelUpdatedCount += rangeUpdatedCount;
+		});
+
+		m_levelLocalChanged[level] = 0;
+		m_levelChanged[level] = (levelUpdatedCount > 0);
+		updatedCount += levelUpdatedCount;
+	}
+
+	m_changedNodes.clear();
+	for (uint32_t level = 0; level < GetLevelCount(); level++)
+	{
+		if (!m_levelChanged[level])
+		{
+			continue;
+		}
+		for (uint32_t position = m_levelStarts[level]; position < m_levelStarts[level + 1]; position++)
+		{
+			if (m_worldChanged[position])
+			{
+				m_changedNodes.push_back(m_nodes[position]);
+			}
+		}
+	}
+	std::sort(m_changedNodes.begin(), m_changedNodes.end());
+
+	if (stats)
+	{
+		stats->nodeCount = GetNodeCount();
+		stats->levelCount = GetLevelCount();
+		stats->updatedNodeCount = updatedCount;
+		stats->skippedLevelCount = skippedLevelCount;
+		stats->threadCount = threadCount;
+		stats->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+	return updatedCount;
+}
+
+void TransformHierarchy::CheckNode(uint32_t node) const
+{
+	if (node >= GetNodeCount())
+	{
+		throw std::logic_error("Transform node out of range");
+	}
+}
+
+void TransformHierarchy::SortByLevel()
+{
+	// Counting sort of the positions by level, stable so that the nodes of a level keep their order
+	const uint32_t levelCount = GetLevelCount();
+	m_levelStarts.assign(levelCount + 1, 0);
+	for (uint32_t node : m_nodes)
+	{
+		m_levelStarts[m_levels[node] + 1]++;
+	}
+	for (uint32_t level = 0; level < levelCount; level++)
+	{
+		m_levelStarts[level + 1] += m_levelStarts[level];
+	}
+
+	std::vector<uint32_t> newPositions(m_nodes.size());
+	std::vector<uint32_t> next(m_levelStarts.begin(), m_levelStarts.end() - 1);
+	for (size_t position = 0; position < m_nodes.size(); position++)
+	{
+		newPositions[position] = next[m_levels[m_nodes[position]]]++;
+	}
+
+	for (uint32_t& parentPosition : m_parentPositions)
+	{
+		if (parentPosition != kNoParent)
+		{
+			parentPosition = newPositions[parentPosition];
+		}
+	}
+	Permute(m_localTransforms, newPositions);
+	Permute(m_worldTransforms, newPositions);
+	Permute(m_parentPositions, newPositions);
+	Permute(m_nodes, newPositions);
+	Permute(m_localChanged, newPositions);
+	Permute(m_worldChanged, newPositions);
+	for (size_t position = 0; position < m_nodes.size(); position++)
+	{
+		m_positions[m_nodes[position]] = static_cast<uint32_t>(position);
+	}
+	m_sorted = true;
+}
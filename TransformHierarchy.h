@@ -0,0 +1,107 @@
+#pragma once
+
+// #DXR Custom: Transform Hierarchy
+// Parent/child hierarchy of transforms. Each node has a local transform relative to its parent,
+// and its world transform is local * parentWorld, in the row vector convention of DirectXMath.
+//
+// The nodes are stored in topological order, sorted by level (depth in the hierarchy), so that the
+// world transforms of a level only depend on those of the previous levels. Update propagates the
+// transforms one level at a time, the nodes of a level being processed in parallel. Only the
+// nodes whose local transform changed, or whose parent world transform changed, are recomputed:
+// a level without any of them is skipped entirely, along with the unchanged subtrees below it.
+//
+// Node identifiers are given in creation order and never change. A node can only be attached to
+// an existing node, which keeps the hierarchy acyclic.
+
+#include "VertexTypes.h"
+#include "nv_helpers_dx12/ThreadPool.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct TransformUpdateOptions
+{
+	uint32_t threadCount = 0;				// 0 selects std::thread::hardware_concurrency()
+	uint32_t grainSize = 1024;				// Nodes per task. Smaller levels are processed inline
+};
+
+struct TransformUpdateStats
+{
+	uint32_t nodeCount = 0;
+	uint32_t levelCount = 0;
+	uint32_t updatedNodeCount = 0;			// Nodes whose world transform was recomputed
+	uint32_t skippedLevelCount = 0;			// Levels without any change
+	uint32_t threadCount = 0;
+	double milliseconds = 0.0;
+};
+
+class TransformHierarchy
+{
+public:
+	static const uint32_t kNoParent = 0xFFFFFFFFu;
+
+	/// <summary>
+	/// Add a node, as a root if parent is kNoParent. Returns its identifier. Throws
+	/// std::logic_error if the parent does not exist
+	/// </summary>
+	uint32_t AddNode(uint32_t parent, const XMMATRIX& localTransform);
+
+	void Clear();
+
+	uint32_t GetNodeCount() const { return static_cast<uint32_t>(m_positions.size()); }
+	uint32_t GetLevelCount() const { return static_cast<uint32_t>(m_levelChanged.size()); }
+	uint32_t GetParent(uint32_t node) const;
+
+	/// <summary>
+	/// Set the transform of a node relative to its parent. The world transforms of the node and of
+	/// its subtree are recomputed on the next Update. Throws std::logic_error if the node does not exist
+	/// </summary>
+	void SetLocalTransform(uint32_t node, const XMMATRIX& localTransform);
+	XMMATRIX GetLocalTransform(uint32_t node) const;
+
+	/// <summary>
+	/// World transform of a node, as of the last Update
+	/// </summary>
+	XMMATRIX GetWorldTransform(uint32_t node) const;
+
+	/// <summary>
+	/// Recompute the world transforms of the changed nodes and of their subtrees. Returns the
+	/// number of nodes whose world transform was recomputed
+	/// </summary>
+	uint32_t Update(const TransformUpdateOptions& options = {}, TransformUpdateStats* stats = nullptr);
+
+	/// <summary>
+	/// Nodes whose world transform was recomputed by the last Update, in increasing order
+	/// </summary>
+	const std::vector<uint32_t>& GetChangedNodes() const { return m_changedNodes; }
+
+private:
+	void CheckNode(uint32_t node) const;
+	/// Reorder the nodes by level after nodes were added
+	void SortByLevel();
+
+	// Per position, in level order
+	std::vector<XMFLOAT4X4> m_localTransforms;
+	std::vector<XMFLOAT4X4> m_worldTransforms;
+	std::vector<uint32_t> m_parentPositions;	// kNoParent for the roots
+	std::vector<uint32_t> m_nodes;				// Identifier of the node at each position
+	std::vector<uint8_t> m_localChanged;
+	std::vector<uint8_t> m_worldChanged;		// Set by the last Update
+
+	// Per node identifier
+	std::vector<uint32_t> m_positions;
+	std::vector<uint32_t> m_levels;
+
+	// Per level: first position, with one extra entry for the end, and whether a local transform
+	// changed since the last Update, or a world transform changed during it
+	std::vector<uint32_t> m_levelStarts;
+	std::vector<uint8_t> m_levelLocalChanged;
+	std::vector<uint8_t> m_levelChanged;
+	bool m_sorted = true;
+
+	std::vector<uint32_t> m_changedNodes;
+
+	// Kept from update to update, and recreated when the requested thread count changes
+	std::unique_ptr<nv_helpers_dx12::ThreadPool> m_threadPool;
+};
@@ -0,0 +1,56 @@
+// #DXR Custom: Packed Vertices
+// Vertex buffer of the hit geometry, either in the float layout of STriVertex or packed
+// (see VertexPacking.h). Its layout is given by the mesh format constants of the hit group record.
+
+StructuredBuffer<int> indices : register(t1);
+ByteAddressBuffer BTriVertex : register(t0);
+
+cbuffer MeshFormat : register(b0)
+{
+    // Object-space transform of the packed positions, identity for the float layout
+    row_major float3x4 dequantization;
+    uint vertexFormat;
+    uint vertexStride;
+}
+
+// Values of VertexPositionFormat
+static const uint VERTEX_FORMAT_FLOAT32 = 0;
+static const uint VERTEX_FORMAT_SNORM16 = 1;
+static const uint VERTEX_FORMAT_FLOAT16 = 2;
+
+// Object-space position of a vertex
+float3 FetchVertexPosition(uint index)
+{
+    uint address = index * vertexStride;
+    if (vertexFormat == VERTEX_FORMAT_FLOAT32)
+    {
+        return asfloat(BTriVertex.Load3(address));
+    }
+
+    uint2 bits = BTriVertex.Load2(address);
+    float3 position;
+    if (vertexFormat == VERTEX_FORMAT_SNORM16)
+    {
+        // Sign-extend the 16-bit lanes. As for the input assembler, -32768 and -32767 map to -1
+        int3 values = int3(int(bits.x << 16) >> 16, int(bits.x) >> 16, int(bits.y << 16) >> 16);
+        position = max(float3(values) / 32767.0f, -1.0f);
+    }
+    else
+    {
+        position = f16tof32(uint3(bits.x, bits.x >> 16, bits.y));
+    }
+    return mul(dequantization, float4(position, 1.0f));
+}
+
+float4 FetchVertexColor(uint index)
+{
+    uint address = index * vertexStride;
+    if (vertexFormat == VERTEX_FORMAT_FLOAT32)
+    {
+        return asfloat(BTriVertex.Load4(address + 12));
+    }
+
+    // RGBA8, red in the low byte
+    uint color = BTriVertex.Load(address + 8);
+    return float4(color & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff, color >> 24) / 255.0f;
+}
@@ -0,0 +1,345 @@
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define VERTEX_PACKING_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	const float kSnorm16Max = 32767.0f;
+	const float kUnorm8Max = 255.0f;
+	// Added to the bits of a float to rebias its exponent to the one of a half: (15 - 127) << 23
+	const uint32_t kHalfExponentRebias = 0u - (112u << 23);
+
+	uint32_t FloatBits(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	float BitsToFloat(uint32_t bits)
+	{
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+#if VERTEX_PACKING_SSE2
+	__m128 ClampSSE(__m128 value, __m128 low, __m128 high)
+	{
+		return _mm_min_ps(_mm_max_ps(value, low), high);
+	}
+
+	/// Same rounding as VertexPacking::FloatToHalf, for finite values below 65504 in magnitude
+	__m128i FloatToHalfSSE(__m128 value)
+	{
+		const __m128i signMask = _mm_set1_epi32(static_cast<int>(0x80000000u));
+		__m128i bits = _mm_castps_si128(value);
+		__m128i sign = _mm_and_si128(bits, signMask);
+		__m128i absolute = _mm_xor_si128(bits, sign);
+
+		// Values too small to be normal halfs: adding 0.5 aligns the bits to the denormal step,
+		// and the hardware rounds to nearest even
+		__m128 denormal = _mm_add_ps(_mm_castsi128_ps(absolute), _mm_set1_ps(0.5f));
+		__m128i denormalHalf = _mm_sub_epi32(_mm_castps_si128(denormal), _mm_set1_epi32(0x3f000000));
+
+		// Normal halfs: rebias the exponent and round the mantissa to nearest even
+		__m128i odd = _mm_and_si128(_mm_srli_epi32(absolute, 13), _mm_set1_epi32(1));
+		__m128i normal = _mm_add_epi32(absolute, _mm_set1_epi32(static_cast<int>(kHalfExponentRebias + 0xfff)));
+		__m128i normalHalf = _mm_srli_epi32(_mm_add_epi32(normal, odd), 13);
+
+		__m128i isDenormal = _mm_cmplt_epi32(absolute, _mm_set1_epi32(0x38800000));
+		__m128i half = _mm_or_si128(_mm_and_si128(isDenormal, denormalHalf), _mm_andnot_si128(isDenormal, normalHalf));
+		return _mm_or_si128(half, _mm_srli_epi32(sign, 16));
+	}
+
+	/// Convert halfs zero-extended to 32 bits, including denormals, infinities and NaNs
+	__m128 HalfToFloatSSE(__m128i half)
+	{
+		__m128i exponentMantissa = _mm_and_si128(half, _mm_set1_epi32(0x7fff));
+		__m128i sign = _mm_slli_epi32(_mm_xor_si128(half, exponentMantissa), 16);
+
+		// Scaling by 2^112 rebiases the exponent of normal values and normalizes denormal ones
+		__m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(exponentMantissa, 13)),
+			_mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+		__m128i isInfinityOrNaN = _mm_cmpgt_epi32(exponentMantissa, _mm_set1_epi32(0x7bff));
+		__m128i infinityExponent = _mm_and_si128(isInfinityOrNaN, _mm_set1_epi32(255 << 23));
+		return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infinityExponent)));
+	}
+
+	/// Pack the 4 lanes of 32-bit integers in [-32768, 65535] to 16 bits
+	__m128i PackTo16SSE(__m128i value)
+	{
+		// Sign-extending the low 16 bits avoids the saturation of _mm_packs_epi32
+		__m128i extended = _mm_srai_epi32(_mm_slli_epi32(value, 16), 16);
+		return _mm_packs_epi32(extended, extended);
+	}
+#else
+	float Clamp(float value, float low, float high)
+	{
+		// Written so that NaN maps to the lower bound, as _mm_max_ps does
+		return (std::min)(value > low ? value : low, high);
+	}
+#endif
+}
+
+void VertexQuantization::GetTransform3x4(float matrix[12]) const
+{
+	const float transform[12] =
+	{
+		scale.x, 0.0f, 0.0f, offset.x,
+		0.0f, scale.y, 0.0f, offset.y,
+		0.0f, 0.0f, scale.z, offset.z
+	};
+	memcpy(matrix, transform, sizeof(transform));
+}
+
+XMMATRIX VertexQuantization::GetMatrix() const
+{
+	return XMMatrixScaling(scale.x, scale.y, scale.z) * XMMatrixTranslation(offset.x, offset.y, offset.z);
+}
+
+VertexQuantization VertexPacking::ComputeQuantization(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax)
+{
+	float halfExtent[3] =
+	{
+		0.5f * (boundsMax.x - boundsMin.x),
+		0.5f * (boundsMax.y - boundsMin.y),
+		0.5f * (boundsMax.z - boundsMin.z)
+	};
+	float largest = (std::max)((std::max)(halfExtent[0], halfExtent[1]), halfExtent[2]);
+	float smallest = largest > 0.0f ? largest * 1e-6f : 1.0f;
+
+	VertexQuantization quantization;
+	quantization.scale = { (std::max)(halfExtent[0], smallest), (std::max)(halfExtent[1], smallest),
+		(std::max)(halfExtent[2], smallest) };
+	quantization.offset = { 0.5f * (boundsMin.x + boundsMax.x), 0.5f * (boundsMin.y + boundsMax.y),
+		0.5f * (boundsMin.z + boundsMax.z) };
+	return quantization;
+}
+
+void VertexPacking::Encode(const Vertex* vertices, uint32_t vertexCount, PackedVertex* packed,
+	VertexPositionFormat format, const VertexQuantization& quantization)
+{
+	const float inverseScale[3] =
+	{
+		1.0f / quantization.scale.x, 1.0f / quantization.scale.y, 1.0f / quantization.scale.z
+	};
+	const bool snorm = format == VertexPositionFormat::Snorm16;
+
+#if VERTEX_PACKING_SSE2
+	// One vertex per iteration: the position and the color each fill a register. The padding lane
+	// of the position is forced to 1 before the conversion
+	const __m128 offset = _mm_setr_ps(quantization.offset.x, quantization.offset.y, quantization.offset.z, 0.0f);
+	const __m128 scale = _mm_setr_ps(inverseScale[0], inverseScale[1], inverseScale[2], 0.0f);
+	const __m128 padding = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+	const __m128 minusOne = _mm_set1_ps(-1.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 snormMax = _mm_set1_ps(kSnorm16Max);
+	const __m128 unormMax = _mm_set1_ps(kUnorm8Max);
+
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		const Vertex& vertex = vertices[i];
+		__m128 position = _mm_setr_ps(vertex.position.x, vertex.position.y, vertex.position.z, 0.0f);
+		position = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(position, offset), scale), padding);
+		position = ClampSSE(position, minusOne, one);
+
+		__m128i positionBits = snorm ? _mm_cvtps_epi32(_mm_mul_ps(position, snormMax)) : FloatToHalfSSE(position);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(packed[i].position), PackTo16SSE(positionBits));
+
+		__m128 color = ClampSSE(_mm_loadu_ps(&vertex.color.x), zero, one);
+		__m128i colorBits = _mm_cvtps_epi32(_mm_mul_ps(color, unormMax));
+		colorBits = _mm_packs_epi32(colorBits, colorBits);
+		packed[i].color = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(colorBits, colorBits)));
+	}
+#else
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		const Vertex& vertex = vertices[i];
+		const float position[4] =
+		{
+			Clamp((vertex.position.x - quantization.offset.x) * inverseScale[0], -1.0f, 1.0f),
+			Clamp((vertex.position.y - quantization.offset.y) * inverseScale[1], -1.0f, 1.0f),
+			Clamp((vertex.position.z - quantization.offset.z) * inverseScale[2], -1.0f, 1.0f),
+			1.0f
+		};
+		for (int c = 0; c < 4; c++)
+		{
+			// lrintf rounds to nearest even, as the SSE conversion
+			packed[i].position[c] = snorm ? static_cast<uint16_t>(static_cast<int16_t>(lrintf(position[c] * kSnorm16Max)))
+				: FloatToHalf(position[c]);
+		}
+
+		const float color[4] = { vertex.color.x, vertex.color.y, vertex.color.z, vertex.color.w };
+		uint32_t packedColor = 0;
+		for (int c = 0; c < 4; c++)
+		{
+			packedColor |= static_cast<uint32_t>(lrintf(Clamp(color[c], 0.0f, 1.0f) * kUnorm8Max)) << (8 * c);
+		}
+		packed[i].color = packedColor;
+	}
+#endif
+}
+
+void VertexPacking::Decode(const PackedVertex* packed, uint32_t vertexCount, Vertex* vertices,
+	VertexPositionFormat format, const VertexQuantization& quantization)
+{
+	const bool snorm = format == VertexPositionFormat::Snorm16;
+
+#if VERTEX_PACKING_SSE2
+	const __m128 offset = _mm_setr_ps(quantization.offset.x, quantization.offset.y, quantization.offset.z, 0.0f);
+	const __m128 scale = _mm_setr_ps(quantization.scale.x, quantization.scale.y, quantization.scale.z, 0.0f);
+	const __m128 minusOne = _mm_set1_ps(-1.0f);
+	const __m128 snormMax = _mm_set1_ps(kSnorm16Max);
+	const __m128 unormMax = _mm_set1_ps(kUnorm8Max);
+	const __m128i zero = _mm_setzero_si128();
+
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		__m128i positionBits = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(packed[i].position));
+		__m128 position;
+		if (snorm)
+		{
+			// The GPU maps -32768 and -32767 to -1
+			__m128i extended = _mm_srai_epi32(_mm_unpacklo_epi16(positionBits, positionBits), 16);
+			position = _mm_max_ps(_mm_div_ps(_mm_cvtepi32_ps(extended), snormMax), minusOne);
+		}
+		else
+		{
+			position = HalfToFloatSSE(_mm_unpacklo_epi16(positionBits, zero));
+		}
+		position = _mm_add_ps(_mm_mul_ps(position, scale), offset);
+
+		float lanes[4];
+		_mm_storeu_ps(lanes, position);
+		vertices[i].position = { lanes[0], lanes[1], lanes[2] };
+
+		__m128i colorBits = _mm_cvtsi32_si128(static_cast<int>(packed[i].color));
+		colorBits = _mm_unpacklo_epi16(_mm_unpacklo_epi8(colorBits, zero), zero);
+		_mm_storeu_ps(&vertices[i].color.x, _mm_div_ps(_mm_cvtepi32_ps(colorBits), unormMax));
+	}
+#else
+	const float scale[3] = { quantization.scale.x, quantization.scale.y, quantization.scale.z };
+	const float offset[3] = { quantization.offset.x, quantization.offset.y, quantization.offset.z };
+
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		float position[3];
+		for (int c = 0; c < 3; c++)
+		{
+			float value = snorm ? (std::max)(static_cast<int16_t>(packed[i].position[c]) / kSnorm16Max, -1.0f)
+				: HalfToFloat(packed[i].position[c]);
+			position[c] = value * scale[c] + offset[c];
+		}
+		vertices[i].position = { position[0], position[1], position[2] };
+
+		float color[4];
+		for (int c = 0; c < 4; c++)
+		{
+			color[c] = static_cast<float>((packed[i].color >> (8 * c)) & 0xff) / kUnorm8Max;
+		}
+		vertices[i].color = { color[0], color[1], color[2], color[3] };
+	}
+#endif
+}
+
+VertexPackingError VertexPacking::MeasureError(const Vertex* vertices, const PackedVertex* packed, uint32_t vertexCount,
+	VertexPositionFormat format, const VertexQuantization& quantization)
+{
+	VertexPackingError error;
+	error.sizeInBytes = static_cast<uint64_t>(vertexCount) * sizeof(Vertex);
+	error.packedSizeInBytes = static_cast<uint64_t>(vertexCount) * sizeof(PackedVertex);
+	if (vertexCount == 0)
+	{
+		return error;
+	}
+
+	// Decoded by blocks, to measure what the GPU reads without allocating a copy of the mesh
+	const uint32_t kBlockSize = 256;
+	Vertex decoded[kBlockSize];
+	double squaredErrorSum = 0.0;
+	float maxSquaredError = 0.0f;
+	XMFLOAT3 boundsMin = vertices[0].position;
+	XMFLOAT3 boundsMax = vertices[0].position;
+
+	for (uint32_t first = 0; first < vertexCount; first += kBlockSize)
+	{
+		uint32_t count = (std::min)(kBlockSize, vertexCount - first);
+		Decode(packed + first, count, decoded, format, quantization);
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const Vertex& original = vertices[first + i];
+			float dx = decoded[i].position.x - original.position.x;
+			float dy = decoded[i].position.y - original.position.y;
+			float dz = decoded[i].position.z - original.position.z;
+			float squaredError = dx * dx + dy * dy + dz * dz;
+			squaredErrorSum += squaredError;
+			maxSquaredError = (std::max)(maxSquaredError, squaredError);
+
+			error.maxColorError = (std::max)(error.maxColorError, (std::max)(
+				(std::max)(std::fabs(decoded[i].color.x - original.color.x), std::fabs(decoded[i].color.y - original.color.y)),
+				(std::max)(std::fabs(decoded[i].color.z - original.color.z), std::fabs(decoded[i].color.w - original.color.w))));
+
+			boundsMin = { (std::min)(boundsMin.x, original.position.x), (std::min)(boundsMin.y, original.position.y),
+				(std::min)(boundsMin.z, original.position.z) };
+			boundsMax = { (std::max)(boundsMax.x, original.position.x), (std::max)(boundsMax.y, original.position.y),
+				(std::max)(boundsMax.z, original.position.z) };
+		}
+	}
+
+	error.maxPositionError = std::sqrt(maxSquaredError);
+	error.rmsPositionError = static_cast<float>(std::sqrt(squaredErrorSum / vertexCount));
+	float dx = boundsMax.x - boundsMin.x;
+	float dy = boundsMax.y - boundsMin.y;
+	float dz = boundsMax.z - boundsMin.z;
+	float diagonal = std::sqrt(dx * dx + dy * dy + dz * dz);
+	error.relativePositionError = diagonal > 0.0f ? error.maxPositionError / diagonal : 0.0f;
+	return error;
+}
+
+uint16_t VertexPacking::FloatToHalf(float value)
+{
+	uint32_t bits = FloatBits(value);
+	uint32_t sign = bits & 0x80000000u;
+	bits ^= sign;
+
+	uint32_t half;
+	if (bits >= 0x47800000u)
+	{
+		// Too large for a half, infinity or NaN
+		half = bits > 0x7f800000u ? 0x7e00u : 0x7c00u;
+	}
+	else if (bits < 0x38800000u)
+	{
+		// Denormal half or zero
+		half = FloatBits(BitsToFloat(bits) + 0.5f) - 0x3f000000u;
+	}
+	else
+	{
+		uint32_t odd = (bits >> 13) & 1;
+		half = (bits + kHalfExponentRebias + 0xfffu + odd) >> 13;
+	}
+	return static_cast<uint16_t>(half | (sign >> 16));
+}
+
+float VertexPacking::HalfToFloat(uint16_t value)
+{
+	uint32_t exponentMantissa = value & 0x7fffu;
+	uint32_t sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+	float scaled = BitsToFloat(exponentMantissa << 13) * BitsToFloat((254 - 15) << 23);
+	uint32_t bits = FloatBits(scaled) | sign;
+	if (exponentMantissa > 0x7bffu)
+	{
+		bits |= 255u << 23;
+	}
+	return BitsToFloat(bits);
+}
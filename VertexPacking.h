@@ -0,0 +1,101 @@
+#pragma once
+
+// #DXR Custom: Packed Vertices
+// Compact GPU layout of the Vertex structure: 12 bytes instead of 28, to reduce the memory and
+// bandwidth used by the vertex buffers of large meshes in the raster and raytracing paths. The
+// packed vertices take 43% of the memory of the float ones, a saving of 57%.
+//
+// PackedVertex layout:
+//   uint16_t position[4]  x, y, z as snorm16 or fp16, and a padding lane storing 1
+//                         (DXGI_FORMAT_R16G16B16A16_SNORM or DXGI_FORMAT_R16G16B16A16_FLOAT)
+//   uint32_t color        RGBA8 unorm, red in the low byte (DXGI_FORMAT_R8G8B8A8_UNORM)
+//
+// The positions are quantized in the bounding box of the mesh, mapped to [-1, 1] on each axis.
+// The VertexQuantization of the mesh brings them back to object space: it is given to the BLAS
+// builder as the geometry transform, folded into the instance matrices of the raster path, and
+// applied by the hit shaders when they fetch vertices. The padding lane lets the vertex shader
+// read the position as a float4 with w = 1, as with the float layout.
+//
+// The encode and decode kernels process 4 vertices at a time with SSE2 on x64, and fall back to
+// scalar code elsewhere. Both paths produce the same bits.
+
+#include "VertexTypes.h"
+
+#include <cstdint>
+
+/// Storage of the vertex positions on the GPU
+enum class VertexPositionFormat : uint32_t
+{
+	Float32 = 0,	// Vertex layout, not packed
+	Snorm16 = 1,	// 16-bit fixed point in the bounding box: uniform precision of extent / 65534
+	Float16 = 2		// Half floats in the bounding box: more precision near the center, less at the edges
+};
+
+struct PackedVertex
+{
+	uint16_t position[4];
+	uint32_t color;
+};
+
+static_assert(sizeof(PackedVertex) == 12, "PackedVertex must match the layout read by the shaders");
+
+/// Affine transform from quantized [-1, 1] coordinates to object space: position * scale + offset
+struct VertexQuantization
+{
+	XMFLOAT3 scale = { 1.0f, 1.0f, 1.0f };
+	XMFLOAT3 offset = { 0.0f, 0.0f, 0.0f };
+
+	/// <summary>
+	/// Write the transform as the row-major 3x4 matrix expected by
+	/// D3D12_RAYTRACING_GEOMETRY_TRIANGLES_DESC::Transform3x4
+	/// </summary>
+	void GetTransform3x4(float matrix[12]) const;
+
+	/// Same transform, for the row vector convention of DirectXMath
+	XMMATRIX GetMatrix() const;
+};
+
+/// Difference between the vertices and their packed version
+struct VertexPackingError
+{
+	float maxPositionError = 0.0f;			// Largest distance between a position and its decoded value
+	float rmsPositionError = 0.0f;
+	float relativePositionError = 0.0f;		// maxPositionError over the diagonal of the bounding box
+	float maxColorError = 0.0f;				// Largest difference on a color channel
+	uint64_t sizeInBytes = 0;				// Of the vertices in the Vertex layout
+	uint64_t packedSizeInBytes = 0;
+};
+
+class VertexPacking
+{
+public:
+	/// <summary>
+	/// Quantization mapping the bounding box of a mesh to [-1, 1]. Flat axes get a small extent,
+	/// so that the transform remains invertible
+	/// </summary>
+	static VertexQuantization ComputeQuantization(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax);
+
+	/// <summary>
+	/// Pack vertices, which are expected in the bounding box used to compute the quantization.
+	/// Positions outside of it are clamped, as are the color channels outside of [0, 1].
+	/// The format cannot be Float32
+	/// </summary>
+	static void Encode(const Vertex* vertices, uint32_t vertexCount, PackedVertex* packed,
+		VertexPositionFormat format, const VertexQuantization& quantization);
+
+	/// <summary>
+	/// Unpack vertices as the GPU reads them
+	/// </summary>
+	static void Decode(const PackedVertex* packed, uint32_t vertexCount, Vertex* vertices,
+		VertexPositionFormat format, const VertexQuantization& quantization);
+
+	/// <summary>
+	/// Compare vertices with their packed version
+	/// </summary>
+	static VertexPackingError MeasureError(const Vertex* vertices, const PackedVertex* packed, uint32_t vertexCount,
+		VertexPositionFormat format, const VertexQuantization& quantization);
+
+	/// Conversions between float and IEEE half, rounding to nearest even
+	static uint16_t FloatToHalf(float value);
+	static float HalfToFloat(uint16_t value);
+};
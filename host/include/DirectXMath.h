@@ -0,0 +1,166 @@
+#pragma once
+
+// #DXR Custom: Host Build
+// Portable subset of DirectXMath, used by the host build (see CMakeLists.txt) on platforms
+// without the Windows SDK. Only the types and functions needed by the platform independent
+// modules are provided, with the same memory layouts and conventions as DirectXMath: matrices
+// are row-major and multiply row vectors, XMStoreFloat3x4 stores the transposed matrix. The
+// vectors are plain floats, without SIMD, since the host build only runs tests and tools.
+//
+// This header must never be visible to the Windows build, which uses the real DirectXMath.
+
+#include <cmath>
+#include <cstring>
+
+namespace DirectX
+{
+	static const float XM_PI = 3.141592654f;
+
+	struct alignas(16) XMVECTOR
+	{
+		float v[4];
+	};
+
+	struct alignas(16) XMMATRIX
+	{
+		XMVECTOR r[4];
+	};
+
+	struct XMFLOAT3
+	{
+		float x;
+		float y;
+		float z;
+
+		XMFLOAT3() = default;
+		constexpr XMFLOAT3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+	};
+
+	struct XMFLOAT4
+	{
+		float x;
+		float y;
+		float z;
+		float w;
+
+		XMFLOAT4() = default;
+		constexpr XMFLOAT4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+	};
+
+	struct XMFLOAT3X4
+	{
+		float m[3][4];
+	};
+
+	struct XMFLOAT4X4
+	{
+		float m[4][4];
+	};
+
+	inline float XMConvertToRadians(float degrees) { return degrees * (XM_PI / 180.0f); }
+
+	inline XMVECTOR XMVectorSet(float x, float y, float z, float w)
+	{
+		XMVECTOR v = { { x, y, z, w } };
+		return v;
+	}
+
+	inline XMMATRIX XMMatrixIdentity()
+	{
+		XMMATRIX m = {};
+		for (int i = 0; i < 4; i++)
+		{
+			m.r[i].v[i] = 1.0f;
+		}
+		return m;
+	}
+
+	inline XMMATRIX XMMatrixScaling(float x, float y, float z)
+	{
+		XMMATRIX m = XMMatrixIdentity();
+		m.r[0].v[0] = x;
+		m.r[1].v[1] = y;
+		m.r[2].v[2] = z;
+		return m;
+	}
+
+	inline XMMATRIX XMMatrixTranslation(float x, float y, float z)
+	{
+		XMMATRIX m = XMMatrixIdentity();
+		m.r[3].v[0] = x;
+		m.r[3].v[1] = y;
+		m.r[3].v[2] = z;
+		return m;
+	}
+
+	inline XMMATRIX XMMatrixRotationY(float angle)
+	{
+		XMMATRIX m = XMMatrixIdentity();
+		float s = std::sin(angle);
+		float c = std::cos(angle);
+		m.r[0].v[0] = c;
+		m.r[0].v[2] = -s;
+		m.r[2].v[0] = s;
+		m.r[2].v[2] = c;
+		return m;
+	}
+
+	inline XMMATRIX XMMatrixMultiply(const XMMATRIX& a, const XMMATRIX& b)
+	{
+		XMMATRIX m = {};
+		for (int i = 0; i < 4; i++)
+		{
+			for (int k = 0; k < 4; k++)
+			{
+				for (int j = 0; j < 4; j++)
+				{
+					m.r[i].v[j] += a.r[i].v[k] * b.r[k].v[j];
+				}
+			}
+		}
+		return m;
+	}
+
+	inline XMMATRIX operator*(const XMMATRIX& a, const XMMATRIX& b) { return XMMatrixMultiply(a, b); }
+
+	inline XMMATRIX XMMatrixTranspose(const XMMATRIX& a)
+	{
+		XMMATRIX m;
+		for (int i = 0; i < 4; i++)
+		{
+			for (int j = 0; j < 4; j++)
+			{
+				m.r[i].v[j] = a.r[j].v[i];
+			}
+		}
+		return m;
+	}
+
+	inline XMMATRIX XMLoadFloat4x4(const XMFLOAT4X4* source)
+	{
+		XMMATRIX m;
+		memcpy(&m, source, sizeof(XMFLOAT4X4));
+		return m;
+	}
+
+	inline void XMStoreFloat4x4(XMFLOAT4X4* destination, const XMMATRIX& m)
+	{
+		memcpy(destination, &m, sizeof(XMFLOAT4X4));
+	}
+
+	inline void XMStoreFloat3x4(XMFLOAT3X4* destination, const XMMATRIX& m)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 4; j++)
+			{
+				destination->m[i][j] = m.r[j].v[i];
+			}
+		}
+	}
+
+	inline void XMStoreFloat4(XMFLOAT4* destination, const XMVECTOR& v)
+	{
+		memcpy(destination, &v, sizeof(XMFLOAT4));
+	}
+}
@@ -41,7 +41,7 @@ namespace nv_helpers_dx12 {
 
 //--------------------------------------------------------------------------------------------------
 // Add a vertex buffer in GPU memory into the acceleration structure. The
-// vertices are supposed to be represented by 3 float32 value
+// vertices are represented by 3 float32 values unless another format is given
 void BottomLevelASGenerator::AddVertexBuffer(
     ID3D12Resource *vertexBuffer, // Buffer containing the vertex coordinates,
                                   // possibly interleaved with other vertex data
@@ -55,21 +55,23 @@ void BottomLevelASGenerator::AddVertexBuffer(
                                      // vertices. This buffer cannot be nullptr
     UINT64 transformOffsetInBytes,   // Offset of the transform matrix in the
                                      // transform buffer
-    bool isOpaque /* = true */ // If true, the geometry is considered opaque,
-                               // optimizing the search for a closest hit
+    bool isOpaque /* = true */, // If true, the geometry is considered opaque,
+                                // optimizing the search for a closest hit
+    DXGI_FORMAT vertexFormat /* = DXGI_FORMAT_R32G32B32_FLOAT */ // Format of
+                                // the vertex coordinates
 ) {
   AddVertexBuffer(vertexBuffer, vertexOffsetInBytes, vertexCount,
                   vertexSizeInBytes, nullptr, 0, 0, transformBuffer,
-                  transformOffsetInBytes, isOpaque);
+                  transformOffsetInBytes, isOpaque, vertexFormat);
 }
 
 //--------------------------------------------------------------------------------------------------
 // Add a vertex buffer along with its index buffer in GPU memory into the
-// acceleration structure. The vertices are supposed to be represented by 3
-// float32 value. This implementation limits the original flexibility of the
-// API:
+// acceleration structure. This implementation limits the original
+// flexibility of the API:
 //   - triangles (no custom intersector support)
-//   - 3xfloat32 format
+//   - 3xfloat32 format by default. Packed formats such as 4xsnorm16 can be
+//     given, the fourth component being ignored by the builder
 //   - 32-bit indices
 void BottomLevelASGenerator::AddVertexBuffer(
     ID3D12Resource *vertexBuffer, // Buffer containing the vertex coordinates,
@@ -88,18 +90,21 @@ void BottomLevelASGenerator::AddVertexBuffer(
                                      // vertices. This buffer cannot be nullptr
     UINT64 transformOffsetInBytes,   // Offset of the transform matrix in the
                                      // transform buffer
-    bool isOpaque /* = true */ // If true, the geometry is considered opaque,
-                               // optimizing the search for a closest hit
+    bool isOpaque /* = true */, // If true, the geometry is considered opaque,
+                                // optimizing the search for a closest hit
+    DXGI_FORMAT vertexFormat /* = DXGI_FORMAT_R32G32B32_FLOAT */ // Format of
+                                // the vertex coordinates
 ) {
   // Create the DX12 descriptor representing the input data, assumed to be
-  // opaque triangles, with 3xf32 vertex coordinates and 32-bit indices
+  // opaque triangles, with 3xf32 vertex coordinates by default and 32-bit
+  // indices
   D3D12_RAYTRACING_GEOMETRY_DESC descriptor = {};
   descriptor.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
   descriptor.Triangles.VertexBuffer.StartAddress =
       vertexBuffer->GetGPUVirtualAddress() + vertexOffsetInBytes;
   descriptor.Triangles.VertexBuffer.StrideInBytes = vertexSizeInBytes;
   descriptor.Triangles.VertexCount = vertexCount;
-  descriptor.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+  descriptor.Triangles.VertexFormat = vertexFormat;
   descriptor.Triangles.IndexBuffer =
       indexBuffer ? (indexBuffer->GetGPUVirtualAddress() + indexOffsetInBytes)
                   : 0;
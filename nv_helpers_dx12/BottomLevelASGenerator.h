@@ -81,8 +81,8 @@ class BottomLevelASGenerator
 {
 public:
   /// Add a vertex buffer in GPU memory into the acceleration structure. The
-  /// vertices are supposed to be represented by 3 float32 value. Indices are
-  /// implicit.
+  /// vertices are represented by 3 float32 values unless another format is
+  /// given. Indices are implicit.
   void AddVertexBuffer(ID3D12Resource* vertexBuffer, /// Buffer containing the vertex coordinates,
                                                      /// possibly interleaved with other vertex data
                        UINT64 vertexOffsetInBytes,   /// Offset of the first vertex in the vertex
@@ -98,13 +98,16 @@ public:
                                                         /// be nullptr
                        UINT64 transformOffsetInBytes,   /// Offset of the transform matrix in the
                                                         /// transform buffer
-                       bool isOpaque = true /// If true, the geometry is considered opaque,
-                                            /// optimizing the search for a closest hit
+                       bool isOpaque = true, /// If true, the geometry is considered opaque,
+                                             /// optimizing the search for a closest hit
+                       DXGI_FORMAT vertexFormat = DXGI_FORMAT_R32G32B32_FLOAT /// Format of the
+                                             /// vertex coordinates, such as
+                                             /// DXGI_FORMAT_R16G16B16A16_SNORM for packed vertices
   );
 
   /// Add a vertex buffer along with its index buffer in GPU memory into the acceleration structure.
-  /// The vertices are supposed to be represented by 3 float32 value, and the indices are 32-bit
-  /// unsigned ints
+  /// The vertices are represented by 3 float32 values unless another format is given, and the
+  /// indices are 32-bit unsigned ints
   void AddVertexBuffer(ID3D12Resource* vertexBuffer, /// Buffer containing the vertex coordinates,
                                                      /// possibly interleaved with other vertex data
                        UINT64 vertexOffsetInBytes,   /// Offset of the first vertex in the vertex
@@ -125,8 +128,11 @@ public:
                                                         /// be nullptr
                        UINT64 transformOffsetInBytes,   /// Offset of the transform matrix in the
                                                         /// transform buffer
-                       bool isOpaque = true /// If true, the geometry is considered opaque,
-                                            /// optimizing the search for a closest hit
+                       bool isOpaque = true, /// If true, the geometry is considered opaque,
+                                             /// optimizing the search for a closest hit
+                       DXGI_FORMAT vertexFormat = DXGI_FORMAT_R32G32B32_FLOAT /// Format of the
+                                             /// vertex coordinates, such as
+                                             /// DXGI_FORMAT_R16G16B16A16_SNORM for packed vertices
   );
 
   /// Compute the size of the scratch space required to build the acceleration structure, as well as
@@ -0,0 +1,1020 @@
+#include "BottomLevelBVHBuilder.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace nv_helpers_dx12 {
+
+namespace {
+
+// Axis-aligned box used during the build
+struct Bounds
+{
+  float minP[3];
+  float maxP[3];
+
+  void Reset()
+  {
+    for (int a = 0; a < 3; a++)
+    {
+      minP[a] = std::numeric_limits<float>::max();
+      maxP[a] = -std::numeric_limits<float>::max();
+    }
+  }
+
+  void Grow(const float p[3])
+  {
+    for (int a = 0; a < 3; a++)
+    {
+      minP[a] = std::min(minP[a], p[a]);
+      maxP[a] = std::max(maxP[a], p[a]);
+    }
+  }
+
+  void Grow(const Bounds &b)
+  {
+    for (int a = 0; a < 3; a++)
+    {
+      minP[a] = std::min(minP[a], b.minP[a]);
+      maxP[a] = std::max(maxP[a], b.maxP[a]);
+    }
+  }
+
+  // Half of the surface area, which is enough for SAH ratios
+  float HalfArea() const
+  {
+    float dx = maxP[0] - minP[0];
+    float dy = maxP[1] - minP[1];
+    float dz = maxP[2] - minP[2];
+    if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+      return 0.0f;
+    return dx * dy + dy * dz + dz * dx;
+  }
+};
+
+struct Bin
+{
+  Bounds bounds;
+  uint32_t count;
+};
+
+// Range of primitives to be turned into the subtree rooted at nodeIndex
+struct BuildTask
+{
+  uint32_t nodeIndex;
+  uint32_t begin;
+  uint32_t end;
+};
+
+
+//--------------------------------------------------------------------------------------------------
+// Binned SAH build. The primitives are split recursively, evaluating
+// binCount-1 candidate planes along each axis of the centroid bounds and
+// keeping the cheapest one. A node becomes a leaf if it holds at most
+// maxLeafSize primitives and splitting would not reduce the SAH cost. The
+// children of a node are stored next to each other in the node array.
+void BuildBinnedSAH(const std::vector<Bounds> &primitiveBounds,
+                    const std::vector<float> &centroids,
+                    const BVHBuildSettings &settings, BottomLevelBVH &result) {
+  const uint32_t triangleCount =
+      static_cast<uint32_t>(primitiveBounds.size());
+  const uint32_t binCount = settings.binCount;
+
+  uint32_t *indices = result.primitiveIndices.data();
+  for (uint32_t i = 0; i < triangleCount; i++)
+    indices[i] = i;
+
+  // A binary tree with one primitive per leaf has 2N-1 nodes
+  result.nodes.reserve(2 * static_cast<size_t>(triangleCount) - 1);
+  result.nodes.push_back(BVHNode());
+
+  std::vector<Bin> bins(binCount);
+  std::vector<float> rightAreas(binCount);
+  std::vector<uint32_t> rightCounts(binCount);
+
+  // Explicit stack, to support degenerate inputs producing very deep trees
+  std::vector<BuildTask> stack;
+  stack.push_back({0, 0, triangleCount});
+
+  while (!stack.empty())
+  {
+    BuildTask task = stack.back();
+    stack.pop_back();
+
+    const uint32_t count = task.end - task.begin;
+
+    // Bounds of the node and of the primitive centroids
+    Bounds nodeBounds, centroidBounds;
+    nodeBounds.Reset();
+    centroidBounds.Reset();
+    for (uint32_t i = task.begin; i < task.end; i++)
+    {
+      nodeBounds.Grow(primitiveBounds[indices[i]]);
+      centroidBounds.Grow(&centroids[3 * indices[i]]);
+    }
+
+    BVHNode &node = result.nodes[task.nodeIndex];
+    memcpy(node.boundsMin, nodeBounds.minP, sizeof(node.boundsMin));
+    memcpy(node.boundsMax, nodeBounds.maxP, sizeof(node.boundsMax));
+
+    // Find the cheapest split plane
+    const float leafCost = settings.intersectionCost * count;
+    const float nodeArea = nodeBounds.HalfArea();
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1;
+    uint32_t bestBin = 0;
+
+    if (count > 1)
+    {
+      for (int axis = 0; axis < 3; axis++)
+      {
+        float extent = centroidBounds.maxP[axis] - centroidBounds.minP[axis];
+        if (extent <= 0.0f)
+          continue;
+
+        for (Bin &bin : bins)
+        {
+          bin.bounds.Reset();
+          bin.count = 0;
+        }
+
+        float scale = binCount / extent;
+        for (uint32_t i = task.begin; i < task.end; i++)
+        {
+          uint32_t primitive = indices[i];
+          uint32_t b = static_cast<uint32_t>(
+              (centroids[3 * primitive + axis] - centroidBounds.minP[axis]) *
+              scale);
+          b = std::min(b, binCount - 1);
+          bins[b].bounds.Grow(primitiveBounds[primitive]);
+          bins[b].count++;
+        }
+
+        // Sweep from the right to get the area and count on the right of each
+        // plane, then from the left to evaluate the cost
+        Bounds accumulated;
+        accumulated.Reset();
+        uint32_t accumulatedCount = 0;
+        for (uint32_t b = binCount - 1; b > 0; b--)
+        {
+          accumulated.Grow(bins[b].bounds);
+          accumulatedCount += bins[b].count;
+          rightAreas[b] = accumulated.HalfArea();
+          rightCounts[b] = accumulatedCount;
+        }
+
+        accumulated.Reset();
+        accumulatedCount = 0;
+        for (uint32_t b = 0; b < binCount - 1; b++)
+        {
+          accumulated.Grow(bins[b].bounds);
+          accumulatedCount += bins[b].count;
+          if (accumulatedCount == 0 || rightCounts[b + 1] == 0)
+            continue;
+
+          float cost =
+              settings.traversalCost +
+              settings.intersectionCost *
+                  (accumulated.HalfArea() * accumulatedCount +
+                   rightAreas[b + 1] * rightCounts[b + 1]) /
+                  nodeArea;
+          if (cost < bestCost)
+          {
+            bestCost = cost;
+            bestAxis = axis;
+            bestBin = b;
+          }
+        }
+      }
+    }
+
+    bool makeLeaf = count == 1 ||
+                    (count <= settings.maxLeafSize && leafCost <= bestCost);
+    if (makeLeaf)
+    {
+      node.leftFirst = task.begin;
+      node.primitiveCount = count;
+      continue;
+    }
+
+    // Partition the primitives around the selected plane. If no plane could
+    // separate them (all centroids are identical), split the range in halves
+    uint32_t middle = task.begin;
+    if (bestAxis >= 0)
+    {
+      float scale = binCount / (centroidBounds.maxP[bestAxis] -
+                                centroidBounds.minP[bestAxis]);
+      float minP = centroidBounds.minP[bestAxis];
+      uint32_t *split = std::partition(
+          indices + task.begin, indices + task.end, [&](uint32_t primitive) {
+            uint32_t b = static_cast<uint32_t>(
+                (centroids[3 * primitive + bestAxis] - minP) * scale);
+            return std::min(b, binCount - 1) <= bestBin;
+          });
+      middle = static_cast<uint32_t>(split - indices);
+    }
+    if (middle == task.begin || middle == task.end)
+      middle = task.begin + count / 2;
+
+    uint32_t leftChild = static_cast<uint32_t>(result.nodes.size());
+    // The reference to the node may be invalidated by the insertion
+    result.nodes[task.nodeIndex].leftFirst = leftChild;
+    result.nodes[task.nodeIndex].primitiveCount = 0;
+    result.nodes.push_back(BVHNode());
+    result.nodes.push_back(BVHNode());
+
+    stack.push_back({leftChild + 1, middle, task.end});
+    stack.push_back({leftChild, task.begin, middle});
+  }
+}
+
+// Ranges of primitives processed by each task of the parallel loops
+const uint32_t kParallelGrainSize = 4096;
+
+// Number of leaves of the treelets reorganized by the LBVH optimization
+const uint32_t kTreeletSize = 7;
+
+const uint32_t kInvalidNode = ~0u;
+
+inline uint32_t CountLeadingZeros(uint64_t v) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  return _BitScanReverse64(&index, v) ? 63 - index : 64;
+#else
+  return v ? static_cast<uint32_t>(__builtin_clzll(v)) : 64;
+#endif
+}
+
+inline uint32_t PopCount(uint32_t v) {
+  uint32_t count = 0;
+  for (; v; v &= v - 1)
+    count++;
+  return count;
+}
+
+inline uint32_t LowestBitIndex(uint32_t v) {
+  uint32_t index = 0;
+  while (!(v & (1u << index)))
+    index++;
+  return index;
+}
+
+// Insert two zeros between each of the 10 low bits of v
+inline uint64_t ExpandBits10(uint64_t v) {
+  v &= 0x3ff;
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+// Insert two zeros between each of the 21 low bits of v
+inline uint64_t ExpandBits21(uint64_t v) {
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffffull;
+  v = (v | v << 16) & 0x1f0000ff0000ffull;
+  v = (v | v << 8) & 0x100f00f00f00f00full;
+  v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+  v = (v | v << 2) & 0x1249249249249249ull;
+  return v;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Parallel LSD radix sort of the Morton codes along with the primitive indices,
+// 8 bits per pass. Each pass histograms blocks of the input in parallel, then
+// scatters each block to its own offsets, which keeps the sort stable
+void RadixSort(std::vector<uint64_t> &keys, std::vector<uint32_t> &values,
+               uint32_t keyBits, ThreadPool &threadPool) {
+  const uint32_t count = static_cast<uint32_t>(keys.size());
+  const uint32_t blockSize =
+      std::max(count / (threadPool.GetThreadCount() * 4), kParallelGrainSize);
+  const uint32_t blockCount = (count + blockSize - 1) / blockSize;
+
+  std::vector<uint64_t> keysOut(count);
+  std::vector<uint32_t> valuesOut(count);
+  std::vector<uint32_t> offsets(static_cast<size_t>(blockCount) * 256);
+
+  for (uint32_t shift = 0; shift < keyBits; shift += 8)
+  {
+    threadPool.ParallelFor(
+        blockCount, 1, [&](uint32_t begin, uint32_t end, uint32_t) {
+          for (uint32_t b = begin; b < end; b++)
+          {
+            uint32_t *histogram = &offsets[static_cast<size_t>(b) * 256];
+            std::fill(histogram, histogram + 256, 0);
+            uint32_t last = std::min((b + 1) * blockSize, count);
+            for (uint32_t i = b * blockSize; i < last; i++)
+              histogram[(keys[i] >> shift) & 0xff]++;
+          }
+        });
+
+    // Exclusive prefix sum, digit-major so that the blocks of a digit are
+    // written in order
+    uint32_t sum = 0;
+    bool singleDigit = false;
+    for (uint32_t d = 0; d < 256; d++)
+    {
+      uint32_t digitStart = sum;
+      for (uint32_t b = 0; b < blockCount; b++)
+      {
+        uint32_t c = offsets[static_cast<size_t>(b) * 256 + d];
+        offsets[static_cast<size_t>(b) * 256 + d] = sum;
+        sum += c;
+      }
+      singleDigit |= (sum - digitStart) == count;
+    }
+
+    // All keys share this digit, the pass would not change the order
+    if (singleDigit)
+      continue;
+
+    threadPool.ParallelFor(
+        blockCount, 1, [&](uint32_t begin, uint32_t end, uint32_t) {
+          for (uint32_t b = begin; b < end; b++)
+          {
+            uint32_t *offset = &offsets[static_cast<size_t>(b) * 256];
+            uint32_t last = std::min((b + 1) * blockSize, count);
+            for (uint32_t i = b * blockSize; i < last; i++)
+            {
+              uint32_t destination = offset[(keys[i] >> shift) & 0xff]++;
+              keysOut[destination] = keys[i];
+              valuesOut[destination] = values[i];
+            }
+          }
+        });
+    keys.swap(keysOut);
+    values.swap(valuesOut);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Binary radix tree built from sorted Morton codes. With N leaves, internal
+// nodes are numbered [0, N-1) with the root at 0, and leaf k is node N-1+k
+class LBVHTree {
+public:
+  LBVHTree(const std::vector<uint64_t> &codes,
+           const std::vector<uint32_t> &sortedPrimitives,
+           const std::vector<Bounds> &primitiveBounds,
+           const BVHBuildSettings &settings, ThreadPool &threadPool)
+      : m_codes(codes), m_sortedPrimitives(sortedPrimitives),
+        m_primitiveBounds(primitiveBounds), m_settings(settings),
+        m_threadPool(threadPool),
+        m_leafCount(static_cast<uint32_t>(codes.size())) {
+    uint32_t nodeCount = 2 * m_leafCount - 1;
+    m_left.resize(m_leafCount - 1);
+    m_right.resize(m_leafCount - 1);
+    m_parent.resize(nodeCount);
+    m_bounds.resize(nodeCount);
+    m_cost.resize(nodeCount);
+    m_visits.reset(new std::atomic<uint32_t>[m_leafCount - 1]);
+  }
+
+  // Emit all the internal nodes in parallel. Each internal node covers a range
+  // of keys starting or ending at its own index, and is split where the common
+  // prefix of the keys of the range changes
+  void EmitHierarchy() {
+    m_parent[0] = kInvalidNode;
+    m_threadPool.ParallelFor(
+        m_leafCount - 1, kParallelGrainSize,
+        [&](uint32_t begin, uint32_t end, uint32_t) {
+          for (uint32_t i = begin; i < end; i++)
+            EmitNode(static_cast<int64_t>(i));
+        });
+  }
+
+  // Compute the bounds and SAH costs of all the nodes bottom-up
+  void ComputeBounds() {
+    BottomUp(
+        [&](uint32_t leaf, uint32_t k) {
+          m_bounds[leaf] = m_primitiveBounds[m_sortedPrimitives[k]];
+          m_cost[leaf] =
+              m_settings.intersectionCost * m_bounds[leaf].HalfArea();
+        },
+        [&](uint32_t node) { UpdateNode(node); });
+  }
+
+  // Reorganize treelets bottom-up to minimize their SAH cost. A node is only
+  // processed once both its subtrees have been optimized, so the treelets of
+  // concurrently processed nodes never overlap
+  void OptimizeTreelets() {
+    BottomUp([](uint32_t, uint32_t) {},
+             [&](uint32_t node) { OptimizeTreelet(node); });
+  }
+
+  // Store the tree in the flat node array. The children of internal node i
+  // are placed at 1 + 2i and 2 + 2i, which assigns a unique slot to every node
+  // without a sequential traversal
+  void Write(BottomLevelBVH &result) const {
+    result.nodes.resize(2 * static_cast<size_t>(m_leafCount) - 1);
+    WriteNode(result.nodes[0], 0);
+    m_threadPool.ParallelFor(
+        m_leafCount - 1, kParallelGrainSize,
+        [&](uint32_t begin, uint32_t end, uint32_t) {
+          for (uint32_t i = begin; i < end; i++)
+          {
+            WriteNode(result.nodes[1 + 2 * static_cast<size_t>(i)], m_left[i]);
+            WriteNode(result.nodes[2 + 2 * static_cast<size_t>(i)], m_right[i]);
+          }
+        });
+  }
+
+private:
+  bool IsLeaf(uint32_t node) const { return node >= m_leafCount - 1; }
+
+  // Length of the common prefix of keys i and j, or -1 if j is out of range.
+  // Duplicate keys are disambiguated by their index
+  int Delta(int64_t i, int64_t j) const {
+    if (j < 0 || j >= static_cast<int64_t>(m_leafCount))
+      return -1;
+    uint64_t a = m_codes[i];
+    uint64_t b = m_codes[j];
+    if (a == b)
+      return 64 + static_cast<int>(CountLeadingZeros(
+                      static_cast<uint64_t>(i ^ j))) - 32;
+    return static_cast<int>(CountLeadingZeros(a ^ b));
+  }
+
+  void EmitNode(int64_t i) {
+    // Direction of the range covered by the node
+    int d = (Delta(i, i + 1) - Delta(i, i - 1)) >= 0 ? 1 : -1;
+
+    // Upper bound of the range length, then binary search of the other end
+    int deltaMin = Delta(i, i - d);
+    int64_t maxLength = 2;
+    while (Delta(i, i + maxLength * d) > deltaMin)
+      maxLength *= 2;
+    int64_t length = 0;
+    for (int64_t t = maxLength / 2; t >= 1; t /= 2)
+    {
+      if (Delta(i, i + (length + t) * d) > deltaMin)
+        length += t;
+    }
+    int64_t j = i + length * d;
+
+    // Binary search of the split position
+    int deltaNode = Delta(i, j);
+    int64_t s = 0;
+    int64_t t = length;
+    do
+    {
+      t = (t + 1) / 2;
+      if (Delta(i, i + (s + t) * d) > deltaNode)
+        s += t;
+    } while (t > 1);
+    int64_t split = i + s * d + std::min(d, 0);
+
+    uint32_t first = static_cast<uint32_t>(std::min(i, j));
+    uint32_t last = static_cast<uint32_t>(std::max(i, j));
+    uint32_t left = static_cast<uint32_t>(split);
+    uint32_t right = static_cast<uint32_t>(split + 1);
+    if (left == first)
+      left += m_leafCount - 1;
+    if (right == last)
+      right += m_leafCount - 1;
+
+    m_left[i] = left;
+    m_right[i] = right;
+    m_parent[left] = static_cast<uint32_t>(i);
+    m_parent[right] = static_cast<uint32_t>(i);
+  }
+
+  // Run one thread per leaf, walking up the tree. The first thread reaching a
+  // node stops there, the second one processes it, hence both subtrees of a
+  // node are complete when it is processed
+  template <typename LeafFunction, typename NodeFunction>
+  void BottomUp(LeafFunction processLeaf, NodeFunction processNode) {
+    m_threadPool.ParallelFor(m_leafCount - 1, kParallelGrainSize,
+                             [&](uint32_t begin, uint32_t end, uint32_t) {
+                               for (uint32_t i = begin; i < end; i++)
+                                 m_visits[i].store(0, std::memory_order_relaxed);
+                             });
+
+    m_threadPool.ParallelFor(
+        m_leafCount, kParallelGrainSize,
+        [&](uint32_t begin, uint32_t end, uint32_t) {
+          for (uint32_t k = begin; k < end; k++)
+          {
+            uint32_t leaf = m_leafCount - 1 + k;
+            processLeaf(leaf, k);
+            uint32_t node = m_parent[leaf];
+            while (node != kInvalidNode &&
+                   m_visits[node].fetch_add(1, std::memory_order_acq_rel) != 0)
+            {
+              processNode(node);
+              node = m_parent[node];
+            }
+          }
+        });
+  }
+
+  void UpdateNode(uint32_t node) {
+    uint32_t left = m_left[node];
+    uint32_t right = m_right[node];
+    m_bounds[node] = m_bounds[left];
+    m_bounds[node].Grow(m_bounds[right]);
+    m_cost[node] = m_settings.traversalCost * m_bounds[node].HalfArea() +
+                   m_cost[left] + m_cost[right];
+  }
+
+  // Find the optimal topology of the treelet rooted at the node, by dynamic
+  // programming over all the subsets of its leaves
+  void OptimizeTreelet(uint32_t root) {
+    uint32_t leaves[kTreeletSize];
+    uint32_t internals[kTreeletSize - 1];
+    uint32_t leafCount = 2;
+    uint32_t internalCount = 1;
+    leaves[0] = m_left[root];
+    leaves[1] = m_right[root];
+    internals[0] = root;
+
+    // Grow the treelet by expanding the leaf with the largest area
+    while (leafCount < kTreeletSize)
+    {
+      int best = -1;
+      float bestArea = -1.0f;
+      for (uint32_t k = 0; k < leafCount; k++)
+      {
+        if (!IsLeaf(leaves[k]) && m_bounds[leaves[k]].HalfArea() > bestArea)
+        {
+          bestArea = m_bounds[leaves[k]].HalfArea();
+          best = static_cast<int>(k);
+        }
+      }
+      if (best < 0)
+        break;
+
+      uint32_t expanded = leaves[best];
+      internals[internalCount++] = expanded;
+      leaves[best] = m_left[expanded];
+      leaves[leafCount++] = m_right[expanded];
+    }
+
+    if (leafCount < 3)
+      return;
+
+    const uint32_t subsetCount = 1u << leafCount;
+    Bounds subsetBounds[1u << kTreeletSize];
+    float optimalCost[1u << kTreeletSize];
+    uint8_t optimalSplit[1u << kTreeletSize];
+
+    for (uint32_t mask = 1; mask < subsetCount; mask++)
+    {
+      uint32_t lowest = mask & (~mask + 1);
+      const Bounds &leafBounds = m_bounds[leaves[LowestBitIndex(lowest)]];
+      if (mask == lowest)
+      {
+        subsetBounds[mask] = leafBounds;
+        optimalCost[mask] = m_cost[leaves[LowestBitIndex(lowest)]];
+        continue;
+      }
+      subsetBounds[mask] = subsetBounds[mask ^ lowest];
+      subsetBounds[mask].Grow(leafBounds);
+
+      // Subsets are visited in increasing order, so all the partitions of the
+      // subset have already been solved. Only partitions holding the lowest
+      // leaf on their left are tested, the others being symmetric
+      float best = std::numeric_limits<float>::max();
+      uint32_t bestPartition = 0;
+      for (uint32_t p = (mask - 1) & mask; p != 0; p = (p - 1) & mask)
+      {
+        if (!(p & lowest))
+          continue;
+        float cost = optimalCost[p] + optimalCost[mask ^ p];
+        if (cost < best)
+        {
+          best = cost;
+          bestPartition = p;
+        }
+      }
+      optimalCost[mask] =
+          m_settings.traversalCost * subsetBounds[mask].HalfArea() + best;
+      optimalSplit[mask] = static_cast<uint8_t>(bestPartition);
+    }
+
+    const uint32_t fullSet = subsetCount - 1;
+    if (optimalCost[fullSet] >= m_cost[root] * 0.9999f)
+      return;
+
+    // Rebuild the treelet, reusing its internal nodes. The root keeps its index
+    uint32_t nextInternal = 1;
+    Restructure(fullSet, root, leaves, internals, nextInternal, subsetBounds,
+                optimalCost, optimalSplit);
+  }
+
+  void Restructure(uint32_t mask, uint32_t node, const uint32_t *leaves,
+                   const uint32_t *internals, uint32_t &nextInternal,
+                   const Bounds *subsetBounds, const float *optimalCost,
+                   const uint8_t *optimalSplit) {
+    uint32_t partitions[2] = {optimalSplit[mask],
+                              mask ^ static_cast<uint32_t>(optimalSplit[mask])};
+    uint32_t children[2];
+    for (int side = 0; side < 2; side++)
+    {
+      uint32_t subset = partitions[side];
+      if (PopCount(subset) == 1)
+      {
+        children[side] = leaves[LowestBitIndex(subset)];
+      }
+      else
+      {
+        children[side] = internals[nextInternal++];
+        Restructure(subset, children[side], leaves, internals, nextInternal,
+                    subsetBounds, optimalCost, optimalSplit);
+      }
+      m_parent[children[side]] = node;
+    }
+    m_left[node] = children[0];
+    m_right[node] = children[1];
+    m_bounds[node] = subsetBounds[mask];
+    m_cost[node] = optimalCost[mask];
+  }
+
+  void WriteNode(BVHNode &output, uint32_t node) const {
+    memcpy(output.boundsMin, m_bounds[node].minP, sizeof(output.boundsMin));
+    memcpy(output.boundsMax, m_bounds[node].maxP, sizeof(output.boundsMax));
+    if (IsLeaf(node))
+    {
+      output.leftFirst = node - (m_leafCount - 1);
+      output.primitiveCount = 1;
+    }
+    else
+    {
+      output.leftFirst = 1 + 2 * node;
+      output.primitiveCount = 0;
+    }
+  }
+
+  const std::vector<uint64_t> &m_codes;
+  const std::vector<uint32_t> &m_sortedPrimitives;
+  const std::vector<Bounds> &m_primitiveBounds;
+  const BVHBuildSettings &m_settings;
+  ThreadPool &m_threadPool;
+  const uint32_t m_leafCount;
+
+  std::vector<uint32_t> m_left;
+  std::vector<uint32_t> m_right;
+  std::vector<uint32_t> m_parent;
+  std::vector<Bounds> m_bounds;
+  std::vector<float> m_cost;
+  std::unique_ptr<std::atomic<uint32_t>[]> m_visits;
+};
+
+//--------------------------------------------------------------------------------------------------
+// LBVH build: Morton codes of the centroids, radix sort, parallel emission of
+// the hierarchy, bounds computation and optional treelet optimization
+void BuildLBVH(const std::vector<Bounds> &primitiveBounds,
+               const std::vector<float> &centroids,
+               const BVHBuildSettings &settings, ThreadPool &threadPool,
+               BottomLevelBVH &result) {
+  const uint32_t triangleCount =
+      static_cast<uint32_t>(primitiveBounds.size());
+
+  // Bounds of the centroids, reduced per thread
+  std::vector<Bounds> threadBounds(threadPool.GetThreadCount());
+  for (Bounds &b : threadBounds)
+    b.Reset();
+  threadPool.ParallelFor(triangleCount, kParallelGrainSize,
+                         [&](uint32_t begin, uint32_t end, uint32_t thread) {
+                           for (uint32_t i = begin; i < end; i++)
+                             threadBounds[thread].Grow(&centroids[3 * i]);
+                         });
+  Bounds centroidBounds;
+  centroidBounds.Reset();
+  for (const Bounds &b : threadBounds)
+    centroidBounds.Grow(b);
+
+  // Quantize the centroids on a 2^10 or 2^21 grid along each axis
+  const bool wideCodes = settings.mortonCodeBits == 63;
+  const float gridSize = wideCodes ? 2097152.0f : 1024.0f;
+  float scale[3];
+  for (int a = 0; a < 3; a++)
+  {
+    float extent = centroidBounds.maxP[a] - centroidBounds.minP[a];
+    scale[a] = extent > 0.0f ? gridSize / extent : 0.0f;
+  }
+
+  std::vector<uint64_t> codes(triangleCount);
+  std::vector<uint32_t> sortedPrimitives(triangleCount);
+  threadPool.ParallelFor(
+      triangleCount, kParallelGrainSize,
+      [&](uint32_t begin, uint32_t end, uint32_t) {
+        for (uint32_t i = begin; i < end; i++)
+        {
+          uint64_t cell[3];
+          for (int a = 0; a < 3; a++)
+          {
+            float q = (centroids[3 * i + a] - centroidBounds.minP[a]) * scale[a];
+            cell[a] = static_cast<uint64_t>(
+                std::min(std::max(q, 0.0f), gridSize - 1.0f));
+          }
+          codes[i] = wideCodes ? (ExpandBits21(cell[0]) << 2) |
+                                     (ExpandBits21(cell[1]) << 1) |
+                                     ExpandBits21(cell[2])
+                               : (ExpandBits10(cell[0]) << 2) |
+                                     (ExpandBits10(cell[1]) << 1) |
+                                     ExpandBits10(cell[2]);
+          sortedPrimitives[i] = i;
+        }
+      });
+
+  RadixSort(codes, sortedPrimitives, wideCodes ? 64 : 32, threadPool);
+
+  // A single triangle is a tree made of one leaf
+  if (triangleCount == 1)
+  {
+    BVHNode root = {};
+    memcpy(root.boundsMin, primitiveBounds[0].minP, sizeof(root.boundsMin));
+    memcpy(root.boundsMax, primitiveBounds[0].maxP, sizeof(root.boundsMax));
+    root.leftFirst = 0;
+    root.primitiveCount = 1;
+    result.nodes.assign(1, root);
+    result.primitiveIndices = sortedPrimitives;
+    return;
+  }
+
+  LBVHTree tree(codes, sortedPrimitives, primitiveBounds, settings,
+                threadPool);
+  tree.EmitHierarchy();
+  tree.ComputeBounds();
+  for (uint32_t pass = 0; pass < settings.treeletOptimizationPasses; pass++)
+    tree.OptimizeTreelets();
+  tree.Write(result);
+
+  result.primitiveIndices = sortedPrimitives;
+}
+
+//--------------------------------------------------------------------------------------------------
+// SAH cost, depth and leaf statistics of the final tree
+void ComputeTreeStats(const BVHBuildSettings &settings,
+                      BottomLevelBVH &result) {
+  const BVHNode &root = result.nodes[0];
+  Bounds rootBounds;
+  memcpy(rootBounds.minP, root.boundsMin, sizeof(rootBounds.minP));
+  memcpy(rootBounds.maxP, root.boundsMax, sizeof(rootBounds.maxP));
+  float rootArea = rootBounds.HalfArea();
+
+  double sahCost = 0.0;
+  uint32_t leafCount = 0;
+  uint32_t maxDepth = 0;
+
+  std::vector<std::pair<uint32_t, uint32_t>> stack;
+  stack.push_back({0, 0});
+  while (!stack.empty())
+  {
+    uint32_t nodeIndex = stack.back().first;
+    uint32_t depth = stack.back().second;
+    stack.pop_back();
+    maxDepth = std::max(maxDepth, depth);
+
+    const BVHNode &node = result.nodes[nodeIndex];
+    Bounds b;
+    memcpy(b.minP, node.boundsMin, sizeof(b.minP));
+    memcpy(b.maxP, node.boundsMax, sizeof(b.maxP));
+    double relativeArea = rootArea > 0.0f ? b.HalfArea() / rootArea : 1.0;
+    if (node.IsLeaf())
+    {
+      sahCost += settings.intersectionCost * node.primitiveCount * relativeArea;
+      leafCount++;
+    }
+    else
+    {
+      sahCost += settings.traversalCost * relativeArea;
+      stack.push_back({node.leftFirst, depth + 1});
+      stack.push_back({node.leftFirst + 1, depth + 1});
+    }
+  }
+
+  result.stats.sahCost = sahCost;
+  result.stats.nodeCount = static_cast<uint32_t>(result.nodes.size());
+  result.stats.leafCount = leafCount;
+  result.stats.maxDepth = maxDepth;
+  result.stats.averageLeafSize =
+      static_cast<float>(result.stats.triangleCount) / leafCount;
+}
+
+} // namespace
+
+//--------------------------------------------------------------------------------------------------
+// Add a vertex buffer in CPU memory into the hierarchy. The vertices are
+// supposed to be represented by 3 float32 value
+void BottomLevelBVHBuilder::AddVertexBuffer(
+    const void *vertexData, // Buffer containing the vertex coordinates,
+                            // possibly interleaved with other vertex data
+    uint64_t
+        vertexOffsetInBytes, // Offset of the first vertex in the vertex buffer
+    uint32_t vertexCount,    // Number of vertices to consider in the buffer
+    uint32_t vertexSizeInBytes, // Size of a vertex including all its other
+                                // data, used to stride in the buffer
+    bool isOpaque /* = true */  // If true, the geometry is considered opaque
+) {
+  AddVertexBuffer(vertexData, vertexOffsetInBytes, vertexCount,
+                  vertexSizeInBytes, nullptr, 0, 0, isOpaque);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Add a vertex buffer along with its index buffer in CPU memory into the
+// hierarchy. As for the BottomLevelASGenerator, only triangles with 3xfloat32
+// vertex coordinates and 32-bit indices are supported
+void BottomLevelBVHBuilder::AddVertexBuffer(
+    const void *vertexData, // Buffer containing the vertex coordinates,
+                            // possibly interleaved with other vertex data
+    uint64_t
+        vertexOffsetInBytes, // Offset of the first vertex in the vertex buffer
+    uint32_t vertexCount,    // Number of vertices to consider in the buffer
+    uint32_t vertexSizeInBytes, // Size of a vertex including all its other
+                                // data, used to stride in the buffer
+    const uint32_t *indexData,  // Buffer containing the vertex indices
+                                // describing the triangles
+    uint64_t indexOffsetInBytes, // Offset of the first index in the index buffer
+    uint32_t indexCount,         // Number of indices to consider in the buffer
+    bool isOpaque /* = true */   // If true, the geometry is considered opaque
+) {
+  if (vertexData == nullptr)
+  {
+    throw std::logic_error("Vertex data cannot be null");
+  }
+  if (vertexSizeInBytes < 3 * sizeof(float))
+  {
+    throw std::logic_error("Vertex stride is smaller than a float3 position");
+  }
+
+  GeometryDesc descriptor = {};
+  descriptor.vertexData =
+      static_cast<const uint8_t *>(vertexData) + vertexOffsetInBytes;
+  descriptor.vertexCount = vertexCount;
+  descriptor.vertexStrideInBytes = vertexSizeInBytes;
+  descriptor.indexData =
+      indexData ? reinterpret_cast<const uint32_t *>(
+                      reinterpret_cast<const uint8_t *>(indexData) +
+                      indexOffsetInBytes)
+                : nullptr;
+  descriptor.indexCount = indexData ? indexCount : 0;
+  descriptor.firstTriangle = m_triangleCount;
+  descriptor.isOpaque = isOpaque;
+
+  m_triangleCount += (indexData ? indexCount : vertexCount) / 3;
+  m_geometries.push_back(descriptor);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Total number of triangles added so far
+uint32_t BottomLevelBVHBuilder::GetTriangleCount() const {
+  return m_triangleCount;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Fetch the vertex positions of a triangle from its global index
+void BottomLevelBVHBuilder::GetTriangle(uint32_t triangleIndex, float v0[3],
+                                        float v1[3], float v2[3]) const {
+  // Find the last geometry starting at or before the triangle
+  auto it = std::upper_bound(
+      m_geometries.begin(), m_geometries.end(), triangleIndex,
+      [](uint32_t index, const GeometryDesc &g) {
+        return index < g.firstTriangle;
+      });
+  const GeometryDesc &geometry = *(it - 1);
+
+  uint32_t local = triangleIndex - geometry.firstTriangle;
+  float *out[3] = {v0, v1, v2};
+  for (uint32_t k = 0; k < 3; k++)
+  {
+    uint32_t vertex = geometry.indexData ? geometry.indexData[3 * local + k]
+                                         : 3 * local + k;
+    memcpy(out[k],
+           geometry.vertexData +
+               static_cast<size_t>(vertex) * geometry.vertexStrideInBytes,
+           3 * sizeof(float));
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Build the hierarchy of all the geometry added so far. The bounds and
+// centroids of the triangles are computed first, then the tree is built with
+// the selected mode, and the statistics are gathered from the final tree
+void BottomLevelBVHBuilder::Generate(
+    BottomLevelBVH &result, // Hierarchy and build statistics
+    const BVHBuildSettings &settings /* = {} */, // Build mode, bin count, leaf
+                                                 // size and SAH costs
+    ThreadPool *threadPool /* = nullptr */ // Threads used by the build
+) const {
+  if (settings.mode == BVHBuildMode::BinnedSAH && settings.binCount < 2)
+  {
+    throw std::logic_error("The SAH build requires at least 2 bins");
+  }
+  if (settings.maxLeafSize < 1)
+  {
+    throw std::logic_error("The maximum leaf size must be at least 1");
+  }
+  if (settings.mode == BVHBuildMode::LBVH && settings.mortonCodeBits != 30 &&
+      settings.mortonCodeBits != 63)
+  {
+    throw std::logic_error("Morton codes must be 30 or 63 bits");
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  // The LBVH build is always parallel, and creates a pool if none is provided
+  std::unique_ptr<ThreadPool> localPool;
+  if (threadPool == nullptr && settings.mode == BVHBuildMode::LBVH)
+  {
+    localPool.reset(new ThreadPool());
+    threadPool = localPool.get();
+  }
+
+  const uint32_t triangleCount = m_triangleCount;
+
+  result.nodes.clear();
+  result.primitiveIndices.resize(triangleCount);
+  result.geometryTriangleOffsets.resize(m_geometries.size());
+  result.geometryOpaque.resize(m_geometries.size());
+  for (size_t g = 0; g < m_geometries.size(); g++)
+  {
+    result.geometryTriangleOffsets[g] = m_geometries[g].firstTriangle;
+    result.geometryOpaque[g] = m_geometries[g].isOpaque ? 1 : 0;
+  }
+  result.stats = BVHBuildStats();
+  result.stats.mode = settings.mode;
+  result.stats.threadCount = threadPool ? threadPool->GetThreadCount() : 1;
+  result.stats.triangleCount = triangleCount;
+  result.stats.binCount = settings.binCount;
+  result.stats.maxLeafSize =
+      settings.mode == BVHBuildMode::LBVH ? 1 : settings.maxLeafSize;
+
+  // Empty hierarchy: a single empty leaf whose bounds cannot be hit
+  if (triangleCount == 0)
+  {
+    BVHNode root = {};
+    Bounds empty;
+    empty.Reset();
+    memcpy(root.boundsMin, empty.minP, sizeof(root.boundsMin));
+    memcpy(root.boundsMax, empty.maxP, sizeof(root.boundsMax));
+    result.nodes.push_back(root);
+    result.stats.nodeCount = 1;
+    result.stats.leafCount = 1;
+    return;
+  }
+
+  // Bounds and centroids of all the triangles
+  std::vector<Bounds> primitiveBounds(triangleCount);
+  std::vector<float> centroids(static_cast<size_t>(triangleCount) * 3);
+  for (const GeometryDesc &geometry : m_geometries)
+  {
+    uint32_t geometryTriangles =
+        (geometry.indexData ? geometry.indexCount : geometry.vertexCount) / 3;
+    auto computeBounds = [&](uint32_t begin, uint32_t end, uint32_t) {
+      for (uint32_t t = begin; t < end; t++)
+      {
+        uint32_t triangle = geometry.firstTriangle + t;
+        Bounds &b = primitiveBounds[triangle];
+        b.Reset();
+        for (uint32_t k = 0; k < 3; k++)
+        {
+          uint32_t vertex =
+              geometry.indexData ? geometry.indexData[3 * t + k] : 3 * t + k;
+          const float *p = reinterpret_cast<const float *>(
+              geometry.vertexData +
+              static_cast<size_t>(vertex) * geometry.vertexStrideInBytes);
+          b.Grow(p);
+        }
+        for (int a = 0; a < 3; a++)
+          centroids[3 * triangle + a] = 0.5f * (b.minP[a] + b.maxP[a]);
+      }
+    };
+    if (threadPool)
+      threadPool->ParallelFor(geometryTriangles, kParallelGrainSize,
+                              computeBounds);
+    else
+      computeBounds(0, geometryTriangles, 0);
+  }
+
+  if (settings.mode == BVHBuildMode::LBVH)
+  {
+    BuildLBVH(primitiveBounds, centroids, settings, *threadPool, result);
+  }
+  else
+  {
+    BuildBinnedSAH(primitiveBounds, centroids, settings, result);
+  }
+
+  result.stats.buildMilliseconds =
+      std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - start)
+          .count();
+  result.stats.trianglesPerSecond =
+      result.stats.buildMilliseconds > 0.0
+          ? triangleCount * 1000.0 / result.stats.buildMilliseconds
+          : 0.0;
+
+  ComputeTreeStats(settings, result);
+}
+} // namespace nv_helpers_dx12
@@ -0,0 +1,193 @@
+/*
+The BottomLevelBVHBuilder is the CPU counterpart of the BottomLevelASGenerator.
+It consumes the same geometry descriptors (vertex stride, vertex and index counts,
+opaque flag), but reads the data from CPU memory and builds the hierarchy itself
+instead of handing the build to the driver. The result is a compact bounding
+volume hierarchy stored in a flat node array, used by the CPU reference
+raytracer and by offline tools.
+
+Two build modes are available:
+- BinnedSAH evaluates a fixed number of split planes per axis and produces high
+  quality trees, for static geometry
+- LBVH sorts the triangles along a Morton curve and emits all the nodes of the
+  hierarchy in parallel (Karras, "Maximizing Parallelism in the Construction of
+  BVHs, Octrees, and k-d Trees", 2012). It is much faster, which makes it
+  suitable for rebuilding animated or streamed meshes every frame. The tree
+  quality can be improved afterwards by optimizing treelets of 7 leaves
+  (Karras and Aila, "Fast Parallel Construction of High-Quality Bounding Volume
+  Hierarchies", 2013). The build runs on a ThreadPool.
+
+As with the BottomLevelASGenerator, the application first adds all the vertex
+buffers to be contained in the structure using AddVertexBuffer. The Generate
+call then builds the hierarchy. The geometry data is only referenced, and must
+remain valid until Generate returns.
+
+Build statistics (time, SAH cost, node and leaf counts) are stored along with
+the result so that bin counts and leaf sizes can be compared on large meshes.
+
+
+Example:
+
+BottomLevelBVHBuilder builder;
+builder.AddVertexBuffer(vertices.data(), 0, vertexCount, sizeof(Vertex),
+indices.data(), 0, indexCount);
+
+BVHBuildSettings settings;
+settings.binCount = 32;
+
+BottomLevelBVH bvh;
+builder.Generate(bvh, settings);
+
+// Fast rebuild of an animated mesh
+settings.mode = BVHBuildMode::LBVH;
+settings.treeletOptimizationPasses = 1;
+builder.Generate(bvh, settings, &threadPool);
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <stdexcept>
+
+namespace nv_helpers_dx12
+{
+
+class ThreadPool;
+
+/// Node of the hierarchy. Interior nodes store the index of their left child,
+/// the right child being stored right after it. Leaves store the index of their
+/// first primitive in BottomLevelBVH::primitiveIndices, and a non-zero count.
+/// The node is 32 bytes, so that two nodes fit in a cache line.
+struct BVHNode
+{
+  float boundsMin[3];
+  uint32_t leftFirst;      /// Left child index for interior nodes, first primitive for leaves
+  float boundsMax[3];
+  uint32_t primitiveCount; /// Number of primitives in a leaf, 0 for interior nodes
+
+  bool IsLeaf() const { return primitiveCount != 0; }
+};
+
+enum class BVHBuildMode
+{
+  BinnedSAH,  /// Top-down binned SAH build, for static geometry
+  LBVH        /// Parallel Morton-code build, for geometry rebuilt every frame
+};
+
+/// Parameters of the build
+struct BVHBuildSettings
+{
+  BVHBuildMode mode = BVHBuildMode::BinnedSAH;
+  uint32_t binCount = 16;         /// Number of bins along each axis when evaluating splits (SAH)
+  uint32_t maxLeafSize = 4;       /// Nodes with more primitives are always split (SAH). The LBVH
+                                  /// always stores one triangle per leaf
+  float traversalCost = 1.0f;     /// SAH cost of traversing an interior node
+  float intersectionCost = 1.0f;  /// SAH cost of intersecting a triangle
+  uint32_t mortonCodeBits = 30;   /// 30 or 63 bits Morton codes (LBVH). 63-bit codes separate
+                                  /// the triangles of large meshes better, at the cost of more
+                                  /// sorting passes
+  uint32_t treeletOptimizationPasses = 0; /// Number of treelet reordering passes (LBVH)
+};
+
+/// Statistics gathered during the build
+struct BVHBuildStats
+{
+  BVHBuildMode mode = BVHBuildMode::BinnedSAH;
+  double buildMilliseconds = 0.0;
+  double trianglesPerSecond = 0.0;
+  double sahCost = 0.0;           /// SAH cost of the whole tree, relative to the root area
+  uint32_t threadCount = 0;
+  uint32_t triangleCount = 0;
+  uint32_t nodeCount = 0;
+  uint32_t leafCount = 0;
+  uint32_t maxDepth = 0;
+  uint32_t binCount = 0;
+  uint32_t maxLeafSize = 0;
+  float averageLeafSize = 0.0f;
+};
+
+/// Result of a build. Primitives are identified by a global triangle index: the
+/// triangles of geometry g start at geometryTriangleOffsets[g]
+struct BottomLevelBVH
+{
+  std::vector<BVHNode> nodes;               /// Root is nodes[0]
+  std::vector<uint32_t> primitiveIndices;   /// Triangle indices, in leaf order
+  std::vector<uint32_t> geometryTriangleOffsets;
+  std::vector<uint8_t> geometryOpaque;      /// 1 if the geometry was added as opaque
+  BVHBuildStats stats;
+};
+
+/// Helper class to generate bottom-level hierarchies on the CPU
+class BottomLevelBVHBuilder
+{
+public:
+  /// Add a vertex buffer in CPU memory into the hierarchy. The vertices are
+  /// supposed to be represented by 3 float32 value. Indices are implicit.
+  void AddVertexBuffer(const void* vertexData,       /// Buffer containing the vertex coordinates,
+                                                     /// possibly interleaved with other vertex data
+                       uint64_t vertexOffsetInBytes, /// Offset of the first vertex in the vertex
+                                                     /// buffer
+                       uint32_t vertexCount,         /// Number of vertices to consider
+                                                     /// in the buffer
+                       uint32_t vertexSizeInBytes,   /// Size of a vertex including all
+                                                     /// its other data, used to stride
+                                                     /// in the buffer
+                       bool isOpaque = true /// If true, the geometry is considered opaque
+  );
+
+  /// Add a vertex buffer along with its index buffer in CPU memory into the hierarchy.
+  /// The vertices are supposed to be represented by 3 float32 value, and the indices are 32-bit
+  /// unsigned ints
+  void AddVertexBuffer(const void* vertexData,       /// Buffer containing the vertex coordinates,
+                                                     /// possibly interleaved with other vertex data
+                       uint64_t vertexOffsetInBytes, /// Offset of the first vertex in the vertex
+                                                     /// buffer
+                       uint32_t vertexCount,         /// Number of vertices to consider
+                                                     /// in the buffer
+                       uint32_t vertexSizeInBytes,   /// Size of a vertex including
+                                                     /// all its other data,
+                                                     /// used to stride in the buffer
+                       const uint32_t* indexData,    /// Buffer containing the vertex indices
+                                                     /// describing the triangles
+                       uint64_t indexOffsetInBytes,  /// Offset of the first index in
+                                                     /// the index buffer
+                       uint32_t indexCount,          /// Number of indices to consider in the buffer
+                       bool isOpaque = true /// If true, the geometry is considered opaque
+  );
+
+  /// Total number of triangles added so far
+  uint32_t GetTriangleCount() const;
+
+  /// Fetch the vertex positions of a triangle from its global index
+  void GetTriangle(uint32_t triangleIndex, float v0[3], float v1[3], float v2[3]) const;
+
+  /// Build the hierarchy of all the geometry added so far
+  void Generate(BottomLevelBVH& result, /// Hierarchy and build statistics
+                const BVHBuildSettings& settings = {}, /// Build mode, bin count, leaf size and
+                                                       /// SAH costs
+                ThreadPool* threadPool = nullptr /// Threads used by the build. If nullptr, the
+                                                 /// binned SAH build runs on the calling thread
+                                                 /// and the LBVH build creates a temporary pool
+  ) const;
+
+private:
+  /// CPU equivalent of the D3D12_RAYTRACING_GEOMETRY_TRIANGLES_DESC
+  struct GeometryDesc
+  {
+    const uint8_t* vertexData;
+    uint32_t vertexCount;
+    uint32_t vertexStrideInBytes;
+    const uint32_t* indexData; /// nullptr for non-indexed geometry
+    uint32_t indexCount;
+    uint32_t firstTriangle;
+    bool isOpaque;
+  };
+
+  /// Geometry descriptors used to generate the hierarchy
+  std::vector<GeometryDesc> m_geometries = {};
+
+  uint32_t m_triangleCount = 0;
+};
+} // namespace nv_helpers_dx12
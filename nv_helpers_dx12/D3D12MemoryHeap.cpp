@@ -0,0 +1,96 @@
+#include "D3D12MemoryHeap.h"
+
+namespace nv_helpers_dx12
+{
+
+//--------------------------------------------------------------------------------------------------
+// Create the buffer backing the page. Committed buffers are 64KB aligned, which
+// satisfies all the placement alignments of the allocations. Upload pages are
+// persistently mapped
+D3D12MemoryHeap::D3D12MemoryHeap(ID3D12Device* device, uint64_t sizeInBytes,
+                                 const D3D12_HEAP_PROPERTIES& heapProps, D3D12_RESOURCE_FLAGS flags,
+                                 D3D12_RESOURCE_STATES initialState)
+    : m_size(sizeInBytes) {
+  D3D12_RESOURCE_DESC bufDesc = {};
+  bufDesc.Alignment = 0;
+  bufDesc.DepthOrArraySize = 1;
+  bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+  bufDesc.Flags = flags;
+  bufDesc.Format = DXGI_FORMAT_UNKNOWN;
+  bufDesc.Height = 1;
+  bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+  bufDesc.MipLevels = 1;
+  bufDesc.SampleDesc.Count = 1;
+  bufDesc.SampleDesc.Quality = 0;
+  bufDesc.Width = sizeInBytes;
+
+  HRESULT hr = device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &bufDesc,
+                                               initialState, nullptr, IID_PPV_ARGS(&m_resource));
+  if (FAILED(hr))
+  {
+    throw std::logic_error("Could not create the buffer of a memory pool page");
+  }
+
+  if (heapProps.Type == D3D12_HEAP_TYPE_UPLOAD)
+  {
+    // We do not intend to read from this resource on the CPU
+    D3D12_RANGE readRange = {0, 0};
+    hr = m_resource->Map(0, &readRange, reinterpret_cast<void**>(&m_mappedData));
+    if (FAILED(hr))
+    {
+      throw std::logic_error("Could not map the buffer of a memory pool page");
+    }
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Unmap upload pages, the resource itself is released by its ComPtr
+D3D12MemoryHeap::~D3D12MemoryHeap() {
+  if (m_mappedData)
+  {
+    m_resource->Unmap(0, nullptr);
+  }
+}
+
+uint64_t D3D12MemoryHeap::GetSize() const {
+  return m_size;
+}
+
+uint64_t D3D12MemoryHeap::GetGPUAddress() const {
+  return m_resource->GetGPUVirtualAddress();
+}
+
+uint8_t* D3D12MemoryHeap::GetCPUAddress() const {
+  return m_mappedData;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+D3D12MemoryHeapFactory::D3D12MemoryHeapFactory(ID3D12Device* device,
+                                               const D3D12_HEAP_PROPERTIES& heapProps,
+                                               D3D12_RESOURCE_FLAGS flags,
+                                               D3D12_RESOURCE_STATES initialState)
+    : m_device(device), m_heapProps(heapProps), m_flags(flags), m_initialState(initialState) {
+  static_assert(MemoryAlignment::ConstantBuffer == D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT,
+                "Constant buffer alignment mismatch");
+  static_assert(MemoryAlignment::AccelerationStructure ==
+                    D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT,
+                "Acceleration structure alignment mismatch");
+  static_assert(MemoryAlignment::ShaderTable == D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT,
+                "Shader table alignment mismatch");
+  static_assert(MemoryAlignment::ShaderRecord == D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT,
+                "Shader record alignment mismatch");
+  static_assert(MemoryAlignment::InstanceDescs == D3D12_RAYTRACING_INSTANCE_DESCS_BYTE_ALIGNMENT,
+                "Instance descriptors alignment mismatch");
+  static_assert(MemoryAlignment::Heap == D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT,
+                "Heap alignment mismatch");
+}
+
+//--------------------------------------------------------------------------------------------------
+// Create a page with the heap type, flags and initial state of the factory
+std::unique_ptr<MemoryHeap> D3D12MemoryHeapFactory::CreateHeap(uint64_t sizeInBytes) {
+  return std::unique_ptr<MemoryHeap>(
+      new D3D12MemoryHeap(m_device, sizeInBytes, m_heapProps, m_flags, m_initialState));
+}
+} // namespace nv_helpers_dx12
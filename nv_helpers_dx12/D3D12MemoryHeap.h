@@ -0,0 +1,72 @@
+/*
+D3D12 backing of the MemoryPool pages. Each page is a single buffer resource,
+whose GPU virtual address range is shared by all the allocations of the page.
+Upload pages are mapped once at creation and stay mapped until destruction, as
+allowed for upload heaps, so that the allocations can be written through their
+CPU address at any time.
+
+All the pages of a factory use the same heap type, resource flags and initial
+state: a pool for acceleration structures uses a default heap with the
+ALLOW_UNORDERED_ACCESS flag in the RAYTRACING_ACCELERATION_STRUCTURE state,
+while a pool of constant buffers uses an upload heap in the GENERIC_READ state.
+Use D3D12MemoryHeap::GetResource to access the resource of an allocation, for
+example to issue barriers.
+
+
+Example:
+
+D3D12MemoryHeapFactory uploadHeaps(device, kUploadHeapProps, D3D12_RESOURCE_FLAG_NONE,
+                                   D3D12_RESOURCE_STATE_GENERIC_READ);
+MemoryPool constants(uploadHeaps, MemoryPoolDesc{AllocationStrategy::Linear, 64 * 1024});
+
+*/
+
+#pragma once
+
+#include "d3d12.h"
+
+#include "MemoryAllocator.h"
+
+#include <wrl/client.h>
+
+namespace nv_helpers_dx12
+{
+
+/// Page of a MemoryPool, stored in a D3D12 buffer
+class D3D12MemoryHeap : public MemoryHeap
+{
+public:
+  D3D12MemoryHeap(ID3D12Device* device, uint64_t sizeInBytes, const D3D12_HEAP_PROPERTIES& heapProps,
+                  D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES initialState);
+  ~D3D12MemoryHeap() override;
+
+  uint64_t GetSize() const override;
+  uint64_t GetGPUAddress() const override;
+  uint8_t* GetCPUAddress() const override;
+
+  /// Buffer containing the allocations of the page
+  ID3D12Resource* GetResource() const { return m_resource.Get(); }
+
+private:
+  Microsoft::WRL::ComPtr<ID3D12Resource> m_resource;
+  uint64_t m_size;
+  uint8_t* m_mappedData = nullptr;
+};
+
+/// Creates the pages of a MemoryPool as D3D12 buffers
+class D3D12MemoryHeapFactory : public MemoryHeapFactory
+{
+public:
+  /// The device must outlive the factory
+  D3D12MemoryHeapFactory(ID3D12Device* device, const D3D12_HEAP_PROPERTIES& heapProps,
+                         D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES initialState);
+
+  std::unique_ptr<MemoryHeap> CreateHeap(uint64_t sizeInBytes) override;
+
+private:
+  ID3D12Device* m_device;
+  D3D12_HEAP_PROPERTIES m_heapProps;
+  D3D12_RESOURCE_FLAGS m_flags;
+  D3D12_RESOURCE_STATES m_initialState;
+};
+} // namespace nv_helpers_dx12
@@ -0,0 +1,64 @@
+#include "D3D12TimelineFence.h"
+
+namespace nv_helpers_dx12
+{
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+D3D12TimelineFence::D3D12TimelineFence(ID3D12Device* device, ID3D12CommandQueue* commandQueue)
+    : m_commandQueue(commandQueue) {
+  HRESULT hr = device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence));
+  if (FAILED(hr))
+  {
+    throw std::logic_error("Could not create the frame fence");
+  }
+
+  m_event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+  if (m_event == nullptr)
+  {
+    throw std::logic_error("Could not create the frame fence event");
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+D3D12TimelineFence::~D3D12TimelineFence() {
+  if (m_event)
+  {
+    CloseHandle(m_event);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+void D3D12TimelineFence::Signal(uint64_t value) {
+  HRESULT hr = m_commandQueue->Signal(m_fence.Get(), value);
+  if (FAILED(hr))
+  {
+    throw std::logic_error("Could not signal the frame fence");
+  }
+}
+
+uint64_t D3D12TimelineFence::GetCompletedValue() {
+  return m_fence->GetCompletedValue();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+void D3D12TimelineFence::Wait(uint64_t value) {
+  if (m_fence->GetCompletedValue() >= value)
+  {
+    return;
+  }
+  HRESULT hr = m_fence->SetEventOnCompletion(value, m_event);
+  if (FAILED(hr))
+  {
+    throw std::logic_error("Could not wait for the frame fence");
+  }
+  WaitForSingleObject(m_event, INFINITE);
+}
+} // namespace nv_helpers_dx12
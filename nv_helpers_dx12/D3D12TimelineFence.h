@@ -0,0 +1,44 @@
+/*
+D3D12 implementation of the TimelineFence used by the FrameContextRing. The
+values are signaled on a command queue, after the command lists submitted
+before, and the CPU waits on them through an event.
+
+
+Example:
+
+D3D12TimelineFence fence(device, commandQueue);
+FrameContextRing ring(fence, FrameCount);
+
+*/
+
+#pragma once
+
+#include "d3d12.h"
+
+#include "FrameContextRing.h"
+
+#include <wrl/client.h>
+
+namespace nv_helpers_dx12
+{
+
+class D3D12TimelineFence : public TimelineFence
+{
+public:
+  /// The queue must outlive the fence
+  D3D12TimelineFence(ID3D12Device* device, ID3D12CommandQueue* commandQueue);
+  ~D3D12TimelineFence() override;
+
+  D3D12TimelineFence(const D3D12TimelineFence&) = delete;
+  D3D12TimelineFence& operator=(const D3D12TimelineFence&) = delete;
+
+  void Signal(uint64_t value) override;
+  uint64_t GetCompletedValue() override;
+  void Wait(uint64_t value) override;
+
+private:
+  ID3D12CommandQueue* m_commandQueue;
+  Microsoft::WRL::ComPtr<ID3D12Fence> m_fence;
+  HANDLE m_event = nullptr;
+};
+} // namespace nv_helpers_dx12
@@ -0,0 +1,143 @@
+#include "FrameContextRing.h"
+
+#include <chrono>
+
+namespace nv_helpers_dx12
+{
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+SoftwareFence::SoftwareFence(uint32_t latencyInSignals) : m_latency(latencyInSignals) {}
+
+//--------------------------------------------------------------------------------------------------
+// Enqueue the signal, and complete the signals which are now more than the latency behind
+void SoftwareFence::Signal(uint64_t value) {
+  uint64_t lastValue = m_pendingValues.empty() ? m_completedValue : m_pendingValues.back();
+  if (value <= lastValue)
+  {
+    throw std::logic_error("Fence values must increase with each signal");
+  }
+  m_pendingValues.push_back(value);
+  while (m_pendingValues.size() > m_latency)
+  {
+    Advance();
+  }
+}
+
+uint64_t SoftwareFence::GetCompletedValue() {
+  return m_completedValue;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+void SoftwareFence::Wait(uint64_t value) {
+  while (m_completedValue < value)
+  {
+    if (m_pendingValues.empty())
+    {
+      throw std::logic_error("Waiting for a fence value which was never signaled");
+    }
+    Advance();
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+void SoftwareFence::Advance(uint32_t signalCount) {
+  for (uint32_t i = 0; i < signalCount && !m_pendingValues.empty(); i++)
+  {
+    m_completedValue = m_pendingValues.front();
+    m_pendingValues.pop_front();
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+FrameContextRing::FrameContextRing(TimelineFence& fence, uint32_t frameCount)
+    : m_fence(fence), m_contextFenceValues(frameCount, 0) {
+  if (frameCount == 0)
+  {
+    throw std::logic_error("A frame ring requires at least one context");
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+FrameContextRing::~FrameContextRing() {
+  for (PendingRelease& pending : m_pendingReleases)
+  {
+    pending.release();
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// The context was last used GetFrameCount() frames ago. If the GPU is more than that many frames
+// behind, the CPU has to wait for it
+uint32_t FrameContextRing::BeginFrame() {
+  uint64_t contextFenceValue = m_contextFenceValues[m_frameIndex];
+  uint64_t completedValue = m_fence.GetCompletedValue();
+  if (completedValue < contextFenceValue)
+  {
+    auto start = std::chrono::steady_clock::now();
+    m_fence.Wait(contextFenceValue);
+    auto end = std::chrono::steady_clock::now();
+
+    m_stats.blockingWaits++;
+    m_stats.waitMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+    completedValue = m_fence.GetCompletedValue();
+  }
+
+  RunCompletedReleases(completedValue);
+  return m_frameIndex;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+uint64_t FrameContextRing::EndFrame() {
+  uint64_t fenceValue = m_nextFenceValue++;
+  m_fence.Signal(fenceValue);
+  m_contextFenceValues[m_frameIndex] = fenceValue;
+  m_frameIndex = (m_frameIndex + 1) % GetFrameCount();
+  m_stats.frameCount++;
+  return fenceValue;
+}
+
+//--------------------------------------------------------------------------------------------------
+// All the work submitted so far, as well as the frame being recorded, completes before the next
+// signal
+void FrameContextRing::DeferRelease(std::function<void()> release) {
+  m_pendingReleases.push_back({m_nextFenceValue, std::move(release)});
+  m_stats.pendingReleases = static_cast<uint32_t>(m_pendingReleases.size());
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+void FrameContextRing::WaitForIdle() {
+  uint64_t fenceValue = m_nextFenceValue++;
+  m_fence.Signal(fenceValue);
+  m_fence.Wait(fenceValue);
+  RunCompletedReleases(fenceValue);
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+void FrameContextRing::RunCompletedReleases(uint64_t completedValue) {
+  while (!m_pendingReleases.empty() && m_pendingReleases.front().fenceValue <= completedValue)
+  {
+    // Pop before calling, in case the release defers another one
+    std::function<void()> release = std::move(m_pendingReleases.front().release);
+    m_pendingReleases.pop_front();
+    release();
+    m_stats.releasedCount++;
+  }
+  m_stats.pendingReleases = static_cast<uint32_t>(m_pendingReleases.size());
+}
+} // namespace nv_helpers_dx12
@@ -0,0 +1,158 @@
+/*
+The FrameContextRing lets the CPU record frame N+1 while the GPU still executes
+frame N, instead of waiting for the GPU at the end of every frame. Each frame
+in flight has its own context, whose index the application uses to select the
+per-frame resources written by the CPU: command allocator, upload memory,
+instance descriptors ... A context is reused only once the GPU has reached the
+fence value signaled at the end of the frame which last used it.
+
+Resources which may still be referenced by the frames in flight are not
+released immediately: DeferRelease keeps them alive until the GPU has completed
+all the work submitted so far.
+
+The GPU progress is abstracted behind the TimelineFence interface, a monotonic
+counter signaled by the queue. D3D12TimelineFence wraps a ID3D12Fence, while
+SoftwareFence simulates a queue running a fixed number of frames behind the
+CPU. The software fence is deterministic, so that the scheduling can be tested
+and benchmarked without a device.
+
+
+Example:
+
+SoftwareFence fence(2); // The GPU completes a frame once 2 newer frames are submitted
+FrameContextRing ring(fence, 3);
+
+for (...)
+{
+  uint32_t frameIndex = ring.BeginFrame(); // Blocks if the context is still in use
+  ... reset the allocator and upload memory of frameIndex, record and submit
+  ring.EndFrame();
+}
+ring.WaitForIdle();
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+namespace nv_helpers_dx12
+{
+
+/// Monotonic counter signaled by a queue once the work submitted before the signal has completed
+class TimelineFence
+{
+public:
+  virtual ~TimelineFence() {}
+
+  /// Enqueue a signal of the value, after all the work submitted so far. Values must increase
+  virtual void Signal(uint64_t value) = 0;
+
+  /// Last value reached by the queue
+  virtual uint64_t GetCompletedValue() = 0;
+
+  /// Block the CPU until the queue reaches the value
+  virtual void Wait(uint64_t value) = 0;
+};
+
+/// Deterministic fence simulating a queue which completes a signal once a fixed number of newer
+/// signals have been enqueued, i.e. a GPU running that many frames behind the CPU
+class SoftwareFence : public TimelineFence
+{
+public:
+  /// With a latency of 0, each signal completes immediately
+  explicit SoftwareFence(uint32_t latencyInSignals = 0);
+
+  void Signal(uint64_t value) override;
+  uint64_t GetCompletedValue() override;
+
+  /// Complete all the signals up to the value, as if the CPU had idled until then. Waiting for
+  /// a value which was never signaled would deadlock, and throws instead
+  void Wait(uint64_t value) override;
+
+  /// Complete the oldest pending signals, simulating the progress of the queue
+  void Advance(uint32_t signalCount = 1);
+
+  /// Number of signals enqueued but not completed yet
+  uint32_t GetPendingSignalCount() const { return static_cast<uint32_t>(m_pendingValues.size()); }
+
+private:
+  uint32_t m_latency;
+  uint64_t m_completedValue = 0;
+  std::deque<uint64_t> m_pendingValues;
+};
+
+/// Scheduling statistics of a ring
+struct FrameRingStats
+{
+  uint64_t frameCount = 0;       /// Frames ended so far
+  uint32_t blockingWaits = 0;    /// Calls to BeginFrame which had to wait for the GPU
+  double waitMilliseconds = 0.0; /// Time spent in those waits
+  uint32_t releasedCount = 0;    /// Deferred releases executed
+  uint32_t pendingReleases = 0;  /// Deferred releases waiting for the GPU
+};
+
+/// Ring of frame contexts, each one reused once the GPU has finished the frame which last used it
+class FrameContextRing
+{
+public:
+  /// The fence must outlive the ring
+  FrameContextRing(TimelineFence& fence, uint32_t frameCount);
+
+  /// Run the pending releases, so that no resource outlives the ring. The GPU must be idle
+  ~FrameContextRing();
+
+  FrameContextRing(const FrameContextRing&) = delete;
+  FrameContextRing& operator=(const FrameContextRing&) = delete;
+
+  /// Wait until the GPU has finished with the current context, and run the releases whose work
+  /// has completed. Returns the index of the context, which selects the per-frame resources
+  uint32_t BeginFrame();
+
+  /// Signal the fence after the work of the frame has been submitted, and move to the next
+  /// context. Returns the fence value of the frame
+  uint64_t EndFrame();
+
+  /// Call the release function once the GPU has completed all the work submitted so far,
+  /// including the frame being recorded. Captured ComPtrs are released along with the function
+  void DeferRelease(std::function<void()> release);
+
+  /// Signal the fence and wait for it, then run all the pending releases
+  void WaitForIdle();
+
+  /// Index of the current context. Work recorded before the first BeginFrame uses context 0
+  uint32_t GetFrameIndex() const { return m_frameIndex; }
+  uint32_t GetFrameCount() const { return static_cast<uint32_t>(m_contextFenceValues.size()); }
+
+  /// Fence value which will be signaled by the next call to EndFrame or WaitForIdle
+  uint64_t GetNextFenceValue() const { return m_nextFenceValue; }
+
+  const FrameRingStats& GetStats() const { return m_stats; }
+
+private:
+  /// Run the releases whose fence value has been reached
+  void RunCompletedReleases(uint64_t completedValue);
+
+  struct PendingRelease
+  {
+    uint64_t fenceValue;
+    std::function<void()> release;
+  };
+
+  TimelineFence& m_fence;
+  uint32_t m_frameIndex = 0;
+  uint64_t m_nextFenceValue = 1;
+
+  /// Fence value signaled at the end of the last frame of each context, 0 if never used
+  std::vector<uint64_t> m_contextFenceValues;
+
+  /// Releases sorted by fence value, as the values increase with each submission
+  std::deque<PendingRelease> m_pendingReleases;
+
+  FrameRingStats m_stats;
+};
+} // namespace nv_helpers_dx12
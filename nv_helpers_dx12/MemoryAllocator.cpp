@@ -0,0 +1,379 @@
+#include "MemoryAllocator.h"
+
+#include <algorithm>
+
+// Helper to compute aligned buffer sizes
+#ifndef ROUND_UP
+#define ROUND_UP(v, powerOf2Alignment) (((v) + (powerOf2Alignment)-1) & ~((powerOf2Alignment)-1))
+#endif
+
+namespace nv_helpers_dx12
+{
+
+namespace
+{
+bool IsPowerOfTwo(uint64_t v)
+{
+  return v != 0 && (v & (v - 1)) == 0;
+}
+
+uint64_t NextPowerOfTwo(uint64_t v)
+{
+  uint64_t result = 1;
+  while (result < v)
+  {
+    result <<= 1;
+  }
+  return result;
+}
+
+uint32_t Log2(uint64_t powerOfTwo)
+{
+  uint32_t result = 0;
+  while (powerOfTwo > 1)
+  {
+    powerOfTwo >>= 1;
+    result++;
+  }
+  return result;
+}
+} // namespace
+
+//--------------------------------------------------------------------------------------------------
+// Allocate the storage with enough room to align its start as a D3D12 heap
+CpuMemoryHeap::CpuMemoryHeap(uint64_t sizeInBytes, uint64_t gpuAddress)
+    : m_storage(new uint8_t[sizeInBytes + MemoryAlignment::Heap]), m_size(sizeInBytes),
+      m_gpuAddress(gpuAddress) {
+  uintptr_t start = reinterpret_cast<uintptr_t>(m_storage.get());
+  m_alignedStart = m_storage.get() + (ROUND_UP(start, MemoryAlignment::Heap) - start);
+}
+
+uint64_t CpuMemoryHeap::GetSize() const {
+  return m_size;
+}
+
+uint64_t CpuMemoryHeap::GetGPUAddress() const {
+  return m_gpuAddress;
+}
+
+uint8_t* CpuMemoryHeap::GetCPUAddress() const {
+  return m_alignedStart;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Create a heap in system memory. The fake GPU address ranges of the heaps are
+// separated by a gap, so that overflows from one heap to the next are visible
+std::unique_ptr<MemoryHeap> CpuMemoryHeapFactory::CreateHeap(uint64_t sizeInBytes) {
+  std::unique_ptr<MemoryHeap> heap(new CpuMemoryHeap(sizeInBytes, m_nextGPUAddress));
+  m_nextGPUAddress += ROUND_UP(sizeInBytes, MemoryAlignment::Heap) + MemoryAlignment::Heap;
+  m_heapCount++;
+  return heap;
+}
+
+//--------------------------------------------------------------------------------------------------
+// The whole range starts as a single free block of level 0
+BuddyAllocator::BuddyAllocator(uint64_t sizeInBytes, uint64_t minBlockSizeInBytes)
+    : m_size(sizeInBytes), m_minBlockSize(minBlockSizeInBytes), m_freeBytes(sizeInBytes) {
+  if (!IsPowerOfTwo(minBlockSizeInBytes) || sizeInBytes % minBlockSizeInBytes != 0 ||
+      !IsPowerOfTwo(sizeInBytes / minBlockSizeInBytes))
+  {
+    throw std::logic_error(
+        "Buddy allocator size must be a power of two multiple of the minimum block size");
+  }
+
+  m_freeBlocks.resize(Log2(sizeInBytes / minBlockSizeInBytes) + 1);
+  m_freeBlocks[0].insert(0);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Find the smallest free block which can hold the allocation, and split it
+// until it has the required size. The upper halves go back to the free lists
+uint64_t BuddyAllocator::Allocate(uint64_t sizeInBytes, uint64_t alignment) {
+  uint64_t blockSize = std::max(NextPowerOfTwo(std::max(sizeInBytes, alignment)), m_minBlockSize);
+  if (blockSize > m_size)
+  {
+    return kInvalidOffset;
+  }
+
+  const uint32_t level = GetLevel(blockSize);
+  int32_t sourceLevel = static_cast<int32_t>(level);
+  while (sourceLevel >= 0 && m_freeBlocks[sourceLevel].empty())
+  {
+    sourceLevel--;
+  }
+  if (sourceLevel < 0)
+  {
+    return kInvalidOffset;
+  }
+
+  uint64_t offset = *m_freeBlocks[sourceLevel].begin();
+  m_freeBlocks[sourceLevel].erase(m_freeBlocks[sourceLevel].begin());
+  for (uint32_t l = static_cast<uint32_t>(sourceLevel) + 1; l <= level; l++)
+  {
+    m_freeBlocks[l].insert(offset + GetLevelBlockSize(l));
+  }
+
+  m_allocatedLevels[offset] = level;
+  m_freeBytes -= blockSize;
+  return offset;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return a block to the free lists. As long as the buddy of the block is free,
+// both are merged into the block of the level above
+void BuddyAllocator::Free(uint64_t offset) {
+  auto it = m_allocatedLevels.find(offset);
+  if (it == m_allocatedLevels.end())
+  {
+    throw std::logic_error("Freeing a block which has not been allocated");
+  }
+
+  uint32_t level = it->second;
+  m_allocatedLevels.erase(it);
+  m_freeBytes += GetLevelBlockSize(level);
+
+  while (level > 0)
+  {
+    uint64_t buddy = offset ^ GetLevelBlockSize(level);
+    auto buddyIt = m_freeBlocks[level].find(buddy);
+    if (buddyIt == m_freeBlocks[level].end())
+    {
+      break;
+    }
+    m_freeBlocks[level].erase(buddyIt);
+    offset = std::min(offset, buddy);
+    level--;
+  }
+  m_freeBlocks[level].insert(offset);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Size of the block actually reserved for an allocation
+uint64_t BuddyAllocator::GetBlockSize(uint64_t offset) const {
+  auto it = m_allocatedLevels.find(offset);
+  if (it == m_allocatedLevels.end())
+  {
+    throw std::logic_error("Querying a block which has not been allocated");
+  }
+  return GetLevelBlockSize(it->second);
+}
+
+//--------------------------------------------------------------------------------------------------
+// The largest free block is the one of the lowest level with a free block
+uint64_t BuddyAllocator::GetLargestFreeBlock() const {
+  for (uint32_t l = 0; l < m_freeBlocks.size(); l++)
+  {
+    if (!m_freeBlocks[l].empty())
+    {
+      return GetLevelBlockSize(l);
+    }
+  }
+  return 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Level of the blocks of a given size, level 0 being the whole range
+uint32_t BuddyAllocator::GetLevel(uint64_t blockSize) const {
+  return Log2(m_size / blockSize);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Validate the description of the pool. Buddy pages are powers of two
+MemoryPool::MemoryPool(MemoryHeapFactory& heapFactory, const MemoryPoolDesc& desc /* = {} */)
+    : m_heapFactory(heapFactory), m_desc(desc) {
+  if (m_desc.pageSizeInBytes == 0)
+  {
+    throw std::logic_error("The page size of a memory pool cannot be 0");
+  }
+  if (m_desc.strategy == AllocationStrategy::Buddy)
+  {
+    if (!IsPowerOfTwo(m_desc.minBlockSizeInBytes))
+    {
+      throw std::logic_error("The minimum block size must be a power of two");
+    }
+    m_desc.pageSizeInBytes =
+        std::max(NextPowerOfTwo(m_desc.pageSizeInBytes), m_desc.minBlockSizeInBytes);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Place the allocation in the first page with enough room, or in a new page
+MemoryAllocation MemoryPool::Allocate(uint64_t sizeInBytes, uint64_t alignment) {
+  if (!IsPowerOfTwo(alignment) || alignment > MemoryAlignment::Heap)
+  {
+    throw std::logic_error("Allocation alignment must be a power of two, at most 64KB");
+  }
+  if (sizeInBytes == 0)
+  {
+    throw std::logic_error("Cannot allocate 0 bytes");
+  }
+
+  MemoryAllocation allocation;
+  for (uint32_t i = 0; i < static_cast<uint32_t>(m_pages.size()); i++)
+  {
+    if (AllocateInPage(i, sizeInBytes, alignment, allocation))
+    {
+      return allocation;
+    }
+  }
+
+  uint32_t pageIndex = AddPage(sizeInBytes, alignment);
+  if (!AllocateInPage(pageIndex, sizeInBytes, alignment, allocation))
+  {
+    throw std::logic_error("Allocation does not fit in a newly created page");
+  }
+  return allocation;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Try to place an allocation in an existing page
+bool MemoryPool::AllocateInPage(uint32_t pageIndex, uint64_t sizeInBytes, uint64_t alignment,
+                                MemoryAllocation& allocation) {
+  Page& page = m_pages[pageIndex];
+  uint64_t offset;
+  uint64_t allocatedBytes;
+
+  if (m_desc.strategy == AllocationStrategy::Buddy)
+  {
+    offset = page.buddy->Allocate(sizeInBytes, alignment);
+    if (offset == BuddyAllocator::kInvalidOffset)
+    {
+      return false;
+    }
+    allocatedBytes = page.buddy->GetBlockSize(offset);
+  }
+  else
+  {
+    offset = ROUND_UP(page.linearOffset, alignment);
+    if (offset + sizeInBytes > page.heap->GetSize())
+    {
+      return false;
+    }
+    allocatedBytes = offset + sizeInBytes - page.linearOffset;
+    page.linearOffset = offset + sizeInBytes;
+  }
+
+  page.allocationCount++;
+  page.requestedBytes += sizeInBytes;
+  page.allocatedBytes += allocatedBytes;
+
+  allocation.heap = page.heap.get();
+  allocation.offset = offset;
+  allocation.size = sizeInBytes;
+  allocation.gpuAddress = page.heap->GetGPUAddress() + offset;
+  uint8_t* cpuAddress = page.heap->GetCPUAddress();
+  allocation.cpuAddress = cpuAddress ? cpuAddress + offset : nullptr;
+  allocation.pageIndex = pageIndex;
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Add a page large enough for the allocation. Allocations larger than the page
+// size get a dedicated page
+uint32_t MemoryPool::AddPage(uint64_t sizeInBytes, uint64_t alignment) {
+  uint64_t pageSize = m_desc.pageSizeInBytes;
+  if (m_desc.strategy == AllocationStrategy::Buddy)
+  {
+    uint64_t blockSize =
+        std::max(NextPowerOfTwo(std::max(sizeInBytes, alignment)), m_desc.minBlockSizeInBytes);
+    pageSize = std::max(pageSize, blockSize);
+  }
+  else
+  {
+    pageSize = std::max(pageSize, sizeInBytes);
+  }
+
+  Page page;
+  page.heap = m_heapFactory.CreateHeap(pageSize);
+  if (!page.heap || page.heap->GetSize() < pageSize)
+  {
+    throw std::logic_error("The heap factory returned a heap smaller than requested");
+  }
+  if (page.heap->GetGPUAddress() % MemoryAlignment::Heap != 0)
+  {
+    throw std::logic_error("The heap factory returned a heap which is not 64KB aligned");
+  }
+  if (m_desc.strategy == AllocationStrategy::Buddy)
+  {
+    page.buddy.reset(new BuddyAllocator(pageSize, m_desc.minBlockSizeInBytes));
+  }
+
+  m_pages.push_back(std::move(page));
+  return static_cast<uint32_t>(m_pages.size() - 1);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Release an allocation. Only supported by the buddy strategy
+void MemoryPool::Free(const MemoryAllocation& allocation) {
+  if (m_desc.strategy != AllocationStrategy::Buddy)
+  {
+    throw std::logic_error("Linear memory pools only release their allocations through Reset");
+  }
+  if (allocation.pageIndex >= m_pages.size() ||
+      m_pages[allocation.pageIndex].heap.get() != allocation.heap)
+  {
+    throw std::logic_error("Freeing an allocation which does not belong to this pool");
+  }
+
+  Page& page = m_pages[allocation.pageIndex];
+  page.allocatedBytes -= page.buddy->GetBlockSize(allocation.offset);
+  page.buddy->Free(allocation.offset);
+  page.allocationCount--;
+  page.requestedBytes -= allocation.size;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Release all the allocations at once, keeping the heaps for reuse. The
+// allocations must not be in use by the GPU anymore
+void MemoryPool::Reset() {
+  for (Page& page : m_pages)
+  {
+    if (page.buddy)
+    {
+      page.buddy.reset(new BuddyAllocator(page.heap->GetSize(), m_desc.minBlockSizeInBytes));
+    }
+    page.linearOffset = 0;
+    page.allocationCount = 0;
+    page.requestedBytes = 0;
+    page.allocatedBytes = 0;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Accumulate the statistics of all the pages
+MemoryPoolStats MemoryPool::GetStats() const {
+  MemoryPoolStats stats;
+  stats.pageCount = static_cast<uint32_t>(m_pages.size());
+
+  // An allocation never spans pages, so the free space of each page is only
+  // fragmented if it is not a single block
+  uint64_t contiguousFreeBytes = 0;
+  for (const Page& page : m_pages)
+  {
+    const uint64_t heapSize = page.heap->GetSize();
+    stats.allocationCount += page.allocationCount;
+    stats.reservedBytes += heapSize;
+    stats.requestedBytes += page.requestedBytes;
+    stats.allocatedBytes += page.allocatedBytes;
+
+    uint64_t freeBytes = page.buddy ? page.buddy->GetFreeBytes() : heapSize - page.linearOffset;
+    uint64_t largestFreeBlock =
+        page.buddy ? page.buddy->GetLargestFreeBlock() : heapSize - page.linearOffset;
+    stats.freeBytes += freeBytes;
+    stats.largestFreeBlock = std::max(stats.largestFreeBlock, largestFreeBlock);
+    contiguousFreeBytes += largestFreeBlock;
+  }
+
+  if (stats.reservedBytes > 0)
+  {
+    stats.utilization = static_cast<float>(static_cast<double>(stats.requestedBytes) /
+                                           static_cast<double>(stats.reservedBytes));
+  }
+  if (stats.freeBytes > 0)
+  {
+    stats.fragmentation = 1.0f - static_cast<float>(static_cast<double>(contiguousFreeBytes) /
+                                                    static_cast<double>(stats.freeBytes));
+  }
+  return stats;
+}
+} // namespace nv_helpers_dx12
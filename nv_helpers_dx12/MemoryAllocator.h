@@ -0,0 +1,264 @@
+/*
+The MemoryPool suballocates buffers from a small number of large heaps, instead
+of creating one committed resource per buffer as CreateBuffer does. Each
+allocation is a range of a heap, identified by its offset, with its GPU virtual
+address and, for CPU-visible heaps, its CPU address. Constant buffers, shader
+tables and acceleration structures can then be referenced by their GPU address
+while thousands of them share a single resource.
+
+The heaps are created on demand by a MemoryHeapFactory, in pages of a fixed
+size. Allocations larger than a page get a dedicated heap. The memory is
+abstracted behind the MemoryHeap interface: D3D12MemoryHeap backs the pages with
+a buffer resource, and CpuMemoryHeap with system memory, so that the allocation
+logic can be exercised without a device.
+
+Two strategies are available:
+- Buddy: each page is split into power-of-two blocks, and freed blocks are merged
+  back with their buddy. Suited to long-lived allocations in default heaps, such
+  as acceleration structures
+- Linear: allocations are appended to the current page and are only released all
+  at once by Reset. Suited to upload heaps written by the CPU, such as per-frame
+  or per-instance constants
+
+Allocations are aligned to the requirements of their use, see MemoryAlignment.
+The pool reports its utilization (live bytes over reserved bytes) and the
+fragmentation of its free space, to tune the page size.
+
+The sample itself only pools the buffers written by the CPU: the material table,
+the camera constants and the per-frame draw instance indices, in linear upload
+pools. The acceleration structures and their scratch buffers remain committed
+resources created by CreateBuffer. The AS generators take an ID3D12Resource and
+insert UAV barriers on it, which for a pooled range would synchronize the whole
+page, and placing them in a pool would require passing GPU address ranges
+through the generators instead. The buddy strategy is covered by the tests of
+the host build (tests/MemoryAllocatorTests.cpp).
+
+
+Example:
+
+CpuMemoryHeapFactory factory;
+MemoryPool pool(factory, MemoryPoolDesc{AllocationStrategy::Linear, 64 * 1024});
+
+MemoryAllocation cb = pool.Allocate(sizeof(Material), MemoryAlignment::ConstantBuffer);
+memcpy(cb.cpuAddress, &material, sizeof(Material));
+... use cb.gpuAddress as a root constant buffer view
+
+MemoryPoolStats stats = pool.GetStats();
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+namespace nv_helpers_dx12
+{
+
+/// Placement alignments required by D3D12, in bytes
+namespace MemoryAlignment
+{
+static const uint64_t ConstantBuffer = 256;        /// D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT
+static const uint64_t AccelerationStructure = 256; /// D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT,
+                                                   /// also used for the scratch buffers
+static const uint64_t ShaderTable = 64;            /// D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT
+static const uint64_t ShaderRecord = 32;           /// D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT
+static const uint64_t InstanceDescs = 16;          /// D3D12_RAYTRACING_INSTANCE_DESCS_BYTE_ALIGNMENT
+static const uint64_t Heap = 65536;                /// D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, the
+                                                   /// alignment of the start of every heap
+} // namespace MemoryAlignment
+
+/// Block of memory in which the allocations are placed
+class MemoryHeap
+{
+public:
+  virtual ~MemoryHeap() {}
+
+  /// Size of the heap in bytes
+  virtual uint64_t GetSize() const = 0;
+
+  /// GPU virtual address of the start of the heap
+  virtual uint64_t GetGPUAddress() const = 0;
+
+  /// CPU address of the start of the heap, nullptr if the heap is not visible from the CPU
+  virtual uint8_t* GetCPUAddress() const = 0;
+};
+
+/// Creates the heaps of a pool
+class MemoryHeapFactory
+{
+public:
+  virtual ~MemoryHeapFactory() {}
+
+  /// Create a heap of the given size. The start of the heap must be aligned on
+  /// MemoryAlignment::Heap
+  virtual std::unique_ptr<MemoryHeap> CreateHeap(uint64_t sizeInBytes) = 0;
+};
+
+/// Heap in system memory, with fake GPU addresses. Used to run the allocator
+/// without a device
+class CpuMemoryHeap : public MemoryHeap
+{
+public:
+  CpuMemoryHeap(uint64_t sizeInBytes, uint64_t gpuAddress);
+
+  uint64_t GetSize() const override;
+  uint64_t GetGPUAddress() const override;
+  uint8_t* GetCPUAddress() const override;
+
+private:
+  std::unique_ptr<uint8_t[]> m_storage;
+  uint8_t* m_alignedStart;
+  uint64_t m_size;
+  uint64_t m_gpuAddress;
+};
+
+/// Factory of CpuMemoryHeap, giving each heap a distinct GPU address range
+class CpuMemoryHeapFactory : public MemoryHeapFactory
+{
+public:
+  std::unique_ptr<MemoryHeap> CreateHeap(uint64_t sizeInBytes) override;
+
+  /// Number of heaps created so far
+  uint32_t GetHeapCount() const { return m_heapCount; }
+
+private:
+  uint64_t m_nextGPUAddress = MemoryAlignment::Heap;
+  uint32_t m_heapCount = 0;
+};
+
+/// Buddy allocator managing the offsets within a range of memory. Blocks are powers of two,
+/// hence aligned on their size
+class BuddyAllocator
+{
+public:
+  static const uint64_t kInvalidOffset = ~0ull;
+
+  /// The size must be a power of two multiple of the minimum block size
+  BuddyAllocator(uint64_t sizeInBytes, uint64_t minBlockSizeInBytes);
+
+  /// Allocate a block of at least the given size and alignment. Returns kInvalidOffset if no
+  /// block is large enough
+  uint64_t Allocate(uint64_t sizeInBytes, uint64_t alignment);
+
+  /// Release a block returned by Allocate, merging it with its buddy when possible
+  void Free(uint64_t offset);
+
+  /// Size of the block actually reserved for an allocation
+  uint64_t GetBlockSize(uint64_t offset) const;
+
+  uint64_t GetFreeBytes() const { return m_freeBytes; }
+  uint64_t GetLargestFreeBlock() const;
+
+private:
+  /// Level of the blocks of a given size, level 0 being the whole range
+  uint32_t GetLevel(uint64_t blockSize) const;
+  uint64_t GetLevelBlockSize(uint32_t level) const { return m_size >> level; }
+
+  uint64_t m_size;
+  uint64_t m_minBlockSize;
+  uint64_t m_freeBytes;
+
+  /// Offsets of the free blocks of each level, sorted so that allocations are packed at the
+  /// start of the range
+  std::vector<std::set<uint64_t>> m_freeBlocks;
+
+  /// Level of each allocated block, by offset
+  std::map<uint64_t, uint32_t> m_allocatedLevels;
+};
+
+enum class AllocationStrategy
+{
+  Buddy, /// Individual allocations can be freed
+  Linear /// Allocations are only released all at once by Reset
+};
+
+/// Parameters of a pool
+struct MemoryPoolDesc
+{
+  AllocationStrategy strategy = AllocationStrategy::Buddy;
+  uint64_t pageSizeInBytes = 4 * 1024 * 1024; /// Size of the heaps, rounded up to a power of two
+                                              /// for the buddy strategy
+  uint64_t minBlockSizeInBytes = 256;         /// Smallest buddy block, also the granularity of
+                                              /// the allocations (buddy only)
+};
+
+/// Range of a heap returned by the pool
+struct MemoryAllocation
+{
+  MemoryHeap* heap = nullptr;
+  uint64_t offset = 0;     /// Offset in the heap
+  uint64_t size = 0;       /// Requested size
+  uint64_t gpuAddress = 0; /// Equivalent of a D3D12_GPU_VIRTUAL_ADDRESS
+  uint8_t* cpuAddress = nullptr; /// nullptr for heaps not visible from the CPU
+  uint32_t pageIndex = 0;
+
+  bool IsValid() const { return heap != nullptr; }
+};
+
+/// Usage statistics of a pool
+struct MemoryPoolStats
+{
+  uint32_t pageCount = 0;
+  uint32_t allocationCount = 0;     /// Live allocations
+  uint64_t reservedBytes = 0;       /// Total size of the heaps
+  uint64_t requestedBytes = 0;      /// Sum of the requested sizes of the live allocations
+  uint64_t allocatedBytes = 0;      /// Bytes taken by the live allocations, including rounding
+                                    /// and alignment padding
+  uint64_t freeBytes = 0;           /// Bytes which can still be allocated
+  uint64_t largestFreeBlock = 0;    /// Largest allocation which fits without a new page
+  float utilization = 0.0f;         /// requestedBytes / reservedBytes
+  float fragmentation = 0.0f;       /// 1 - (largest free block of each page) / freeBytes: 0 when
+                                    /// the free space of each page is contiguous, close to 1 when
+                                    /// it is scattered in small blocks
+};
+
+/// Suballocator of buffers within heaps created on demand
+class MemoryPool
+{
+public:
+  /// The factory must outlive the pool
+  MemoryPool(MemoryHeapFactory& heapFactory, const MemoryPoolDesc& desc = {});
+
+  MemoryPool(const MemoryPool&) = delete;
+  MemoryPool& operator=(const MemoryPool&) = delete;
+
+  /// Allocate a range of at least sizeInBytes bytes, whose GPU address is a multiple of the
+  /// alignment. The alignment must be a power of two, at most MemoryAlignment::Heap
+  MemoryAllocation Allocate(uint64_t sizeInBytes, uint64_t alignment);
+
+  /// Release an allocation. Only supported by the buddy strategy
+  void Free(const MemoryAllocation& allocation);
+
+  /// Release all the allocations at once, keeping the heaps for reuse
+  void Reset();
+
+  MemoryPoolStats GetStats() const;
+
+private:
+  struct Page
+  {
+    std::unique_ptr<MemoryHeap> heap;
+    std::unique_ptr<BuddyAllocator> buddy; /// Buddy strategy only
+    uint64_t linearOffset = 0;             /// Linear strategy only
+    uint32_t allocationCount = 0;
+    uint64_t requestedBytes = 0;
+    uint64_t allocatedBytes = 0;
+  };
+
+  /// Try to place an allocation in an existing page
+  bool AllocateInPage(uint32_t pageIndex, uint64_t sizeInBytes, uint64_t alignment,
+                      MemoryAllocation& allocation);
+
+  /// Add a page large enough for the allocation
+  uint32_t AddPage(uint64_t sizeInBytes, uint64_t alignment);
+
+  MemoryHeapFactory& m_heapFactory;
+  MemoryPoolDesc m_desc;
+  std::vector<Page> m_pages;
+};
+} // namespace nv_helpers_dx12
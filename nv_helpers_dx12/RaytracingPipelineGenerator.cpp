@@ -40,13 +40,86 @@ compiling in debug mode.
 */
 
 #include "RaytracingPipelineGenerator.h"
+#include "RootSignatureGenerator.h"
 
 #include "dxcapi.h"
+#include <algorithm>
+#include <cstring>
 #include <unordered_set>
 
 namespace nv_helpers_dx12
 {
 
+namespace
+{
+/// Version of the serialized descriptions, to be increased when their layout changes
+const UINT64 kDescriptionVersion = 2;
+
+void AppendValue(std::vector<uint8_t>& output, UINT64 value)
+{
+  uint8_t bytes[sizeof(value)];
+  memcpy(bytes, &value, sizeof(value));
+  output.insert(output.end(), bytes, bytes + sizeof(value));
+}
+
+/// Data prefixed with its size, so that the fields cannot be confused with each other
+void AppendBytes(std::vector<uint8_t>& output, const void* data, size_t size)
+{
+  AppendValue(output, size);
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  output.insert(output.end(), bytes, bytes + size);
+}
+
+void AppendString(std::vector<uint8_t>& output, const std::wstring& value)
+{
+  AppendBytes(output, value.data(), value.size() * sizeof(wchar_t));
+}
+
+void AppendSortedStrings(std::vector<uint8_t>& output, std::vector<std::wstring> values)
+{
+  std::sort(values.begin(), values.end());
+  AppendValue(output, values.size());
+  for (const std::wstring& value : values)
+  {
+    AppendString(output, value);
+  }
+}
+
+/// Append serialized elements in sorted order, which makes the output independent of the order in
+/// which the elements were added to the generator
+void AppendSortedElements(std::vector<uint8_t>& output, std::vector<std::vector<uint8_t>> elements)
+{
+  std::sort(elements.begin(), elements.end());
+  AppendValue(output, elements.size());
+  for (const std::vector<uint8_t>& element : elements)
+  {
+    AppendBytes(output, element.data(), element.size());
+  }
+}
+
+/// Identify a root signature by its serialized blob, or by its address if it does not carry one.
+/// Returns false in the latter case
+bool AppendRootSignature(std::vector<uint8_t>& output, ID3D12RootSignature* rootSignature)
+{
+  UINT size = 0;
+  if (rootSignature != nullptr &&
+      SUCCEEDED(rootSignature->GetPrivateData(SerializedRootSignatureGuid, &size, nullptr)) &&
+      size > 0)
+  {
+    std::vector<uint8_t> blob(size);
+    if (SUCCEEDED(rootSignature->GetPrivateData(SerializedRootSignatureGuid, &size, blob.data())))
+    {
+      AppendValue(output, 1);
+      AppendBytes(output, blob.data(), size);
+      return true;
+    }
+  }
+  AppendValue(output, 0);
+  AppendValue(output, reinterpret_cast<UINT64>(rootSignature));
+  return false;
+}
+} // namespace
+
 //--------------------------------------------------------------------------------------------------
 // The pipeline helper requires access to the device, as well as the
 // raytracing device prior to Windows 10 RS5.
@@ -131,21 +204,89 @@ void RayTracingPipelineGenerator::SetMaxRecursionDepth(UINT maxDepth)
   m_maxRecursionDepth = maxDepth;
 }
 
+//--------------------------------------------------------------------------------------------------
+//
+// Allow adding shaders to the generated state objects with GenerateAddition. This requires
+// raytracing tier 1.1, and a device implementing ID3D12Device7
+void RayTracingPipelineGenerator::SetAllowAdditions(bool allowAdditions)
+{
+  m_allowAdditions = allowAdditions;
+}
+
 //--------------------------------------------------------------------------------------------------
 //
 // Compiles the raytracing state object
 ID3D12StateObject* RayTracingPipelineGenerator::Generate()
+{
+  ID3D12StateObject* rtStateObject = CreateStateObject(0, 0, 0, nullptr);
+  MarkAsGenerated();
+  return rtStateObject;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+// Extend a state object with the libraries, hit groups and root signature associations added
+// since the last call to Generate or GenerateAddition. The shaders of the existing state object are
+// not compiled again, and keep their shader identifiers in the new one
+ID3D12StateObject*
+RayTracingPipelineGenerator::GenerateAddition(ID3D12StateObject* existingStateObject)
+{
+  if (!m_allowAdditions)
+  {
+    throw std::logic_error("State object additions are not allowed by the pipeline");
+  }
+  if (!HasPendingAdditions())
+  {
+    throw std::logic_error("No shaders to add to the state object");
+  }
+  ID3D12StateObject* rtStateObject =
+      CreateStateObject(m_generatedLibraryCount, m_generatedHitGroupCount,
+                        m_generatedAssociationCount, existingStateObject);
+  MarkAsGenerated();
+  return rtStateObject;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+// Whether libraries, hit groups or associations were added since the last generation
+bool RayTracingPipelineGenerator::HasPendingAdditions() const
+{
+  return m_generatedLibraryCount < m_libraries.size() ||
+         m_generatedHitGroupCount < m_hitGroups.size() ||
+         m_generatedAssociationCount < m_rootSignatureAssociations.size();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+// Consider the current libraries, hit groups and associations as generated
+void RayTracingPipelineGenerator::MarkAsGenerated()
+{
+  m_generatedLibraryCount = m_libraries.size();
+  m_generatedHitGroupCount = m_hitGroups.size();
+  m_generatedAssociationCount = m_rootSignatureAssociations.size();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+// Create a state object from the libraries, hit groups and associations starting at the given
+// indices, or add them to an existing state object. An addition redeclares the configuration
+// subobjects, which must be identical to those of the existing state object
+ID3D12StateObject* RayTracingPipelineGenerator::CreateStateObject(
+    size_t firstLibrary, size_t firstHitGroup, size_t firstAssociation,
+    ID3D12StateObject* existingStateObject)
 {
   // The pipeline is made of a set of sub-objects, representing the DXIL libraries, hit group
   // declarations, root signature associations, plus some configuration objects
   UINT64 subobjectCount =
-      m_libraries.size() +                     // DXIL libraries
-      m_hitGroups.size() +                     // Hit group declarations
-      1 +                                      // Shader configuration
-      1 +                                      // Shader payload
-      2 * m_rootSignatureAssociations.size() + // Root signature declaration + association
-      2 +                                      // Empty global and local root signatures
-      1;                                       // Final pipeline subobject
+      (m_libraries.size() - firstLibrary) +   // DXIL libraries
+      (m_hitGroups.size() - firstHitGroup) +  // Hit group declarations
+      1 +                                     // Shader configuration
+      1 +                                     // Shader payload
+      2 * (m_rootSignatureAssociations.size() -
+           firstAssociation) +                // Root signature declaration + association
+      2 +                                     // Empty global and local root signatures
+      1 +                                     // Final pipeline subobject
+      1;                                      // State object configuration
 
   // Initialize a vector with the target object count. It is necessary to make the allocation before
   // adding subobjects as some subobjects reference other subobjects by pointer. Using push_back may
@@ -155,21 +296,21 @@ ID3D12StateObject* RayTracingPipelineGenerator::Generate()
   UINT currentIndex = 0;
 
   // Add all the DXIL libraries
-  for (const Library& lib : m_libraries)
+  for (size_t i = firstLibrary; i < m_libraries.size(); i++)
   {
     D3D12_STATE_SUBOBJECT libSubobject = {};
     libSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_DXIL_LIBRARY;
-    libSubobject.pDesc = &lib.m_libDesc;
+    libSubobject.pDesc = &m_libraries[i].m_libDesc;
 
     subobjects[currentIndex++] = libSubobject;
   }
 
   // Add all the hit group declarations
-  for (const HitGroup& group : m_hitGroups)
+  for (size_t i = firstHitGroup; i < m_hitGroups.size(); i++)
   {
     D3D12_STATE_SUBOBJECT hitGroup = {};
     hitGroup.Type = D3D12_STATE_SUBOBJECT_TYPE_HIT_GROUP;
-    hitGroup.pDesc = &group.m_desc;
+    hitGroup.pDesc = &m_hitGroups[i].m_desc;
 
     subobjects[currentIndex++] = hitGroup;
   }
@@ -189,7 +330,7 @@ ID3D12StateObject* RayTracingPipelineGenerator::Generate()
   // Those shaders have to be associated with the payload definition
   std::vector<std::wstring> exportedSymbols = {};
   std::vector<LPCWSTR> exportedSymbolPointers = {};
-  BuildShaderExportList(exportedSymbols);
+  BuildShaderExportList(exportedSymbols, firstLibrary, firstHitGroup);
 
   // Build an array of the string pointers
   exportedSymbolPointers.reserve(exportedSymbols.size());
@@ -215,8 +356,9 @@ ID3D12StateObject* RayTracingPipelineGenerator::Generate()
 
   // The root signature association requires two objects for each: one to declare the root
   // signature, and another to associate that root signature to a set of symbols
-  for (RootSignatureAssociation& assoc : m_rootSignatureAssociations)
+  for (size_t i = firstAssociation; i < m_rootSignatureAssociations.size(); i++)
   {
+    RootSignatureAssociation& assoc = m_rootSignatureAssociations[i];
 
     // Add a subobject to declare the root signature
     D3D12_STATE_SUBOBJECT rootSigObject = {};
@@ -263,6 +405,19 @@ ID3D12StateObject* RayTracingPipelineGenerator::Generate()
 
   subobjects[currentIndex++] = pipelineConfigObject;
 
+  // Pipelines which can be extended later on declare it in their configuration, as do additions
+  // which can themselves be extended
+  D3D12_STATE_OBJECT_CONFIG stateObjectConfig = {};
+  stateObjectConfig.Flags = D3D12_STATE_OBJECT_FLAG_ALLOW_STATE_OBJECT_ADDITIONS;
+  if (m_allowAdditions)
+  {
+    D3D12_STATE_SUBOBJECT stateObjectConfigObject = {};
+    stateObjectConfigObject.Type = D3D12_STATE_SUBOBJECT_TYPE_STATE_OBJECT_CONFIG;
+    stateObjectConfigObject.pDesc = &stateObjectConfig;
+
+    subobjects[currentIndex++] = stateObjectConfigObject;
+  }
+
   // Describe the ray tracing pipeline state object
   D3D12_STATE_OBJECT_DESC pipelineDesc = {};
   pipelineDesc.Type = D3D12_STATE_OBJECT_TYPE_RAYTRACING_PIPELINE;
@@ -271,15 +426,84 @@ ID3D12StateObject* RayTracingPipelineGenerator::Generate()
 
   ID3D12StateObject* rtStateObject = nullptr;
 
-  // Create the state object
-  HRESULT hr = m_device->CreateStateObject(&pipelineDesc, IID_PPV_ARGS(&rtStateObject));
+  if (existingStateObject == nullptr)
+  {
+    // Create the state object
+    HRESULT hr = m_device->CreateStateObject(&pipelineDesc, IID_PPV_ARGS(&rtStateObject));
+    if (FAILED(hr))
+    {
+      throw std::logic_error("Could not create the raytracing state object");
+    }
+    return rtStateObject;
+  }
+
+  // Add the new subobjects to the existing state object
+  ID3D12Device7* device7 = nullptr;
+  if (FAILED(m_device->QueryInterface(IID_PPV_ARGS(&device7))))
+  {
+    throw std::logic_error("State object additions require ID3D12Device7");
+  }
+  HRESULT hr =
+      device7->AddToStateObject(&pipelineDesc, existingStateObject, IID_PPV_ARGS(&rtStateObject));
+  device7->Release();
   if (FAILED(hr))
   {
-    throw std::logic_error("Could not create the raytracing state object");
+    throw std::logic_error("Could not add to the raytracing state object");
   }
   return rtStateObject;
 }
 
+//--------------------------------------------------------------------------------------------------
+//
+// Canonical serialization of the pipeline, independent of the order of the addition calls. The
+// empty global and local root signatures are the same for all pipelines, and are left out
+bool RayTracingPipelineGenerator::SerializeDescription(std::vector<uint8_t>& description) const
+{
+  bool persistent = true;
+  description.clear();
+  AppendValue(description, kDescriptionVersion);
+
+  // The libraries are identified by their code and exports
+  std::vector<std::vector<uint8_t>> elements;
+  for (const Library& lib : m_libraries)
+  {
+    std::vector<uint8_t> element;
+    AppendBytes(element, lib.m_libDesc.DXILLibrary.pShaderBytecode,
+                lib.m_libDesc.DXILLibrary.BytecodeLength);
+    AppendSortedStrings(element, lib.m_exportedSymbols);
+    elements.push_back(std::move(element));
+  }
+  AppendSortedElements(description, std::move(elements));
+
+  elements.clear();
+  for (const HitGroup& group : m_hitGroups)
+  {
+    std::vector<uint8_t> element;
+    AppendString(element, group.m_hitGroupName);
+    AppendString(element, group.m_closestHitSymbol);
+    AppendString(element, group.m_anyHitSymbol);
+    AppendString(element, group.m_intersectionSymbol);
+    elements.push_back(std::move(element));
+  }
+  AppendSortedElements(description, std::move(elements));
+
+  elements.clear();
+  for (const RootSignatureAssociation& assoc : m_rootSignatureAssociations)
+  {
+    std::vector<uint8_t> element;
+    persistent &= AppendRootSignature(element, assoc.m_rootSignature);
+    AppendSortedStrings(element, assoc.m_symbols);
+    elements.push_back(std::move(element));
+  }
+  AppendSortedElements(description, std::move(elements));
+
+  AppendValue(description, m_maxPayLoadSizeInBytes);
+  AppendValue(description, m_maxAttributeSizeInBytes);
+  AppendValue(description, m_maxRecursionDepth);
+  AppendValue(description, m_allowAdditions ? 1 : 0);
+  return persistent;
+}
+
 //--------------------------------------------------------------------------------------------------
 //
 // The pipeline creation requires having at least one empty global and local root signatures, so
@@ -338,7 +562,8 @@ void RayTracingPipelineGenerator::CreateDummyRootSignatures()
 //
 // Build a list containing the export symbols for the ray generation shaders, miss shaders, and
 // hit group names
-void RayTracingPipelineGenerator::BuildShaderExportList(std::vector<std::wstring>& exportedSymbols)
+void RayTracingPipelineGenerator::BuildShaderExportList(std::vector<std::wstring>& exportedSymbols,
+                                                        size_t firstLibrary, size_t firstHitGroup)
 {
   // Get all names from libraries
   // Get names associated to hit groups
@@ -422,6 +647,20 @@ void RayTracingPipelineGenerator::BuildShaderExportList(std::vector<std::wstring
     exports.insert(hitGroup.m_hitGroupName);
   }
 
+  // An addition only associates its own shaders and hit groups to the shader configuration, the
+  // others being already associated in the existing state object
+  for (size_t i = 0; i < firstLibrary; i++)
+  {
+    for (const auto& exportName : m_libraries[i].m_exportedSymbols)
+    {
+      exports.erase(exportName);
+    }
+  }
+  for (size_t i = 0; i < firstHitGroup; i++)
+  {
+    exports.erase(m_hitGroups[i].m_hitGroupName);
+  }
+
   // Finally build a vector containing ray generation and miss shaders, plus the hit group names
   for (const auto& name : exports)
   {
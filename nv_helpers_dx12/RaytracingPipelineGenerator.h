@@ -57,6 +57,25 @@ pipeline.SetMaxRecursionDepth(1);
 
 rtStateObject = pipeline.Generate();
 
+Shaders can also be added to an existing pipeline, for example when new materials
+are streamed in. The pipeline is then generated with additions allowed, and the
+libraries, hit groups and root signature associations added after Generate are
+appended to it with GenerateAddition, without compiling the existing ones again:
+
+pipeline.SetAllowAdditions(true);
+rtStateObject = pipeline.Generate();
+...
+pipeline.AddLibrary(m_newHitLibrary.Get(), {L"NewClosestHit"});
+pipeline.AddHitGroup(L"NewHitGroup", L"NewClosestHit");
+pipeline.AddRootSignatureAssociation(m_hitSignature.Get(), {L"NewHitGroup"});
+newStateObject = pipeline.GenerateAddition(rtStateObject);
+
+The description of the pipeline can also be serialized in a canonical form, using
+SerializeDescription. The serialization does not depend on the order of the
+calls, so that two generators describing the same pipeline produce the same
+bytes, which can be hashed to look up the state object in a pipeline cache
+instead of calling Generate.
+
 */
 
 #pragma once
@@ -65,6 +84,7 @@ rtStateObject = pipeline.Generate();
 
 #include <dxcapi.h>
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <stdexcept>
@@ -120,9 +140,35 @@ public:
   /// algorithms must be flattened to a loop in the ray generation program for best performance.
   void SetMaxRecursionDepth(UINT maxDepth);
 
+  /// Allow adding shaders to the generated state objects with GenerateAddition. This requires
+  /// raytracing tier 1.1, and a device implementing ID3D12Device7
+  void SetAllowAdditions(bool allowAdditions);
+
   /// Compiles the raytracing state object
   ID3D12StateObject* Generate();
 
+  /// Extend a state object with the libraries, hit groups and root signature associations added
+  /// since the last call to Generate or GenerateAddition, using ID3D12Device7::AddToStateObject.
+  /// The shaders of the existing state object are not compiled again, and keep their shader
+  /// identifiers in the new one. The existing state object is left unchanged
+  ID3D12StateObject* GenerateAddition(ID3D12StateObject* existingStateObject);
+
+  /// Whether libraries, hit groups or associations were added since the last generation
+  bool HasPendingAdditions() const;
+
+  /// Consider the current libraries, hit groups and associations as generated, for example when
+  /// their state object was found in a pipeline cache instead of calling Generate
+  void MarkAsGenerated();
+
+  /// Canonical serialization of the pipeline: the DXIL code and exports of the libraries, the hit
+  /// groups, the root signature associations, the payload and attribute sizes and the recursion
+  /// depth. The libraries, hit groups, associations and symbol lists are sorted, as their order
+  /// has no effect on the state object. The root signatures are identified by the serialized blob
+  /// attached by RootSignatureGenerator (see SerializedRootSignatureGuid), and by their address
+  /// otherwise. Returns false in the latter case, the description then being only valid while
+  /// those root signatures are alive
+  bool SerializeDescription(std::vector<uint8_t>& description) const;
+
 private:
   /// Storage for DXIL libraries and their exported symbols
   struct Library
@@ -173,9 +219,16 @@ private:
   /// we systematically create both
   void CreateDummyRootSignatures();
 
+  /// Create a state object from the libraries, hit groups and associations starting at the given
+  /// indices, or add them to an existing state object
+  ID3D12StateObject* CreateStateObject(size_t firstLibrary, size_t firstHitGroup,
+                                       size_t firstAssociation,
+                                       ID3D12StateObject* existingStateObject);
+
   /// Build a list containing the export symbols for the ray generation shaders, miss shaders, and
-  /// hit group names
-  void BuildShaderExportList(std::vector<std::wstring>& exportedSymbols);
+  /// hit group names, leaving out those of the libraries and hit groups before the given indices
+  void BuildShaderExportList(std::vector<std::wstring>& exportedSymbols, size_t firstLibrary,
+                             size_t firstHitGroup);
 
   std::vector<Library> m_libraries = {};
   std::vector<HitGroup> m_hitGroups = {};
@@ -188,6 +241,12 @@ private:
   /// Maximum recursion depth, initialized to 1 to at least allow tracing primary rays
   UINT m_maxRecursionDepth = 1;
 
+  bool m_allowAdditions = false;
+  /// Number of libraries, hit groups and associations already in a state object
+  size_t m_generatedLibraryCount = 0;
+  size_t m_generatedHitGroupCount = 0;
+  size_t m_generatedAssociationCount = 0;
+
   ID3D12Device5* m_device;
   ID3D12RootSignature* m_dummyLocalRootSignature;
   ID3D12RootSignature* m_dummyGlobalRootSignature;
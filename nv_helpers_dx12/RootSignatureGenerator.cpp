@@ -155,25 +155,97 @@ void RootSignatureGenerator::AddRootParameter(D3D12_ROOT_PARAMETER_TYPE type,
 // Create the root signature from the set of parameters, in the order of the addition calls
 ID3D12RootSignature* RootSignatureGenerator::Generate(ID3D12Device* device, bool isLocal)
 {
-  // Go through all the parameters, and set the actual addresses of the heap range descriptors based
-  // on their indices in the range set array
+  ID3DBlob* pSigBlob = Serialize(isLocal);
+  ID3D12RootSignature* pRootSig = nullptr;
+  try
+  {
+    pRootSig = CreateFromBlob(device, pSigBlob->GetBufferPointer(), pSigBlob->GetBufferSize());
+  }
+  catch (const std::logic_error&)
+  {
+    pSigBlob->Release();
+    throw;
+  }
+  pSigBlob->Release();
+  return pRootSig;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+// Canonical form of the layout of the root signature: its flags, and the type, registers and ranges
+// of its parameters in order. Each value is stored on 32 bits, in native byte order
+void RootSignatureGenerator::SerializeLayout(bool isLocal, std::vector<uint8_t>& layout) const
+{
+  // Version of the layout format, to change along with it
+  const UINT kLayoutVersion = 1;
+
+  layout.clear();
+  auto append = [&layout](UINT value) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    layout.insert(layout.end(), bytes, bytes + sizeof(value));
+  };
+  append(kLayoutVersion);
+  append(isLocal ? 1 : 0);
+  append(static_cast<UINT>(m_parameters.size()));
   for (size_t i = 0; i < m_parameters.size(); i++)
   {
-    if (m_parameters[i].ParameterType == D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE)
+    const D3D12_ROOT_PARAMETER& param = m_parameters[i];
+    append(static_cast<UINT>(param.ParameterType));
+    append(static_cast<UINT>(param.ShaderVisibility));
+    if (param.ParameterType == D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE)
+    {
+      // The ranges are held by m_ranges, the parameter itself having no valid pointer yet
+      const std::vector<D3D12_DESCRIPTOR_RANGE>& ranges = m_ranges[m_rangeLocations[i]];
+      append(static_cast<UINT>(ranges.size()));
+      for (const D3D12_DESCRIPTOR_RANGE& range : ranges)
+      {
+        append(static_cast<UINT>(range.RangeType));
+        append(range.NumDescriptors);
+        append(range.BaseShaderRegister);
+        append(range.RegisterSpace);
+        append(range.OffsetInDescriptorsFromTableStart);
+      }
+    }
+    else if (param.ParameterType == D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS)
     {
-      m_parameters[i].DescriptorTable.pDescriptorRanges = m_ranges[m_rangeLocations[i]].data();
+      append(param.Constants.ShaderRegister);
+      append(param.Constants.RegisterSpace);
+      append(param.Constants.Num32BitValues);
+    }
+    else
+    {
+      append(param.Descriptor.ShaderRegister);
+      append(param.Descriptor.RegisterSpace);
+    }
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+// Serialize the root signature with D3D12SerializeRootSignature. The caller releases the blob
+ID3DBlob* RootSignatureGenerator::Serialize(bool isLocal) const
+{
+  // Go through all the parameters, and set the actual addresses of the heap range descriptors based
+  // on their indices in the range set array. The parameters are copied, so that the generator is
+  // left untouched
+  std::vector<D3D12_ROOT_PARAMETER> parameters = m_parameters;
+  for (size_t i = 0; i < parameters.size(); i++)
+  {
+    if (parameters[i].ParameterType == D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE)
+    {
+      parameters[i].DescriptorTable.pDescriptorRanges = m_ranges[m_rangeLocations[i]].data();
     }
   }
   // Specify the root signature with its set of parameters
   D3D12_ROOT_SIGNATURE_DESC rootDesc = {};
-  rootDesc.NumParameters = static_cast<UINT>(m_parameters.size());
-  rootDesc.pParameters = m_parameters.data();
+  rootDesc.NumParameters = static_cast<UINT>(parameters.size());
+  rootDesc.pParameters = parameters.data();
   // Set the flags of the signature. By default root signatures are global, for example for vertex
   // and pixel shaders. For raytracing shaders the root signatures are local.
   rootDesc.Flags =
       isLocal ? D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE : D3D12_ROOT_SIGNATURE_FLAG_NONE;
 
-  // Create the root signature from its descriptor
+  // Serialize the root signature from its descriptor
   ID3DBlob* pSigBlob;
   ID3DBlob* pErrorBlob;
   HRESULT hr = D3D12SerializeRootSignature(&rootDesc, D3D_ROOT_SIGNATURE_VERSION_1_0, &pSigBlob,
@@ -182,9 +254,27 @@ ID3D12RootSignature* RootSignatureGenerator::Generate(ID3D12Device* device, bool
   {
     throw std::logic_error("Cannot serialize root signature");
   }
+  return pSigBlob;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+// Create a root signature from a serialized blob, attaching the blob to it under
+// SerializedRootSignatureGuid
+ID3D12RootSignature* RootSignatureGenerator::CreateFromBlob(ID3D12Device* device,
+                                                            const void* blob, size_t blobSize)
+{
   ID3D12RootSignature* pRootSig;
-  hr = device->CreateRootSignature(0, pSigBlob->GetBufferPointer(), pSigBlob->GetBufferSize(),
-                                   IID_PPV_ARGS(&pRootSig));
+  HRESULT hr = device->CreateRootSignature(0, blob, blobSize, IID_PPV_ARGS(&pRootSig));
+  if (SUCCEEDED(hr))
+  {
+    // Identify the root signature by its content, the private data being a copy of the blob
+    hr = pRootSig->SetPrivateData(SerializedRootSignatureGuid, static_cast<UINT>(blobSize), blob);
+    if (FAILED(hr))
+    {
+      pRootSig->Release();
+    }
+  }
   if (FAILED(hr))
   {
     throw std::logic_error("Cannot create root signature");
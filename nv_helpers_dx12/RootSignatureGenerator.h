@@ -48,12 +48,28 @@ rsc.AddRangeParameter({{0,1,0, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 0},
 {0,1,0, D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 2}});
 return rsc.Generate(m_device.Get(), true);
 
+The generated root signatures carry their serialized blob as private data, under
+SerializedRootSignatureGuid. It identifies them by content, for example in the
+pipeline descriptions of RayTracingPipelineGenerator::SerializeDescription.
+
+Generate can also be split in its two steps, to share root signatures with the same
+layout or to reuse serialized blobs:
+
+std::vector<uint8_t> layout;
+rsc.SerializeLayout(true, layout);
+// ... look up the layout, and otherwise
+ID3DBlob* blob = rsc.Serialize(true);
+rootSignature = nv_helpers_dx12::RootSignatureGenerator::CreateFromBlob(
+  m_device.Get(), blob->GetBufferPointer(), blob->GetBufferSize());
+blob->Release();
+
 */
 
 #pragma once
 
 #include "d3d12.h"
 
+#include <cstdint>
 #include <tuple>
 #include <vector>
 #include <string>
@@ -62,6 +78,11 @@ return rsc.Generate(m_device.Get(), true);
 namespace nv_helpers_dx12
 {
 
+/// Private data of the generated root signatures, holding their serialized blob
+// {5B2C6A41-8E0D-4C3B-9A6F-2D7E1B4C8F93}
+static const GUID SerializedRootSignatureGuid = {
+    0x5b2c6a41, 0x8e0d, 0x4c3b, {0x9a, 0x6f, 0x2d, 0x7e, 0x1b, 0x4c, 0x8f, 0x93}};
+
 class RootSignatureGenerator
 {
 public:
@@ -104,9 +125,23 @@ public:
   void AddRootParameter(D3D12_ROOT_PARAMETER_TYPE type, UINT shaderRegister = 0,
                         UINT registerSpace = 0, UINT numRootConstants = 1);
 
-  /// Create the root signature from the set of parameters, in the order of the addition calls
+  /// Create the root signature from the set of parameters, in the order of the addition calls. The
+  /// serialized blob is attached to it under SerializedRootSignatureGuid
   ID3D12RootSignature* Generate(ID3D12Device* device, bool isLocal);
 
+  /// Canonical form of the layout of the root signature: its flags, and the type, registers and
+  /// ranges of its parameters in order. Two generators with the same layout produce identical root
+  /// signatures, regardless of the way the parameters were added
+  void SerializeLayout(bool isLocal, std::vector<uint8_t>& layout) const;
+
+  /// Serialize the root signature with D3D12SerializeRootSignature. The caller releases the blob
+  ID3DBlob* Serialize(bool isLocal) const;
+
+  /// Create a root signature from a serialized blob, attaching the blob to it under
+  /// SerializedRootSignatureGuid
+  static ID3D12RootSignature* CreateFromBlob(ID3D12Device* device, const void* blob,
+                                             size_t blobSize);
+
 private:
   /// Heap range descriptors
   std::vector<std::vector<D3D12_DESCRIPTOR_RANGE>> m_ranges;
@@ -36,6 +36,8 @@ dispatch rays description.
 
 #include "ShaderBindingTableGenerator.h"
 
+#include <algorithm>
+
 // Helper to compute aligned buffer sizes
 #ifndef ROUND_UP
 #define ROUND_UP(v, powerOf2Alignment) (((v) + (powerOf2Alignment)-1) & ~((powerOf2Alignment)-1))
@@ -67,11 +69,67 @@ void ShaderBindingTableGenerator::AddMissProgram(const std::wstring& entryPoint,
 //--------------------------------------------------------------------------------------------------
 //
 // Add a hit group by name, with its list of data pointers or values according to
-// the layout of its root signature
-void ShaderBindingTableGenerator::AddHitGroup(const std::wstring& entryPoint,
+// the layout of its root signature. Returns the index of its record in the hit group section
+UINT ShaderBindingTableGenerator::AddHitGroup(const std::wstring& entryPoint,
                                               const std::vector<void*>& inputData)
 {
   m_hitGroup.emplace_back(SBTEntry(entryPoint, inputData));
+  return static_cast<UINT>(m_hitGroup.size() - 1);
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+// Change the hit group used by a record, keeping its data. The record is written by the next call
+// to Generate or Patch
+void ShaderBindingTableGenerator::SetHitGroupProgram(UINT recordIndex,
+                                                     const std::wstring& entryPoint)
+{
+  if (recordIndex >= m_hitGroup.size())
+  {
+    throw std::logic_error("Hit group record index out of range");
+  }
+  if (m_hitGroup[recordIndex].m_entryPoint == entryPoint)
+  {
+    return;
+  }
+  m_hitGroup[recordIndex].m_entryPoint = entryPoint;
+  MarkHitGroupDirty(recordIndex);
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+// Change the data of a hit group record. Once the SBT size is computed, the data must fit in the
+// hit group entry size
+void ShaderBindingTableGenerator::SetHitGroupData(UINT recordIndex,
+                                                  const std::vector<void*>& inputData)
+{
+  if (recordIndex >= m_hitGroup.size())
+  {
+    throw std::logic_error("Hit group record index out of range");
+  }
+  if (m_hitGroupEntrySize != 0 &&
+      m_progIdSize + 8 * static_cast<uint32_t>(inputData.size()) > m_hitGroupEntrySize)
+  {
+    throw std::logic_error("Hit group data larger than the SBT entries, the SBT must be rebuilt");
+  }
+  if (m_hitGroup[recordIndex].m_inputData == inputData)
+  {
+    return;
+  }
+  m_hitGroup[recordIndex].m_inputData = inputData;
+  MarkHitGroupDirty(recordIndex);
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+// Set the number of copies of the SBT whose changed records are tracked
+void ShaderBindingTableGenerator::SetBufferCount(UINT bufferCount)
+{
+  if (bufferCount == 0)
+  {
+    throw std::logic_error("The SBT needs at least one buffer");
+  }
+  m_dirtyHitGroups.assign(bufferCount, std::vector<UINT>());
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -102,8 +160,13 @@ uint32_t ShaderBindingTableGenerator::ComputeSBTSize()
 // Access to the raytracing pipeline object is required to fetch program identifiers using their
 // names
 void ShaderBindingTableGenerator::Generate(ID3D12Resource* sbtBuffer,
-                                           ID3D12StateObjectProperties* raytracingPipeline)
+                                           ID3D12StateObjectProperties* raytracingPipeline,
+                                           UINT bufferIndex /*= 0*/)
 {
+  if (bufferIndex >= m_dirtyHitGroups.size())
+  {
+    throw std::logic_error("SBT buffer index out of range");
+  }
   // Map the SBT
   uint8_t* pData;
   HRESULT hr = sbtBuffer->Map(0, nullptr, reinterpret_cast<void**>(&pData));
@@ -125,6 +188,70 @@ void ShaderBindingTableGenerator::Generate(ID3D12Resource* sbtBuffer,
 
   // Unmap the SBT
   sbtBuffer->Unmap(0, nullptr);
+  m_dirtyHitGroups[bufferIndex].clear();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+// Write only the hit group records changed since the last Generate or Patch of the same copy into
+// sbtBuffer, which must hold that copy. Returns the number of records written
+UINT ShaderBindingTableGenerator::Patch(ID3D12Resource* sbtBuffer,
+                                        ID3D12StateObjectProperties* raytracingPipeline,
+                                        UINT bufferIndex /*= 0*/)
+{
+  if (bufferIndex >= m_dirtyHitGroups.size())
+  {
+    throw std::logic_error("SBT buffer index out of range");
+  }
+  std::vector<UINT>& dirtyHitGroups = m_dirtyHitGroups[bufferIndex];
+  if (dirtyHitGroups.empty())
+  {
+    return 0;
+  }
+
+  // Records changed several times are only written once
+  std::sort(dirtyHitGroups.begin(), dirtyHitGroups.end());
+  dirtyHitGroups.erase(std::unique(dirtyHitGroups.begin(), dirtyHitGroups.end()),
+                       dirtyHitGroups.end());
+
+  // Map the SBT, without reading it back
+  uint8_t* pData;
+  D3D12_RANGE readRange = {0, 0};
+  HRESULT hr = sbtBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pData));
+  if (FAILED(hr))
+  {
+    throw std::logic_error("Could not map the shader binding table");
+  }
+
+  // The hit group section starts after the ray generation and miss sections
+  uint8_t* hitGroupData = pData + GetRayGenSectionSize() + GetMissSectionSize();
+  for (UINT recordIndex : dirtyHitGroups)
+  {
+    CopyShaderRecord(raytracingPipeline, hitGroupData + recordIndex * m_hitGroupEntrySize,
+                     m_hitGroup[recordIndex], m_hitGroupEntrySize);
+  }
+
+  // Unmap the SBT, telling the written range
+  D3D12_RANGE writtenRange = {GetRayGenSectionSize() + GetMissSectionSize() +
+                                  dirtyHitGroups.front() * m_hitGroupEntrySize,
+                              GetRayGenSectionSize() + GetMissSectionSize() +
+                                  (dirtyHitGroups.back() + 1) * m_hitGroupEntrySize};
+  sbtBuffer->Unmap(0, &writtenRange);
+
+  UINT patchedCount = static_cast<UINT>(dirtyHitGroups.size());
+  dirtyHitGroups.clear();
+  return patchedCount;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+// Mark a hit group record as changed for all the copies of the SBT
+void ShaderBindingTableGenerator::MarkHitGroupDirty(UINT recordIndex)
+{
+  for (std::vector<UINT>& dirtyHitGroups : m_dirtyHitGroups)
+  {
+    dirtyHitGroups.push_back(recordIndex);
+  }
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -135,6 +262,10 @@ void ShaderBindingTableGenerator::Reset()
   m_rayGen.clear();
   m_miss.clear();
   m_hitGroup.clear();
+  for (std::vector<UINT>& dirtyHitGroups : m_dirtyHitGroups)
+  {
+    dirtyHitGroups.clear();
+  }
 
   m_rayGenEntrySize = 0;
   m_missEntrySize = 0;
@@ -206,25 +337,42 @@ uint32_t ShaderBindingTableGenerator::CopyShaderData(
   uint8_t* pData = outputData;
   for (const auto& shader : shaders)
   {
-    // Get the shader identifier, and check whether that identifier is known
-    void* id = raytracingPipeline->GetShaderIdentifier(shader.m_entryPoint.c_str());
-    if (!id)
-    {
-      std::wstring errMsg(std::wstring(L"Unknown shader identifier used in the SBT: ") +
-                          shader.m_entryPoint);
-      throw std::logic_error(std::string(errMsg.begin(), errMsg.end()));
-    }
-    // Copy the shader identifier
-    memcpy(pData, id, m_progIdSize);
-    // Copy all its resources pointers or values in bulk
-    memcpy(pData + m_progIdSize, shader.m_inputData.data(), shader.m_inputData.size() * 8);
-
+    CopyShaderRecord(raytracingPipeline, pData, shader, entrySize);
     pData += entrySize;
   }
   // Return the number of bytes actually written to the output buffer
   return static_cast<uint32_t>(shaders.size()) * entrySize;
 }
 
+//--------------------------------------------------------------------------------------------------
+//
+// Copy the shader identifier of an entry followed by its resource pointers and/or root constants
+// in outputData, and clear the rest of the entry of entrySize bytes
+void ShaderBindingTableGenerator::CopyShaderRecord(ID3D12StateObjectProperties* raytracingPipeline,
+                                                   uint8_t* outputData, const SBTEntry& shader,
+                                                   uint32_t entrySize)
+{
+  // Get the shader identifier, and check whether that identifier is known
+  void* id = raytracingPipeline->GetShaderIdentifier(shader.m_entryPoint.c_str());
+  if (!id)
+  {
+    std::wstring errMsg(std::wstring(L"Unknown shader identifier used in the SBT: ") +
+                        shader.m_entryPoint);
+    throw std::logic_error(std::string(errMsg.begin(), errMsg.end()));
+  }
+  // Copy the shader identifier
+  memcpy(outputData, id, m_progIdSize);
+  // Copy all its resources pointers or values in bulk
+  size_t dataSize = shader.m_inputData.size() * 8;
+  if (dataSize > 0)
+  {
+    memcpy(outputData + m_progIdSize, shader.m_inputData.data(), dataSize);
+  }
+  // Clear the end of the entry, which may hold the data of a previous, longer record: the buffer
+  // is written again by Patch and by later calls to Generate
+  memset(outputData + m_progIdSize + dataSize, 0, entrySize - m_progIdSize - dataSize);
+}
+
 //--------------------------------------------------------------------------------------------------
 //
 // Compute the size of the SBT entries for a set of entries, which is determined by the maximum
@@ -235,7 +383,7 @@ uint32_t ShaderBindingTableGenerator::GetEntrySize(const std::vector<SBTEntry>&
   size_t maxArgs = 0;
   for (const auto& shader : entries)
   {
-    maxArgs = max(maxArgs, shader.m_inputData.size());
+    maxArgs = (std::max)(maxArgs, shader.m_inputData.size());
   }
   // A SBT entry is made of a program ID and a set of parameters, taking 8 bytes each. Those
   // parameters can either be 8-bytes pointers, or 4-bytes constants
@@ -102,6 +102,25 @@ missSectionSizeInBytes; desc.HitGroupTable.SizeInBytes = hitGroupsSectionSize;
 desc.HitGroupTable.StrideInBytes = m_sbtHelper.GetHitGroupEntrySize();
 
 
+//--------------------------------------------------------------------
+The program and data of a hit group record can be changed after Generate, for
+example once a new hit group has been added to the state object. Only the
+records changed since the last Generate or Patch are then written to the SBT.
+The SBT can have several copies, for example one per frame in flight, so that a
+copy is updated while the GPU still reads the others. Each copy tracks the
+records it is missing, and is brought up to date when its frame comes around:
+//--------------------------------------------------------------------
+
+m_sbtHelper.SetBufferCount(FrameCount);
+UINT recordIndex = m_sbtHelper.AddHitGroup(L"HitGroup", {...});
+...
+for (UINT n = 0; n < FrameCount; n++)
+  m_sbtHelper.Generate(m_sbtStorage[n].Get(), m_rtStateObjectProps.Get(), n);
+...
+m_sbtHelper.SetHitGroupProgram(recordIndex, L"NewHitGroup");
+...
+// Once the GPU is done with the resources of the frame
+m_sbtHelper.Patch(m_sbtStorage[frameIndex].Get(), m_rtStateObjectProps.Get(), frameIndex);
 
 */
 
@@ -128,17 +147,37 @@ public:
   void AddMissProgram(const std::wstring& entryPoint, const std::vector<void*>& inputData);
 
   /// Add a hit group by name, with its list of data pointers or values according to
-  /// the layout of its root signature
-  void AddHitGroup(const std::wstring& entryPoint, const std::vector<void*>& inputData);
+  /// the layout of its root signature. Returns the index of its record in the hit group section
+  UINT AddHitGroup(const std::wstring& entryPoint, const std::vector<void*>& inputData);
+
+  /// Change the hit group used by a record, keeping its data. The root signature of the new hit
+  /// group must have the same layout. The record is written to each copy of the SBT by the next
+  /// call to Generate or Patch for that copy
+  void SetHitGroupProgram(UINT recordIndex, const std::wstring& entryPoint);
+
+  /// Change the data of a hit group record, for example to bind another vertex buffer. Once the
+  /// SBT size is computed, the data must fit in the hit group entry size, or the SBT has to be
+  /// rebuilt
+  void SetHitGroupData(UINT recordIndex, const std::vector<void*>& inputData);
+
+  /// Set the number of copies of the SBT whose changed records are tracked, 1 by default. All the
+  /// copies have to be written by Generate
+  void SetBufferCount(UINT bufferCount);
 
   /// Compute the size of the SBT based on the set of programs and hit groups it contains
   uint32_t ComputeSBTSize();
 
   /// Build the SBT and store it into sbtBuffer, which has to be pre-allocated on the upload heap.
   /// Access to the raytracing pipeline object is required to fetch program identifiers using their
-  /// names
-  void Generate(ID3D12Resource* sbtBuffer,
-                ID3D12StateObjectProperties* raytracingPipeline);
+  /// names. bufferIndex identifies the copy of the SBT held by sbtBuffer
+  void Generate(ID3D12Resource* sbtBuffer, ID3D12StateObjectProperties* raytracingPipeline,
+                UINT bufferIndex = 0);
+
+  /// Write only the hit group records changed since the last Generate or Patch of the same copy
+  /// into sbtBuffer, which must hold that copy. The records being written must not be in use by the
+  /// GPU. Returns the number of records written
+  UINT Patch(ID3D12Resource* sbtBuffer, ID3D12StateObjectProperties* raytracingPipeline,
+             UINT bufferIndex = 0);
 
   /// Reset the sets of programs and hit groups
   void Reset();
@@ -168,10 +207,18 @@ private:
   {
     SBTEntry(std::wstring entryPoint, std::vector<void*> inputData);
 
-    const std::wstring m_entryPoint;
-    const std::vector<void*> m_inputData;
+    std::wstring m_entryPoint;
+    std::vector<void*> m_inputData;
   };
 
+  /// Mark a hit group record as changed for all the copies of the SBT
+  void MarkHitGroupDirty(UINT recordIndex);
+
+  /// Copy the shader identifier of an entry followed by its resource pointers and/or root
+  /// constants in outputData, and clear the rest of the entry of entrySize bytes
+  void CopyShaderRecord(ID3D12StateObjectProperties* raytracingPipeline, uint8_t* outputData,
+                        const SBTEntry& shader, uint32_t entrySize);
+
   /// For each entry, copy the shader identifier followed by its resource pointers and/or root
   /// constants in outputData, with a stride in bytes of entrySize, and returns the size in bytes
   /// actually written to outputData.
@@ -187,15 +234,18 @@ private:
   std::vector<SBTEntry> m_miss;
   std::vector<SBTEntry> m_hitGroup;
 
+  /// For each copy of the SBT, the hit group records changed since its last Generate or Patch
+  std::vector<std::vector<UINT>> m_dirtyHitGroups = std::vector<std::vector<UINT>>(1);
+
   /// For each category, the size of an entry in the SBT depends on the maximum number of resources
   /// used by the shaders in that category.The helper computes those values automatically in
   /// GetEntrySize()
-  uint32_t m_rayGenEntrySize;
-  uint32_t m_missEntrySize;
-  uint32_t m_hitGroupEntrySize;
+  uint32_t m_rayGenEntrySize = 0;
+  uint32_t m_missEntrySize = 0;
+  uint32_t m_hitGroupEntrySize = 0;
 
   /// The program names are translated into program identifiers.The size in bytes of an identifier
   /// is provided by the device and is the same for all categories.
-  UINT m_progIdSize;
+  UINT m_progIdSize = 0;
 };
 } // namespace nv_helpers_dx12
@@ -0,0 +1,173 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace nv_helpers_dx12 {
+
+//--------------------------------------------------------------------------------------------------
+// Create the pool. The thread count includes the thread calling ParallelFor,
+// hence only threadCount-1 workers are started
+ThreadPool::ThreadPool(uint32_t threadCount /* = 0 */) : m_pendingTasks(0) {
+  if (threadCount == 0)
+  {
+    threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  m_queues.resize(threadCount);
+  for (auto &queue : m_queues)
+  {
+    queue.reset(new WorkQueue());
+  }
+
+  m_workers.reserve(threadCount - 1);
+  for (uint32_t i = 1; i < threadCount; i++)
+  {
+    m_workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Stop and join all the workers
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_wakeMutex);
+    m_stop = true;
+  }
+  m_wakeCondition.notify_all();
+  for (auto &worker : m_workers)
+  {
+    worker.join();
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Number of threads taking part in the loops, including the calling thread
+uint32_t ThreadPool::GetThreadCount() const {
+  return static_cast<uint32_t>(m_queues.size());
+}
+
+//--------------------------------------------------------------------------------------------------
+// Split [0, count) in ranges and distribute them over the queues of all the
+// threads. Each queue receives a contiguous set of ranges, so that without
+// stealing each thread works on a contiguous part of the input
+void ThreadPool::ParallelFor(uint32_t count, uint32_t grainSize,
+                             const RangeFunction &body) {
+  if (count == 0)
+  {
+    return;
+  }
+
+  const uint32_t threadCount = GetThreadCount();
+  if (grainSize == 0)
+  {
+    grainSize = std::max(count / (threadCount * 4), 1u);
+  }
+
+  // Small loops, or pools without workers, are run inline
+  if (threadCount == 1 || count <= grainSize)
+  {
+    body(0, count, 0);
+    return;
+  }
+
+  std::lock_guard<std::mutex> loopLock(m_loopMutex);
+
+  const uint32_t taskCount = (count + grainSize - 1) / grainSize;
+  const uint32_t tasksPerQueue = (taskCount + threadCount - 1) / threadCount;
+  m_pendingTasks.store(taskCount);
+
+  for (uint32_t q = 0; q < threadCount; q++)
+  {
+    std::lock_guard<std::mutex> lock(m_queues[q]->mutex);
+    uint32_t firstTask = q * tasksPerQueue;
+    uint32_t lastTask = std::min(firstTask + tasksPerQueue, taskCount);
+    for (uint32_t t = firstTask; t < lastTask; t++)
+    {
+      uint32_t begin = t * grainSize;
+      m_queues[q]->tasks.push_back(
+          {begin, std::min(begin + grainSize, count), &body});
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_wakeMutex);
+    m_generation++;
+  }
+  m_wakeCondition.notify_all();
+
+  RunTasks(0);
+
+  // The remaining tasks are being processed by other threads
+  while (m_pendingTasks.load(std::memory_order_acquire) != 0)
+  {
+    std::this_thread::yield();
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Main loop of the workers: sleep until a loop is submitted, then process
+// tasks until none is left
+void ThreadPool::WorkerLoop(uint32_t threadIndex) {
+  uint64_t generation = 0;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_wakeMutex);
+      m_wakeCondition.wait(
+          lock, [&]() { return m_stop || m_generation != generation; });
+      if (m_stop)
+      {
+        return;
+      }
+      generation = m_generation;
+    }
+    RunTasks(threadIndex);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Process tasks from the queue of the thread, then steal from the other
+// queues. Each task references its loop body, so a worker waking up late
+// cannot run a task with the body of a previous loop
+void ThreadPool::RunTasks(uint32_t threadIndex) {
+  Task task;
+  while (PopTask(threadIndex, task) || StealTask(threadIndex, task))
+  {
+    (*task.body)(task.begin, task.end, threadIndex);
+    m_pendingTasks.fetch_sub(1, std::memory_order_acq_rel);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Take the most recently queued task of the thread
+bool ThreadPool::PopTask(uint32_t threadIndex, Task &task) {
+  WorkQueue &queue = *m_queues[threadIndex];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.tasks.empty())
+  {
+    return false;
+  }
+  task = queue.tasks.back();
+  queue.tasks.pop_back();
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Take the oldest task of another thread, starting with the next thread to
+// spread the thieves over the queues
+bool ThreadPool::StealTask(uint32_t threadIndex, Task &task) {
+  const uint32_t threadCount = GetThreadCount();
+  for (uint32_t i = 1; i < threadCount; i++)
+  {
+    WorkQueue &queue = *m_queues[(threadIndex + i) % threadCount];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty())
+    {
+      task = queue.tasks.front();
+      queue.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+} // namespace nv_helpers_dx12
@@ -0,0 +1,100 @@
+/*
+The ThreadPool runs parallel loops on a fixed set of worker threads. Each thread
+owns a queue of ranges: it pops work from the back of its own queue, and steals
+from the front of the other queues once its own is empty, so that threads
+finishing early help with the remaining work instead of idling.
+
+The thread calling ParallelFor takes part in the loop and only returns once all
+the ranges have been processed. Calls to ParallelFor are serialized, and cannot
+be nested within the body of another ParallelFor.
+
+
+Example:
+
+ThreadPool pool;
+pool.ParallelFor(triangleCount, 1024,
+                 [&](uint32_t begin, uint32_t end, uint32_t threadIndex) {
+                   for (uint32_t i = begin; i < end; i++)
+                     ...
+                 });
+
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nv_helpers_dx12
+{
+
+/// Work-stealing pool of threads executing parallel loops
+class ThreadPool
+{
+public:
+  /// Body of a parallel loop, processing the indices in [begin, end). threadIndex is in
+  /// [0, GetThreadCount()), and can be used to index per-thread data
+  using RangeFunction = std::function<void(uint32_t begin, uint32_t end, uint32_t threadIndex)>;
+
+  /// Create the pool. The thread count includes the thread calling ParallelFor, hence a pool of 1
+  /// thread runs everything inline. 0 uses all the hardware threads
+  explicit ThreadPool(uint32_t threadCount = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /// Number of threads taking part in the loops, including the calling thread
+  uint32_t GetThreadCount() const;
+
+  /// Split [0, count) in ranges of grainSize indices and process them on all the threads. A grain
+  /// size of 0 selects a size giving a few ranges per thread
+  void ParallelFor(uint32_t count, uint32_t grainSize, const RangeFunction& body);
+
+private:
+  struct Task
+  {
+    uint32_t begin;
+    uint32_t end;
+    const RangeFunction* body;
+  };
+
+  /// Queue of a thread, protected by its own lock to limit contention
+  struct WorkQueue
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void WorkerLoop(uint32_t threadIndex);
+
+  /// Process tasks from the queue of the thread, then from the other queues, until none is left
+  void RunTasks(uint32_t threadIndex);
+
+  bool PopTask(uint32_t threadIndex, Task& task);
+  bool StealTask(uint32_t threadIndex, Task& task);
+
+  /// One queue per thread, the calling thread using queue 0
+  std::vector<std::unique_ptr<WorkQueue>> m_queues;
+  std::vector<std::thread> m_workers;
+
+  /// Wakes up the workers when new tasks are submitted
+  std::mutex m_wakeMutex;
+  std::condition_variable m_wakeCondition;
+  uint64_t m_generation = 0;
+  bool m_stop = false;
+
+  /// Number of tasks of the current loop which have not completed yet
+  std::atomic<uint32_t> m_pendingTasks;
+
+  /// Serializes the calls to ParallelFor
+  std::mutex m_loopMutex;
+};
+} // namespace nv_helpers_dx12
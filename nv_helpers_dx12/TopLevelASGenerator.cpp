@@ -94,6 +94,26 @@ void TopLevelASGenerator::ComputeASBufferSizes(
                                              // descriptors, containing the matrices,
                                              // indices etc.
 )
+{
+  ComputeASBufferSizes(device, allowUpdate, static_cast<UINT>(m_instances.size()), scratchSizeInBytes,
+                       resultSizeInBytes, descriptorsSizeInBytes);
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+// Compute the buffer sizes for instances whose descriptors are written by the application
+void TopLevelASGenerator::ComputeASBufferSizes(
+    ID3D12Device5* device,         // Device on which the build will be performed
+    bool allowUpdate,              // If true, the resulting acceleration structure will
+                                   // allow iterative updates
+    UINT instanceCount,            // Number of instance descriptors
+    UINT64* scratchSizeInBytes,    // Required scratch memory on the GPU to build
+                                   // the acceleration structure
+    UINT64* resultSizeInBytes,     // Required GPU memory to store the acceleration
+                                   // structure
+    UINT64* descriptorsSizeInBytes // Required GPU memory to store instance
+                                   // descriptors
+)
 {
   // The generated AS can support iterative updates. This may change the final
   // size of the AS as well as the temporary memory requirements, and hence has
@@ -107,7 +127,7 @@ void TopLevelASGenerator::ComputeASBufferSizes(
   prebuildDesc = {};
   prebuildDesc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
   prebuildDesc.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-  prebuildDesc.NumDescs = static_cast<UINT>(m_instances.size());
+  prebuildDesc.NumDescs = instanceCount;
   prebuildDesc.Flags = m_flags;
 
   // This structure is used to hold the sizes of the required scratch memory and
@@ -131,7 +151,7 @@ void TopLevelASGenerator::ComputeASBufferSizes(
   // The instance descriptors are stored as-is in GPU memory, so we can deduce
   // the required size from the instance count
   m_instanceDescsSizeInBytes =
-      ROUND_UP(sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * static_cast<UINT64>(m_instances.size()),
+      ROUND_UP(sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * static_cast<UINT64>(instanceCount),
                D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
 
   *scratchSizeInBytes = m_scratchSizeInBytes;
@@ -159,6 +179,16 @@ void TopLevelASGenerator::Generate(
                                                  // is requested
 )
 {
+  // Sanity checks
+  if (m_flags != D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE && updateOnly)
+  {
+    throw std::logic_error("Cannot update a top-level AS not originally built for updates");
+  }
+  if (updateOnly && previousResult == nullptr)
+  {
+    throw std::logic_error("Top-level hierarchy update requires the previous hierarchy");
+  }
+
   // Copy the descriptors in the target descriptor buffer
   D3D12_RAYTRACING_INSTANCE_DESC* instanceDescs;
   descriptorsBuffer->Map(0, nullptr, reinterpret_cast<void**>(&instanceDescs));
@@ -179,26 +209,57 @@ void TopLevelASGenerator::Generate(
   // Create the description for each instance
   for (uint32_t i = 0; i < instanceCount; i++)
   {
-    // Instance ID visible in the shader in InstanceID()
-    instanceDescs[i].InstanceID = m_instances[i].instanceID;
-    // Index of the hit group invoked upon intersection
-    instanceDescs[i].InstanceContributionToHitGroupIndex = m_instances[i].hitGroupIndex;
-    // Instance flags, including backface culling, winding, etc - TODO: should
-    // be accessible from outside
-    instanceDescs[i].Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
-    // Instance transform matrix
-    DirectX::XMMATRIX m = XMMatrixTranspose(
-        m_instances[i].transform); // GLM is column major, the INSTANCE_DESC is row major
-    memcpy(instanceDescs[i].Transform, &m, sizeof(instanceDescs[i].Transform));
-    // Get access to the bottom level
-    instanceDescs[i].AccelerationStructure = m_instances[i].bottomLevelAS->GetGPUVirtualAddress();
-    // Visibility mask, always visible here - TODO: should be accessible from
-    // outside
-    instanceDescs[i].InstanceMask = 0xFF;
+    WriteInstanceDesc(m_instances[i], instanceDescs[i]);
   }
 
   descriptorsBuffer->Unmap(0, nullptr);
 
+  BuildFromDescriptors(commandList, scratchBuffer, resultBuffer, descriptorsBuffer, instanceCount,
+                       updateOnly, previousResult);
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+// Enqueue the construction of the acceleration structure from instance descriptors written by the
+// application. The instances added with AddInstance are not used
+void TopLevelASGenerator::GenerateFromDescriptors(
+    ID3D12GraphicsCommandList4* commandList, // Command list on which the build will be enqueued
+    ID3D12Resource* scratchBuffer,     // Scratch buffer used by the builder to
+                                       // store temporary data
+    ID3D12Resource* resultBuffer,      // Result buffer storing the acceleration structure
+    ID3D12Resource* descriptorsBuffer, // Instance descriptors written by the application
+    UINT instanceCount,                // Number of instance descriptors
+    bool updateOnly /*= false*/,       // If true, simply refit the existing
+                                       // acceleration structure
+    ID3D12Resource* previousResult /*= nullptr*/ // Optional previous acceleration
+                                                 // structure, used if an iterative update
+                                                 // is requested
+)
+{
+  // Sanity checks
+  if (m_flags != D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE && updateOnly)
+  {
+    throw std::logic_error("Cannot update a top-level AS not originally built for updates");
+  }
+  if (updateOnly && previousResult == nullptr)
+  {
+    throw std::logic_error("Top-level hierarchy update requires the previous hierarchy");
+  }
+
+  BuildFromDescriptors(commandList, scratchBuffer, resultBuffer, descriptorsBuffer, instanceCount,
+                       updateOnly, previousResult);
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+// Enqueue the build or the update of the acceleration structure, once the descriptors are written
+void TopLevelASGenerator::BuildFromDescriptors(ID3D12GraphicsCommandList4* commandList,
+                                               ID3D12Resource* scratchBuffer,
+                                               ID3D12Resource* resultBuffer,
+                                               ID3D12Resource* descriptorsBuffer,
+                                               UINT instanceCount, bool updateOnly,
+                                               ID3D12Resource* previousResult)
+{
   // If this in an update operation we need to provide the source buffer
   D3D12_GPU_VIRTUAL_ADDRESS pSourceAS = updateOnly ? previousResult->GetGPUVirtualAddress() : 0;
 
@@ -211,16 +272,6 @@ void TopLevelASGenerator::Generate(
     flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
   }
 
-  // Sanity checks
-  if (m_flags != D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE && updateOnly)
-  {
-    throw std::logic_error("Cannot update a top-level AS not originally built for updates");
-  }
-  if (updateOnly && previousResult == nullptr)
-  {
-    throw std::logic_error("Top-level hierarchy update requires the previous hierarchy");
-  }
-
   // Create a descriptor of the requested builder work, to generate a top-level
   // AS from the input parameters
   D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc = {};
@@ -248,12 +299,37 @@ void TopLevelASGenerator::Generate(
   commandList->ResourceBarrier(1, &uavBarrier);
 }
 
+//--------------------------------------------------------------------------------------------------
+//
+// Write the descriptor of an instance
+void TopLevelASGenerator::WriteInstanceDesc(const Instance& instance,
+                                            D3D12_RAYTRACING_INSTANCE_DESC& desc) const
+{
+  // Instance ID visible in the shader in InstanceID()
+  desc.InstanceID = instance.instanceID;
+  // Index of the hit group invoked upon intersection
+  desc.InstanceContributionToHitGroupIndex = instance.hitGroupIndex;
+  // Instance flags, including backface culling, winding, etc - TODO: should
+  // be accessible from outside
+  desc.Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
+  // Instance transform matrix
+  DirectX::XMMATRIX m = XMMatrixTranspose(
+      DirectX::XMLoadFloat4x4(&instance.transform)); // GLM is column major, the INSTANCE_DESC is row major
+  memcpy(desc.Transform, &m, sizeof(desc.Transform));
+  // Get access to the bottom level
+  desc.AccelerationStructure = instance.bottomLevelAS->GetGPUVirtualAddress();
+  // Visibility mask, always visible here - TODO: should be accessible from
+  // outside
+  desc.InstanceMask = 0xFF;
+}
+
 //--------------------------------------------------------------------------------------------------
 //
 //
 TopLevelASGenerator::Instance::Instance(ID3D12Resource* blAS, const DirectX::XMMATRIX& tr, UINT iID,
                                         UINT hgId)
-    : bottomLevelAS(blAS), transform(tr), instanceID(iID), hitGroupIndex(hgId)
+    : bottomLevelAS(blAS), instanceID(iID), hitGroupIndex(hgId)
 {
+  DirectX::XMStoreFloat4x4(&transform, tr);
 }
 } // namespace nv_helpers_dx12
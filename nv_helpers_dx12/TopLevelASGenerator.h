@@ -43,6 +43,10 @@ acceleration structure and store it in the result buffer.
 Note that the build is enqueued in the command list, meaning that the scratch
 buffer needs to be kept until the command list execution is finished.
 
+Applications keeping their own instance data can also write the instance
+descriptors themselves, and build from them with GenerateFromDescriptors. The
+generator then only sizes and enqueues the builds.
+
 
 
 Example:
@@ -116,6 +120,12 @@ public:
                                      /// indices etc.
   );
 
+  /// Compute the buffer sizes for instanceCount instances whose descriptors are written by the
+  /// application rather than added with AddInstance, see GenerateFromDescriptors
+  void ComputeASBufferSizes(ID3D12Device5* device, bool allowUpdate, UINT instanceCount,
+                            UINT64* scratchSizeInBytes, UINT64* resultSizeInBytes,
+                            UINT64* descriptorsSizeInBytes);
+
   /// Enqueue the construction of the acceleration structure on a command list,
   /// using application-provided buffers and possibly a pointer to the previous
   /// acceleration structure in case of iterative updates. Note that the update
@@ -133,21 +143,44 @@ public:
                                                /// if an iterative update is requested
   );
 
+  /// Enqueue the construction of the acceleration structure from the instance descriptors
+  /// already written by the application in descriptorsBuffer, for example from its own instance
+  /// store. The instances added with AddInstance are ignored
+  void GenerateFromDescriptors(
+      ID3D12GraphicsCommandList4* commandList, /// Command list on which the build will be enqueued
+      ID3D12Resource* scratchBuffer,     /// Scratch buffer used by the builder to
+                                         /// store temporary data
+      ID3D12Resource* resultBuffer,      /// Result buffer storing the acceleration structure
+      ID3D12Resource* descriptorsBuffer, /// Instance descriptors written by the application
+      UINT instanceCount,                /// Number of instance descriptors
+      bool updateOnly = false, /// If true, simply refit the existing acceleration structure
+      ID3D12Resource* previousResult = nullptr /// Optional previous acceleration structure, used
+                                               /// if an iterative update is requested
+  );
+
 private:
+  /// Enqueue the build or the update of the acceleration structure, once the descriptors are written
+  void BuildFromDescriptors(ID3D12GraphicsCommandList4* commandList, ID3D12Resource* scratchBuffer,
+                            ID3D12Resource* resultBuffer, ID3D12Resource* descriptorsBuffer,
+                            UINT instanceCount, bool updateOnly, ID3D12Resource* previousResult);
+
   /// Helper struct storing the instance data
   struct Instance
   {
     Instance(ID3D12Resource* blAS, const DirectX::XMMATRIX& tr, UINT iID, UINT hgId);
     /// Bottom-level AS
     ID3D12Resource* bottomLevelAS;
-    /// Transform matrix
-    const DirectX::XMMATRIX& transform;
+    /// Transform matrix. A copy is kept, as the matrix given to AddInstance may be a temporary
+    DirectX::XMFLOAT4X4 transform;
     /// Instance ID visible in the shader
     UINT instanceID;
     /// Hit group index used to fetch the shaders from the SBT
     UINT hitGroupIndex;
   };
 
+  /// Write the descriptor of an instance
+  void WriteInstanceDesc(const Instance& instance, D3D12_RAYTRACING_INSTANCE_DESC& desc) const;
+
   /// Construction flags, indicating whether the AS supports iterative updates
   D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS m_flags;
   /// Instances contained in the top-level AS
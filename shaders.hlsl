@@ -24,7 +24,11 @@ struct InstanceProperties
 
 StructuredBuffer<InstanceProperties> instanceProps : register(t0);
 
-uint instanceIndex : register(b1);
+// #DXR Custom: Draw Batching
+// Each instanced draw reads its instances from drawInstances[instanceOffset + SV_InstanceID],
+// which gives their index in instanceProps (see DrawBatcher)
+uint instanceOffset : register(b1);
+StructuredBuffer<uint> drawInstances : register(t1);
 
 struct PSInput
 {
@@ -32,10 +36,13 @@ struct PSInput
 	float4 color : COLOR;
 };
 
-PSInput VSMain(float4 position : POSITION, float4 color : COLOR)
+PSInput VSMain(float4 position : POSITION, float4 color : COLOR, uint instanceID : SV_InstanceID)
 {
 	PSInput result;
 
+    // #DXR Custom: Draw Batching
+    uint instanceIndex = drawInstances[instanceOffset + instanceID];
+
 	// #DXR Extra: Perspective Camera
     // #DXR Extra: Refitting (Rasterization)
     float4 pos;
@@ -0,0 +1,146 @@
+// #DXR Custom: GPU Memory Suballocation
+// Tests of D3D12MemoryHeapFactory, with a device creating buffers in system memory
+
+#include "TestFramework.h"
+
+#include "nv_helpers_dx12/D3D12MemoryHeap.h"
+
+#include <vector>
+
+using namespace nv_helpers_dx12;
+
+namespace
+{
+	int g_liveResourceCount = 0;
+
+	/// Buffer in system memory, counting its mappings
+	struct MockResource : ID3D12Resource
+	{
+		MockResource(uint64_t width, D3D12_GPU_VIRTUAL_ADDRESS address) : storage(width), gpuAddress(address)
+		{
+			g_liveResourceCount++;
+		}
+		~MockResource() override { g_liveResourceCount--; }
+
+		HRESULT Map(UINT, const D3D12_RANGE*, void** data) override
+		{
+			mapCount++;
+			*data = storage.data();
+			return S_OK;
+		}
+		void Unmap(UINT, const D3D12_RANGE*) override { mapCount--; }
+		D3D12_GPU_VIRTUAL_ADDRESS GetGPUVirtualAddress() override { return gpuAddress; }
+
+		std::vector<uint8_t> storage;
+		D3D12_GPU_VIRTUAL_ADDRESS gpuAddress;
+		int mapCount = 0;
+	};
+
+	/// Records the committed buffers it creates
+	struct MockDevice : ID3D12Device
+	{
+		HRESULT CreateCommittedResource(const D3D12_HEAP_PROPERTIES* heapProps, D3D12_HEAP_FLAGS,
+			const D3D12_RESOURCE_DESC* desc, D3D12_RESOURCE_STATES initialState, const D3D12_CLEAR_VALUE*,
+			REFIID riid, void** resource) override
+		{
+			*resource = nullptr;
+			if (fail || riid != MockIidOf<ID3D12Resource>())
+				return E_FAIL;
+
+			heapTypes.push_back(heapProps->Type);
+			descs.push_back(*desc);
+			initialStates.push_back(initialState);
+			MockResource* created = new MockResource(desc->Width, nextGPUAddress);
+			nextGPUAddress += 16 * MemoryAlignment::Heap;
+			resources.push_back(created);
+			*resource = static_cast<ID3D12Resource*>(created);
+			return S_OK;
+		}
+
+		bool fail = false;
+		D3D12_GPU_VIRTUAL_ADDRESS nextGPUAddress = 0x10000000;
+		std::vector<D3D12_HEAP_TYPE> heapTypes;
+		std::vector<D3D12_RESOURCE_DESC> descs;
+		std::vector<D3D12_RESOURCE_STATES> initialStates;
+		std::vector<MockResource*> resources;
+	};
+
+	D3D12_HEAP_PROPERTIES MakeHeapProperties(D3D12_HEAP_TYPE type)
+	{
+		D3D12_HEAP_PROPERTIES heapProps = {};
+		heapProps.Type = type;
+		heapProps.CreationNodeMask = 1;
+		heapProps.VisibleNodeMask = 1;
+		return heapProps;
+	}
+}
+
+TEST_CASE(UploadPagesAreMappedBuffers)
+{
+	MockDevice* device = new MockDevice();
+	{
+		D3D12MemoryHeapFactory factory(device, MakeHeapProperties(D3D12_HEAP_TYPE_UPLOAD), D3D12_RESOURCE_FLAG_NONE,
+			D3D12_RESOURCE_STATE_GENERIC_READ);
+		MemoryPool pool(factory, MemoryPoolDesc{ AllocationStrategy::Linear, 64 * 1024 });
+		MemoryAllocation first = pool.Allocate(16, MemoryAlignment::ConstantBuffer);
+		MemoryAllocation second = pool.Allocate(16, MemoryAlignment::ConstantBuffer);
+
+		REQUIRE(device->resources.size() == 1);
+		MockResource* resource = device->resources[0];
+		CHECK(device->heapTypes[0] == D3D12_HEAP_TYPE_UPLOAD);
+		CHECK(device->initialStates[0] == D3D12_RESOURCE_STATE_GENERIC_READ);
+		const D3D12_RESOURCE_DESC& desc = device->descs[0];
+		CHECK(desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER);
+		CHECK(desc.Width == 64 * 1024);
+		CHECK(desc.Layout == D3D12_TEXTURE_LAYOUT_ROW_MAJOR);
+		CHECK(desc.Flags == D3D12_RESOURCE_FLAG_NONE);
+		CHECK(resource->mapCount == 1);
+
+		// The allocations are ranges of the buffer, written through the persistent mapping
+		CHECK(first.gpuAddress == resource->gpuAddress);
+		CHECK(second.gpuAddress == resource->gpuAddress + 256);
+		REQUIRE(second.cpuAddress == resource->storage.data() + 256);
+		second.cpuAddress[0] = 42;
+		CHECK(resource->storage[256] == 42);
+		CHECK(static_cast<D3D12MemoryHeap*>(second.heap)->GetResource() == resource);
+	}
+
+	// The pages are unmapped and released with the pool
+	CHECK(g_liveResourceCount == 0);
+	device->Release();
+}
+
+TEST_CASE(DefaultPagesAreNotMapped)
+{
+	MockDevice* device = new MockDevice();
+	{
+		D3D12MemoryHeapFactory factory(device, MakeHeapProperties(D3D12_HEAP_TYPE_DEFAULT),
+			D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE);
+		MemoryPool pool(factory, MemoryPoolDesc{ AllocationStrategy::Buddy, 64 * 1024, 256 });
+		MemoryAllocation allocation = pool.Allocate(1000, MemoryAlignment::AccelerationStructure);
+		MemoryAllocation dedicated = pool.Allocate(100 * 1024, MemoryAlignment::AccelerationStructure);
+
+		REQUIRE(device->resources.size() == 2);
+		CHECK(device->descs[0].Flags == D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+		CHECK(device->initialStates[0] == D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE);
+		CHECK(device->descs[1].Width == 128 * 1024);
+		CHECK(device->resources[0]->mapCount == 0);
+		CHECK(allocation.cpuAddress == nullptr);
+		CHECK(allocation.gpuAddress == device->resources[0]->gpuAddress);
+		CHECK(dedicated.gpuAddress == device->resources[1]->gpuAddress);
+	}
+	CHECK(g_liveResourceCount == 0);
+	device->Release();
+}
+
+TEST_CASE(FailedResourceCreationThrows)
+{
+	MockDevice* device = new MockDevice();
+	device->fail = true;
+	D3D12MemoryHeapFactory factory(device, MakeHeapProperties(D3D12_HEAP_TYPE_UPLOAD), D3D12_RESOURCE_FLAG_NONE,
+		D3D12_RESOURCE_STATE_GENERIC_READ);
+	MemoryPool pool(factory);
+	CHECK_THROWS(pool.Allocate(256, MemoryAlignment::ConstantBuffer), std::logic_error);
+	CHECK(pool.GetStats().pageCount == 0);
+	device->Release();
+}
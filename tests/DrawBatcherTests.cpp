@@ -0,0 +1,179 @@
+// #DXR Custom: Draw Batching
+// Tests of DrawBatcher, recording into a sink which logs the commands instead of a command list
+
+#include "TestFramework.h"
+
+#include "DrawBatcher.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+
+namespace
+{
+	/// Sink logging each command as a line of text, and drawing the instances it is given
+	class MockDrawCommandSink : public DrawCommandSink
+	{
+	public:
+		explicit MockDrawCommandSink(const std::vector<uint32_t>& instances) : m_instances(instances) {}
+
+		void SetPipelineState(uint32_t pipelineState) override
+		{
+			commands.push_back("pso " + std::to_string(pipelineState));
+			m_pipelineState = pipelineState;
+		}
+
+		void SetMesh(uint32_t mesh) override
+		{
+			commands.push_back("mesh " + std::to_string(mesh));
+			m_mesh = mesh;
+		}
+
+		void SetInstanceOffset(uint32_t firstInstance) override
+		{
+			m_firstInstance = firstInstance;
+		}
+
+		void DrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex) override
+		{
+			commands.push_back("draw " + std::to_string(firstIndex) + "+" + std::to_string(indexCount) + " x" +
+				std::to_string(instanceCount));
+			drawCallCount++;
+
+			// What the vertex shader sees: the instance list read at the offset plus SV_InstanceID
+			for (uint32_t instanceId = 0; instanceId < instanceCount; instanceId++)
+			{
+				drawnItems.push_back({ m_pipelineState, m_mesh, firstIndex, indexCount,
+					m_instances[m_firstInstance + instanceId] });
+			}
+		}
+
+		std::vector<std::string> commands;
+		std::vector<DrawItem> drawnItems;
+		uint32_t drawCallCount = 0;
+
+	private:
+		const std::vector<uint32_t>& m_instances;
+		uint32_t m_pipelineState = ~0u;
+		uint32_t m_mesh = ~0u;
+		uint32_t m_firstInstance = ~0u;
+	};
+
+	bool ItemOrder(const DrawItem& a, const DrawItem& b)
+	{
+		if (a.pipelineState != b.pipelineState)
+			return a.pipelineState < b.pipelineState;
+		if (a.mesh != b.mesh)
+			return a.mesh < b.mesh;
+		if (a.firstIndex != b.firstIndex)
+			return a.firstIndex < b.firstIndex;
+		if (a.indexCount != b.indexCount)
+			return a.indexCount < b.indexCount;
+		return a.instance < b.instance;
+	}
+
+	bool SameItems(std::vector<DrawItem> a, std::vector<DrawItem> b)
+	{
+		std::sort(a.begin(), a.end(), ItemOrder);
+		std::sort(b.begin(), b.end(), ItemOrder);
+		return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const DrawItem& x, const DrawItem& y)
+		{
+			return !ItemOrder(x, y) && !ItemOrder(y, x);
+		});
+	}
+}
+
+TEST_CASE(RecordSetsTheStateOnlyWhenItChanges)
+{
+	DrawBatcher batcher;
+	batcher.Add(1, 0, 0, 12, 0);
+	batcher.Add(0, 1, 0, 6, 1);
+	batcher.Add(1, 0, 0, 12, 2);
+	batcher.Add(0, 0, 0, 12, 3);
+	batcher.Add(0, 0, 12, 6, 4);
+	batcher.Add(0, 0, 0, 12, 5);
+	batcher.Add(1, 1, 0, 6, 6);
+	batcher.Add(0, 1, 0, 0, 7);
+	batcher.Build();
+	CHECK(batcher.GetDrawCount() == 7);
+
+	MockDrawCommandSink sink(batcher.GetInstances());
+	batcher.Record(sink);
+	const std::vector<std::string> expected =
+	{
+		"pso 0", "mesh 0", "draw 0+12 x2", "draw 12+6 x1", "mesh 1", "draw 0+6 x1",
+		"pso 1", "mesh 0", "draw 0+12 x2", "mesh 1", "draw 0+6 x1",
+	};
+	CHECK(sink.commands == expected);
+}
+
+TEST_CASE(RecordDrawsEveryInstanceOnce)
+{
+	std::mt19937 random(11);
+	std::vector<DrawItem> items;
+	DrawBatcher batcher;
+	for (uint32_t instance = 0; instance < 2000; instance++)
+	{
+		DrawItem item = { static_cast<uint32_t>(random() % 3), static_cast<uint32_t>(random() % 4),
+			static_cast<uint32_t>(36 * (random() % 2)), 36, instance };
+		items.push_back(item);
+		batcher.Add(item.pipelineState, item.mesh, item.firstIndex, item.indexCount, item.instance);
+	}
+	batcher.Build();
+
+	MockDrawCommandSink sink(batcher.GetInstances());
+	batcher.Record(sink);
+	CHECK(SameItems(sink.drawnItems, items));
+	CHECK(sink.drawCallCount == batcher.GetBatches().size());
+	CHECK(sink.drawCallCount <= 3 * 4 * 2);
+	CHECK(std::count_if(sink.commands.begin(), sink.commands.end(),
+		[](const std::string& command) { return command.compare(0, 4, "pso ") == 0; }) == 3);
+}
+
+TEST_CASE(BatchesDoNotDependOnTheOrderOfTheDraws)
+{
+	std::vector<DrawItem> items;
+	for (uint32_t instance = 0; instance < 100; instance++)
+	{
+		items.push_back({ instance % 2, instance % 5, 0, 24, instance });
+	}
+
+	DrawBatcher forward;
+	for (const DrawItem& item : items)
+	{
+		forward.Add(item.pipelineState, item.mesh, item.firstIndex, item.indexCount, item.instance);
+	}
+	forward.Build();
+
+	std::mt19937 random(3);
+	std::shuffle(items.begin(), items.end(), random);
+	DrawBatcher shuffled;
+	for (const DrawItem& item : items)
+	{
+		shuffled.Add(item.pipelineState, item.mesh, item.firstIndex, item.indexCount, item.instance);
+	}
+	shuffled.Build();
+
+	CHECK(forward.GetInstances() == shuffled.GetInstances());
+	MockDrawCommandSink forwardSink(forward.GetInstances());
+	MockDrawCommandSink shuffledSink(shuffled.GetInstances());
+	forward.Record(forwardSink);
+	shuffled.Record(shuffledSink);
+	CHECK(forwardSink.commands == shuffledSink.commands);
+}
+
+TEST_CASE(ClearRemovesTheDrawsAndTheBatches)
+{
+	DrawBatcher batcher;
+	batcher.Add(0, 0, 0, 3, 0);
+	batcher.Build();
+	batcher.Clear();
+	batcher.Build();
+	CHECK(batcher.GetDrawCount() == 0);
+	CHECK(batcher.GetBatches().empty());
+	CHECK(batcher.GetInstances().empty());
+
+	MockDrawCommandSink sink(batcher.GetInstances());
+	batcher.Record(sink);
+	CHECK(sink.commands.empty());
+}
@@ -0,0 +1,135 @@
+// #DXR Custom: Frames In Flight
+// Tests of FrameContextRing, scheduled against SoftwareFence, which stands for a GPU running a
+// fixed number of frames behind the CPU
+
+#include "TestFramework.h"
+
+#include "nv_helpers_dx12/FrameContextRing.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace nv_helpers_dx12;
+
+TEST_CASE(BeginFrameBlocksWhenTheLatencyReachesTheRingDepth)
+{
+	const uint32_t frameCount = 20;
+	for (uint32_t depth = 1; depth <= 3; depth++)
+	{
+		for (uint32_t latency = 0; latency <= 4; latency++)
+		{
+			SoftwareFence fence(latency);
+			FrameContextRing ring(fence, depth);
+			for (uint32_t frame = 0; frame < frameCount; frame++)
+			{
+				uint32_t blockingWaits = ring.GetStats().blockingWaits;
+				CHECK(ring.BeginFrame() == frame % depth);
+
+				// The first use of each context never waits, the later ones wait on every frame
+				// once the GPU is as many frames behind as there are contexts
+				bool blocked = ring.GetStats().blockingWaits != blockingWaits;
+				CHECK(blocked == (frame >= depth && latency >= depth));
+				CHECK(ring.EndFrame() == frame + 1);
+			}
+			CHECK(ring.GetStats().frameCount == frameCount);
+			CHECK(ring.GetStats().blockingWaits == (latency >= depth ? frameCount - depth : 0));
+		}
+	}
+}
+
+TEST_CASE(DeferredReleasesRunOnceTheirFrameCompletes)
+{
+	SoftwareFence fence(2);
+	FrameContextRing ring(fence, 3);
+	std::vector<std::string> released;
+
+	// Frame 0 ends with fence value 1, frame 1 with value 2
+	ring.BeginFrame();
+	ring.DeferRelease([&]() { released.push_back("A"); });
+	ring.EndFrame();
+	ring.BeginFrame();
+	ring.DeferRelease([&]() { released.push_back("B"); });
+	ring.DeferRelease([&]() {
+		released.push_back("C");
+		// A release deferring another one, which waits for the frame recorded when it runs
+		ring.DeferRelease([&]() { released.push_back("D"); });
+	});
+	ring.EndFrame();
+	CHECK(ring.GetStats().pendingReleases == 3);
+
+	// The GPU is two frames behind: value 1 completes once frame 2 is submitted
+	ring.BeginFrame();
+	CHECK(released.empty());
+	ring.EndFrame();
+	CHECK(fence.GetCompletedValue() == 1);
+	ring.BeginFrame();
+	CHECK((released == std::vector<std::string>{ "A" }));
+	ring.EndFrame();
+	ring.BeginFrame();
+	CHECK((released == std::vector<std::string>{ "A", "B", "C" }));
+	CHECK(ring.GetStats().pendingReleases == 1);
+	ring.EndFrame();
+
+	// D was deferred while recording frame 4, which ends with value 5
+	for (int frame = 5; frame < 7; frame++)
+	{
+		ring.BeginFrame();
+		CHECK(released.size() == 3);
+		ring.EndFrame();
+	}
+	ring.BeginFrame();
+	CHECK((released == std::vector<std::string>{ "A", "B", "C", "D" }));
+	CHECK(ring.GetStats().releasedCount == 4);
+	CHECK(ring.GetStats().pendingReleases == 0);
+}
+
+TEST_CASE(WaitForIdleDrainsTheQueue)
+{
+	SoftwareFence fence(3);
+	std::vector<int> released;
+	{
+		FrameContextRing ring(fence, 4);
+		for (int frame = 0; frame < 3; frame++)
+		{
+			ring.BeginFrame();
+			ring.DeferRelease([&released, frame]() { released.push_back(frame); });
+			ring.EndFrame();
+		}
+		CHECK(released.empty());
+		CHECK(fence.GetPendingSignalCount() == 3);
+
+		ring.WaitForIdle();
+		CHECK((released == std::vector<int>{ 0, 1, 2 }));
+		CHECK(fence.GetPendingSignalCount() == 0);
+		CHECK(fence.GetCompletedValue() == 4);
+		CHECK(ring.GetNextFenceValue() == 5);
+		CHECK(ring.GetStats().pendingReleases == 0);
+
+		// The next frame starts without waiting, on the context following the last frame
+		CHECK(ring.BeginFrame() == 3);
+		CHECK(ring.GetStats().blockingWaits == 0);
+
+		// The releases still pending run with the destruction of the ring
+		ring.DeferRelease([&]() { released.push_back(3); });
+	}
+	CHECK(released.size() == 4);
+}
+
+TEST_CASE(InvalidSchedulesThrow)
+{
+	SoftwareFence fence(1);
+	CHECK_THROWS(FrameContextRing(fence, 0), std::logic_error);
+
+	fence.Signal(2);
+	CHECK_THROWS(fence.Signal(2), std::logic_error);
+	CHECK_THROWS(fence.Wait(3), std::logic_error);
+	fence.Wait(2);
+	CHECK(fence.GetCompletedValue() == 2);
+
+	// Advance completes what is pending and no more
+	fence.Signal(3);
+	fence.Advance(5);
+	CHECK(fence.GetCompletedValue() == 3);
+	CHECK(fence.GetPendingSignalCount() == 0);
+}
@@ -0,0 +1,216 @@
+// #DXR Custom: Material Table
+// Tests of MaterialTable: the sharing and recycling of the material entries, and the bytes its
+// uploads write into an array standing for the mapped buffer
+
+#include "TestFramework.h"
+
+#include "MaterialTable.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+	const uint8_t kUnwritten = 0xCD;
+
+	Material MakeMaterial(float red, float green, float blue)
+	{
+		Material material;
+		material.albedo = XMVectorSet(red, green, blue, 1.0f);
+		material.specularReflection = XMVectorSet(0.5f, 0.5f, 0.5f, 16.0f);
+		return material;
+	}
+
+	/// Mapped upload buffer of a table, filled with kUnwritten until the table writes it
+	struct MappedTable
+	{
+		MappedTable(uint32_t instanceCapacity, uint32_t materialCapacity)
+			: layout(MaterialTable::ComputeLayout(instanceCapacity, materialCapacity)),
+			bytes(static_cast<size_t>(layout.sizeInBytes), kUnwritten)
+		{
+		}
+
+		uint32_t GetInstanceMaterial(uint32_t instanceID) const
+		{
+			uint32_t materialIndex;
+			memcpy(&materialIndex, &bytes[layout.instanceOffset + instanceID * sizeof(uint32_t)], sizeof(uint32_t));
+			return materialIndex;
+		}
+
+		XMFLOAT4 GetAlbedo(uint32_t materialIndex) const
+		{
+			XMFLOAT4 albedo;
+			memcpy(&albedo, &bytes[layout.albedoOffset + materialIndex * sizeof(XMFLOAT4)], sizeof(XMFLOAT4));
+			return albedo;
+		}
+
+		/// Offsets of the bytes different from kUnwritten
+		std::vector<uint64_t> GetWrittenOffsets() const
+		{
+			std::vector<uint64_t> offsets;
+			for (uint64_t offset = 0; offset < bytes.size(); offset++)
+			{
+				if (bytes[offset] != kUnwritten)
+					offsets.push_back(offset);
+			}
+			return offsets;
+		}
+
+		void Clear() { bytes.assign(bytes.size(), kUnwritten); }
+
+		MaterialTableLayout layout;
+		std::vector<uint8_t> bytes;
+	};
+
+	/// Offsets of a range of bytes, which must all have been written
+	void AppendRange(std::vector<uint64_t>& offsets, uint64_t start, uint64_t size)
+	{
+		for (uint64_t offset = start; offset < start + size; offset++)
+		{
+			offsets.push_back(offset);
+		}
+	}
+}
+
+TEST_CASE(IdenticalMaterialsShareAnEntry)
+{
+	MaterialTable table;
+	table.Resize(4);
+	CHECK(table.GetUniqueMaterialCount() == 1);
+	CHECK(table.GetMaterialSlotCount() == 1);
+
+	table.SetMaterial(0, MakeMaterial(1.0f, 0.0f, 0.0f));
+	table.SetMaterial(1, MakeMaterial(1.0f, 0.0f, 0.0f));
+	table.SetMaterial(2, MakeMaterial(0.0f, 1.0f, 0.0f));
+	CHECK(table.GetUniqueMaterialCount() == 3);
+	CHECK(table.GetMaterialSlotCount() == 3);
+
+	MappedTable mapped(4, 4);
+	table.Upload(mapped.bytes.data(), mapped.layout, true);
+	uint32_t red = mapped.GetInstanceMaterial(0);
+	CHECK(mapped.GetInstanceMaterial(1) == red);
+	CHECK(mapped.GetInstanceMaterial(2) != red);
+	CHECK(mapped.GetInstanceMaterial(3) != red);
+	CHECK(mapped.GetInstanceMaterial(3) != mapped.GetInstanceMaterial(2));
+	CHECK(mapped.GetAlbedo(red).x == 1.0f);
+	CHECK(mapped.GetAlbedo(red).y == 0.0f);
+
+	// Materials differing in any component are not shared
+	Material specular = MakeMaterial(1.0f, 0.0f, 0.0f);
+	specular.specularReflection = XMVectorSet(0.5f, 0.5f, 0.5f, 32.0f);
+	table.SetMaterial(3, specular);
+	CHECK(table.GetUniqueMaterialCount() == 3);
+	CHECK(table.GetMaterialSlotCount() == 4);
+}
+
+TEST_CASE(FreedEntriesAreReused)
+{
+	MaterialTable table;
+	table.Resize(2);
+	table.SetMaterial(0, MakeMaterial(1.0f, 0.0f, 0.0f));
+	table.SetMaterial(1, MakeMaterial(0.0f, 1.0f, 0.0f));
+	// The default material is no longer used
+	CHECK(table.GetUniqueMaterialCount() == 2);
+	CHECK(table.GetMaterialSlotCount() == 3);
+
+	// The new material takes the entry of the default one, then the red one is freed
+	table.SetMaterial(0, MakeMaterial(0.0f, 0.0f, 1.0f));
+	CHECK(table.GetUniqueMaterialCount() == 2);
+	CHECK(table.GetMaterialSlotCount() == 3);
+	table.SetMaterial(1, MakeMaterial(1.0f, 1.0f, 0.0f));
+	CHECK(table.GetMaterialSlotCount() == 3);
+
+	MappedTable mapped(2, 3);
+	table.Upload(mapped.bytes.data(), mapped.layout, true);
+	CHECK(mapped.GetInstanceMaterial(0) == 0);
+	CHECK(mapped.GetAlbedo(0).z == 1.0f);
+	CHECK(mapped.GetAlbedo(mapped.GetInstanceMaterial(1)).y == 1.0f);
+
+	// Reassigning the material of an instance keeps its entry
+	table.SetMaterial(0, MakeMaterial(0.0f, 0.0f, 1.0f));
+	CHECK(!table.HasChanges());
+	CHECK(table.GetUniqueMaterialCount() == 2);
+
+	// Shrinking the table releases the materials of the removed instances
+	table.Resize(1);
+	CHECK(table.GetUniqueMaterialCount() == 1);
+	table.Resize(2, MakeMaterial(0.0f, 1.0f, 1.0f));
+	CHECK(table.GetUniqueMaterialCount() == 2);
+	CHECK(table.GetMaterialSlotCount() == 3);
+
+	CHECK_THROWS(table.SetMaterial(2, MakeMaterial(1.0f, 1.0f, 1.0f)), std::logic_error);
+}
+
+TEST_CASE(PartialUploadWritesOnlyTheDirtyEntries)
+{
+	MaterialTable table;
+	table.Resize(8);
+	MappedTable mapped(8, 4);
+	uint64_t fullBytes = table.Upload(mapped.bytes.data(), mapped.layout, true);
+	CHECK(fullBytes == 8 * sizeof(uint32_t) + 2 * sizeof(XMFLOAT4));
+	CHECK(!table.HasChanges());
+
+	// A new material: the instance entry and both arrays of the material
+	mapped.Clear();
+	table.SetMaterial(5, MakeMaterial(1.0f, 0.0f, 0.0f));
+	CHECK(table.HasChanges());
+	uint64_t bytesWritten = table.Upload(mapped.bytes.data(), mapped.layout, false);
+	CHECK(bytesWritten == sizeof(uint32_t) + 2 * sizeof(XMFLOAT4));
+	uint32_t red = mapped.GetInstanceMaterial(5);
+	CHECK(red == 1);
+	std::vector<uint64_t> expected;
+	AppendRange(expected, mapped.layout.instanceOffset + 5 * sizeof(uint32_t), sizeof(uint32_t));
+	AppendRange(expected, mapped.layout.albedoOffset + red * sizeof(XMFLOAT4), sizeof(XMFLOAT4));
+	AppendRange(expected, mapped.layout.specularOffset + red * sizeof(XMFLOAT4), sizeof(XMFLOAT4));
+	CHECK(mapped.GetWrittenOffsets() == expected);
+
+	// A shared material: the instance entry only
+	mapped.Clear();
+	table.SetMaterial(3, MakeMaterial(1.0f, 0.0f, 0.0f));
+	CHECK(table.Upload(mapped.bytes.data(), mapped.layout, false) == sizeof(uint32_t));
+	expected.clear();
+	AppendRange(expected, mapped.layout.instanceOffset + 3 * sizeof(uint32_t), sizeof(uint32_t));
+	CHECK(mapped.GetWrittenOffsets() == expected);
+	CHECK(mapped.GetInstanceMaterial(3) == red);
+
+	// Nothing changed
+	mapped.Clear();
+	CHECK(table.Upload(mapped.bytes.data(), mapped.layout, false) == 0);
+	CHECK(mapped.GetWrittenOffsets().empty());
+
+	// Changes of an instance removed before the upload are not written
+	table.SetMaterial(7, MakeMaterial(0.0f, 1.0f, 0.0f));
+	table.Resize(7);
+	mapped.Clear();
+	table.Upload(mapped.bytes.data(), mapped.layout, false);
+	for (uint64_t offset : mapped.GetWrittenOffsets())
+	{
+		CHECK(offset >= mapped.layout.albedoOffset);
+	}
+}
+
+TEST_CASE(FitsFailsOnceTheCapacityIsExceeded)
+{
+	MaterialTableLayout layout = MaterialTable::ComputeLayout(3, 2);
+	CHECK(layout.albedoOffset == 16);
+	CHECK(layout.specularOffset == 16 + 2 * sizeof(XMFLOAT4));
+	CHECK(layout.sizeInBytes == 16 + 4 * sizeof(XMFLOAT4));
+
+	MaterialTable table;
+	table.Resize(3);
+	table.SetMaterial(0, MakeMaterial(1.0f, 0.0f, 0.0f));
+	CHECK(table.Fits(layout));
+
+	table.Resize(4);
+	CHECK(!table.Fits(layout));
+	std::vector<uint8_t> bytes(static_cast<size_t>(layout.sizeInBytes));
+	CHECK_THROWS(table.Upload(bytes.data(), layout, true), std::logic_error);
+
+	table.Resize(3);
+	CHECK(table.Fits(layout));
+	table.SetMaterial(1, MakeMaterial(0.0f, 1.0f, 0.0f));
+	CHECK(table.GetMaterialSlotCount() == 3);
+	CHECK(!table.Fits(layout));
+	CHECK_THROWS(table.Upload(bytes.data(), layout, false), std::logic_error);
+}
@@ -0,0 +1,222 @@
+// #DXR Custom: GPU Memory Suballocation
+// Tests of BuddyAllocator and MemoryPool, on heaps in system memory (CpuMemoryHeapFactory)
+
+#include "TestFramework.h"
+
+#include "nv_helpers_dx12/MemoryAllocator.h"
+
+using namespace nv_helpers_dx12;
+
+namespace
+{
+	const uint64_t kPageSize = 64 * 1024;
+
+	bool IsAligned(uint64_t value, uint64_t alignment) { return value % alignment == 0; }
+}
+
+TEST_CASE(BuddySplitsTheSmallestFreeBlock)
+{
+	BuddyAllocator buddy(1024, 64);
+	CHECK(buddy.GetFreeBytes() == 1024);
+	CHECK(buddy.GetLargestFreeBlock() == 1024);
+
+	// The first allocation splits the range down to 64 bytes, leaving 512, 256, 128 and 64
+	CHECK(buddy.Allocate(64, 1) == 0);
+	CHECK(buddy.GetFreeBytes() == 960);
+	CHECK(buddy.GetLargestFreeBlock() == 512);
+
+	// Sizes are rounded up to a power of two, and served by the free block of that size
+	CHECK(buddy.Allocate(100, 1) == 128);
+	CHECK(buddy.GetBlockSize(128) == 128);
+	CHECK(buddy.Allocate(64, 1) == 64);
+	CHECK(buddy.Allocate(300, 1) == 512);
+	CHECK(buddy.GetBlockSize(512) == 512);
+	CHECK(buddy.GetFreeBytes() == 256);
+	CHECK(buddy.GetLargestFreeBlock() == 256);
+}
+
+TEST_CASE(BuddyBlocksMergeBackWithTheirBuddy)
+{
+	BuddyAllocator buddy(1024, 64);
+	uint64_t offsets[16];
+	for (uint64_t& offset : offsets)
+	{
+		offset = buddy.Allocate(64, 1);
+		REQUIRE(offset != BuddyAllocator::kInvalidOffset);
+	}
+	CHECK(buddy.GetFreeBytes() == 0);
+	CHECK(buddy.GetLargestFreeBlock() == 0);
+	CHECK(buddy.Allocate(64, 1) == BuddyAllocator::kInvalidOffset);
+
+	// Every other block: nothing can merge, the free space is scattered
+	for (int i = 0; i < 16; i += 2)
+	{
+		buddy.Free(offsets[i]);
+	}
+	CHECK(buddy.GetFreeBytes() == 512);
+	CHECK(buddy.GetLargestFreeBlock() == 64);
+	CHECK(buddy.Allocate(128, 1) == BuddyAllocator::kInvalidOffset);
+
+	// Freeing the buddies merges the blocks up to the whole range
+	for (int i = 1; i < 16; i += 2)
+	{
+		buddy.Free(offsets[i]);
+	}
+	CHECK(buddy.GetFreeBytes() == 1024);
+	CHECK(buddy.GetLargestFreeBlock() == 1024);
+	CHECK(buddy.Allocate(1024, 1) == 0);
+}
+
+TEST_CASE(BuddyAlignsBlocksOnTheirSize)
+{
+	BuddyAllocator buddy(4096, 64);
+	CHECK(buddy.Allocate(64, 1) == 0);
+	uint64_t offset = buddy.Allocate(64, 256);
+	CHECK(offset == 256);
+	CHECK(buddy.GetBlockSize(offset) == 256);
+	CHECK(IsAligned(buddy.Allocate(32, 1024), 1024));
+	CHECK(buddy.Allocate(8192, 1) == BuddyAllocator::kInvalidOffset);
+	CHECK(buddy.Allocate(64, 8192) == BuddyAllocator::kInvalidOffset);
+}
+
+TEST_CASE(BuddyRejectsInvalidUse)
+{
+	CHECK_THROWS(BuddyAllocator(1000, 64), std::logic_error);
+	CHECK_THROWS(BuddyAllocator(1024, 48), std::logic_error);
+	CHECK_THROWS(BuddyAllocator(3 * 64, 64), std::logic_error);
+
+	BuddyAllocator buddy(1024, 64);
+	uint64_t offset = buddy.Allocate(128, 1);
+	CHECK_THROWS(buddy.Free(offset + 64), std::logic_error);
+	CHECK_THROWS(buddy.GetBlockSize(offset + 64), std::logic_error);
+	buddy.Free(offset);
+	CHECK_THROWS(buddy.Free(offset), std::logic_error);
+	CHECK(buddy.GetFreeBytes() == 1024);
+}
+
+TEST_CASE(BuddyPoolReportsUtilizationAndFragmentation)
+{
+	CpuMemoryHeapFactory factory;
+	MemoryPool pool(factory, MemoryPoolDesc{ AllocationStrategy::Buddy, kPageSize, 256 });
+	MemoryPoolStats stats = pool.GetStats();
+	CHECK(stats.pageCount == 0);
+	CHECK(stats.utilization == 0.0f);
+	CHECK(stats.fragmentation == 0.0f);
+
+	MemoryAllocation allocations[4];
+	for (MemoryAllocation& allocation : allocations)
+	{
+		allocation = pool.Allocate(100, MemoryAlignment::ConstantBuffer);
+		REQUIRE(allocation.IsValid());
+		CHECK(IsAligned(allocation.gpuAddress, MemoryAlignment::ConstantBuffer));
+		CHECK(allocation.cpuAddress != nullptr);
+		CHECK(allocation.size == 100);
+	}
+	stats = pool.GetStats();
+	CHECK(stats.pageCount == 1);
+	CHECK(stats.allocationCount == 4);
+	CHECK(stats.reservedBytes == kPageSize);
+	CHECK(stats.requestedBytes == 400);
+	CHECK(stats.allocatedBytes == 1024);
+	CHECK(stats.freeBytes == kPageSize - 1024);
+	CHECK(stats.largestFreeBlock == kPageSize / 2);
+	CHECK(stats.utilization == 400.0f / kPageSize);
+
+	// Two separate holes of 256 bytes: the free space is no longer contiguous
+	pool.Free(allocations[1]);
+	pool.Free(allocations[3]);
+	stats = pool.GetStats();
+	CHECK(stats.allocationCount == 2);
+	CHECK(stats.requestedBytes == 200);
+	CHECK(stats.allocatedBytes == 512);
+	CHECK(stats.freeBytes == kPageSize - 512);
+	CHECK(stats.fragmentation > 0.0f);
+	CHECK(stats.fragmentation == 1.0f - static_cast<float>(static_cast<double>(kPageSize / 2) / (kPageSize - 512)));
+
+	pool.Free(allocations[0]);
+	pool.Free(allocations[2]);
+	stats = pool.GetStats();
+	CHECK(stats.allocationCount == 0);
+	CHECK(stats.freeBytes == kPageSize);
+	CHECK(stats.largestFreeBlock == kPageSize);
+	CHECK(stats.fragmentation == 0.0f);
+	CHECK(factory.GetHeapCount() == 1);
+}
+
+TEST_CASE(PoolGivesOversizedAllocationsADedicatedPage)
+{
+	CpuMemoryHeapFactory factory;
+	MemoryPool buddyPool(factory, MemoryPoolDesc{ AllocationStrategy::Buddy, kPageSize, 256 });
+	MemoryAllocation small = buddyPool.Allocate(256, MemoryAlignment::AccelerationStructure);
+	MemoryAllocation large = buddyPool.Allocate(100 * 1024, MemoryAlignment::AccelerationStructure);
+	CHECK(small.pageIndex == 0);
+	CHECK(large.pageIndex == 1);
+	CHECK(large.offset == 0);
+	CHECK(large.heap->GetSize() == 128 * 1024);
+	CHECK(IsAligned(large.gpuAddress, MemoryAlignment::Heap));
+
+	// Heaps do not overlap
+	CHECK(large.gpuAddress >= small.heap->GetGPUAddress() + small.heap->GetSize());
+	CHECK(buddyPool.GetStats().reservedBytes == kPageSize + 128 * 1024);
+
+	// The small allocations still go to the first page
+	CHECK(buddyPool.Allocate(256, MemoryAlignment::ConstantBuffer).pageIndex == 0);
+
+	MemoryPool linearPool(factory, MemoryPoolDesc{ AllocationStrategy::Linear, kPageSize });
+	MemoryAllocation linearLarge = linearPool.Allocate(100000, MemoryAlignment::ShaderTable);
+	CHECK(linearLarge.heap->GetSize() == 100000);
+	CHECK(factory.GetHeapCount() == 3);
+}
+
+TEST_CASE(LinearPoolPadsForAlignmentAndResets)
+{
+	CpuMemoryHeapFactory factory;
+	MemoryPool pool(factory, MemoryPoolDesc{ AllocationStrategy::Linear, kPageSize });
+
+	MemoryAllocation first = pool.Allocate(10, MemoryAlignment::InstanceDescs);
+	MemoryAllocation second = pool.Allocate(10, MemoryAlignment::ConstantBuffer);
+	CHECK(first.offset == 0);
+	CHECK(second.offset == 256);
+	CHECK(second.cpuAddress == first.cpuAddress + 256);
+	MemoryPoolStats stats = pool.GetStats();
+	CHECK(stats.requestedBytes == 20);
+	CHECK(stats.allocatedBytes == 266);
+	CHECK(stats.freeBytes == kPageSize - 266);
+	CHECK(stats.fragmentation == 0.0f);
+
+	// A full page moves the allocations to a new page
+	MemoryAllocation third = pool.Allocate(40 * 1024, MemoryAlignment::ShaderTable);
+	MemoryAllocation fourth = pool.Allocate(40 * 1024, MemoryAlignment::ShaderTable);
+	CHECK(third.pageIndex == 0);
+	CHECK(fourth.pageIndex == 1);
+	CHECK(pool.GetStats().pageCount == 2);
+
+	// Individual allocations cannot be freed, Reset keeps the pages
+	CHECK_THROWS(pool.Free(first), std::logic_error);
+	pool.Reset();
+	stats = pool.GetStats();
+	CHECK(stats.pageCount == 2);
+	CHECK(stats.allocationCount == 0);
+	CHECK(stats.requestedBytes == 0);
+	CHECK(stats.freeBytes == 2 * kPageSize);
+	CHECK(pool.Allocate(10, MemoryAlignment::ConstantBuffer).offset == 0);
+	CHECK(factory.GetHeapCount() == 2);
+}
+
+TEST_CASE(PoolRejectsInvalidUse)
+{
+	CpuMemoryHeapFactory factory;
+	CHECK_THROWS(MemoryPool(factory, MemoryPoolDesc{ AllocationStrategy::Buddy, 0 }), std::logic_error);
+	CHECK_THROWS(MemoryPool(factory, MemoryPoolDesc{ AllocationStrategy::Buddy, kPageSize, 100 }), std::logic_error);
+
+	MemoryPool pool(factory, MemoryPoolDesc{ AllocationStrategy::Buddy, kPageSize, 256 });
+	CHECK_THROWS(pool.Allocate(0, MemoryAlignment::ConstantBuffer), std::logic_error);
+	CHECK_THROWS(pool.Allocate(16, 48), std::logic_error);
+	CHECK_THROWS(pool.Allocate(16, 2 * MemoryAlignment::Heap), std::logic_error);
+
+	MemoryPool otherPool(factory, MemoryPoolDesc{ AllocationStrategy::Buddy, kPageSize, 256 });
+	MemoryAllocation foreign = otherPool.Allocate(256, MemoryAlignment::ConstantBuffer);
+	pool.Allocate(256, MemoryAlignment::ConstantBuffer);
+	CHECK_THROWS(pool.Free(foreign), std::logic_error);
+	CHECK_THROWS(pool.Free(MemoryAllocation()), std::logic_error);
+}
@@ -0,0 +1,111 @@
+// #DXR Custom: Mesh Optimizer
+// Tests of the vertex cache stages of MeshOptimizer, on a grid whose triangles are shuffled
+
+#include "TestFramework.h"
+#include "TestMeshes.h"
+
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <array>
+
+namespace
+{
+	const uint32_t kCacheSize = 16;
+
+	/// Triangles of an index buffer as position triples in corner order, sorted, to compare the
+	/// geometry of two buffers regardless of the order of the triangles and vertices
+	std::vector<std::array<float, 9>> GetSortedTriangles(const std::vector<Vertex>& vertices,
+		const std::vector<uint32_t>& indices)
+	{
+		std::vector<std::array<float, 9>> triangles(indices.size() / 3);
+		for (size_t t = 0; t < triangles.size(); t++)
+		{
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				const XMFLOAT3& position = vertices[indices[3 * t + c]].position;
+				triangles[t][3 * c] = position.x;
+				triangles[t][3 * c + 1] = position.y;
+				triangles[t][3 * c + 2] = position.z;
+			}
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+
+	void CheckVertexCacheOrder(void (*optimize)(std::vector<uint32_t>&, uint32_t, uint32_t))
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		TestMeshes::MakeShuffledGrid(40, vertices, indices);
+		const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+		VertexCacheStats before = MeshOptimizer::AnalyzeVertexCache(indices, vertexCount, kCacheSize);
+
+		std::vector<uint32_t> optimized = indices;
+		optimize(optimized, vertexCount, kCacheSize);
+		VertexCacheStats after = MeshOptimizer::AnalyzeVertexCache(optimized, vertexCount, kCacheSize);
+
+		// Same triangles with the same corner order, far fewer vertex shader invocations
+		CHECK(GetSortedTriangles(vertices, optimized) == GetSortedTriangles(vertices, indices));
+		CHECK(before.acmr > 2.5f);
+		CHECK(after.acmr < 0.8f);
+		CHECK(after.atvr < 1.6f);
+	}
+}
+
+TEST_CASE(TipsifyKeepsTheTrianglesAndReducesTheACMR)
+{
+	CheckVertexCacheOrder(MeshOptimizer::OptimizeVertexCache);
+}
+
+TEST_CASE(ForsythKeepsTheTrianglesAndReducesTheACMR)
+{
+	CheckVertexCacheOrder(MeshOptimizer::OptimizeVertexCacheForsyth);
+}
+
+TEST_CASE(ForsythHandlesDegenerateTriangles)
+{
+	std::vector<uint32_t> indices = { 0, 1, 2, 2, 2, 3, 1, 3, 2, 4, 4, 4 };
+	std::vector<uint32_t> optimized = indices;
+	MeshOptimizer::OptimizeVertexCacheForsyth(optimized, 5, kCacheSize);
+	REQUIRE(optimized.size() == indices.size());
+
+	std::vector<std::array<uint32_t, 3>> expected = { { { 0, 1, 2 } }, { { 2, 2, 3 } }, { { 1, 3, 2 } }, { { 4, 4, 4 } } };
+	std::vector<std::array<uint32_t, 3>> triangles;
+	for (size_t i = 0; i < optimized.size(); i += 3)
+	{
+		triangles.push_back({ { optimized[i], optimized[i + 1], optimized[i + 2] } });
+	}
+	std::sort(expected.begin(), expected.end());
+	std::sort(triangles.begin(), triangles.end());
+	CHECK(triangles == expected);
+}
+
+TEST_CASE(OptimizeKeepsTheGeometryWithEitherAlgorithm)
+{
+	const VertexCacheAlgorithm algorithms[] = { VertexCacheAlgorithm::Tipsify, VertexCacheAlgorithm::Forsyth };
+	for (VertexCacheAlgorithm algorithm : algorithms)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		TestMeshes::MakeShuffledGrid(30, vertices, indices);
+		std::vector<std::array<float, 9>> triangles = GetSortedTriangles(vertices, indices);
+
+		MeshOptimizationOptions options;
+		options.vertexCacheAlgorithm = algorithm;
+		MeshOptimizationStats stats;
+		MeshOptimizer::Optimize(vertices, indices, options, &stats);
+
+		CHECK(GetSortedTriangles(vertices, indices) == triangles);
+		CHECK(stats.after.acmr < stats.before.acmr);
+		CHECK(stats.clusterCount > 0);
+
+		// The vertex fetch stage stores the vertices in the order of their first use
+		uint32_t nextVertex = 0;
+		for (uint32_t index : indices)
+		{
+			CHECK(index <= nextVertex);
+			nextVertex = (std::max)(nextVertex, index + 1);
+		}
+	}
+}
@@ -0,0 +1,113 @@
+// #DXR Custom: Meshlets
+// Tests of MeshletBuilder::OrderTriangles, on a grid ordered for the vertex cache as MeshOptimizer
+// does before it
+
+#include "TestFramework.h"
+#include "TestMeshes.h"
+
+#include "MeshletBuilder.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace
+{
+	/// Grid of size x size quads in the XY plane, with its triangles shuffled then ordered by Tipsify
+	void MakeGrid(uint32_t size, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		TestMeshes::MakeShuffledGrid(size, vertices, indices);
+		MeshOptimizer::OptimizeVertexCache(indices, static_cast<uint32_t>(vertices.size()), 16);
+	}
+
+	/// Triangles of an index buffer in corner order, sorted
+	std::vector<std::array<uint32_t, 3>> GetSortedTriangles(const std::vector<uint32_t>& indices)
+	{
+		std::vector<std::array<uint32_t, 3>> triangles;
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			triangles.push_back({ { indices[i], indices[i + 1], indices[i + 2] } });
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+
+	float GetAverageRadius(const MeshletData& meshlets)
+	{
+		float radiusSum = 0.0f;
+		for (const MeshletBounds& bounds : meshlets.bounds)
+		{
+			radiusSum += bounds.radius;
+		}
+		return radiusSum / static_cast<float>(meshlets.bounds.size());
+	}
+}
+
+TEST_CASE(OrderTrianglesKeepsTheTrianglesAndTheirWinding)
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	MakeGrid(60, vertices, indices);
+
+	std::vector<uint32_t> ordered = indices;
+	MeshletBuilder::OrderTriangles(vertices.data(), static_cast<uint32_t>(vertices.size()), ordered.data(),
+		static_cast<uint32_t>(ordered.size()));
+	CHECK(ordered != indices);
+	CHECK(GetSortedTriangles(ordered) == GetSortedTriangles(indices));
+}
+
+TEST_CASE(OrderTrianglesGivesMoreCompactMeshlets)
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	MakeGrid(150, vertices, indices);
+	const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+	const uint32_t indexCount = static_cast<uint32_t>(indices.size());
+
+	MeshletData scanned;
+	MeshletStats scannedStats;
+	MeshletBuilder::Build(vertices.data(), vertexCount, indices.data(), indexCount, scanned, {}, &scannedStats);
+
+	std::vector<uint32_t> ordered = indices;
+	MeshletBuilder::OrderTriangles(vertices.data(), vertexCount, ordered.data(), indexCount);
+	MeshletData grown;
+	MeshletStats grownStats;
+	MeshletBuilder::Build(vertices.data(), vertexCount, ordered.data(), indexCount, grown, {}, &grownStats);
+
+	// Rounder meshlets, at the cost of at most a few percent more of them
+	CHECK(GetAverageRadius(grown) < 0.95f * GetAverageRadius(scanned));
+	CHECK(grownStats.meshletCount < scannedStats.meshletCount * 105 / 100);
+
+	const MeshletBuildOptions limits;
+	for (const Meshlet& meshlet : grown.meshlets)
+	{
+		CHECK(meshlet.vertexCount <= limits.maxVertices);
+		CHECK(meshlet.triangleCount <= limits.maxTriangles);
+	}
+}
+
+TEST_CASE(OrderTrianglesDoesNotDependOnTheThreadCount)
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	MakeGrid(200, vertices, indices);
+
+	std::vector<uint32_t> single = indices;
+	std::vector<uint32_t> parallel = indices;
+	MeshletBuildOptions options;
+	options.threadCount = 1;
+	MeshletBuilder::OrderTriangles(vertices.data(), static_cast<uint32_t>(vertices.size()), single.data(),
+		static_cast<uint32_t>(single.size()), options);
+	options.threadCount = 4;
+	MeshletBuilder::OrderTriangles(vertices.data(), static_cast<uint32_t>(vertices.size()), parallel.data(),
+		static_cast<uint32_t>(parallel.size()), options);
+	CHECK(single == parallel);
+}
+
+TEST_CASE(OrderTrianglesRejectsAnIndexOutOfRange)
+{
+	std::vector<Vertex> vertices(3);
+	std::vector<uint32_t> indices = { 0, 1, 2, 2, 1, 3 };
+	CHECK_THROWS(MeshletBuilder::OrderTriangles(vertices.data(), 3, indices.data(), 6), std::runtime_error);
+}
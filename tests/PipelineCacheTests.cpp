@@ -0,0 +1,302 @@
+// #DXR Custom: Pipeline Cache
+// Tests of the canonical pipeline descriptions of RayTracingPipelineGenerator and of their keys,
+// and of PipelineCache with a device creating empty state objects
+
+#include "TestFramework.h"
+
+#include "PipelineCache.h"
+#include "nv_helpers_dx12/RootSignatureGenerator.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+
+using Microsoft::WRL::ComPtr;
+using nv_helpers_dx12::RayTracingPipelineGenerator;
+
+namespace
+{
+	/// Compiled library, whose bytes are the given text
+	struct MockDxilLibrary : IDxcBlob
+	{
+		explicit MockDxilLibrary(const std::string& code) : bytes(code.begin(), code.end()) {}
+
+		void* GetBufferPointer() override { return bytes.data(); }
+		SIZE_T GetBufferSize() override { return bytes.size(); }
+
+		std::vector<uint8_t> bytes;
+	};
+
+	/// Private data storage of the D3D12 objects
+	template <class Interface>
+	struct MockObject : Interface
+	{
+		HRESULT GetPrivateData(REFGUID guid, UINT* size, void* data) override
+		{
+			auto found = privateData.find(Key(guid));
+			if (found == privateData.end())
+				return DXGI_ERROR_NOT_FOUND;
+			if (data)
+			{
+				if (*size < found->second.size())
+					return E_INVALIDARG;
+				memcpy(data, found->second.data(), found->second.size());
+			}
+			*size = static_cast<UINT>(found->second.size());
+			return S_OK;
+		}
+
+		HRESULT SetPrivateData(REFGUID guid, UINT size, const void* data) override
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			privateData[Key(guid)].assign(bytes, bytes + size);
+			return S_OK;
+		}
+
+		static std::string Key(REFGUID guid) { return std::string(reinterpret_cast<const char*>(&guid), sizeof(GUID)); }
+
+		std::map<std::string, std::vector<uint8_t>> privateData;
+	};
+
+	/// Counts the state objects it creates, which hold nothing
+	struct MockDevice : MockObject<ID3D12Device5>
+	{
+		HRESULT CreateRootSignature(UINT, const void*, SIZE_T, REFIID riid, void** rootSignature) override
+		{
+			*rootSignature = nullptr;
+			if (riid != MockIidOf<ID3D12RootSignature>())
+				return E_NOINTERFACE;
+			*rootSignature = static_cast<ID3D12RootSignature*>(new MockObject<ID3D12RootSignature>());
+			return S_OK;
+		}
+
+		HRESULT CreateStateObject(const D3D12_STATE_OBJECT_DESC*, REFIID riid, void** stateObject) override
+		{
+			*stateObject = nullptr;
+			if (riid != MockIidOf<ID3D12StateObject>())
+				return E_NOINTERFACE;
+			stateObjectCount++;
+			*stateObject = static_cast<ID3D12StateObject*>(new MockObject<ID3D12StateObject>());
+			return S_OK;
+		}
+
+		int stateObjectCount = 0;
+	};
+
+	/// Blob store in memory, shared by the caches of a test to stand for successive runs
+	struct MemoryBlobStore : PipelineBlobStore
+	{
+		explicit MemoryBlobStore(std::map<CacheKey, std::vector<uint8_t>>& storage) : blobs(storage) {}
+
+		bool Load(const CacheKey& key, std::vector<uint8_t>& blob) override
+		{
+			auto found = blobs.find(key);
+			if (found == blobs.end())
+				return false;
+			blob = found->second;
+			return true;
+		}
+
+		bool Store(const CacheKey& key, const std::vector<uint8_t>& blob) override
+		{
+			blobs[key] = blob;
+			return true;
+		}
+
+		std::map<CacheKey, std::vector<uint8_t>>& blobs;
+	};
+
+	ComPtr<ID3D12RootSignature> MakeHitSignature(ID3D12Device* device, UINT vertexRegister = 0)
+	{
+		nv_helpers_dx12::RootSignatureGenerator generator;
+		generator.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, vertexRegister);
+		generator.AddHeapRangesParameter({ { 2, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1 } });
+		ComPtr<ID3D12RootSignature> signature;
+		signature.Attach(generator.Generate(device, true));
+		return signature;
+	}
+
+	ComPtr<ID3D12RootSignature> MakeMissSignature(ID3D12Device* device)
+	{
+		nv_helpers_dx12::RootSignatureGenerator generator;
+		generator.AddHeapRangesParameter({ { 0, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2 } });
+		ComPtr<ID3D12RootSignature> signature;
+		signature.Attach(generator.Generate(device, true));
+		return signature;
+	}
+
+	/// Pipeline of the sample, each field of which a test can change
+	struct PipelineVariant
+	{
+		bool reverseCalls = false;
+		std::wstring closestHit = L"ClosestHit";
+		std::wstring extraHitExport;
+		std::string hitCode = "hit code";
+		UINT payloadSize = 48;
+		UINT attributeSize = 8;
+		UINT recursionDepth = 3;
+		UINT hitVertexRegister = 0;
+		bool hitSignatureWithoutLayout = false;
+	};
+
+	/// Objects of a pipeline, new ones for each description so that only their content matters
+	struct PipelineObjects
+	{
+		PipelineObjects(MockDevice* device, const PipelineVariant& variant)
+		{
+			rayGen.Attach(new MockDxilLibrary("raygen code"));
+			miss.Attach(new MockDxilLibrary("miss code"));
+			hit.Attach(new MockDxilLibrary(variant.hitCode));
+			missSignature = MakeMissSignature(device);
+			if (variant.hitSignatureWithoutLayout)
+				hitSignature.Attach(new MockObject<ID3D12RootSignature>());
+			else
+				hitSignature = MakeHitSignature(device, variant.hitVertexRegister);
+		}
+
+		ComPtr<IDxcBlob> rayGen;
+		ComPtr<IDxcBlob> miss;
+		ComPtr<IDxcBlob> hit;
+		ComPtr<ID3D12RootSignature> missSignature;
+		ComPtr<ID3D12RootSignature> hitSignature;
+	};
+
+	void Describe(RayTracingPipelineGenerator& pipeline, const PipelineObjects& objects, const PipelineVariant& variant)
+	{
+		std::vector<std::wstring> hitExports = { variant.closestHit };
+		if (!variant.extraHitExport.empty())
+			hitExports.push_back(variant.extraHitExport);
+
+		if (!variant.reverseCalls)
+		{
+			pipeline.AddLibrary(objects.rayGen.Get(), { L"RayGen" });
+			pipeline.AddLibrary(objects.miss.Get(), { L"Miss", L"ShadowMiss" });
+			pipeline.AddLibrary(objects.hit.Get(), hitExports);
+			pipeline.AddHitGroup(L"HitGroup", variant.closestHit);
+			pipeline.AddRootSignatureAssociation(objects.hitSignature.Get(), { L"HitGroup" });
+			pipeline.AddRootSignatureAssociation(objects.missSignature.Get(), { L"Miss", L"ShadowMiss" });
+			pipeline.SetMaxPayloadSize(variant.payloadSize);
+			pipeline.SetMaxAttributeSize(variant.attributeSize);
+			pipeline.SetMaxRecursionDepth(variant.recursionDepth);
+			return;
+		}
+
+		std::reverse(hitExports.begin(), hitExports.end());
+		pipeline.SetMaxRecursionDepth(variant.recursionDepth);
+		pipeline.SetMaxAttributeSize(variant.attributeSize);
+		pipeline.AddRootSignatureAssociation(objects.missSignature.Get(), { L"ShadowMiss", L"Miss" });
+		pipeline.AddRootSignatureAssociation(objects.hitSignature.Get(), { L"HitGroup" });
+		pipeline.AddHitGroup(L"HitGroup", variant.closestHit);
+		pipeline.AddLibrary(objects.hit.Get(), hitExports);
+		pipeline.AddLibrary(objects.miss.Get(), { L"ShadowMiss", L"Miss" });
+		pipeline.AddLibrary(objects.rayGen.Get(), { L"RayGen" });
+		pipeline.SetMaxPayloadSize(variant.payloadSize);
+	}
+
+	std::vector<uint8_t> SerializeDescription(MockDevice* device, const PipelineVariant& variant,
+		bool* persistent = nullptr)
+	{
+		PipelineObjects objects(device, variant);
+		RayTracingPipelineGenerator pipeline(device);
+		Describe(pipeline, objects, variant);
+		std::vector<uint8_t> description;
+		bool isPersistent = pipeline.SerializeDescription(description);
+		if (persistent)
+			*persistent = isPersistent;
+		return description;
+	}
+}
+
+TEST_CASE(DescriptionDoesNotDependOnTheOrderOfTheCalls)
+{
+	ComPtr<MockDevice> device;
+	device.Attach(new MockDevice());
+
+	bool persistent = false;
+	std::vector<uint8_t> description = SerializeDescription(device.Get(), {}, &persistent);
+	CHECK(persistent);
+	CHECK(!description.empty());
+
+	PipelineVariant reversed;
+	reversed.reverseCalls = true;
+	std::vector<uint8_t> reversedDescription = SerializeDescription(device.Get(), reversed);
+	CHECK(reversedDescription == description);
+	CHECK(PipelineCache::ComputeKey(reversedDescription) == PipelineCache::ComputeKey(description));
+
+	// New library and root signature objects with the same content
+	CHECK(SerializeDescription(device.Get(), {}) == description);
+}
+
+TEST_CASE(EveryFieldChangesTheKey)
+{
+	ComPtr<MockDevice> device;
+	device.Attach(new MockDevice());
+
+	std::vector<PipelineVariant> variants(9);
+	variants[1].closestHit = L"PlaneClosestHit";
+	variants[2].extraHitExport = L"ShadowClosestHit";
+	variants[3].hitCode = "hit codf";
+	variants[4].payloadSize = 52;
+	variants[5].attributeSize = 16;
+	variants[6].recursionDepth = 2;
+	variants[7].hitVertexRegister = 1;
+	variants[8].hitSignatureWithoutLayout = true;
+
+	std::set<CacheKey> keys;
+	for (size_t i = 0; i < variants.size(); i++)
+	{
+		bool persistent = false;
+		keys.insert(PipelineCache::ComputeKey(SerializeDescription(device.Get(), variants[i], &persistent)));
+		CHECK(keys.size() == i + 1);
+
+		// A root signature not made by RootSignatureGenerator is only known by its address
+		CHECK(persistent == !variants[i].hitSignatureWithoutLayout);
+	}
+}
+
+TEST_CASE(CacheCreatesEachPipelineOnce)
+{
+	ComPtr<MockDevice> device;
+	device.Attach(new MockDevice());
+	std::map<CacheKey, std::vector<uint8_t>> storage;
+	PipelineVariant reversed;
+	reversed.reverseCalls = true;
+	PipelineVariant changed;
+	changed.payloadSize = 52;
+
+	auto getOrCreate = [&](PipelineCache& cache, const PipelineVariant& variant, bool& cacheHit)
+	{
+		PipelineObjects objects(device.Get(), variant);
+		RayTracingPipelineGenerator pipeline(device.Get());
+		Describe(pipeline, objects, variant);
+		return cache.GetOrCreate(pipeline, &cacheHit);
+	};
+
+	{
+		PipelineCache cache(std::unique_ptr<PipelineBlobStore>(new MemoryBlobStore(storage)));
+		bool cacheHit = true;
+		ComPtr<ID3D12StateObject> first = getOrCreate(cache, {}, cacheHit);
+		CHECK(!cacheHit);
+		ComPtr<ID3D12StateObject> second = getOrCreate(cache, reversed, cacheHit);
+		CHECK(cacheHit);
+		CHECK(second.Get() == first.Get());
+		ComPtr<ID3D12StateObject> third = getOrCreate(cache, changed, cacheHit);
+		CHECK(!cacheHit);
+		CHECK(third.Get() != first.Get());
+
+		CHECK(device->stateObjectCount == 2);
+		CHECK(cache.GetStats().memoryHitCount == 1);
+		CHECK(cache.GetStats().createCount == 2);
+		CHECK(cache.GetStats().knownCount == 0);
+		CHECK(storage.size() == 2);
+	}
+
+	// The next run creates the state objects again, knowing they were created before
+	PipelineCache cache(std::unique_ptr<PipelineBlobStore>(new MemoryBlobStore(storage)));
+	bool cacheHit = true;
+	getOrCreate(cache, reversed, cacheHit);
+	CHECK(!cacheHit);
+	CHECK(device->stateObjectCount == 3);
+	CHECK(cache.GetStats().knownCount == 1);
+}
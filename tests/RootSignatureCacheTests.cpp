@@ -0,0 +1,229 @@
+// #DXR Custom: Root Signature Cache
+// Tests of RootSignatureCache, with a device creating root signatures which keep their blob, and
+// the serialization of the mocks (see mocks/d3d12.cpp)
+
+#include "TestFramework.h"
+
+#include "RootSignatureCache.h"
+
+#include <cstdio>
+#include <map>
+#include <set>
+#include <string>
+
+using Microsoft::WRL::ComPtr;
+using nv_helpers_dx12::RootSignatureGenerator;
+
+namespace
+{
+	const char* kDirectory = "RootSignatureCacheTests.cache";
+
+	/// Root signature keeping the blob it was created from, and its private data
+	struct MockRootSignature : ID3D12RootSignature
+	{
+		HRESULT GetPrivateData(REFGUID guid, UINT* size, void* data) override
+		{
+			if (guid != nv_helpers_dx12::SerializedRootSignatureGuid || privateData.empty())
+				return DXGI_ERROR_NOT_FOUND;
+			if (data)
+			{
+				if (*size < privateData.size())
+					return E_INVALIDARG;
+				memcpy(data, privateData.data(), privateData.size());
+			}
+			*size = static_cast<UINT>(privateData.size());
+			return S_OK;
+		}
+
+		HRESULT SetPrivateData(REFGUID guid, UINT size, const void* data) override
+		{
+			if (guid != nv_helpers_dx12::SerializedRootSignatureGuid)
+				return E_INVALIDARG;
+			privateData.assign(static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+			return S_OK;
+		}
+
+		std::vector<uint8_t> blob;
+		std::vector<uint8_t> privateData;
+	};
+
+	/// Accepts the blobs of the mock serialization, unless told to reject the next one
+	struct MockDevice : ID3D12Device
+	{
+		HRESULT CreateRootSignature(UINT, const void* blob, SIZE_T blobSize, REFIID riid, void** rootSignature) override
+		{
+			*rootSignature = nullptr;
+			uint32_t magic = 0;
+			if (blobSize >= sizeof(magic))
+				memcpy(&magic, blob, sizeof(magic));
+			if (riid != MockIidOf<ID3D12RootSignature>() || magic != 0xB10B || rejectNext)
+			{
+				rejectNext = false;
+				return E_INVALIDARG;
+			}
+
+			MockRootSignature* created = new MockRootSignature();
+			created->blob.assign(static_cast<const uint8_t*>(blob), static_cast<const uint8_t*>(blob) + blobSize);
+			*rootSignature = static_cast<ID3D12RootSignature*>(created);
+			createCount++;
+			return S_OK;
+		}
+
+		bool rejectNext = false;
+		int createCount = 0;
+	};
+
+	/// Hit signature of the sample, with its ranges given as tuples
+	RootSignatureGenerator MakeHitSignature(UINT indexRegister = 1, UINT constantCount = 0)
+	{
+		RootSignatureGenerator generator;
+		generator.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, 0);
+		generator.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, indexRegister);
+		generator.AddHeapRangesParameter({ { 2, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1 },
+			{ 3, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2 }, { 4, 3, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 4 } });
+		generator.AddHeapRangesParameter({ { 0, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, 0 } });
+		generator.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_CBV, 0);
+		if (constantCount > 0)
+			generator.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS, 1, 0, constantCount);
+		return generator;
+	}
+
+	/// The same layout, with its ranges given as D3D12_DESCRIPTOR_RANGE
+	RootSignatureGenerator MakeHitSignatureFromRanges()
+	{
+		RootSignatureGenerator generator;
+		generator.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, 0);
+		generator.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, 1);
+		generator.AddHeapRangesParameter(std::vector<D3D12_DESCRIPTOR_RANGE>{
+			{ D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 2, 0, 1 }, { D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 3, 0, 2 },
+			{ D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 3, 4, 0, 4 } });
+		generator.AddHeapRangesParameter(std::vector<D3D12_DESCRIPTOR_RANGE>{
+			{ D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, 1, 0, 0, 0 } });
+		generator.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_CBV, 0);
+		return generator;
+	}
+
+	RootSignatureGenerator MakeMissSignature()
+	{
+		RootSignatureGenerator generator;
+		generator.AddHeapRangesParameter({ { 0, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2 } });
+		generator.AddHeapRangesParameter({ { 0, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, 0 } });
+		return generator;
+	}
+
+	CacheKey ComputeKey(const RootSignatureGenerator& generator, bool isLocal = true)
+	{
+		std::vector<uint8_t> layout;
+		generator.SerializeLayout(isLocal, layout);
+		return RootSignatureCache::ComputeKey(layout);
+	}
+
+	/// Remove the entries a test may have left in the cache directory
+	void RemoveEntries(const std::vector<RootSignatureGenerator>& generators)
+	{
+		CacheDirectory directory(kDirectory, ".rootsig", kRootSignatureCacheMagic, kRootSignatureCacheVersion);
+		for (const RootSignatureGenerator& generator : generators)
+		{
+			std::remove(directory.GetEntryFileName(ComputeKey(generator)).c_str());
+		}
+		std::remove(kDirectory);
+	}
+}
+
+TEST_CASE(SameLayoutGivesOneRootSignature)
+{
+	ComPtr<MockDevice> device;
+	device.Attach(new MockDevice());
+	RootSignatureCache cache;
+
+	// The hit, shadow and reflection hit groups of the sample
+	ComPtr<ID3D12RootSignature> hit = cache.GetOrCreate(device.Get(), MakeHitSignature(), true);
+	ComPtr<ID3D12RootSignature> shadow = cache.GetOrCreate(device.Get(), MakeHitSignature(), true);
+	ComPtr<ID3D12RootSignature> reflection = cache.GetOrCreate(device.Get(), MakeHitSignatureFromRanges(), true);
+	ComPtr<ID3D12RootSignature> miss = cache.GetOrCreate(device.Get(), MakeMissSignature(), true);
+	ComPtr<ID3D12RootSignature> global = cache.GetOrCreate(device.Get(), MakeHitSignature(), false);
+
+	CHECK(shadow.Get() == hit.Get());
+	CHECK(reflection.Get() == hit.Get());
+	CHECK(miss.Get() != hit.Get());
+	CHECK(global.Get() != hit.Get());
+	CHECK(cache.GetSize() == 3);
+	CHECK(device->createCount == 3);
+
+	const RootSignatureCacheStats& stats = cache.GetStats();
+	CHECK(stats.requestCount == 5);
+	CHECK(stats.sharedCount == 2);
+	CHECK(stats.createCount == 3);
+	CHECK(stats.serializeCount == 3);
+	CHECK(stats.diskHitCount == 0);
+
+	cache.Clear();
+	CHECK(cache.GetSize() == 0);
+}
+
+TEST_CASE(LayoutChangesGiveDifferentKeys)
+{
+	CHECK(ComputeKey(MakeHitSignature()) == ComputeKey(MakeHitSignatureFromRanges()));
+
+	// A range moved from one table to the next
+	RootSignatureGenerator twoThenOne;
+	twoThenOne.AddHeapRangesParameter({ { 0, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0 },
+		{ 1, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1 } });
+	twoThenOne.AddHeapRangesParameter({ { 2, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2 } });
+	RootSignatureGenerator oneThenTwo;
+	oneThenTwo.AddHeapRangesParameter({ { 0, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0 } });
+	oneThenTwo.AddHeapRangesParameter({ { 1, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1 },
+		{ 2, 1, 0, D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2 } });
+
+	const CacheKey keys[] =
+	{
+		ComputeKey(MakeHitSignature()),
+		ComputeKey(MakeHitSignature(), false),
+		ComputeKey(MakeHitSignature(2)),
+		ComputeKey(MakeHitSignature(1, 1)),
+		ComputeKey(MakeHitSignature(1, 2)),
+		ComputeKey(MakeMissSignature()),
+		ComputeKey(RootSignatureGenerator()),
+		ComputeKey(twoThenOne),
+		ComputeKey(oneThenTwo),
+	};
+	std::set<CacheKey> distinctKeys(std::begin(keys), std::end(keys));
+	CHECK(distinctKeys.size() == sizeof(keys) / sizeof(keys[0]));
+}
+
+TEST_CASE(BlobRoundTripsThroughTheDirectory)
+{
+	const std::vector<RootSignatureGenerator> generators = { MakeHitSignature(), MakeMissSignature() };
+	RemoveEntries(generators);
+	ComPtr<MockDevice> device;
+	device.Attach(new MockDevice());
+
+	std::vector<uint8_t> hitBlob;
+	{
+		RootSignatureCache cache(kDirectory);
+		ComPtr<ID3D12RootSignature> hit = cache.GetOrCreate(device.Get(), MakeHitSignature(), true);
+		cache.GetOrCreate(device.Get(), MakeMissSignature(), true);
+		hitBlob = static_cast<MockRootSignature*>(hit.Get())->blob;
+		CHECK(cache.GetStats().serializeCount == 2);
+		CHECK(cache.GetStats().storeFailureCount == 0);
+	}
+
+	// The next run creates the root signatures from the stored blobs, without serializing them
+	RootSignatureCache cache(kDirectory);
+	ComPtr<ID3D12RootSignature> hit = cache.GetOrCreate(device.Get(), MakeHitSignatureFromRanges(), true);
+	const MockRootSignature* loaded = static_cast<MockRootSignature*>(hit.Get());
+	CHECK(loaded->blob == hitBlob);
+	CHECK(loaded->privateData == hitBlob);
+	CHECK(cache.GetStats().diskHitCount == 1);
+	CHECK(cache.GetStats().serializeCount == 0);
+
+	// A blob rejected by the runtime is serialized again
+	RootSignatureCache otherCache(kDirectory);
+	device->rejectNext = true;
+	ComPtr<ID3D12RootSignature> miss = otherCache.GetOrCreate(device.Get(), MakeMissSignature(), true);
+	CHECK(miss.Get() != nullptr);
+	CHECK(otherCache.GetStats().diskHitCount == 0);
+	CHECK(otherCache.GetStats().serializeCount == 1);
+
+	RemoveEntries(generators);
+}
@@ -0,0 +1,202 @@
+// #DXR Custom: Instance Store
+// Tests of SceneInstanceStore: the handles across destroys, and the GPU data written for each
+// frame context, into arrays standing for the mapped upload buffers
+
+#include "TestFramework.h"
+
+#include "SceneInstanceStore.h"
+
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+	const uint32_t kUnwritten = 0xFFFFFF;
+
+	/// Upload buffers of a frame context, recording which instances the last write reached
+	struct FrameBuffers
+	{
+		explicit FrameBuffers(uint32_t capacity) : properties(capacity), descs(capacity) {}
+
+		/// Write the changes of the frame context, and return the dense indices written
+		std::vector<uint32_t> Write(SceneInstanceStore& store, uint32_t frameIndex)
+		{
+			for (D3D12_RAYTRACING_INSTANCE_DESC& desc : descs)
+			{
+				desc.InstanceID = kUnwritten;
+			}
+			uint32_t writtenCount = store.WriteChanges(frameIndex, meshVertexTransforms, properties.data(), descs.data());
+
+			std::vector<uint32_t> written;
+			for (uint32_t index = 0; index < descs.size(); index++)
+			{
+				if (descs[index].InstanceID != kUnwritten)
+					written.push_back(index);
+			}
+			CHECK(written.size() == writtenCount);
+			return written;
+		}
+
+		// Mesh 0 is drawn as is, mesh 1 scaled twice, as packed vertices would be
+		XMFLOAT4X4 meshVertexTransforms[2];
+		std::vector<XMFLOAT4X4> properties;
+		std::vector<D3D12_RAYTRACING_INSTANCE_DESC> descs;
+	};
+
+	FrameBuffers MakeFrameBuffers(uint32_t capacity)
+	{
+		FrameBuffers buffers(capacity);
+		XMStoreFloat4x4(&buffers.meshVertexTransforms[0], XMMatrixIdentity());
+		XMStoreFloat4x4(&buffers.meshVertexTransforms[1], XMMatrixScaling(2.0f, 2.0f, 2.0f));
+		return buffers;
+	}
+
+	/// Instance at (x, 0, 0), whose material index is x so that the descriptors tell them apart
+	InstanceHandle CreateAt(SceneInstanceStore& store, uint32_t x, uint32_t mesh = 0)
+	{
+		SceneInstanceDesc desc;
+		desc.bottomLevelAS = 0x1000 * (mesh + 1);
+		desc.hitGroupIndex = 2 * mesh;
+		desc.materialIndex = x;
+		desc.mesh = mesh;
+		return store.Create(XMMatrixTranslation(static_cast<float>(x), 0.0f, 0.0f), desc);
+	}
+}
+
+TEST_CASE(EachFrameWritesTheChangesOnce)
+{
+	SceneInstanceStore store(2);
+	for (uint32_t x = 0; x < 100; x++)
+	{
+		CreateAt(store, x, x % 2);
+	}
+	FrameBuffers frames[2] = { MakeFrameBuffers(100), MakeFrameBuffers(100) };
+	CHECK(frames[0].Write(store, 0).size() == 100);
+
+	// The vertex shader matrix is the mesh transform followed by the instance transform, the TLAS
+	// transform is the transposed 3x4 part of the instance transform
+	const XMFLOAT4X4& properties = frames[0].properties[7];
+	CHECK(properties.m[0][0] == 2.0f && properties.m[3][0] == 7.0f);
+	const D3D12_RAYTRACING_INSTANCE_DESC& desc = frames[0].descs[7];
+	CHECK(desc.Transform[0][0] == 1.0f && desc.Transform[0][3] == 7.0f);
+	CHECK(desc.InstanceID == 7);
+	CHECK(desc.InstanceMask == 0xFF);
+	CHECK(desc.InstanceContributionToHitGroupIndex == 2);
+	CHECK(desc.AccelerationStructure == 0x2000);
+	CHECK(frames[0].Write(store, 0).empty());
+
+	store.SetTransform(70, XMMatrixTranslation(1.0f, 2.0f, 3.0f));
+	store.SetMask(3, 0x01);
+	store.SetMask(5, 0xFF);
+	store.SetMaterialIndex(64, 64);
+	store.SetBottomLevelAS(9, 0x3000, 4);
+	store.SetMask(3, 0x02);
+	CHECK((frames[0].Write(store, 0) == std::vector<uint32_t>{ 3, 9, 70 }));
+	CHECK(frames[0].descs[3].InstanceMask == 0x02);
+	CHECK(frames[0].descs[9].AccelerationStructure == 0x3000);
+	CHECK(frames[0].descs[70].Transform[1][3] == 2.0f);
+
+	// The other frame context, which was in flight, gets all its instances then the same changes
+	CHECK(frames[1].Write(store, 1).size() == 100);
+	CHECK(frames[1].Write(store, 1).empty());
+	store.SetFlags(99, 1);
+	CHECK((frames[1].Write(store, 1) == std::vector<uint32_t>{ 99 }));
+	CHECK((frames[0].Write(store, 0) == std::vector<uint32_t>{ 99 }));
+	CHECK_THROWS(frames[0].Write(store, 2), std::out_of_range);
+}
+
+TEST_CASE(DestroyMovesTheLastInstanceIntoTheHole)
+{
+	SceneInstanceStore store(2);
+	std::vector<InstanceHandle> handles;
+	for (uint32_t x = 0; x < 5; x++)
+	{
+		handles.push_back(CreateAt(store, x));
+	}
+	FrameBuffers frame = MakeFrameBuffers(5);
+	frame.Write(store, 0);
+
+	store.Destroy(handles[1]);
+	CHECK(store.GetCount() == 4);
+	CHECK(!store.IsValid(handles[1]));
+	CHECK_THROWS(store.GetIndex(handles[1]), std::logic_error);
+	CHECK_THROWS(store.Destroy(handles[1]), std::logic_error);
+	CHECK(store.GetIndex(handles[4]) == 1);
+	CHECK(store.GetIndex(handles[3]) == 3);
+	CHECK(store.GetMaterialIndex(1) == 4);
+
+	// Only the moved instance is written again, at its new index
+	CHECK((frame.Write(store, 0) == std::vector<uint32_t>{ 1 }));
+	CHECK(frame.descs[1].InstanceID == 4);
+	CHECK(frame.descs[1].Transform[0][3] == 4.0f);
+
+	// A changed instance destroyed before the frame writes it is not written past the end
+	store.SetTransform(3, XMMatrixIdentity());
+	store.Destroy(handles[3]);
+	CHECK(frame.Write(store, 0).empty());
+
+	// Frame context 1 has not written anything yet: it gets the remaining instances once
+	CHECK((frame.Write(store, 1) == std::vector<uint32_t>{ 0, 1, 2 }));
+	CHECK_THROWS(store.SetTransform(3, XMMatrixIdentity()), std::logic_error);
+	CHECK_THROWS(store.SetMask(3, 0), std::logic_error);
+}
+
+TEST_CASE(ReusedSlotsRejectStaleHandles)
+{
+	SceneInstanceStore store;
+	InstanceHandle first = CreateAt(store, 1);
+	InstanceHandle second = CreateAt(store, 2);
+	store.Destroy(first);
+
+	InstanceHandle third = CreateAt(store, 3);
+	CHECK(third.slot == first.slot);
+	CHECK(third.generation != first.generation);
+	CHECK(!store.IsValid(first));
+	CHECK(store.IsValid(third));
+	CHECK(store.GetIndex(second) == 0);
+	CHECK(store.GetIndex(third) == 1);
+	CHECK(!store.IsValid(InstanceHandle()));
+
+	// The index freed by the destroy is written again for the new instance
+	FrameBuffers frame = MakeFrameBuffers(2);
+	CHECK((frame.Write(store, 0) == std::vector<uint32_t>{ 0, 1 }));
+	CHECK(frame.descs[1].InstanceID == 3);
+
+	store.Clear();
+	CHECK(store.GetCount() == 0);
+	CHECK(!store.IsValid(second));
+	CHECK(!store.IsValid(third));
+	CHECK(frame.Write(store, 0).empty());
+}
+
+TEST_CASE(MarkAllChangedRewritesEveryFrame)
+{
+	SceneInstanceStore store(3);
+	for (uint32_t x = 0; x < 130; x++)
+	{
+		CreateAt(store, x);
+	}
+	FrameBuffers frame = MakeFrameBuffers(130);
+	for (uint32_t frameIndex = 0; frameIndex < 3; frameIndex++)
+	{
+		frame.Write(store, frameIndex);
+	}
+
+	store.SetMask(10, 0x01);
+	store.MarkAllChanged();
+	for (uint32_t frameIndex = 0; frameIndex < 3; frameIndex++)
+	{
+		CHECK(frame.Write(store, frameIndex).size() == 130);
+		CHECK(frame.Write(store, frameIndex).empty());
+	}
+
+	// WriteInstanceDescs writes every descriptor for a full build, without consuming the changes
+	store.SetMask(20, 0x01);
+	for (D3D12_RAYTRACING_INSTANCE_DESC& desc : frame.descs)
+	{
+		desc.InstanceID = kUnwritten;
+	}
+	store.WriteInstanceDescs(frame.descs.data());
+	CHECK(frame.descs[129].InstanceID == 129);
+	CHECK((frame.Write(store, 0) == std::vector<uint32_t>{ 20 }));
+}
@@ -0,0 +1,206 @@
+// #DXR Custom: SBT Patching
+// Tests of the per-copy patching of ShaderBindingTableGenerator, with a pipeline whose shader
+// identifiers are known bytes and SBT copies held in memory
+
+#include "TestFramework.h"
+
+#include "nv_helpers_dx12/ShaderBindingTableGenerator.h"
+
+#include <wrl/client.h>
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+using Microsoft::WRL::ComPtr;
+using nv_helpers_dx12::ShaderBindingTableGenerator;
+
+namespace
+{
+	/// Pipeline giving each of its exports an identifier filled with a byte of its own
+	struct MockStateObjectProperties : ID3D12StateObjectProperties
+	{
+		MockStateObjectProperties()
+		{
+			const wchar_t* exports[] = { L"RayGen", L"Miss", L"ShadowMiss", L"HitGroup", L"ShadowHitGroup", L"PlaneHitGroup" };
+			uint8_t value = 1;
+			for (const wchar_t* name : exports)
+			{
+				identifiers[name].fill(value++);
+			}
+		}
+
+		void* GetShaderIdentifier(LPCWSTR exportName) override
+		{
+			auto found = identifiers.find(exportName);
+			return found == identifiers.end() ? nullptr : found->second.data();
+		}
+
+		std::map<std::wstring, std::array<uint8_t, D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT>> identifiers;
+	};
+
+	/// Upload buffer in memory, recording the range written by its last Unmap
+	struct MockBuffer : ID3D12Resource
+	{
+		explicit MockBuffer(size_t size) : bytes(size, 0xCD) {}
+
+		HRESULT Map(UINT, const D3D12_RANGE*, void** data) override
+		{
+			*data = bytes.data();
+			mapCount++;
+			return S_OK;
+		}
+
+		void Unmap(UINT, const D3D12_RANGE* writtenRange) override
+		{
+			written = writtenRange ? *writtenRange : D3D12_RANGE{ 0, bytes.size() };
+		}
+
+		std::vector<uint8_t> bytes;
+		D3D12_RANGE written = { 0, 0 };
+		int mapCount = 0;
+	};
+
+	void* Pointer(uintptr_t value)
+	{
+		return reinterpret_cast<void*>(value);
+	}
+
+	/// SBT of the sample: one ray generation, two miss programs and a hit group per instance and ray
+	/// type, whose records hold the vertex and index buffers of the instance
+	void MakeTable(ShaderBindingTableGenerator& sbt, UINT instanceCount)
+	{
+		sbt.AddRayGenerationProgram(L"RayGen", { Pointer(0x100) });
+		sbt.AddMissProgram(L"Miss", {});
+		sbt.AddMissProgram(L"ShadowMiss", {});
+		for (UINT i = 0; i < instanceCount; i++)
+		{
+			sbt.AddHitGroup(L"HitGroup", { Pointer(0x1000 + i), Pointer(0x2000 + i), Pointer(0x3000) });
+			sbt.AddHitGroup(L"ShadowHitGroup", {});
+		}
+	}
+
+	/// Bytes of a hit group record in a copy of the SBT
+	std::vector<uint8_t> GetRecord(const ShaderBindingTableGenerator& sbt, const MockBuffer* buffer, UINT recordIndex)
+	{
+		size_t offset = sbt.GetRayGenSectionSize() + sbt.GetMissSectionSize() + recordIndex * sbt.GetHitGroupEntrySize();
+		return std::vector<uint8_t>(buffer->bytes.begin() + offset, buffer->bytes.begin() + offset + sbt.GetHitGroupEntrySize());
+	}
+
+	/// Indices of the hit group records which differ between two copies of the SBT
+	std::vector<UINT> GetChangedRecords(const ShaderBindingTableGenerator& sbt, const MockBuffer* a, const MockBuffer* b,
+		UINT recordCount)
+	{
+		std::vector<UINT> changed;
+		for (UINT recordIndex = 0; recordIndex < recordCount; recordIndex++)
+		{
+			if (GetRecord(sbt, a, recordIndex) != GetRecord(sbt, b, recordIndex))
+				changed.push_back(recordIndex);
+		}
+		return changed;
+	}
+}
+
+TEST_CASE(PatchWritesTheDirtyRecordsOfEachCopy)
+{
+	ComPtr<MockStateObjectProperties> props;
+	props.Attach(new MockStateObjectProperties());
+	ShaderBindingTableGenerator sbt;
+	MakeTable(sbt, 8);
+	sbt.SetBufferCount(2);
+	const uint32_t sbtSize = sbt.ComputeSBTSize();
+	ComPtr<MockBuffer> copies[2];
+	for (UINT n = 0; n < 2; n++)
+	{
+		copies[n].Attach(new MockBuffer(sbtSize));
+		sbt.Generate(copies[n].Get(), props.Get(), n);
+		CHECK(sbt.Patch(copies[n].Get(), props.Get(), n) == 0);
+	}
+	CHECK(copies[0]->bytes == copies[1]->bytes);
+
+	// An instance changing its mesh, and another its material, twice
+	sbt.SetHitGroupData(4, { Pointer(0x1100), Pointer(0x2100), Pointer(0x3000) });
+	sbt.SetHitGroupProgram(11, L"PlaneHitGroup");
+	sbt.SetHitGroupProgram(11, L"HitGroup");
+	sbt.SetHitGroupProgram(11, L"PlaneHitGroup");
+	// Setting the same data does not dirty the record
+	sbt.SetHitGroupData(6, { Pointer(0x1003), Pointer(0x2003), Pointer(0x3000) });
+
+	const std::vector<uint8_t> before = copies[0]->bytes;
+	CHECK(sbt.Patch(copies[0].Get(), props.Get(), 0) == 2);
+	CHECK((GetChangedRecords(sbt, copies[0].Get(), copies[1].Get(), 16) == std::vector<UINT>{ 4, 11 }));
+	const UINT hitGroupOffset = sbt.GetRayGenSectionSize() + sbt.GetMissSectionSize();
+	CHECK(copies[0]->written.Begin == hitGroupOffset + 4 * sbt.GetHitGroupEntrySize());
+	CHECK(copies[0]->written.End == hitGroupOffset + 12 * sbt.GetHitGroupEntrySize());
+	CHECK(sbt.Patch(copies[0].Get(), props.Get(), 0) == 0);
+
+	// Copy 1, still in flight while copy 0 was patched, is still pending and gets the same records
+	const std::vector<uint8_t> stale = copies[1]->bytes;
+	CHECK(sbt.Patch(copies[1].Get(), props.Get(), 1) == 2);
+	CHECK(copies[1]->bytes == copies[0]->bytes);
+	CHECK((GetChangedRecords(sbt, copies[1].Get(), copies[0].Get(), 16).empty()));
+	CHECK(copies[1]->bytes != stale);
+	CHECK(sbt.Patch(copies[1].Get(), props.Get(), 1) == 0);
+
+	// Patching gives the same table as generating it again
+	ComPtr<MockBuffer> generated;
+	generated.Attach(new MockBuffer(sbtSize));
+	sbt.Generate(generated.Get(), props.Get(), 0);
+	CHECK(generated->bytes == copies[0]->bytes);
+	CHECK(before != copies[0]->bytes);
+}
+
+TEST_CASE(PatchClearsTheEndOfShorterRecords)
+{
+	ComPtr<MockStateObjectProperties> props;
+	props.Attach(new MockStateObjectProperties());
+	ShaderBindingTableGenerator sbt;
+	MakeTable(sbt, 2);
+	ComPtr<MockBuffer> buffer;
+	buffer.Attach(new MockBuffer(sbt.ComputeSBTSize()));
+	sbt.Generate(buffer.Get(), props.Get());
+
+	// The record of a shadow hit group holds no data, the end of its entry is cleared
+	std::vector<uint8_t> shadowRecord = GetRecord(sbt, buffer.Get(), 1);
+	CHECK(shadowRecord[0] == 5);
+	CHECK(std::count(shadowRecord.begin() + D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT, shadowRecord.end(), 0) ==
+		static_cast<long>(shadowRecord.size() - D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT));
+
+	// A record given shorter data does not keep the end of the previous one
+	sbt.SetHitGroupData(2, { Pointer(0x1234) });
+	CHECK(sbt.Patch(buffer.Get(), props.Get()) == 1);
+	std::vector<uint8_t> record = GetRecord(sbt, buffer.Get(), 2);
+	uint64_t firstPointer = 0;
+	memcpy(&firstPointer, record.data() + D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT, sizeof(firstPointer));
+	CHECK(firstPointer == 0x1234);
+	CHECK(std::count(record.begin() + D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT + 8, record.end(), 0) ==
+		static_cast<long>(record.size() - D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT - 8));
+}
+
+TEST_CASE(PatchRejectsInvalidUpdates)
+{
+	ComPtr<MockStateObjectProperties> props;
+	props.Attach(new MockStateObjectProperties());
+	ShaderBindingTableGenerator sbt;
+	MakeTable(sbt, 1);
+	sbt.SetBufferCount(2);
+	ComPtr<MockBuffer> buffer;
+	buffer.Attach(new MockBuffer(sbt.ComputeSBTSize()));
+
+	CHECK_THROWS(sbt.Generate(buffer.Get(), props.Get(), 2), std::logic_error);
+	CHECK_THROWS(sbt.Patch(buffer.Get(), props.Get(), 2), std::logic_error);
+	CHECK_THROWS(sbt.SetBufferCount(0), std::logic_error);
+	CHECK_THROWS(sbt.SetHitGroupProgram(2, L"HitGroup"), std::logic_error);
+
+	// Data which does not fit the entries computed by ComputeSBTSize needs a new SBT
+	CHECK_THROWS(sbt.SetHitGroupData(1, { Pointer(1), Pointer(2), Pointer(3), Pointer(4), Pointer(5) }),
+		std::logic_error);
+
+	// An export missing from the pipeline is reported when the record is written
+	sbt.Generate(buffer.Get(), props.Get(), 1);
+	sbt.SetHitGroupProgram(1, L"UnknownHitGroup");
+	CHECK_THROWS(sbt.Patch(buffer.Get(), props.Get(), 1), std::logic_error);
+	CHECK(buffer->mapCount == 2);
+}
@@ -0,0 +1,288 @@
+// #DXR Custom: Shader Cache
+// Tests of ShaderCache with a stub compiler, on sources and entries written to the working
+// directory: the hits and misses across launches, and what the keys depend on
+
+#include "TestFramework.h"
+
+#include "ShaderCache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+	/// Compiles a file into its own bytes, and records the files it compiled
+	class StubShaderCompiler : public ShaderCompiler
+	{
+	public:
+		std::string GetVersion() const override { return version; }
+
+		bool Compile(const ShaderCompileRequest& request, std::vector<uint8_t>& bytecode, std::string& /*errors*/) override
+		{
+			std::ifstream file(request.fileName, std::ios::binary);
+			bytecode.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+			compiledFiles.push_back(request.fileName);
+			return true;
+		}
+
+		std::string version;
+		std::vector<std::string> compiledFiles;
+	};
+
+	/// Sources and cache entries of a test case, removed with it. The compiler version is unique
+	/// to each test case, so that the entries left by an interrupted run are never found
+	class ShaderCacheFixture
+	{
+	public:
+		ShaderCacheFixture()
+		{
+			compiler.version = "stub " + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+		}
+
+		~ShaderCacheFixture()
+		{
+			for (const std::string& fileName : m_fileNames)
+			{
+				std::remove(fileName.c_str());
+			}
+			// Removes the empty directory on POSIX systems only
+			std::remove(kDirectory);
+		}
+
+		/// Write a source file, returning its name
+		std::string WriteSource(const std::string& name, const std::string& content)
+		{
+			std::string fileName = "shader_cache_test_" + name;
+			std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+			file << content;
+			m_fileNames.insert(fileName);
+			return fileName;
+		}
+
+		ShaderCompileRequest MakeRequest(const std::string& fileName) const
+		{
+			ShaderCompileRequest request;
+			request.fileName = fileName;
+			request.targetProfile = "lib_6_3";
+			request.arguments = { "-O3" };
+			return request;
+		}
+
+		/// Get a shader from a new cache, as at a launch of the sample, and return whether it was
+		/// a hit. The binary must hold the current source either way
+		bool Load(const ShaderCompileRequest& request)
+		{
+			ShaderCache cache(compiler, kDirectory);
+			bool cacheHit = false;
+			std::shared_ptr<const ShaderBinary> binary = cache.Get(request, &cacheHit);
+			m_fileNames.insert(cache.GetEntryFileName(cache.ComputeKey(request)));
+
+			std::ifstream file(request.fileName, std::ios::binary);
+			std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+			REQUIRE(binary != nullptr);
+			CHECK(binary->IsMapped() == cacheHit);
+			CHECK(std::string(static_cast<const char*>(binary->GetData()), binary->GetSize()) == source);
+			return cacheHit;
+		}
+
+		std::string GetEntryFileName(const ShaderCompileRequest& request) const
+		{
+			ShaderCache cache(const_cast<StubShaderCompiler&>(compiler), kDirectory);
+			return cache.GetEntryFileName(cache.ComputeKey(request));
+		}
+
+		ShaderCacheKey ComputeKey(const ShaderCompileRequest& request) const
+		{
+			ShaderCache cache(const_cast<StubShaderCompiler&>(compiler), "");
+			return cache.ComputeKey(request);
+		}
+
+		StubShaderCompiler compiler;
+
+	private:
+		static const char* const kDirectory;
+		std::set<std::string> m_fileNames;
+	};
+
+	const char* const ShaderCacheFixture::kDirectory = "shader_cache_tests";
+
+	std::string ReadBytes(const std::string& fileName)
+	{
+		std::ifstream file(fileName, std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	void WriteBytes(const std::string& fileName, const std::string& bytes)
+	{
+		std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+		file << bytes;
+	}
+}
+
+TEST_CASE(ColdRunMissesAndWarmRunHits)
+{
+	ShaderCacheFixture fixture;
+	std::string header = fixture.WriteSource("common.hlsli", "float Shared();\n");
+	std::vector<ShaderCompileRequest> requests;
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		std::string name = "library" + std::to_string(i) + ".hlsl";
+		requests.push_back(fixture.MakeRequest(fixture.WriteSource(name,
+			"#include \"shader_cache_test_common.hlsli\"\nfloat Library" + std::to_string(i) + "();\n")));
+	}
+
+	for (const ShaderCompileRequest& request : requests)
+	{
+		CHECK(!fixture.Load(request));
+	}
+	CHECK(fixture.compiler.compiledFiles.size() == requests.size());
+
+	for (const ShaderCompileRequest& request : requests)
+	{
+		CHECK(fixture.Load(request));
+	}
+	CHECK(fixture.compiler.compiledFiles.size() == requests.size());
+}
+
+TEST_CASE(EditingAHeaderRecompilesOnlyItsIncluders)
+{
+	ShaderCacheFixture fixture;
+	// library0 and library1 include common, which includes nested. library2 includes other only
+	fixture.WriteSource("nested.hlsli", "float Nested();\n");
+	fixture.WriteSource("common.hlsli", "#include \"shader_cache_test_nested.hlsli\"\nfloat Common();\n");
+	fixture.WriteSource("other.hlsli", "float Other();\n");
+	std::vector<ShaderCompileRequest> requests =
+	{
+		fixture.MakeRequest(fixture.WriteSource("library0.hlsl", "#include \"shader_cache_test_common.hlsli\"\n")),
+		fixture.MakeRequest(fixture.WriteSource("library1.hlsl", "  #  include <shader_cache_test_common.hlsli>\n")),
+		fixture.MakeRequest(fixture.WriteSource("library2.hlsl", "#include \"shader_cache_test_other.hlsli\"\n")),
+	};
+	for (const ShaderCompileRequest& request : requests)
+	{
+		fixture.Load(request);
+	}
+
+	fixture.WriteSource("other.hlsli", "float Other(float x);\n");
+	CHECK(fixture.Load(requests[0]));
+	CHECK(fixture.Load(requests[1]));
+	CHECK(!fixture.Load(requests[2]));
+
+	fixture.WriteSource("nested.hlsli", "float Nested(float x);\n");
+	CHECK(!fixture.Load(requests[0]));
+	CHECK(!fixture.Load(requests[1]));
+	CHECK(fixture.Load(requests[2]));
+
+	// Reverting an edit finds the entries of the previous content again
+	fixture.WriteSource("other.hlsli", "float Other();\n");
+	CHECK(fixture.Load(requests[2]));
+	CHECK(fixture.compiler.compiledFiles.size() == 6);
+}
+
+TEST_CASE(KeysCoverTheCompilationSettings)
+{
+	ShaderCacheFixture fixture;
+	ShaderCompileRequest request = fixture.MakeRequest(fixture.WriteSource("library.hlsl", "float Library();\n"));
+	ShaderCacheKey key = fixture.ComputeKey(request);
+	CHECK(fixture.ComputeKey(request) == key);
+
+	ShaderCompileRequest changed = request;
+	changed.targetProfile = "lib_6_5";
+	CHECK(fixture.ComputeKey(changed) != key);
+
+	changed = request;
+	changed.defines = { "USE_SHADOWS" };
+	ShaderCacheKey definedKey = fixture.ComputeKey(changed);
+	CHECK(definedKey != key);
+	changed.defines = { "USE_SHADOWS=0" };
+	CHECK(fixture.ComputeKey(changed) != definedKey);
+
+	changed = request;
+	changed.entryPoint = "RayGen";
+	CHECK(fixture.ComputeKey(changed) != key);
+
+	changed = request;
+	changed.arguments = { "-Od" };
+	CHECK(fixture.ComputeKey(changed) != key);
+
+	// The values of the lists are prefixed with their sizes, so moving one from a list to the
+	// next changes the key
+	changed = request;
+	changed.arguments.clear();
+	changed.includeDirectories = { "-O3" };
+	CHECK(fixture.ComputeKey(changed) != key);
+
+	std::string version = fixture.compiler.version;
+	fixture.compiler.version = version + " updated";
+	CHECK(fixture.ComputeKey(request) != key);
+	fixture.compiler.version = version;
+	CHECK(fixture.ComputeKey(request) == key);
+
+	CHECK_THROWS(fixture.ComputeKey(fixture.MakeRequest("shader_cache_test_missing.hlsl")), std::runtime_error);
+}
+
+TEST_CASE(CorruptedAndTruncatedEntriesAreRecompiled)
+{
+	ShaderCacheFixture fixture;
+	ShaderCompileRequest request = fixture.MakeRequest(fixture.WriteSource("library.hlsl",
+		"float Library();\nfloat Other();\n"));
+	CHECK(!fixture.Load(request));
+	std::string entryFileName = fixture.GetEntryFileName(request);
+	std::string entry = ReadBytes(entryFileName);
+	REQUIRE(entry.size() > CacheDirectory::kDataOffset);
+
+	std::string corrupted = entry;
+	corrupted[CacheDirectory::kDataOffset + 3] ^= 0x20;
+	WriteBytes(entryFileName, corrupted);
+	CHECK(!fixture.Load(request));
+	CHECK(ReadBytes(entryFileName) == entry);
+	CHECK(fixture.Load(request));
+
+	WriteBytes(entryFileName, entry.substr(0, entry.size() - 4));
+	CHECK(!fixture.Load(request));
+	CHECK(fixture.Load(request));
+
+	WriteBytes(entryFileName, entry.substr(0, sizeof(CacheEntryHeader) / 2));
+	CHECK(!fixture.Load(request));
+	CHECK(fixture.Load(request));
+
+	WriteBytes(entryFileName, std::string());
+	CHECK(!fixture.Load(request));
+	CHECK(fixture.Load(request));
+	CHECK(fixture.compiler.compiledFiles.size() == 5);
+
+	// The invalid entries are counted apart from the missing ones
+	WriteBytes(entryFileName, corrupted);
+	ShaderCache cache(fixture.compiler, "shader_cache_tests");
+	cache.Get(request);
+	CHECK(cache.GetStats().missCount == 1);
+	CHECK(cache.GetStats().invalidEntryCount == 1);
+}
+
+TEST_CASE(IncludeCyclesTerminate)
+{
+	ShaderCacheFixture fixture;
+	fixture.WriteSource("self.hlsli", "#include \"shader_cache_test_self.hlsli\"\n");
+	fixture.WriteSource("a.hlsli", "#include \"shader_cache_test_b.hlsli\"\n#include \"shader_cache_test_self.hlsli\"\n");
+	fixture.WriteSource("b.hlsli", "#include \"shader_cache_test_a.hlsli\"\n");
+	ShaderCompileRequest request = fixture.MakeRequest(fixture.WriteSource("library.hlsl",
+		"#include \"shader_cache_test_a.hlsli\"\n"));
+	CHECK(!fixture.Load(request));
+	CHECK(fixture.Load(request));
+
+	// Every member of the cycle is part of the key
+	fixture.WriteSource("b.hlsli", "#include \"shader_cache_test_a.hlsli\"\nfloat B();\n");
+	CHECK(!fixture.Load(request));
+
+	// A cycle through ever longer relative paths never reaches the same name twice, and stops at
+	// the bound on the size of the closure
+	fixture.WriteSource("relative.hlsli", "#include \"./shader_cache_test_relative.hlsli\"\n");
+	ShaderCompileRequest relative = fixture.MakeRequest(fixture.WriteSource("relative.hlsl",
+		"#include \"shader_cache_test_relative.hlsli\"\n"));
+	CHECK_THROWS(fixture.ComputeKey(relative), std::runtime_error);
+}
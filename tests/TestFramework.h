@@ -0,0 +1,71 @@
+#pragma once
+
+// #DXR Custom: Host Build
+// Minimal test harness of the host build. A test executable is made of TestMain.cpp and of files
+// declaring test cases:
+//
+//   TEST_CASE(BuddyBlocksMergeBack)
+//   {
+//     CHECK(allocator.GetFreeBytes() == size);
+//     CHECK_THROWS(allocator.Free(12), std::logic_error);
+//   }
+//
+// A failed CHECK is reported and the test case goes on, REQUIRE stops the test case. Exceptions
+// escaping a test case fail it. The executable runs all its test cases, or the ones whose name
+// contains its first argument, and returns a non-zero code if any of them failed.
+
+#include <cstdio>
+
+namespace TestFramework
+{
+	typedef void (*TestFunction)();
+
+	/// Add a test case to the executable, returns true so that it can initialize a static
+	bool Register(const char* name, TestFunction function);
+
+	/// Record a failure of the running test case
+	void Fail(const char* file, int line, const char* expression);
+
+	/// Thrown by REQUIRE to stop the running test case
+	struct Abort
+	{
+	};
+}
+
+#define TEST_CASE(name) \
+	static void name(); \
+	static const bool name##Registered = TestFramework::Register(#name, name); \
+	static void name()
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+			TestFramework::Fail(__FILE__, __LINE__, #condition); \
+	} while (0)
+
+#define REQUIRE(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			TestFramework::Fail(__FILE__, __LINE__, #condition); \
+			throw TestFramework::Abort(); \
+		} \
+	} while (0)
+
+#define CHECK_THROWS(expression, exceptionType) \
+	do \
+	{ \
+		bool thrown = false; \
+		try \
+		{ \
+			expression; \
+		} \
+		catch (const exceptionType&) \
+		{ \
+			thrown = true; \
+		} \
+		if (!thrown) \
+			TestFramework::Fail(__FILE__, __LINE__, #expression " throws " #exceptionType); \
+	} while (0)
@@ -0,0 +1,69 @@
+#include "TestFramework.h"
+
+#include <cstring>
+#include <exception>
+#include <vector>
+
+namespace
+{
+	struct TestCase
+	{
+		const char* name;
+		TestFramework::TestFunction function;
+	};
+
+	std::vector<TestCase>& GetTestCases()
+	{
+		static std::vector<TestCase> testCases;
+		return testCases;
+	}
+
+	int g_failureCount = 0;
+}
+
+namespace TestFramework
+{
+	bool Register(const char* name, TestFunction function)
+	{
+		GetTestCases().push_back(TestCase{ name, function });
+		return true;
+	}
+
+	void Fail(const char* file, int line, const char* expression)
+	{
+		std::printf("  %s(%d): CHECK failed: %s\n", file, line, expression);
+		g_failureCount++;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* filter = argc > 1 ? argv[1] : nullptr;
+	int failedCount = 0;
+	int runCount = 0;
+	for (const TestCase& testCase : GetTestCases())
+	{
+		if (filter && !std::strstr(testCase.name, filter))
+			continue;
+
+		int failuresBefore = g_failureCount;
+		try
+		{
+			testCase.function();
+		}
+		catch (const TestFramework::Abort&)
+		{
+		}
+		catch (const std::exception& exception)
+		{
+			std::printf("  unexpected exception: %s\n", exception.what());
+			g_failureCount++;
+		}
+		bool passed = g_failureCount == failuresBefore;
+		std::printf("[%s] %s\n", passed ? "  OK  " : " FAIL ", testCase.name);
+		failedCount += passed ? 0 : 1;
+		runCount++;
+	}
+	std::printf("%d test cases, %d failed\n", runCount, failedCount);
+	return (failedCount == 0 && runCount > 0) ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+// #DXR Custom: Host Build
+// Meshes shared by the test cases of the mesh processing modules
+
+#include "VertexTypes.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace TestMeshes
+{
+	/// Grid of size x size quads in the XY plane, with its triangles in a random order that is the
+	/// same at every call
+	inline void MakeShuffledGrid(uint32_t size, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		vertices.resize((size + 1) * (size + 1));
+		for (uint32_t y = 0; y <= size; y++)
+		{
+			for (uint32_t x = 0; x <= size; x++)
+			{
+				vertices[y * (size + 1) + x].position = DirectX::XMFLOAT3(static_cast<float>(x), static_cast<float>(y), 0.0f);
+				vertices[y * (size + 1) + x].color = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+			}
+		}
+
+		std::vector<std::array<uint32_t, 3>> triangles;
+		for (uint32_t y = 0; y < size; y++)
+		{
+			for (uint32_t x = 0; x < size; x++)
+			{
+				uint32_t i = y * (size + 1) + x;
+				triangles.push_back({ { i, i + size + 1, i + 1 } });
+				triangles.push_back({ { i + 1, i + size + 1, i + size + 2 } });
+			}
+		}
+		std::mt19937 random(7);
+		std::shuffle(triangles.begin(), triangles.end(), random);
+		indices.clear();
+		for (const std::array<uint32_t, 3>& triangle : triangles)
+		{
+			indices.insert(indices.end(), triangle.begin(), triangle.end());
+		}
+	}
+}
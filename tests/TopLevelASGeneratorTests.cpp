@@ -0,0 +1,201 @@
+// #DXR Custom: Instance Updates
+// Tests of the builds and refits enqueued by TopLevelASGenerator, with a command list recording
+// them and descriptor buffers in system memory
+
+#include "TestFramework.h"
+
+#include "nv_helpers_dx12/TopLevelASGenerator.h"
+
+#include <wrl/client.h>
+
+#include <stdexcept>
+#include <vector>
+
+using namespace DirectX;
+using Microsoft::WRL::ComPtr;
+using nv_helpers_dx12::TopLevelASGenerator;
+
+namespace
+{
+	/// Buffer in system memory at a fixed GPU address, counting its mappings
+	struct MockBuffer : ID3D12Resource
+	{
+		MockBuffer(size_t size, D3D12_GPU_VIRTUAL_ADDRESS address) : bytes(size, 0xCD), gpuAddress(address) {}
+
+		HRESULT Map(UINT, const D3D12_RANGE*, void** data) override
+		{
+			*data = bytes.data();
+			mapCount++;
+			return S_OK;
+		}
+		D3D12_GPU_VIRTUAL_ADDRESS GetGPUVirtualAddress() override { return gpuAddress; }
+
+		const D3D12_RAYTRACING_INSTANCE_DESC* GetInstanceDescs() const
+		{
+			return reinterpret_cast<const D3D12_RAYTRACING_INSTANCE_DESC*>(bytes.data());
+		}
+
+		std::vector<uint8_t> bytes;
+		D3D12_GPU_VIRTUAL_ADDRESS gpuAddress;
+		int mapCount = 0;
+	};
+
+	/// Sizes growing with the instance count, not aligned so that the rounding shows
+	struct MockDevice : ID3D12Device5
+	{
+		void GetRaytracingAccelerationStructurePrebuildInfo(const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS* inputs,
+			D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO* info) override
+		{
+			info->ResultDataMaxSizeInBytes = 1000 + 100 * inputs->NumDescs;
+			info->ScratchDataSizeInBytes = 500 + 10 * inputs->NumDescs;
+			info->UpdateScratchDataSizeInBytes = 0;
+			lastFlags = inputs->Flags;
+		}
+
+		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS lastFlags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
+	};
+
+	/// Records the builds and the barriers
+	struct MockCommandList : ID3D12GraphicsCommandList4
+	{
+		void BuildRaytracingAccelerationStructure(const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC* desc, UINT,
+			const D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC*) override
+		{
+			builds.push_back(*desc);
+		}
+
+		void ResourceBarrier(UINT count, const D3D12_RESOURCE_BARRIER* barriers) override
+		{
+			this->barriers.insert(this->barriers.end(), barriers, barriers + count);
+		}
+
+		std::vector<D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC> builds;
+		std::vector<D3D12_RESOURCE_BARRIER> barriers;
+	};
+
+	/// Buffers of a top-level AS, at distinct GPU addresses
+	struct Buffers
+	{
+		explicit Buffers(UINT64 descriptorsSize)
+		{
+			scratch.Attach(new MockBuffer(0, 0x10000));
+			result.Attach(new MockBuffer(0, 0x20000));
+			descriptors.Attach(new MockBuffer(static_cast<size_t>(descriptorsSize), 0x30000));
+		}
+
+		ComPtr<MockBuffer> scratch;
+		ComPtr<MockBuffer> result;
+		ComPtr<MockBuffer> descriptors;
+	};
+}
+
+TEST_CASE(ComputeASBufferSizesRoundsTheSizes)
+{
+	ComPtr<MockDevice> device;
+	device.Attach(new MockDevice());
+	TopLevelASGenerator generator;
+
+	UINT64 scratchSize = 0, resultSize = 0, descriptorsSize = 0;
+	generator.ComputeASBufferSizes(device.Get(), true, 3, &scratchSize, &resultSize, &descriptorsSize);
+	CHECK(resultSize == 1536);
+	CHECK(scratchSize == 768);
+	CHECK(descriptorsSize == 256);
+	CHECK(device->lastFlags == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE);
+
+	generator.ComputeASBufferSizes(device.Get(), false, 5, &scratchSize, &resultSize, &descriptorsSize);
+	CHECK(descriptorsSize == 512);
+	CHECK(device->lastFlags == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE);
+}
+
+TEST_CASE(GenerateWritesTheDescriptorsOfTheInstances)
+{
+	ComPtr<MockDevice> device;
+	device.Attach(new MockDevice());
+	ComPtr<MockCommandList> commandList;
+	commandList.Attach(new MockCommandList());
+	ComPtr<MockBuffer> blas;
+	blas.Attach(new MockBuffer(0, 0x40000));
+
+	TopLevelASGenerator generator;
+	generator.AddInstance(blas.Get(), XMMatrixIdentity(), 0, 0);
+	// The transform is copied, the matrix given to AddInstance being a temporary
+	generator.AddInstance(blas.Get(), XMMatrixTranslation(1.0f, 2.0f, 3.0f), 7, 2);
+	UINT64 scratchSize, resultSize, descriptorsSize;
+	generator.ComputeASBufferSizes(device.Get(), true, &scratchSize, &resultSize, &descriptorsSize);
+	Buffers buffers(descriptorsSize);
+	generator.Generate(commandList.Get(), buffers.scratch.Get(), buffers.result.Get(), buffers.descriptors.Get());
+
+	const D3D12_RAYTRACING_INSTANCE_DESC& desc = buffers.descriptors->GetInstanceDescs()[1];
+	CHECK(desc.InstanceID == 7);
+	CHECK(desc.InstanceContributionToHitGroupIndex == 2);
+	CHECK(desc.InstanceMask == 0xFF);
+	CHECK(desc.AccelerationStructure == 0x40000);
+	CHECK(desc.Transform[0][0] == 1.0f && desc.Transform[0][3] == 1.0f);
+	CHECK(desc.Transform[1][3] == 2.0f && desc.Transform[2][3] == 3.0f);
+	// The end of the buffer is cleared on a full build
+	CHECK(buffers.descriptors->bytes.back() == 0);
+
+	REQUIRE(commandList->builds.size() == 1);
+	const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC& build = commandList->builds[0];
+	CHECK(build.Inputs.Type == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL);
+	CHECK(build.Inputs.Flags == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE);
+	CHECK(build.Inputs.NumDescs == 2);
+	CHECK(build.Inputs.InstanceDescs == 0x30000);
+	CHECK(build.DestAccelerationStructureData == 0x20000);
+	CHECK(build.ScratchAccelerationStructureData == 0x10000);
+	CHECK(build.SourceAccelerationStructureData == 0);
+	REQUIRE(commandList->barriers.size() == 1);
+	CHECK(commandList->barriers[0].Type == D3D12_RESOURCE_BARRIER_TYPE_UAV);
+	CHECK(commandList->barriers[0].UAV.pResource == buffers.result.Get());
+}
+
+TEST_CASE(UpdateRefitsThePreviousStructureInPlace)
+{
+	ComPtr<MockDevice> device;
+	device.Attach(new MockDevice());
+	ComPtr<MockCommandList> commandList;
+	commandList.Attach(new MockCommandList());
+	TopLevelASGenerator generator;
+	UINT64 scratchSize, resultSize, descriptorsSize;
+	generator.ComputeASBufferSizes(device.Get(), true, 100, &scratchSize, &resultSize, &descriptorsSize);
+	Buffers buffers(descriptorsSize);
+
+	// The descriptors written by the application are left untouched
+	generator.GenerateFromDescriptors(commandList.Get(), buffers.scratch.Get(), buffers.result.Get(),
+		buffers.descriptors.Get(), 100);
+	generator.GenerateFromDescriptors(commandList.Get(), buffers.scratch.Get(), buffers.result.Get(),
+		buffers.descriptors.Get(), 100, true, buffers.result.Get());
+	CHECK(buffers.descriptors->mapCount == 0);
+
+	REQUIRE(commandList->builds.size() == 2);
+	CHECK(commandList->builds[0].Inputs.Flags == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE);
+	CHECK(commandList->builds[0].SourceAccelerationStructureData == 0);
+	CHECK(commandList->builds[1].Inputs.Flags == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE);
+	CHECK(commandList->builds[1].Inputs.NumDescs == 100);
+	CHECK(commandList->builds[1].SourceAccelerationStructureData == 0x20000);
+	CHECK(commandList->builds[1].DestAccelerationStructureData == 0x20000);
+	CHECK(commandList->barriers.size() == 2);
+}
+
+TEST_CASE(UpdateRequiresAnUpdatableStructure)
+{
+	ComPtr<MockDevice> device;
+	device.Attach(new MockDevice());
+	ComPtr<MockCommandList> commandList;
+	commandList.Attach(new MockCommandList());
+	TopLevelASGenerator generator;
+	UINT64 scratchSize, resultSize, descriptorsSize;
+	generator.ComputeASBufferSizes(device.Get(), false, 4, &scratchSize, &resultSize, &descriptorsSize);
+	Buffers buffers(descriptorsSize);
+
+	CHECK_THROWS(generator.GenerateFromDescriptors(commandList.Get(), buffers.scratch.Get(), buffers.result.Get(),
+		buffers.descriptors.Get(), 4, true, buffers.result.Get()), std::logic_error);
+	CHECK_THROWS(generator.Generate(commandList.Get(), buffers.scratch.Get(), buffers.result.Get(),
+		buffers.descriptors.Get(), true, buffers.result.Get()), std::logic_error);
+
+	generator.ComputeASBufferSizes(device.Get(), true, 4, &scratchSize, &resultSize, &descriptorsSize);
+	CHECK_THROWS(generator.GenerateFromDescriptors(commandList.Get(), buffers.scratch.Get(), buffers.result.Get(),
+		buffers.descriptors.Get(), 4, true, nullptr), std::logic_error);
+	CHECK(commandList->builds.empty());
+	CHECK(buffers.descriptors->mapCount == 0);
+}
@@ -0,0 +1,171 @@
+// #DXR Custom: Packed Vertices
+// Round trips of VertexPacking, with the position error bounded by the bounding box of the mesh
+
+#include "TestFramework.h"
+
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+	const XMFLOAT3 kBoundsMin = { -3.0f, 1.0f, -0.25f };
+	const XMFLOAT3 kBoundsMax = { 5.0f, 2.0f, 0.25f };
+
+	/// Vertices spread in the bounding box, including its corners. The count is not a multiple of
+	/// 4, so that the scalar tail of the SIMD kernels runs too
+	std::vector<Vertex> MakeVertices(uint32_t count)
+	{
+		std::mt19937 random(3);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::vector<Vertex> vertices(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			float t[3] = { unit(random), unit(random), unit(random) };
+			if (i < 8)
+			{
+				t[0] = static_cast<float>(i & 1);
+				t[1] = static_cast<float>((i >> 1) & 1);
+				t[2] = static_cast<float>((i >> 2) & 1);
+			}
+			vertices[i].position = XMFLOAT3(kBoundsMin.x + t[0] * (kBoundsMax.x - kBoundsMin.x),
+				kBoundsMin.y + t[1] * (kBoundsMax.y - kBoundsMin.y), kBoundsMin.z + t[2] * (kBoundsMax.z - kBoundsMin.z));
+			vertices[i].color = XMFLOAT4(unit(random), unit(random), unit(random), unit(random));
+		}
+		return vertices;
+	}
+
+	/// Largest error of a decoded coordinate on an axis of the given extent: half a quantization
+	/// step for snorm16, half an ulp of the largest half below 1 for fp16, and a little slack for
+	/// the float arithmetic of the decoding
+	float GetAxisErrorBound(VertexPositionFormat format, float extent)
+	{
+		float step = format == VertexPositionFormat::Snorm16 ? 1.0f / 32767.0f : std::ldexp(1.0f, -11);
+		return 0.5f * extent * (0.5f * step) * 1.01f + 1e-6f;
+	}
+
+	void CheckRoundTrip(VertexPositionFormat format)
+	{
+		std::vector<Vertex> vertices = MakeVertices(1001);
+		VertexQuantization quantization = VertexPacking::ComputeQuantization(kBoundsMin, kBoundsMax);
+		std::vector<PackedVertex> packed(vertices.size());
+		VertexPacking::Encode(vertices.data(), static_cast<uint32_t>(vertices.size()), packed.data(), format, quantization);
+		std::vector<Vertex> decoded(vertices.size());
+		VertexPacking::Decode(packed.data(), static_cast<uint32_t>(packed.size()), decoded.data(), format, quantization);
+
+		const float extent[3] = { kBoundsMax.x - kBoundsMin.x, kBoundsMax.y - kBoundsMin.y, kBoundsMax.z - kBoundsMin.z };
+		float maxError[3] = { 0.0f, 0.0f, 0.0f };
+		float maxColorError = 0.0f;
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			maxError[0] = (std::max)(maxError[0], std::fabs(decoded[i].position.x - vertices[i].position.x));
+			maxError[1] = (std::max)(maxError[1], std::fabs(decoded[i].position.y - vertices[i].position.y));
+			maxError[2] = (std::max)(maxError[2], std::fabs(decoded[i].position.z - vertices[i].position.z));
+			maxColorError = (std::max)(maxColorError, std::fabs(decoded[i].color.x - vertices[i].color.x));
+			maxColorError = (std::max)(maxColorError, std::fabs(decoded[i].color.w - vertices[i].color.w));
+			CHECK(packed[i].position[3] == (format == VertexPositionFormat::Snorm16 ? 32767 : 0x3c00));
+		}
+		for (int axis = 0; axis < 3; axis++)
+		{
+			CHECK(maxError[axis] <= GetAxisErrorBound(format, extent[axis]));
+		}
+		CHECK(maxColorError <= 0.5f / 255.0f + 1e-6f);
+
+		// The report agrees, relative to the diagonal of the bounding box
+		VertexPackingError error = VertexPacking::MeasureError(vertices.data(), packed.data(),
+			static_cast<uint32_t>(vertices.size()), format, quantization);
+		float diagonal = std::sqrt(extent[0] * extent[0] + extent[1] * extent[1] + extent[2] * extent[2]);
+		float boundError = std::sqrt(maxError[0] * maxError[0] + maxError[1] * maxError[1] + maxError[2] * maxError[2]);
+		CHECK(error.maxPositionError <= boundError + 1e-6f);
+		CHECK(error.maxPositionError >= (std::max)((std::max)(maxError[0], maxError[1]), maxError[2]) - 1e-6f);
+		CHECK(std::fabs(error.relativePositionError - error.maxPositionError / diagonal) <= 1e-6f);
+		CHECK(error.rmsPositionError <= error.maxPositionError);
+	}
+}
+
+TEST_CASE(Snorm16RoundTripIsWithinHalfAStepOfTheBoundingBox)
+{
+	CheckRoundTrip(VertexPositionFormat::Snorm16);
+}
+
+TEST_CASE(Float16RoundTripIsWithinHalfAnUlpOfTheBoundingBox)
+{
+	CheckRoundTrip(VertexPositionFormat::Float16);
+}
+
+TEST_CASE(PackedVerticesTake43PercentOfTheMemory)
+{
+	// 12 bytes instead of 28: the packed vertices take 43% of the memory, a 57% saving
+	std::vector<Vertex> vertices = MakeVertices(1000);
+	std::vector<PackedVertex> packed(vertices.size());
+	VertexQuantization quantization = VertexPacking::ComputeQuantization(kBoundsMin, kBoundsMax);
+	VertexPacking::Encode(vertices.data(), 1000, packed.data(), VertexPositionFormat::Snorm16, quantization);
+	VertexPackingError error = VertexPacking::MeasureError(vertices.data(), packed.data(), 1000,
+		VertexPositionFormat::Snorm16, quantization);
+	CHECK(error.sizeInBytes == 28000);
+	CHECK(error.packedSizeInBytes == 12000);
+	CHECK(std::lround(100.0 * error.packedSizeInBytes / error.sizeInBytes) == 43);
+}
+
+TEST_CASE(OutOfBoundsValuesAreClamped)
+{
+	std::vector<Vertex> vertices(5);
+	for (Vertex& vertex : vertices)
+	{
+		vertex.position = XMFLOAT3(100.0f, -100.0f, 0.0f);
+		vertex.color = XMFLOAT4(2.0f, -1.0f, 0.5f, 1.0f);
+	}
+	VertexQuantization quantization = VertexPacking::ComputeQuantization(kBoundsMin, kBoundsMax);
+	const VertexPositionFormat formats[] = { VertexPositionFormat::Snorm16, VertexPositionFormat::Float16 };
+	for (VertexPositionFormat format : formats)
+	{
+		PackedVertex packed[5];
+		Vertex decoded[5];
+		VertexPacking::Encode(vertices.data(), 5, packed, format, quantization);
+		VertexPacking::Decode(packed, 5, decoded, format, quantization);
+		for (const Vertex& vertex : decoded)
+		{
+			CHECK(std::fabs(vertex.position.x - kBoundsMax.x) <= 1e-3f);
+			CHECK(std::fabs(vertex.position.y - kBoundsMin.y) <= 1e-3f);
+			CHECK(vertex.color.x == 1.0f);
+			CHECK(vertex.color.y == 0.0f);
+		}
+	}
+}
+
+TEST_CASE(FlatMeshesKeepAnInvertibleQuantization)
+{
+	// A plane: the flat axis gets a small extent instead of a zero scale
+	XMFLOAT3 boundsMin = { -1.0f, 0.0f, -1.0f };
+	XMFLOAT3 boundsMax = { 1.0f, 0.0f, 1.0f };
+	VertexQuantization quantization = VertexPacking::ComputeQuantization(boundsMin, boundsMax);
+	CHECK(quantization.scale.y > 0.0f);
+
+	Vertex vertex;
+	vertex.position = XMFLOAT3(0.5f, 0.0f, -0.25f);
+	vertex.color = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	PackedVertex packed;
+	Vertex decoded;
+	VertexPacking::Encode(&vertex, 1, &packed, VertexPositionFormat::Snorm16, quantization);
+	VertexPacking::Decode(&packed, 1, &decoded, VertexPositionFormat::Snorm16, quantization);
+	CHECK(std::fabs(decoded.position.x - 0.5f) <= GetAxisErrorBound(VertexPositionFormat::Snorm16, 2.0f));
+	CHECK(std::fabs(decoded.position.y) <= 1e-6f);
+	CHECK(std::fabs(decoded.position.z + 0.25f) <= GetAxisErrorBound(VertexPositionFormat::Snorm16, 2.0f));
+}
+
+TEST_CASE(HalfConversionsRoundTripEveryFiniteHalf)
+{
+	for (uint32_t bits = 0; bits < 0x10000; bits++)
+	{
+		uint16_t half = static_cast<uint16_t>(bits);
+		if ((half & 0x7c00) == 0x7c00)
+			continue;
+		REQUIRE(VertexPacking::FloatToHalf(VertexPacking::HalfToFloat(half)) == half);
+	}
+	// Ties round to even
+	CHECK(VertexPacking::FloatToHalf(1.0f + std::ldexp(1.0f, -11)) == 0x3c00);
+	CHECK(VertexPacking::FloatToHalf(1.0f + 3.0f * std::ldexp(1.0f, -11)) == 0x3c02);
+}
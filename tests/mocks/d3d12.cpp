@@ -0,0 +1,78 @@
+// #DXR Custom: Host Build
+// D3D12SerializeRootSignature of the mocks: the blob holds the fields of the description, so
+// that equal descriptions give equal blobs and any change of the layout changes the blob, as
+// with the real serialization. The static samplers are not supported.
+
+#include <d3d12.h>
+
+#include <vector>
+
+namespace
+{
+	class MockBlob : public ID3DBlob
+	{
+	public:
+		void* GetBufferPointer() override { return m_data.data(); }
+		SIZE_T GetBufferSize() override { return m_data.size(); }
+
+		void Add(uint32_t value)
+		{
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+			m_data.insert(m_data.end(), bytes, bytes + sizeof(value));
+		}
+
+	private:
+		std::vector<uint8_t> m_data;
+	};
+}
+
+HRESULT D3D12SerializeRootSignature(const D3D12_ROOT_SIGNATURE_DESC* rootSignature, D3D_ROOT_SIGNATURE_VERSION version,
+	ID3DBlob** blob, ID3DBlob** errorBlob)
+{
+	if (errorBlob)
+	{
+		*errorBlob = nullptr;
+	}
+	if (!rootSignature || !blob || rootSignature->NumStaticSamplers != 0)
+	{
+		return E_INVALIDARG;
+	}
+
+	MockBlob* result = new MockBlob();
+	result->Add(0xB10B);
+	result->Add(version);
+	result->Add(rootSignature->Flags);
+	result->Add(rootSignature->NumParameters);
+	for (UINT i = 0; i < rootSignature->NumParameters; i++)
+	{
+		const D3D12_ROOT_PARAMETER& parameter = rootSignature->pParameters[i];
+		result->Add(parameter.ParameterType);
+		result->Add(parameter.ShaderVisibility);
+		switch (parameter.ParameterType)
+		{
+		case D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE:
+			result->Add(parameter.DescriptorTable.NumDescriptorRanges);
+			for (UINT r = 0; r < parameter.DescriptorTable.NumDescriptorRanges; r++)
+			{
+				const D3D12_DESCRIPTOR_RANGE& range = parameter.DescriptorTable.pDescriptorRanges[r];
+				result->Add(range.RangeType);
+				result->Add(range.NumDescriptors);
+				result->Add(range.BaseShaderRegister);
+				result->Add(range.RegisterSpace);
+				result->Add(range.OffsetInDescriptorsFromTableStart);
+			}
+			break;
+		case D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS:
+			result->Add(parameter.Constants.ShaderRegister);
+			result->Add(parameter.Constants.RegisterSpace);
+			result->Add(parameter.Constants.Num32BitValues);
+			break;
+		default:
+			result->Add(parameter.Descriptor.ShaderRegister);
+			result->Add(parameter.Descriptor.RegisterSpace);
+			break;
+		}
+	}
+	*blob = result;
+	return S_OK;
+}
@@ -0,0 +1,483 @@
+#pragma once
+
+// #DXR Custom: Host Build
+// Stand-in for d3d12.h in the tests of the modules using D3D12. The declarations follow the
+// Windows SDK, restricted to what these modules use. The methods of the interfaces are not pure:
+// they return E_NOTIMPL, so that a mock only overrides what a test exercises. The constants have
+// the values of the SDK, the static_asserts of D3D12MemoryHeap.cpp compare them to
+// MemoryAlignment.
+//
+// D3D12SerializeRootSignature is implemented in d3d12.cpp, as a plain serialization of the
+// description, so that equal descriptions give equal blobs as with the real runtime.
+
+#include <windows.h>
+
+typedef UINT64 D3D12_GPU_VIRTUAL_ADDRESS;
+
+#define D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT 256
+#define D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT 65536
+#define D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT 256
+#define D3D12_RAYTRACING_INSTANCE_DESCS_BYTE_ALIGNMENT 16
+#define D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT 32
+#define D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT 64
+
+enum DXGI_FORMAT
+{
+	DXGI_FORMAT_UNKNOWN = 0
+};
+
+struct DXGI_SAMPLE_DESC
+{
+	UINT Count;
+	UINT Quality;
+};
+
+struct D3D12_RANGE
+{
+	SIZE_T Begin;
+	SIZE_T End;
+};
+
+enum D3D12_HEAP_TYPE
+{
+	D3D12_HEAP_TYPE_DEFAULT = 1,
+	D3D12_HEAP_TYPE_UPLOAD = 2,
+	D3D12_HEAP_TYPE_READBACK = 3
+};
+
+enum D3D12_CPU_PAGE_PROPERTY
+{
+	D3D12_CPU_PAGE_PROPERTY_UNKNOWN = 0
+};
+
+enum D3D12_MEMORY_POOL
+{
+	D3D12_MEMORY_POOL_UNKNOWN = 0
+};
+
+struct D3D12_HEAP_PROPERTIES
+{
+	D3D12_HEAP_TYPE Type;
+	D3D12_CPU_PAGE_PROPERTY CPUPageProperty;
+	D3D12_MEMORY_POOL MemoryPoolPreference;
+	UINT CreationNodeMask;
+	UINT VisibleNodeMask;
+};
+
+enum D3D12_HEAP_FLAGS
+{
+	D3D12_HEAP_FLAG_NONE = 0
+};
+
+enum D3D12_RESOURCE_DIMENSION
+{
+	D3D12_RESOURCE_DIMENSION_UNKNOWN = 0,
+	D3D12_RESOURCE_DIMENSION_BUFFER = 1
+};
+
+enum D3D12_TEXTURE_LAYOUT
+{
+	D3D12_TEXTURE_LAYOUT_UNKNOWN = 0,
+	D3D12_TEXTURE_LAYOUT_ROW_MAJOR = 1
+};
+
+enum D3D12_RESOURCE_FLAGS
+{
+	D3D12_RESOURCE_FLAG_NONE = 0,
+	D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS = 0x4
+};
+
+enum D3D12_RESOURCE_STATES
+{
+	D3D12_RESOURCE_STATE_COMMON = 0,
+	D3D12_RESOURCE_STATE_UNORDERED_ACCESS = 0x8,
+	D3D12_RESOURCE_STATE_GENERIC_READ = 0xac3,
+	D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE = 0x400000
+};
+
+struct D3D12_RESOURCE_DESC
+{
+	D3D12_RESOURCE_DIMENSION Dimension;
+	UINT64 Alignment;
+	UINT64 Width;
+	UINT Height;
+	UINT16 DepthOrArraySize;
+	UINT16 MipLevels;
+	DXGI_FORMAT Format;
+	DXGI_SAMPLE_DESC SampleDesc;
+	D3D12_TEXTURE_LAYOUT Layout;
+	D3D12_RESOURCE_FLAGS Flags;
+};
+
+struct D3D12_CLEAR_VALUE;
+
+enum D3D12_DESCRIPTOR_RANGE_TYPE
+{
+	D3D12_DESCRIPTOR_RANGE_TYPE_SRV = 0,
+	D3D12_DESCRIPTOR_RANGE_TYPE_UAV = 1,
+	D3D12_DESCRIPTOR_RANGE_TYPE_CBV = 2,
+	D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER = 3
+};
+
+#define D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND 0xffffffff
+
+struct D3D12_DESCRIPTOR_RANGE
+{
+	D3D12_DESCRIPTOR_RANGE_TYPE RangeType;
+	UINT NumDescriptors;
+	UINT BaseShaderRegister;
+	UINT RegisterSpace;
+	UINT OffsetInDescriptorsFromTableStart;
+};
+
+enum D3D12_ROOT_PARAMETER_TYPE
+{
+	D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE = 0,
+	D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS = 1,
+	D3D12_ROOT_PARAMETER_TYPE_CBV = 2,
+	D3D12_ROOT_PARAMETER_TYPE_SRV = 3,
+	D3D12_ROOT_PARAMETER_TYPE_UAV = 4
+};
+
+enum D3D12_SHADER_VISIBILITY
+{
+	D3D12_SHADER_VISIBILITY_ALL = 0
+};
+
+struct D3D12_ROOT_DESCRIPTOR_TABLE
+{
+	UINT NumDescriptorRanges;
+	const D3D12_DESCRIPTOR_RANGE* pDescriptorRanges;
+};
+
+struct D3D12_ROOT_CONSTANTS
+{
+	UINT ShaderRegister;
+	UINT RegisterSpace;
+	UINT Num32BitValues;
+};
+
+struct D3D12_ROOT_DESCRIPTOR
+{
+	UINT ShaderRegister;
+	UINT RegisterSpace;
+};
+
+struct D3D12_ROOT_PARAMETER
+{
+	D3D12_ROOT_PARAMETER_TYPE ParameterType;
+	union
+	{
+		D3D12_ROOT_DESCRIPTOR_TABLE DescriptorTable;
+		D3D12_ROOT_CONSTANTS Constants;
+		D3D12_ROOT_DESCRIPTOR Descriptor;
+	};
+	D3D12_SHADER_VISIBILITY ShaderVisibility;
+};
+
+enum D3D12_ROOT_SIGNATURE_FLAGS
+{
+	D3D12_ROOT_SIGNATURE_FLAG_NONE = 0,
+	D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE = 0x80
+};
+
+struct D3D12_STATIC_SAMPLER_DESC;
+
+struct D3D12_ROOT_SIGNATURE_DESC
+{
+	UINT NumParameters;
+	const D3D12_ROOT_PARAMETER* pParameters;
+	UINT NumStaticSamplers;
+	const D3D12_STATIC_SAMPLER_DESC* pStaticSamplers;
+	D3D12_ROOT_SIGNATURE_FLAGS Flags;
+};
+
+enum D3D_ROOT_SIGNATURE_VERSION
+{
+	D3D_ROOT_SIGNATURE_VERSION_1 = 0x1,
+	D3D_ROOT_SIGNATURE_VERSION_1_0 = 0x1
+};
+
+enum D3D12_STATE_SUBOBJECT_TYPE
+{
+	D3D12_STATE_SUBOBJECT_TYPE_STATE_OBJECT_CONFIG = 0,
+	D3D12_STATE_SUBOBJECT_TYPE_GLOBAL_ROOT_SIGNATURE = 1,
+	D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE = 2,
+	D3D12_STATE_SUBOBJECT_TYPE_NODE_MASK = 3,
+	D3D12_STATE_SUBOBJECT_TYPE_DXIL_LIBRARY = 5,
+	D3D12_STATE_SUBOBJECT_TYPE_EXISTING_COLLECTION = 6,
+	D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION = 7,
+	D3D12_STATE_SUBOBJECT_TYPE_DXIL_SUBOBJECT_TO_EXPORTS_ASSOCIATION = 8,
+	D3D12_STATE_SUBOBJECT_TYPE_RAYTRACING_SHADER_CONFIG = 9,
+	D3D12_STATE_SUBOBJECT_TYPE_RAYTRACING_PIPELINE_CONFIG = 10,
+	D3D12_STATE_SUBOBJECT_TYPE_HIT_GROUP = 11
+};
+
+struct D3D12_STATE_SUBOBJECT
+{
+	D3D12_STATE_SUBOBJECT_TYPE Type;
+	const void* pDesc;
+};
+
+enum D3D12_EXPORT_FLAGS
+{
+	D3D12_EXPORT_FLAG_NONE = 0
+};
+
+struct D3D12_EXPORT_DESC
+{
+	LPCWSTR Name;
+	LPCWSTR ExportToRename;
+	D3D12_EXPORT_FLAGS Flags;
+};
+
+struct D3D12_SHADER_BYTECODE
+{
+	const void* pShaderBytecode;
+	SIZE_T BytecodeLength;
+};
+
+struct D3D12_DXIL_LIBRARY_DESC
+{
+	D3D12_SHADER_BYTECODE DXILLibrary;
+	UINT NumExports;
+	D3D12_EXPORT_DESC* pExports;
+};
+
+enum D3D12_HIT_GROUP_TYPE
+{
+	D3D12_HIT_GROUP_TYPE_TRIANGLES = 0
+};
+
+struct D3D12_HIT_GROUP_DESC
+{
+	LPCWSTR HitGroupExport;
+	D3D12_HIT_GROUP_TYPE Type;
+	LPCWSTR AnyHitShaderImport;
+	LPCWSTR ClosestHitShaderImport;
+	LPCWSTR IntersectionShaderImport;
+};
+
+struct D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION
+{
+	const D3D12_STATE_SUBOBJECT* pSubobjectToAssociate;
+	UINT NumExports;
+	LPCWSTR* pExports;
+};
+
+struct D3D12_RAYTRACING_SHADER_CONFIG
+{
+	UINT MaxPayloadSizeInBytes;
+	UINT MaxAttributeSizeInBytes;
+};
+
+struct D3D12_RAYTRACING_PIPELINE_CONFIG
+{
+	UINT MaxTraceRecursionDepth;
+};
+
+enum D3D12_STATE_OBJECT_FLAGS
+{
+	D3D12_STATE_OBJECT_FLAG_NONE = 0,
+	D3D12_STATE_OBJECT_FLAG_ALLOW_LOCAL_DEPENDENCIES_ON_EXTERNAL_DEFINITIONS = 0x1,
+	D3D12_STATE_OBJECT_FLAG_ALLOW_EXTERNAL_DEPENDENCIES_ON_LOCAL_DEFINITIONS = 0x2,
+	D3D12_STATE_OBJECT_FLAG_ALLOW_STATE_OBJECT_ADDITIONS = 0x4
+};
+
+struct D3D12_STATE_OBJECT_CONFIG
+{
+	D3D12_STATE_OBJECT_FLAGS Flags;
+};
+
+enum D3D12_STATE_OBJECT_TYPE
+{
+	D3D12_STATE_OBJECT_TYPE_COLLECTION = 0,
+	D3D12_STATE_OBJECT_TYPE_RAYTRACING_PIPELINE = 3
+};
+
+struct D3D12_STATE_OBJECT_DESC
+{
+	D3D12_STATE_OBJECT_TYPE Type;
+	UINT NumSubobjects;
+	const D3D12_STATE_SUBOBJECT* pSubobjects;
+};
+
+struct ID3DBlob : IUnknown
+{
+	virtual void* GetBufferPointer() { return nullptr; }
+	virtual SIZE_T GetBufferSize() { return 0; }
+};
+
+struct ID3D12Object : IUnknown
+{
+	virtual HRESULT GetPrivateData(REFGUID, UINT*, void*) { return E_NOTIMPL; }
+	virtual HRESULT SetPrivateData(REFGUID, UINT, const void*) { return E_NOTIMPL; }
+};
+
+struct ID3D12RootSignature : ID3D12Object
+{
+};
+
+struct ID3D12StateObject : ID3D12Object
+{
+};
+
+struct ID3D12StateObjectProperties : IUnknown
+{
+	virtual void* GetShaderIdentifier(LPCWSTR) { return nullptr; }
+	virtual UINT64 GetShaderStackSize(LPCWSTR) { return 0; }
+};
+
+struct D3D12_GLOBAL_ROOT_SIGNATURE
+{
+	ID3D12RootSignature* pGlobalRootSignature;
+};
+
+struct D3D12_LOCAL_ROOT_SIGNATURE
+{
+	ID3D12RootSignature* pLocalRootSignature;
+};
+
+struct D3D12_EXISTING_COLLECTION_DESC
+{
+	ID3D12StateObject* pExistingCollection;
+	UINT NumExports;
+	D3D12_EXPORT_DESC* pExports;
+};
+
+HRESULT D3D12SerializeRootSignature(const D3D12_ROOT_SIGNATURE_DESC* rootSignature, D3D_ROOT_SIGNATURE_VERSION version,
+	ID3DBlob** blob, ID3DBlob** errorBlob);
+
+struct ID3D12Resource : ID3D12Object
+{
+	virtual HRESULT Map(UINT, const D3D12_RANGE*, void**) { return E_NOTIMPL; }
+	virtual void Unmap(UINT, const D3D12_RANGE*) {}
+	virtual D3D12_GPU_VIRTUAL_ADDRESS GetGPUVirtualAddress() { return 0; }
+};
+
+enum D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE
+{
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL = 0,
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL = 0x1
+};
+
+enum D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS
+{
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE = 0,
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE = 0x1,
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE = 0x20
+};
+
+enum D3D12_ELEMENTS_LAYOUT
+{
+	D3D12_ELEMENTS_LAYOUT_ARRAY = 0
+};
+
+enum D3D12_RAYTRACING_INSTANCE_FLAGS
+{
+	D3D12_RAYTRACING_INSTANCE_FLAG_NONE = 0
+};
+
+struct D3D12_RAYTRACING_INSTANCE_DESC
+{
+	FLOAT Transform[3][4];
+	UINT InstanceID : 24;
+	UINT InstanceMask : 8;
+	UINT InstanceContributionToHitGroupIndex : 24;
+	UINT Flags : 8;
+	D3D12_GPU_VIRTUAL_ADDRESS AccelerationStructure;
+};
+
+/// Only the top-level inputs are declared, the union of the SDK is reduced to InstanceDescs
+struct D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS
+{
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE Type;
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS Flags;
+	UINT NumDescs;
+	D3D12_ELEMENTS_LAYOUT DescsLayout;
+	D3D12_GPU_VIRTUAL_ADDRESS InstanceDescs;
+};
+
+struct D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO
+{
+	UINT64 ResultDataMaxSizeInBytes;
+	UINT64 ScratchDataSizeInBytes;
+	UINT64 UpdateScratchDataSizeInBytes;
+};
+
+struct D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC
+{
+	D3D12_GPU_VIRTUAL_ADDRESS DestAccelerationStructureData;
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS Inputs;
+	D3D12_GPU_VIRTUAL_ADDRESS SourceAccelerationStructureData;
+	D3D12_GPU_VIRTUAL_ADDRESS ScratchAccelerationStructureData;
+};
+
+struct D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC;
+
+enum D3D12_RESOURCE_BARRIER_TYPE
+{
+	D3D12_RESOURCE_BARRIER_TYPE_TRANSITION = 0,
+	D3D12_RESOURCE_BARRIER_TYPE_ALIASING = 1,
+	D3D12_RESOURCE_BARRIER_TYPE_UAV = 2
+};
+
+enum D3D12_RESOURCE_BARRIER_FLAGS
+{
+	D3D12_RESOURCE_BARRIER_FLAG_NONE = 0
+};
+
+struct D3D12_RESOURCE_UAV_BARRIER
+{
+	ID3D12Resource* pResource;
+};
+
+/// Only the UAV barriers are declared
+struct D3D12_RESOURCE_BARRIER
+{
+	D3D12_RESOURCE_BARRIER_TYPE Type;
+	D3D12_RESOURCE_BARRIER_FLAGS Flags;
+	D3D12_RESOURCE_UAV_BARRIER UAV;
+};
+
+struct ID3D12GraphicsCommandList : ID3D12Object
+{
+	virtual void ResourceBarrier(UINT, const D3D12_RESOURCE_BARRIER*) {}
+};
+
+struct ID3D12GraphicsCommandList4 : ID3D12GraphicsCommandList
+{
+	virtual void BuildRaytracingAccelerationStructure(const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC*, UINT,
+		const D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC*)
+	{
+	}
+};
+
+struct ID3D12Device : ID3D12Object
+{
+	virtual HRESULT CreateCommittedResource(const D3D12_HEAP_PROPERTIES*, D3D12_HEAP_FLAGS, const D3D12_RESOURCE_DESC*,
+		D3D12_RESOURCE_STATES, const D3D12_CLEAR_VALUE*, REFIID, void**)
+	{
+		return E_NOTIMPL;
+	}
+
+	virtual HRESULT CreateRootSignature(UINT, const void*, SIZE_T, REFIID, void**) { return E_NOTIMPL; }
+};
+
+struct ID3D12Device5 : ID3D12Device
+{
+	virtual HRESULT CreateStateObject(const D3D12_STATE_OBJECT_DESC*, REFIID, void**) { return E_NOTIMPL; }
+
+	virtual void GetRaytracingAccelerationStructurePrebuildInfo(const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS*,
+		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO*)
+	{
+	}
+};
+
+struct ID3D12Device7 : ID3D12Device5
+{
+	virtual HRESULT AddToStateObject(const D3D12_STATE_OBJECT_DESC*, ID3D12StateObject*, REFIID, void**)
+	{
+		return E_NOTIMPL;
+	}
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+// #DXR Custom: Host Build
+// Stand-in for dxcapi.h in the tests of the modules using D3D12, see d3d12.h in this directory.
+// The modules only read compiled libraries through IDxcBlob.
+
+#include <windows.h>
+
+struct IDxcBlob : IUnknown
+{
+	virtual void* GetBufferPointer() { return nullptr; }
+	virtual SIZE_T GetBufferSize() { return 0; }
+};
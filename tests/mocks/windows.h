@@ -0,0 +1,90 @@
+#pragma once
+
+// #DXR Custom: Host Build
+// Stand-in for the Windows SDK headers in the tests of the modules using D3D12 (see d3d12.h in
+// this directory). Only the types and macros these modules use are declared. IUnknown counts
+// its references itself, so that the mock objects of the tests only implement the methods they
+// exercise.
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+typedef int BOOL;
+typedef unsigned int UINT;
+typedef uint8_t UINT8;
+typedef uint16_t UINT16;
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+typedef unsigned long ULONG;
+typedef size_t SIZE_T;
+typedef float FLOAT;
+typedef wchar_t WCHAR;
+typedef const wchar_t* LPCWSTR;
+typedef int32_t HRESULT;
+
+#define S_OK ((HRESULT)0)
+#define E_NOTIMPL ((HRESULT)0x80004001L)
+#define E_NOINTERFACE ((HRESULT)0x80004002L)
+#define E_FAIL ((HRESULT)0x80004005L)
+#define E_INVALIDARG ((HRESULT)0x80070057L)
+#define DXGI_ERROR_NOT_FOUND ((HRESULT)0x887A0002L)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+
+#define ZeroMemory(destination, length) memset((destination), 0, (length))
+
+struct GUID
+{
+	uint32_t Data1;
+	uint16_t Data2;
+	uint16_t Data3;
+	uint8_t Data4[8];
+};
+typedef const GUID& REFGUID;
+typedef const GUID& REFIID;
+
+inline bool operator==(const GUID& a, const GUID& b) { return memcmp(&a, &b, sizeof(GUID)) == 0; }
+inline bool operator!=(const GUID& a, const GUID& b) { return !(a == b); }
+
+/// Identifier of an interface type, distinct for each type
+template <class T>
+REFIID MockIidOf()
+{
+	static std::atomic<uint32_t> nextIid(1);
+	static const GUID iid = { nextIid++, 0, 0, { 0 } };
+	return iid;
+}
+
+template <class T>
+REFIID MockIidOf(T**)
+{
+	return MockIidOf<T>();
+}
+
+#define IID_PPV_ARGS(pp) MockIidOf(pp), reinterpret_cast<void**>(pp)
+
+struct IUnknown
+{
+	virtual ~IUnknown() {}
+
+	virtual ULONG AddRef() { return ++m_refCount; }
+
+	virtual ULONG Release()
+	{
+		ULONG refCount = --m_refCount;
+		if (refCount == 0)
+			delete this;
+		return refCount;
+	}
+
+	/// The mocks implementing other interfaces than their own override this
+	virtual HRESULT QueryInterface(REFIID, void** object)
+	{
+		*object = nullptr;
+		return E_NOINTERFACE;
+	}
+
+private:
+	std::atomic<ULONG> m_refCount{ 1 };
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+// #DXR Custom: Host Build
+// Subset of Microsoft::WRL::ComPtr used by the modules under test
+
+#include <windows.h>
+
+#include <cstddef>
+
+namespace Microsoft
+{
+	namespace WRL
+	{
+		template <class T>
+		class ComPtr
+		{
+		public:
+			ComPtr() {}
+			ComPtr(std::nullptr_t) {}
+			ComPtr(T* pointer) : m_pointer(pointer) { InternalAddRef(); }
+			ComPtr(const ComPtr& other) : m_pointer(other.m_pointer) { InternalAddRef(); }
+			ComPtr(ComPtr&& other) : m_pointer(other.m_pointer) { other.m_pointer = nullptr; }
+			~ComPtr() { InternalRelease(); }
+
+			ComPtr& operator=(const ComPtr& other)
+			{
+				ComPtr(other).Swap(*this);
+				return *this;
+			}
+			ComPtr& operator=(ComPtr&& other)
+			{
+				ComPtr(static_cast<ComPtr&&>(other)).Swap(*this);
+				return *this;
+			}
+			ComPtr& operator=(T* pointer)
+			{
+				ComPtr(pointer).Swap(*this);
+				return *this;
+			}
+
+			T* Get() const { return m_pointer; }
+			T* operator->() const { return m_pointer; }
+			explicit operator bool() const { return m_pointer != nullptr; }
+
+			/// Address of the pointer, released first as with the real ComPtr
+			T** operator&()
+			{
+				InternalRelease();
+				return &m_pointer;
+			}
+			T** GetAddressOf() { return &m_pointer; }
+			T** ReleaseAndGetAddressOf() { return &(*this); }
+
+			void Attach(T* pointer)
+			{
+				InternalRelease();
+				m_pointer = pointer;
+			}
+			T* Detach()
+			{
+				T* pointer = m_pointer;
+				m_pointer = nullptr;
+				return pointer;
+			}
+			void Reset() { InternalRelease(); }
+			void Swap(ComPtr& other)
+			{
+				T* pointer = m_pointer;
+				m_pointer = other.m_pointer;
+				other.m_pointer = pointer;
+			}
+
+			template <class U>
+			HRESULT As(ComPtr<U>* other) const
+			{
+				return m_pointer->QueryInterface(IID_PPV_ARGS(&(*other)));
+			}
+
+		private:
+			void InternalAddRef()
+			{
+				if (m_pointer)
+					m_pointer->AddRef();
+			}
+			void InternalRelease()
+			{
+				T* pointer = m_pointer;
+				m_pointer = nullptr;
+				if (pointer)
+					pointer->Release();
+			}
+
+			T* m_pointer = nullptr;
+		};
+	}
+}
@@ -0,0 +1,909 @@
+// #DXR Custom: Host Build
+// Benchmarks of the platform independent modules, built by the host build (see CMakeLists.txt).
+// Each case generates its own input, so that the figures quoted for a module can be reproduced
+// on any machine:
+//
+//   Benchmark [--quick] [--threads N] [--repeat N] [case...]
+//
+// Without case names, all the cases run. --quick shrinks the inputs so that every case runs in
+// a fraction of a second; ctest runs it that way to keep the cases working. --threads sets the
+// size of the thread pools (0 uses all the hardware threads) and --repeat the number of timed
+// runs, whose median is reported.
+
+#include "SampleScene.h"
+
+#include "CpuRaytracer.h"
+#include "InstanceCuller.h"
+#include "MeshCache.h"
+#include "MeshLoader.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "ShaderCache.h"
+#include "TransformHierarchy.h"
+#include "VertexTypes.h"
+#include "nv_helpers_dx12/BottomLevelBVHBuilder.h"
+#include "nv_helpers_dx12/FrameContextRing.h"
+#include "nv_helpers_dx12/ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct BenchmarkOptions
+	{
+		bool quick = false;
+		uint32_t threadCount = 0;
+		uint32_t repeatCount = 5;
+	};
+
+	struct BenchmarkCase
+	{
+		const char* name;
+		const char* description;
+		void (*run)(const BenchmarkOptions& options);
+	};
+
+	/// Median duration of the timed runs of a function
+	double MeasureMilliseconds(const BenchmarkOptions& options, const std::function<void()>& function)
+	{
+		std::vector<double> durations(options.repeatCount);
+		for (double& duration : durations)
+		{
+			auto start = std::chrono::steady_clock::now();
+			function();
+			duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		std::sort(durations.begin(), durations.end());
+		return durations[durations.size() / 2];
+	}
+
+	/// Sphere of radius 1 whose surface is displaced by a few sine waves, made of about
+	/// triangleCount triangles. Its triangles are laid out ring by ring, as a scanned or
+	/// tessellated mesh would be
+	void MakeBumpySphere(uint32_t triangleCount, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		uint32_t rings = (std::max)(4u, static_cast<uint32_t>(std::sqrt(triangleCount / 4.0)));
+		uint32_t segments = 2 * rings;
+		const float pi = 3.14159265f;
+
+		vertices.clear();
+		vertices.reserve(static_cast<size_t>(rings + 1) * (segments + 1));
+		for (uint32_t ring = 0; ring <= rings; ring++)
+		{
+			float theta = pi * ring / rings;
+			for (uint32_t segment = 0; segment <= segments; segment++)
+			{
+				float phi = 2.0f * pi * segment / segments;
+				float radius = 1.0f + 0.05f * std::sin(7.0f * theta) * std::sin(5.0f * phi) +
+					0.01f * std::sin(31.0f * theta) * std::sin(29.0f * phi);
+				Vertex vertex;
+				vertex.position = XMFLOAT3(radius * std::sin(theta) * std::cos(phi), radius * std::cos(theta),
+					radius * std::sin(theta) * std::sin(phi));
+				vertex.color = XMFLOAT4(theta / pi, phi / (2.0f * pi), 0.5f, 1.0f);
+				vertices.push_back(vertex);
+			}
+		}
+
+		indices.clear();
+		indices.reserve(static_cast<size_t>(rings) * segments * 6);
+		for (uint32_t ring = 0; ring < rings; ring++)
+		{
+			for (uint32_t segment = 0; segment < segments; segment++)
+			{
+				uint32_t i0 = ring * (segments + 1) + segment;
+				uint32_t i1 = i0 + segments + 1;
+				uint32_t triangle[6] = { i0, i1, i0 + 1, i0 + 1, i1, i1 + 1 };
+				indices.insert(indices.end(), triangle, triangle + 6);
+			}
+		}
+	}
+
+	/// Write a mesh as an OBJ file with vertex colors, as exported by common tools
+	bool WriteObj(const std::string& fileName, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+	{
+		FILE* file = std::fopen(fileName.c_str(), "wb");
+		if (!file)
+		{
+			return false;
+		}
+		std::fprintf(file, "# Benchmark mesh\n");
+		for (const Vertex& vertex : vertices)
+		{
+			std::fprintf(file, "v %.6f %.6f %.6f %.6f %.6f %.6f\n", vertex.position.x, vertex.position.y, vertex.position.z,
+				vertex.color.x, vertex.color.y, vertex.color.z);
+		}
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			std::fprintf(file, "f %u %u %u\n", indices[i] + 1, indices[i + 1] + 1, indices[i + 2] + 1);
+		}
+		return std::fclose(file) == 0;
+	}
+
+	/// Write a mesh as a binary little-endian PLY file with 8-bit vertex colors
+	bool WritePly(const std::string& fileName, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+	{
+		FILE* file = std::fopen(fileName.c_str(), "wb");
+		if (!file)
+		{
+			return false;
+		}
+		std::fprintf(file, "ply\nformat binary_little_endian 1.0\nelement vertex %zu\n"
+			"property float x\nproperty float y\nproperty float z\n"
+			"property uchar red\nproperty uchar green\nproperty uchar blue\n"
+			"element face %zu\nproperty list uchar int vertex_indices\nend_header\n", vertices.size(), indices.size() / 3);
+
+		std::vector<uint8_t> record(15);
+		for (const Vertex& vertex : vertices)
+		{
+			std::memcpy(&record[0], &vertex.position, 12);
+			record[12] = static_cast<uint8_t>(vertex.color.x * 255.0f + 0.5f);
+			record[13] = static_cast<uint8_t>(vertex.color.y * 255.0f + 0.5f);
+			record[14] = static_cast<uint8_t>(vertex.color.z * 255.0f + 0.5f);
+			std::fwrite(record.data(), 1, 15, file);
+		}
+		record.resize(13);
+		record[0] = 3;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			std::memcpy(&record[1], &indices[i], 12);
+			std::fwrite(record.data(), 1, 13, file);
+		}
+		return std::fclose(file) == 0;
+	}
+
+	// #DXR Custom: CPU BVH
+	// Binned SAH build against the LBVH variants, on the same mesh
+	void RunBvhBuild(const BenchmarkOptions& options)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		MakeBumpySphere(options.quick ? 20000 : 1000000, vertices, indices);
+
+		nv_helpers_dx12::BottomLevelBVHBuilder builder;
+		builder.AddVertexBuffer(vertices.data(), 0, static_cast<uint32_t>(vertices.size()), sizeof(Vertex),
+			indices.data(), 0, static_cast<uint32_t>(indices.size()));
+		nv_helpers_dx12::ThreadPool threadPool(options.threadCount);
+
+		struct Variant
+		{
+			const char* name;
+			nv_helpers_dx12::BVHBuildMode mode;
+			uint32_t mortonCodeBits;
+			uint32_t treeletOptimizationPasses;
+		};
+		const Variant variants[] =
+		{
+			{ "binned SAH", nv_helpers_dx12::BVHBuildMode::BinnedSAH, 30, 0 },
+			{ "LBVH 30-bit", nv_helpers_dx12::BVHBuildMode::LBVH, 30, 0 },
+			{ "LBVH 63-bit", nv_helpers_dx12::BVHBuildMode::LBVH, 63, 0 },
+			{ "LBVH 30-bit + 1 treelet pass", nv_helpers_dx12::BVHBuildMode::LBVH, 30, 1 },
+		};
+		std::printf("  %u triangles, %u threads\n", builder.GetTriangleCount(), threadPool.GetThreadCount());
+		for (const Variant& variant : variants)
+		{
+			nv_helpers_dx12::BVHBuildSettings settings;
+			settings.mode = variant.mode;
+			settings.mortonCodeBits = variant.mortonCodeBits;
+			settings.treeletOptimizationPasses = variant.treeletOptimizationPasses;
+			nv_helpers_dx12::BottomLevelBVH bvh;
+			double milliseconds = MeasureMilliseconds(options, [&]() { builder.Generate(bvh, settings, &threadPool); });
+			std::printf("  %-30s %9.2f ms  %7.2f Mtris/s  SAH cost %.2f  %u nodes\n", variant.name, milliseconds,
+				builder.GetTriangleCount() / (milliseconds * 1e3), bvh.stats.sahCost, bvh.stats.nodeCount);
+		}
+	}
+
+	// #DXR Custom: CPU Ray Packets
+	// Sample scene rendered one ray at a time, then in packets with each kernel. The tetrahedrons
+	// are replaced by a finer mesh, so that the traversal weighs as it does with loaded meshes.
+	// The kernels the CPU does not support fall back to the best supported one, as reported
+	void RunRayPackets(const BenchmarkOptions& options)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		MakeBumpySphere(options.quick ? 2000 : 100000, vertices, indices);
+		CpuScene scene;
+		BuildSampleScene(vertices, indices, scene);
+		CpuRaytracer raytracer;
+		raytracer.SetScene(scene);
+		const uint32_t width = options.quick ? 64 : 640;
+		const uint32_t height = options.quick ? 48 : 480;
+		CpuCamera camera = MakeSampleCamera(width, height);
+
+		struct Variant
+		{
+			const char* name;
+			bool usePackets;
+			CpuTraversal::Kernel kernel;
+		};
+		const Variant variants[] =
+		{
+			{ "single rays", false, CpuTraversal::Kernel::Scalar },
+			{ "packets, scalar", true, CpuTraversal::Kernel::Scalar },
+			{ "packets, SSE", true, CpuTraversal::Kernel::SSE },
+			{ "packets, AVX2", true, CpuTraversal::Kernel::AVX2 },
+		};
+		std::printf("  %ux%u\n", width, height);
+		std::vector<uint8_t> image;
+		for (const Variant& variant : variants)
+		{
+			CpuRenderOptions renderOptions;
+			renderOptions.threadCount = options.threadCount;
+			renderOptions.usePackets = variant.usePackets;
+			renderOptions.kernel = variant.kernel;
+			double milliseconds = MeasureMilliseconds(options, [&]() { raytracer.Render(camera, width, height, image, renderOptions); });
+			const CpuRenderStats& stats = raytracer.GetStats();
+			uint64_t rayCount = stats.primaryRays + stats.reflectionRays + stats.shadowRays;
+			std::printf("  %-30s %9.2f ms  %7.2f Mrays/s per thread  %u threads  %s kernel  %.0f%% rays in packets\n",
+				variant.name, milliseconds, stats.raysPerSecondPerThread * 1e-6, stats.threadCount,
+				CpuTraversal::GetKernelName(stats.kernel), 100.0 * stats.packetRays / (std::max)(rayCount, uint64_t(1)));
+		}
+	}
+
+	// #DXR Custom: Mesh Loader
+	// OBJ and binary PLY files of the same mesh, loaded on one thread and on the whole pool, then
+	// the numbers of the OBJ file parsed by MeshLoader::ParseFloat against strtod. The files are
+	// written to the working directory and read from the page cache, so the figures are the ones
+	// of the parsing, not of the disk
+	void RunMeshLoader(const BenchmarkOptions& options)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		MakeBumpySphere(options.quick ? 20000 : 2000000, vertices, indices);
+		const std::string objFileName = "benchmark_mesh.obj";
+		const std::string plyFileName = "benchmark_mesh.ply";
+		if (!WriteObj(objFileName, vertices, indices) || !WritePly(plyFileName, vertices, indices))
+		{
+			std::printf("  cannot write the mesh files in the working directory\n");
+			return;
+		}
+
+		struct Variant
+		{
+			const char* name;
+			const std::string* fileName;
+			uint32_t threadCount;
+		};
+		const Variant variants[] =
+		{
+			{ "OBJ, 1 thread", &objFileName, 1 },
+			{ "OBJ, all threads", &objFileName, options.threadCount },
+			{ "PLY, 1 thread", &plyFileName, 1 },
+			{ "PLY, all threads", &plyFileName, options.threadCount },
+		};
+		std::printf("  %zu triangles, %zu vertices\n", indices.size() / 3, vertices.size());
+		for (const Variant& variant : variants)
+		{
+			MeshLoadOptions loadOptions;
+			loadOptions.threadCount = variant.threadCount;
+			MeshLoadStats stats;
+			double milliseconds = MeasureMilliseconds(options, [&]()
+			{
+				MeshLoader::Load(*variant.fileName, vertices, indices, loadOptions, &stats);
+			});
+			double megabytes = stats.fileSizeInBytes / (1024.0 * 1024.0);
+			std::printf("  %-30s %9.2f ms  %7.1f MB/s  %7.2f Mtris/s  %u threads  %.1f MB\n", variant.name, milliseconds,
+				megabytes / (milliseconds * 1e-3), stats.triangleCount / (milliseconds * 1e3), stats.threadCount, megabytes);
+		}
+
+		std::ifstream stream(objFileName, std::ios::binary);
+		std::string text((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+		std::vector<float> numbers;
+		numbers.reserve(text.size() / 8);
+		const char* textEnd = text.data() + text.size();
+		double fastMilliseconds = MeasureMilliseconds(options, [&]()
+		{
+			numbers.clear();
+			for (const char* p = text.data(); p < textEnd;)
+			{
+				float value;
+				if (MeshLoader::ParseFloat(p, textEnd, value))
+					numbers.push_back(value);
+				else
+					p++;
+			}
+		});
+		size_t fastCount = numbers.size();
+		double strtodMilliseconds = MeasureMilliseconds(options, [&]()
+		{
+			numbers.clear();
+			for (const char* p = text.data(); p < textEnd;)
+			{
+				char* next;
+				double value = std::strtod(p, &next);
+				if (next != p)
+				{
+					numbers.push_back(static_cast<float>(value));
+					p = next;
+				}
+				else
+				{
+					p++;
+				}
+			}
+		});
+		std::printf("  %-30s %9.2f ms  %7.1f Mfloats/s\n", "ParseFloat", fastMilliseconds, fastCount / (fastMilliseconds * 1e3));
+		std::printf("  %-30s %9.2f ms  %7.1f Mfloats/s\n", "strtod", strtodMilliseconds, numbers.size() / (strtodMilliseconds * 1e3));
+
+		std::remove(objFileName.c_str());
+		std::remove(plyFileName.c_str());
+	}
+
+	// #DXR Custom: Mesh Cache
+	// Startup cost of a mesh from an OBJ file against its cache: the text path parses the file and
+	// builds the BVH, the cache path maps the file and copies the geometry, as CreateMeshBuffers
+	// does into its upload buffers. The files are in the page cache, so this is the warm startup;
+	// a cold startup adds the read of the file, which is smaller for the cache than for the text
+	void RunMeshCache(const BenchmarkOptions& options)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		MakeBumpySphere(options.quick ? 20000 : 1000000, vertices, indices);
+		const std::string objFileName = "benchmark_cache.obj";
+		const std::string cacheFileName = "benchmark_cache.mdmc";
+		MeshLoadOptions loadOptions;
+		loadOptions.threadCount = options.threadCount;
+		if (!WriteObj(objFileName, vertices, indices) || !MeshCache::Convert(objFileName, cacheFileName, loadOptions))
+		{
+			std::printf("  cannot write the mesh files in the working directory\n");
+			return;
+		}
+		nv_helpers_dx12::ThreadPool threadPool(options.threadCount);
+
+		double textMilliseconds = MeasureMilliseconds(options, [&]()
+		{
+			MeshLoader::Load(objFileName, vertices, indices, loadOptions);
+			nv_helpers_dx12::BottomLevelBVHBuilder builder;
+			builder.AddVertexBuffer(vertices.data(), 0, static_cast<uint32_t>(vertices.size()), sizeof(Vertex),
+				indices.data(), 0, static_cast<uint32_t>(indices.size()));
+			nv_helpers_dx12::BottomLevelBVH bvh;
+			builder.Generate(bvh, nv_helpers_dx12::BVHBuildSettings(), &threadPool);
+		});
+
+		struct Variant
+		{
+			const char* name;
+			bool verifyPayload;
+		};
+		const Variant variants[] =
+		{
+			{ "cache", false },
+			{ "cache, payload verified", true },
+		};
+		std::printf("  %zu triangles, %u threads\n", indices.size() / 3, threadPool.GetThreadCount());
+		std::printf("  %-30s %9.2f ms\n", "OBJ + BVH build", textMilliseconds);
+		std::vector<Vertex> uploadVertices;
+		std::vector<uint32_t> uploadIndices;
+		for (const Variant& variant : variants)
+		{
+			bool opened = true;
+			double milliseconds = MeasureMilliseconds(options, [&]()
+			{
+				MeshCache cache;
+				opened &= cache.Open(cacheFileName, nullptr, variant.verifyPayload);
+				if (opened)
+				{
+					MeshView mesh = cache.GetMesh(0);
+					uploadVertices.assign(mesh.vertices, mesh.vertices + mesh.vertexCount);
+					uploadIndices.assign(mesh.indices, mesh.indices + mesh.indexCount);
+				}
+			});
+			if (!opened)
+			{
+				std::printf("  %-30s cannot open the cache\n", variant.name);
+				continue;
+			}
+			std::printf("  %-30s %9.2f ms  %5.1fx faster\n", variant.name, milliseconds, textMilliseconds / milliseconds);
+		}
+
+		std::remove(objFileName.c_str());
+		std::remove(cacheFileName.c_str());
+	}
+
+	// #DXR Custom: Meshlets
+	// Meshlets cut from the vertex cache order alone, and from the order of OrderTriangles, then
+	// culled for a camera close enough that the frustum and the normal cones both reject meshlets.
+	// The input is Tipsify's order of a mesh laid out ring by ring
+	void RunMeshlets(const BenchmarkOptions& options)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> tipsifyIndices;
+		MakeBumpySphere(options.quick ? 20000 : 1000000, vertices, tipsifyIndices);
+		const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+		const uint32_t indexCount = static_cast<uint32_t>(tipsifyIndices.size());
+		MeshOptimizer::OptimizeVertexCache(tipsifyIndices, vertexCount, 16);
+		MeshletBuildOptions buildOptions;
+		buildOptions.threadCount = options.threadCount;
+
+		std::vector<uint32_t> meshletIndices;
+		double orderMilliseconds = MeasureMilliseconds(options, [&]()
+		{
+			meshletIndices = tipsifyIndices;
+			MeshletBuilder::OrderTriangles(vertices.data(), vertexCount, meshletIndices.data(), indexCount, buildOptions);
+		});
+
+		// Camera on the Z axis looking at the sphere, projection of XMMatrixPerspectiveFovRH with a
+		// 45 degree field of view, in the row vector convention
+		const float distance = 1.8f;
+		const float nearZ = 0.1f;
+		const float yScale = 1.0f / std::tan(0.5f * 3.14159265f / 4.0f);
+		const float zRange = 1000.0f / (nearZ - 1000.0f);
+		XMFLOAT4X4 objectToClip = {};
+		objectToClip.m[0][0] = yScale;
+		objectToClip.m[1][1] = yScale;
+		objectToClip.m[2][2] = zRange;
+		objectToClip.m[2][3] = -1.0f;
+		objectToClip.m[3][2] = (nearZ - distance) * zRange;
+		objectToClip.m[3][3] = distance;
+		const XMFLOAT3 cameraPosition = { 0.0f, 0.0f, distance };
+
+		struct Variant
+		{
+			const char* name;
+			const std::vector<uint32_t>* indices;
+		};
+		const Variant variants[] =
+		{
+			{ "Tipsify order", &tipsifyIndices },
+			{ "meshlet order", &meshletIndices },
+		};
+		std::printf("  %u triangles, OrderTriangles %.2f ms\n", indexCount / 3, orderMilliseconds);
+		for (const Variant& variant : variants)
+		{
+			MeshletData meshlets;
+			MeshletStats stats;
+			double buildMilliseconds = MeasureMilliseconds(options, [&]()
+			{
+				MeshletBuilder::Build(vertices.data(), vertexCount, variant.indices->data(), indexCount, meshlets,
+					buildOptions, &stats);
+			});
+			double radiusSum = 0.0;
+			uint32_t coneCount = 0;
+			for (const MeshletBounds& bounds : meshlets.bounds)
+			{
+				radiusSum += bounds.radius;
+				coneCount += bounds.coneCutoff < 1.0f ? 1 : 0;
+			}
+
+			std::vector<MeshletDrawRange> ranges;
+			uint32_t visibleCount = 0;
+			double cullMilliseconds = MeasureMilliseconds(options, [&]()
+			{
+				visibleCount = MeshletBuilder::Cull(meshlets, objectToClip, cameraPosition, ranges);
+			});
+			uint64_t visibleIndices = 0;
+			for (const MeshletDrawRange& range : ranges)
+			{
+				visibleIndices += range.indexCount;
+			}
+			std::printf("  %-16s build %7.2f ms  %6u meshlets  %5.1f vertices  %5.1f triangles  radius %.4f  %3.0f%% cones"
+				"  cull %6.3f ms  %4.1f%% meshlets / %4.1f%% triangles drawn in %zu ranges\n",
+				variant.name, buildMilliseconds, stats.meshletCount, stats.averageVertexCount, stats.averageTriangleCount,
+				radiusSum / (std::max)(stats.meshletCount, 1u), 100.0 * coneCount / (std::max)(stats.meshletCount, 1u),
+				cullMilliseconds, 100.0 * visibleCount / (std::max)(stats.meshletCount, 1u),
+				100.0 * visibleIndices / indexCount, ranges.size());
+		}
+	}
+
+	// #DXR Custom: Mesh LOD
+	// LOD chains with the sample options (see D3D12HelloTriangle::BuildMeshLods) and with more
+	// levels, and the triangles drawn for a row of instances receding from the camera when each
+	// one uses the coarsest level whose error covers at most one pixel, the rule of
+	// D3D12HelloTriangle::SelectLods
+	void RunLodChain(const BenchmarkOptions& options)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		MakeBumpySphere(options.quick ? 20000 : 1000000, vertices, indices);
+		const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+		const uint32_t indexCount = static_cast<uint32_t>(indices.size());
+		MeshOptimizer::OptimizeVertexCache(indices, vertexCount, 16);
+
+		// 1000 instances of radius 1, 2 to 200 units away, seen at 1080 pixels with a 45 degree
+		// vertical field of view
+		const uint32_t instanceCount = 1000;
+		const float pixelsPerUnit = 0.5f * 1080.0f / std::tan(0.5f * 3.14159265f / 4.0f);
+
+		struct Variant
+		{
+			const char* name;
+			uint32_t maxLevels;
+		};
+		const Variant variants[] =
+		{
+			{ "sample options", LodChainOptions().maxLevels },
+			{ "up to 10 levels", 10 },
+		};
+		for (const Variant& variant : variants)
+		{
+			LodChainOptions chainOptions;
+			chainOptions.maxLevels = variant.maxLevels;
+			std::vector<uint32_t> lodIndices;
+			std::vector<MeshLodLevel> levels;
+			LodChainStats stats;
+			double milliseconds = MeasureMilliseconds(options, [&]()
+			{
+				levels = MeshSimplifier::BuildLodChain(vertices.data(), vertexCount, indices.data(), indexCount,
+					lodIndices, chainOptions, &stats);
+			});
+
+			std::vector<uint32_t> levelUse(levels.size(), 0);
+			uint64_t lodTriangles = 0;
+			for (uint32_t i = 0; i < instanceCount; i++)
+			{
+				float distance = 2.0f + 198.0f * i / (instanceCount - 1) - 1.0f;
+				size_t selected = 0;
+				while (selected + 1 < levels.size() && levels[selected + 1].error * pixelsPerUnit / distance <= 1.0f)
+				{
+					selected++;
+				}
+				levelUse[selected]++;
+				lodTriangles += levels[selected].indexCount / 3;
+			}
+
+			std::printf("  %-16s %u triangles, %zu levels in %.2f ms (%.2f M triangles/s), %u triangles stored\n",
+				variant.name, stats.sourceTriangles, levels.size(), milliseconds,
+				stats.sourceTriangles / (1000.0 * milliseconds), stats.totalTriangles);
+			for (size_t k = 0; k < levels.size(); k++)
+			{
+				std::printf("    level %zu  %8u triangles  %5.1f%%  error %.5f  %4u instances\n", k,
+					levels[k].indexCount / 3, 100.0 * levels[k].indexCount / indexCount, levels[k].error, levelUse[k]);
+			}
+			std::printf("    %u instances 2 to 200 units away draw %.1f%% of the triangles\n", instanceCount,
+				100.0 * lodTriangles / (static_cast<uint64_t>(instanceCount) * (indexCount / 3)));
+		}
+	}
+
+	// #DXR Custom: Instance Culling
+	// Frustum culling of instances spread in every direction around the camera, so that the
+	// 45 degree square frustum sees about 5% of them, with the SSE kernel and the scalar loop
+	void RunInstanceCulling(const BenchmarkOptions& options)
+	{
+		const uint32_t instanceCount = options.quick ? 10000 : 1000000;
+		InstanceCuller culler;
+		culler.Resize(instanceCount);
+		std::mt19937 random(5);
+		std::normal_distribution<float> direction;
+		std::uniform_real_distribution<float> distance(10.0f, 100.0f);
+		const XMFLOAT3 objectMin = { -0.5f, -0.5f, -0.5f };
+		const XMFLOAT3 objectMax = { 0.5f, 0.5f, 0.5f };
+		for (uint32_t i = 0; i < instanceCount; i++)
+		{
+			float x = direction(random);
+			float y = direction(random);
+			float z = direction(random);
+			float scale = distance(random) / (std::max)(std::sqrt(x * x + y * y + z * z), 1e-6f);
+			culler.SetInstanceBounds(i, objectMin, objectMax,
+				XMMatrixRotationY(static_cast<float>(i)) * XMMatrixTranslation(scale * x, scale * y, scale * z));
+		}
+
+		// Camera at the origin looking down -Z, projection of XMMatrixPerspectiveFovRH with a
+		// 45 degree field of view and a square aspect ratio, in the row vector convention
+		const float nearZ = 0.1f;
+		const float yScale = 1.0f / std::tan(0.5f * 3.14159265f / 4.0f);
+		const float zRange = 1000.0f / (nearZ - 1000.0f);
+		XMFLOAT4X4 worldToClip = {};
+		worldToClip.m[0][0] = yScale;
+		worldToClip.m[1][1] = yScale;
+		worldToClip.m[2][2] = zRange;
+		worldToClip.m[2][3] = -1.0f;
+		worldToClip.m[3][2] = nearZ * zRange;
+
+		struct Variant
+		{
+			const char* name;
+			bool simd;
+		};
+		const Variant variants[] =
+		{
+			{ "scalar", false },
+			{ "SSE", true },
+		};
+		double scalarMilliseconds = 0.0;
+		for (const Variant& variant : variants)
+		{
+			InstanceCullOptions cullOptions;
+			cullOptions.simd = variant.simd;
+			std::vector<uint32_t> visible;
+			uint32_t visibleCount = 0;
+			double milliseconds = MeasureMilliseconds(options, [&]()
+			{
+				visibleCount = culler.Cull(worldToClip, visible, cullOptions);
+			});
+			scalarMilliseconds = variant.simd ? scalarMilliseconds : milliseconds;
+			std::printf("  %-8s %u instances  %7.3f ms  %6.2f ns per instance  %4.1f%% visible  %5.2fx\n", variant.name,
+				instanceCount, milliseconds, 1e6 * milliseconds / instanceCount, 100.0 * visibleCount / instanceCount,
+				scalarMilliseconds / milliseconds);
+		}
+	}
+
+	// #DXR Custom: Transform Hierarchy
+	// Update of a hierarchy of 100k nodes, 8 children per node, after a change of the root, which
+	// moves every node, after changes of 1% of the nodes, and without any change
+	void RunTransformHierarchy(const BenchmarkOptions& options)
+	{
+		const uint32_t nodeCount = options.quick ? 5000 : 100000;
+		TransformHierarchy hierarchy;
+		std::mt19937 random(9);
+		std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+		for (uint32_t i = 0; i < nodeCount; i++)
+		{
+			uint32_t parent = (i == 0) ? TransformHierarchy::kNoParent : (i - 1) / 8;
+			hierarchy.AddNode(parent, XMMatrixRotationY(offset(random)) *
+				XMMatrixTranslation(offset(random), offset(random), offset(random)));
+		}
+		hierarchy.Update();
+
+		std::vector<uint32_t> changedNodes(nodeCount / 100);
+		for (uint32_t& node : changedNodes)
+		{
+			node = static_cast<uint32_t>(random() % nodeCount);
+		}
+
+		struct Variant
+		{
+			const char* name;
+			uint32_t threadCount;
+			const std::vector<uint32_t>* changed;	// nullptr moves the root
+		};
+		const std::vector<uint32_t> unchanged;
+		const Variant variants[] =
+		{
+			{ "root moved, 1 thread", 1, nullptr },
+			{ "root moved, all threads", options.threadCount, nullptr },
+			{ "1% moved, 1 thread", 1, &changedNodes },
+			{ "1% moved, all threads", options.threadCount, &changedNodes },
+			{ "nothing moved", options.threadCount, &unchanged },
+		};
+		std::printf("  %u nodes, %u levels\n", hierarchy.GetNodeCount(), hierarchy.GetLevelCount());
+		for (const Variant& variant : variants)
+		{
+			TransformUpdateOptions updateOptions;
+			updateOptions.threadCount = variant.threadCount;
+			TransformUpdateStats stats;
+			float angle = 0.0f;
+			double milliseconds = MeasureMilliseconds(options, [&]()
+			{
+				angle += 0.01f;
+				if (!variant.changed)
+				{
+					hierarchy.SetLocalTransform(0, XMMatrixRotationY(angle));
+				}
+				else
+				{
+					for (uint32_t node : *variant.changed)
+					{
+						hierarchy.SetLocalTransform(node, XMMatrixRotationY(angle) * XMMatrixTranslation(0.0f, 1.0f, 0.0f));
+					}
+				}
+				hierarchy.Update(updateOptions, &stats);
+			});
+			std::printf("  %-24s %8.3f ms  %6u nodes updated  %u of %u levels skipped  %u threads\n", variant.name,
+				milliseconds, stats.updatedNodeCount, stats.skippedLevelCount, stats.levelCount, stats.threadCount);
+		}
+	}
+
+	// #DXR Custom: Shader Cache
+	// Shader startup from a cold cache and from a warm one, for libraries laid out as those of the
+	// sample: a few entry files sharing a tree of headers. The stub compiler only copies the
+	// sources, so the cold figures leave out the cost of DXC and only show what the cache adds
+	class StubShaderCompiler : public ShaderCompiler
+	{
+	public:
+		std::string GetVersion() const override { return "benchmark stub"; }
+
+		bool Compile(const ShaderCompileRequest& request, std::vector<uint8_t>& bytecode, std::string& /*errors*/) override
+		{
+			std::ifstream file(request.fileName, std::ios::binary);
+			bytecode.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+			bytecode.resize(64 * 1024, 0);
+			return true;
+		}
+	};
+
+	void RunShaderCache(const BenchmarkOptions& options)
+	{
+		const uint32_t libraryCount = options.quick ? 2 : 8;
+		const uint32_t headerCount = 6;
+		const std::string directory = "benchmark_shader_cache";
+
+		// Each header includes the next one, and each library includes the first header
+		std::vector<std::string> fileNames;
+		for (uint32_t i = 0; i < headerCount + libraryCount; i++)
+		{
+			bool isHeader = i < headerCount;
+			std::string fileName = "benchmark_shader" + std::to_string(i) + (isHeader ? ".hlsli" : ".hlsl");
+			std::ofstream file(fileName, std::ios::binary);
+			if (isHeader && i + 1 < headerCount)
+			{
+				file << "#include \"benchmark_shader" << i + 1 << ".hlsli\"\n";
+			}
+			else if (!isHeader)
+			{
+				file << "#include \"benchmark_shader0.hlsli\"\n";
+			}
+			for (uint32_t line = 0; line < 400; line++)
+			{
+				file << "float Function" << i << "_" << line << "(float3 p) { return dot(p, float3(" << line << ", 1, 2)); }\n";
+			}
+			fileNames.push_back(fileName);
+		}
+		std::vector<ShaderCompileRequest> requests(libraryCount);
+		for (uint32_t i = 0; i < libraryCount; i++)
+		{
+			requests[i].fileName = fileNames[headerCount + i];
+			requests[i].targetProfile = "lib_6_3";
+			requests[i].arguments = { "-O3" };
+		}
+
+		StubShaderCompiler compiler;
+		{
+			ShaderCache cache(compiler, directory);
+			for (const ShaderCompileRequest& request : requests)
+			{
+				std::remove(cache.GetEntryFileName(cache.ComputeKey(request)).c_str());
+			}
+			cache.ResetStats();
+			auto start = std::chrono::steady_clock::now();
+			for (const ShaderCompileRequest& request : requests)
+			{
+				cache.Get(request);
+			}
+			double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			ShaderCacheStats stats = cache.GetStats();
+			std::printf("  %u libraries of %u files, cold cache %7.3f ms: keys %.3f ms, stub compiler %.3f ms, writes %.3f ms,"
+				" %u misses\n", libraryCount, headerCount + 1, milliseconds, stats.keyMilliseconds,
+				stats.compileMilliseconds, stats.writeMilliseconds, stats.missCount);
+		}
+
+		// A new cache for each run, as at the launch of the sample
+		ShaderCacheStats stats;
+		double warmMilliseconds = MeasureMilliseconds(options, [&]()
+		{
+			ShaderCache cache(compiler, directory);
+			for (const ShaderCompileRequest& request : requests)
+			{
+				cache.Get(request);
+			}
+			stats = cache.GetStats();
+		});
+		std::printf("  %u libraries of %u files, warm cache %7.3f ms: keys %.3f ms, mapping and checks %.3f ms, %u hits\n",
+			libraryCount, headerCount + 1, warmMilliseconds, stats.keyMilliseconds, stats.loadMilliseconds, stats.hitCount);
+
+		ShaderCache cache(compiler, directory);
+		for (const ShaderCompileRequest& request : requests)
+		{
+			std::remove(cache.GetEntryFileName(cache.ComputeKey(request)).c_str());
+		}
+		for (const std::string& fileName : fileNames)
+		{
+			std::remove(fileName.c_str());
+		}
+		// Removes the empty directory on POSIX systems only
+		std::remove(directory.c_str());
+	}
+
+	// #DXR Custom: Frames In Flight
+	// Scheduling of the frame-context ring against a simulated GPU running a fixed number of frames
+	// behind the CPU, each frame deferring the release of a resource as the sample does when it
+	// replaces a buffer. The figures show which depths let the CPU run ahead without waiting, and
+	// the cost of the ring itself per frame
+	void RunFrameRing(const BenchmarkOptions& options)
+	{
+		const uint32_t frameCount = options.quick ? 1000 : 100000;
+		struct Variant
+		{
+			uint32_t depth;
+			uint32_t latency;
+		};
+		const Variant variants[] =
+		{
+			{ 1, 0 }, { 1, 1 }, { 2, 1 }, { 2, 2 }, { 3, 2 }, { 3, 3 },
+		};
+		for (const Variant& variant : variants)
+		{
+			nv_helpers_dx12::FrameRingStats stats;
+			uint32_t releasedCount = 0;
+			double milliseconds = MeasureMilliseconds(options, [&]()
+			{
+				nv_helpers_dx12::SoftwareFence fence(variant.latency);
+				nv_helpers_dx12::FrameContextRing ring(fence, variant.depth);
+				for (uint32_t frame = 0; frame < frameCount; frame++)
+				{
+					ring.BeginFrame();
+					std::shared_ptr<uint32_t> resource = std::make_shared<uint32_t>(frame);
+					ring.DeferRelease([resource, &releasedCount]() { releasedCount++; });
+					ring.EndFrame();
+				}
+				stats = ring.GetStats();
+				ring.WaitForIdle();
+			});
+			std::printf("  %u contexts, GPU %u frames behind  %6u frames  %6.1f ns per frame  %5.1f%% frames waiting"
+				"  %u releases pending\n", variant.depth, variant.latency, frameCount, 1e6 * milliseconds / frameCount,
+				100.0 * stats.blockingWaits / frameCount, stats.pendingReleases);
+		}
+	}
+
+	const BenchmarkCase kCases[] =
+	{
+		{ "bvh", "CPU BVH build, binned SAH and LBVH (BottomLevelBVHBuilder)", RunBvhBuild },
+		{ "packets", "CPU reference render, single rays and ray packets (CpuRaytracer)", RunRayPackets },
+		{ "loader", "OBJ and PLY loading, and float parsing (MeshLoader)", RunMeshLoader },
+		{ "cache", "Mesh startup from a cache against the OBJ file (MeshCache)", RunMeshCache },
+		{ "meshlets", "Meshlet build and culling, with and without OrderTriangles (MeshletBuilder)", RunMeshlets },
+		{ "lod", "LOD chain simplification and triangles drawn with distance selection (MeshSimplifier)", RunLodChain },
+		{ "culling", "Instance frustum culling, scalar and SSE (InstanceCuller)", RunInstanceCulling },
+		{ "hierarchy", "Transform hierarchy update, full and partial (TransformHierarchy)", RunTransformHierarchy },
+		{ "shaders", "Shader startup from a cold and a warm cache, with a stub compiler (ShaderCache)", RunShaderCache },
+		{ "frames", "Frames in flight against a simulated GPU latency (FrameContextRing)", RunFrameRing },
+	};
+
+	void PrintUsage()
+	{
+		std::fprintf(stderr, "Usage: Benchmark [--quick] [--threads N] [--repeat N] [case...]\nCases:\n");
+		for (const BenchmarkCase& benchmarkCase : kCases)
+		{
+			std::fprintf(stderr, "  %-12s %s\n", benchmarkCase.name, benchmarkCase.description);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkOptions options;
+	std::vector<const BenchmarkCase*> selected;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+		if (argument == "--quick")
+		{
+			options.quick = true;
+			options.repeatCount = 1;
+		}
+		else if (argument == "--threads" && i + 1 < argc)
+		{
+			options.threadCount = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (argument == "--repeat" && i + 1 < argc)
+		{
+			options.repeatCount = (std::max)(1u, static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)));
+		}
+		else
+		{
+			auto found = std::find_if(std::begin(kCases), std::end(kCases),
+				[&](const BenchmarkCase& benchmarkCase) { return argument == benchmarkCase.name; });
+			if (found == std::end(kCases))
+			{
+				PrintUsage();
+				return 2;
+			}
+			selected.push_back(found);
+		}
+	}
+	if (selected.empty())
+	{
+		for (const BenchmarkCase& benchmarkCase : kCases)
+		{
+			selected.push_back(&benchmarkCase);
+		}
+	}
+
+	for (const BenchmarkCase* benchmarkCase : selected)
+	{
+		std::printf("%s: %s\n", benchmarkCase->name, benchmarkCase->description);
+		benchmarkCase->run(options);
+	}
+	return 0;
+}
@@ -0,0 +1,218 @@
+// #DXR Custom: CPU Reference Renderer
+// Command line driver of CpuRaytracer, built by the host build (see CMakeLists.txt) without any
+// D3D12 or Win32 dependency. It builds the scene of the sample, renders it and optionally
+// compares the result with a stored image, so that a change of the shading or of the traversal
+// is caught without a GPU:
+//
+//   CpuReference [--width 160] [--height 120] [--mesh file.obj] [--threads 0] [--tile-size 0]
+//                [--kernel auto|scalar|sse|avx2] [--output image.ppm]
+//                [--compare reference.ppm [--tolerance 2] [--max-mismatch 0.001] [--update]]
+//
+// The scene is the one of SampleScene.h. The skybox is not loaded, the miss shaders use SKY_COL.
+//
+// Exit codes: 0 on success, 1 if the image differs from the reference, 2 on any other error.
+
+#include "SampleScene.h"
+
+#include "CpuRaytracer.h"
+#include "MeshDataUtility.h"
+#include "MeshLoader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct Arguments
+	{
+		uint32_t width = 160;
+		uint32_t height = 120;
+		std::string meshPath;
+		std::string outputPath;
+		std::string comparePath;
+		uint32_t tolerance = 2;				// Largest channel difference of a matching pixel
+		double maxMismatch = 0.001;			// Largest fraction of pixels which do not match
+		bool update = false;				// Write the reference instead of comparing with it
+		CpuRenderOptions options;
+	};
+
+	void PrintUsage()
+	{
+		std::fprintf(stderr, "Usage: CpuReference [--width N] [--height N] [--mesh file] [--threads N] [--tile-size N]\n"
+			"                    [--kernel auto|scalar|sse|avx2] [--output image.ppm]\n"
+			"                    [--compare reference.ppm [--tolerance N] [--max-mismatch F] [--update]]\n");
+	}
+
+	bool ParseArguments(int argc, char** argv, Arguments& arguments)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			std::string name = argv[i];
+			if (name == "--update")
+			{
+				arguments.update = true;
+				continue;
+			}
+			if (i + 1 >= argc)
+			{
+				return false;
+			}
+			std::string value = argv[++i];
+			if (name == "--width")
+				arguments.width = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+			else if (name == "--height")
+				arguments.height = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+			else if (name == "--mesh")
+				arguments.meshPath = value;
+			else if (name == "--threads")
+				arguments.options.threadCount = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+			else if (name == "--tile-size")
+				arguments.options.tileSize = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+			else if (name == "--output")
+				arguments.outputPath = value;
+			else if (name == "--compare")
+				arguments.comparePath = value;
+			else if (name == "--tolerance")
+				arguments.tolerance = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+			else if (name == "--max-mismatch")
+				arguments.maxMismatch = std::strtod(value.c_str(), nullptr);
+			else if (name == "--kernel")
+			{
+				if (value == "auto")
+					arguments.options.kernel = CpuTraversal::Kernel::Auto;
+				else if (value == "scalar")
+					arguments.options.kernel = CpuTraversal::Kernel::Scalar;
+				else if (value == "sse")
+					arguments.options.kernel = CpuTraversal::Kernel::SSE;
+				else if (value == "avx2")
+					arguments.options.kernel = CpuTraversal::Kernel::AVX2;
+				else
+					return false;
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return arguments.width > 0 && arguments.height > 0 && (!arguments.update || !arguments.comparePath.empty());
+	}
+
+	/// Number of pixels with a channel differing by more than the tolerance, and largest difference
+	uint64_t CountMismatches(const std::vector<uint8_t>& image, const std::vector<uint8_t>& reference,
+		uint32_t tolerance, uint32_t& maxDifference)
+	{
+		uint64_t mismatchCount = 0;
+		maxDifference = 0;
+		for (size_t pixel = 0; pixel < image.size(); pixel += 4)
+		{
+			bool mismatch = false;
+			for (size_t channel = 0; channel < 3; channel++)
+			{
+				uint32_t difference = static_cast<uint32_t>(std::abs(image[pixel + channel] - reference[pixel + channel]));
+				maxDifference = (std::max)(maxDifference, difference);
+				mismatch |= difference > tolerance;
+			}
+			mismatchCount += mismatch ? 1 : 0;
+		}
+		return mismatchCount;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Arguments arguments;
+	if (!ParseArguments(argc, argv, arguments))
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	std::vector<Vertex> meshVertices = MeshDataUtility::TetrahedronVertices;
+	std::vector<uint32_t> meshIndices = MeshDataUtility::TetrahedronIndices;
+	if (!arguments.meshPath.empty())
+	{
+		// Same options as D3D12HelloTriangle::GetMeshLoadOptions
+		MeshLoadOptions loadOptions;
+		loadOptions.normalizedSize = 2.0f;
+		loadOptions.optimize = true;
+		try
+		{
+			MeshLoader::Load(arguments.meshPath, meshVertices, meshIndices, loadOptions);
+		}
+		catch (const std::runtime_error& error)
+		{
+			std::fprintf(stderr, "CpuReference: %s\n", error.what());
+			return 2;
+		}
+		if (meshIndices.empty())
+		{
+			std::fprintf(stderr, "CpuReference: no triangle in %s\n", arguments.meshPath.c_str());
+			return 2;
+		}
+	}
+
+	CpuScene scene;
+	BuildSampleScene(meshVertices, meshIndices, scene);
+	CpuRaytracer raytracer;
+	raytracer.SetScene(scene);
+
+	std::vector<uint8_t> image;
+	raytracer.Render(MakeSampleCamera(arguments.width, arguments.height), arguments.width, arguments.height, image,
+		arguments.options);
+	const CpuRenderStats& stats = raytracer.GetStats();
+	std::printf("CpuReference: %ux%u in %.2f ms, %u threads, %ux%u tiles, %s kernel, %llu primary / %llu reflection / %llu shadow rays\n",
+		arguments.width, arguments.height, stats.renderMilliseconds, stats.threadCount, stats.tileSize, stats.tileSize,
+		CpuTraversal::GetKernelName(stats.kernel), static_cast<unsigned long long>(stats.primaryRays),
+		static_cast<unsigned long long>(stats.reflectionRays), static_cast<unsigned long long>(stats.shadowRays));
+
+	if (!arguments.outputPath.empty() &&
+		!CpuRaytracer::WritePPM(arguments.outputPath, arguments.width, arguments.height, image))
+	{
+		std::fprintf(stderr, "CpuReference: cannot write %s\n", arguments.outputPath.c_str());
+		return 2;
+	}
+	if (arguments.comparePath.empty())
+	{
+		return 0;
+	}
+	if (arguments.update)
+	{
+		if (!CpuRaytracer::WritePPM(arguments.comparePath, arguments.width, arguments.height, image))
+		{
+			std::fprintf(stderr, "CpuReference: cannot write %s\n", arguments.comparePath.c_str());
+			return 2;
+		}
+		std::printf("CpuReference: updated %s\n", arguments.comparePath.c_str());
+		return 0;
+	}
+
+	uint32_t referenceWidth = 0;
+	uint32_t referenceHeight = 0;
+	std::vector<uint8_t> reference;
+	if (!CpuRaytracer::ReadPPM(arguments.comparePath, referenceWidth, referenceHeight, reference))
+	{
+		std::fprintf(stderr, "CpuReference: cannot read %s\n", arguments.comparePath.c_str());
+		return 2;
+	}
+	if (referenceWidth != arguments.width || referenceHeight != arguments.height)
+	{
+		std::fprintf(stderr, "CpuReference: %s is %ux%u, the image is %ux%u\n", arguments.comparePath.c_str(),
+			referenceWidth, referenceHeight, arguments.width, arguments.height);
+		return 1;
+	}
+
+	// The packet kernels round differently from the scalar one, hence the tolerance
+	uint32_t maxDifference = 0;
+	uint64_t mismatchCount = CountMismatches(image, reference, arguments.tolerance, maxDifference);
+	double mismatchFraction = static_cast<double>(mismatchCount) / (static_cast<double>(arguments.width) * arguments.height);
+	bool match = mismatchFraction <= arguments.maxMismatch;
+	std::printf("CpuReference: %s %s, %llu pixels differ by more than %u (%.4f%%), largest difference %u\n",
+		match ? "matches" : "DIFFERS FROM", arguments.comparePath.c_str(), static_cast<unsigned long long>(mismatchCount),
+		arguments.tolerance, 100.0 * mismatchFraction, maxDifference);
+	return match ? 0 : 1;
+}
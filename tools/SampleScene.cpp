@@ -0,0 +1,104 @@
+#include "SampleScene.h"
+
+#include "MeshDataUtility.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Fixed sequence in [0, 1), identical on every platform unlike the standard distributions
+	float NextRandom(uint32_t& state)
+	{
+		state = state * 1664525u + 1013904223u;
+		return static_cast<float>(state >> 8) / 16777216.0f;
+	}
+
+	// Column-vector matrix, whose memory layout is the one of the equivalent XMMATRIX
+	glm::mat4 InstanceTransform(float angleDegrees, float x, float z)
+	{
+		glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z));
+		transform = glm::rotate(transform, glm::radians(angleDegrees), glm::vec3(0.0f, 1.0f, 0.0f));
+		return glm::scale(transform, glm::vec3(0.5f));
+	}
+
+	CpuMesh MakeMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+	{
+		CpuMesh mesh;
+		mesh.vertexData = reinterpret_cast<const uint8_t*>(vertices.data());
+		mesh.vertexCount = static_cast<uint32_t>(vertices.size());
+		mesh.vertexStrideInBytes = sizeof(Vertex);
+		mesh.indexData = indices.data();
+		mesh.indexCount = static_cast<uint32_t>(indices.size());
+		return mesh;
+	}
+}
+
+// Same instances as CreateAccelerationStructures: the tetrahedrons first, the plane last
+void BuildSampleScene(const std::vector<Vertex>& meshVertices, const std::vector<uint32_t>& meshIndices, CpuScene& scene)
+{
+	scene.meshes.push_back(MakeMesh(meshVertices, meshIndices));
+	scene.meshes.push_back(MakeMesh(MeshDataUtility::PlaneVertices, MeshDataUtility::PlaneIndices));
+
+	std::vector<glm::mat4> transforms =
+	{
+		glm::scale(glm::mat4(1.0f), glm::vec3(0.5f)),
+		InstanceTransform(135.0f, 1.0f, -1.0f),
+		InstanceTransform(-135.0f, -1.0f, -1.0f),
+		InstanceTransform(45.0f, 1.0f, 1.0f),
+		InstanceTransform(-45.0f, -1.0f, 1.0f),
+		InstanceTransform(-45.0f, -2.0f, -2.0f),
+		InstanceTransform(-45.0f, -2.0f, 2.0f),
+		InstanceTransform(-45.0f, 2.0f, 2.0f),
+		InstanceTransform(-45.0f, 2.0f, -2.0f),
+		glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.8f, 0.0f)), glm::vec3(1000.0f))
+	};
+
+	// Same material model as CreateMaterialTable, half of the tetrahedrons being metallic
+	uint32_t state = 1;
+	scene.instances.resize(transforms.size());
+	for (size_t i = 0; i < transforms.size(); i++)
+	{
+		CpuInstance& instance = scene.instances[i];
+		bool isPlane = (i == transforms.size() - 1);
+		instance.meshIndex = isPlane ? 1 : 0;
+		memcpy(instance.objectToWorld, glm::value_ptr(transforms[i]), sizeof(instance.objectToWorld));
+		if (isPlane)
+		{
+			instance.material.albedo = glm::vec3(0.8f);
+			instance.material.specular = glm::vec3(0.04f);
+			continue;
+		}
+		bool isMetal = NextRandom(state) > 0.5f;
+		glm::vec3 color(NextRandom(state), NextRandom(state), NextRandom(state));
+		instance.material.albedo = isMetal ? glm::vec3(0.0f) : color;
+		instance.material.specular = isMetal ? color : glm::vec3(0.04f);
+	}
+}
+
+// Same matrices as UpdateCameraBuffer for the camera set in OnInit
+CpuCamera MakeSampleCamera(uint32_t width, uint32_t height)
+{
+	glm::mat4 view = glm::lookAt(glm::vec3(1.5f, 1.5f, 1.5f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	// XMMatrixPerspectiveFovRH, whose memory layout is the equivalent column-vector matrix
+	const float nearZ = 0.1f;
+	const float farZ = 1000.0f;
+	float aspectRatio = static_cast<float>(width) / static_cast<float>(height);
+	float yScale = 1.0f / std::tan(0.5f * glm::radians(45.0f));
+	float zRange = farZ / (nearZ - farZ);
+	glm::mat4 projection(0.0f);
+	projection[0][0] = yScale / aspectRatio;
+	projection[1][1] = yScale;
+	projection[2][2] = zRange;
+	projection[2][3] = -1.0f;
+	projection[3][2] = zRange * nearZ;
+
+	CpuCamera camera;
+	camera.viewInverse = glm::inverse(view);
+	camera.projectionInverse = glm::inverse(projection);
+	return camera;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+// #DXR Custom: Host Build
+// Scene of the sample as seen by the CPU reference renderer, shared by the host tools. It mirrors
+// D3D12HelloTriangle::CreateAccelerationStructures and the default camera of OnInit, and must be
+// kept in sync with them. The materials of the application are random, the ones used here come
+// from a fixed sequence so that the rendered image is reproducible.
+
+#include "CpuRaytracer.h"
+#include "VertexTypes.h"
+
+#include <cstdint>
+#include <vector>
+
+/// <summary>
+/// The instances of the sample: tetrahedrons using the given mesh, and the plane. The mesh data
+/// is referenced by the scene and must outlive it
+/// </summary>
+void BuildSampleScene(const std::vector<Vertex>& meshVertices, const std::vector<uint32_t>& meshIndices, CpuScene& scene);
+
+/// <summary>
+/// Camera of the sample for an image of the given size
+/// </summary>
+CpuCamera MakeSampleCamera(uint32_t width, uint32_t height);